@@ -0,0 +1,253 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Throughput of every distance kernel: L2 and cosine for each value type, ISA variant and
+// dimension, one pair per call and one query against a batch per call, over a working set that
+// fits the L1/L2 cache and over one that has to come from memory. One CSV or JSON line per run.
+
+#include "Utils/DistanceUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+template <typename T>
+using SingleFunc = float (*)(const T*, const T*, DimensionType);
+
+template <typename T>
+using BatchFunc = void (*)(const T*, const void* const*, int, DimensionType, float*);
+
+struct BenchConfig {
+    std::vector<int> dims = {96, 100, 128, 256, 768, 1024};
+    std::vector<std::string> types;    // empty for all
+    std::vector<std::string> isas;     // empty for all the CPU has
+    std::vector<std::string> metrics;  // empty for both
+    int batch = 16;
+    double minMs = 200;
+    int repeats = 3;
+    std::size_t cacheBytes = 32 << 10;
+    std::size_t memoryBytes = (std::size_t)256 << 20;
+    bool json = false;
+};
+
+// one kernel under test, batch is null where the variant has no batched form
+template <typename T>
+struct Kernel {
+    const char* metric;
+    const char* isa;
+    SingleFunc<T> single;
+    BatchFunc<T> batch;
+};
+
+// the same ISA checks DistanceCalcSelector makes, so every variant listed can run here
+template <typename T>
+std::vector<Kernel<T>> Kernels() {
+    bool isSize4 = sizeof(T) == 4;
+    bool canSSE = InstructionSet::SSE2() || (isSize4 && InstructionSet::SSE());
+    bool canAVX = InstructionSet::AVX2() || (isSize4 && InstructionSet::AVX());
+    if (std::is_same<T, Float16>::value)
+        canAVX = canAVX && InstructionSet::F16C();
+    std::vector<Kernel<T>> kernels = {
+        {"l2", "naive", &DistanceUtils::ComputeL2Distance<T>, &DistanceUtils::ComputeL2DistanceBatch<T>},
+        {"cosine", "naive", &DistanceUtils::ComputeCosineDistance<T>, &DistanceUtils::ComputeCosineDistanceBatch<T>},
+    };
+    if (canSSE) {
+        kernels.push_back({"l2", "sse", &DistanceUtils::ComputeL2Distance_SSE, &DistanceUtils::ComputeL2DistanceBatch_SSE});
+        kernels.push_back({"cosine", "sse", &DistanceUtils::ComputeCosineDistance_SSE, &DistanceUtils::ComputeCosineDistanceBatch_SSE});
+    }
+    if (canAVX) {
+        kernels.push_back({"l2", "avx", &DistanceUtils::ComputeL2Distance_AVX, &DistanceUtils::ComputeL2DistanceBatch_AVX});
+        kernels.push_back({"cosine", "avx", &DistanceUtils::ComputeCosineDistance_AVX, &DistanceUtils::ComputeCosineDistanceBatch_AVX});
+    }
+    if (InstructionSet::AVX512()) {
+        kernels.push_back({"l2", "avx512", &DistanceUtils::ComputeL2Distance_AVX512, &DistanceUtils::ComputeL2DistanceBatch_AVX512});
+        kernels.push_back({"cosine", "avx512", &DistanceUtils::ComputeCosineDistance_AVX512, &DistanceUtils::ComputeCosineDistanceBatch_AVX512});
+    }
+    if constexpr (std::is_same<T, BFloat16>::value) {
+        if (InstructionSet::AVX512BF16())
+            kernels.push_back({"cosine", "avx512bf16", &DistanceUtils::ComputeCosineDistance_AVX512BF16, nullptr});
+    }
+    return kernels;
+}
+
+static bool Selected(const std::vector<std::string>& p_filter, const std::string& p_name) {
+    return p_filter.empty() || std::find(p_filter.begin(), p_filter.end(), p_name) != p_filter.end();
+}
+
+static std::vector<std::string> SplitList(const std::string& p_list) {
+    std::vector<std::string> items;
+    std::stringstream stream(p_list);
+    std::string item;
+    while (std::getline(stream, item, ','))
+        if (!item.empty())
+            items.push_back(item);
+    return items;
+}
+
+template <typename T>
+T RandomValue(std::mt19937& p_rng) {
+    if constexpr (std::is_same<T, std::int8_t>::value || std::is_same<T, std::int16_t>::value)
+        return (T)std::uniform_int_distribution<int>(-127, 127)(p_rng);
+    else if constexpr (std::is_same<T, std::uint8_t>::value)
+        return (T)std::uniform_int_distribution<int>(0, 255)(p_rng);
+    else
+        return T(std::uniform_real_distribution<float>(-1.0f, 1.0f)(p_rng));
+}
+
+static volatile float g_sink;
+
+// best of p_config.repeats rounds, each running whole passes over the working set for at least
+// minMs / repeats. Returns nanoseconds per distance
+template <typename T>
+double Measure(const BenchConfig& p_config, const T* p_query, const std::vector<const void*>& p_vectors, DimensionType p_dim, SingleFunc<T> p_single, BatchFunc<T> p_batch) {
+    std::vector<float> dists(p_config.batch);
+    float sum = 0;
+    auto pass = [&] {
+        if (p_batch == nullptr) {
+            for (const void* vector : p_vectors) sum += p_single(p_query, (const T*)vector, p_dim);
+            return;
+        }
+        for (std::size_t i = 0; i < p_vectors.size(); i += p_config.batch) {
+            int count = (int)(std::min)((std::size_t)p_config.batch, p_vectors.size() - i);
+            p_batch(p_query, p_vectors.data() + i, count, p_dim, dists.data());
+            sum += dists[0];
+        }
+    };
+    pass();
+    double best = 0;
+    for (int round = 0; round < p_config.repeats; round++) {
+        std::uint64_t distances = 0;
+        auto begin = std::chrono::steady_clock::now();
+        double elapsedNs = 0;
+        do {
+            pass();
+            distances += p_vectors.size();
+            elapsedNs = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+        } while (elapsedNs < p_config.minMs * 1e6 / p_config.repeats);
+        double perDistance = elapsedNs / distances;
+        if (round == 0 || perDistance < best)
+            best = perDistance;
+    }
+    g_sink = sum;
+    return best;
+}
+
+static void Report(const BenchConfig& p_config, const char* p_type, const char* p_metric, const char* p_isa, const char* p_mode, int p_dim, const char* p_set, std::size_t p_bytes, std::size_t p_vectorBytes, double p_ns) {
+    double gbPerS = p_vectorBytes / p_ns;
+    if (p_config.json) {
+        std::cout << "{\"type\":\"" << p_type << "\",\"metric\":\"" << p_metric << "\",\"isa\":\"" << p_isa << "\",\"mode\":\"" << p_mode << "\",\"dim\":" << p_dim << ",\"working_set\":\"" << p_set
+                  << "\",\"working_set_bytes\":" << p_bytes << ",\"ns_per_distance\":" << p_ns << ",\"mdist_per_s\":" << 1e3 / p_ns << ",\"gb_per_s\":" << gbPerS << "}" << std::endl;
+    } else {
+        std::cout << p_type << "," << p_metric << "," << p_isa << "," << p_mode << "," << p_dim << "," << p_set << "," << p_bytes << "," << p_ns << "," << 1e3 / p_ns << "," << gbPerS << std::endl;
+    }
+}
+
+template <typename T>
+void RunType(const BenchConfig& p_config, const char* p_type) {
+    if (!Selected(p_config.types, p_type))
+        return;
+    std::vector<Kernel<T>> kernels = Kernels<T>();
+    std::mt19937 rng(7);
+    for (int dim : p_config.dims) {
+        std::size_t vectorBytes = sizeof(T) * dim;
+        // vectors packed back to back like a posting list, so odd dimensions give unaligned rows
+        std::size_t total = (std::max)(p_config.memoryBytes / vectorBytes, (std::size_t)p_config.batch);
+        std::vector<T> data(total * dim), query(dim);
+        for (auto& value : data) value = RandomValue<T>(rng);
+        for (auto& value : query) value = RandomValue<T>(rng);
+
+        struct WorkingSet {
+            const char* name;
+            std::size_t count;
+        };
+        WorkingSet sets[] = {
+            {"cache", (std::min)(total, (std::max)(p_config.cacheBytes / vectorBytes, (std::size_t)p_config.batch))},
+            {"memory", total},
+        };
+        for (auto& set : sets) {
+            // visited in random order as a graph search does, so the prefetcher cannot hide misses
+            std::vector<const void*> vectors(set.count);
+            for (std::size_t i = 0; i < set.count; i++) vectors[i] = data.data() + i * dim;
+            std::shuffle(vectors.begin(), vectors.end(), rng);
+            for (auto& kernel : kernels) {
+                if (!Selected(p_config.metrics, kernel.metric) || !Selected(p_config.isas, kernel.isa))
+                    continue;
+                double ns = Measure<T>(p_config, query.data(), vectors, dim, kernel.single, nullptr);
+                Report(p_config, p_type, kernel.metric, kernel.isa, "single", dim, set.name, set.count * vectorBytes, vectorBytes, ns);
+                if (kernel.batch == nullptr)
+                    continue;
+                ns = Measure<T>(p_config, query.data(), vectors, dim, kernel.single, kernel.batch);
+                Report(p_config, p_type, kernel.metric, kernel.isa, "batch", dim, set.name, set.count * vectorBytes, vectorBytes, ns);
+            }
+        }
+    }
+}
+
+static void Usage() {
+    std::cerr << "Usage: bench_distance [options]\n"
+              << "  --dims 96,100,128,256,768,1024   dimensions\n"
+              << "  --types int8,uint8,int16,float,float16,bfloat16\n"
+              << "  --isa naive,sse,avx,avx512,avx512bf16\n"
+              << "  --metrics l2,cosine\n"
+              << "  --batch 16       vectors per batched call\n"
+              << "  --min-ms 200     time per kernel, mode and working set\n"
+              << "  --repeats 3      rounds, the fastest is reported\n"
+              << "  --cache-kb 32    in-cache working set\n"
+              << "  --memory-mb 256  out-of-cache working set\n"
+              << "  --json           JSON lines instead of CSV" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--dims" && i + 1 < argc) {
+            config.dims.clear();
+            for (auto& dim : SplitList(argv[++i])) config.dims.push_back(std::stoi(dim));
+        } else if (arg == "--types" && i + 1 < argc) {
+            config.types = SplitList(argv[++i]);
+        } else if (arg == "--isa" && i + 1 < argc) {
+            config.isas = SplitList(argv[++i]);
+        } else if (arg == "--metrics" && i + 1 < argc) {
+            config.metrics = SplitList(argv[++i]);
+        } else if (arg == "--batch" && i + 1 < argc) {
+            config.batch = (std::max)(1, std::stoi(argv[++i]));
+        } else if (arg == "--min-ms" && i + 1 < argc) {
+            config.minMs = std::stod(argv[++i]);
+        } else if (arg == "--repeats" && i + 1 < argc) {
+            config.repeats = (std::max)(1, std::stoi(argv[++i]));
+        } else if (arg == "--cache-kb" && i + 1 < argc) {
+            config.cacheBytes = std::stoull(argv[++i]) << 10;
+        } else if (arg == "--memory-mb" && i + 1 < argc) {
+            config.memoryBytes = std::stoull(argv[++i]) << 20;
+        } else if (arg == "--json") {
+            config.json = true;
+        } else {
+            Usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::cerr << "CPU: sse2 " << InstructionSet::SSE2() << ", avx2 " << InstructionSet::AVX2() << ", f16c " << InstructionSet::F16C() << ", avx512 " << InstructionSet::AVX512()
+              << ", avx512bf16 " << InstructionSet::AVX512BF16() << std::endl;
+    if (!config.json)
+        std::cout << "type,metric,isa,mode,dim,working_set,working_set_bytes,ns_per_distance,mdist_per_s,gb_per_s" << std::endl;
+
+    RunType<std::int8_t>(config, "int8");
+    RunType<std::uint8_t>(config, "uint8");
+    RunType<std::int16_t>(config, "int16");
+    RunType<float>(config, "float");
+    RunType<Float16>(config, "float16");
+    RunType<BFloat16>(config, "bfloat16");
+    return 0;
+}
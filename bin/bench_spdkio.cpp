@@ -0,0 +1,412 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Drives SPDKIO directly, without an index on top, so storage changes can be measured in
+// isolation: postings of a configurable size distribution are loaded, then threads run a
+// Get/MultiGet/Put/Merge mix for a fixed time. Reports throughput and latency percentiles per
+// operation, device pages and commands, mean commands in flight, and CPU time per I/O.
+
+#include "Core/SPANN/ExtraSPDKController.h"
+#include "Core/SPANN/ExtraUringController.h"
+#include "Core/SPANN/StageLatency.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+enum Op { OpGet, OpMultiGet, OpPut, OpMerge, OpCount };
+static const char* const c_opNames[OpCount] = {"get", "multiget", "put", "merge"};
+
+struct BenchConfig {
+    std::string backend = "spdk";  // spdk: the bdev of SPFRESH_SPDK_CONF/SPFRESH_SPDK_BDEV, uring: --file
+    std::string file;
+    std::string mapping = "bench_spdkio_mapping";
+    std::string sizes = "lognormal:8192:1.0";
+    double mix[OpCount] = {70, 20, 5, 5};
+    int threads = 8;
+    int keys = 100000;
+    int postingBlocks = 64;
+    int batchSize = 64;
+    int ioDepth = 0;  // 0 keeps SPFRESH_SPDK_IO_DEPTH or the uring default
+    int multiGetKeys = 8;
+    int mergeBytes = 512;
+    double seconds = 10;
+    AddressType maxBlocks = 0;
+    bool json = false;
+};
+
+// posting sizes in bytes: fixed:B, uniform:MIN:MAX or lognormal:MEDIAN:SIGMA, clamped to what a
+// posting of postingBlocks pages holds
+class SizeDistribution {
+   public:
+    bool Parse(const std::string& p_spec, std::size_t p_max) {
+        m_max = p_max;
+        std::vector<std::string> parts;
+        std::stringstream stream(p_spec);
+        std::string part;
+        while (std::getline(stream, part, ':')) parts.push_back(part);
+        if (parts.empty())
+            return false;
+        m_kind = parts[0];
+        if (m_kind == "fixed" && parts.size() == 2) {
+            m_a = std::stod(parts[1]);
+        } else if ((m_kind == "uniform" || m_kind == "lognormal") && parts.size() == 3) {
+            m_a = std::stod(parts[1]);
+            m_b = std::stod(parts[2]);
+        } else {
+            return false;
+        }
+        return true;
+    }
+
+    std::size_t Sample(std::mt19937_64& p_rng) const {
+        double bytes = m_a;
+        if (m_kind == "uniform")
+            bytes = std::uniform_real_distribution<double>(m_a, m_b)(p_rng);
+        else if (m_kind == "lognormal")
+            bytes = std::lognormal_distribution<double>(std::log(m_a), m_b)(p_rng);
+        return (std::size_t)(std::min)((std::max)(bytes, 1.0), (double)m_max);
+    }
+
+   private:
+    std::string m_kind;
+    double m_a = 0, m_b = 0;
+    std::size_t m_max = 0;
+};
+
+// latencies of one operation in nanoseconds, log-linear buckets as the stage histograms use
+struct OpResult {
+    std::vector<std::uint64_t> m_buckets = std::vector<std::uint64_t>(StageBuckets::kCount, 0);
+    std::uint64_t m_ops = 0, m_errors = 0, m_bytes = 0, m_totalNs = 0, m_maxNs = 0;
+
+    inline void Add(std::uint64_t p_ns, std::size_t p_bytes, bool p_ok) {
+        m_buckets[StageBuckets::Of(p_ns)]++;
+        m_ops++;
+        m_errors += p_ok ? 0 : 1;
+        m_bytes += p_bytes;
+        m_totalNs += p_ns;
+        m_maxNs = (std::max)(m_maxNs, p_ns);
+    }
+
+    void Merge(const OpResult& p_other) {
+        for (int b = 0; b < StageBuckets::kCount; b++) m_buckets[b] += p_other.m_buckets[b];
+        m_ops += p_other.m_ops;
+        m_errors += p_other.m_errors;
+        m_bytes += p_other.m_bytes;
+        m_totalNs += p_other.m_totalNs;
+        m_maxNs = (std::max)(m_maxNs, p_other.m_maxNs);
+    }
+
+    double PercentileUs(double p_fraction) const {
+        if (m_ops == 0)
+            return 0;
+        std::uint64_t rank = (std::min)((std::uint64_t)(p_fraction * m_ops), m_ops - 1), seen = 0;
+        for (int b = 0; b < StageBuckets::kCount; b++) {
+            seen += m_buckets[b];
+            if (seen > rank)
+                return (StageBuckets::Low(b) + StageBuckets::Width(b) / 2.0) / 1000.0;
+        }
+        return m_maxNs / 1000.0;
+    }
+};
+
+// sum of all series of p_name in a metrics scrape, 0 when the device does not export it
+static double MetricSum(const std::string& p_text, const std::string& p_name) {
+    double sum = 0;
+    std::stringstream stream(p_text);
+    std::string line;
+    while (std::getline(stream, line)) {
+        if (line.compare(0, p_name.size(), p_name) != 0 || line.size() <= p_name.size() || (line[p_name.size()] != ' ' && line[p_name.size()] != '{'))
+            continue;
+        sum += std::stod(line.substr(line.rfind(' ') + 1));
+    }
+    return sum;
+}
+
+struct DeviceCounters {
+    double m_pages = 0, m_commands = 0, m_busySeconds = 0, m_cpuSeconds = 0;
+    bool m_hasLatency = false;
+
+    static DeviceCounters Take(KeyValueIO& p_db) {
+        Helper::MetricsWriter writer;
+        p_db.CollectMetrics(writer);
+        DeviceCounters counters;
+        counters.m_pages = MetricSum(writer.Text(), "sptag_io_pages_total");
+        counters.m_commands = MetricSum(writer.Text(), "sptag_io_commands_total");
+        counters.m_busySeconds = MetricSum(writer.Text(), "sptag_io_latency_seconds_sum");
+        counters.m_hasLatency = writer.Text().find("sptag_io_latency_seconds_sum") != std::string::npos;
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        counters.m_cpuSeconds = usage.ru_utime.tv_sec + usage.ru_stime.tv_sec + (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e6;
+        return counters;
+    }
+};
+
+// writers only touch keys k with k % threads == their id, as the posting locks of the searcher
+// serialise writes per posting; readers pick any key
+static SizeType OwnedKey(std::mt19937_64& p_rng, int p_thread, const BenchConfig& p_config) {
+    std::uint64_t slots = (p_config.keys - 1 - p_thread) / p_config.threads + 1;
+    return (SizeType)(p_thread + p_config.threads * (p_rng() % slots));
+}
+
+static bool Load(KeyValueIO& p_db, const BenchConfig& p_config, const SizeDistribution& p_sizes, const std::string& p_pattern, std::vector<std::size_t>& p_postingBytes) {
+    std::atomic<bool> ok(true);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < p_config.threads; t++) {
+        workers.emplace_back([&, t] {
+            p_db.Initialize();
+            std::mt19937_64 rng(1000 + t);
+            for (SizeType key = t; key < p_config.keys && ok; key += p_config.threads) {
+                std::size_t bytes = p_sizes.Sample(rng);
+                if (p_db.Put(key, p_pattern.substr(key % 4096, bytes)) != ErrorCode::Success) {
+                    std::cerr << "Load: Put of key " << key << " (" << bytes << " bytes) failed" << std::endl;
+                    ok = false;
+                }
+                p_postingBytes[key] = bytes;
+            }
+            p_db.ExitBlockController();
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    return ok;
+}
+
+static void Run(KeyValueIO& p_db, const BenchConfig& p_config, const SizeDistribution& p_sizes, const std::string& p_pattern, std::vector<std::size_t>& p_postingBytes, std::vector<OpResult>& p_results) {
+    const std::size_t maxBytes = (std::size_t)p_config.postingBlocks * PageSize;
+    std::atomic<bool> stop(false);
+    std::vector<std::vector<OpResult>> perThread(p_config.threads, std::vector<OpResult>(OpCount));
+    std::vector<std::thread> workers;
+    for (int t = 0; t < p_config.threads; t++) {
+        workers.emplace_back([&, t] {
+            p_db.Initialize();
+            std::mt19937_64 rng(2000 + t);
+            std::discrete_distribution<int> pick(p_config.mix, p_config.mix + OpCount);
+            std::vector<SizeType> keys;
+            std::vector<PostingView> views;
+            std::string value;
+            std::vector<OpResult>& results = perThread[t];
+            while (!stop.load(std::memory_order_relaxed)) {
+                int op = pick(rng);
+                std::size_t bytes = 0;
+                bool ok = true;
+                auto begin = std::chrono::steady_clock::now();
+                switch (op) {
+                    case OpGet:
+                        ok = p_db.Get((SizeType)(rng() % p_config.keys), &value) == ErrorCode::Success;
+                        bytes = value.size();
+                        break;
+                    case OpMultiGet:
+                        keys.clear();
+                        while ((int)keys.size() < (std::min)(p_config.multiGetKeys, p_config.keys)) {
+                            SizeType key = (SizeType)(rng() % p_config.keys);
+                            if (std::find(keys.begin(), keys.end(), key) == keys.end())
+                                keys.push_back(key);
+                        }
+                        ok = p_db.MultiGet(keys, &views) == ErrorCode::Success;
+                        for (auto& view : views) bytes += view.size;
+                        p_db.ReleasePostingViews(&views);
+                        break;
+                    case OpPut: {
+                        SizeType key = OwnedKey(rng, t, p_config);
+                        bytes = p_sizes.Sample(rng);
+                        ok = p_db.Put(key, p_pattern.substr(key % 4096, bytes)) == ErrorCode::Success;
+                        if (ok)
+                            p_postingBytes[key] = bytes;
+                        break;
+                    }
+                    case OpMerge: {
+                        // a posting that cannot take the append any more is rewritten at a fresh size
+                        // and counted as a put, as a split would shrink it
+                        SizeType key = OwnedKey(rng, t, p_config);
+                        if (p_postingBytes[key] + p_config.mergeBytes > maxBytes) {
+                            op = OpPut;
+                            bytes = p_sizes.Sample(rng);
+                            ok = p_db.Put(key, p_pattern.substr(key % 4096, bytes)) == ErrorCode::Success;
+                            if (ok)
+                                p_postingBytes[key] = bytes;
+                            break;
+                        }
+                        bytes = p_config.mergeBytes;
+                        ok = p_db.Merge(key, p_pattern.substr(0, bytes)) == ErrorCode::Success;
+                        if (ok)
+                            p_postingBytes[key] += bytes;
+                        break;
+                    }
+                }
+                auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - begin).count();
+                results[op].Add((std::uint64_t)ns, bytes, ok);
+            }
+            p_db.ExitBlockController();
+        });
+    }
+    std::this_thread::sleep_for(std::chrono::duration<double>(p_config.seconds));
+    stop = true;
+    for (auto& worker : workers) worker.join();
+    p_results.assign(OpCount, OpResult());
+    for (auto& results : perThread)
+        for (int op = 0; op < OpCount; op++) p_results[op].Merge(results[op]);
+}
+
+static void Report(const BenchConfig& p_config, const std::vector<OpResult>& p_results, const DeviceCounters& p_before, const DeviceCounters& p_after, double p_seconds) {
+    std::uint64_t ops = 0;
+    for (auto& result : p_results) ops += result.m_ops;
+    double pages = p_after.m_pages - p_before.m_pages, commands = p_after.m_commands - p_before.m_commands;
+    double cpu = p_after.m_cpuSeconds - p_before.m_cpuSeconds;
+    // Little's law: summed command latency over wall time is the mean number in flight
+    double inflight = (p_after.m_busySeconds - p_before.m_busySeconds) / p_seconds;
+
+    if (p_config.json) {
+        std::cout << "{\"backend\":\"" << p_config.backend << "\",\"threads\":" << p_config.threads << ",\"batch_size\":" << p_config.batchSize << ",\"io_depth\":" << p_config.ioDepth
+                  << ",\"sizes\":\"" << p_config.sizes << "\",\"seconds\":" << p_seconds << ",\"ops\":{";
+        for (int op = 0; op < OpCount; op++) {
+            const OpResult& result = p_results[op];
+            std::cout << (op ? "," : "") << "\"" << c_opNames[op] << "\":{\"count\":" << result.m_ops << ",\"errors\":" << result.m_errors << ",\"per_s\":" << result.m_ops / p_seconds
+                      << ",\"mb_per_s\":" << result.m_bytes / p_seconds / 1048576 << ",\"mean_us\":" << (result.m_ops ? result.m_totalNs / 1000.0 / result.m_ops : 0)
+                      << ",\"p50_us\":" << result.PercentileUs(0.5) << ",\"p99_us\":" << result.PercentileUs(0.99) << ",\"p999_us\":" << result.PercentileUs(0.999)
+                      << ",\"max_us\":" << result.m_maxNs / 1000.0 << "}";
+        }
+        std::cout << "},\"device\":{\"pages_per_s\":" << pages / p_seconds << ",\"mb_per_s\":" << pages * PageSize / p_seconds / 1048576 << ",\"commands_per_s\":" << commands / p_seconds
+                  << ",\"pages_per_command\":" << (commands > 0 ? pages / commands : 0);
+        if (p_after.m_hasLatency)
+            std::cout << ",\"mean_inflight\":" << inflight;
+        std::cout << ",\"cpu_us_per_command\":" << (commands > 0 ? cpu * 1e6 / commands : 0) << ",\"cpu_us_per_op\":" << (ops > 0 ? cpu * 1e6 / ops : 0) << ",\"cpu_cores\":" << cpu / p_seconds << "}}" << std::endl;
+        return;
+    }
+
+    printf("%-9s %10s %8s %10s %9s %9s %9s %9s %9s %9s\n", "op", "count", "errors", "ops/s", "MB/s", "mean us", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (int op = 0; op < OpCount; op++) {
+        const OpResult& result = p_results[op];
+        if (result.m_ops == 0)
+            continue;
+        printf("%-9s %10llu %8llu %10.0f %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", c_opNames[op], (unsigned long long)result.m_ops, (unsigned long long)result.m_errors, result.m_ops / p_seconds,
+               result.m_bytes / p_seconds / 1048576, result.m_totalNs / 1000.0 / result.m_ops, result.PercentileUs(0.5), result.PercentileUs(0.99), result.PercentileUs(0.999), result.m_maxNs / 1000.0);
+    }
+    printf("device: %.0f pages/s (%.1f MB/s), %.0f commands/s, %.2f pages/command", pages / p_seconds, pages * PageSize / p_seconds / 1048576, commands / p_seconds, commands > 0 ? pages / commands : 0);
+    if (p_after.m_hasLatency)
+        printf(", %.1f commands in flight on average", inflight);
+    printf("\ncpu: %.2f cores, %.1f us per command, %.1f us per operation\n", cpu / p_seconds, commands > 0 ? cpu * 1e6 / commands : 0, ops > 0 ? cpu * 1e6 / ops : 0);
+}
+
+static void Usage() {
+    std::cerr << "Usage: bench_spdkio [options]\n"
+              << "  --backend spdk|uring   spdk takes SPFRESH_SPDK_CONF/SPFRESH_SPDK_BDEV, uring needs --file\n"
+              << "  --file PATH            file or block device for the uring backend\n"
+              << "  --blocks N             device blocks to use, default the whole device\n"
+              << "  --mapping PATH         block mapping file, removed before and after the run\n"
+              << "  --sizes SPEC           fixed:B | uniform:MIN:MAX | lognormal:MEDIAN:SIGMA (bytes), default lognormal:8192:1.0\n"
+              << "  --mix G,M,P,X          weights of get,multiget,put,merge, default 70,20,5,5\n"
+              << "  --threads 8  --keys 100000  --posting-blocks 64  --multiget-keys 8  --merge-bytes 512\n"
+              << "  --batch-size 64        SPDKIO batch size\n"
+              << "  --io-depth N           sets SPFRESH_SPDK_IO_DEPTH, or the ring depth for uring\n"
+              << "  --seconds 10           measured run after the load\n"
+              << "  --json                 one JSON object instead of the table" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--backend" && i + 1 < argc) {
+            config.backend = argv[++i];
+        } else if (arg == "--file" && i + 1 < argc) {
+            config.file = argv[++i];
+        } else if (arg == "--blocks" && i + 1 < argc) {
+            config.maxBlocks = std::stoll(argv[++i]);
+        } else if (arg == "--mapping" && i + 1 < argc) {
+            config.mapping = argv[++i];
+        } else if (arg == "--sizes" && i + 1 < argc) {
+            config.sizes = argv[++i];
+        } else if (arg == "--mix" && i + 1 < argc) {
+            std::stringstream stream(argv[++i]);
+            std::string weight;
+            for (int op = 0; op < OpCount && std::getline(stream, weight, ','); op++) config.mix[op] = std::stod(weight);
+        } else if (arg == "--threads" && i + 1 < argc) {
+            config.threads = (std::max)(1, std::stoi(argv[++i]));
+        } else if (arg == "--keys" && i + 1 < argc) {
+            config.keys = std::stoi(argv[++i]);
+        } else if (arg == "--posting-blocks" && i + 1 < argc) {
+            config.postingBlocks = std::stoi(argv[++i]);
+        } else if (arg == "--multiget-keys" && i + 1 < argc) {
+            config.multiGetKeys = (std::max)(1, std::stoi(argv[++i]));
+        } else if (arg == "--merge-bytes" && i + 1 < argc) {
+            config.mergeBytes = (std::max)(1, std::stoi(argv[++i]));
+        } else if (arg == "--batch-size" && i + 1 < argc) {
+            config.batchSize = std::stoi(argv[++i]);
+        } else if (arg == "--io-depth" && i + 1 < argc) {
+            config.ioDepth = std::stoi(argv[++i]);
+        } else if (arg == "--seconds" && i + 1 < argc) {
+            config.seconds = std::stod(argv[++i]);
+        } else if (arg == "--json") {
+            config.json = true;
+        } else {
+            Usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    SizeDistribution sizes;
+    if (!sizes.Parse(config.sizes, (std::size_t)config.postingBlocks * PageSize) || config.keys < config.threads || config.mergeBytes > config.postingBlocks * PageSize) {
+        Usage();
+        return 1;
+    }
+    std::shared_ptr<BlockDevice> device;
+    if (config.backend == "uring") {
+        if (config.file.empty()) {
+            Usage();
+            return 1;
+        }
+        device = std::make_shared<UringBlockController>(config.file, config.ioDepth > 0 ? config.ioDepth : UringBlockController::kDefaultQueueDepth);
+    } else if (config.backend == "spdk") {
+        if (config.ioDepth > 0)
+            setenv("SPFRESH_SPDK_IO_DEPTH", std::to_string(config.ioDepth).c_str(), 1);
+    } else {
+        Usage();
+        return 1;
+    }
+
+    std::remove(config.mapping.c_str());
+    std::string pattern((std::size_t)config.postingBlocks * PageSize + 4096, 0);
+    std::mt19937_64 rng(7);
+    for (auto& c : pattern) c = (char)rng();
+    std::vector<std::size_t> postingBytes(config.keys, 0);
+    int exitCode = 0;
+    {
+        SPDKIO db(config.mapping.c_str(), config.keys, config.keys, config.postingBlocks, 1024, config.batchSize, 1,
+                  config.maxBlocks > 0 ? config.maxBlocks : BlockDevice::kMaxNumBlocks, false, device);
+        auto loadBegin = std::chrono::steady_clock::now();
+        if (!Load(db, config, sizes, pattern, postingBytes)) {
+            exitCode = 1;
+        } else {
+            double loadSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadBegin).count();
+            std::size_t loaded = 0;
+            for (auto bytes : postingBytes) loaded += bytes;
+            std::cerr << "Loaded " << config.keys << " postings, " << loaded / 1048576.0 << " MB in " << loadSeconds << " s" << std::endl;
+
+            std::vector<OpResult> results;
+            DeviceCounters before = DeviceCounters::Take(db);
+            auto begin = std::chrono::steady_clock::now();
+            Run(db, config, sizes, pattern, postingBytes, results);
+            double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            DeviceCounters after = DeviceCounters::Take(db);
+            Report(config, results, before, after, seconds);
+        }
+        db.ShutDown();
+    }
+    std::remove(config.mapping.c_str());
+    return exitCode;
+}
@@ -1,4 +1,5 @@
 #include <algorithm>
+#include <array>
 #include <atomic>
 #include <chrono>
 #include <cmath>
@@ -8,9 +9,11 @@
 #include <filesystem>
 #include <fstream>
 #include <iostream>
+#include <map>
 #include <random>
 #include <string>
 #include <thread>
+#include <tuple>
 #include <vector>
 
 #include <sys/mman.h>
@@ -135,6 +138,15 @@ struct Args {
     int resultNum = 10;
     std::vector<int> searchInternalResultNums; // per-K; expanded to match kValues
     int maxDistRatio = 1000000;
+    // Recall-vs-latency sweep after every batch; a parameter without a list keeps its base value
+    std::string sweepOutput;
+    std::string sweepMode = "grid";
+    std::vector<int> sweepInternalResultNums;
+    std::vector<float> sweepMaxDistRatios;
+    std::vector<int> sweepMaxChecks;
+    std::vector<int> sweepPostingPageLimits;
+    double sweepRecallTarget = 1.0;
+    std::string truthFile; // "{batch}" is replaced by the batch number; brute force when empty
 };
 
 static void PrintUsage(const char* prog) {
@@ -180,7 +192,34 @@ static void PrintUsage(const char* prog) {
               << "  --buffer-length <n>   Buffer length (default: 1)\n"
               << "  --result-num <n>      Search result count (default: 10)\n"
               << "  --search-internal-result-num <n>[,<n>,...] Search internal result count per K (default: 64)\n"
-              << "  --max-dist-ratio <n>  Max distance ratio (default: 1000000)\n";
+              << "  --max-dist-ratio <n>  Max distance ratio (default: 1000000)\n"
+              << "  Sweep:\n"
+              << "  --sweep-output <file> TSV of recall, QPS and P99 per parameter point and batch, with the\n"
+              << "                        Pareto frontier marked (enables the sweep)\n"
+              << "  --sweep-mode <s>      grid (every combination) or adaptive (greedy walk) (default: grid)\n"
+              << "  --sweep-internal-result-num <n>[,<n>...] SearchInternalResultNum values\n"
+              << "  --sweep-max-dist-ratio <f>[,<f>...] MaxDistRatio values\n"
+              << "  --sweep-max-check <n>[,<n>...] MaxCheck values of the head index\n"
+              << "  --sweep-posting-page-limit <n>[,<n>...] SearchPostingPageLimit values\n"
+              << "  --sweep-recall-target <f> Adaptive walk stops once recall reaches this (default: 1.0)\n"
+              << "  --truth <file>        Truth file per batch, {batch} is replaced by the batch number: int32\n"
+              << "                        rows and columns, then rows x columns int32 ids (default: exact\n"
+              << "                        neighbors kept up to date by brute force as batches are added)\n";
+}
+
+template <typename V>
+static std::vector<V> ParseList(const std::string& p_list) {
+    std::vector<V> values;
+    size_t pos = 0;
+    while (pos < p_list.size()) {
+        size_t comma = p_list.find(',', pos);
+        if (comma == std::string::npos) comma = p_list.size();
+        values.push_back(static_cast<V>(std::stod(p_list.substr(pos, comma - pos))));
+        pos = comma + 1;
+    }
+    std::sort(values.begin(), values.end());
+    values.erase(std::unique(values.begin(), values.end()), values.end());
+    return values;
 }
 
 static bool ParseArgs(int argc, char* argv[], Args& args) {
@@ -280,6 +319,22 @@ static bool ParseArgs(int argc, char* argv[], Args& args) {
             }
         } else if (arg == "--max-dist-ratio" && i + 1 < argc) {
             args.maxDistRatio = std::stoi(argv[++i]);
+        } else if (arg == "--sweep-output" && i + 1 < argc) {
+            args.sweepOutput = argv[++i];
+        } else if (arg == "--sweep-mode" && i + 1 < argc) {
+            args.sweepMode = argv[++i];
+        } else if (arg == "--sweep-internal-result-num" && i + 1 < argc) {
+            args.sweepInternalResultNums = ParseList<int>(argv[++i]);
+        } else if (arg == "--sweep-max-dist-ratio" && i + 1 < argc) {
+            args.sweepMaxDistRatios = ParseList<float>(argv[++i]);
+        } else if (arg == "--sweep-max-check" && i + 1 < argc) {
+            args.sweepMaxChecks = ParseList<int>(argv[++i]);
+        } else if (arg == "--sweep-posting-page-limit" && i + 1 < argc) {
+            args.sweepPostingPageLimits = ParseList<int>(argv[++i]);
+        } else if (arg == "--sweep-recall-target" && i + 1 < argc) {
+            args.sweepRecallTarget = std::stod(argv[++i]);
+        } else if (arg == "--truth" && i + 1 < argc) {
+            args.truthFile = argv[++i];
         } else if (arg == "--help" || arg == "-h") {
             PrintUsage(argv[0]);
             std::exit(0);
@@ -318,6 +373,16 @@ static bool ParseArgs(int argc, char* argv[], Args& args) {
         return false;
     }
 
+    if (args.sweepMode != "grid" && args.sweepMode != "adaptive") {
+        std::cerr << "Error: --sweep-mode must be grid or adaptive\n";
+        return false;
+    }
+    if (args.sweepOutput.empty() && (!args.sweepInternalResultNums.empty() || !args.sweepMaxDistRatios.empty() ||
+                                     !args.sweepMaxChecks.empty() || !args.sweepPostingPageLimits.empty())) {
+        std::cerr << "Error: --sweep-* lists need --sweep-output\n";
+        return false;
+    }
+
     return true;
 }
 
@@ -435,22 +500,11 @@ static int Run(const Args& args) {
     // --- Prepare index directory ---
     std::filesystem::create_directories(args.indexDir);
 
-    // --- Write first batch to temp file for BuildIndex ---
+    // --- BuildIndex maps the first batch straight from the db file, random vectors go to a temp file ---
     std::string tempVectorFile = args.indexDir + "/init_vectors.bin";
-    std::cerr << "Writing batch 1 vectors to " << tempVectorFile << "...\n";
-    if (useDbFile) {
-        std::ofstream out(tempVectorFile, std::ios::binary);
-        if (!out.is_open()) {
-            std::cerr << "Error: cannot write to file: " << tempVectorFile << "\n";
-            return 1;
-        }
-        size_t bytes = static_cast<size_t>(count) * dim * sizeof(T);
-        out.write(reinterpret_cast<const char*>(dbMmap.as<T>()), static_cast<std::streamsize>(bytes));
-        if (!out.good()) {
-            std::cerr << "Error: write failed: " << tempVectorFile << "\n";
-            return 1;
-        }
-    } else {
+    std::string initVectorFile = useDbFile ? args.dbVectors : tempVectorFile;
+    if (!useDbFile) {
+        std::cerr << "Writing batch 1 vectors to " << tempVectorFile << "...\n";
         if (!GenerateRandomVectorsToFile<T>(tempVectorFile, count, dim, args.seed))
             return 1;
     }
@@ -461,7 +515,8 @@ static int Run(const Args& args) {
 
     index->SetParameter("ValueType", Helper::Convert::ConvertToString(GetEnumValueType<T>()).c_str(), "Base");
     index->SetParameter("Dim", std::to_string(dim).c_str(), "Base");
-    index->SetParameter("VectorPath", tempVectorFile.c_str(), "Base");
+    index->SetParameter("VectorPath", initVectorFile.c_str(), "Base");
+    index->SetParameter("VectorSize", std::to_string(count).c_str(), "Base");
     index->SetParameter("IndexDirectory", args.indexDir.c_str(), "Base");
     index->SetParameter("DistCalcMethod", args.distCalcMethod.c_str(), "Base");
 
@@ -700,6 +755,260 @@ static int Run(const Args& args) {
         return nullptr;
     };
 
+    // --- Recall-vs-latency sweep ---
+    // Recall is measured against exact neighbors in seqNum space: read per batch from --truth, or
+    // kept as a max-heap per query that each batch extends by brute force
+    const bool sweep = !args.sweepOutput.empty() && queryCount > 0;
+    if (!args.sweepOutput.empty() && !sweep)
+        std::cerr << "Warning: no query vectors, sweep skipped\n";
+    const int maxK = *std::max_element(kValues.begin(), kValues.end());
+    std::vector<std::vector<std::pair<float, int>>> truthHeaps(sweep && args.truthFile.empty() ? queryCount : 0);
+    std::vector<std::vector<int>> truth(sweep ? queryCount : 0);
+    int truthCovered = 0;
+    MmapFile initMmap;
+    FILE* sweepFile = nullptr;
+    if (sweep) {
+        sweepFile = fopen(args.sweepOutput.c_str(), "w");
+        if (!sweepFile) {
+            std::cerr << "Error: cannot open sweep output file: " << args.sweepOutput << "\n";
+            return 1;
+        }
+        fprintf(sweepFile, "batch\tK\tnum_points\tsearch_internal_result_num\tmax_dist_ratio\tmax_check\t"
+                "search_posting_page_limit\trecall\tsearch_qps\tmean_lat_ms\tp99_lat_ms\tmean_dist_cmps\t"
+                "pareto_p99\tpareto_qps\n");
+        if (args.truthFile.empty() && !useDbFile &&
+            !initMmap.open(tempVectorFile, static_cast<size_t>(count) * dim * sizeof(T)))
+            return 1;
+    }
+
+    auto updateTruth = [&](int batchIdx, int numPoints) -> bool {
+        if (!args.truthFile.empty()) {
+            std::string path = args.truthFile;
+            size_t at = path.find("{batch}");
+            if (at != std::string::npos) path.replace(at, 7, std::to_string(batchIdx));
+            std::ifstream in(path, std::ios::binary);
+            std::int32_t rows = 0, cols = 0;
+            in.read(reinterpret_cast<char*>(&rows), sizeof(rows));
+            in.read(reinterpret_cast<char*>(&cols), sizeof(cols));
+            if (!in.good() || rows < queryCount || cols < maxK) {
+                std::cerr << "Error: truth file " << path << " needs " << queryCount << " rows of at least "
+                          << maxK << " ids\n";
+                return false;
+            }
+            std::vector<std::int32_t> row(cols);
+            for (int qi = 0; qi < queryCount; qi++) {
+                in.read(reinterpret_cast<char*>(row.data()), static_cast<std::streamsize>(cols) * sizeof(std::int32_t));
+                if (!in.good()) {
+                    std::cerr << "Error: truth file " << path << " is truncated\n";
+                    return false;
+                }
+                truth[qi].assign(row.begin(), row.begin() + maxK);
+            }
+            return true;
+        }
+
+        const int chunkVecs = 4096;
+        std::vector<T> chunk(static_cast<size_t>(chunkVecs) * dim);
+        for (int lo = truthCovered; lo < numPoints; lo += chunkVecs) {
+            int n = std::min(chunkVecs, numPoints - lo);
+            for (int i = 0; i < n; i++) {
+                T* out = chunk.data() + static_cast<size_t>(i) * dim;
+                int seq = lo + i;
+                if (useDbFile || seq < count) {
+                    const T* src = (useDbFile ? dbMmap.as<T>() : initMmap.as<T>()) + static_cast<size_t>(seq) * dim;
+                    std::memcpy(out, src, sizeof(T) * dim);
+                } else {
+                    std::mt19937 rng(args.seed + static_cast<unsigned>(seq));
+                    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+                    for (int d = 0; d < dim; d++) out[d] = static_cast<T>(dist(rng));
+                }
+            }
+            std::atomic<int> nextQuery(0);
+            std::vector<std::thread> workers;
+            for (int t = 0; t < numThreads; t++) {
+                workers.emplace_back([&, lo, n]() {
+                    for (int qi = nextQuery.fetch_add(1); qi < queryCount; qi = nextQuery.fetch_add(1)) {
+                        const T* q = queryData + static_cast<size_t>(qi) * dim;
+                        auto& heap = truthHeaps[qi];
+                        for (int i = 0; i < n; i++) {
+                            float d = index->ComputeDistance(q, chunk.data() + static_cast<size_t>(i) * dim);
+                            if (static_cast<int>(heap.size()) < maxK) {
+                                heap.emplace_back(d, lo + i);
+                                std::push_heap(heap.begin(), heap.end());
+                            } else if (d < heap.front().first) {
+                                std::pop_heap(heap.begin(), heap.end());
+                                heap.back() = {d, lo + i};
+                                std::push_heap(heap.begin(), heap.end());
+                            }
+                        }
+                    }
+                });
+            }
+            for (auto& th : workers) th.join();
+        }
+        truthCovered = std::max(truthCovered, numPoints);
+        for (int qi = 0; qi < queryCount; qi++) {
+            std::vector<std::pair<float, int>> sorted(truthHeaps[qi]);
+            std::sort(sorted.begin(), sorted.end());
+            truth[qi].clear();
+            for (auto& e : sorted) truth[qi].push_back(e.second);
+        }
+        return true;
+    };
+
+    // Recall@k: the share of the k exact neighbors found, averaged over all queries
+    auto computeRecall = [&](const std::vector<QueryResult_>& results, int kVal) -> double {
+        double sum = 0;
+        std::vector<int> expected;
+        for (auto& qr : results) {
+            const auto& exact = truth[qr.queryIdx];
+            expected.assign(exact.begin(), exact.begin() + std::min<size_t>(kVal, exact.size()));
+            std::sort(expected.begin(), expected.end());
+            int found = 0;
+            int limit = std::min(kVal, static_cast<int>(qr.hits.size()));
+            for (int j = 0; j < limit; j++) {
+                SizeType vid = qr.hits[j].vid;
+                if (vid >= 0 && static_cast<size_t>(vid) < vidToSeqNum.size() &&
+                    std::binary_search(expected.begin(), expected.end(), vidToSeqNum[vid]))
+                    found++;
+            }
+            sum += static_cast<double>(found) / kVal;
+        }
+        return sum / queryCount;
+    };
+
+    struct SweepPoint {
+        int internalResultNum;
+        float maxDistRatio;
+        int maxCheck;
+        int postingPageLimit;
+        double recall;
+        LatencyStats stats;
+        bool paretoP99;
+        bool paretoQps;
+    };
+
+    // Every parameter is an ascending axis, larger values search more; the head index takes
+    // MaxCheck itself, the SSD options size the workspace of new query threads with it
+    const std::string baseHeadMaxCheck = sweep ? index->GetParameter("MaxCheck", "BuildHead") : std::string();
+    const std::string baseSsdMaxCheck = index->GetParameter("MaxCheck", "BuildSSDIndex");
+    auto applySweepPoint = [&](float maxDistRatio, const std::string& headMaxCheck, const std::string& ssdMaxCheck, int postingPageLimit) {
+        index->SetParameter("MaxDistRatio", std::to_string(maxDistRatio).c_str(), "BuildSSDIndex");
+        index->SetParameter("MaxCheck", headMaxCheck.c_str(), "BuildHead");
+        index->SetParameter("MaxCheck", ssdMaxCheck.c_str(), "BuildSSDIndex");
+        index->SetParameter("SearchPostingPageLimit", std::to_string(postingPageLimit).c_str(), "BuildSSDIndex");
+    };
+
+    auto runSweep = [&](int batchIdx, int numPoints) -> bool {
+        if (!updateTruth(batchIdx, numPoints))
+            return false;
+        auto axisOf = [](const auto& values, double base) {
+            std::vector<double> axis(values.begin(), values.end());
+            if (axis.empty()) axis.push_back(base);
+            return axis;
+        };
+        for (size_t ki = 0; ki < kValues.size(); ki++) {
+            int kVal = kValues[ki];
+            std::vector<double> axes[4] = {
+                axisOf(args.sweepInternalResultNums, searchInternalResultNums[ki]),
+                axisOf(args.sweepMaxDistRatios, args.maxDistRatio),
+                axisOf(args.sweepMaxChecks, std::stod(baseHeadMaxCheck)),
+                axisOf(args.sweepPostingPageLimits, args.postingPageLimit)};
+            std::vector<SweepPoint> points;
+            std::map<std::array<size_t, 4>, size_t> evaluated;
+
+            auto evaluate = [&](const std::array<size_t, 4>& at) -> size_t {
+                auto it = evaluated.find(at);
+                if (it != evaluated.end()) return it->second;
+                SweepPoint p{};
+                p.internalResultNum = static_cast<int>(axes[0][at[0]]);
+                p.maxDistRatio = static_cast<float>(axes[1][at[1]]);
+                p.maxCheck = static_cast<int>(axes[2][at[2]]);
+                p.postingPageLimit = static_cast<int>(axes[3][at[3]]);
+                std::string maxCheck = std::to_string(p.maxCheck);
+                applySweepPoint(p.maxDistRatio, maxCheck, maxCheck, p.postingPageLimit);
+
+                std::vector<QueryResult_> results;
+                auto wallStart = std::chrono::high_resolution_clock::now();
+                runQueries(results, kVal, p.internalResultNum);
+                auto wallEnd = std::chrono::high_resolution_clock::now();
+                p.stats = computeLatencyStats(results, std::chrono::duration<double>(wallEnd - wallStart).count());
+                p.recall = computeRecall(results, kVal);
+                fprintf(stderr, "  sweep K=%-4d internal=%-5d ratio=%-8g maxcheck=%-6d pages=%-4d recall=%.4f  QPS=%10.1f  P99=%8.1fus\n",
+                        kVal, p.internalResultNum, p.maxDistRatio, p.maxCheck, p.postingPageLimit, p.recall,
+                        p.stats.qps, p.stats.p99Us);
+                evaluated[at] = points.size();
+                points.push_back(p);
+                return points.size() - 1;
+            };
+
+            if (args.sweepMode == "grid") {
+                std::array<size_t, 4> at{};
+                while (true) {
+                    evaluate(at);
+                    int d = 0;
+                    while (d < 4 && ++at[d] == axes[d].size()) at[d++] = 0;
+                    if (d == 4) break;
+                }
+            } else {
+                // Greedy walk from the cheapest corner: step along the axis with the most recall
+                // per microsecond of P99 until the target is met or no step adds recall
+                std::array<size_t, 4> at{};
+                size_t cur = evaluate(at);
+                while (points[cur].recall < args.sweepRecallTarget) {
+                    size_t best = points.size();
+                    std::array<size_t, 4> bestAt = at;
+                    double bestGain = 0;
+                    for (int d = 0; d < 4; d++) {
+                        if (at[d] + 1 >= axes[d].size()) continue;
+                        std::array<size_t, 4> next = at;
+                        next[d]++;
+                        size_t n = evaluate(next);
+                        double gain = points[n].recall - points[cur].recall;
+                        if (gain <= 0) continue;
+                        gain /= std::max(points[n].stats.p99Us - points[cur].stats.p99Us, 1.0);
+                        if (gain > bestGain) {
+                            bestGain = gain;
+                            best = n;
+                            bestAt = next;
+                        }
+                    }
+                    if (best == points.size()) break;
+                    at = bestAt;
+                    cur = best;
+                }
+            }
+
+            // A point is on a frontier when no other point has at least its recall and is at
+            // least as fast, one of the two strictly
+            int frontier = 0;
+            for (auto& p : points) {
+                p.paretoP99 = p.paretoQps = true;
+                for (auto& q : points) {
+                    if (q.recall >= p.recall && q.stats.p99Us <= p.stats.p99Us &&
+                        (q.recall > p.recall || q.stats.p99Us < p.stats.p99Us))
+                        p.paretoP99 = false;
+                    if (q.recall >= p.recall && q.stats.qps >= p.stats.qps &&
+                        (q.recall > p.recall || q.stats.qps > p.stats.qps))
+                        p.paretoQps = false;
+                }
+                frontier += p.paretoP99;
+            }
+            std::sort(points.begin(), points.end(),
+                      [](const SweepPoint& a, const SweepPoint& b) { return a.recall < b.recall; });
+            for (auto& p : points) {
+                fprintf(sweepFile, "%d\t%d\t%d\t%d\t%g\t%d\t%d\t%.4f\t%.2f\t%.2f\t%.2f\t%.1f\t%d\t%d\n",
+                        batchIdx, kVal, numPoints, p.internalResultNum, p.maxDistRatio, p.maxCheck,
+                        p.postingPageLimit, p.recall, p.stats.qps, p.stats.meanUs / 1000.0,
+                        p.stats.p99Us / 1000.0, p.stats.meanDistCmps, p.paretoP99 ? 1 : 0, p.paretoQps ? 1 : 0);
+            }
+            fflush(sweepFile);
+            fprintf(stderr, "  sweep K=%-4d %zu points, %d on the recall/P99 frontier\n", kVal, points.size(), frontier);
+        }
+        applySweepPoint(static_cast<float>(args.maxDistRatio), baseHeadMaxCheck, baseSsdMaxCheck, args.postingPageLimit);
+        return true;
+    };
+
     // --- Write build stats row ---
     {
         long rss = get_rss_mb();
@@ -741,6 +1050,8 @@ static int Run(const Args& args) {
             FILE* qf = getQueryFile(kVal);
             if (qf) writeQueryResults(qf, 0, 0, kVal, results);
         }
+        if (sweep && !runSweep(0, count))
+            return 1;
         std::cerr << "Batch 0 queries complete.\n";
     }
 
@@ -871,6 +1182,8 @@ static int Run(const Args& args) {
                 FILE* qf = getQueryFile(kVal);
                 if (qf) writeQueryResults(qf, b, batchStart, kVal, results);
             }
+            if (sweep && !runSweep(b, batchEnd))
+                return 1;
             std::cerr << "Batch " << (b + 1) << " queries complete.\n";
         }
     }
@@ -880,6 +1193,7 @@ static int Run(const Args& args) {
 
     // Close output files
     if (statsFile) fclose(statsFile);
+    if (sweepFile) fclose(sweepFile);
     for (auto& p : queryFiles) fclose(p.second);
 
     // Wait for all background merge/reassign operations before index destruction
@@ -889,7 +1203,8 @@ static int Run(const Args& args) {
     }
 
     // Cleanup temp file
-    std::filesystem::remove(tempVectorFile);
+    if (!useDbFile)
+        std::filesystem::remove(tempVectorFile);
 
     std::cerr << "Done.\n";
     return 0;
@@ -0,0 +1,293 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Re-issues the commands of a block-level I/O trace (SPFRESH_IO_TRACE, see IOTrace.h) against a
+// device, at the recorded pace scaled by --speed or as fast as the device takes them, and puts
+// the replayed latency per operation next to the one recorded. Writes are skipped unless
+// --writes is given, they overwrite whatever the device holds at the traced blocks.
+
+#include "Core/SPANN/ExtraSPDKController.h"
+#include "Core/SPANN/ExtraUringController.h"
+#include "Core/SPANN/IOTrace.h"
+#include "Core/SPANN/StageLatency.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+struct ReplayConfig {
+    std::string trace;
+    std::string backend = "spdk";  // spdk: the bdev of SPFRESH_SPDK_CONF/SPFRESH_SPDK_BDEV, uring: --file
+    std::string file;
+    AddressType maxBlocks = 0;     // traced blocks past it wrap around, 0 keeps them as recorded
+    double speed = 1;              // 2 replays twice as fast as recorded, 0 as fast as possible
+    int threads = 8;
+    int batchSize = 64;
+    bool writes = false;
+    bool json = false;
+};
+
+// latencies in nanoseconds, log-linear buckets as the stage histograms use
+struct LatencyResult {
+    std::vector<std::uint64_t> m_buckets = std::vector<std::uint64_t>(StageBuckets::kCount, 0);
+    std::uint64_t m_count = 0, m_errors = 0, m_totalNs = 0, m_maxNs = 0;
+
+    inline void Add(std::uint64_t p_ns, bool p_ok = true) {
+        m_buckets[StageBuckets::Of(p_ns)]++;
+        m_count++;
+        m_errors += p_ok ? 0 : 1;
+        m_totalNs += p_ns;
+        m_maxNs = (std::max)(m_maxNs, p_ns);
+    }
+
+    void Merge(const LatencyResult& p_other) {
+        for (int b = 0; b < StageBuckets::kCount; b++) m_buckets[b] += p_other.m_buckets[b];
+        m_count += p_other.m_count;
+        m_errors += p_other.m_errors;
+        m_totalNs += p_other.m_totalNs;
+        m_maxNs = (std::max)(m_maxNs, p_other.m_maxNs);
+    }
+
+    double PercentileUs(double p_fraction) const {
+        if (m_count == 0)
+            return 0;
+        std::uint64_t rank = (std::min)((std::uint64_t)(p_fraction * m_count), m_count - 1), seen = 0;
+        for (int b = 0; b < StageBuckets::kCount; b++) {
+            seen += m_buckets[b];
+            if (seen > rank)
+                return (StageBuckets::Low(b) + StageBuckets::Width(b) / 2.0) / 1000.0;
+        }
+        return m_maxNs / 1000.0;
+    }
+
+    double MeanUs() const {
+        return m_count ? m_totalNs / 1000.0 / m_count : 0;
+    }
+};
+
+static const char* const c_opNames[2] = {"read", "write"};
+
+struct ReplayResult {
+    LatencyResult m_replayed[2];
+    LatencyResult m_recorded[2];
+    std::uint64_t m_bytes[2] = {0, 0};
+    std::uint64_t m_maxLagNs = 0;  // how late a command was issued behind its schedule
+    double m_seconds = 0;
+    double m_recordedSeconds = 0;
+};
+
+static void Replay(BlockDevice& p_device, const ReplayConfig& p_config, const std::vector<IOTraceRecord>& p_commands, AddressType p_deviceBlocks, ReplayResult& p_result) {
+    std::uint64_t firstNs = p_commands.front().timeNs;
+    std::uint32_t maxLength = 0;
+    for (auto& record : p_commands) maxLength = (std::max)(maxLength, record.length);
+    std::string pattern(maxLength, 'r');
+
+    std::vector<ReplayResult> perThread(p_config.threads);
+    std::vector<std::thread> workers;
+    // the clock starts once every thread has its I/O context, bringing the device up is not replayed
+    std::atomic<int> ready(0);
+    std::atomic<bool> go(false);
+    std::chrono::steady_clock::time_point begin;
+    for (int t = 0; t < p_config.threads; t++) {
+        workers.emplace_back([&, t] {
+            p_device.Initialize(p_config.batchSize, p_deviceBlocks);
+            ready++;
+            while (!go.load(std::memory_order_acquire)) std::this_thread::yield();
+            ReplayResult& result = perThread[t];
+            std::vector<AddressType> blocks;
+            std::string value;
+            // command i goes to thread i % threads, each thread keeps the recorded order of its share
+            for (std::size_t i = t; i < p_commands.size(); i += p_config.threads) {
+                const IOTraceRecord& record = p_commands[i];
+                auto scheduled = begin;
+                if (p_config.speed > 0) {
+                    scheduled += std::chrono::nanoseconds((std::uint64_t)((record.timeNs - firstNs) / p_config.speed));
+                    std::this_thread::sleep_until(scheduled);
+                }
+                auto issue = std::chrono::steady_clock::now();
+                if (p_config.speed > 0)
+                    result.m_maxLagNs = (std::max)(result.m_maxLagNs, (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(issue - scheduled).count());
+
+                AddressType pages = ((AddressType)record.length + PageSize - 1) >> PageSizeEx;
+                AddressType first = (AddressType)(record.offset >> PageSizeEx);
+                if (p_config.maxBlocks > 0)
+                    first = first % (std::max)((AddressType)1, p_config.maxBlocks - pages);
+                IOClassScope ioClass((IOClass)(std::min)((int)record.ioClass, kIOClasses - 1));
+                bool ok;
+                if (record.op == (std::uint8_t)IOTraceOp::Read) {
+                    blocks.assign(1, (AddressType)record.length);
+                    for (AddressType p = 0; p < pages; p++) blocks.push_back(first + p);
+                    ok = p_device.ReadBlocks(blocks.data(), &value);
+                } else {
+                    blocks.clear();
+                    for (AddressType p = 0; p < pages; p++) blocks.push_back(first + p);
+                    ok = p_device.WriteBlocks(blocks.data(), (int)pages, pattern.substr(0, record.length));
+                }
+                // open loop: latency counts from the scheduled time, so a device falling behind shows
+                auto end = std::chrono::steady_clock::now();
+                int op = record.op == (std::uint8_t)IOTraceOp::Read ? 0 : 1;
+                result.m_replayed[op].Add((std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(end - (p_config.speed > 0 ? scheduled : issue)).count(), ok);
+                result.m_bytes[op] += record.length;
+            }
+            p_device.ShutDown();
+        });
+    }
+    while (ready.load() < p_config.threads) std::this_thread::yield();
+    begin = std::chrono::steady_clock::now();
+    go.store(true, std::memory_order_release);
+    for (auto& worker : workers) worker.join();
+    p_result.m_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+    p_result.m_recordedSeconds = (p_commands.back().timeNs - firstNs) / 1e9;
+    for (auto& result : perThread) {
+        for (int op = 0; op < 2; op++) {
+            p_result.m_replayed[op].Merge(result.m_replayed[op]);
+            p_result.m_bytes[op] += result.m_bytes[op];
+        }
+        p_result.m_maxLagNs = (std::max)(p_result.m_maxLagNs, result.m_maxLagNs);
+    }
+}
+
+static void Report(const ReplayConfig& p_config, const ReplayResult& p_result) {
+    if (p_config.json) {
+        std::cout << "{\"trace\":\"" << p_config.trace << "\",\"backend\":\"" << p_config.backend << "\",\"speed\":" << p_config.speed << ",\"threads\":" << p_config.threads
+                  << ",\"seconds\":" << p_result.m_seconds << ",\"recorded_seconds\":" << p_result.m_recordedSeconds << ",\"max_lag_us\":" << p_result.m_maxLagNs / 1000.0 << ",\"ops\":{";
+        bool first = true;
+        for (int op = 0; op < 2; op++) {
+            const LatencyResult& replayed = p_result.m_replayed[op];
+            const LatencyResult& recorded = p_result.m_recorded[op];
+            if (replayed.m_count == 0)
+                continue;
+            std::cout << (first ? "" : ",") << "\"" << c_opNames[op] << "\":{\"count\":" << replayed.m_count << ",\"errors\":" << replayed.m_errors
+                      << ",\"mb_per_s\":" << p_result.m_bytes[op] / p_result.m_seconds / 1048576 << ",\"replayed\":{\"mean_us\":" << replayed.MeanUs() << ",\"p50_us\":" << replayed.PercentileUs(0.5)
+                      << ",\"p99_us\":" << replayed.PercentileUs(0.99) << ",\"p999_us\":" << replayed.PercentileUs(0.999) << ",\"max_us\":" << replayed.m_maxNs / 1000.0
+                      << "},\"recorded\":{\"count\":" << recorded.m_count << ",\"mean_us\":" << recorded.MeanUs() << ",\"p50_us\":" << recorded.PercentileUs(0.5) << ",\"p99_us\":" << recorded.PercentileUs(0.99)
+                      << ",\"p999_us\":" << recorded.PercentileUs(0.999) << ",\"max_us\":" << recorded.m_maxNs / 1000.0 << "}}";
+            first = false;
+        }
+        std::cout << "}}" << std::endl;
+        return;
+    }
+
+    printf("replayed %.2f s of trace in %.2f s, issued up to %.1f us behind schedule\n", p_result.m_recordedSeconds, p_result.m_seconds, p_result.m_maxLagNs / 1000.0);
+    printf("%-6s %-9s %10s %8s %9s %9s %9s %9s %9s %9s\n", "op", "", "count", "errors", "MB/s", "mean us", "p50 us", "p99 us", "p99.9 us", "max us");
+    for (int op = 0; op < 2; op++) {
+        const LatencyResult& replayed = p_result.m_replayed[op];
+        const LatencyResult& recorded = p_result.m_recorded[op];
+        if (replayed.m_count == 0)
+            continue;
+        printf("%-6s %-9s %10llu %8llu %9.1f %9.1f %9.1f %9.1f %9.1f %9.1f\n", c_opNames[op], "replayed", (unsigned long long)replayed.m_count, (unsigned long long)replayed.m_errors,
+               p_result.m_bytes[op] / p_result.m_seconds / 1048576, replayed.MeanUs(), replayed.PercentileUs(0.5), replayed.PercentileUs(0.99), replayed.PercentileUs(0.999), replayed.m_maxNs / 1000.0);
+        printf("%-6s %-9s %10llu %8s %9s %9.1f %9.1f %9.1f %9.1f %9.1f\n", "", "recorded", (unsigned long long)recorded.m_count, "", "", recorded.MeanUs(), recorded.PercentileUs(0.5),
+               recorded.PercentileUs(0.99), recorded.PercentileUs(0.999), recorded.m_maxNs / 1000.0);
+    }
+}
+
+static void Usage() {
+    std::cerr << "Usage: io_replay --trace PATH [options]\n"
+              << "  --trace PATH           trace file written under SPFRESH_IO_TRACE\n"
+              << "  --backend spdk|uring   spdk takes SPFRESH_SPDK_CONF/SPFRESH_SPDK_BDEV, uring needs --file\n"
+              << "  --file PATH            file or block device for the uring backend\n"
+              << "  --blocks N             device blocks, traced blocks past the end wrap around\n"
+              << "  --speed 1              pace relative to the recording, 0 issues as fast as possible\n"
+              << "  --threads 8            replaying threads, command i runs on thread i % threads\n"
+              << "  --batch-size 64        device batch size\n"
+              << "  --writes               replay the writes too, destroys the data at the traced blocks\n"
+              << "  --json                 one JSON object instead of the table" << std::endl;
+}
+
+int main(int argc, char* argv[]) {
+    ReplayConfig config;
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--trace" && i + 1 < argc) {
+            config.trace = argv[++i];
+        } else if (arg == "--backend" && i + 1 < argc) {
+            config.backend = argv[++i];
+        } else if (arg == "--file" && i + 1 < argc) {
+            config.file = argv[++i];
+        } else if (arg == "--blocks" && i + 1 < argc) {
+            config.maxBlocks = std::stoll(argv[++i]);
+        } else if (arg == "--speed" && i + 1 < argc) {
+            config.speed = (std::max)(0.0, std::stod(argv[++i]));
+        } else if (arg == "--threads" && i + 1 < argc) {
+            config.threads = (std::max)(1, std::stoi(argv[++i]));
+        } else if (arg == "--batch-size" && i + 1 < argc) {
+            config.batchSize = std::stoi(argv[++i]);
+        } else if (arg == "--writes") {
+            config.writes = true;
+        } else if (arg == "--json") {
+            config.json = true;
+        } else {
+            Usage();
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+    if (config.trace.empty()) {
+        Usage();
+        return 1;
+    }
+
+    std::vector<IOTraceRecord> records;
+    if (!ReadIOTrace(config.trace, records)) {
+        std::cerr << "Cannot read trace " << config.trace << std::endl;
+        return 1;
+    }
+    // the replaying device must not trace over its own input
+    unsetenv(kIOTraceEnv);
+
+    ReplayResult result;
+    std::unordered_map<std::uint64_t, std::uint32_t> recordedLatency;
+    for (auto& record : records) {
+        if (record.event == (std::uint8_t)IOTraceEvent::Complete)
+            recordedLatency[record.command] = record.latencyUs;
+    }
+    std::vector<IOTraceRecord> commands;
+    std::uint64_t skippedWrites = 0;
+    for (auto& record : records) {
+        if (record.event != (std::uint8_t)IOTraceEvent::Submit || record.length == 0)
+            continue;
+        if (record.op == (std::uint8_t)IOTraceOp::Write && !config.writes) {
+            skippedWrites++;
+            continue;
+        }
+        commands.push_back(record);
+        auto it = recordedLatency.find(record.command);
+        if (it != recordedLatency.end())
+            result.m_recorded[record.op == (std::uint8_t)IOTraceOp::Read ? 0 : 1].Add((std::uint64_t)it->second * 1000);
+    }
+    std::stable_sort(commands.begin(), commands.end(), [](const IOTraceRecord& a, const IOTraceRecord& b) { return a.timeNs < b.timeNs; });
+    std::cerr << "Trace " << config.trace << ": " << records.size() << " records, " << commands.size() << " commands to replay";
+    if (skippedWrites > 0)
+        std::cerr << ", " << skippedWrites << " writes skipped (--writes replays them)";
+    std::cerr << std::endl;
+    if (commands.empty())
+        return 0;
+
+    std::shared_ptr<BlockDevice> device;
+    if (config.backend == "uring") {
+        if (config.file.empty()) {
+            Usage();
+            return 1;
+        }
+        device = std::make_shared<UringBlockController>(config.file);
+    } else if (config.backend == "spdk") {
+        device = SPDKIO::CreateDevice();
+    } else {
+        Usage();
+        return 1;
+    }
+    Replay(*device, config, commands, config.maxBlocks > 0 ? config.maxBlocks : BlockDevice::kMaxNumBlocks, result);
+    Report(config, result);
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Sharded SPANN over MPI, one shard per rank:
+//   mpirun -np <shards> sharded build <config.ini>    split VectorPath over the ranks and build every shard
+//   mpirun -np <shards> sharded search <config.ini>   answer QueryPath from the shards, recall against TruthPath
+// The configuration is the one of ssdserving; IndexDirectory holds a shard_<rank> folder per rank.
+
+#include <chrono>
+#include <map>
+#include <set>
+#include <string>
+
+#include "Core/Common.h"
+#include "Core/Common/TruthSet.h"
+#include "Core/SPANN/ShardedIndex.h"
+#include "Helper/SimpleIniReader.h"
+#include "Helper/VectorSetReader.h"
+
+namespace SPTAG::SSDServing::Sharded {
+
+typedef std::map<std::string, std::map<std::string, std::string>> ConfigMap;
+
+// the sections of ssdserving, search parameters folded into BuildSSDIndex the same way
+void ReadConfig(const char* p_configPath, ConfigMap& p_config, SPANN::Options& p_opts) {
+    Helper::IniReader iniReader;
+    iniReader.LoadIniFile(p_configPath);
+    for (const char* section : {"Base", "SelectHead", "BuildHead", "BuildSSDIndex"}) p_config[section] = iniReader.GetParameters(section);
+    for (auto& KV : iniReader.GetParameters("SearchSSDIndex")) {
+        std::string param = KV.first;
+        if (Helper::StrUtils::StrEqualIgnoreCase(param.c_str(), "isExecute"))
+            continue;
+        if (Helper::StrUtils::StrEqualIgnoreCase(param.c_str(), "PostingPageLimit"))
+            param = "SearchPostingPageLimit";
+        if (Helper::StrUtils::StrEqualIgnoreCase(param.c_str(), "InternalResultNum"))
+            param = "SearchInternalResultNum";
+        p_config["BuildSSDIndex"][param] = KV.second;
+    }
+    for (auto& section : p_config) {
+        for (auto& KV : section.second) p_opts.SetParameter(section.first.c_str(), KV.first.c_str(), KV.second.c_str());
+    }
+}
+
+template <typename T>
+int Build(const ConfigMap& p_config, SPANN::Options& p_opts) {
+    SPANN::ShardedIndex<T> index;
+    std::shared_ptr<VectorSet> vectors;
+    std::shared_ptr<Helper::VectorSetReader<T>> reader;
+    if (index.Rank() == SPANN::ShardedIndex<T>::kRoot) {
+        reader = Helper::VectorSetReader<T>::CreateInstance((std::max)(p_opts.m_vectorSize, (SizeType)0), p_opts.m_dim, p_opts.m_vectorDelimiter);
+        if (reader->LoadFile(p_opts.m_vectorPath) != ErrorCode::Success) {
+            LOG(Helper::LogLevel::LL_Error, "Failed to read vector file %s.\n", p_opts.m_vectorPath.c_str());
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        vectors = reader->GetVectorSet();
+        if (p_opts.m_distCalcMethod == DistCalcMethod::Cosine)
+            vectors->Normalize(p_opts.m_iSSDNumberOfThreads);
+    }
+    auto start = std::chrono::steady_clock::now();
+    ErrorCode ret = index.Build(p_opts.m_indexDirectory, vectors ? (const T*)vectors->GetData() : nullptr, vectors ? vectors->Count() : 0, p_opts.m_dim, p_config, p_opts.m_shardCells, p_opts.m_shardRouterSamples);
+    if (ret != ErrorCode::Success) {
+        LOG(Helper::LogLevel::LL_Error, "Failed to build the shards.\n");
+        return 1;
+    }
+    LOG(Helper::LogLevel::LL_Info, "Built %d shards of %d vectors in %.2lfs.\n", index.Ranks(), index.Count(), std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    return 0;
+}
+
+template <typename T>
+int Search(SPANN::Options& p_opts) {
+    SPANN::ShardedIndex<T> index;
+    if (index.Load(p_opts.m_indexDirectory) != ErrorCode::Success) {
+        LOG(Helper::LogLevel::LL_Error, "Failed to load the shards from %s.\n", p_opts.m_indexDirectory.c_str());
+        return 1;
+    }
+    bool root = index.Rank() == SPANN::ShardedIndex<T>::kRoot;
+    std::shared_ptr<VectorSet> queries;
+    if (root) {
+        auto reader = Helper::VectorSetReader<T>::CreateInstance((std::max)(p_opts.m_querySize, (SizeType)0), p_opts.m_dim, p_opts.m_queryDelimiter);
+        if (reader->LoadFile(p_opts.m_queryPath) != ErrorCode::Success) {
+            LOG(Helper::LogLevel::LL_Error, "Failed to read query file %s.\n", p_opts.m_queryPath.c_str());
+            MPI_Abort(MPI_COMM_WORLD, 1);
+        }
+        queries = reader->GetVectorSet();
+        if (p_opts.m_distCalcMethod == DistCalcMethod::Cosine)
+            queries->Normalize(p_opts.m_iSSDNumberOfThreads);
+    }
+    SizeType numQueries = queries ? queries->Count() : 0;
+    int K = p_opts.m_resultNum;
+
+    std::vector<std::vector<BasicResult>> results;
+    auto start = std::chrono::steady_clock::now();
+    index.SearchBatch(queries ? (const T*)queries->GetData() : nullptr, numQueries, K, p_opts.m_shardProbe, p_opts.m_searchThreadNum, &results);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    if (!root)
+        return 0;
+    LOG(Helper::LogLevel::LL_Info, "Searched %d queries over %d shards in %.3lfs, %.1lf QPS.\n", numQueries, index.Ranks(), seconds, numQueries / seconds);
+
+    if (!p_opts.m_truthPath.empty()) {
+        auto ptr = f_createIO();
+        if (ptr == nullptr || !ptr->Initialize(p_opts.m_truthPath.c_str(), std::ios::in | std::ios::binary)) {
+            LOG(Helper::LogLevel::LL_Error, "Failed open truth file: %s\n", p_opts.m_truthPath.c_str());
+            return 1;
+        }
+        std::vector<std::set<SizeType>> truth;
+        int truthK = (p_opts.m_truthResultNum <= 0) ? K : p_opts.m_truthResultNum;
+        int originalK = truthK;
+        SizeType truthQueries = numQueries;
+        COMMON::TruthSet::LoadTruth(ptr, truth, truthQueries, originalK, truthK, p_opts.m_truthType);
+        double recall = 0;
+        for (SizeType q = 0; q < (std::min)(numQueries, (SizeType)truth.size()); q++) {
+            int found = 0;
+            for (int i = 0; i < K; i++) found += (int)truth[q].count(results[q][i].VID);
+            recall += (double)found / (std::min)(K, (int)(std::max)(truth[q].size(), (size_t)1));
+        }
+        LOG(Helper::LogLevel::LL_Info, "Recall%d@%d: %f\n", truthK, K, recall / (std::max)(numQueries, (SizeType)1));
+    }
+    return 0;
+}
+
+}  // namespace SPTAG::SSDServing::Sharded
+
+int main(int argc, char* argv[]) {
+    using namespace SPTAG;
+    MPI_Init(&argc, &argv);
+    if (argc < 3) {
+        LOG(Helper::LogLevel::LL_Error, "sharded build|search configFilePath\n");
+        MPI_Finalize();
+        return -1;
+    }
+    std::string mode(argv[1]);
+    SSDServing::Sharded::ConfigMap config;
+    SPANN::Options opts;
+    SSDServing::Sharded::ReadConfig(argv[2], config, opts);
+
+    int ret = -1;
+    switch (opts.m_valueType) {
+#define DefineVectorValueType(Name, Type)                                                                                                 \
+    case VectorValueType::Name:                                                                                                           \
+        ret = mode == "build" ? SSDServing::Sharded::Build<Type>(config, opts) : mode == "search" ? SSDServing::Sharded::Search<Type>(opts) \
+                                                                                                  : -1;                                   \
+        break;
+#include "Core/DefinitionList.h"
+#undef DefineVectorValueType
+        default:
+            LOG(Helper::LogLevel::LL_Error, "Unsupported value type.\n");
+            ret = 1;
+    }
+    if (ret == -1)
+        LOG(Helper::LogLevel::LL_Error, "Unknown mode %s, expected build or search\n", mode.c_str());
+    MPI_Finalize();
+    return ret;
+}
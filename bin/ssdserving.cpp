@@ -11,6 +11,7 @@
 #include "Core/Common/TruthSet.h"
 #include "Core/Common/QueryResultSet.h"
 #include "Core/SPANN/Index.h"
+#include "Helper/CoreServer.h"
 #include "Helper/SimpleIniReader.h"
 #include "Helper/VectorSetReader.h"
 #include "Helper/VectorSetReader.h"
@@ -149,10 +150,69 @@ void PrintPercentiles(const std::vector<V>& p_values, std::function<T(const V&)>
         collects[static_cast<size_t>(collects.size() - 1)]);
 }
 
+// one pinned worker per core of ServingCores, queries dealt to the workers' rings in turn
+template <typename ValueType>
+void SearchPerCore(SPANN::Index<ValueType>* p_index, const std::vector<int>& p_cores, std::vector<QueryResult>& p_results, std::vector<SPANN::SearchStats>& p_stats, int p_numQueries) {
+    std::vector<int> reactorCores;
+    const char* reactorMask = getenv("SPFRESH_SPDK_REACTOR_MASK");
+    if (reactorMask != nullptr && Helper::CoreMap::Parse(reactorMask, reactorCores) && Helper::CoreMap::Overlap(reactorCores, p_cores))
+        LOG(Helper::LogLevel::LL_Warning, "ServingCores overlap the SPDK reactor mask %s, search workers will compete with the reactors.\n", reactorMask);
+
+    LOG(Helper::LogLevel::LL_Info, "Searching: %d pinned workers, numQueries: %d.\n", (int)p_cores.size(), p_numQueries);
+
+    Utils::StopW sw;
+    std::atomic_int done(0);
+    {
+        Helper::CoreServer<int> server;
+        server.Start(
+            p_cores,
+            (size_t)(std::max)(p_index->GetOptions()->m_servingRingSize, 2),
+            [&](int, int& index) {
+                auto start = std::chrono::steady_clock::now();
+                p_index->GetMemoryIndex()->SearchIndex(p_results[index]);
+                auto headEnd = std::chrono::steady_clock::now();
+                p_index->SearchDiskIndex(p_results[index], &(p_stats[index]));
+                auto end = std::chrono::steady_clock::now();
+
+                p_stats[index].m_exLatency = Utils::getMsInterval(headEnd, end);
+                p_stats[index].m_totalLatency = p_stats[index].m_totalSearchLatency = Utils::getMsInterval(start, end);
+                done.fetch_add(1, std::memory_order_relaxed);
+            },
+            [&](int) { p_index->Initialize(); },
+            [&](int) { p_index->ExitBlockController(); });
+
+        for (int index = 0; index < p_numQueries; index++) {
+            if ((index & ((1 << 14) - 1)) == 0) {
+                LOG(Helper::LogLevel::LL_Info, "Sent %.2lf%%...\n", index * 100.0 / p_numQueries);
+            }
+            server.Submit(index);
+        }
+        while (done.load() < p_numQueries) std::this_thread::yield();
+    }
+
+    double sendingCost = sw.getElapsedSec();
+
+    LOG(Helper::LogLevel::LL_Info,
+        "Finish sending in %.3lf seconds, actuallQPS is %.2lf, query count %u.\n",
+        sendingCost,
+        p_numQueries / sendingCost,
+        static_cast<uint32_t>(p_numQueries));
+}
+
 template <typename ValueType>
 void SearchSequential(SPANN::Index<ValueType>* p_index, int p_numThreads, std::vector<QueryResult>& p_results, std::vector<SPANN::SearchStats>& p_stats, int p_maxQueryCount, int p_internalResultNum) {
     int numQueries = min(static_cast<int>(p_results.size()), p_maxQueryCount);
 
+    std::vector<int> cores;
+    if (!Helper::CoreMap::Parse(p_index->GetOptions()->m_servingCores, cores)) {
+        LOG(Helper::LogLevel::LL_Warning, "Cannot parse ServingCores %s, falling back to %d unpinned threads.\n", p_index->GetOptions()->m_servingCores.c_str(), p_numThreads);
+        cores.clear();
+    }
+    if (!cores.empty()) {
+        SearchPerCore(p_index, cores, p_results, p_stats, numQueries);
+        return;
+    }
+
     std::atomic_size_t queriesSent(0);
 
     std::vector<std::thread> threads;
@@ -563,6 +623,8 @@ int BootProgram(std::map<std::string, std::map<std::string, std::string>>* confi
     std::shared_ptr<SPTAG::SPANN::Index<std::uint8_t>> index_UInt8;
     std::shared_ptr<SPTAG::SPANN::Index<std::int16_t>> index_Int16;
     std::shared_ptr<SPTAG::SPANN::Index<float>> index_Float;
+    std::shared_ptr<SPTAG::SPANN::Index<SPTAG::Float16>> index_Float16;
+    std::shared_ptr<SPTAG::SPANN::Index<SPTAG::BFloat16>> index_BFloat16;
     switch (valueType) {
 #define DefineVectorValueType(Name, Type)                                                         \
     case SPTAG::VectorValueType::Name:                                                            \
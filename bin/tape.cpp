@@ -6,9 +6,13 @@
 #include "Helper/TracePlayer.h"
 #include "Helper/ResultWriter.h"
 
+#include <algorithm>
 #include <atomic>
+#include <chrono>
 #include <cstdint>
 #include <iostream>
+#include <mutex>
+#include <random>
 #include <string>
 #include <thread>
 #include <vector>
@@ -24,12 +28,23 @@ struct TapeConfig {
     std::string spdkMappingPath;// SPDK mapping file path
     int numThreads;             // Number of worker threads
     std::size_t windowSize;     // TracePlayer window size
+    std::size_t loaders;        // TracePlayer loader threads
+    std::size_t readAhead;      // TracePlayer chunks loaded ahead
     int insertQueries;          // Number of consecutive insert queries
     int searchQueries;          // Number of consecutive search queries
     int k;                      // Number of nearest neighbors for search
     int dimension;              // Vector dimension
+    std::string arrival;        // closed (workers as fast as they can), constant or poisson
+    double insertRate;          // Open loop inserts per second
+    double searchRate;          // Open loop searches per second
+    double slaP99Ms;            // Sweep for the highest rates whose P99 stays under this, 0 for no sweep
+    double stepSeconds;         // Length of one sweep step
+    double sweepFactor;         // Rate growth per sweep step until the SLA is missed
+    int sweepRefine;            // Bisection steps between the last good and the first bad rate
 };
 
+using Clock = std::chrono::steady_clock;
+
 // Hash function that creates alternating pattern of insertQueries inserts and searchQueries searches
 class AlternatingPatternHash {
 public:
@@ -56,6 +71,85 @@ private:
     int m_cycleLength;
 };
 
+// Spreads inserts evenly over the trace as insertShare of all operations, so open loop runs with
+// separate insert and search rates see the two kinds in the ratio of their rates
+class RatioPatternHash {
+public:
+    explicit RatioPatternHash(double insertShare) : m_share(insertShare) {}
+
+    std::uint64_t operator()(std::uint64_t seqNum) const {
+        // an insert wherever the running insert count steps up
+        return static_cast<std::uint64_t>((seqNum + 1) * m_share) > static_cast<std::uint64_t>(seqNum * m_share) ? 1 : 0;
+    }
+
+private:
+    double m_share;
+};
+
+// Send times of one operation kind in an open loop run, at fixed gaps or at exponential ones for a
+// Poisson process. They never depend on when earlier operations completed, so time spent queueing
+// behind a slow index shows up as latency instead of quietly lowering the offered load
+class ArrivalSchedule {
+public:
+    ArrivalSchedule(Clock::time_point start, double rate, bool poisson, std::uint64_t seed)
+        : m_start(start), m_rate(rate), m_poisson(poisson), m_rng(seed) {}
+
+    Clock::time_point Next() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        double offset = m_poisson ? m_offset : m_count / m_rate;
+        m_count++;
+        if (m_poisson)
+            m_offset += std::exponential_distribution<double>(m_rate)(m_rng);
+        return m_start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(offset));
+    }
+
+private:
+    Clock::time_point m_start;
+    double m_rate;
+    bool m_poisson;
+    std::mutex m_lock;
+    std::mt19937_64 m_rng;
+    std::uint64_t m_count = 0;
+    double m_offset = 0;
+};
+
+// Latencies in nanoseconds in the log-linear buckets of the stage histograms
+struct LatencyHistogram {
+    std::vector<std::uint64_t> buckets = std::vector<std::uint64_t>(SPANN::StageBuckets::kCount, 0);
+    std::uint64_t count = 0;
+    std::uint64_t maxNs = 0;
+
+    void Add(std::uint64_t ns) {
+        buckets[SPANN::StageBuckets::Of(ns)]++;
+        count++;
+        maxNs = std::max(maxNs, ns);
+    }
+
+    void Merge(const LatencyHistogram& other) {
+        for (std::size_t b = 0; b < buckets.size(); ++b) buckets[b] += other.buckets[b];
+        count += other.count;
+        maxNs = std::max(maxNs, other.maxNs);
+    }
+
+    double PercentileMs(double fraction) const {
+        if (count == 0) return 0;
+        std::uint64_t rank = std::min(static_cast<std::uint64_t>(fraction * count), count - 1), seen = 0;
+        for (std::size_t b = 0; b < buckets.size(); ++b) {
+            seen += buckets[b];
+            if (seen > rank) return (SPANN::StageBuckets::Low(b) + SPANN::StageBuckets::Width(b) / 2.0) / 1e6;
+        }
+        return maxNs / 1e6;
+    }
+};
+
+// Outcome of one open loop run at fixed rates, index 0 for inserts and 1 for searches
+struct PhaseResult {
+    LatencyHistogram response[2];  // from the scheduled send time, queueing included
+    LatencyHistogram service[2];   // from the actual start
+    double seconds = 0;
+    bool exhausted = false;
+};
+
 template <typename T>
 bool RunTapeTest(const TapeConfig& config) {
     std::cout << "=== Tape Test ===" << std::endl;
@@ -66,6 +160,7 @@ bool RunTapeTest(const TapeConfig& config) {
     std::cout << "Window size: " << config.windowSize << std::endl;
     std::cout << "Insert queries per cycle: " << config.insertQueries << std::endl;
     std::cout << "Search queries per cycle: " << config.searchQueries << std::endl;
+    std::cout << "Arrival: " << config.arrival << std::endl;
     std::cout << "K: " << config.k << std::endl;
 
     // ========================================
@@ -125,13 +220,16 @@ bool RunTapeTest(const TapeConfig& config) {
     // ========================================
     std::cout << "\n[2] Creating TracePlayer from " << config.traceFile << "..." << std::endl;
 
-    AlternatingPatternHash hashFn(config.insertQueries, config.searchQueries);
-    Helper::TracePlayer<T> player(config.traceFile, config.windowSize, hashFn);
+    bool openLoop = config.arrival != "closed";
+    typename Helper::TracePlayer<T>::HashFunction hashFn = AlternatingPatternHash(config.insertQueries, config.searchQueries);
+    if (openLoop) hashFn = RatioPatternHash(config.insertRate / (config.insertRate + config.searchRate));
+    Helper::TracePlayer<T> player(config.traceFile, config.windowSize, hashFn, config.loaders, config.readAhead);
 
     std::cout << "TracePlayer initialized:" << std::endl;
     std::cout << "  Total vectors: " << player.GetTotalVectors() << std::endl;
     std::cout << "  Dimension: " << player.GetDimension() << std::endl;
     std::cout << "  Window size: " << player.GetWindowSize() << std::endl;
+    std::cout << "  Read-ahead: " << config.readAhead << " chunks of " << player.GetChunkVectors() << " vectors, " << config.loaders << " loader(s)" << std::endl;
 
     // Verify dimension matches
     if (player.GetDimension() != static_cast<std::size_t>(index->GetFeatureDim())) {
@@ -149,89 +247,214 @@ bool RunTapeTest(const TapeConfig& config) {
 
     std::cout << "ResultWriter initialized:" << std::endl;
     std::cout << "  K: " << writer.GetK() << std::endl;
-    std::cout << "  Num slots: " << writer.GetNumSlots() << std::endl;
+    std::cout << "  Records per thread buffer: " << writer.GetNumSlots() << std::endl;
 
     // ========================================
-    // Step 4: Launch worker threads
+    // Step 4: Replay the trace, closed or open loop
     // ========================================
-    std::cout << "\n[4] Launching " << config.numThreads << " worker threads..." << std::endl;
-
     std::atomic<std::size_t> insertCount{0};
     std::atomic<std::size_t> searchCount{0};
     std::atomic<bool> hasError{false};
 
-    auto workerFunc = [&]() {
-        // Per-thread SPDK initialization (required!)
-        index->Initialize();
+    // Runs one trace record against the index and logs its result
+    auto execute = [&](const Helper::TraceRecord<T>& record) {
+        std::size_t seqNum = record.SequenceNumber();
+        const T* data = record.Data();
+        std::size_t dim = record.Dimension();
+
+        if (record.GetOperationKind() == Helper::OperationKind::Write) {
+            // Insert operation
+            SizeType vid;
+            ErrorCode err = index->AddIndexSPFresh(data, 1, static_cast<DimensionType>(dim), &vid);
+            if (err != ErrorCode::Success) {
+                std::cerr << "Insert failed for seqNum " << seqNum << ": " << static_cast<int>(err) << std::endl;
+                hasError.store(true);
+                return;
+            }
 
-        while (true) {
-            // Get next trace record
-            auto guard = player.Next();
-            if (!guard) {
-                // Trace exhausted
-                break;
+            // Write insert result
+            writer.WriteInsertRecord(static_cast<std::uint64_t>(seqNum),
+                                    static_cast<std::uint64_t>(vid));
+            insertCount.fetch_add(1, std::memory_order_relaxed);
+        } else {
+            // Search operation
+            COMMON::QueryResultSet<T> query(data, config.k);
+            query.Reset();
+
+            ErrorCode err = index->SearchIndex(query);
+            if (err != ErrorCode::Success) {
+                std::cerr << "Search failed for seqNum " << seqNum << ": " << static_cast<int>(err) << std::endl;
+                hasError.store(true);
+                return;
             }
 
-            const auto& record = **guard;
-            std::size_t seqNum = record.SequenceNumber();
-            const T* data = record.Data();
-            std::size_t dim = record.Dimension();
-
-            if (record.GetOperationKind() == Helper::OperationKind::Write) {
-                // Insert operation
-                SizeType vid;
-                ErrorCode err = index->AddIndexSPFresh(data, 1, static_cast<DimensionType>(dim), &vid);
-                if (err != ErrorCode::Success) {
-                    std::cerr << "Insert failed for seqNum " << seqNum << ": " << static_cast<int>(err) << std::endl;
-                    hasError.store(true);
-                    continue;
-                }
+            // Collect result IDs
+            std::vector<std::uint64_t> resultIds(config.k);
+            for (int i = 0; i < config.k; ++i) {
+                BasicResult* result = query.GetResult(i);
+                resultIds[i] = (result && result->VID >= 0)
+                               ? static_cast<std::uint64_t>(result->VID)
+                               : static_cast<std::uint64_t>(-1);
+            }
 
-                // Write insert result
-                writer.WriteInsertRecord(static_cast<std::uint64_t>(seqNum),
-                                        static_cast<std::uint64_t>(vid));
-                insertCount.fetch_add(1, std::memory_order_relaxed);
-            } else {
-                // Search operation
-                COMMON::QueryResultSet<T> query(data, config.k);
-                query.Reset();
-
-                ErrorCode err = index->SearchIndex(query);
-                if (err != ErrorCode::Success) {
-                    std::cerr << "Search failed for seqNum " << seqNum << ": " << static_cast<int>(err) << std::endl;
-                    hasError.store(true);
-                    continue;
-                }
+            // Write search result
+            writer.WriteSearchRecord(static_cast<std::uint64_t>(seqNum), resultIds.data());
+            searchCount.fetch_add(1, std::memory_order_relaxed);
+        }
+    };
 
-                // Collect result IDs
-                std::vector<std::uint64_t> resultIds(config.k);
-                for (int i = 0; i < config.k; ++i) {
-                    BasicResult* result = query.GetResult(i);
-                    resultIds[i] = (result && result->VID >= 0)
-                                   ? static_cast<std::uint64_t>(result->VID)
-                                   : static_cast<std::uint64_t>(-1);
+    // Open loop at the given rates for the given time, 0 for the rest of the trace. Every record is
+    // sent at its scheduled time whether or not earlier ones are done, so the threads only bound
+    // the concurrency; when all of them are busy the wait counts towards the latency
+    auto runPhase = [&](double insertRate, double searchRate, double seconds) {
+        PhaseResult phase;
+        Clock::time_point start = Clock::now() + std::chrono::milliseconds(10);
+        Clock::time_point end = seconds > 0 ? start + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(seconds)) : Clock::time_point::max();
+        bool poisson = config.arrival == "poisson";
+        ArrivalSchedule inserts(start, std::max(insertRate, 1e-9), poisson, 1), searches(start, std::max(searchRate, 1e-9), poisson, 2);
+        std::vector<PhaseResult> perThread(config.numThreads);
+        std::atomic<bool> exhausted{false};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < config.numThreads; ++t) {
+            threads.emplace_back([&, t]() {
+                index->Initialize();
+                PhaseResult& local = perThread[t];
+                while (true) {
+                    auto guard = player.Next();
+                    if (!guard) {
+                        exhausted.store(true);
+                        break;
+                    }
+                    int kind = (*guard)->GetOperationKind() == Helper::OperationKind::Write ? 0 : 1;
+                    Clock::time_point send = (kind == 0 ? inserts : searches).Next();
+                    // a record scheduled past the end still runs, the trace has to stay complete
+                    bool last = send >= end;
+                    if (!last) std::this_thread::sleep_until(send);
+                    Clock::time_point begin = Clock::now();
+                    execute(**guard);
+                    Clock::time_point done = Clock::now();
+                    if (last) break;
+                    local.response[kind].Add(std::chrono::duration_cast<std::chrono::nanoseconds>(done - send).count());
+                    local.service[kind].Add(std::chrono::duration_cast<std::chrono::nanoseconds>(done - begin).count());
                 }
-
-                // Write search result
-                writer.WriteSearchRecord(static_cast<std::uint64_t>(seqNum), resultIds.data());
-                searchCount.fetch_add(1, std::memory_order_relaxed);
+                index->ExitBlockController();
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        for (auto& local : perThread) {
+            for (int kind = 0; kind < 2; ++kind) {
+                phase.response[kind].Merge(local.response[kind]);
+                phase.service[kind].Merge(local.service[kind]);
             }
         }
+        // an overloaded step runs on past its end until the backlog scheduled in it is served
+        phase.seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        phase.exhausted = exhausted.load();
+        return phase;
+    };
 
-        // Signal thread completion to SPDK
-        index->ExitBlockController();
+    auto reportPhase = [&](const PhaseResult& phase, double insertRate, double searchRate) {
+        const char* names[2] = {"insert", "search"};
+        double rates[2] = {insertRate, searchRate};
+        for (int kind = 0; kind < 2; ++kind) {
+            if (rates[kind] <= 0) continue;
+            const LatencyHistogram& response = phase.response[kind];
+            std::cout << "  " << names[kind] << ": offered " << rates[kind] << "/s, achieved " << response.count / std::max(phase.seconds, 1e-9)
+                      << "/s, latency P50 " << response.PercentileMs(0.5) << " ms, P99 " << response.PercentileMs(0.99)
+                      << " ms, P99.9 " << response.PercentileMs(0.999) << " ms, max " << response.maxNs / 1e6
+                      << " ms (service P99 " << phase.service[kind].PercentileMs(0.99) << " ms)" << std::endl;
+        }
     };
 
-    // Launch threads
-    std::vector<std::thread> threads;
-    threads.reserve(config.numThreads);
-    for (int i = 0; i < config.numThreads; ++i) {
-        threads.emplace_back(workerFunc);
-    }
+    // Rates are sustainable when every kind keeps its P99 under the SLA and the index kept up
+    // with the offered load instead of falling behind
+    auto meetsSla = [&](const PhaseResult& phase, double insertRate, double searchRate) {
+        double rates[2] = {insertRate, searchRate};
+        for (int kind = 0; kind < 2; ++kind) {
+            if (rates[kind] <= 0) continue;
+            if (phase.response[kind].PercentileMs(0.99) > config.slaP99Ms) return false;
+            if (phase.response[kind].count < 0.95 * rates[kind] * phase.seconds) return false;
+        }
+        return true;
+    };
+
+    // Closed loop: every thread takes the next record as soon as its previous one is done
+    auto runClosed = [&]() {
+        auto workerFunc = [&]() {
+            // Per-thread SPDK initialization (required!)
+            index->Initialize();
+
+            while (true) {
+                // Get next trace record
+                auto guard = player.Next();
+                if (!guard) {
+                    // Trace exhausted
+                    break;
+                }
+                execute(**guard);
+            }
+
+            // Signal thread completion to SPDK
+            index->ExitBlockController();
+        };
+
+        // Launch threads
+        std::vector<std::thread> threads;
+        threads.reserve(config.numThreads);
+        for (int i = 0; i < config.numThreads; ++i) {
+            threads.emplace_back(workerFunc);
+        }
+
+        // Join threads
+        for (auto& t : threads) {
+            t.join();
+        }
+    };
 
-    // Join threads
-    for (auto& t : threads) {
-        t.join();
+    if (!openLoop) {
+        std::cout << "\n[4] Launching " << config.numThreads << " worker threads..." << std::endl;
+        runClosed();
+    } else if (config.slaP99Ms <= 0) {
+        std::cout << "\n[4] Open loop (" << config.arrival << ") at " << config.insertRate << " inserts/s and " << config.searchRate
+                  << " searches/s on " << config.numThreads << " threads..." << std::endl;
+        PhaseResult phase = runPhase(config.insertRate, config.searchRate, 0);
+        reportPhase(phase, config.insertRate, config.searchRate);
+    } else {
+        // Rates grow by sweepFactor until a step misses the SLA, then bisect between the last good
+        // and the first bad scale. Each step replays the next stretch of the trace
+        std::cout << "\n[4] Sweeping for P99 <= " << config.slaP99Ms << " ms, " << config.stepSeconds << " s per step on "
+                  << config.numThreads << " threads..." << std::endl;
+        double scale = 1, good = 0, bad = 0;
+        int refined = 0;
+        while (true) {
+            double insertRate = config.insertRate * scale, searchRate = config.searchRate * scale;
+            PhaseResult phase = runPhase(insertRate, searchRate, config.stepSeconds);
+            if (phase.exhausted) {
+                std::cout << "  trace exhausted during the step at scale " << scale << ", stopping" << std::endl;
+                break;
+            }
+            bool ok = meetsSla(phase, insertRate, searchRate);
+            std::cout << "  step x" << scale << (ok ? " meets" : " misses") << " the SLA" << std::endl;
+            reportPhase(phase, insertRate, searchRate);
+            if (ok) good = scale; else bad = scale;
+            if (bad == 0) {
+                scale *= config.sweepFactor;
+            } else if (good == 0) {
+                scale /= config.sweepFactor;
+                if (scale < 1e-3) break;
+            } else {
+                if (refined++ >= config.sweepRefine) break;
+                scale = (good + bad) / 2;
+            }
+        }
+        if (good > 0) {
+            std::cout << "Max sustainable: " << config.insertRate * good << " inserts/s + " << config.searchRate * good
+                      << " searches/s at P99 <= " << config.slaP99Ms << " ms" << std::endl;
+        } else {
+            std::cout << "No rate met P99 <= " << config.slaP99Ms << " ms" << std::endl;
+        }
+        // the rest of the trace still goes in, so the result log stays complete
+        runClosed();
     }
 
     // Wait for background operations to complete
@@ -268,10 +491,19 @@ void PrintUsage(const char* progName) {
     std::cerr << "  --spdk-map <file>    SPDK mapping file path" << std::endl;
     std::cerr << "  --threads <n>        Number of worker threads (default: 4)" << std::endl;
     std::cerr << "  --window <n>         TracePlayer window size (default: 64)" << std::endl;
+    std::cerr << "  --loaders <n>        TracePlayer loader threads (default: 1)" << std::endl;
+    std::cerr << "  --read-ahead <n>     TracePlayer chunks loaded ahead (default: 8)" << std::endl;
     std::cerr << "  --insert <n>         Consecutive insert queries per cycle (default: 1)" << std::endl;
     std::cerr << "  --search <n>         Consecutive search queries per cycle (default: 1)" << std::endl;
     std::cerr << "  --k <n>              Number of nearest neighbors (default: 10)" << std::endl;
     std::cerr << "  --dim <n>            Vector dimension (default: 128)" << std::endl;
+    std::cerr << "  --arrival <mode>     closed, constant or poisson (default: closed)" << std::endl;
+    std::cerr << "  --insert-rate <r>    Open loop inserts per second" << std::endl;
+    std::cerr << "  --search-rate <r>    Open loop searches per second" << std::endl;
+    std::cerr << "  --sla-p99-ms <ms>    Sweep the rates for the highest ones meeting this P99 (default: off)" << std::endl;
+    std::cerr << "  --step-seconds <s>   Sweep step length (default: 30)" << std::endl;
+    std::cerr << "  --sweep-factor <f>   Sweep rate growth per step (default: 1.5)" << std::endl;
+    std::cerr << "  --sweep-refine <n>   Sweep bisection steps (default: 4)" << std::endl;
 }
 
 int main(int argc, char* argv[]) {
@@ -279,10 +511,19 @@ int main(int argc, char* argv[]) {
     config.indexDir = "./tape_index";
     config.numThreads = 4;
     config.windowSize = 64;
+    config.loaders = 1;
+    config.readAhead = 8;
     config.insertQueries = 1;
     config.searchQueries = 1;
     config.k = 10;
     config.dimension = 128;
+    config.arrival = "closed";
+    config.insertRate = 0;
+    config.searchRate = 0;
+    config.slaP99Ms = 0;
+    config.stepSeconds = 30;
+    config.sweepFactor = 1.5;
+    config.sweepRefine = 4;
 
     // Parse command line arguments
     for (int i = 1; i < argc; ++i) {
@@ -301,6 +542,10 @@ int main(int argc, char* argv[]) {
             config.numThreads = std::stoi(argv[++i]);
         } else if (arg == "--window" && i + 1 < argc) {
             config.windowSize = std::stoull(argv[++i]);
+        } else if (arg == "--loaders" && i + 1 < argc) {
+            config.loaders = std::stoull(argv[++i]);
+        } else if (arg == "--read-ahead" && i + 1 < argc) {
+            config.readAhead = std::stoull(argv[++i]);
         } else if (arg == "--insert" && i + 1 < argc) {
             config.insertQueries = std::stoi(argv[++i]);
         } else if (arg == "--search" && i + 1 < argc) {
@@ -309,6 +554,20 @@ int main(int argc, char* argv[]) {
             config.k = std::stoi(argv[++i]);
         } else if (arg == "--dim" && i + 1 < argc) {
             config.dimension = std::stoi(argv[++i]);
+        } else if (arg == "--arrival" && i + 1 < argc) {
+            config.arrival = argv[++i];
+        } else if (arg == "--insert-rate" && i + 1 < argc) {
+            config.insertRate = std::stod(argv[++i]);
+        } else if (arg == "--search-rate" && i + 1 < argc) {
+            config.searchRate = std::stod(argv[++i]);
+        } else if (arg == "--sla-p99-ms" && i + 1 < argc) {
+            config.slaP99Ms = std::stod(argv[++i]);
+        } else if (arg == "--step-seconds" && i + 1 < argc) {
+            config.stepSeconds = std::stod(argv[++i]);
+        } else if (arg == "--sweep-factor" && i + 1 < argc) {
+            config.sweepFactor = std::stod(argv[++i]);
+        } else if (arg == "--sweep-refine" && i + 1 < argc) {
+            config.sweepRefine = std::stoi(argv[++i]);
         } else if (arg == "--help" || arg == "-h") {
             PrintUsage(argv[0]);
             return 0;
@@ -327,6 +586,19 @@ int main(int argc, char* argv[]) {
         return 1;
     }
 
+    if (config.arrival != "closed" && config.arrival != "constant" && config.arrival != "poisson") {
+        std::cerr << "Error: --arrival must be closed, constant or poisson" << std::endl;
+        return 1;
+    }
+    if (config.arrival != "closed" && (config.insertRate < 0 || config.searchRate < 0 || config.insertRate + config.searchRate <= 0)) {
+        std::cerr << "Error: open loop needs --insert-rate and/or --search-rate" << std::endl;
+        return 1;
+    }
+    if (config.slaP99Ms > 0 && (config.arrival == "closed" || config.stepSeconds <= 0 || config.sweepFactor <= 1)) {
+        std::cerr << "Error: a sweep needs an open loop --arrival, --step-seconds > 0 and --sweep-factor > 1" << std::endl;
+        return 1;
+    }
+
     // Run the test
     bool success = RunTapeTest<float>(config);
 
@@ -19,12 +19,16 @@
 #include "Core/Common/RelativeNeighborhoodGraph.h"
 #include "Core/Common/BKTree.h"
 #include "Core/Common/Labelset.h"
+#include "Core/Common/SQ8Quantizer.h"
 #include "Helper/SimpleIniReader.h"
 #include "Helper/StringConvert.h"
 #include "Helper/ThreadPool.h"
 
+#include <atomic>
 #include <functional>
+#include <mutex>
 #include <shared_mutex>
+#include <vector>
 
 namespace SPTAG::Helper {
 class IniReader;
@@ -48,6 +52,17 @@ class Index {
         DistCalcMethod m_distMethod;
     };
 
+    class LinkStagedJob : public Helper::ThreadPool::Job {
+       public:
+        LinkStagedJob(Index<T>* p_index) : m_index(p_index) {}
+        void exec(IAbortOperation* p_abort) {
+            m_index->LinkStaged(p_abort);
+        }
+
+       private:
+        Index<T>* m_index;
+    };
+
    protected:
     bool m_bReady = false;
     std::shared_ptr<MetadataSet> m_pMetadata;
@@ -84,10 +99,20 @@ class Index {
 
     int m_addCountForRebuild;
     float m_fDeletePercentageForRefine;
-    std::mutex m_dataAddLock;  // protect data and graph
+    // appends hold it shared and reserve their rows lock-free, save, refine and the first build
+    // hold it exclusive
+    std::shared_timed_mutex m_dataAddLock;
     std::shared_timed_mutex m_dataDeleteLock;
     COMMON::Labelset m_deletedID;
 
+    // nodes added by StageIndexIdx that are not linked into the graph yet; searches scan them
+    // directly until LinkStaged has refined them in
+    std::vector<SizeType> m_stagedNodes;
+    mutable std::shared_timed_mutex m_stagedLock;
+    std::atomic<SizeType> m_stagedCount{0};
+    std::atomic<bool> m_linkJobQueued{false};
+    std::mutex m_stagedLinkLock;
+
     Helper::ThreadPool m_threadPool;
     int m_iNumberOfThreads;
 
@@ -95,6 +120,19 @@ class Index {
     std::function<float(const T*, const T*, DimensionType)> m_fComputeDistance;
     int m_iBaseSquare;
 
+    // allocation of the vectors, graph and labels, applied before they are built or loaded
+    int m_iHugePageMB;
+    std::string m_sNumaPlacement;
+    COMMON::MemoryPolicy m_memoryPolicy;
+
+    // SQ8 copy of m_pSamples walked instead of the full vectors when m_bQuantizedSearch is set,
+    // rebuilt from m_pSamples after load, build and refine and never saved
+    bool m_bQuantizedSearch;
+    int m_iQuantizedRecheck;
+    COMMON::SQ8Quantizer m_quantizer;
+    COMMON::Dataset<std::int8_t> m_pQuantizedSamples;
+    std::function<float(const std::int8_t*, const std::int8_t*, DimensionType)> m_fComputeQuantizedDistance;
+
     int m_iMaxCheck;
     int m_iThresholdOfNumberOfContinuousNoBetterPropagation;
     int m_iNumberOfInitialDynamicPivots;
@@ -116,8 +154,9 @@ class Index {
 #undef DefineBKTParameter
 
         m_pSamples.SetName("Vector");
+        m_pQuantizedSamples.SetName("QuantizedVector");
         m_fComputeDistance = std::function<float(const T*, const T*, DimensionType)>(COMMON::DistanceCalcSelector<T>(m_iDistCalcMethod));
-        m_iBaseSquare = (m_iDistCalcMethod == DistCalcMethod::Cosine) ? COMMON::Utils::GetBase<T>() * COMMON::Utils::GetBase<T>() : 1;
+        m_iBaseSquare = (m_iDistCalcMethod != DistCalcMethod::L2) ? COMMON::Utils::GetBase<T>() * COMMON::Utils::GetBase<T>() : 1;
     }
 
     ~Index() {}
@@ -220,6 +259,10 @@ class Index {
 
     static void SortSelections(std::vector<Edge>* selections);
 
+    // with NumaPlacement Replicate, copy the vectors and graph to every NUMA node so that searches
+    // read the copy of their socket. Called after load, the index must not be updated afterwards
+    ErrorCode ReplicatePerNode();
+
     std::string GetParameter(const std::string& p_param, const std::string& p_section = "Index") const;
     ErrorCode SetParameter(const std::string& p_param, const std::string& p_value, const std::string& p_section = "Index");
 
@@ -239,9 +282,21 @@ class Index {
     ErrorCode BuildIndex(const void* p_data, SizeType p_vectorNum, DimensionType p_dimension, bool p_normalized = false, bool p_shareOwnership = false);
     ErrorCode SearchIndex(QueryResult& p_query, bool p_searchDeleted = false) const;
     ErrorCode RefineSearchIndex(QueryResult& p_query, bool p_searchDeleted = false) const;
+    // every sample in the tree's depth-first order, the order graph refinement walks the nodes in
+    inline void GetTreeOrder(std::vector<SizeType>& p_order) const {
+        m_pTrees.DepthFirstOrder(GetNumSamples(), p_order);
+    }
     ErrorCode SearchTree(QueryResult& p_query) const;
     ErrorCode AddIndex(const void* p_data, SizeType p_vectorNum, DimensionType p_dimension, std::shared_ptr<MetadataSet> p_metadataSet, bool p_withMetaIndex = false, bool p_normalized = false);
     ErrorCode AddIndexIdx(SizeType begin, SizeType end);
+    // make [begin, end) searchable right away and link it into the graph on the background pool
+    ErrorCode StageIndexIdx(SizeType begin, SizeType end);
+    // link every staged node before returning
+    void FlushStaged();
+
+    inline SizeType GetStagedNum() const {
+        return m_stagedCount.load();
+    }
     ErrorCode AddIndexId(const void* p_data, SizeType p_vectorNum, DimensionType p_dimension, int& beginHead, int& endHead);
 
     ErrorCode DeleteIndex(const void* p_vectors, SizeType p_vectorNum);
@@ -257,10 +312,38 @@ class Index {
     ErrorCode MergeIndex(Index<T>* p_addindex, int p_threadnum, IAbortOperation* p_abort);
 
    private:
-    void SearchIndex(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, bool p_searchDeleted, bool p_searchDuplicated, std::function<bool(const ByteArray&)> filterFunc = nullptr) const;
+    void LinkStaged(IAbortOperation* p_abort);
+
+    // p_quantized walks m_pQuantizedSamples; graph refinement always searches the full vectors
+    void SearchIndex(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, bool p_searchDeleted, bool p_searchDuplicated, bool p_quantized, std::function<bool(const ByteArray&)> filterFunc = nullptr) const;
 
     template <bool (*notDeleted)(const COMMON::Labelset&, SizeType), bool (*isDup)(COMMON::QueryResultSet<T>&, SizeType, float), bool (*checkFilter)(const std::shared_ptr<MetadataSet>&, SizeType, std::function<bool(const ByteArray&)>)>
-    void Search(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, std::function<bool(const ByteArray&)> filterFunc) const;
+    void Search(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, bool p_quantized, std::function<bool(const ByteArray&)> filterFunc) const;
+
+    // graph walk over p_data, distances to p_target fill p_query
+    template <typename S, bool (*notDeleted)(const COMMON::Labelset&, SizeType), bool (*isDup)(COMMON::QueryResultSet<T>&, SizeType, float), bool (*checkFilter)(const std::shared_ptr<MetadataSet>&, SizeType, std::function<bool(const ByteArray&)>)>
+    void SearchGraph(const COMMON::Dataset<S>& p_data, const std::function<float(const S*, const S*, DimensionType)>& p_fComputeDistance, COMMON::QueryResultSet<S>& p_target, COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, std::function<bool(const ByteArray&)> filterFunc) const;
+
+    // train the quantizer on m_pSamples and encode all of them
+    void BuildQuantizedSamples();
+
+    // the distance kernel of the samples' dimension, picked again once it is known
+    void BindDistanceKernel() {
+        m_fComputeDistance = COMMON::DistanceCalcSelector<T>(m_iDistCalcMethod, m_pSamples.C());
+    }
+
+    // hand HugePageMB and NumaPlacement to the datasets before they allocate
+    void ApplyMemoryPolicy();
+
+    // encode rows [p_begin, p_end) of m_pSamples into slots already added to m_pQuantizedSamples
+    void EncodeQuantizedSamples(SizeType p_begin, SizeType p_end);
+
+    // add p_vectorNum rows to every dataset, numbered from p_begin which the first of them hands out
+    ErrorCode AppendRows(const void* p_data, SizeType p_vectorNum, SizeType& p_begin);
+
+    inline bool UseQuantizedSamples() const {
+        return m_bQuantizedSearch && m_pQuantizedSamples.R() > 0;
+    }
 };
 
 // Estimation methods (BKT-specific)
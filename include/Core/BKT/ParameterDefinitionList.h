@@ -15,6 +15,8 @@ DefineBKTParameter(m_pTrees.m_iBKTKmeansK, int, 32L, "BKTKmeansK")
 DefineBKTParameter(m_pTrees.m_iBKTLeafSize, int, 8L, "BKTLeafSize")
 DefineBKTParameter(m_pTrees.m_iSamples, int, 1000L, "Samples")
 DefineBKTParameter(m_pTrees.m_fBalanceFactor, float, 100.0F, "BKTLambdaFactor")
+DefineBKTParameter(m_pTrees.m_iKmeansBatch, int, 0L, "BKTKmeansBatch")  // > 0 trains the tree kmeans on mini-batches of this size
+DefineBKTParameter(m_pTrees.m_fKmeansTolerance, float, 1e-3F, "BKTKmeansTolerance")  // center movement at which the kmeans stops
 
 DefineBKTParameter(m_pGraph.m_iTPTNumber, int, 32L, "TPTNumber")
 DefineBKTParameter(m_pGraph.m_iTPTLeafSize, int, 2000L, "TPTLeafSize")
@@ -50,5 +52,9 @@ DefineBKTParameter(m_iHashTableExp, int, 2L, "HashTableExponent")
 DefineBKTParameter(m_iDataBlockSize, int, 1024 * 1024, "DataBlockSize")
 DefineBKTParameter(m_iDataCapacity, int, MaxSize, "DataCapacity")
 DefineBKTParameter(m_iMetaRecordSize, int, 10, "MetaRecordSize")
+DefineBKTParameter(m_iHugePageMB, int, 0L, "HugePageMB")  // 2 or 1024 puts vectors and graph on huge pages
+DefineBKTParameter(m_sNumaPlacement, std::string, std::string("Local"), "NumaPlacement")  // Local, Interleave or Replicate (read-only indexes)
+DefineBKTParameter(m_bQuantizedSearch, bool, false, "QuantizedSearch")
+DefineBKTParameter(m_iQuantizedRecheck, int, 0L, "QuantizedRecheck")
 
 #endif
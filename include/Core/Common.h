@@ -14,6 +14,7 @@
 #include <cmath>
 #include "Helper/Logging.h"
 #include "Helper/DiskIO.h"
+#include "Core/Float16.h"
 
 #include <stdio.h>
 #include <unistd.h>
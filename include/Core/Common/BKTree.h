@@ -14,6 +14,7 @@
 #include "WorkSpace.h"
 #include "Dataset.h"
 #include "Utils/DistanceUtils.h"
+#include "Helper/TaskScheduler.h"
 
 namespace SPTAG::COMMON {
 // node type for storing BKT
@@ -43,10 +44,21 @@ struct KmeansArgs {
     float* clusterDist;
     float* weightedCounts;
     float* newWeightedCounts;
+    // mini-batch mode: _batch vectors a pass, centers move by the running mean of everything they were assigned
+    int _batch = 0;
+    int _maxIter = 100;
+    float _tolerance = 1e-3f;
+    int _patience = 5;
+    float* floatCenters;
+    float* seenCounts;
+    const void** centerPtrs;
+    float* dists;
     std::function<float(const T*, const T*, DimensionType)> fComputeDistance;
+    DistanceBatchReturn<T> fComputeDistanceBatch;
 
     KmeansArgs(int k, DimensionType dim, SizeType datasize, int threadnum, DistCalcMethod distMethod) : _K(k), _DK(k), _D(dim), _RD(dim), _T(threadnum), _M(distMethod) {
         fComputeDistance = COMMON::DistanceCalcSelector<T>(distMethod);
+        fComputeDistanceBatch = COMMON::DistanceBatchSelector<T>(distMethod);
 
         centers = (T*)ALIGN_ALLOC(sizeof(T) * _K * _D);
         newTCenters = (T*)ALIGN_ALLOC(sizeof(T) * _K * _D);
@@ -58,6 +70,20 @@ struct KmeansArgs {
         clusterDist = new float[_T * _K];
         weightedCounts = new float[_K];
         newWeightedCounts = new float[_T * _K];
+        floatCenters = new float[_K * _RD];
+        seenCounts = new float[_K];
+        centerPtrs = new const void*[_K];
+        dists = new float[_T * _K];
+        for (int i = 0; i < _K; i++) centerPtrs[i] = centers + i * _D;
+
+        // every slice is first touched by a task of the shared scheduler, the way KmeansAssign uses
+        // them, rather than all by the constructing thread
+        Helper::TaskScheduler::Instance().Run(_T, [this](int tid) {
+            memset(newCenters + (size_t)tid * _K * _RD, 0, sizeof(float) * _K * _RD);
+            memset(newCounts + tid * _K, 0, sizeof(SizeType) * _K);
+            memset(newWeightedCounts + tid * _K, 0, sizeof(float) * _K);
+            memset(dists + tid * _K, 0, sizeof(float) * _K);
+        });
     }
 
     ~KmeansArgs() {
@@ -71,6 +97,10 @@ struct KmeansArgs {
         delete[] clusterDist;
         delete[] weightedCounts;
         delete[] newWeightedCounts;
+        delete[] floatCenters;
+        delete[] seenCounts;
+        delete[] centerPtrs;
+        delete[] dists;
     }
 
     inline void ClearCounts() {
@@ -176,6 +206,52 @@ float RefineCenters(const Dataset<T>& data, KmeansArgs<T>& args) {
     return diff;
 }
 
+// mini-batch update: each center moves to the mean of all vectors it has been assigned so far,
+// centers never assigned are reseeded like in RefineCenters
+template <typename T, typename R>
+float RefineMiniBatchCenters(const Dataset<T>& data, KmeansArgs<T>& args) {
+    int maxcluster = -1;
+    SizeType maxCount = 0;
+    for (int k = 0; k < args._DK; k++) {
+        if (args.counts[k] > maxCount && args.newCounts[k] > 0 && args.clusterIdx[k] >= 0) {
+            maxcluster = k;
+            maxCount = args.counts[k];
+        }
+    }
+
+    float diff = 0;
+    for (int k = 0; k < args._DK; k++) {
+        T* TCenter = args.newTCenters + k * args._D;
+        float* floatCenter = args.floatCenters + k * args._RD;
+        if (args.counts[k] == 0) {
+            if (args.seenCounts[k] == 0 && maxcluster != -1) {
+                const R* seed = (const R*)data[args.clusterIdx[maxcluster]];
+                for (DimensionType j = 0; j < args._RD; j++) floatCenter[j] = (float)seed[j];
+            }
+        } else {
+            float seen = args.seenCounts[k];
+            float total = seen + args.counts[k];
+            float* batchSum = args.newCenters + k * args._RD;
+            for (DimensionType j = 0; j < args._RD; j++) floatCenter[j] = (floatCenter[j] * seen + batchSum[j]) / total;
+            args.seenCounts[k] = total;
+            if (args._M == DistCalcMethod::Cosine) {
+                COMMON::Utils::Normalize(floatCenter, args._RD, COMMON::Utils::GetBase<T>());
+            }
+        }
+        for (DimensionType j = 0; j < args._D; j++) TCenter[j] = (T)(floatCenter[j]);
+        diff += DistanceUtils::ComputeDistance(TCenter, args.centers + k * args._D, args._D, DistCalcMethod::L2);
+    }
+    return diff;
+}
+
+// move a uniform random choice of p_count of [first, last) to the front, the rest keeps its order
+inline void ShuffleFront(std::vector<SizeType>& indices, const SizeType first, const SizeType last, SizeType p_count) {
+    for (SizeType i = 0; i < p_count && first + i < last - 1; i++) {
+        std::uniform_int_distribution<SizeType> pick(first + i, last - 1);
+        std::swap(indices[first + i], indices[pick(rg)]);
+    }
+}
+
 #if defined(NEWGPU)
 
     #include "Core/Common/cuda/Kmeans.hxx"
@@ -196,8 +272,8 @@ inline float KmeansAssign(const Dataset<T>& data, std::vector<SizeType>& indices
     float currDist = 0;
     SizeType subsize = (last - first - 1) / args._T + 1;
 
-    #pragma omp parallel for num_threads(args._T) shared(data, indices) reduction(+ : currDist)
-    for (int tid = 0; tid < args._T; tid++) {
+    std::vector<float> taskDist(args._T, 0);
+    Helper::TaskScheduler::Instance().Run(args._T, [&](int tid) {
         SizeType istart = first + tid * subsize;
         SizeType iend = min(first + (tid + 1) * subsize, last);
         SizeType* inewCounts = args.newCounts + tid * args._K;
@@ -205,13 +281,16 @@ inline float KmeansAssign(const Dataset<T>& data, std::vector<SizeType>& indices
         SizeType* iclusterIdx = args.clusterIdx + tid * args._K;
         float* iclusterDist = args.clusterDist + tid * args._K;
         float* iweightedCounts = args.newWeightedCounts + tid * args._K;
+        float* idists = args.dists + tid * args._K;
         float idist = 0;
 
         for (SizeType i = istart; i < iend; i++) {
             int clusterid = 0;
             float smallestDist = MaxDist;
+            // one vector against all centers in the batch kernel, which keeps the vector in registers
+            args.fComputeDistanceBatch(data[indices[i]], args.centerPtrs, args._DK, args._D, idists);
             for (int k = 0; k < args._DK; k++) {
-                float dist = args.fComputeDistance(data[indices[i]], args.centers + k * args._D, args._D) + lambda * args.counts[k];
+                float dist = idists[k] + lambda * args.counts[k];
                 if (dist > -MaxDist && dist < smallestDist) {
                     clusterid = k;
                     smallestDist = dist;
@@ -237,8 +316,9 @@ inline float KmeansAssign(const Dataset<T>& data, std::vector<SizeType>& indices
                 }
             }
         }
-        currDist += idist;
-    }
+        taskDist[tid] = idist;
+    });
+    for (float d : taskDist) currDist += d;
 
     for (int i = 1; i < args._T; i++) {
         for (int k = 0; k < args._DK; k++) {
@@ -304,13 +384,20 @@ float TryClustering(const Dataset<T>& data, std::vector<SizeType>& indices, cons
     if (abort && abort->ShouldAbort())
         return 0;
 
-    SizeType batchEnd = min(first + samples, last);
+    // a range that fits in one batch is clustered with full passes
+    bool miniBatch = args._batch > 0 && last - first > args._batch;
+    SizeType batchEnd = min(first + (miniBatch ? args._batch : samples), last);
     float currDiff, currDist, minClusterDist = MaxDist;
     int noImprovement = 0;
     float originalLambda = COMMON::Utils::GetBase<T>() * COMMON::Utils::GetBase<T>() / lambdaFactor / (batchEnd - first);
-    for (int iter = 0; iter < 100; iter++) {
+    if (miniBatch) {
+        memset(args.seenCounts, 0, sizeof(float) * args._K);
+        for (size_t j = 0; j < (size_t)args._K * args._D; j++) args.floatCenters[j] = (float)args.newTCenters[j];
+    }
+    for (int iter = 0; iter < args._maxIter; iter++) {
         std::memcpy(args.centers, args.newTCenters, sizeof(T) * args._K * args._D);
-        std::shuffle(indices.begin() + first, indices.begin() + last, rg);
+        // only the batch has to be a random choice, not the whole range
+        ShuffleFront(indices, first, last, batchEnd - first);
 
         args.ClearCenters();
         args.ClearCounts();
@@ -335,12 +422,12 @@ float TryClustering(const Dataset<T>& data, std::vector<SizeType>& indices, cons
         }
         */
 
-        currDiff = RefineCenters<T, R>(data, args);
+        currDiff = miniBatch ? RefineMiniBatchCenters<T, R>(data, args) : RefineCenters<T, R>(data, args);
         // if (debug) LOG(Helper::LogLevel::LL_Info, "iter %d dist:%f diff:%f\n", iter, currDist, currDiff);
 
         if (abort && abort->ShouldAbort())
             return 0;
-        if (currDiff < 1e-3 || noImprovement >= 5)
+        if (currDiff < args._tolerance || noImprovement >= args._patience)
             break;
     }
 
@@ -426,13 +513,15 @@ int KmeansClustering(const Dataset<T>& data, std::vector<SizeType>& indices, con
 
 class BKTree {
    public:
-    BKTree() : m_iTreeNumber(1), m_iBKTKmeansK(32), m_iBKTLeafSize(8), m_iSamples(1000), m_fBalanceFactor(-1.0f), m_bfs(0), m_lock(new std::shared_timed_mutex) {}
+    BKTree() : m_iTreeNumber(1), m_iBKTKmeansK(32), m_iBKTLeafSize(8), m_iSamples(1000), m_bfs(0), m_iKmeansBatch(0), m_fBalanceFactor(-1.0f), m_fKmeansTolerance(1e-3f), m_lock(new std::shared_timed_mutex) {}
 
     BKTree(const BKTree& other) : m_iTreeNumber(other.m_iTreeNumber),
                                   m_iBKTKmeansK(other.m_iBKTKmeansK),
                                   m_iBKTLeafSize(other.m_iBKTLeafSize),
                                   m_iSamples(other.m_iSamples),
+                                  m_iKmeansBatch(other.m_iKmeansBatch),
                                   m_fBalanceFactor(other.m_fBalanceFactor),
+                                  m_fKmeansTolerance(other.m_fKmeansTolerance),
                                   m_lock(new std::shared_timed_mutex) {}
     ~BKTree() {}
 
@@ -485,6 +574,8 @@ class BKTree {
             localindices.assign(indices->begin(), indices->end());
         }
         KmeansArgs<T> args(m_iBKTKmeansK, data.C(), (SizeType)localindices.size(), numOfThreads, distMethod);
+        args._batch = m_iKmeansBatch;
+        args._tolerance = m_fKmeansTolerance;
 
         if (m_fBalanceFactor < 0)
             m_fBalanceFactor = DynamicFactorSelect(data, localindices, 0, (SizeType)localindices.size(), args, m_iSamples);
@@ -551,6 +642,58 @@ class BKTree {
         }
     }
 
+    // the IDs below p_count in the first tree's depth-first order, vectors of one leaf end up next
+    // to each other; IDs the tree does not hold are appended
+    void DepthFirstOrder(SizeType p_count, std::vector<SizeType>& p_order) const {
+        std::shared_lock<std::shared_timed_mutex> lock(*m_lock);
+        p_order.clear();
+        p_order.reserve(p_count);
+        std::vector<bool> seen(p_count, false);
+        if (!m_pTreeStart.empty()) {
+            std::stack<SizeType> nodes;
+            nodes.push(m_pTreeStart[0]);
+            while (!nodes.empty()) {
+                const BKTNode& node = m_pTreeRoots[nodes.top()];
+                nodes.pop();
+                if (node.centerid >= 0 && node.centerid < p_count && !seen[node.centerid]) {
+                    seen[node.centerid] = true;
+                    p_order.push_back(node.centerid);
+                }
+                if (node.childStart == -1)
+                    continue;
+                SizeType childStart = node.childStart < 0 ? -node.childStart : node.childStart;
+                for (SizeType child = node.childEnd - 1; child >= childStart; child--) nodes.push(child);
+            }
+        }
+        for (SizeType i = 0; i < p_count; i++) {
+            if (!seen[i])
+                p_order.push_back(i);
+        }
+    }
+
+    // greedy descent of the first tree to the node whose cluster p_query falls in; leaves of one
+    // parent get neighbouring node indices, 0 without trees. The caller holds m_lock
+    template <typename T>
+    SizeType NearestLeaf(const Dataset<T>& data, const std::function<float(const T*, const T*, DimensionType)>& fComputeDistance, const T* p_query) const {
+        if (m_pTreeStart.empty())
+            return 0;
+        SizeType current = m_pTreeStart[0];
+        while (m_pTreeRoots[current].childStart >= 0) {
+            const BKTNode& node = m_pTreeRoots[current];
+            SizeType nearest = node.childStart;
+            float best = (std::numeric_limits<float>::max)();
+            for (SizeType child = node.childStart; child < node.childEnd; child++) {
+                float dist = fComputeDistance(p_query, data[m_pTreeRoots[child].centerid], data.C());
+                if (dist < best) {
+                    best = dist;
+                    nearest = child;
+                }
+            }
+            current = nearest;
+        }
+        return current;
+    }
+
     inline std::uint64_t BufferSize() const {
         return sizeof(int) + sizeof(SizeType) * m_iTreeNumber +
                sizeof(SizeType) + sizeof(BKTNode) * m_pTreeRoots.size();
@@ -708,8 +851,8 @@ class BKTree {
 
    public:
     std::unique_ptr<std::shared_timed_mutex> m_lock;
-    int m_iTreeNumber, m_iBKTKmeansK, m_iBKTLeafSize, m_iSamples, m_bfs;
-    float m_fBalanceFactor;
+    int m_iTreeNumber, m_iBKTKmeansK, m_iBKTLeafSize, m_iSamples, m_bfs, m_iKmeansBatch;
+    float m_fBalanceFactor, m_fKmeansTolerance;
 };
 }  // namespace SPTAG::COMMON
 #endif
@@ -5,6 +5,8 @@
 #define _SPTAG_COMMON_DATASET_H_
 
 #include "Core/Common.h"
+#include "MemoryPolicy.h"
+#include <algorithm>
 #include <atomic>
 #include <string>
 #include <memory>
@@ -12,6 +14,7 @@
 #include <cstddef>
 #include <cstring>
 #include <cmath>
+#include <thread>
 
 namespace SPTAG::COMMON {
 // structure to save Data and Graph
@@ -225,15 +228,44 @@ class Dataset {
     DimensionType cols = 1;
     char* data = nullptr;
     bool ownData = false;
+    // rows past rows: incRows published to readers, reservedRows handed out to appenders.
+    // abandonedRows is the start of the first range an append gave up on, -1 while there is none
     std::atomic<SizeType> incRows{0};
+    std::atomic<SizeType> reservedRows{0};
+    std::atomic<SizeType> abandonedRows{-1};
     SizeType maxRows;
     SizeType rowsInBlock;
     SizeType rowsInBlockEx;
+    // sized for the capacity up front, a null entry is a block no append has reached yet
     std::shared_ptr<std::vector<char*>> incBlocks;
 
     DimensionType colStart = 0;
     DimensionType mycols = 0;
 
+    MemoryPolicy policy;
+    // per NUMA node copies of the first rows rows, read instead of data once Replicate filled them
+    std::vector<char*> replicas;
+    // the incremental blocks are carved from the storage given to Attach and not freed here
+    bool attached = false;
+
+    void Release() {
+        if (ownData)
+            MemoryPolicy::Free(data);
+        if (!attached) {
+            for (char* ptr : *incBlocks)
+                MemoryPolicy::Free(ptr);
+        }
+        std::fill(incBlocks->begin(), incBlocks->end(), nullptr);
+        attached = false;
+        for (char* ptr : replicas)
+            MemoryPolicy::Free(ptr);
+        replicas.clear();
+    }
+
+    inline char* Base() const {
+        return replicas.empty() ? data : replicas[MemoryPolicy::CurrentNode() % replicas.size()];
+    }
+
    public:
     Dataset() {}
 
@@ -241,23 +273,18 @@ class Dataset {
         Initialize(rows_, cols_, rowsInBlock_, capacity_, data_, shareOwnership_, incBlocks_, colStart_, rowEnd_);
     }
     ~Dataset() {
-        if (ownData)
-            ALIGN_FREE(data);
-        for (char* ptr : *incBlocks)
-            ALIGN_FREE(ptr);
-        incBlocks->clear();
+        if (incBlocks != nullptr)
+            Release();
     }
 
     void Initialize(SizeType rows_, DimensionType cols_, SizeType rowsInBlock_, SizeType capacity_, const void* data_ = nullptr, bool shareOwnership_ = true, std::shared_ptr<std::vector<char*>> incBlocks_ = nullptr, int colStart_ = 0, int rowEnd_ = -1) {
-        if (data != nullptr) {
-            if (ownData)
-                ALIGN_FREE(data);
-            for (char* ptr : *incBlocks)
-                ALIGN_FREE(ptr);
-            incBlocks->clear();
-        }
+        if (data != nullptr)
+            Release();
 
         rows = rows_;
+        incRows.store(0, std::memory_order_release);
+        reservedRows.store(0, std::memory_order_release);
+        abandonedRows.store(-1, std::memory_order_release);
         if (rowEnd_ >= colStart_)
             cols = rowEnd_;
         else
@@ -265,7 +292,7 @@ class Dataset {
         data = (char*)data_;
         if (data_ == nullptr || !shareOwnership_) {
             ownData = true;
-            data = (char*)ALIGN_ALLOC(((size_t)rows) * cols);
+            data = (char*)policy.Allocate(((size_t)rows) * cols);
             if (data_ != nullptr)
                 memcpy(data, data_, ((size_t)rows) * cols);
             else
@@ -277,7 +304,9 @@ class Dataset {
         incBlocks = incBlocks_;
         if (incBlocks == nullptr)
             incBlocks.reset(new std::vector<char*>());
-        incBlocks->reserve((static_cast<std::int64_t>(capacity_) + rowsInBlock) >> rowsInBlockEx);
+        size_t blocks = (size_t)((static_cast<std::int64_t>(capacity_) + rowsInBlock) >> rowsInBlockEx);
+        if (incBlocks->size() < blocks)
+            incBlocks->resize(blocks, nullptr);
 
         colStart = colStart_;
         mycols = cols_;
@@ -287,6 +316,53 @@ class Dataset {
         return data != nullptr;
     }
 
+    // bytes of the storage Attach needs to hold up to p_capacity rows, however many of them exist already
+    static size_t AttachBytes(DimensionType p_cols, SizeType p_rowsInBlock, SizeType p_capacity) {
+        size_t blockRows = (size_t)1 << static_cast<SizeType>(ceil(log2(p_rowsInBlock)));
+        return ((size_t)p_capacity + blockRows) * p_cols * sizeof(T);
+    }
+
+    // use p_base, AttachBytes long, for the p_rows present rows and for every row AddBatch adds later,
+    // which takes its blocks from there in order instead of allocating them. All rows thus stay one
+    // contiguous array, e.g. of a mapped file, and p_base is left to its owner
+    void Attach(char* p_base, SizeType p_rows, DimensionType p_cols, SizeType p_rowsInBlock, SizeType p_capacity) {
+        Initialize(p_rows, p_cols, p_rowsInBlock, p_capacity, p_base, true);
+        ownData = false;
+        attached = true;
+        size_t blockBytes = ((size_t)rowsInBlock + 1) * cols;
+        char* next = data + ((size_t)rows) * cols;
+        size_t block = 0;
+        for (SizeType covered = rows; covered < maxRows; covered += rowsInBlock + 1, next += blockBytes) (*incBlocks)[block++] = next;
+    }
+
+    // applies to the blocks allocated from now on, so it is set before Initialize or Load
+    void SetMemoryPolicy(const MemoryPolicy& p_policy) {
+        policy = p_policy;
+    }
+
+    // copy the rows present now to every NUMA node, each thread then reads the copy of its node.
+    // Writes through At reach a single copy, so only data that stays read-only may be replicated;
+    // rows added later live in the shared incremental blocks
+    ErrorCode Replicate() {
+        int nodes = MemoryPolicy::NodeCount();
+        if (data == nullptr || colStart != 0 || !replicas.empty() || nodes <= 1)
+            return ErrorCode::Success;
+        size_t bytes = ((size_t)rows) * cols;
+        for (int node = 0; node < nodes; node++) {
+            char* copy = (char*)policy.Allocate(bytes, node);
+            if (copy == nullptr) {
+                for (char* ptr : replicas)
+                    MemoryPolicy::Free(ptr);
+                replicas.clear();
+                return ErrorCode::MemoryOverFlow;
+            }
+            memcpy(copy, data, bytes);
+            replicas.push_back(copy);
+        }
+        LOG(Helper::LogLevel::LL_Info, "Replicate %s (%d,%d) on %d nodes\n", name.c_str(), rows, mycols, nodes);
+        return ErrorCode::Success;
+    }
+
     void SetName(const std::string& name_) {
         name = name_;
     }
@@ -294,6 +370,7 @@ class Dataset {
         return name;
     }
 
+    // not to be called while other threads append
     void SetR(SizeType R_) {
         if (R_ >= rows)
             incRows.store(R_ - rows, std::memory_order_release);
@@ -301,6 +378,8 @@ class Dataset {
             rows = R_;
             incRows.store(0, std::memory_order_release);
         }
+        reservedRows.store(incRows.load(std::memory_order_relaxed), std::memory_order_release);
+        abandonedRows.store(-1, std::memory_order_release);
     }
 
     inline SizeType R() const {
@@ -318,7 +397,7 @@ class Dataset {
         SizeType incIndex = index - rows;                                                                            \
         return (T*)((*incBlocks)[incIndex >> rowsInBlockEx] + ((size_t)(incIndex & rowsInBlock)) * cols + colStart); \
     }                                                                                                                \
-    return (T*)(data + ((size_t)index) * cols + colStart);
+    return (T*)(Base() + ((size_t)index) * cols + colStart);
 
     inline const T* At(SizeType index) const {
         GETITEM(index)
@@ -336,36 +415,125 @@ class Dataset {
         GETITEM(index)}
 #undef GETITEM
 
-    ErrorCode AddBatch(SizeType num, const T* pData = nullptr) {
+    // Appends num rows, copied from pData or left as -1, and returns the index of the first in
+    // p_begin. Threads append without a lock: rows are reserved from an atomic counter, a missing
+    // block is installed by whichever thread reaches it first, and rows become visible through R()
+    // in reservation order, so a call only waits for appends reserved before it to finish copying.
+    // A range whose blocks cannot be allocated is abandoned, see Abandon
+    ErrorCode AddBatch(SizeType num, const T* pData = nullptr, SizeType* p_begin = nullptr) {
+        if (colStart != 0)
+            return ErrorCode::Success;
+        SizeType begin;
+        ErrorCode ret = ReserveBatch(num, begin);
+        if (ret != ErrorCode::Success)
+            return ret;
+        if (p_begin != nullptr)
+            *p_begin = begin;
+        return FillAndPublish(begin - rows, num, pData);
+    }
+
+    // Hands out num row indices from p_begin without filling them. The caller fills the range
+    // with AddBatchAt, or gives it up with Abandon
+    ErrorCode ReserveBatch(SizeType num, SizeType& p_begin) {
+        if (abandonedRows.load(std::memory_order_acquire) >= 0)
+            return ErrorCode::MemoryOverFlow;
+        SizeType start = reservedRows.load(std::memory_order_relaxed);
+        do {
+            if (rows + start > maxRows - num)
+                return ErrorCode::MemoryOverFlow;
+        } while (!reservedRows.compare_exchange_weak(start, start + num, std::memory_order_relaxed));
+        p_begin = rows + start;
+        return ErrorCode::Success;
+    }
+
+    // Appends the rows p_begin .. p_begin + num - 1 whose indices another dataset handed out with
+    // AddBatch or ReserveBatch, so that datasets growing together keep one row numbering without a
+    // common lock
+    ErrorCode AddBatchAt(SizeType p_begin, SizeType num, const T* pData = nullptr) {
         if (colStart != 0)
             return ErrorCode::Success;
-        if (R() > maxRows - num)
+        if (p_begin < rows || p_begin > maxRows - num)
+            return ErrorCode::MemoryOverFlow;
+        SizeType start = p_begin - rows;
+        SizeType abandoned = abandonedRows.load(std::memory_order_acquire);
+        if (abandoned >= 0 && abandoned <= start)
+            return ErrorCode::MemoryOverFlow;
+        SizeType reserved = reservedRows.load(std::memory_order_relaxed);
+        while (reserved < start + num && !reservedRows.compare_exchange_weak(reserved, start + num, std::memory_order_relaxed)) {
+        }
+        return FillAndPublish(start, num, pData);
+    }
+
+    // installs the blocks of rows p_begin .. p_begin + num - 1, after which filling them cannot
+    // fail. Datasets growing together allocate for a range before any of them publishes it
+    ErrorCode AllocateBlocks(SizeType p_begin, SizeType num) {
+        if (colStart != 0 || num <= 0)
+            return ErrorCode::Success;
+        if (p_begin < rows || p_begin > maxRows - num)
             return ErrorCode::MemoryOverFlow;
+        SizeType first = (p_begin - rows) >> rowsInBlockEx, last = (p_begin - rows + num - 1) >> rowsInBlockEx;
+        for (SizeType curBlockIdx = first; curBlockIdx <= last; curBlockIdx++) {
+            char* block = __atomic_load_n(&(*incBlocks)[curBlockIdx], __ATOMIC_ACQUIRE);
+            if (block != nullptr)
+                continue;
+            char* newBlock = (char*)policy.Allocate(((size_t)rowsInBlock + 1) * cols);
+            if (newBlock == nullptr)
+                return ErrorCode::MemoryOverFlow;
+            std::memset(newBlock, -1, ((size_t)rowsInBlock + 1) * cols);
+            if (!__atomic_compare_exchange_n(&(*incBlocks)[curBlockIdx], &block, newBlock, false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+                MemoryPolicy::Free(newBlock);
+        }
+        return ErrorCode::Success;
+    }
+
+    // gives up the range reserved from p_begin: it is never published, so readers never reach
+    // rows that may have no block, and neither is any range after it. New reservations fail from
+    // then on, until SetR drops them
+    void Abandon(SizeType p_begin) {
+        if (colStart != 0 || p_begin < rows)
+            return;
+        SizeType start = p_begin - rows;
+        SizeType abandoned = abandonedRows.load(std::memory_order_relaxed);
+        while ((abandoned < 0 || abandoned > start) && !abandonedRows.compare_exchange_weak(abandoned, start, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+    }
 
-        SizeType currentIncRows = incRows.load(std::memory_order_acquire);
+   private:
+    ErrorCode FillAndPublish(SizeType start, SizeType num, const T* pData) {
+        ErrorCode ret = AllocateBlocks(rows + start, num);
+        if (ret != ErrorCode::Success) {
+            Abandon(rows + start);
+            return ret;
+        }
         SizeType written = 0;
         while (written < num) {
-            SizeType curBlockIdx = ((currentIncRows + written) >> rowsInBlockEx);
-            if (curBlockIdx >= (SizeType)(incBlocks->size())) {
-                char* newBlock = (char*)ALIGN_ALLOC(((size_t)rowsInBlock + 1) * cols);
-                if (newBlock == nullptr)
-                    return ErrorCode::MemoryOverFlow;
-                std::memset(newBlock, -1, ((size_t)rowsInBlock + 1) * cols);
-                incBlocks->push_back(newBlock);
-            }
-            SizeType curBlockPos = ((currentIncRows + written) & rowsInBlock);
+            SizeType curBlockIdx = ((start + written) >> rowsInBlockEx);
+            char* block = __atomic_load_n(&(*incBlocks)[curBlockIdx], __ATOMIC_ACQUIRE);
+            SizeType curBlockPos = ((start + written) & rowsInBlock);
             SizeType toWrite = min(rowsInBlock + 1 - curBlockPos, num - written);
             if (pData) {
                 for (int i = 0; i < toWrite; i++) {
-                    std::memcpy((*incBlocks)[curBlockIdx] + ((size_t)curBlockPos + i) * cols + colStart, pData + ((size_t)written + i) * mycols, mycols * sizeof(T));
+                    std::memcpy(block + ((size_t)curBlockPos + i) * cols + colStart, pData + ((size_t)written + i) * mycols, mycols * sizeof(T));
                 }
+            } else if (attached) {
+                // attached blocks still hold whatever the storage had, allocated ones start out as -1
+                std::memset(block + ((size_t)curBlockPos) * cols, -1, ((size_t)toWrite) * cols);
             }
             written += toWrite;
         }
-        incRows.fetch_add(written, std::memory_order_release);
+        // later reservations wait behind this one, none is published past an abandoned range
+        for (int spin = 0; incRows.load(std::memory_order_acquire) != start; spin++) {
+            SizeType abandoned = abandonedRows.load(std::memory_order_acquire);
+            if (abandoned >= 0 && abandoned < start)
+                return ErrorCode::MemoryOverFlow;
+            if (spin >= 64)
+                std::this_thread::yield();
+        }
+        incRows.store(start + num, std::memory_order_release);
         return ErrorCode::Success;
     }
 
+   public:
     ErrorCode Save(std::shared_ptr<Helper::DiskIO> p_out) const {
         SizeType CR = R();
         IOBINARY(p_out, WriteBinary, sizeof(SizeType), (char*)&CR);
@@ -426,7 +594,7 @@ class Dataset {
     ErrorCode Refine(const std::vector<SizeType>& indices, COMMON::Dataset<T>& dataset) const {
         SizeType newrows = (SizeType)(indices.size());
         if (dataset.data == nullptr)
-            dataset.Initialize(newrows, mycols, rowsInBlock + 1, static_cast<SizeType>(incBlocks->capacity() * (rowsInBlock + 1)));
+            dataset.Initialize(newrows, mycols, rowsInBlock + 1, static_cast<SizeType>(incBlocks->size() * (rowsInBlock + 1)));
 
         for (SizeType i = 0; i < newrows; i++) {
             std::memcpy((void*)dataset.At(i), (void*)At(indices[i]), sizeof(T) * mycols);
@@ -0,0 +1,98 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_DELETEDBITMAP_H_
+#define _SPTAG_COMMON_DELETEDBITMAP_H_
+
+#include "Core/Common.h"
+#include "Utils/SIMDUtils.h"
+#include <sys/mman.h>
+
+namespace SPTAG::COMMON {
+// One bit per key, in a flat range reserved for the capacity up front: pages are only committed
+// once a bit on them is set, so the bitmap grows with the keys without ever moving and readers
+// need no lock. Posting entries are tested 64 at a time, gathering the keys and their words
+class DeletedBitmap {
+   public:
+    DeletedBitmap() = default;
+    DeletedBitmap(const DeletedBitmap&) = delete;
+    DeletedBitmap& operator=(const DeletedBitmap&) = delete;
+
+    ~DeletedBitmap() {
+        Release();
+    }
+
+    // room for keys [0, p_capacity), all clear
+    ErrorCode Reserve(SizeType p_capacity) {
+        Release();
+        size_t words = ((size_t)(std::max)(p_capacity, (SizeType)1) + 31) >> 5;
+        m_bytes = (words * sizeof(std::uint32_t) + PageSize - 1) / PageSize * PageSize;
+        void* base = mmap(nullptr, m_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (base == MAP_FAILED) {
+            LOG(Helper::LogLevel::LL_Error, "DeletedBitmap: cannot reserve %zu bytes for %d keys\n", m_bytes, p_capacity);
+            m_bytes = 0;
+            return ErrorCode::MemoryOverFlow;
+        }
+        m_bits = (std::uint32_t*)base;
+        m_capacity = p_capacity;
+        return ErrorCode::Success;
+    }
+
+    inline SizeType Capacity() const {
+        return m_capacity;
+    }
+
+    inline bool Test(SizeType p_key) const {
+        return (__atomic_load_n(m_bits + (p_key >> 5), __ATOMIC_ACQUIRE) >> (p_key & 31)) & 1;
+    }
+
+    // true when the bit was clear before
+    inline bool Set(SizeType p_key) {
+        std::uint32_t bit = 1u << (p_key & 31);
+        return (__atomic_fetch_or(m_bits + (p_key >> 5), bit, __ATOMIC_ACQ_REL) & bit) == 0;
+    }
+
+    inline void Clear(SizeType p_key) {
+        __atomic_fetch_and(m_bits + (p_key >> 5), ~(1u << (p_key & 31)), __ATOMIC_ACQ_REL);
+    }
+
+    // bit i of p_mask[i / 64] set when the key at p_entries + i * p_stride is set
+    void TestStrided(const char* p_entries, int p_stride, int p_count, std::uint64_t* p_mask) const {
+        static const BitTestReturn test = BitTestSelector();
+        for (int i = 0; i < p_count; i += 64) p_mask[i >> 6] = test(m_bits, p_entries + (size_t)i * p_stride, p_stride, (std::min)(64, p_count - i));
+    }
+
+    // after Reserve, set the bits of [0, p_rows) for which p_set holds a whole word at a time. Pages
+    // without a set bit stay uncommitted
+    template <typename F>
+    void Rebuild(SizeType p_rows, F p_set) {
+        SizeType words = (p_rows + 31) >> 5;
+#pragma omp parallel for schedule(static, 4096)
+        for (SizeType w = 0; w < words; w++) {
+            std::uint32_t word = 0;
+            SizeType first = w << 5, last = (std::min)(first + 32, p_rows);
+            for (SizeType key = first; key < last; key++) {
+                if (p_set(key))
+                    word |= 1u << (key - first);
+            }
+            if (word != 0)
+                m_bits[w] = word;
+        }
+    }
+
+   private:
+    void Release() {
+        if (m_bits != nullptr)
+            munmap(m_bits, m_bytes);
+        m_bits = nullptr;
+        m_bytes = 0;
+        m_capacity = 0;
+    }
+
+    std::uint32_t* m_bits = nullptr;
+    size_t m_bytes = 0;
+    SizeType m_capacity = 0;
+};
+}  // namespace SPTAG::COMMON
+
+#endif  // _SPTAG_COMMON_DELETEDBITMAP_H_
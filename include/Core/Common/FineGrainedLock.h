@@ -4,10 +4,13 @@
 #ifndef _SPTAG_COMMON_FINEGRAINEDLOCK_H_
 #define _SPTAG_COMMON_FINEGRAINEDLOCK_H_
 
-#include <shared_mutex>
-#include <vector>
-#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
 
 namespace SPTAG::COMMON {
 class FineGrainedLock {
@@ -36,30 +39,104 @@ class FineGrainedLock {
     }
 };
 
-class FineGrainedRWLock {
+// Spin lock carrying a sequence number, one per posting. Writers (append, split, merge) take it
+// exclusively, the sequence is odd while they hold it. Readers take nothing: they note the
+// sequence before reading the posting and validate it afterwards, a read that overlapped a
+// writer sees a different sequence. Usable with std::unique_lock.
+class SeqLock {
    public:
-    FineGrainedRWLock() {
-        m_locks.reset(new std::shared_timed_mutex[PoolSize + 1]);
+    void lock() {
+        for (int spins = 0;; spins++) {
+            std::uint32_t seq = m_seq.load(std::memory_order_relaxed);
+            if ((seq & 1) == 0 && m_seq.compare_exchange_weak(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed))
+                return;
+            Backoff(spins);
+        }
     }
-    ~FineGrainedRWLock() {}
 
-    std::shared_timed_mutex& operator[](SizeType idx) {
-        unsigned index = hash_func((unsigned)idx);
-        return m_locks[index];
+    bool try_lock() {
+        std::uint32_t seq = m_seq.load(std::memory_order_relaxed);
+        return (seq & 1) == 0 && m_seq.compare_exchange_strong(seq, seq + 1, std::memory_order_acquire, std::memory_order_relaxed);
     }
 
-    const std::shared_timed_mutex& operator[](SizeType idx) const {
-        unsigned index = hash_func((unsigned)idx);
-        return m_locks[index];
+    void unlock() {
+        m_seq.fetch_add(1, std::memory_order_release);
     }
 
-    inline unsigned hash_func(unsigned idx) const {
-        return ((unsigned)(idx * 99991) + _rotl(idx, 2) + 101) & PoolSize;
+    // sequence to validate a read against, odd while a writer holds the lock
+    inline std::uint32_t ReadBegin() const {
+        return m_seq.load(std::memory_order_acquire);
+    }
+
+    // like ReadBegin but waits for a writer to finish
+    std::uint32_t WaitReadBegin() const {
+        for (int spins = 0;; spins++) {
+            std::uint32_t seq = m_seq.load(std::memory_order_acquire);
+            if ((seq & 1) == 0)
+                return seq;
+            Backoff(spins);
+        }
+    }
+
+    // true when no writer held or took the lock since ReadBegin returned p_seq
+    inline bool ReadValidate(std::uint32_t p_seq) const {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return (p_seq & 1) == 0 && m_seq.load(std::memory_order_relaxed) == p_seq;
     }
 
    private:
-    static const int PoolSize = 32767;
-    std::unique_ptr<std::shared_timed_mutex[]> m_locks;
+    // writers hold a posting across its I/O, so waiters soon stop spinning and sleep
+    static void Backoff(int p_spins) {
+        if (p_spins < 1024)
+            std::this_thread::yield();
+        else
+            std::this_thread::sleep_for(std::chrono::microseconds(50));
+    }
+
+    std::atomic<std::uint32_t> m_seq{0};
+};
+
+// A SeqLock for every posting ID, allocated in blocks as IDs grow. Within a block consecutive
+// IDs are spread over different cache lines: heads created together by a split are usually
+// written together, and they should not bounce one line between cores.
+class PostingLockTable {
+   public:
+    PostingLockTable() {
+        m_blocks.reset(new std::atomic<Block*>[MaxBlocks]);
+        for (unsigned i = 0; i < MaxBlocks; i++) m_blocks[i].store(nullptr, std::memory_order_relaxed);
+    }
+
+    ~PostingLockTable() {
+        for (unsigned i = 0; i < MaxBlocks; i++) delete m_blocks[i].load(std::memory_order_relaxed);
+    }
+
+    SeqLock& operator[](SizeType idx) {
+        unsigned id = (unsigned)idx;
+        std::atomic<Block*>& slot = m_blocks[(id >> BlockBits) & (MaxBlocks - 1)];
+        Block* block = slot.load(std::memory_order_acquire);
+        if (block == nullptr) {
+            Block* fresh = new Block();
+            if (slot.compare_exchange_strong(block, fresh, std::memory_order_acq_rel))
+                block = fresh;
+            else
+                delete fresh;
+        }
+        unsigned offset = id & (BlockSize - 1);
+        return block->m_locks[(offset % LinesPerBlock) * LocksPerLine + offset / LinesPerBlock];
+    }
+
+   private:
+    static const unsigned BlockBits = 14;
+    static const unsigned BlockSize = 1u << BlockBits;
+    static const unsigned MaxBlocks = 1u << (31 - BlockBits);
+    static const unsigned LocksPerLine = 64 / sizeof(SeqLock);
+    static const unsigned LinesPerBlock = BlockSize / LocksPerLine;
+
+    struct alignas(64) Block {
+        SeqLock m_locks[BlockSize];
+    };
+
+    std::unique_ptr<std::atomic<Block*>[]> m_blocks;
 };
 }  // namespace SPTAG::COMMON
 
@@ -23,6 +23,13 @@ class Labelset {
         m_data.Initialize(size, 1, blockSize, capacity);
     }
 
+    // labels are written in place, so they are never replicated
+    void SetMemoryPolicy(MemoryPolicy p_policy) {
+        if (p_policy.placement == NumaPlacement::Replicate)
+            p_policy.placement = NumaPlacement::Interleave;
+        m_data.SetMemoryPolicy(p_policy);
+    }
+
     inline size_t Count() const {
         return m_inserted.load();
     }
@@ -73,8 +80,21 @@ class Labelset {
         return m_data.Load(pmemoryFile + sizeof(SizeType), blockSize, capacity);
     }
 
-    inline ErrorCode AddBatch(SizeType num) {
-        return m_data.AddBatch(num);
+    // lock-free, p_begin gets the first new index
+    inline ErrorCode AddBatch(SizeType num, SizeType* p_begin = nullptr) {
+        return m_data.AddBatch(num, nullptr, p_begin);
+    }
+
+    inline ErrorCode AddBatchAt(SizeType p_begin, SizeType num) {
+        return m_data.AddBatchAt(p_begin, num);
+    }
+
+    inline ErrorCode AllocateBlocks(SizeType p_begin, SizeType num) {
+        return m_data.AllocateBlocks(p_begin, num);
+    }
+
+    inline void Abandon(SizeType p_begin) {
+        m_data.Abandon(p_begin);
     }
 
     inline std::uint64_t BufferSize() const {
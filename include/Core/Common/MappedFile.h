@@ -0,0 +1,179 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_MAPPEDFILE_H_
+#define _SPTAG_COMMON_MAPPEDFILE_H_
+
+#include "Core/Common.h"
+#include "Dataset.h"
+#include <fcntl.h>
+#include <mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace SPTAG::COMMON {
+// A record file mapped shared: a 64 byte header followed by the rows. Updates of the rows land in
+// the page cache in place and reach the disk whenever the kernel writes them back or Checkpoint
+// syncs them. The header is only written by Checkpoint, once the rows are durable, so after a crash
+// it still describes the last checkpoint and rows added since are ignored
+class MappedFile {
+   public:
+    struct Header {
+        char magic[8];
+        std::int32_t elementSize;
+        SizeType rows;
+        std::int64_t aux;  // counter of the owner, the deleted labels of a VersionLabel
+        std::uint64_t checkpoints;
+        char reserved[32];
+    };
+    static constexpr size_t kHeaderBytes = 64;
+    static_assert(sizeof(Header) == kHeaderBytes, "MappedFile header must stay 64 bytes");
+
+    MappedFile() {}
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile() {
+        Close();
+    }
+
+    // map at least p_bodyBytes of rows. A file written with the same element size keeps its header
+    // and rows unless p_reset, anything else starts over with 0 rows and p_fresh set
+    ErrorCode Open(const std::string& p_path, int p_elementSize, size_t p_bodyBytes, bool p_reset, bool& p_fresh) {
+        std::lock_guard<std::mutex> lock(m_checkpointLock);
+        Unmap();
+        int fd = open(p_path.c_str(), O_RDWR | O_CREAT | (p_reset ? O_TRUNC : 0), 0644);
+        if (fd < 0) {
+            LOG(Helper::LogLevel::LL_Error, "MappedFile: cannot open %s\n", p_path.c_str());
+            return ErrorCode::FailedOpenFile;
+        }
+        struct stat info;
+        Header header;
+        bool valid = fstat(fd, &info) == 0 && (size_t)info.st_size >= kHeaderBytes && pread(fd, &header, sizeof(header), 0) == sizeof(header) &&
+                     memcmp(header.magic, kMagic, sizeof(header.magic)) == 0 && header.elementSize == p_elementSize && header.rows >= 0 &&
+                     kHeaderBytes + (size_t)header.rows * p_elementSize <= (size_t)info.st_size;
+        if (!valid && !p_reset && info.st_size > 0)
+            LOG(Helper::LogLevel::LL_Warning, "MappedFile: %s is not a record file of %d byte rows, starting over\n", p_path.c_str(), p_elementSize);
+
+        size_t length = kHeaderBytes + p_bodyBytes;
+        if (valid)
+            length = (std::max)(length, (size_t)info.st_size);
+        if ((!valid || (size_t)info.st_size < length) && ftruncate(fd, length) != 0) {
+            LOG(Helper::LogLevel::LL_Error, "MappedFile: cannot size %s to %zu bytes\n", p_path.c_str(), length);
+            close(fd);
+            return ErrorCode::DiskIOFail;
+        }
+        void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            LOG(Helper::LogLevel::LL_Error, "MappedFile: cannot map %zu bytes of %s\n", length, p_path.c_str());
+            return ErrorCode::Fail;
+        }
+        m_base = (char*)base;
+        m_length = length;
+        if (!valid) {
+            memset(&header, 0, sizeof(header));
+            memcpy(header.magic, kMagic, sizeof(header.magic));
+            header.elementSize = p_elementSize;
+            memcpy(m_base, &header, sizeof(header));
+        }
+        p_fresh = !valid;
+        return ErrorCode::Success;
+    }
+
+    // back p_data with the rows of p_path, a fresh file gets p_rows rows of -1 and is checkpointed
+    // right away so that its header is valid from the start
+    template <typename T>
+    ErrorCode Attach(Dataset<T>& p_data, const std::string& p_path, SizeType p_rows, SizeType p_blockSize, SizeType p_capacity, bool p_reset) {
+        bool fresh;
+        SizeType capacity = (std::max)(p_capacity, p_rows);
+        ErrorCode ret = Open(p_path, sizeof(T), Dataset<T>::AttachBytes(1, p_blockSize, capacity), p_reset, fresh);
+        if (ret != ErrorCode::Success)
+            return ret;
+        if (fresh) {
+            memset(Body(), -1, sizeof(T) * p_rows);
+            if ((ret = Checkpoint(p_rows, 0)) != ErrorCode::Success)
+                return ret;
+        }
+        // a file grown past p_capacity keeps all of its rows
+        capacity = (std::max)(capacity, GetHeader()->rows);
+        size_t bytes = Dataset<T>::AttachBytes(1, p_blockSize, capacity);
+        if (bytes > BodyBytes() && (ret = Open(p_path, sizeof(T), bytes, false, fresh)) != ErrorCode::Success)
+            return ret;
+        p_data.Attach(Body(), GetHeader()->rows, 1, p_blockSize, capacity);
+        return ErrorCode::Success;
+    }
+
+    // sync the rows, then record p_rows and p_aux in the header and sync it
+    ErrorCode Checkpoint(SizeType p_rows, std::int64_t p_aux) {
+        std::lock_guard<std::mutex> lock(m_checkpointLock);
+        if (m_base == nullptr)
+            return ErrorCode::Success;
+        if (msync(m_base, m_length, MS_SYNC) != 0)
+            return ErrorCode::DiskIOFail;
+        Header* header = GetHeader();
+        header->rows = p_rows;
+        header->aux = p_aux;
+        header->checkpoints++;
+        if (msync(m_base, kHeaderBytes, MS_SYNC) != 0)
+            return ErrorCode::DiskIOFail;
+        return ErrorCode::Success;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(m_checkpointLock);
+        Unmap();
+    }
+
+    inline bool IsOpen() const {
+        return m_base != nullptr;
+    }
+
+    inline Header* GetHeader() const {
+        return (Header*)m_base;
+    }
+
+    inline char* Body() const {
+        return m_base + kHeaderBytes;
+    }
+
+    inline size_t BodyBytes() const {
+        return m_length - kHeaderBytes;
+    }
+
+    // fault the first p_bytes of the rows in now instead of on first touch
+    void Prefault(size_t p_bytes) const {
+        if (m_base != nullptr)
+            PrefaultRange(m_base, (std::min)(kHeaderBytes + p_bytes, m_length));
+    }
+
+    // read one byte of every page of a mapping starting at p_base, the pages split over the OpenMP threads
+    static void PrefaultRange(const char* p_base, size_t p_length) {
+        madvise((void*)p_base, p_length, MADV_WILLNEED);
+        std::int64_t pages = (std::int64_t)((p_length + kPageBytes - 1) / kPageBytes);
+        std::uint64_t sum = 0;
+#pragma omp parallel for reduction(+ : sum)
+        for (std::int64_t i = 0; i < pages; i++) sum += (unsigned char)p_base[i * kPageBytes];
+        volatile std::uint64_t sink = sum;
+        (void)sink;
+    }
+
+   private:
+    void Unmap() {
+        if (m_base != nullptr)
+            munmap(m_base, m_length);
+        m_base = nullptr;
+        m_length = 0;
+    }
+
+    static constexpr char kMagic[8] = {'S', 'P', 'T', 'A', 'G', 'R', 'E', 'C'};
+    static constexpr size_t kPageBytes = 4096;
+
+    char* m_base = nullptr;
+    size_t m_length = 0;
+    std::mutex m_checkpointLock;
+};
+}  // namespace SPTAG::COMMON
+
+#endif  // _SPTAG_COMMON_MAPPEDFILE_H_
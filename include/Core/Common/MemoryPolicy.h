@@ -0,0 +1,123 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_MEMORYPOLICY_H_
+#define _SPTAG_COMMON_MEMORYPOLICY_H_
+
+#include "Core/Common.h"
+#include <numa.h>
+#include <sched.h>
+#include <sys/mman.h>
+
+#ifndef MAP_HUGE_SHIFT
+    #define MAP_HUGE_SHIFT 26
+#endif
+
+namespace SPTAG::COMMON {
+// Where the pages of a Dataset go. Local leaves them to first touch on 4K pages, Interleave spreads
+// them round-robin over the NUMA nodes and Replicate additionally keeps one copy of the loaded rows
+// per node (see Dataset::Replicate), for read-only data only
+enum class NumaPlacement : std::uint8_t { Local,
+                                          Interleave,
+                                          Replicate };
+
+// Allocation policy of a Dataset. HugePageMB 2 or 1024 maps blocks of at least one huge page from
+// the hugetlbfs pool SPDK also draws from (script/setup-hugepages.sh) and falls back to transparent
+// hugepages once it runs dry. Every block carries a header recording how it was obtained, so Free
+// needs neither the size nor the policy
+struct MemoryPolicy {
+    int hugePageMB = 0;
+    NumaPlacement placement = NumaPlacement::Local;
+
+    inline bool IsDefault() const {
+        return hugePageMB == 0 && placement == NumaPlacement::Local;
+    }
+
+    static inline bool ParsePlacement(const std::string& p_name, NumaPlacement& p_placement) {
+        if (p_name == "Local")
+            p_placement = NumaPlacement::Local;
+        else if (p_name == "Interleave")
+            p_placement = NumaPlacement::Interleave;
+        else if (p_name == "Replicate")
+            p_placement = NumaPlacement::Replicate;
+        else
+            return false;
+        return true;
+    }
+
+    static inline int NodeCount() {
+        return numa_available() < 0 ? 1 : (std::max)(numa_num_configured_nodes(), 1);
+    }
+
+    // node of the CPU the calling thread first asked from, threads are expected to stay on their socket
+    static inline int CurrentNode() {
+        static thread_local int node = -1;
+        if (node < 0) {
+            int cpu = sched_getcpu();
+            node = (numa_available() < 0 || cpu < 0) ? 0 : (std::max)(numa_node_of_cpu(cpu), 0);
+        }
+        return node;
+    }
+
+    // p_bytes aligned like ALIGN_ALLOC, bound to p_node when it is not -1
+    void* Allocate(size_t p_bytes, int p_node = -1) const {
+        size_t total = p_bytes + kHeaderBytes;
+        if (IsDefault() && p_node < 0) {
+            char* base = (char*)ALIGN_ALLOC(total);
+            if (base == nullptr)
+                return nullptr;
+            return Stamp(base, 0);
+        }
+        void* base = MAP_FAILED;
+        size_t length = 0;
+        if (hugePageMB > 0) {
+            size_t page = (size_t)hugePageMB << 20;
+            if (total >= page) {
+                length = (total + page - 1) / page * page;
+                int shift = hugePageMB >= 1024 ? 30 : 21;
+                base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB | (shift << MAP_HUGE_SHIFT), -1, 0);
+            }
+        }
+        if (base == MAP_FAILED) {
+            length = (total + kSmallPage - 1) / kSmallPage * kSmallPage;
+            base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (base == MAP_FAILED)
+                return nullptr;
+            if (hugePageMB > 0)
+                madvise(base, length, MADV_HUGEPAGE);
+        }
+        // set before the first touch, which is what places the pages
+        if (numa_available() >= 0) {
+            if (p_node >= 0)
+                numa_tonode_memory(base, length, p_node);
+            else if (placement != NumaPlacement::Local)
+                numa_interleave_memory(base, length, numa_all_nodes_ptr);
+        }
+        return Stamp((char*)base, length);
+    }
+
+    static void Free(void* p_ptr) {
+        if (p_ptr == nullptr)
+            return;
+        Header* header = (Header*)((char*)p_ptr - kHeaderBytes);
+        if (header->mapped == 0)
+            ALIGN_FREE(header);
+        else
+            munmap(header, header->mapped);
+    }
+
+   private:
+    struct Header {
+        std::uint64_t mapped;  // length of the mapping, 0 for heap blocks
+    };
+    static constexpr size_t kHeaderBytes = 64;
+    static constexpr size_t kSmallPage = 4096;
+
+    static inline void* Stamp(char* p_base, size_t p_mapped) {
+        ((Header*)p_base)->mapped = p_mapped;
+        return p_base + kHeaderBytes;
+    }
+};
+}  // namespace SPTAG::COMMON
+
+#endif  // _SPTAG_COMMON_MEMORYPOLICY_H_
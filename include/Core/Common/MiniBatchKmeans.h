@@ -0,0 +1,299 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_MINIBATCHKMEANS_H_
+#define _SPTAG_COMMON_MINIBATCHKMEANS_H_
+
+#include "Core/Common.h"
+#include "Dataset.h"
+#include "Utils/DistanceUtils.h"
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <random>
+#include <unordered_set>
+#include <vector>
+
+namespace SPTAG::COMMON {
+// Head selection by hierarchical mini-batch k-means. Every cluster owns a head budget: a cluster
+// whose budget fits in m_branch is cut into that many clusters whose centers are its heads, larger
+// ones are cut into m_branch clusters that share the budget by size. Centers are trained on random
+// batches (Sculley's per-center learning rate) and assigned through the one-to-many distance
+// kernels. A cluster is trained on one thread from a generator seeded by its position in the
+// tree and assignments are written per vector, so the heads do not depend on the thread count:
+// large clusters parallelise their assignments, the small ones of a level run side by side.
+// With m_samples the tree is trained on a sample; m_refine then routes every vector down the tree
+// so each head is the vector of the whole set closest to its center.
+template <typename T>
+class MiniBatchKmeans {
+   public:
+    int m_branch = 32;
+    int m_batchSize = 4096;
+    int m_iterations = 100;
+    SizeType m_samples = 0;
+    bool m_refine = true;
+    int m_threads = 1;
+    std::uint64_t m_seed = 0x5EED5EED;
+
+    void SelectHeads(const Dataset<T>& p_data, DistCalcMethod p_distCalcMethod, SizeType p_headCount, std::vector<SizeType>& p_selected) {
+        m_dim = p_data.C();
+        m_distCalcMethod = p_distCalcMethod;
+        m_distanceBatch = DistanceBatchSelector<T>(p_distCalcMethod);
+        m_nodes.clear();
+        m_leaves = 0;
+        p_selected.clear();
+        if (p_data.R() == 0 || p_headCount <= 0)
+            return;
+
+        std::vector<SizeType> members(p_data.R());
+        for (SizeType i = 0; i < p_data.R(); i++) members[i] = i;
+        if (m_samples > 0 && m_samples < p_data.R()) {
+            std::mt19937_64 rng(m_seed);
+            for (SizeType i = 0; i < m_samples; i++) std::swap(members[i], members[i + (SizeType)(rng() % (std::uint64_t)(p_data.R() - i))]);
+            members.resize(m_samples);
+            std::sort(members.begin(), members.end());
+        }
+        // the sample stays around when its own vectors are routed
+        std::vector<SizeType> sample;
+        if ((SizeType)members.size() < p_data.R() && !m_refine)
+            sample = members;
+        BuildTree(p_data, std::move(members), p_headCount);
+
+        // every leaf takes the routed vector closest to its center, ties to the smaller ID
+        std::vector<std::atomic<std::uint64_t>> best(m_leaves);
+        for (auto& key : best) key = (std::numeric_limits<std::uint64_t>::max)();
+        SizeType routed = sample.empty() ? p_data.R() : (SizeType)sample.size();
+#pragma omp parallel num_threads(m_threads)
+        {
+            std::vector<float> dists;
+#pragma omp for schedule(dynamic, 1024)
+            for (SizeType i = 0; i < routed; i++) {
+                SizeType vid = sample.empty() ? i : sample[i];
+                float dist;
+                SizeType leaf = Route(p_data[vid], dists, dist);
+                if (leaf < 0)
+                    continue;
+                std::uint64_t key = ((std::uint64_t)OrderedBits(dist) << 32) | (std::uint32_t)vid;
+                std::uint64_t current = best[leaf].load();
+                while (key < current && !best[leaf].compare_exchange_weak(current, key)) {
+                }
+            }
+        }
+        for (auto& key : best) {
+            if (key.load() != (std::numeric_limits<std::uint64_t>::max)())
+                p_selected.push_back((SizeType)(key.load() & 0xFFFFFFFF));
+        }
+        std::sort(p_selected.begin(), p_selected.end());
+        p_selected.erase(std::unique(p_selected.begin(), p_selected.end()), p_selected.end());
+    }
+
+    inline size_t NodeCount() const {
+        return m_nodes.size();
+    }
+
+   private:
+    // children[c] >= 0 is a node, -1 a cluster without a head, otherwise leaf -2 - children[c]
+    struct Node {
+        std::vector<T> centers;
+        std::vector<const void*> pointers;
+        std::vector<SizeType> children;
+    };
+
+    struct Task {
+        SizeType node;
+        SizeType budget;
+        std::vector<SizeType> members;
+    };
+
+    // assignments of one cluster are spread over the threads from this size on
+    static constexpr SizeType kParallelCluster = 1 << 16;
+
+    void BuildTree(const Dataset<T>& p_data, std::vector<SizeType> p_members, SizeType p_headCount) {
+        m_nodes.emplace_back();
+        std::vector<Task> tasks;
+        SizeType budget = (std::min)(p_headCount, (SizeType)p_members.size());
+        tasks.push_back(Task{0, budget, std::move(p_members)});
+        while (!tasks.empty()) {
+            std::vector<std::vector<std::vector<SizeType>>> parts(tasks.size());
+            for (size_t t = 0; t < tasks.size(); t++) {
+                if ((SizeType)tasks[t].members.size() >= kParallelCluster)
+                    Split(p_data, tasks[t], parts[t], true);
+            }
+#pragma omp parallel for num_threads(m_threads) schedule(dynamic, 1)
+            for (int t = 0; t < (int)tasks.size(); t++) {
+                if ((SizeType)tasks[t].members.size() < kParallelCluster)
+                    Split(p_data, tasks[t], parts[t], false);
+            }
+
+            std::vector<Task> next;
+            for (size_t t = 0; t < tasks.size(); t++) {
+                std::vector<SizeType> budgets = ShareBudget(tasks[t].budget, parts[t]);
+                for (size_t c = 0; c < parts[t].size(); c++) {
+                    SizeType child = -1;
+                    if (budgets[c] == 1) {
+                        child = -2 - m_leaves++;
+                    } else if (budgets[c] > 1) {
+                        child = (SizeType)m_nodes.size();
+                        m_nodes.emplace_back();
+                        next.push_back(Task{child, budgets[c], std::move(parts[t][c])});
+                    }
+                    m_nodes[tasks[t].node].children[c] = child;
+                }
+                tasks[t].members = std::vector<SizeType>();
+            }
+            tasks.swap(next);
+        }
+    }
+
+    // train the centers of p_task's node and cut its members by nearest center
+    void Split(const Dataset<T>& p_data, const Task& p_task, std::vector<std::vector<SizeType>>& p_parts, bool p_parallel) {
+        Node& node = m_nodes[p_task.node];
+        SizeType count = (SizeType)p_task.members.size();
+        if (p_task.budget >= count) {
+            // every member is its own head
+            SetCenters(node, count);
+            for (SizeType i = 0; i < count; i++) std::memcpy(node.centers.data() + (size_t)i * m_dim, p_data[p_task.members[i]], sizeof(T) * m_dim);
+            p_parts.resize(count);
+            for (SizeType i = 0; i < count; i++) p_parts[i].push_back(p_task.members[i]);
+            return;
+        }
+
+        int k = (int)(std::min)(p_task.budget, (SizeType)m_branch);
+        std::mt19937_64 rng(m_seed + 0x9E3779B97F4A7C15ULL * (std::uint64_t)(p_task.node + 1));
+        SetCenters(node, k);
+        std::vector<float> centers((size_t)k * m_dim);
+        std::unordered_set<SizeType> seeds;
+        while ((int)seeds.size() < k) seeds.insert(p_task.members[rng() % (std::uint64_t)count]);
+        std::vector<SizeType> ordered(seeds.begin(), seeds.end());
+        std::sort(ordered.begin(), ordered.end());
+        for (int c = 0; c < k; c++) {
+            const T* seed = p_data[ordered[c]];
+            for (DimensionType d = 0; d < m_dim; d++) centers[(size_t)c * m_dim + d] = (float)seed[d];
+        }
+        StoreCenters(node, centers, k);
+
+        int batchSize = (int)(std::min)((SizeType)m_batchSize, count);
+        std::vector<SizeType> batch(batchSize);
+        std::vector<int> labels(batchSize);
+        std::vector<SizeType> seen(k, 0);
+        for (int iter = 0; iter < m_iterations; iter++) {
+            for (int i = 0; i < batchSize; i++) batch[i] = p_task.members[rng() % (std::uint64_t)count];
+            Assign(p_data, node, batch.data(), batchSize, labels.data(), p_parallel);
+            for (int i = 0; i < batchSize; i++) {
+                float* center = centers.data() + (size_t)labels[i] * m_dim;
+                float rate = 1.0f / ++seen[labels[i]];
+                const T* vector = p_data[batch[i]];
+                for (DimensionType d = 0; d < m_dim; d++) center[d] += rate * ((float)vector[d] - center[d]);
+            }
+            StoreCenters(node, centers, k);
+        }
+
+        std::vector<int> all(count);
+        Assign(p_data, node, p_task.members.data(), count, all.data(), p_parallel);
+        p_parts.resize(k);
+        for (SizeType i = 0; i < count; i++) p_parts[all[i]].push_back(p_task.members[i]);
+    }
+
+    // a budget up to m_branch gives each non-empty cluster one head, a larger one is shared by
+    // size with the largest remainders rounded up
+    std::vector<SizeType> ShareBudget(SizeType p_budget, const std::vector<std::vector<SizeType>>& p_parts) const {
+        std::vector<SizeType> budgets(p_parts.size(), 0);
+        SizeType total = 0;
+        for (auto& part : p_parts) total += (SizeType)part.size();
+        if (p_budget >= total || p_budget <= m_branch) {
+            for (size_t c = 0; c < p_parts.size(); c++) budgets[c] = p_parts[c].empty() ? 0 : 1;
+            return budgets;
+        }
+        std::vector<std::pair<double, size_t>> remainders(p_parts.size());
+        SizeType assigned = 0;
+        for (size_t c = 0; c < p_parts.size(); c++) {
+            double quota = (double)p_budget * p_parts[c].size() / total;
+            budgets[c] = (SizeType)quota;
+            assigned += budgets[c];
+            remainders[c] = std::make_pair(quota - budgets[c], c);
+        }
+        std::stable_sort(remainders.begin(), remainders.end(), [](const std::pair<double, size_t>& a, const std::pair<double, size_t>& b) { return a.first > b.first; });
+        for (size_t i = 0; assigned < p_budget && i < remainders.size(); i++, assigned++) budgets[remainders[i].second]++;
+        return budgets;
+    }
+
+    void Assign(const Dataset<T>& p_data, const Node& p_node, const SizeType* p_ids, SizeType p_count, int* p_labels, bool p_parallel) const {
+#pragma omp parallel num_threads(m_threads) if (p_parallel)
+        {
+            std::vector<float> dists(p_node.pointers.size());
+#pragma omp for schedule(static)
+            for (SizeType i = 0; i < p_count; i++) p_labels[i] = Nearest(p_node, p_data[p_ids[i]], dists.data());
+        }
+    }
+
+    inline int Nearest(const Node& p_node, const T* p_vector, float* p_dists) const {
+        m_distanceBatch(p_vector, p_node.pointers.data(), (int)p_node.pointers.size(), m_dim, p_dists);
+        return (int)(std::min_element(p_dists, p_dists + p_node.pointers.size()) - p_dists);
+    }
+
+    // the leaf p_vector ends in and its distance to the leaf's center, -1 without a head
+    SizeType Route(const T* p_vector, std::vector<float>& p_dists, float& p_dist) const {
+        SizeType node = 0;
+        while (true) {
+            const Node& current = m_nodes[node];
+            p_dists.resize(current.pointers.size());
+            int c = Nearest(current, p_vector, p_dists.data());
+            SizeType child = current.children[c];
+            if (child >= 0) {
+                node = child;
+                continue;
+            }
+            p_dist = p_dists[c];
+            return child == -1 ? -1 : -2 - child;
+        }
+    }
+
+    inline void SetCenters(Node& p_node, SizeType p_count) const {
+        p_node.centers.resize((size_t)p_count * m_dim);
+        p_node.pointers.resize(p_count);
+        p_node.children.assign(p_count, -1);
+        for (SizeType c = 0; c < p_count; c++) p_node.pointers[c] = p_node.centers.data() + (size_t)c * m_dim;
+    }
+
+    // the trained centers in the value type, scaled to the base length for Cosine and rounded for integer types
+    void StoreCenters(Node& p_node, const std::vector<float>& p_centers, int p_count) const {
+        for (int c = 0; c < p_count; c++) {
+            const float* center = p_centers.data() + (size_t)c * m_dim;
+            float scale = 1.0f;
+            if (m_distCalcMethod == DistCalcMethod::Cosine) {
+                double length = 0;
+                for (DimensionType d = 0; d < m_dim; d++) length += (double)center[d] * center[d];
+                length = std::sqrt(length);
+                if (length > 1e-6)
+                    scale = (float)(Utils::GetBase<T>() / length);
+            }
+            T* out = p_node.centers.data() + (size_t)c * m_dim;
+            for (DimensionType d = 0; d < m_dim; d++) {
+                float value = center[d] * scale;
+                if (std::numeric_limits<T>::is_integer) {
+                    value = std::round(value);
+                    value = (std::min)((std::max)(value, (float)(std::numeric_limits<T>::min)()), (float)(std::numeric_limits<T>::max)());
+                }
+                out[d] = (T)value;
+            }
+        }
+    }
+
+    // float bits that order as unsigned integers the way the floats do
+    static inline std::uint32_t OrderedBits(float p_value) {
+        std::uint32_t bits;
+        std::memcpy(&bits, &p_value, sizeof(bits));
+        return (bits & 0x80000000u) ? ~bits : (bits | 0x80000000u);
+    }
+
+    DimensionType m_dim = 0;
+    DistCalcMethod m_distCalcMethod = DistCalcMethod::L2;
+    DistanceBatchReturn<T> m_distanceBatch = nullptr;
+    std::vector<Node> m_nodes;
+    SizeType m_leaves = 0;
+};
+}  // namespace SPTAG::COMMON
+
+#endif  // _SPTAG_COMMON_MINIBATCHKMEANS_H_
@@ -0,0 +1,212 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_PQQUANTIZER_H_
+#define _SPTAG_COMMON_PQQUANTIZER_H_
+
+#include "Core/Common.h"
+#include "Utils/DistanceUtils.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <random>
+#include <vector>
+
+namespace SPTAG::COMMON {
+// Product quantizer with 256 centroids per subspace: a vector is cut into m_numSubvectors pieces of
+// m_subDim components and each piece is stored as the one byte ID of its nearest centroid.
+// Distances to a query are summed up from a per-query table of piece-to-centroid distances (ADC).
+class PQQuantizer {
+   public:
+    static constexpr int kCentroids = 256;
+
+    PQQuantizer() {}
+
+    PQQuantizer(DimensionType p_dim, int p_numSubvectors, DistCalcMethod p_distCalcMethod, int p_base)
+        : m_dim(p_dim), m_numSubvectors(p_numSubvectors), m_subDim(p_dim / p_numSubvectors), m_distCalcMethod(p_distCalcMethod), m_base(p_base) {
+        m_codebooks.assign((size_t)m_numSubvectors * kCentroids * m_subDim, 0);
+    }
+
+    // the largest number of subvectors dividing p_dim with at least 4 components each
+    static int DefaultSubvectors(DimensionType p_dim) {
+        for (int m = max(1, p_dim / 4); m > 1; m--) {
+            if (p_dim % m == 0)
+                return m;
+        }
+        return 1;
+    }
+
+    inline int CodeSize() const {
+        return m_numSubvectors;
+    }
+
+    inline DimensionType Dimension() const {
+        return m_dim;
+    }
+
+    inline size_t TableSize() const {
+        return (size_t)m_numSubvectors * kCentroids;
+    }
+
+    // k-means on every subspace of p_count sample vectors, subspaces are trained in parallel
+    template <typename T>
+    void Train(const T* p_data, SizeType p_count, int p_iterations, int p_threads) {
+#pragma omp parallel for num_threads(p_threads) schedule(dynamic)
+        for (int m = 0; m < m_numSubvectors; m++) {
+            std::vector<float> sub((size_t)p_count * m_subDim);
+            for (SizeType i = 0; i < p_count; i++) {
+                const T* piece = p_data + (size_t)i * m_dim + (size_t)m * m_subDim;
+                for (DimensionType d = 0; d < m_subDim; d++) sub[(size_t)i * m_subDim + d] = (float)piece[d];
+            }
+            TrainSubspace(sub.data(), p_count, Centroids(m, 0), p_iterations, m);
+        }
+    }
+
+    template <typename T>
+    void Encode(const T* p_vector, std::uint8_t* p_code) const {
+        float piece[256];
+        std::vector<float> buffer;
+        float* sub = piece;
+        if (m_subDim > 256) {
+            buffer.resize(m_subDim);
+            sub = buffer.data();
+        }
+        for (int m = 0; m < m_numSubvectors; m++) {
+            for (DimensionType d = 0; d < m_subDim; d++) sub[d] = (float)p_vector[(size_t)m * m_subDim + d];
+            p_code[m] = (std::uint8_t)NearestCentroid(Centroids(m, 0), sub);
+        }
+    }
+
+    // reconstruct a vector from its code, integer types are rounded and clamped
+    template <typename T>
+    void Decode(const std::uint8_t* p_code, T* p_vector) const {
+        for (int m = 0; m < m_numSubvectors; m++) {
+            const float* centroid = Centroids(m, p_code[m]);
+            for (DimensionType d = 0; d < m_subDim; d++) {
+                float value = centroid[d];
+                if (std::numeric_limits<T>::is_integer) {
+                    value = std::round(value);
+                    value = (std::min)((std::max)(value, (float)(std::numeric_limits<T>::min)()), (float)(std::numeric_limits<T>::max)());
+                }
+                p_vector[(size_t)m * m_subDim + d] = (T)value;
+            }
+        }
+    }
+
+    // p_table gets TableSize() entries: the squared L2 distance of each query piece to each centroid,
+    // or minus their inner product for Cosine, which QueryDistance offsets by base * base
+    template <typename T>
+    void BuildTable(const T* p_query, float* p_table) const {
+        bool l2 = m_distCalcMethod == DistCalcMethod::L2;
+        for (int m = 0; m < m_numSubvectors; m++) {
+            const T* piece = p_query + (size_t)m * m_subDim;
+            for (int k = 0; k < kCentroids; k++) {
+                const float* centroid = Centroids(m, k);
+                float dist = 0;
+                for (DimensionType d = 0; d < m_subDim; d++) {
+                    float q = (float)piece[d];
+                    dist += l2 ? (q - centroid[d]) * (q - centroid[d]) : -q * centroid[d];
+                }
+                p_table[(size_t)m * kCentroids + k] = dist;
+            }
+        }
+    }
+
+    // same scale as the distance of the decoded vector
+    inline float QueryDistance(const float* p_table, const std::uint8_t* p_code) const {
+        float dist = m_lookupSum(p_table, p_code, m_numSubvectors);
+        return m_distCalcMethod == DistCalcMethod::L2 ? dist : (float)m_base * m_base + dist;
+    }
+
+    ErrorCode SaveQuantizer(std::shared_ptr<Helper::DiskIO> p_out) const {
+        int method = (int)m_distCalcMethod;
+        IOBINARY(p_out, WriteBinary, sizeof(m_dim), (char*)&m_dim);
+        IOBINARY(p_out, WriteBinary, sizeof(m_numSubvectors), (char*)&m_numSubvectors);
+        IOBINARY(p_out, WriteBinary, sizeof(method), (char*)&method);
+        IOBINARY(p_out, WriteBinary, sizeof(m_base), (char*)&m_base);
+        IOBINARY(p_out, WriteBinary, sizeof(float) * m_codebooks.size(), (char*)m_codebooks.data());
+        return ErrorCode::Success;
+    }
+
+    ErrorCode LoadQuantizer(std::shared_ptr<Helper::DiskIO> p_in) {
+        int method;
+        IOBINARY(p_in, ReadBinary, sizeof(m_dim), (char*)&m_dim);
+        IOBINARY(p_in, ReadBinary, sizeof(m_numSubvectors), (char*)&m_numSubvectors);
+        IOBINARY(p_in, ReadBinary, sizeof(method), (char*)&method);
+        IOBINARY(p_in, ReadBinary, sizeof(m_base), (char*)&m_base);
+        if (m_numSubvectors <= 0 || m_dim % m_numSubvectors != 0)
+            return ErrorCode::FailedParseValue;
+        m_distCalcMethod = (DistCalcMethod)method;
+        m_subDim = m_dim / m_numSubvectors;
+        m_codebooks.resize((size_t)m_numSubvectors * kCentroids * m_subDim);
+        IOBINARY(p_in, ReadBinary, sizeof(float) * m_codebooks.size(), (char*)m_codebooks.data());
+        return ErrorCode::Success;
+    }
+
+   private:
+    inline const float* Centroids(int p_subvector, int p_centroid) const {
+        return m_codebooks.data() + ((size_t)p_subvector * kCentroids + p_centroid) * m_subDim;
+    }
+
+    inline float* Centroids(int p_subvector, int p_centroid) {
+        return m_codebooks.data() + ((size_t)p_subvector * kCentroids + p_centroid) * m_subDim;
+    }
+
+    int NearestCentroid(const float* p_centroids, const float* p_piece) const {
+        int best = 0;
+        float bestDist = (std::numeric_limits<float>::max)();
+        for (int k = 0; k < kCentroids; k++) {
+            float dist = DistanceUtils::ComputeL2Distance(p_piece, p_centroids + (size_t)k * m_subDim, m_subDim);
+            if (dist < bestDist) {
+                bestDist = dist;
+                best = k;
+            }
+        }
+        return best;
+    }
+
+    // Lloyd iterations seeded with random samples, empty clusters are reseeded the same way
+    void TrainSubspace(const float* p_data, SizeType p_count, float* p_centroids, int p_iterations, int p_seed) const {
+        if (p_count <= 0)
+            return;
+        std::mt19937 rng(p_seed);
+        std::uniform_int_distribution<SizeType> pick(0, p_count - 1);
+        for (int k = 0; k < kCentroids; k++) {
+            SizeType i = (p_count >= kCentroids) ? pick(rng) : k % p_count;
+            memcpy(p_centroids + (size_t)k * m_subDim, p_data + (size_t)i * m_subDim, sizeof(float) * m_subDim);
+        }
+
+        std::vector<double> sums((size_t)kCentroids * m_subDim);
+        std::vector<SizeType> counts(kCentroids);
+        for (int iter = 0; iter < p_iterations; iter++) {
+            std::fill(sums.begin(), sums.end(), 0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (SizeType i = 0; i < p_count; i++) {
+                const float* piece = p_data + (size_t)i * m_subDim;
+                int k = NearestCentroid(p_centroids, piece);
+                counts[k]++;
+                for (DimensionType d = 0; d < m_subDim; d++) sums[(size_t)k * m_subDim + d] += piece[d];
+            }
+            for (int k = 0; k < kCentroids; k++) {
+                float* centroid = p_centroids + (size_t)k * m_subDim;
+                if (counts[k] == 0) {
+                    memcpy(centroid, p_data + (size_t)pick(rng) * m_subDim, sizeof(float) * m_subDim);
+                    continue;
+                }
+                for (DimensionType d = 0; d < m_subDim; d++) centroid[d] = (float)(sums[(size_t)k * m_subDim + d] / counts[k]);
+            }
+        }
+    }
+
+    DimensionType m_dim = 0;
+    int m_numSubvectors = 0;
+    DimensionType m_subDim = 0;
+    DistCalcMethod m_distCalcMethod = DistCalcMethod::L2;
+    int m_base = 1;
+    std::vector<float> m_codebooks;  // [subvector][centroid][m_subDim]
+    LookupSumReturn m_lookupSum = LookupSumSelector();
+};
+}  // namespace SPTAG::COMMON
+
+#endif  // _SPTAG_COMMON_PQQUANTIZER_H_
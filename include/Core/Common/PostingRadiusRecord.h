@@ -0,0 +1,78 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_POSTINGRADIUSRECORD_H_
+#define _SPTAG_COMMON_POSTINGRADIUSRECORD_H_
+
+#include "Dataset.h"
+
+namespace SPTAG::COMMON {
+// The largest distance from each head to an entry of its posting, in the distance of the index.
+// A radius is an upper bound, never pruned on while unknown (MaxDist): postings start unknown and
+// get theirs at build, on split and merge, or from the first range search reading them
+class PostingRadiusRecord {
+   private:
+    Dataset<float> m_data;
+
+   public:
+    PostingRadiusRecord() {
+        m_data.SetName("PostingRadiusRecord");
+    }
+
+    void Initialize(SizeType size, SizeType blockSize, SizeType capacity) {
+        m_data.Initialize(0, 1, blockSize, capacity);
+        AddBatch(size);
+    }
+
+    inline ErrorCode AddBatch(SizeType num) {
+        SizeType begin = m_data.R();
+        ErrorCode ret = m_data.AddBatch(num);
+        if (ret != ErrorCode::Success)
+            return ret;
+        float unknown = MaxDist;
+        for (SizeType i = begin; i < begin + num; i++) __atomic_store(m_data[i], &unknown, __ATOMIC_RELAXED);
+        return ErrorCode::Success;
+    }
+
+    // postings added to the head index ahead of their row read as unknown
+    inline float Get(SizeType headID) const {
+        if (headID < 0 || headID >= m_data.R())
+            return MaxDist;
+        float radius;
+        __atomic_load(m_data[headID], &radius, __ATOMIC_RELAXED);
+        return radius;
+    }
+
+    inline bool Known(SizeType headID) const {
+        return Get(headID) < MaxDist;
+    }
+
+    inline void Set(SizeType headID, float radius) {
+        if (headID >= 0 && headID < m_data.R())
+            __atomic_store(m_data[headID], &radius, __ATOMIC_RELAXED);
+    }
+
+    // widen a known radius to cover entries about to be appended, an unknown one stays unknown
+    inline void Grow(SizeType headID, float radius) {
+        if (headID < 0 || headID >= m_data.R())
+            return;
+        float old = Get(headID);
+        while (old < radius && !__atomic_compare_exchange(m_data[headID], &old, &radius, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+    }
+
+    // record a radius measured on a read of the posting, only while no writer has set one since
+    inline void Learn(SizeType headID, float radius) {
+        if (headID < 0 || headID >= m_data.R())
+            return;
+        float unknown = MaxDist;
+        __atomic_compare_exchange(m_data[headID], &unknown, &radius, false, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+    }
+
+    inline SizeType GetPostingNum() const {
+        return m_data.R();
+    }
+};
+}  // namespace SPTAG::COMMON
+
+#endif  // _SPTAG_COMMON_POSTINGRADIUSRECORD_H_
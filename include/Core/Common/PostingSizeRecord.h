@@ -6,11 +6,13 @@
 
 #include <atomic>
 #include "Dataset.h"
+#include "MappedFile.h"
 
 namespace SPTAG::COMMON {
 class PostingSizeRecord {
    private:
     Dataset<int> m_data;
+    MappedFile m_file;
 
    public:
     PostingSizeRecord() {
@@ -18,9 +20,40 @@ class PostingSizeRecord {
     }
 
     void Initialize(SizeType size, SizeType blockSize, SizeType capacity) {
+        m_file.Close();
         m_data.Initialize(size, 1, blockSize, capacity);
     }
 
+    // keep the sizes in a shared mapping of p_path, see VersionLabel::Map
+    ErrorCode Map(const std::string& p_path, SizeType size, SizeType blockSize, SizeType capacity, bool p_reset) {
+        ErrorCode ret = m_file.Attach(m_data, p_path, size, blockSize, capacity, p_reset);
+        if (ret != ErrorCode::Success)
+            return ret;
+        LOG(Helper::LogLevel::LL_Info, "Map %s (%d postings, checkpoint %llu) From %s\n", m_data.Name().c_str(), m_file.GetHeader()->rows, (unsigned long long)m_file.GetHeader()->checkpoints, p_path.c_str());
+        return ErrorCode::Success;
+    }
+
+    inline bool IsMapped() const {
+        return m_file.IsOpen();
+    }
+
+    // fault the mapped sizes in, heap sizes are resident already
+    void Prefault() const {
+        m_file.Prefault(sizeof(int) * (size_t)m_data.R());
+    }
+
+    // make the mapped sizes durable, nothing to do for heap sizes
+    ErrorCode Checkpoint() {
+        return m_file.Checkpoint(m_data.R(), 0);
+    }
+
+    // sizes are written in place, so they are never replicated
+    void SetMemoryPolicy(MemoryPolicy p_policy) {
+        if (p_policy.placement == NumaPlacement::Replicate)
+            p_policy.placement = NumaPlacement::Interleave;
+        m_data.SetMemoryPolicy(p_policy);
+    }
+
     inline int GetSize(const SizeType& headID) {
         return *m_data[headID];
     }
@@ -53,6 +86,10 @@ class PostingSizeRecord {
     }
 
     inline ErrorCode Save(const std::string& filename) {
+        if (IsMapped()) {
+            LOG(Helper::LogLevel::LL_Info, "Checkpoint mapped %s instead of saving to %s\n", m_data.Name().c_str(), filename.c_str());
+            return Checkpoint();
+        }
         LOG(Helper::LogLevel::LL_Info, "Save %s To %s\n", m_data.Name().c_str(), filename.c_str());
         auto ptr = f_createIO();
         if (ptr == nullptr || !ptr->Initialize(filename.c_str(), std::ios::binary | std::ios::out))
@@ -76,8 +113,9 @@ class PostingSizeRecord {
         return m_data.Load(pmemoryFile + sizeof(SizeType), blockSize, capacity);
     }
 
-    inline ErrorCode AddBatch(SizeType num) {
-        return m_data.AddBatch(num);
+    // lock-free, p_begin gets the first new index
+    inline ErrorCode AddBatch(SizeType num, SizeType* p_begin = nullptr) {
+        return m_data.AddBatch(num, nullptr, p_begin);
     }
 
     inline std::uint64_t BufferSize() const {
@@ -8,6 +8,7 @@
 #include "Dataset.h"
 #include "FineGrainedLock.h"
 #include "QueryResultSet.h"
+#include "Helper/TaskScheduler.h"
 
 #include <chrono>
 #include <queue>
@@ -60,12 +61,17 @@ class RelativeNeighborhoodGraph {
 
     template <typename T>
     void InsertNeighbors(BKT::Index<T>* index, const SizeType node, SizeType insertNode, float insertDist) {
+        std::lock_guard<std::mutex> lock(m_dataUpdateLock[node]);
+        InsertNeighborsLocked(index, node, insertNode, insertDist);
+    }
+
+    // the caller holds m_dataUpdateLock[node]
+    template <typename T>
+    void InsertNeighborsLocked(BKT::Index<T>* index, const SizeType node, SizeType insertNode, float insertDist) {
         SizeType* nodes = m_pNeighborhoodGraph[node];
         const void* nodeVec = index->GetSample(node);
         const void* insertVec = index->GetSample(insertNode);
 
-        std::lock_guard<std::mutex> lock(m_dataUpdateLock[node]);
-
         _mm_prefetch((const char*)nodes, _MM_HINT_T0);
         _mm_prefetch((const char*)(nodeVec), _MM_HINT_T0);
         _mm_prefetch((const char*)(insertVec), _MM_HINT_T0);
@@ -132,8 +138,7 @@ class RelativeNeighborhoodGraph {
     float GraphAccuracyEstimation(BKT::Index<T>* index, const SizeType samples, const std::unordered_map<SizeType, SizeType>* idmap = nullptr) {
         DimensionType* correct = new DimensionType[samples];
 
-#pragma omp parallel for schedule(dynamic)
-        for (SizeType i = 0; i < samples; i++) {
+        Helper::TaskScheduler::Instance().ParallelFor<SizeType>(0, samples, 1, [&](SizeType i) {
             SizeType x = COMMON::Utils::rand(m_iGraphSize);
             // int x = i;
             COMMON::QueryResultSet<void> query(nullptr, m_iCEF);
@@ -160,7 +165,7 @@ class RelativeNeighborhoodGraph {
                     }
             }
             delete[] exact_rng;
-        }
+        });
         float acc = 0;
         for (SizeType i = 0; i < samples; i++)
             acc += float(correct[i]);
@@ -320,8 +325,7 @@ class RelativeNeighborhoodGraph {
 
         auto t1 = std::chrono::high_resolution_clock::now();
         LOG(Helper::LogLevel::LL_Info, "Parallel TpTree Partition begin\n");
-    #pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < m_iTPTNumber; i++) {
+        Helper::TaskScheduler::Instance().ParallelFor<int>(0, m_iTPTNumber, 1, [&](int i) {
             Sleep(i * 100);
             std::srand(clock());
             for (SizeType j = 0; j < m_iGraphSize; j++)
@@ -329,14 +333,13 @@ class RelativeNeighborhoodGraph {
             std::shuffle(TptreeDataIndices[i].begin(), TptreeDataIndices[i].end(), rg);
             PartitionByTptree<T>(index, TptreeDataIndices[i], 0, m_iGraphSize - 1, TptreeLeafNodes[i]);
             LOG(Helper::LogLevel::LL_Info, "Finish Getting Leaves for Tree %d\n", i);
-        }
+        });
         LOG(Helper::LogLevel::LL_Info, "Parallel TpTree Partition done\n");
         auto t2 = std::chrono::high_resolution_clock::now();
         LOG(Helper::LogLevel::LL_Info, "Build TPTree time (s): %lld\n", std::chrono::duration_cast<std::chrono::seconds>(t2 - t1).count());
 
         for (int i = 0; i < m_iTPTNumber; i++) {
-    #pragma omp parallel for schedule(dynamic)
-            for (SizeType j = 0; j < (SizeType)TptreeLeafNodes[i].size(); j++) {
+            Helper::TaskScheduler::Instance().ParallelFor<SizeType>(0, TptreeLeafNodes[i].size(), 1, [&](SizeType j) {
                 SizeType start_index = TptreeLeafNodes[i][j].first;
                 SizeType end_index = TptreeLeafNodes[i][j].second;
                 if ((j * 5) % TptreeLeafNodes[i].size() == 0)
@@ -354,7 +357,7 @@ class RelativeNeighborhoodGraph {
                         COMMON::Utils::AddNeighbor(p1, dist, (m_pNeighborhoodGraph)[p2], (NeighborhoodDists)[p2], m_iNeighborhoodSize);
                     }
                 }
-            }
+            });
             TptreeDataIndices[i].clear();
             TptreeLeafNodes[i].clear();
         }
@@ -409,13 +412,12 @@ class RelativeNeighborhoodGraph {
     void RebuildGraph(BKT::Index<T>* index, const std::unordered_map<SizeType, SizeType>* idmap = nullptr) {
         std::vector<int> indegree(m_iGraphSize);
 
-#pragma omp parallel for schedule(dynamic)
-        for (SizeType i = 0; i < m_iGraphSize; i++)
+        Helper::TaskScheduler::Instance().ParallelFor<SizeType>(0, m_iGraphSize, 1, [&](SizeType i) {
             indegree[i] = 0;
+        });
 
         auto t0 = std::chrono::high_resolution_clock::now();
-#pragma omp parallel for schedule(dynamic)
-        for (SizeType i = 0; i < m_iGraphSize; i++) {
+        Helper::TaskScheduler::Instance().ParallelFor<SizeType>(0, m_iGraphSize, 1, [&](SizeType i) {
             SizeType* outnodes = m_pNeighborhoodGraph[i];
             for (DimensionType j = 0; j < m_iNeighborhoodSize; j++) {
                 int node = outnodes[j];
@@ -423,13 +425,12 @@ class RelativeNeighborhoodGraph {
                     indegree[node]++;
                 }
             }
-        }
+        });
         auto t1 = std::chrono::high_resolution_clock::now();
         LOG(Helper::LogLevel::LL_Info, "Calculate Indegree time (s): %lld\n", std::chrono::duration_cast<std::chrono::seconds>(t1 - t0).count());
         int rebuild_threshold = m_iNeighborhoodSize / 2;
         int rebuildstart = m_iNeighborhoodSize / 2;
-#pragma omp parallel for schedule(dynamic)
-        for (SizeType i = 0; i < m_iGraphSize; i++) {
+        Helper::TaskScheduler::Instance().ParallelFor<SizeType>(0, m_iGraphSize, 1, [&](SizeType i) {
             SizeType* outnodes = m_pNeighborhoodGraph[i];
             std::vector<bool> reserve(2 * m_iNeighborhoodSize, false);
             int total = 0;
@@ -457,21 +458,44 @@ class RelativeNeighborhoodGraph {
             }
             if ((i * 5) % m_iGraphSize == 0)
                 LOG(Helper::LogLevel::LL_Info, "Rebuild %d%%\n", static_cast<int>(i * 1.0 / m_iGraphSize * 100));
-        }
+        });
         auto t2 = std::chrono::high_resolution_clock::now();
         LOG(Helper::LogLevel::LL_Info, "Rebuild RNG time (s): %lld Graph Acc: %f\n", std::chrono::duration_cast<std::chrono::seconds>(t2 - t1).count(), GraphAccuracyEstimation(index, 100, idmap));
     }
 
+    // One refine pass over every node. Nodes go in the tree's depth-first order, kRefineChunk at a
+    // time, so a chunk searches one region of the graph. A chunk's searches all see the graph as it
+    // was before the chunk and its rows are written afterwards, each by one thread without a lock,
+    // so the pass gives the same graph for any thread count.
+    template <typename T>
+    void RefinePass(BKT::Index<T>* index, const std::vector<SizeType>& order, int CEF, int iter) {
+        SizeType total = (SizeType)order.size();
+        std::vector<SizeType> rows((size_t)(std::min)(total, kRefineChunk) * m_iNeighborhoodSize);
+        int reported = 0;
+        for (SizeType start = 0; start < total; start += kRefineChunk) {
+            SizeType count = (std::min)(kRefineChunk, total - start);
+            Helper::TaskScheduler::Instance().ParallelFor<SizeType>(0, count, 1, [&](SizeType j) {
+                SizeType node = order[start + j];
+                COMMON::QueryResultSet<T> query((const T*)index->GetSample(node), CEF + 1);
+                index->RefineSearchIndex(query, false);
+                RebuildNeighbors(index, node, rows.data() + (size_t)j * m_iNeighborhoodSize, query.GetResults(), CEF + 1);
+            });
+            Helper::TaskScheduler::Instance().ParallelFor<SizeType>(0, count, 1, [&](SizeType j) {
+                std::memcpy(m_pNeighborhoodGraph[order[start + j]], rows.data() + (size_t)j * m_iNeighborhoodSize, sizeof(SizeType) * m_iNeighborhoodSize);
+            });
+
+            for (; reported < 5 && (std::int64_t)(start + count) * 5 >= (std::int64_t)total * (reported + 1); reported++)
+                LOG(Helper::LogLevel::LL_Info, "Refine %d %d%%\n", iter, (reported + 1) * 20);
+        }
+    }
+
     template <typename T>
     void RefineGraph(BKT::Index<T>* index, const std::unordered_map<SizeType, SizeType>* idmap = nullptr) {
+        std::vector<SizeType> order;
+        index->GetTreeOrder(order);
         for (int iter = 0; iter < m_iRefineIter - 1; iter++) {
             auto t1 = std::chrono::high_resolution_clock::now();
-#pragma omp parallel for schedule(dynamic)
-            for (SizeType i = 0; i < m_iGraphSize; i++) {
-                RefineNode<T>(index, i, false, false, (int)(m_iCEF * m_fCEFScale));
-                if ((i * 5) % m_iGraphSize == 0)
-                    LOG(Helper::LogLevel::LL_Info, "Refine %d %d%%\n", iter, static_cast<int>(i * 1.0 / m_iGraphSize * 100));
-            }
+            RefinePass<T>(index, order, (int)(m_iCEF * m_fCEFScale), iter);
             auto t2 = std::chrono::high_resolution_clock::now();
             LOG(Helper::LogLevel::LL_Info, "Refine RNG time (s): %lld Graph Acc: %f\n", std::chrono::duration_cast<std::chrono::seconds>(t2 - t1).count(), GraphAccuracyEstimation(index, 100, idmap));
         }
@@ -480,12 +504,7 @@ class RelativeNeighborhoodGraph {
 
         if (m_iRefineIter > 0) {
             auto t1 = std::chrono::high_resolution_clock::now();
-#pragma omp parallel for schedule(dynamic)
-            for (SizeType i = 0; i < m_iGraphSize; i++) {
-                RefineNode<T>(index, i, false, false, m_iCEF);
-                if ((i * 5) % m_iGraphSize == 0)
-                    LOG(Helper::LogLevel::LL_Info, "Refine %d %d%%\n", m_iRefineIter - 1, static_cast<int>(i * 1.0 / m_iGraphSize * 100));
-            }
+            RefinePass<T>(index, order, m_iCEF, m_iRefineIter - 1);
             auto t2 = std::chrono::high_resolution_clock::now();
             LOG(Helper::LogLevel::LL_Info, "Refine RNG time (s): %lld Graph Acc: %f\n", std::chrono::duration_cast<std::chrono::seconds>(t2 - t1).count(), GraphAccuracyEstimation(index, 100, idmap));
         } else {
@@ -506,8 +525,7 @@ class RelativeNeighborhoodGraph {
         newGraph->m_iGraphSize = R;
         newGraph->m_iNeighborhoodSize = m_iNeighborhoodSize;
 
-#pragma omp parallel for schedule(dynamic)
-        for (SizeType i = 0; i < R; i++) {
+        Helper::TaskScheduler::Instance().ParallelFor<SizeType>(0, R, 1, [&](SizeType i) {
             if ((i * 5) % R == 0)
                 LOG(Helper::LogLevel::LL_Info, "Refine %d%%\n", static_cast<int>(i * 1.0 / R * 100));
 
@@ -526,7 +544,7 @@ class RelativeNeighborhoodGraph {
             }
             if (idmap != nullptr && (iter = idmap->find(-1 - i)) != idmap->end())
                 outnodes[m_iNeighborhoodSize - 1] = -2 - iter->second;
-        }
+        });
 
         if (output != nullptr)
             newGraph->SaveGraph(output);
@@ -552,10 +570,67 @@ class RelativeNeighborhoodGraph {
         }
     }
 
+    // Link the new nodes p_nodes[0, p_count) into the graph, kLinkChunk at a time. The members of a
+    // chunk cannot find each other before their reverse edges exist, so each is also offered the
+    // others as candidates. The reverse edges of a chunk are sorted by target and applied in that
+    // order, which locks every neighbour row once per chunk instead of once per edge.
+    template <typename T>
+    void RefineNodes(BKT::Index<T>* index, const SizeType* p_nodes, SizeType p_count, bool searchDeleted, int CEF) {
+        struct ReverseEdge {
+            SizeType target;
+            SizeType node;
+            float dist;
+        };
+        std::vector<BasicResult> candidates;
+        std::vector<ReverseEdge> reverse;
+        for (SizeType start = 0; start < p_count; start += kLinkChunk) {
+            SizeType end = (std::min)(p_count, start + kLinkChunk);
+            reverse.clear();
+            for (SizeType i = start; i < end; i++) {
+                SizeType node = p_nodes[i];
+                COMMON::QueryResultSet<T> query((const T*)index->GetSample(node), CEF + 1);
+                index->RefineSearchIndex(query, searchDeleted);
+                candidates.clear();
+                for (int j = 0; j <= CEF && query.GetResult(j)->VID >= 0; j++) candidates.emplace_back(query.GetResult(j)->VID, query.GetResult(j)->Dist);
+                for (SizeType j = start; j < end; j++) {
+                    if (j != i)
+                        candidates.emplace_back(p_nodes[j], index->ComputeDistance(index->GetSample(node), index->GetSample(p_nodes[j])));
+                }
+                std::sort(candidates.begin(), candidates.end(), [](const BasicResult& a, const BasicResult& b) { return a.VID < b.VID; });
+                candidates.erase(std::unique(candidates.begin(), candidates.end(), [](const BasicResult& a, const BasicResult& b) { return a.VID == b.VID; }), candidates.end());
+                std::sort(candidates.begin(), candidates.end(), COMMON::Compare);
+                {
+                    std::lock_guard<std::mutex> lock(m_dataUpdateLock[node]);
+                    RebuildNeighbors(index, node, m_pNeighborhoodGraph[node], candidates.data(), (int)candidates.size());
+                }
+                for (size_t j = 0; j < candidates.size() && j <= (size_t)CEF; j++) {
+                    if (candidates[j].VID != node)
+                        reverse.push_back(ReverseEdge{candidates[j].VID, node, candidates[j].Dist});
+                }
+            }
+            std::sort(reverse.begin(), reverse.end(), [](const ReverseEdge& a, const ReverseEdge& b) {
+                return a.target < b.target || (a.target == b.target && (a.dist < b.dist || (a.dist == b.dist && a.node < b.node)));
+            });
+            for (size_t j = 0; j < reverse.size();) {
+                SizeType target = reverse[j].target;
+                std::lock_guard<std::mutex> lock(m_dataUpdateLock[target]);
+                for (; j < reverse.size() && reverse[j].target == target; j++) InsertNeighborsLocked(index, target, reverse[j].node, reverse[j].dist);
+            }
+        }
+    }
+
     inline std::uint64_t BufferSize() const {
         return m_pNeighborhoodGraph.BufferSize();
     }
 
+    inline void SetMemoryPolicy(const MemoryPolicy& p_policy) {
+        m_pNeighborhoodGraph.SetMemoryPolicy(p_policy);
+    }
+
+    inline ErrorCode Replicate() {
+        return m_pNeighborhoodGraph.Replicate();
+    }
+
     ErrorCode LoadGraph(std::shared_ptr<Helper::DiskIO> input, SizeType blockSize, SizeType capacity) {
         ErrorCode ret = ErrorCode::Success;
         if ((ret = m_pNeighborhoodGraph.Load(input, blockSize, capacity)) != ErrorCode::Success)
@@ -613,6 +688,26 @@ class RelativeNeighborhoodGraph {
         return ErrorCode::Success;
     }
 
+    // rows p_begin .. p_begin + num - 1 numbered by the samples, appended without a lock
+    inline ErrorCode AddBatchAt(SizeType p_begin, SizeType num) {
+        ErrorCode ret = m_pNeighborhoodGraph.AddBatchAt(p_begin, num);
+        if (ret != ErrorCode::Success)
+            return ret;
+
+        SizeType size = __atomic_load_n(&m_iGraphSize, __ATOMIC_RELAXED);
+        while (size < p_begin + num && !__atomic_compare_exchange_n(&m_iGraphSize, &size, p_begin + num, true, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        }
+        return ErrorCode::Success;
+    }
+
+    inline ErrorCode AllocateBlocks(SizeType p_begin, SizeType num) {
+        return m_pNeighborhoodGraph.AllocateBlocks(p_begin, num);
+    }
+
+    inline void Abandon(SizeType p_begin) {
+        m_pNeighborhoodGraph.Abandon(p_begin);
+    }
+
     inline SizeType* operator[](SizeType index) {
         return m_pNeighborhoodGraph[index];
     }
@@ -639,6 +734,10 @@ class RelativeNeighborhoodGraph {
         return m_pNeighborhoodGraph.Name();
     }
 
+    // nodes searched before their rows are written in RefinePass, new nodes linked together in RefineNodes
+    static constexpr SizeType kRefineChunk = 4096;
+    static constexpr SizeType kLinkChunk = 64;
+
    protected:
     // Graph structure
     SizeType m_iGraphSize;
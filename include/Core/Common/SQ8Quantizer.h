@@ -0,0 +1,84 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_SQ8QUANTIZER_H_
+#define _SPTAG_COMMON_SQ8QUANTIZER_H_
+
+#include "Core/Common.h"
+#include "Utils/DistanceUtils.h"
+#include <cmath>
+#include <functional>
+#include <limits>
+
+namespace SPTAG::COMMON {
+// Symmetric 8-bit scalar quantizer with one scale for all components: x is stored as
+// round(x / scale) clamped to [-127, 127]. Codes are compared with the int8 kernels and the
+// result is mapped back to the distance scale of the original value type, so quantized and
+// exact distances can be mixed in one result set.
+class SQ8Quantizer {
+   public:
+    static constexpr int kMaxCode = 127;
+
+    SQ8Quantizer() {}
+
+    // p_maxAbs is the largest absolute component seen in the data, larger values are clamped on Encode
+    SQ8Quantizer(DimensionType p_dim, DistCalcMethod p_distCalcMethod, int p_base, float p_maxAbs)
+        : m_dim(p_dim), m_distCalcMethod(p_distCalcMethod), m_base(p_base) {
+        m_scale = (p_maxAbs > 0) ? p_maxAbs / kMaxCode : 1.0f;
+    }
+
+    template <typename T>
+    static float MaxAbs(const T* p_vector, DimensionType p_dim) {
+        float maxAbs = 0;
+        for (DimensionType d = 0; d < p_dim; d++) maxAbs = (std::max)(maxAbs, std::fabs((float)p_vector[d]));
+        return maxAbs;
+    }
+
+    inline DimensionType Dimension() const {
+        return m_dim;
+    }
+
+    inline float Scale() const {
+        return m_scale;
+    }
+
+    template <typename T>
+    void Encode(const T* p_vector, std::int8_t* p_code) const {
+        float inv = 1.0f / m_scale;
+        for (DimensionType d = 0; d < m_dim; d++) {
+            float value = std::round((float)p_vector[d] * inv);
+            p_code[d] = (std::int8_t)(std::min)((std::max)(value, (float)-kMaxCode), (float)kMaxCode);
+        }
+    }
+
+    template <typename T>
+    void Decode(const std::int8_t* p_code, T* p_vector) const {
+        for (DimensionType d = 0; d < m_dim; d++) p_vector[d] = (T)(p_code[d] * m_scale);
+    }
+
+    // distance of two codes on the scale of the value type the quantizer was built for:
+    // squared L2, or base * base minus the inner product for Cosine
+    std::function<float(const std::int8_t*, const std::int8_t*, DimensionType)> DistanceFunction() const {
+        DistanceCalcReturn<std::int8_t> kernel = DistanceCalcSelector<std::int8_t>(m_distCalcMethod);
+        float scale2 = m_scale * m_scale;
+        if (m_distCalcMethod == DistCalcMethod::L2) {
+            return [kernel, scale2](const std::int8_t* pX, const std::int8_t* pY, DimensionType length) {
+                return scale2 * kernel(pX, pY, length);
+            };
+        }
+        float baseSquare = (float)m_base * m_base;
+        float codeBaseSquare = (float)Utils::GetBase<std::int8_t>() * Utils::GetBase<std::int8_t>();
+        return [kernel, scale2, baseSquare, codeBaseSquare](const std::int8_t* pX, const std::int8_t* pY, DimensionType length) {
+            return baseSquare - scale2 * (codeBaseSquare - kernel(pX, pY, length));
+        };
+    }
+
+   private:
+    DimensionType m_dim = 0;
+    DistCalcMethod m_distCalcMethod = DistCalcMethod::L2;
+    int m_base = 1;
+    float m_scale = 1.0f;
+};
+}  // namespace SPTAG::COMMON
+
+#endif  // _SPTAG_COMMON_SQ8QUANTIZER_H_
@@ -0,0 +1,172 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_COMMON_TWOMEANS_H_
+#define _SPTAG_COMMON_TWOMEANS_H_
+
+#include "Core/Common.h"
+#include "Utils/DistanceUtils.h"
+#include <cmath>
+#include <limits>
+#include <vector>
+
+namespace SPTAG::COMMON {
+// 2-means for splitting one posting. Seeds are the vector farthest from the mean and the vector
+// farthest from that one, then Lloyd iterations run until no label changes or p_maxIterations.
+// Assignment goes through the one-to-many distance kernels, one call per center. The buffers are
+// kept between calls so a worker splitting posting after posting does not allocate.
+template <typename T>
+class TwoMeans {
+   public:
+    void Initialize(DimensionType p_dim, DistCalcMethod p_distCalcMethod) {
+        if (m_distanceBatch != nullptr && p_dim == m_dim && p_distCalcMethod == m_distCalcMethod)
+            return;
+        m_dim = p_dim;
+        m_distCalcMethod = p_distCalcMethod;
+        m_distanceBatch = DistanceBatchSelector<T>(p_distCalcMethod);
+        m_distance = DistanceCalcSelector<T>(p_distCalcMethod);
+        m_centers.resize((size_t)2 * p_dim);
+        m_sums.resize((size_t)2 * p_dim);
+    }
+
+    // cluster p_count vectors of the Initialize dimension and return the number of non-empty clusters;
+    // unless p_virtualCenter each center is replaced by the member closest to it
+    int Cluster(const void* const* p_vectors, SizeType p_count, int p_maxIterations, bool p_virtualCenter) {
+        m_labels.assign(p_count, 0);
+        m_dists[0].resize(p_count);
+        m_dists[1].resize(p_count);
+        m_counts[0] = p_count;
+        m_counts[1] = 0;
+        m_representatives[0] = m_representatives[1] = -1;
+        if (p_count < 2)
+            return p_count > 0 ? 1 : 0;
+
+        std::fill(m_sums.begin(), m_sums.begin() + m_dim, 0.0f);
+        for (SizeType i = 0; i < p_count; i++) Accumulate(0, (const T*)p_vectors[i]);
+        SetCenter(0, p_count);
+        Distances(0, p_vectors, p_count);
+        CopyCenter(0, (const T*)p_vectors[Farthest(0, p_count)]);
+        Distances(0, p_vectors, p_count);
+        CopyCenter(1, (const T*)p_vectors[Farthest(0, p_count)]);
+
+        for (int iter = 0; iter < (std::max)(p_maxIterations, 1); iter++) {
+            if (iter > 0)
+                Distances(0, p_vectors, p_count);
+            Distances(1, p_vectors, p_count);
+            SizeType changed = 0;
+            m_counts[0] = m_counts[1] = 0;
+            std::fill(m_sums.begin(), m_sums.end(), 0.0f);
+            for (SizeType i = 0; i < p_count; i++) {
+                int label = m_dists[1][i] < m_dists[0][i] ? 1 : 0;
+                if (iter == 0 || label != m_labels[i])
+                    changed++;
+                m_labels[i] = label;
+                m_counts[label]++;
+                Accumulate(label, (const T*)p_vectors[i]);
+            }
+            if (m_counts[0] == 0 || m_counts[1] == 0)
+                return 1;
+            if (changed == 0)
+                break;
+            SetCenter(0, m_counts[0]);
+            SetCenter(1, m_counts[1]);
+        }
+
+        if (!p_virtualCenter) {
+            Distances(0, p_vectors, p_count);
+            Distances(1, p_vectors, p_count);
+            float best[2] = {(std::numeric_limits<float>::max)(), (std::numeric_limits<float>::max)()};
+            for (SizeType i = 0; i < p_count; i++) {
+                int label = m_labels[i];
+                if (m_dists[label][i] < best[label]) {
+                    best[label] = m_dists[label][i];
+                    m_representatives[label] = i;
+                }
+            }
+            CopyCenter(0, (const T*)p_vectors[m_representatives[0]]);
+            CopyCenter(1, (const T*)p_vectors[m_representatives[1]]);
+        }
+        return 2;
+    }
+
+    // the cluster whose center is nearer to p_vector
+    inline int Assign(const T* p_vector) const {
+        return m_distance(Center(1), p_vector, m_dim) < m_distance(Center(0), p_vector, m_dim) ? 1 : 0;
+    }
+
+    inline int Label(SizeType p_index) const {
+        return m_labels[p_index];
+    }
+
+    inline SizeType Count(int p_cluster) const {
+        return m_counts[p_cluster];
+    }
+
+    inline const T* Center(int p_cluster) const {
+        return m_centers.data() + (size_t)p_cluster * m_dim;
+    }
+
+    // index of the member used as center, -1 for virtual centers
+    inline SizeType Representative(int p_cluster) const {
+        return m_representatives[p_cluster];
+    }
+
+   private:
+    inline void Accumulate(int p_cluster, const T* p_vector) {
+        float* sum = m_sums.data() + (size_t)p_cluster * m_dim;
+        for (DimensionType d = 0; d < m_dim; d++) sum[d] += (float)p_vector[d];
+    }
+
+    // the mean of the accumulated vectors, scaled to the base length for Cosine and rounded for integer types
+    void SetCenter(int p_cluster, SizeType p_count) {
+        float* sum = m_sums.data() + (size_t)p_cluster * m_dim;
+        float scale = 1.0f / p_count;
+        if (m_distCalcMethod == DistCalcMethod::Cosine) {
+            double length = 0;
+            for (DimensionType d = 0; d < m_dim; d++) length += (double)sum[d] * sum[d];
+            length = std::sqrt(length);
+            if (length > 1e-6)
+                scale = (float)(Utils::GetBase<T>() / length);
+        }
+        T* center = m_centers.data() + (size_t)p_cluster * m_dim;
+        for (DimensionType d = 0; d < m_dim; d++) {
+            float value = sum[d] * scale;
+            if (std::numeric_limits<T>::is_integer) {
+                value = std::round(value);
+                value = (std::min)((std::max)(value, (float)(std::numeric_limits<T>::min)()), (float)(std::numeric_limits<T>::max)());
+            }
+            center[d] = (T)value;
+        }
+    }
+
+    inline void CopyCenter(int p_cluster, const T* p_vector) {
+        std::copy(p_vector, p_vector + m_dim, m_centers.data() + (size_t)p_cluster * m_dim);
+    }
+
+    inline void Distances(int p_cluster, const void* const* p_vectors, SizeType p_count) {
+        m_distanceBatch(Center(p_cluster), p_vectors, (int)p_count, m_dim, m_dists[p_cluster].data());
+    }
+
+    inline SizeType Farthest(int p_cluster, SizeType p_count) const {
+        SizeType farthest = 0;
+        for (SizeType i = 1; i < p_count; i++) {
+            if (m_dists[p_cluster][i] > m_dists[p_cluster][farthest])
+                farthest = i;
+        }
+        return farthest;
+    }
+
+    DimensionType m_dim = 0;
+    DistCalcMethod m_distCalcMethod = DistCalcMethod::L2;
+    DistanceBatchReturn<T> m_distanceBatch = nullptr;
+    DistanceCalcReturn<T> m_distance = nullptr;
+    std::vector<T> m_centers;
+    std::vector<float> m_sums;
+    std::vector<float> m_dists[2];
+    std::vector<int> m_labels;
+    SizeType m_counts[2] = {0, 0};
+    SizeType m_representatives[2] = {-1, -1};
+};
+}  // namespace SPTAG::COMMON
+
+#endif  // _SPTAG_COMMON_TWOMEANS_H_
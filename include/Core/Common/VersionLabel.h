@@ -6,12 +6,28 @@
 
 #include <atomic>
 #include "Dataset.h"
+#include "MappedFile.h"
+#include "DeletedBitmap.h"
 
 namespace SPTAG::COMMON {
+// A version byte per VID, 0xfe once deleted. The deleted flags are mirrored in a bitmap, so
+// Deleted and the posting scans touch one bit per VID instead of one byte
 class VersionLabel {
    private:
     std::atomic<SizeType> m_deleted;
     Dataset<std::uint8_t> m_data;
+    MappedFile m_file;
+    DeletedBitmap m_deletedBits;
+
+    // the bits of the labels just initialized, loaded or mapped
+    ErrorCode RebuildDeletedBits(SizeType capacity) {
+        ErrorCode ret = m_deletedBits.Reserve((std::max)(capacity, m_data.R()));
+        if (ret != ErrorCode::Success)
+            return ret;
+        if (m_deleted.load() > 0)
+            m_deletedBits.Rebuild(m_data.R(), [this](SizeType key) { return *m_data[key] == 0xfe; });
+        return ErrorCode::Success;
+    }
 
    public:
     VersionLabel() {
@@ -20,7 +36,47 @@ class VersionLabel {
     }
 
     void Initialize(SizeType size, SizeType blockSize, SizeType capacity) {
+        m_file.Close();
+        m_deleted = 0;
         m_data.Initialize(size, 1, blockSize, capacity);
+        RebuildDeletedBits(capacity);
+    }
+
+    // keep the labels in a shared mapping of p_path: updates land in the file in place, Checkpoint
+    // makes them durable and a restart maps the file instead of reading it. p_reset starts over with
+    // size fresh labels, otherwise the labels of the last checkpoint are kept if there are any
+    ErrorCode Map(const std::string& p_path, SizeType size, SizeType blockSize, SizeType capacity, bool p_reset) {
+        ErrorCode ret = m_file.Attach(m_data, p_path, size, blockSize, capacity, p_reset);
+        if (ret != ErrorCode::Success)
+            return ret;
+        MappedFile::Header* header = m_file.GetHeader();
+        m_deleted = (SizeType)header->aux;
+        ret = RebuildDeletedBits(capacity);
+        if (ret != ErrorCode::Success)
+            return ret;
+        LOG(Helper::LogLevel::LL_Info, "Map %s (%d labels, %d deleted, checkpoint %llu) From %s\n", m_data.Name().c_str(), header->rows, (SizeType)header->aux, (unsigned long long)header->checkpoints, p_path.c_str());
+        return ErrorCode::Success;
+    }
+
+    inline bool IsMapped() const {
+        return m_file.IsOpen();
+    }
+
+    // fault the mapped labels in, heap labels are resident already
+    void Prefault() const {
+        m_file.Prefault((size_t)m_data.R());
+    }
+
+    // make the mapped labels durable, nothing to do for heap labels
+    ErrorCode Checkpoint() {
+        return m_file.Checkpoint(m_data.R(), m_deleted.load());
+    }
+
+    // labels are written in place, so they are never replicated
+    void SetMemoryPolicy(MemoryPolicy p_policy) {
+        if (p_policy.placement == NumaPlacement::Replicate)
+            p_policy.placement = NumaPlacement::Interleave;
+        m_data.SetMemoryPolicy(p_policy);
     }
 
     inline size_t Count() const {
@@ -32,10 +88,18 @@ class VersionLabel {
     }
 
     inline bool Deleted(const SizeType& key) const {
-        return *m_data[key] == 0xfe;
+        return m_deletedBits.Test(key);
     }
 
+    // bit i of p_mask[i / 64] set when the VID at the start of entry i of p_entries, p_stride bytes
+    // apart, is deleted. p_mask holds (p_count + 63) / 64 words
+    inline void DeletedMask(const char* p_entries, int p_stride, int p_count, std::uint64_t* p_mask) const {
+        m_deletedBits.TestStrided(p_entries, p_stride, p_count, p_mask);
+    }
+
+    // the bit goes first, so a VID whose label reads 0xfe always tests deleted
     inline bool Delete(const SizeType& key) {
+        m_deletedBits.Set(key);
         uint8_t oldvalue = (uint8_t)InterlockedExchange8((char*)(m_data[key]), (char)0xfe);
         if (oldvalue == 0xfe)
             return false;
@@ -43,15 +107,28 @@ class VersionLabel {
         return true;
     }
 
+    // delete all p_keys with one update of the deleted count, returns how many were live
+    inline SizeType Delete(const std::vector<SizeType>& p_keys) {
+        SizeType deleted = 0;
+        for (SizeType key : p_keys) {
+            m_deletedBits.Set(key);
+            if ((uint8_t)InterlockedExchange8((char*)(m_data[key]), (char)0xfe) != 0xfe)
+                deleted++;
+        }
+        m_deleted += deleted;
+        return deleted;
+    }
+
     inline uint8_t GetVersion(const SizeType& key) {
         return *m_data[key];
     }
 
     inline bool IncVersion(const SizeType& key, uint8_t* newVersion) {
         while (true) {
-            if (Deleted(key))
-                return false;
             uint8_t oldVersion = GetVersion(key);
+            // checked on the value the exchange compares against, so a concurrent Delete is never undone
+            if (oldVersion == 0xfe)
+                return false;
             *newVersion = (oldVersion + 1) & 0x7f;
             if (((uint8_t)InterlockedCompareExchange((char*)m_data[key], (char)*newVersion, (char)oldVersion)) == oldVersion) {
                 return true;
@@ -59,7 +136,7 @@ class VersionLabel {
         }
     }
 
-    inline SizeType GetVectorNum() {
+    inline SizeType GetVectorNum() const {
         return m_data.R();
     }
 
@@ -70,6 +147,10 @@ class VersionLabel {
     }
 
     inline ErrorCode Save(const std::string& filename) {
+        if (IsMapped()) {
+            LOG(Helper::LogLevel::LL_Info, "Checkpoint mapped %s instead of saving to %s\n", m_data.Name().c_str(), filename.c_str());
+            return Checkpoint();
+        }
         LOG(Helper::LogLevel::LL_Info, "Save %s To %s\n", m_data.Name().c_str(), filename.c_str());
         auto ptr = f_createIO();
         if (ptr == nullptr || !ptr->Initialize(filename.c_str(), std::ios::binary | std::ios::out))
@@ -81,7 +162,10 @@ class VersionLabel {
         SizeType deleted;
         IOBINARY(input, ReadBinary, sizeof(SizeType), (char*)&deleted);
         m_deleted = deleted;
-        return m_data.Load(input, blockSize, capacity);
+        ErrorCode ret = m_data.Load(input, blockSize, capacity);
+        if (ret != ErrorCode::Success)
+            return ret;
+        return RebuildDeletedBits(capacity);
     }
 
     inline ErrorCode Load(const std::string& filename, SizeType blockSize, SizeType capacity) {
@@ -94,11 +178,15 @@ class VersionLabel {
 
     inline ErrorCode Load(char* pmemoryFile, SizeType blockSize, SizeType capacity) {
         m_deleted = *((SizeType*)pmemoryFile);
-        return m_data.Load(pmemoryFile + sizeof(SizeType), blockSize, capacity);
+        ErrorCode ret = m_data.Load(pmemoryFile + sizeof(SizeType), blockSize, capacity);
+        if (ret != ErrorCode::Success)
+            return ret;
+        return RebuildDeletedBits(capacity);
     }
 
-    inline ErrorCode AddBatch(SizeType num) {
-        return m_data.AddBatch(num);
+    // lock-free, p_begin gets the first new index
+    inline ErrorCode AddBatch(SizeType num, SizeType* p_begin = nullptr) {
+        return m_data.AddBatch(num, nullptr, p_begin);
     }
 
     inline std::uint64_t BufferSize() const {
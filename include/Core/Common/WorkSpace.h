@@ -122,6 +122,107 @@ class OptHashPosVector {
     }
 };
 
+// Set of IDs in one open-addressed table whose slots carry the epoch they were written in:
+// clear() bumps the epoch instead of wiping the table. Probing is linear and never gives up,
+// the table doubles (rehashing only live entries) once it is half full and stays that size.
+class EpochHashPosVector {
+   protected:
+    struct Slot {
+        SizeType idx;
+        std::uint32_t epoch;
+    };
+
+    int m_exp;
+    int m_bits;
+    std::uint32_t m_mask;
+    std::uint32_t m_epoch;
+    SizeType m_count;
+    std::unique_ptr<Slot[]> m_hashTable;
+
+    inline std::uint32_t hash_func(SizeType idx) const {
+        return ((std::uint32_t)idx * 2654435761u) >> (32 - m_bits);
+    }
+
+    // true if idx was already in the table
+    inline bool Insert(Slot* hashTable, SizeType idx) {
+        std::uint32_t index = hash_func(idx);
+        while (hashTable[index].epoch == m_epoch) {
+            if (hashTable[index].idx == idx)
+                return true;
+            index = (index + 1) & m_mask;
+        }
+        hashTable[index].idx = idx;
+        hashTable[index].epoch = m_epoch;
+        return false;
+    }
+
+    void DoubleSize() {
+        std::unique_ptr<Slot[]> oldTable(std::move(m_hashTable));
+        std::uint32_t oldSize = m_mask + 1;
+        m_bits++;
+        m_exp++;
+        m_mask = (1u << m_bits) - 1;
+        m_hashTable.reset(new Slot[(size_t)m_mask + 1]());
+        for (std::uint32_t i = 0; i < oldSize; i++) {
+            if (oldTable[i].epoch == m_epoch)
+                Insert(m_hashTable.get(), oldTable[i].idx);
+        }
+    }
+
+   public:
+    EpochHashPosVector() : m_exp(2), m_bits(13), m_mask(8191), m_epoch(1), m_count(0) {}
+
+    // same sizing as OptHashPosVector: the smallest power of 2 above size, shifted left by exp
+    void Init(SizeType size, int exp) {
+        int ex = 0;
+        while (size != 0) {
+            ex++;
+            size >>= 1;
+        }
+        m_exp = exp;
+        m_bits = min(ex + exp, 31);
+        m_mask = (1u << m_bits) - 1;
+        m_hashTable.reset(new Slot[(size_t)m_mask + 1]());
+        m_epoch = 1;
+        m_count = 0;
+    }
+
+    inline void clear() {
+        m_count = 0;
+        if (++m_epoch == 0) {
+            memset(m_hashTable.get(), 0, sizeof(Slot) * ((size_t)m_mask + 1));
+            m_epoch = 1;
+        }
+    }
+
+    inline int HashTableExponent() const {
+        return m_exp;
+    }
+
+    inline int MaxCheck() const {
+        return 1 << (m_bits - m_exp);
+    }
+
+    inline bool CheckAndSet(SizeType idx) {
+        if (Insert(m_hashTable.get(), idx))
+            return true;
+        if (++m_count > (SizeType)(m_mask >> 1))
+            DoubleSize();
+        return false;
+    }
+
+    // lookup only, safe from several threads while nobody inserts
+    inline bool Contains(SizeType idx) const {
+        std::uint32_t index = hash_func(idx);
+        while (m_hashTable[index].epoch == m_epoch) {
+            if (m_hashTable[index].idx == idx)
+                return true;
+            index = (index + 1) & m_mask;
+        }
+        return false;
+    }
+};
+
 class DistPriorityQueue {
     int m_size;
     std::unique_ptr<float[]> m_data;
@@ -252,6 +353,9 @@ struct WorkSpace {
     Heap<NodeDistPair> m_nextBSPTQueue;
 
     DistPriorityQueue m_Results;
+
+    // query encoded for a quantized walk
+    std::vector<std::int8_t> m_quantizedQuery;
 };
 }  // namespace SPTAG::COMMON
 
@@ -7,6 +7,8 @@ DefineVectorValueType(Int8, std::int8_t)
     DefineVectorValueType(UInt8, std::uint8_t)
         DefineVectorValueType(Int16, std::int16_t)
             DefineVectorValueType(Float, float)
+                DefineVectorValueType(Float16, SPTAG::Float16)
+                    DefineVectorValueType(BFloat16, SPTAG::BFloat16)
 
 #endif  // DefineVectorValueType
 
@@ -40,6 +42,7 @@ DefineVectorValueType(Int8, std::int8_t)
     // 0x1000 ~ 0x1FFF  Index Build Status
 
     // 0x2000 ~ 0x2FFF  Index Serve Status
+    DefineErrorCode(IndexBusy, 0x2000)
 
     // 0x3000 ~ 0x3FFF  Helper Function Status
     DefineErrorCode(ReadIni_FailedParseSection, 0x3000)
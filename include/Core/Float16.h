@@ -0,0 +1,165 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_CORE_FLOAT16_H_
+#define _SPTAG_CORE_FLOAT16_H_
+
+#include <cstdint>
+#include <cstring>
+
+namespace SPTAG {
+// 16-bit storage formats for embeddings. Values convert to and from float implicitly, so the
+// generic code computes in float and only the vectors themselves take two bytes per component;
+// the distance kernels widen whole registers at once (F16C, AVX512F, AVX512-BF16)
+
+// IEEE 754 binary16: 1 sign, 5 exponent and 10 mantissa bits, rounded to nearest even
+struct Float16 {
+    std::uint16_t bits = 0;
+
+    Float16() = default;
+    Float16(float p_value) : bits(FromFloat(p_value)) {}
+
+    operator float() const {
+        return ToFloat(bits);
+    }
+
+    Float16& operator+=(float p_value) {
+        return *this = Float16(ToFloat(bits) + p_value);
+    }
+    Float16& operator-=(float p_value) {
+        return *this = Float16(ToFloat(bits) - p_value);
+    }
+    Float16& operator*=(float p_value) {
+        return *this = Float16(ToFloat(bits) * p_value);
+    }
+    Float16& operator/=(float p_value) {
+        return *this = Float16(ToFloat(bits) / p_value);
+    }
+
+    static inline Float16 FromBits(std::uint16_t p_bits) {
+        Float16 value;
+        value.bits = p_bits;
+        return value;
+    }
+
+    static inline std::uint16_t FromFloat(float p_value) {
+        std::uint32_t x;
+        memcpy(&x, &p_value, sizeof(x));
+        std::uint16_t sign = (std::uint16_t)((x >> 16) & 0x8000);
+        std::uint32_t exponent = (x >> 23) & 0xff;
+        std::uint32_t mantissa = x & 0x7fffff;
+        if (exponent == 0xff)
+            return sign | 0x7c00 | (mantissa != 0 ? 0x200 : 0);
+        int e = (int)exponent - 127 + 15;
+        if (e >= 0x1f)
+            return sign | 0x7c00;
+        if (e <= 0) {
+            // subnormal or zero, the implicit bit joins the mantissa before the shift
+            if (e < -10)
+                return sign;
+            mantissa |= 0x800000;
+            int shift = 14 - e;
+            std::uint32_t half = mantissa >> shift;
+            std::uint32_t rest = mantissa & ((1u << shift) - 1);
+            std::uint32_t middle = 1u << (shift - 1);
+            if (rest > middle || (rest == middle && (half & 1)))
+                half++;
+            return sign | (std::uint16_t)half;
+        }
+        std::uint32_t half = ((std::uint32_t)e << 10) | (mantissa >> 13);
+        std::uint32_t rest = mantissa & 0x1fff;
+        // a carry out of the mantissa correctly bumps the exponent, up to infinity
+        if (rest > 0x1000 || (rest == 0x1000 && (half & 1)))
+            half++;
+        return sign | (std::uint16_t)half;
+    }
+
+    static inline float ToFloat(std::uint16_t p_bits) {
+        std::uint32_t sign = (std::uint32_t)(p_bits & 0x8000) << 16;
+        std::uint32_t exponent = (p_bits >> 10) & 0x1f;
+        std::uint32_t mantissa = p_bits & 0x3ff;
+        std::uint32_t x;
+        if (exponent == 0x1f) {
+            x = sign | 0x7f800000 | (mantissa << 13);
+        } else if (exponent != 0) {
+            x = sign | ((exponent + 127 - 15) << 23) | (mantissa << 13);
+        } else if (mantissa == 0) {
+            x = sign;
+        } else {
+            // subnormal half, normalise it for the wider exponent
+            int e = -1;
+            do {
+                e++;
+                mantissa <<= 1;
+            } while ((mantissa & 0x400) == 0);
+            x = sign | ((std::uint32_t)(127 - 15 - e) << 23) | ((mantissa & 0x3ff) << 13);
+        }
+        float value;
+        memcpy(&value, &x, sizeof(value));
+        return value;
+    }
+};
+
+// bfloat16: the upper half of a float, rounded to nearest even. Same range as float, 8 mantissa bits
+struct BFloat16 {
+    std::uint16_t bits = 0;
+
+    BFloat16() = default;
+    BFloat16(float p_value) : bits(FromFloat(p_value)) {}
+
+    operator float() const {
+        return ToFloat(bits);
+    }
+
+    BFloat16& operator+=(float p_value) {
+        return *this = BFloat16(ToFloat(bits) + p_value);
+    }
+    BFloat16& operator-=(float p_value) {
+        return *this = BFloat16(ToFloat(bits) - p_value);
+    }
+    BFloat16& operator*=(float p_value) {
+        return *this = BFloat16(ToFloat(bits) * p_value);
+    }
+    BFloat16& operator/=(float p_value) {
+        return *this = BFloat16(ToFloat(bits) / p_value);
+    }
+
+    static inline BFloat16 FromBits(std::uint16_t p_bits) {
+        BFloat16 value;
+        value.bits = p_bits;
+        return value;
+    }
+
+    static inline std::uint16_t FromFloat(float p_value) {
+        std::uint32_t x;
+        memcpy(&x, &p_value, sizeof(x));
+        if ((x & 0x7fffffff) > 0x7f800000)
+            return (std::uint16_t)((x >> 16) | 0x40);
+        return (std::uint16_t)((x + 0x7fff + ((x >> 16) & 1)) >> 16);
+    }
+
+    static inline float ToFloat(std::uint16_t p_bits) {
+        std::uint32_t x = (std::uint32_t)p_bits << 16;
+        float value;
+        memcpy(&value, &x, sizeof(value));
+        return value;
+    }
+};
+
+static_assert(sizeof(Float16) == 2 && sizeof(BFloat16) == 2, "16-bit value types must stay two bytes");
+
+template <typename T>
+struct IsHalfFloat {
+    static constexpr bool value = false;
+};
+template <>
+struct IsHalfFloat<Float16> {
+    static constexpr bool value = true;
+};
+template <>
+struct IsHalfFloat<BFloat16> {
+    static constexpr bool value = true;
+};
+}  // namespace SPTAG
+
+#endif  // _SPTAG_CORE_FLOAT16_H_
@@ -5,6 +5,8 @@
 #define _SPTAG_METADATASET_H_
 
 #include "CommonDataStructure.h"
+#include "SearchResult.h"
+#include <deque>
 
 namespace SPTAG {
 
@@ -18,6 +20,14 @@ class MetadataSet {
 
     virtual ByteArray GetMetadataCopy(SizeType p_vectorID) const = 0;
 
+    // metadata that stays readable as long as this set lives, without a copy where the set can
+    // give one. The default copies, which is always safe
+    virtual ByteArray GetMetadataView(SizeType p_vectorID) const;
+
+    // GetMetadataView for the Meta of p_count results, c_empty for VID < 0. Sets backed by a mapping
+    // start all page faults of the batch before the first one is waited for
+    virtual void GetMetadataViews(BasicResult* p_results, int p_count) const;
+
     virtual SizeType Count() const = 0;
 
     virtual bool Available() const = 0;
@@ -93,6 +103,9 @@ class MemMetadataSet : public MetadataSet {
 
     ByteArray GetMetadataCopy(SizeType p_vectorID) const;
 
+    // loaded records are views of the holder, added ones are copied since Add may move them
+    ByteArray GetMetadataView(SizeType p_vectorID) const;
+
     SizeType Count() const;
 
     bool Available() const;
@@ -119,6 +132,60 @@ class MemMetadataSet : public MetadataSet {
     std::vector<std::uint8_t> m_newdata;
 };
 
+// Metadata file and its offset index mapped read-only, so a lookup is two loads from the page cache
+// and the loaded records are handed out as views of the mapping. Added records are kept in memory
+// as shared blobs. Saving writes new files next to the mapping, which stays on the old ones until
+// the set is destroyed, so no view handed out is ever unmapped
+class MappedMetadataSet : public MetadataSet {
+   public:
+    MappedMetadataSet(const std::string& p_metaFile, const std::string& p_metaindexFile);
+
+    ~MappedMetadataSet();
+
+    ByteArray GetMetadata(SizeType p_vectorID) const;
+
+    ByteArray GetMetadataCopy(SizeType p_vectorID) const;
+
+    ByteArray GetMetadataView(SizeType p_vectorID) const;
+
+    void GetMetadataViews(BasicResult* p_results, int p_count) const;
+
+    SizeType Count() const;
+
+    bool Available() const;
+
+    std::pair<std::uint64_t, std::uint64_t> BufferSize() const;
+
+    void Add(const ByteArray& data);
+
+    ErrorCode SaveMetadata(std::shared_ptr<Helper::DiskIO> p_metaOut, std::shared_ptr<Helper::DiskIO> p_metaIndexOut);
+
+    ErrorCode SaveMetadata(const std::string& p_metaFile, const std::string& p_metaindexFile);
+
+   private:
+    void Unmap();
+
+    inline std::uint64_t Offset(SizeType p_index) const {
+        std::uint64_t offset;
+        memcpy(&offset, m_offsets + sizeof(std::uint64_t) * p_index, sizeof(offset));
+        return offset;
+    }
+
+    std::shared_ptr<void> m_lock;
+
+    // the index file is a SizeType count followed by count + 1 offsets, unaligned in the mapping
+    const std::uint8_t* m_index = nullptr;
+    size_t m_indexLength = 0;
+    const std::uint8_t* m_offsets = nullptr;
+    const std::uint8_t* m_data = nullptr;
+    size_t m_dataLength = 0;
+
+    SizeType m_count = 0;
+
+    std::deque<ByteArray> m_newdata;
+    std::uint64_t m_newBytes = 0;
+};
+
 }  // namespace SPTAG
 
 #endif  // _SPTAG_METADATASET_H_
@@ -0,0 +1,201 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_AUTOTUNER_H_
+#define _SPTAG_SPANN_AUTOTUNER_H_
+
+#include "Core/Common.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// what the index saw over one tuning interval
+struct TunerSample {
+    std::uint64_t m_queries = 0;
+    double m_searchLatencyUs = 0;    // mean of the interval's queries over all search stages
+    double m_probeLimitedRatio = 0;  // queries whose probe budget ran out while the next head was still worth reading
+    std::uint64_t m_inserts = 0;
+    std::uint64_t m_splits = 0;
+    int m_splitQueue = 0;  // split and merge jobs queued at the end of the interval
+    int m_reassignQueue = 0;
+    double m_postingFill = 0;        // mean live posting length over the posting size limit
+    double m_smallPostingRatio = 0;  // live postings below a quarter of the limit
+};
+
+struct TunerChange {
+    std::string m_param;
+    int m_from;
+    int m_to;
+    std::string m_reason;
+};
+
+// Feedback controller for the update and probe knobs. Every Step looks at one interval's sample
+// and moves each knob by at most one step, an eighth of its value and at least 1, inside its
+// range. Knobs lowered for being idle have to be idle for kIdleSteps intervals in a row first, so
+// a short lull does not undo what a burst needed. A knob without a range is never moved
+class AutoTuner {
+   public:
+    enum Knob { Probe = 0, PageLimit, Merge, ReassignK, AppendThreads, ReassignThreads, kKnobs };
+
+    static constexpr std::uint64_t kMinQueries = 32;
+    static constexpr int kIdleSteps = 3;
+    static constexpr double kProbeLimitedHigh = 0.1;
+    static constexpr double kProbeLimitedLow = 0.01;
+    static constexpr double kSplitsPerInsertHigh = 0.01;
+    static constexpr double kSmallPostingHigh = 0.3;
+    static constexpr double kSmallPostingLow = 0.05;
+
+    static const char* KnobName(int p_knob) {
+        static const char* names[kKnobs] = {"SearchInternalResultNum", "PostingPageLimit", "MergeThreshold", "ReassignK", "AppendThreadNum", "ReassignThreadNum"};
+        return names[p_knob];
+    }
+
+    // "min:max", false for an empty or malformed range
+    static bool ParseRange(const std::string& p_range, int& p_min, int& p_max) {
+        int lo, hi;
+        char rest;
+        if (sscanf(p_range.c_str(), "%d:%d%c", &lo, &hi, &rest) != 2 || lo < 0 || hi < lo)
+            return false;
+        p_min = lo;
+        p_max = hi;
+        return true;
+    }
+
+    void SetRange(Knob p_knob, int p_min, int p_max) {
+        m_knobs[p_knob].m_min = p_min;
+        m_knobs[p_knob].m_max = p_max;
+        m_knobs[p_knob].m_tuned = true;
+    }
+
+    bool Tuned(Knob p_knob) const {
+        return m_knobs[p_knob].m_tuned;
+    }
+
+    // the value the knob has now, set before every Step
+    void SetValue(Knob p_knob, int p_value) {
+        m_knobs[p_knob].m_value = p_value;
+    }
+
+    int Value(Knob p_knob) const {
+        return m_knobs[p_knob].m_value;
+    }
+
+    // 0 for no latency target: the probe budget then only follows the probe-limited queries
+    void SetLatencyTarget(double p_us) {
+        m_latencyTargetUs = p_us;
+    }
+
+    std::vector<TunerChange> Step(const TunerSample& p_sample) {
+        std::vector<TunerChange> changes;
+        bool searched = p_sample.m_queries >= kMinQueries;
+        bool slow = searched && m_latencyTargetUs > 0 && p_sample.m_searchLatencyUs > m_latencyTargetUs * 1.1;
+        bool headroom = !searched || m_latencyTargetUs <= 0 || p_sample.m_searchLatencyUs < m_latencyTargetUs * 0.9;
+        char reason[128];
+
+        if (searched) {
+            if (slow) {
+                snprintf(reason, sizeof(reason), "search latency %.0f us over the %.0f us target", p_sample.m_searchLatencyUs, m_latencyTargetUs);
+                Move(Probe, -1, reason, changes);
+            } else if (p_sample.m_probeLimitedRatio > kProbeLimitedHigh && headroom) {
+                snprintf(reason, sizeof(reason), "%.0f%% of queries ran out of probes", p_sample.m_probeLimitedRatio * 100);
+                Move(Probe, 1, reason, changes);
+            } else if (Idle(Probe, p_sample.m_probeLimitedRatio < kProbeLimitedLow)) {
+                snprintf(reason, sizeof(reason), "%.1f%% of queries ran out of probes", p_sample.m_probeLimitedRatio * 100);
+                Move(Probe, -1, reason, changes);
+            }
+        }
+
+        // larger postings split less often and rewrite less, but every probe reads more
+        double splitRate = p_sample.m_inserts > 0 ? (double)p_sample.m_splits / p_sample.m_inserts : 0;
+        if (slow && p_sample.m_postingFill > 0.5) {
+            snprintf(reason, sizeof(reason), "search latency %.0f us with postings %.0f%% full", p_sample.m_searchLatencyUs, p_sample.m_postingFill * 100);
+            MoveBy(PageLimit, -1, reason, changes);
+        } else if (splitRate > kSplitsPerInsertHigh && headroom) {
+            snprintf(reason, sizeof(reason), "%.1f splits per 1000 inserts", splitRate * 1000);
+            MoveBy(PageLimit, 1, reason, changes);
+        }
+
+        // small postings cost a probe each while holding few vectors, merging them costs writes
+        if (p_sample.m_splitQueue > 4 * (std::max)(Value(AppendThreads), 1)) {
+            snprintf(reason, sizeof(reason), "%d split and merge jobs queued", p_sample.m_splitQueue);
+            Move(Merge, -1, reason, changes);
+        } else if (p_sample.m_smallPostingRatio > kSmallPostingHigh) {
+            snprintf(reason, sizeof(reason), "%.0f%% of postings below a quarter of the limit", p_sample.m_smallPostingRatio * 100);
+            Move(Merge, 1, reason, changes);
+        } else if (Idle(Merge, p_sample.m_smallPostingRatio < kSmallPostingLow)) {
+            snprintf(reason, sizeof(reason), "%.1f%% of postings below a quarter of the limit", p_sample.m_smallPostingRatio * 100);
+            Move(Merge, -1, reason, changes);
+        }
+
+        // reassigns check ReassignK nearby heads after every split, the quality costs reassign work
+        if (p_sample.m_reassignQueue > 4 * (std::max)(Value(ReassignThreads), 1)) {
+            snprintf(reason, sizeof(reason), "%d reassign jobs queued", p_sample.m_reassignQueue);
+            Move(ReassignK, -1, reason, changes);
+        } else if (p_sample.m_reassignQueue == 0 && searched && p_sample.m_probeLimitedRatio > kProbeLimitedHigh) {
+            snprintf(reason, sizeof(reason), "reassigns keep up, %.0f%% of queries ran out of probes", p_sample.m_probeLimitedRatio * 100);
+            Move(ReassignK, 1, reason, changes);
+        }
+
+        TuneThreads(AppendThreads, p_sample.m_splitQueue, "split and merge", changes);
+        TuneThreads(ReassignThreads, p_sample.m_reassignQueue, "reassign", changes);
+        return changes;
+    }
+
+   private:
+    struct KnobState {
+        int m_min = 0;
+        int m_max = -1;
+        int m_value = 0;
+        bool m_tuned = false;
+        int m_idle = 0;
+    };
+
+    // workers are added while more than two jobs per worker wait and taken away once none did for
+    // kIdleSteps intervals
+    void TuneThreads(Knob p_knob, int p_queue, const char* p_kind, std::vector<TunerChange>& p_changes) {
+        char reason[128];
+        if (p_queue > 2 * Value(p_knob)) {
+            snprintf(reason, sizeof(reason), "%d %s jobs queued", p_queue, p_kind);
+            MoveBy(p_knob, 1, reason, p_changes);
+        } else if (Idle(p_knob, p_queue == 0)) {
+            snprintf(reason, sizeof(reason), "no %s jobs queued", p_kind);
+            MoveBy(p_knob, -1, reason, p_changes);
+        }
+    }
+
+    // counts idle intervals, true once there were kIdleSteps in a row
+    bool Idle(Knob p_knob, bool p_idle) {
+        KnobState& knob = m_knobs[p_knob];
+        knob.m_idle = p_idle ? knob.m_idle + 1 : 0;
+        if (knob.m_idle < kIdleSteps)
+            return false;
+        knob.m_idle = 0;
+        return true;
+    }
+
+    // one step of an eighth of the value, at least 1
+    void Move(Knob p_knob, int p_direction, const char* p_reason, std::vector<TunerChange>& p_changes) {
+        MoveBy(p_knob, p_direction * (std::max)(Value(p_knob) / 8, 1), p_reason, p_changes);
+    }
+
+    void MoveBy(Knob p_knob, int p_delta, const char* p_reason, std::vector<TunerChange>& p_changes) {
+        KnobState& knob = m_knobs[p_knob];
+        if (!knob.m_tuned)
+            return;
+        int value = (std::min)((std::max)(knob.m_value + p_delta, knob.m_min), knob.m_max);
+        if (value == knob.m_value)
+            return;
+        p_changes.push_back({KnobName(p_knob), knob.m_value, value, p_reason});
+        knob.m_value = value;
+        knob.m_idle = 0;
+    }
+
+    KnobState m_knobs[kKnobs];
+    double m_latencyTargetUs = 0;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_AUTOTUNER_H_
@@ -0,0 +1,432 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_BLOCKPOOL_H_
+#define _SPTAG_SPANN_BLOCKPOOL_H_
+
+#include "Core/Common.h"
+#include "Core/SPANN/IKeyValueIO.h"
+#include "Core/SPANN/MappingJournal.h"
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SPTAG::SPANN {
+class BlockPool;
+
+// The part of a shared drive one index lays its postings out on. I/O goes straight to the device of
+// the pool, free space comes from the slabs the namespace owns and grows a slab at a time up to its
+// quota. Per-thread Initialize and ShutDown are counted by the pool, so the indexes of a thread
+// bring the device up and down once between them
+class BlockNamespace : public BlockDevice {
+   public:
+    BlockNamespace(std::shared_ptr<BlockPool> p_pool, std::int32_t p_id, const std::string& p_name);
+
+    ~BlockNamespace();
+
+    bool Initialize(int batchSize, AddressType maxBlocks = kMaxNumBlocks) override;
+
+    bool ShutDown() override;
+
+    bool ReadBlocks(AddressType* p_data, std::string* p_value, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        return m_device->ReadBlocks(p_data, p_value, timeout);
+    }
+
+    bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<std::string>* p_values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        return m_device->ReadBlocks(p_data, p_values, timeout);
+    }
+
+    bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<PostingView>* p_views, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        return m_device->ReadBlocks(p_data, p_views, p_onPostingDone, timeout);
+    }
+
+    using BlockDevice::ReadBlocks;
+
+    void ReleaseViews(std::vector<PostingView>* p_views) override {
+        m_device->ReleaseViews(p_views);
+    }
+
+    using BlockDevice::WriteBlocks;
+
+    bool WriteBlocks(std::vector<AddressType*>& p_data, std::vector<int>& p_sizes, std::vector<const std::string*>& p_values) override {
+        return m_device->WriteBlocks(p_data, p_sizes, p_values);
+    }
+
+    PostingView AcquireWriteBuffer(AddressType p_pages) override {
+        return m_device->AcquireWriteBuffer(p_pages);
+    }
+
+    bool WriteBlocksDirect(const AddressType* p_blocks, AddressType p_pages, const char* p_buffer) override {
+        return m_device->WriteBlocksDirect(p_blocks, p_pages, p_buffer);
+    }
+
+    bool IOStatistics() override {
+        return m_device->IOStatistics();
+    }
+
+    void CollectMetrics(Helper::MetricsWriter& p_writer) override {
+        m_device->CollectMetrics(p_writer);
+    }
+
+    // the free space is rebuilt from the owned slabs only, blocks of other namespaces stay untouched
+    void ResetBlocks(const std::vector<std::uint64_t>& p_usedBits) override;
+
+    // free blocks in the owned slabs plus the slabs the quota and the pool still allow
+    AddressType RemainBlocks() override;
+
+    inline const std::string& Name() const {
+        return m_name;
+    }
+
+   protected:
+    bool Grow(int p_size) override;
+
+   private:
+    std::shared_ptr<BlockPool> m_pool;
+    std::shared_ptr<BlockDevice> m_device;
+    std::int32_t m_id;
+    std::string m_name;
+    std::once_flag m_loaded;
+};
+
+// One block device per drive, shared by every index of the process that names the same table.
+// The address space is handed out in slabs to named namespaces, each with a quota of blocks. Which
+// namespace owns which slab is kept in the table file, rewritten before a claimed slab is used, so
+// a namespace recovering its free space after a restart only touches its own slabs while the
+// others need not be open. A shadow index is rebuilt in a namespace of its own next to the live
+// one, and the old namespace is dropped after the swap to give its slabs back
+class BlockPool : public std::enable_shared_from_this<BlockPool> {
+   public:
+    static constexpr AddressType kDefaultSlabBlocks = 65536;  // 256MB
+    static constexpr std::uint32_t kTableMagic = 0x4c505342;  // "BSPL"
+
+    typedef std::function<std::shared_ptr<BlockDevice>()> DeviceFactory;
+
+    // the pool of p_table, brought up on a device from p_factory unless an index of the process has
+    // it open already. p_slabBlocks only applies to a new table. nullptr when the table cannot be read
+    static std::shared_ptr<BlockPool> Attach(const std::string& p_table, const DeviceFactory& p_factory, AddressType p_maxBlocks = BlockDevice::kMaxNumBlocks, AddressType p_slabBlocks = kDefaultSlabBlocks) {
+        std::lock_guard<std::mutex> lock(RegistryLock());
+        std::shared_ptr<BlockPool> pool = Registry()[p_table].lock();
+        if (pool != nullptr)
+            return pool;
+        pool.reset(new BlockPool(p_table, p_maxBlocks, (std::max)(p_slabBlocks, (AddressType)1)));
+        if (fileexists(p_table.c_str()) && pool->Load() != ErrorCode::Success) {
+            LOG(Helper::LogLevel::LL_Error, "BlockPool: cannot read namespace table %s\n", p_table.c_str());
+            return nullptr;
+        }
+        pool->m_device = p_factory();
+        if (pool->m_device == nullptr)
+            return nullptr;
+        Registry()[p_table] = pool;
+        LOG(Helper::LogLevel::LL_Info, "BlockPool: %s with %zu namespaces, %lld blocks per slab\n", p_table.c_str(), pool->m_namespaces.size(), (long long)pool->m_slabBlocks);
+        return pool;
+    }
+
+    // the namespace p_name, created when the table has none of that name. p_quotaBlocks caps the
+    // blocks it may own, 0 for no cap, and replaces the quota of an existing namespace. nullptr if
+    // it is open already, two indexes never share a namespace
+    std::shared_ptr<BlockNamespace> Open(const std::string& p_name, AddressType p_quotaBlocks) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::int32_t id = -1;
+        for (auto& ns : m_namespaces) {
+            if (ns.second.name == p_name)
+                id = ns.first;
+        }
+        if (id >= 0 && m_open.count(id) > 0) {
+            LOG(Helper::LogLevel::LL_Error, "BlockPool: namespace %s is open already\n", p_name.c_str());
+            return nullptr;
+        }
+        if (id < 0) {
+            id = m_nextId++;
+            m_namespaces[id].name = p_name;
+        }
+        m_namespaces[id].quota = p_quotaBlocks;
+        if (SaveLocked() != ErrorCode::Success)
+            return nullptr;
+        m_open.insert(id);
+        return std::make_shared<BlockNamespace>(shared_from_this(), id, p_name);
+    }
+
+    // every slab of p_name goes back to the pool, fails while the namespace is open
+    ErrorCode Drop(const std::string& p_name) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto& ns : m_namespaces) {
+            if (ns.second.name != p_name)
+                continue;
+            if (m_open.count(ns.first) > 0)
+                return ErrorCode::Fail;
+            std::int32_t id = ns.first;
+            for (auto& owner : m_owners) {
+                if (owner == id)
+                    owner = -1;
+            }
+            m_namespaces.erase(id);
+            return SaveLocked();
+        }
+        return ErrorCode::ParamNotFound;
+    }
+
+    inline AddressType SlabBlocks() const {
+        return m_slabBlocks;
+    }
+
+    // slabs owned by p_name, -1 if there is no such namespace
+    AddressType OwnedSlabs(const std::string& p_name) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        for (auto& ns : m_namespaces) {
+            if (ns.second.name == p_name)
+                return CountLocked(ns.first);
+        }
+        return -1;
+    }
+
+   private:
+    friend class BlockNamespace;
+
+    struct Namespace {
+        std::string name;
+        AddressType quota = 0;
+    };
+
+    BlockPool(const std::string& p_table, AddressType p_maxBlocks, AddressType p_slabBlocks)
+        : m_table(p_table), m_maxBlocks(p_maxBlocks), m_slabBlocks(p_slabBlocks) {}
+
+    static std::mutex& RegistryLock() {
+        static std::mutex lock;
+        return lock;
+    }
+
+    static std::map<std::string, std::weak_ptr<BlockPool>>& Registry() {
+        static std::map<std::string, std::weak_ptr<BlockPool>> registry;
+        return registry;
+    }
+
+    // Initialize calls of the calling thread on the device of each pool
+    static std::unordered_map<const BlockPool*, int>& ThreadRefs() {
+        static thread_local std::unordered_map<const BlockPool*, int> refs;
+        return refs;
+    }
+
+    bool InitializeThread(int p_batchSize) {
+        int& refs = ThreadRefs()[this];
+        if (refs++ > 0)
+            return true;
+        if (!m_device->Initialize(p_batchSize, m_maxBlocks)) {
+            ThreadRefs().erase(this);
+            return false;
+        }
+        return true;
+    }
+
+    bool ShutDownThread() {
+        auto& refs = ThreadRefs();
+        auto it = refs.find(this);
+        if (it == refs.end())
+            return true;
+        if (--it->second > 0)
+            return true;
+        refs.erase(it);
+        return m_device->ShutDown();
+    }
+
+    void Close(std::int32_t p_id) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_open.erase(p_id);
+    }
+
+    // first blocks of the slabs p_id owns
+    std::vector<AddressType> SlabsOf(std::int32_t p_id) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::vector<AddressType> starts;
+        for (size_t s = 0; s < m_owners.size(); s++) {
+            if (m_owners[s] == p_id)
+                starts.push_back((AddressType)s * m_slabBlocks);
+        }
+        return starts;
+    }
+
+    // hand p_count free slabs to p_id and persist the table before they are used. Returns their
+    // first blocks, empty when the quota or the drive would be exceeded
+    std::vector<AddressType> Claim(std::int32_t p_id, AddressType p_count) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        std::vector<AddressType> starts;
+        AddressType slabs = m_device->MaxBlocks() / m_slabBlocks;
+        if ((AddressType)m_owners.size() < slabs)
+            m_owners.resize((size_t)slabs, -1);
+        AddressType quota = m_namespaces[p_id].quota;
+        if (quota > 0 && CountLocked(p_id) + p_count > (quota + m_slabBlocks - 1) / m_slabBlocks) {
+            LOG(Helper::LogLevel::LL_Error, "BlockPool: namespace %s reached its quota of %lld blocks\n", m_namespaces[p_id].name.c_str(), (long long)quota);
+            return starts;
+        }
+        for (AddressType s = 0; s < slabs && (AddressType)starts.size() < p_count; s++) {
+            if (m_owners[s] < 0)
+                starts.push_back(s);
+        }
+        if ((AddressType)starts.size() < p_count) {
+            LOG(Helper::LogLevel::LL_Error, "BlockPool: no free slab left for namespace %s\n", m_namespaces[p_id].name.c_str());
+            starts.clear();
+            return starts;
+        }
+        for (AddressType& s : starts) m_owners[s] = p_id;
+        if (SaveLocked() != ErrorCode::Success) {
+            for (AddressType s : starts) m_owners[s] = -1;
+            starts.clear();
+            return starts;
+        }
+        for (AddressType& s : starts) s *= m_slabBlocks;
+        return starts;
+    }
+
+    // blocks p_id could still claim, bounded by its quota and the free slabs
+    AddressType Claimable(std::int32_t p_id) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        AddressType slabs = m_device->MaxBlocks() / m_slabBlocks, free = slabs;
+        for (std::int32_t owner : m_owners) {
+            if (owner >= 0)
+                free--;
+        }
+        AddressType quota = m_namespaces[p_id].quota;
+        if (quota > 0)
+            free = (std::min)(free, (std::max)((AddressType)0, (quota + m_slabBlocks - 1) / m_slabBlocks - CountLocked(p_id)));
+        return free * m_slabBlocks;
+    }
+
+    AddressType CountLocked(std::int32_t p_id) const {
+        AddressType count = 0;
+        for (std::int32_t owner : m_owners) {
+            if (owner == p_id)
+                count++;
+        }
+        return count;
+    }
+
+    ErrorCode Load() {
+        auto ptr = f_createIO();
+        if (ptr == nullptr || !ptr->Initialize(m_table.c_str(), std::ios::binary | std::ios::in))
+            return ErrorCode::FailedOpenFile;
+        std::uint32_t magic = 0;
+        IOBINARY(ptr, ReadBinary, sizeof(magic), (char*)&magic);
+        if (magic != kTableMagic)
+            return ErrorCode::Fail;
+        std::int32_t count = 0;
+        std::uint64_t slabs = 0;
+        IOBINARY(ptr, ReadBinary, sizeof(m_slabBlocks), (char*)&m_slabBlocks);
+        IOBINARY(ptr, ReadBinary, sizeof(m_nextId), (char*)&m_nextId);
+        IOBINARY(ptr, ReadBinary, sizeof(count), (char*)&count);
+        for (std::int32_t i = 0; i < count; i++) {
+            std::int32_t id = 0, length = 0;
+            Namespace ns;
+            IOBINARY(ptr, ReadBinary, sizeof(id), (char*)&id);
+            IOBINARY(ptr, ReadBinary, sizeof(ns.quota), (char*)&ns.quota);
+            IOBINARY(ptr, ReadBinary, sizeof(length), (char*)&length);
+            ns.name.resize(length);
+            if (length > 0) {
+                IOBINARY(ptr, ReadBinary, length, &ns.name[0]);
+            }
+            m_namespaces[id] = ns;
+        }
+        IOBINARY(ptr, ReadBinary, sizeof(slabs), (char*)&slabs);
+        m_owners.resize((size_t)slabs);
+        if (slabs > 0) {
+            IOBINARY(ptr, ReadBinary, sizeof(std::int32_t) * slabs, (char*)m_owners.data());
+        }
+        return m_slabBlocks > 0 ? ErrorCode::Success : ErrorCode::Fail;
+    }
+
+    // written aside and renamed over the table, so a crash leaves the old or the new one
+    ErrorCode SaveLocked() {
+        std::string tmpPath = m_table + "_tmp";
+        {
+            auto ptr = f_createIO();
+            if (ptr == nullptr || !ptr->Initialize(tmpPath.c_str(), std::ios::binary | std::ios::out))
+                return ErrorCode::FailedCreateFile;
+            std::int32_t count = (std::int32_t)m_namespaces.size();
+            std::uint64_t slabs = m_owners.size();
+            IOBINARY(ptr, WriteBinary, sizeof(kTableMagic), (char*)&kTableMagic);
+            IOBINARY(ptr, WriteBinary, sizeof(m_slabBlocks), (char*)&m_slabBlocks);
+            IOBINARY(ptr, WriteBinary, sizeof(m_nextId), (char*)&m_nextId);
+            IOBINARY(ptr, WriteBinary, sizeof(count), (char*)&count);
+            for (auto& ns : m_namespaces) {
+                std::int32_t id = ns.first, length = (std::int32_t)ns.second.name.size();
+                IOBINARY(ptr, WriteBinary, sizeof(id), (char*)&id);
+                IOBINARY(ptr, WriteBinary, sizeof(ns.second.quota), (char*)&ns.second.quota);
+                IOBINARY(ptr, WriteBinary, sizeof(length), (char*)&length);
+                if (length > 0) {
+                    IOBINARY(ptr, WriteBinary, length, (char*)ns.second.name.data());
+                }
+            }
+            IOBINARY(ptr, WriteBinary, sizeof(slabs), (char*)&slabs);
+            if (slabs > 0) {
+                IOBINARY(ptr, WriteBinary, sizeof(std::int32_t) * slabs, (char*)m_owners.data());
+            }
+            ptr->ShutDown();
+        }
+        MappingJournal::SyncFile(tmpPath);
+        if (std::rename(tmpPath.c_str(), m_table.c_str()) != 0) {
+            LOG(Helper::LogLevel::LL_Error, "BlockPool: fail to rename %s to %s\n", tmpPath.c_str(), m_table.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        return ErrorCode::Success;
+    }
+
+    std::string m_table;
+    AddressType m_maxBlocks;
+    AddressType m_slabBlocks = kDefaultSlabBlocks;
+    std::shared_ptr<BlockDevice> m_device;
+
+    std::mutex m_lock;
+    std::int32_t m_nextId = 0;
+    std::map<std::int32_t, Namespace> m_namespaces;
+    std::set<std::int32_t> m_open;
+    // owning namespace of every slab, -1 for a free one
+    std::vector<std::int32_t> m_owners;
+};
+
+inline BlockNamespace::BlockNamespace(std::shared_ptr<BlockPool> p_pool, std::int32_t p_id, const std::string& p_name)
+    : m_pool(p_pool), m_device(p_pool->m_device), m_id(p_id), m_name(p_name) {}
+
+inline BlockNamespace::~BlockNamespace() {
+    m_pool->Close(m_id);
+}
+
+inline bool BlockNamespace::Initialize(int batchSize, AddressType maxBlocks) {
+    if (!m_pool->InitializeThread(batchSize))
+        return false;
+    // until a recovered mapping says otherwise every block of the owned slabs is free
+    std::call_once(m_loaded, [this] {
+        m_maxBlocks = m_device->MaxBlocks();
+        m_blockAllocator.Initialize(0);
+        for (AddressType start : m_pool->SlabsOf(m_id)) m_blockAllocator.AddFree(start, m_pool->SlabBlocks());
+    });
+    return true;
+}
+
+inline bool BlockNamespace::ShutDown() {
+    return m_pool->ShutDownThread();
+}
+
+inline void BlockNamespace::ResetBlocks(const std::vector<std::uint64_t>& p_usedBits) {
+    m_blockAllocator.Initialize(0);
+    for (AddressType start : m_pool->SlabsOf(m_id)) m_blockAllocator.AddFree(start, m_pool->SlabBlocks(), p_usedBits);
+}
+
+inline AddressType BlockNamespace::RemainBlocks() {
+    return m_blockAllocator.FreeBlocks() + m_pool->Claimable(m_id);
+}
+
+inline bool BlockNamespace::Grow(int p_size) {
+    AddressType slab = m_pool->SlabBlocks();
+    std::vector<AddressType> starts = m_pool->Claim(m_id, (std::max)((AddressType)1, ((AddressType)p_size + slab - 1) / slab));
+    for (AddressType start : starts) m_blockAllocator.AddFree(start, slab);
+    return !starts.empty();
+}
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_BLOCKPOOL_H_
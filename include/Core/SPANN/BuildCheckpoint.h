@@ -0,0 +1,126 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_BUILDCHECKPOINT_H_
+#define _SPTAG_SPANN_BUILDCHECKPOINT_H_
+
+#include "Core/Common.h"
+#include <cstdio>
+#include <map>
+#include <string>
+
+namespace SPTAG::SPANN {
+// Progress manifest of a resumable build, one Key=Value line per entry. A phase is marked done
+// once its output is on disk and the replica search records every finished batch, so a restarted
+// build skips completed work. The manifest is replaced through a rename, a crash leaves the old
+// or the new one. A manifest written for another input (its fingerprint differs) is ignored.
+class BuildCheckpoint {
+   public:
+    static constexpr const char* kSelectHead = "SelectHead";
+    static constexpr const char* kBuildHead = "BuildHead";
+    static constexpr const char* kPostings = "Postings";
+    static constexpr const char* kRefine = "Refine";
+
+    // with p_enabled false nothing is read or written and no phase is done
+    ErrorCode Open(const std::string& p_path, const std::string& p_fingerprint, bool p_enabled) {
+        m_path = p_path;
+        m_fingerprint = p_fingerprint;
+        m_enabled = p_enabled;
+        m_values.clear();
+        if (!m_enabled || !fileexists(m_path.c_str()))
+            return ErrorCode::Success;
+
+        FILE* fp = fopen(m_path.c_str(), "r");
+        if (fp == nullptr) {
+            LOG(Helper::LogLevel::LL_Error, "BuildCheckpoint: cannot open %s\n", m_path.c_str());
+            return ErrorCode::FailedOpenFile;
+        }
+        char line[1024];
+        while (fgets(line, sizeof(line), fp) != nullptr) {
+            std::string entry(line);
+            while (!entry.empty() && (entry.back() == '\n' || entry.back() == '\r')) entry.pop_back();
+            size_t sep = entry.find('=');
+            if (sep != std::string::npos)
+                m_values[entry.substr(0, sep)] = entry.substr(sep + 1);
+        }
+        fclose(fp);
+
+        if (m_values["Fingerprint"] != m_fingerprint) {
+            LOG(Helper::LogLevel::LL_Warning, "BuildCheckpoint: %s belongs to another build (%s), starting over\n", m_path.c_str(), m_values["Fingerprint"].c_str());
+            m_values.clear();
+            return ErrorCode::Success;
+        }
+        LOG(Helper::LogLevel::LL_Info, "BuildCheckpoint: resuming from %s, %d replica batches done\n", m_path.c_str(), CompletedBatches());
+        return ErrorCode::Success;
+    }
+
+    inline bool Enabled() const {
+        return m_enabled;
+    }
+
+    inline bool Done(const std::string& p_phase) const {
+        auto iter = m_values.find(p_phase);
+        return iter != m_values.end() && iter->second == "1";
+    }
+
+    // replica search batches finished so far, they are always a prefix
+    inline int CompletedBatches() const {
+        auto iter = m_values.find("ReplicaBatches");
+        return iter == m_values.end() ? 0 : atoi(iter->second.c_str());
+    }
+
+    ErrorCode MarkDone(const std::string& p_phase) {
+        if (!m_enabled)
+            return ErrorCode::Success;
+        m_values[p_phase] = "1";
+        return Save();
+    }
+
+    ErrorCode MarkBatches(int p_batches) {
+        if (!m_enabled)
+            return ErrorCode::Success;
+        m_values["ReplicaBatches"] = std::to_string(p_batches);
+        return Save();
+    }
+
+    // drop the manifest once the build is complete
+    void Remove() {
+        m_values.clear();
+        if (m_enabled)
+            std::remove(m_path.c_str());
+    }
+
+   private:
+    ErrorCode Save() {
+        m_values["Fingerprint"] = m_fingerprint;
+        std::string tmp = m_path + ".tmp";
+        FILE* fp = fopen(tmp.c_str(), "w");
+        if (fp == nullptr) {
+            LOG(Helper::LogLevel::LL_Error, "BuildCheckpoint: cannot create %s\n", tmp.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        bool written = true;
+        for (auto& entry : m_values) written = fprintf(fp, "%s=%s\n", entry.first.c_str(), entry.second.c_str()) > 0 && written;
+        written = (fflush(fp) == 0) && written;
+        written = (fclose(fp) == 0) && written;
+        // rename does not replace an existing file on Windows
+        if (written && std::rename(tmp.c_str(), m_path.c_str()) != 0) {
+            std::remove(m_path.c_str());
+            written = std::rename(tmp.c_str(), m_path.c_str()) == 0;
+        }
+        if (!written) {
+            LOG(Helper::LogLevel::LL_Error, "BuildCheckpoint: cannot write %s\n", m_path.c_str());
+            std::remove(tmp.c_str());
+            return ErrorCode::DiskIOFail;
+        }
+        return ErrorCode::Success;
+    }
+
+    std::string m_path;
+    std::string m_fingerprint;
+    bool m_enabled = false;
+    std::map<std::string, std::string> m_values;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_BUILDCHECKPOINT_H_
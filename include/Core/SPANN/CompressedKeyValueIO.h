@@ -0,0 +1,394 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_COMPRESSEDKEYVALUEIO_H_
+#define _SPTAG_SPANN_COMPRESSEDKEYVALUEIO_H_
+
+#include "Core/SPANN/Compressor.h"
+#include "Core/SPANN/IKeyValueIO.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <unordered_map>
+
+namespace SPTAG::SPANN {
+// Codec for postings of fixed-size entries that start with a non-negative vector ID. The entries
+// are transposed into byte planes, byte j of every entry after each other, so the slowly varying
+// bytes of int8/uint8 vectors and of neighbouring IDs line up for zstd. An encoded posting is a
+// Header, the compressed planes, then raw entries appended later; a posting that does not start
+// with the header's negative marker is raw as a whole, which covers postings the codec chose not
+// to compress and postings that only ever got appends.
+class PostingCodec {
+   public:
+    struct Header {
+        std::int32_t marker;
+        std::uint32_t bodyBytes;        // raw size of the compressed part
+        std::uint32_t compressedBytes;  // stored size of the compressed part
+    };
+
+    static constexpr std::int32_t kMarker = INT32_MIN;
+
+    PostingCodec(int p_entrySize, int p_level) : m_entrySize(p_entrySize), m_compressor(p_level) {}
+
+    inline int EntrySize() const {
+        return m_entrySize;
+    }
+
+    // p_dst gets the stored form of p_size bytes of entries, raw when compression does not pay off
+    void Encode(const char* p_src, size_t p_size, std::string& p_dst) {
+        size_t entries = p_size / m_entrySize;
+        if (entries < 2 || p_size > UINT32_MAX) {
+            p_dst.assign(p_src, p_size);
+            return;
+        }
+        size_t body = entries * m_entrySize;
+        std::string& planes = Scratch();
+        planes.resize(body);
+        for (size_t i = 0; i < entries; i++) {
+            const char* entry = p_src + i * m_entrySize;
+            for (int j = 0; j < m_entrySize; j++) planes[(size_t)j * entries + i] = entry[j];
+        }
+        p_dst.resize(sizeof(Header) + ZSTD_compressBound(body) + (p_size - body));
+        size_t compressed = 0;
+        try {
+            compressed = m_compressor.Compress(planes.data(), body, &p_dst[sizeof(Header)], p_dst.size() - sizeof(Header), false);
+        } catch (const std::runtime_error&) {
+            compressed = body;
+        }
+        if (sizeof(Header) + compressed >= body) {
+            p_dst.assign(p_src, p_size);
+            return;
+        }
+        Header header{kMarker, (std::uint32_t)body, (std::uint32_t)compressed};
+        memcpy(&p_dst[0], &header, sizeof(Header));
+        memcpy(&p_dst[sizeof(Header) + compressed], p_src + body, p_size - body);
+        p_dst.resize(sizeof(Header) + compressed + (p_size - body));
+    }
+
+    // false for a stored posting that cannot be decoded
+    bool Decode(const char* p_src, size_t p_size, std::string& p_dst) {
+        if (!Compressed(p_src, p_size)) {
+            p_dst.assign(p_src, p_size);
+            return true;
+        }
+        Header header;
+        memcpy(&header, p_src, sizeof(Header));
+        if (sizeof(Header) + header.compressedBytes > p_size || header.bodyBytes % m_entrySize != 0) {
+            LOG(Helper::LogLevel::LL_Error, "PostingCodec: header of a %zu byte posting is corrupt\n", p_size);
+            return false;
+        }
+        size_t tail = p_size - sizeof(Header) - header.compressedBytes;
+        std::string& planes = Scratch();
+        planes.resize(header.bodyBytes);
+        try {
+            if (m_compressor.Decompress(p_src + sizeof(Header), header.compressedBytes, &planes[0], planes.size(), false) != header.bodyBytes)
+                return false;
+        } catch (const std::runtime_error&) {
+            return false;
+        }
+        size_t entries = header.bodyBytes / m_entrySize;
+        p_dst.resize(header.bodyBytes + tail);
+        for (size_t i = 0; i < entries; i++) {
+            char* entry = &p_dst[i * m_entrySize];
+            for (int j = 0; j < m_entrySize; j++) entry[j] = planes[(size_t)j * entries + i];
+        }
+        memcpy(&p_dst[header.bodyBytes], p_src + p_size - tail, tail);
+        return true;
+    }
+
+    static inline bool Compressed(const char* p_src, size_t p_size) {
+        std::int32_t marker;
+        if (p_size < sizeof(Header))
+            return false;
+        memcpy(&marker, p_src, sizeof(marker));
+        return marker == kMarker;
+    }
+
+   private:
+    static std::string& Scratch() {
+        static thread_local std::string scratch;
+        return scratch;
+    }
+
+    int m_entrySize;
+    Compressor m_compressor;
+};
+
+// KeyValueIO adapter that stores the postings of p_inner through a PostingCodec. Put and BulkPut
+// compress, Merge appends raw entries behind the compressed part and the next rewrite by split or
+// GC folds them in. Reads decode into thread-local buffers, zero-copy views of raw postings are
+// passed through untouched.
+class CompressedKeyValueIO : public KeyValueIO {
+   public:
+    CompressedKeyValueIO(std::shared_ptr<KeyValueIO> p_inner, int p_entrySize, int p_level) : m_inner(p_inner), m_codec(p_entrySize, p_level) {}
+
+    ErrorCode Get(SizeType key, std::string* value) override {
+        std::string stored;
+        ErrorCode ret = m_inner->Get(key, &stored);
+        if (ret != ErrorCode::Success)
+            return ret;
+        return m_codec.Decode(stored.data(), stored.size(), *value) ? ErrorCode::Success : ErrorCode::Fail;
+    }
+
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        ErrorCode ret = m_inner->MultiGet(keys, values, timeout);
+        std::string decoded;
+        for (auto& value : *values) {
+            if (!PostingCodec::Compressed(value.data(), value.size()))
+                continue;
+            if (!m_codec.Decode(value.data(), value.size(), decoded))
+                return ErrorCode::Fail;
+            value.swap(decoded);
+        }
+        return ret;
+    }
+
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        return MultiGet(keys, values, std::function<void(int)>(), timeout);
+    }
+
+    // the inner views land in a private vector, a compressed one is decoded into a pooled buffer
+    // and handed back to the store as soon as it is copied out
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        std::vector<PostingView> stored;
+        // 0 pending, 1 passed through to the caller, 2 decoded and owed back to the store
+        std::vector<char> state(keys.size(), 0);
+        values->assign(keys.size(), PostingView());
+        bool corrupt = false;
+        auto finish = [&](int i) {
+            if (!PostingCodec::Compressed(stored[i].data, stored[i].size)) {
+                state[i] = 1;
+                (*values)[i] = stored[i];
+                return;
+            }
+            state[i] = 2;
+            std::unique_ptr<std::string> buffer = Pool().Take();
+            if (!m_codec.Decode(stored[i].data, stored[i].size, *buffer)) {
+                corrupt = true;
+                buffer->clear();
+            }
+            (*values)[i].size = (AddressType)buffer->size();
+            (*values)[i].data = Pool().Lend(std::move(buffer));
+            (*values)[i].capacity = -1;
+        };
+        std::function<void(int)> onStored;
+        if (p_onPostingDone) {
+            onStored = [&](int i) {
+                finish(i);
+                p_onPostingDone(i);
+            };
+        }
+        ErrorCode ret = m_inner->MultiGet(keys, &stored, onStored, timeout);
+        stored.resize(keys.size());
+        std::vector<PostingView> decoded;
+        for (int i = 0; i < (int)keys.size(); i++) {
+            if (state[i] == 0 && stored[i].data != nullptr)
+                finish(i);
+            if (state[i] == 2)
+                decoded.push_back(stored[i]);
+        }
+        m_inner->ReleasePostingViews(&decoded);
+        return corrupt ? ErrorCode::Fail : ret;
+    }
+
+    void ReleasePostingViews(std::vector<PostingView>* values) override {
+        for (auto& view : *values) {
+            if (view.data != nullptr && Pool().Release(view.data))
+                view.data = nullptr;
+        }
+        m_inner->ReleasePostingViews(values);
+    }
+
+    ErrorCode Put(SizeType key, const std::string& value) override {
+        std::string stored;
+        Encode(value.data(), value.size(), stored);
+        return m_inner->Put(key, stored);
+    }
+
+    ErrorCode PutNear(SizeType key, const std::string& value, SizeType p_nearKey) override {
+        std::string stored;
+        Encode(value.data(), value.size(), stored);
+        return m_inner->PutNear(key, stored, p_nearKey);
+    }
+
+    ErrorCode Merge(SizeType key, const std::string& value) override {
+        m_rawBytes += value.size();
+        m_storedBytes += value.size();
+        return m_inner->Merge(key, value);
+    }
+
+    // the stored sizes are only known after encoding, so the batch is encoded up front
+    ErrorCode BulkPut(const std::vector<SizeType>& p_keys, const std::vector<size_t>& p_bytes, const std::function<void(size_t, char*)>& p_fill) override {
+        std::vector<std::string> stored(p_keys.size());
+        std::vector<size_t> storedBytes(p_keys.size());
+        std::string raw;
+        for (size_t i = 0; i < p_keys.size(); i++) {
+            raw.resize(p_bytes[i]);
+            if (p_bytes[i] > 0)
+                p_fill(i, &raw[0]);
+            Encode(raw.data(), raw.size(), stored[i]);
+            storedBytes[i] = stored[i].size();
+        }
+        return m_inner->BulkPut(p_keys, storedBytes, [&stored](size_t i, char* ptr) { memcpy(ptr, stored[i].data(), stored[i].size()); });
+    }
+
+    ErrorCode Delete(SizeType key) override {
+        return m_inner->Delete(key);
+    }
+
+    SizeType KeyBound() override {
+        return m_inner->KeyBound();
+    }
+
+    void ForceCompaction() override {
+        m_inner->ForceCompaction();
+    }
+
+    void GetStat() override {
+        size_t raw = m_rawBytes.load(), stored = m_storedBytes.load();
+        LOG(Helper::LogLevel::LL_Info, "Posting compression: %zu bytes written as %zu (ratio %.3f)\n", raw, stored, raw > 0 ? (double)stored / raw : 1.0);
+        m_inner->GetStat();
+    }
+
+    void CollectMetrics(Helper::MetricsWriter& p_writer) override {
+        p_writer.Counter("sptag_posting_raw_bytes_total", "Posting bytes handed to the compressing store", (double)m_rawBytes.load());
+        p_writer.Counter("sptag_posting_stored_bytes_total", "Posting bytes written after compression", (double)m_storedBytes.load());
+        m_inner->CollectMetrics(p_writer);
+    }
+
+    bool Initialize(bool debug = false) override {
+        return m_inner->Initialize(debug);
+    }
+
+    bool ExitBlockController(bool debug = false) override {
+        return m_inner->ExitBlockController(debug);
+    }
+
+    void ShutDown() override {
+        m_inner->ShutDown();
+    }
+
+    void SetGroupCommit(bool p_enable, int p_windowUs, int p_maxBytes) override {
+        m_inner->SetGroupCommit(p_enable, p_windowUs, p_maxBytes);
+    }
+
+    void SetTailCache(size_t p_maxBytes) override {
+        m_inner->SetTailCache(p_maxBytes);
+    }
+
+    void SetPostingCache(size_t p_maxBytes) override {
+        m_inner->SetPostingCache(p_maxBytes);
+    }
+
+    ErrorCode SetMappingJournal(bool p_enable, size_t p_checkpointBytes) override {
+        return m_inner->SetMappingJournal(p_enable, p_checkpointBytes);
+    }
+
+    int Tiers() override {
+        return m_inner->Tiers();
+    }
+
+    int GetTier(SizeType key) override {
+        return m_inner->GetTier(key);
+    }
+
+    // resident postings stay compressed, they are decoded on every read like the others
+    void SetResidentPostings(size_t p_maxBytes) override {
+        m_inner->SetResidentPostings(p_maxBytes);
+    }
+
+    bool MakeResident(SizeType key) override {
+        return m_inner->MakeResident(key);
+    }
+
+    bool IsResident(SizeType key) override {
+        return m_inner->IsResident(key);
+    }
+
+    void DropResident(SizeType key) override {
+        m_inner->DropResident(key);
+    }
+
+    size_t ResidentBytes() override {
+        return m_inner->ResidentBytes();
+    }
+
+    void Prefault() override {
+        m_inner->Prefault();
+    }
+
+    ErrorCode CreateSnapshot() override {
+        return m_inner->CreateSnapshot();
+    }
+
+    ErrorCode ReadSnapshot(SizeType key, std::string* value) override {
+        std::string stored;
+        ErrorCode ret = m_inner->ReadSnapshot(key, &stored);
+        if (ret != ErrorCode::Success)
+            return ret;
+        return m_codec.Decode(stored.data(), stored.size(), *value) ? ErrorCode::Success : ErrorCode::Fail;
+    }
+
+    // the backup keeps the postings compressed, it is opened with SpdkPostingCompression as well
+    ErrorCode WriteSnapshot(const std::string& p_dataPath, const std::string& p_mappingPath, std::atomic<std::uint64_t>* p_bytes) override {
+        return m_inner->WriteSnapshot(p_dataPath, p_mappingPath, p_bytes);
+    }
+
+    void ReleaseSnapshot() override {
+        m_inner->ReleaseSnapshot();
+    }
+
+   private:
+    // decode buffers of the calling thread, lent out until ReleasePostingViews
+    class BufferPool {
+       public:
+        std::unique_ptr<std::string> Take() {
+            if (m_free.empty())
+                return std::unique_ptr<std::string>(new std::string());
+            std::unique_ptr<std::string> buffer = std::move(m_free.back());
+            m_free.pop_back();
+            return buffer;
+        }
+
+        // the buffer's data pointer is its key, distinct per string object also when it is empty
+        const char* Lend(std::unique_ptr<std::string> p_buffer) {
+            const char* data = p_buffer->data();
+            m_lent[data] = std::move(p_buffer);
+            return data;
+        }
+
+        // false for a pointer the pool did not lend
+        bool Release(const char* p_data) {
+            auto iter = m_lent.find(p_data);
+            if (iter == m_lent.end())
+                return false;
+            m_free.push_back(std::move(iter->second));
+            m_lent.erase(iter);
+            return true;
+        }
+
+       private:
+        std::vector<std::unique_ptr<std::string>> m_free;
+        std::unordered_map<const char*, std::unique_ptr<std::string>> m_lent;
+    };
+
+    static BufferPool& Pool() {
+        static thread_local BufferPool pool;
+        return pool;
+    }
+
+    inline void Encode(const char* p_src, size_t p_size, std::string& p_dst) {
+        m_codec.Encode(p_src, p_size, p_dst);
+        m_rawBytes += p_size;
+        m_storedBytes += p_dst.size();
+    }
+
+    std::shared_ptr<KeyValueIO> m_inner;
+    PostingCodec m_codec;
+    std::atomic<size_t> m_rawBytes{0};
+    std::atomic<size_t> m_storedBytes{0};
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_COMPRESSEDKEYVALUEIO_H_
@@ -4,6 +4,7 @@
 #ifndef _SPTAG_SPANN_COMPRESSOR_H_
 #define _SPTAG_SPANN_COMPRESSOR_H_
 
+#include <memory>
 #include <string>
 // #include "zstd.h"
 // #include "zdict.h"
@@ -14,7 +15,28 @@
 namespace SPTAG::SPANN {
 class Compressor {
    private:
+    // one compression and one decompression context per thread, reused by every call; creating
+    // them costs more than compressing a small posting
+    static ZSTD_CCtx* ThreadCCtx() {
+        static thread_local std::unique_ptr<ZSTD_CCtx, size_t (*)(ZSTD_CCtx*)> cctx(ZSTD_createCCtx(), ZSTD_freeCCtx);
+        if (cctx == nullptr) {
+            LOG(Helper::LogLevel::LL_Error, "ZSTD_createCCtx() failed! \n");
+            throw std::runtime_error("ZSTD_createCCtx() failed!");
+        }
+        return cctx.get();
+    }
+
+    static ZSTD_DCtx* ThreadDCtx() {
+        static thread_local std::unique_ptr<ZSTD_DCtx, size_t (*)(ZSTD_DCtx*)> dctx(ZSTD_createDCtx(), ZSTD_freeDCtx);
+        if (dctx == nullptr) {
+            LOG(Helper::LogLevel::LL_Error, "ZSTD_createDCtx() failed! \n");
+            throw std::runtime_error("ZSTD_createDCtx() failed!");
+        }
+        return dctx.get();
+    }
+
     void CreateCDict() {
+        ZSTD_freeCDict(cdict);
         cdict = ZSTD_createCDict((void*)dictBuffer.data(), dictBuffer.size(), compress_level);
         if (cdict == NULL) {
             LOG(Helper::LogLevel::LL_Error, "ZSTD_createCDict() failed! \n");
@@ -23,6 +45,7 @@ class Compressor {
     }
 
     void CreateDDict() {
+        ZSTD_freeDDict(ddict);
         ddict = ZSTD_createDDict((void*)dictBuffer.data(), dictBuffer.size());
         if (ddict == NULL) {
             LOG(Helper::LogLevel::LL_Error, "ZSTD_createDDict() failed! \n");
@@ -30,60 +53,35 @@ class Compressor {
         }
     }
 
-    std::string CompressWithDict(const std::string& src) {
-        size_t est_compress_size = ZSTD_compressBound(src.size());
-        std::string comp_buffer{};
-        comp_buffer.resize(est_compress_size);
-
-        ZSTD_CCtx* const cctx = ZSTD_createCCtx();
-        if (cctx == NULL) {
-            LOG(Helper::LogLevel::LL_Error, "ZSTD_createCCtx() failed! \n");
-            throw std::runtime_error("ZSTD_createCCtx() failed!");
-        }
-        size_t compressed_size = ZSTD_compress_usingCDict(cctx, (void*)comp_buffer.data(), est_compress_size, src.data(), src.size(), cdict);
+    std::size_t CompressWithDict(const char* src, size_t srcSize, char* dst, size_t dstCapacity) {
+        size_t compressed_size = ZSTD_compress_usingCDict(ThreadCCtx(), (void*)dst, dstCapacity, src, srcSize, cdict);
         if (ZSTD_isError(compressed_size)) {
             LOG(Helper::LogLevel::LL_Error, "ZSTD compress error %s, \n", ZSTD_getErrorName(compressed_size));
             throw std::runtime_error("ZSTD compress error");
         }
-        ZSTD_freeCCtx(cctx);
-        comp_buffer.resize(compressed_size);
-        comp_buffer.shrink_to_fit();
-
-        return comp_buffer;
+        return compressed_size;
     }
 
     std::size_t DecompressWithDict(const char* src, size_t srcSize, char* dst, size_t dstCapacity) {
-        ZSTD_DCtx* const dctx = ZSTD_createDCtx();
-        if (dctx == NULL) {
-            LOG(Helper::LogLevel::LL_Error, "ZSTD_createDCtx() failed! \n");
-            throw std::runtime_error("ZSTD_createDCtx() failed!");
-        }
-        std::size_t const decomp_size = ZSTD_decompress_usingDDict(dctx, (void*)dst, dstCapacity, src, srcSize, ddict);
+        std::size_t const decomp_size = ZSTD_decompress_usingDDict(ThreadDCtx(), (void*)dst, dstCapacity, src, srcSize, ddict);
         if (ZSTD_isError(decomp_size)) {
             LOG(Helper::LogLevel::LL_Error, "ZSTD decompress error %s, \n", ZSTD_getErrorName(decomp_size));
             throw std::runtime_error("ZSTD decompress failed.");
         }
-        ZSTD_freeDCtx(dctx);
         return decomp_size;
     }
 
-    std::string CompressWithoutDict(const std::string& src) {
-        size_t est_comp_size = ZSTD_compressBound(src.size());
-        std::string buffer{};
-        buffer.resize(est_comp_size);
-        size_t compressed_size = ZSTD_compress((void*)buffer.data(), est_comp_size, src.data(), src.size(), compress_level);
+    std::size_t CompressWithoutDict(const char* src, size_t srcSize, char* dst, size_t dstCapacity) {
+        size_t compressed_size = ZSTD_compressCCtx(ThreadCCtx(), (void*)dst, dstCapacity, src, srcSize, compress_level);
         if (ZSTD_isError(compressed_size)) {
             LOG(Helper::LogLevel::LL_Error, "ZSTD compress error %s, \n", ZSTD_getErrorName(compressed_size));
             throw std::runtime_error("ZSTD compress error");
         }
-        buffer.resize(compressed_size);
-        buffer.shrink_to_fit();
-
-        return buffer;
+        return compressed_size;
     }
 
     std::size_t DecompressWithoutDict(const char* src, size_t srcSize, char* dst, size_t dstCapacity) {
-        std::size_t const decomp_size = ZSTD_decompress(
+        std::size_t const decomp_size = ZSTD_decompressDCtx(ThreadDCtx(),
             (void*)dst, dstCapacity, src, srcSize);
         if (ZSTD_isError(decomp_size)) {
             LOG(Helper::LogLevel::LL_Error, "ZSTD decompress error %s, \n", ZSTD_getErrorName(decomp_size));
@@ -101,7 +99,13 @@ class Compressor {
         ddict = nullptr;
     }
 
-    virtual ~Compressor() {}
+    Compressor(const Compressor&) = delete;
+    Compressor& operator=(const Compressor&) = delete;
+
+    virtual ~Compressor() {
+        ZSTD_freeCDict(cdict);
+        ZSTD_freeDDict(ddict);
+    }
 
     std::size_t TrainDict(const std::string& samplesBuffer, const size_t* samplesSizes, unsigned nbSamples) {
         dictBuffer.resize(dictBufferCapacity);
@@ -128,7 +132,15 @@ class Compressor {
     }
 
     std::string Compress(const std::string& src, const bool useDict) {
-        return useDict ? CompressWithDict(src) : CompressWithoutDict(src);
+        std::string buffer(ZSTD_compressBound(src.size()), '\0');
+        buffer.resize(Compress(src.data(), src.size(), &buffer[0], buffer.size(), useDict));
+        buffer.shrink_to_fit();
+        return buffer;
+    }
+
+    // compress into a caller buffer of at least ZSTD_compressBound(srcSize) bytes, returns the compressed size
+    std::size_t Compress(const char* src, size_t srcSize, char* dst, size_t dstCapacity, const bool useDict) {
+        return useDict ? CompressWithDict(src, srcSize, dst, dstCapacity) : CompressWithoutDict(src, srcSize, dst, dstCapacity);
     }
 
     std::size_t Decompress(const char* src, size_t srcSize, char* dst, size_t dstCapacity, const bool useDict) {
@@ -0,0 +1,147 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_EPOCHRECLAIMER_H_
+#define _SPTAG_SPANN_EPOCHRECLAIMER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Epoch-based reclamation for memory and blocks that lock-free readers may still be using after a
+// writer unlinked them. A reader announces the global epoch it entered in, counted per parity in
+// the shard of its thread. The epoch only moves from e to e + 1 once no reader of e - 1 is left,
+// so whatever was retired in epoch e is out of every reader's reach when the epoch reaches e + 2.
+// Readers pay two atomic adds on a line shared with few other threads and never wait
+class EpochReclaimer {
+   public:
+    // reader side critical section, the pointers loaded inside stay valid until it ends
+    class Guard {
+       public:
+        explicit Guard(EpochReclaimer& p_reclaimer)
+            : m_reclaimer(p_reclaimer), m_epoch(p_reclaimer.Enter()) {}
+        ~Guard() {
+            m_reclaimer.Exit(m_epoch);
+        }
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+
+       private:
+        EpochReclaimer& m_reclaimer;
+        std::uint64_t m_epoch;
+    };
+
+    EpochReclaimer() {}
+    EpochReclaimer(const EpochReclaimer&) = delete;
+    EpochReclaimer& operator=(const EpochReclaimer&) = delete;
+
+    std::uint64_t Enter() {
+        Shard& shard = m_readers[Home()];
+        while (true) {
+            std::uint64_t epoch = m_epoch.load();
+            shard.m_active[epoch & 1].fetch_add(1);
+            // a reader counted under a parity the epoch already left would hold up the next advance
+            if (m_epoch.load() == epoch)
+                return epoch;
+            shard.m_active[epoch & 1].fetch_sub(1);
+        }
+    }
+
+    void Exit(std::uint64_t p_epoch) {
+        m_readers[Home()].m_active[p_epoch & 1].fetch_sub(1);
+    }
+
+    // p_free runs once no reader that entered before this call is left, on a later Retire's thread.
+    // The caller unlinks what p_free releases before it retires it
+    void Retire(std::function<void()> p_free) {
+        std::vector<std::function<void()>> ripe;
+        {
+            std::lock_guard<std::mutex> lock(m_retiredLock);
+            m_retired.emplace_back(m_epoch.load(), std::move(p_free));
+            TakeRipe(ripe);
+        }
+        for (auto& free : ripe) free();
+    }
+
+    // run what is ripe without retiring anything, e.g. once the writers went quiet
+    void Collect() {
+        std::vector<std::function<void()>> ripe;
+        {
+            std::lock_guard<std::mutex> lock(m_retiredLock);
+            TakeRipe(ripe);
+        }
+        for (auto& free : ripe) free();
+    }
+
+    // run everything retired, for owners that know no reader is left (shutdown)
+    void Drain() {
+        std::deque<std::pair<std::uint64_t, std::function<void()>>> retired;
+        {
+            std::lock_guard<std::mutex> lock(m_retiredLock);
+            retired.swap(m_retired);
+        }
+        for (auto& item : retired) item.second();
+    }
+
+    size_t Pending() {
+        std::lock_guard<std::mutex> lock(m_retiredLock);
+        return m_retired.size();
+    }
+
+    inline std::uint64_t Epoch() const {
+        return m_epoch.load();
+    }
+
+   private:
+    static constexpr size_t kShards = 64;
+
+    struct alignas(64) Shard {
+        std::atomic<std::int64_t> m_active[2] = {{0}, {0}};
+    };
+
+    static inline size_t Home() {
+        static thread_local size_t home = std::hash<std::thread::id>()(std::this_thread::get_id()) % kShards;
+        return home;
+    }
+
+    // e -> e + 1 needs every reader of e - 1, which shares the parity of e + 1, to be gone
+    bool TryAdvance() {
+        std::uint64_t epoch = m_epoch.load();
+        for (Shard& shard : m_readers) {
+            if (shard.m_active[(epoch + 1) & 1].load() != 0)
+                return false;
+        }
+        return m_epoch.compare_exchange_strong(epoch, epoch + 1);
+    }
+
+    // called with m_retiredLock held
+    void TakeRipe(std::vector<std::function<void()>>& p_ripe) {
+        if (m_retired.empty())
+            return;
+        // the oldest item needs two advances, which a quiet reader side allows right away
+        for (int i = 0; i < 2 && m_retired.front().first + 2 > m_epoch.load(); i++) {
+            if (!TryAdvance())
+                break;
+        }
+        std::uint64_t epoch = m_epoch.load();
+        while (!m_retired.empty() && m_retired.front().first + 2 <= epoch) {
+            p_ripe.push_back(std::move(m_retired.front().second));
+            m_retired.pop_front();
+        }
+    }
+
+    std::atomic<std::uint64_t> m_epoch{2};
+    Shard m_readers[kShards];
+
+    std::mutex m_retiredLock;
+    std::deque<std::pair<std::uint64_t, std::function<void()>>> m_retired;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_EPOCHRECLAIMER_H_
@@ -0,0 +1,306 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_EXTENTALLOCATOR_H_
+#define _SPTAG_SPANN_EXTENTALLOCATOR_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Free space of a block device kept as a set of extents [start, start + length).
+// Threads carve blocks out of a private chunk so that consecutive requests of one
+// thread get adjacent addresses and do not contend on the global extent index.
+// Released blocks are merged with their free neighbours again.
+// The address space may be cut into domains, one per device of a striped store: extents never span
+// two domains, and a thread's new chunk comes from the domain with the most free blocks per unit
+// of its current load.
+class ExtentAllocator {
+   public:
+    typedef std::int64_t AddressType;
+
+    static constexpr AddressType kDefaultChunkBlocks = 1024;
+    static constexpr int kShards = 64;
+    // free extents looked at on either side of the hint by AllocateNear
+    static constexpr int kNearScan = 16;
+
+    ExtentAllocator() {}
+
+    // domains start at the sorted addresses of p_starts, the first one at 0. p_load, if set, gives
+    // the load of a domain, chunks go where free blocks / (1 + load) is largest. Initialize has to
+    // follow before any allocation
+    void SetDomains(const std::vector<AddressType>& p_starts, const std::function<AddressType(int)>& p_load = nullptr) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_domainStarts = p_starts.empty() ? std::vector<AddressType>(1, 0) : p_starts;
+        m_domainLoad = p_load;
+    }
+
+    inline int Domains() const {
+        return (int)m_domainStarts.size();
+    }
+
+    // the domain holding p_block
+    inline int DomainOf(AddressType p_block) const {
+        return (int)(std::upper_bound(m_domainStarts.begin() + 1, m_domainStarts.end(), p_block) - m_domainStarts.begin()) - 1;
+    }
+
+    // reset the free space to [0, p_totalBlocks)
+    void Initialize(AddressType p_totalBlocks, AddressType p_chunkBlocks = kDefaultChunkBlocks) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_extents.clear();
+        m_bySize.assign(m_domainStarts.size(), std::set<std::pair<AddressType, AddressType>>());
+        m_domainFree.assign(m_domainStarts.size(), 0);
+        for (auto& shard : m_shards) {
+            shard.start = shard.length = 0;
+        }
+        m_chunkBlocks = std::max<AddressType>(1, p_chunkBlocks);
+        m_freeBlocks = 0;
+        if (p_totalBlocks > 0) InsertLocked(0, p_totalBlocks);
+    }
+
+    // reset the free space to the blocks of [0, p_totalBlocks) whose bit in p_usedBits is clear
+    void Initialize(AddressType p_totalBlocks, const std::vector<std::uint64_t>& p_usedBits, AddressType p_chunkBlocks = kDefaultChunkBlocks) {
+        Initialize(0, p_chunkBlocks);
+        AddFree(0, p_totalBlocks, p_usedBits);
+    }
+
+    // add the blocks of [p_start, p_start + p_length) whose bit in p_usedBits is clear to the free space
+    void AddFree(AddressType p_start, AddressType p_length, const std::vector<std::uint64_t>& p_usedBits) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        AddressType start = -1, end = p_start + p_length;
+        for (AddressType word = p_start >> 6; (word << 6) < end; word++) {
+            std::uint64_t bits = word < (AddressType)p_usedBits.size() ? p_usedBits[word] : 0;
+            // whole words inside a free or a used run need no per-bit work
+            if (((bits == 0 && start >= 0) || (bits == ~0ULL && start < 0)) && (word << 6) >= p_start) continue;
+            for (int i = 0; i < 64; i++) {
+                AddressType block = (word << 6) + i;
+                if (block < p_start) continue;
+                if (block >= end) break;
+                bool used = (bits >> i) & 1;
+                if (!used && start < 0) {
+                    start = block;
+                } else if (used && start >= 0) {
+                    InsertLocked(start, block - start);
+                    start = -1;
+                }
+            }
+        }
+        if (start >= 0) InsertLocked(start, end - start);
+    }
+
+    // add [p_start, p_start + p_length) to the free space
+    void AddFree(AddressType p_start, AddressType p_length) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (p_length > 0) InsertLocked(p_start, p_length);
+    }
+
+    void Clear() {
+        Initialize(0, m_chunkBlocks);
+    }
+
+    // fill p_data with p_size free block addresses, runs of them are adjacent
+    bool Allocate(AddressType* p_data, int p_size) {
+        Shard& shard = m_shards[std::hash<std::thread::id>{}(std::this_thread::get_id()) % kShards];
+        std::lock_guard<std::mutex> shardLock(shard.lock);
+        int filled = 0;
+        while (filled < p_size) {
+            if (shard.length == 0 && !Refill(shard, std::max<AddressType>(m_chunkBlocks, p_size - filled))) {
+                Release(p_data, filled);
+                return false;
+            }
+            int take = (int)std::min<AddressType>(shard.length, p_size - filled);
+            for (int i = 0; i < take; i++) {
+                p_data[filled + i] = shard.start + i;
+            }
+            shard.start += take;
+            shard.length -= take;
+            filled += take;
+            m_freeBlocks -= take;
+        }
+        return true;
+    }
+
+    // p_size adjacent free blocks as close to address p_near as the first fitting run among the
+    // kNearScan free runs on either side allows, taken from the run's end facing p_near. Without
+    // a fitting run nearby the blocks come from the calling thread's chunk as in Allocate
+    bool AllocateNear(AddressType* p_data, int p_size, AddressType p_near) {
+        if (p_near < 0 || p_size <= 0) return Allocate(p_data, p_size);
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            AddressType bestStart = -1, bestDistance = -1;
+            auto after = m_extents.lower_bound(p_near);
+            auto before = after;
+            for (int i = 0; i < kNearScan && after != m_extents.end(); i++, ++after) {
+                if (after->second < p_size) continue;
+                bestStart = after->first;
+                bestDistance = after->first - p_near;
+                break;
+            }
+            for (int i = 0; i < kNearScan && before != m_extents.begin(); i++) {
+                --before;
+                if (before->second < p_size) continue;
+                // a run holding p_near itself is cut at p_near
+                AddressType start = std::min(std::max(before->first, p_near), before->first + before->second - p_size);
+                if (bestStart < 0 || std::max<AddressType>(0, p_near - start - p_size) < bestDistance) bestStart = start;
+                break;
+            }
+            if (bestStart >= 0) {
+                TakeLocked(bestStart, p_size);
+                for (int i = 0; i < p_size; i++) p_data[i] = bestStart + i;
+                m_freeBlocks -= p_size;
+                return true;
+            }
+        }
+        return Allocate(p_data, p_size);
+    }
+
+    // give p_size blocks back, adjacent addresses are coalesced into one extent
+    bool Release(const AddressType* p_data, int p_size) {
+        if (p_size <= 0) return true;
+        std::vector<AddressType> blocks(p_data, p_data + p_size);
+        std::sort(blocks.begin(), blocks.end());
+        std::lock_guard<std::mutex> lock(m_lock);
+        AddressType runStart = blocks[0], runLength = 1;
+        for (int i = 1; i < p_size; i++) {
+            if (blocks[i] == runStart + runLength) {
+                runLength++;
+            } else {
+                InsertLocked(runStart, runLength);
+                runStart = blocks[i];
+                runLength = 1;
+            }
+        }
+        InsertLocked(runStart, runLength);
+        return true;
+    }
+
+    // free blocks, including the ones cached by threads
+    AddressType FreeBlocks() const {
+        return m_freeBlocks.load(std::memory_order_relaxed);
+    }
+
+    std::size_t ExtentCount() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_extents.size();
+    }
+
+   private:
+    struct Shard {
+        std::mutex lock;
+        AddressType start = 0;
+        AddressType length = 0;
+    };
+
+    // the domain a new chunk comes from, -1 when no free extent is left
+    int PickDomainLocked() const {
+        int best = -1;
+        double bestScore = -1;
+        for (int d = 0; d < (int)m_bySize.size(); d++) {
+            if (m_bySize[d].empty()) continue;
+            double score = (double)m_domainFree[d] / (1.0 + (m_domainLoad ? (double)m_domainLoad(d) : 0.0));
+            if (score > bestScore) {
+                best = d;
+                bestScore = score;
+            }
+        }
+        return best;
+    }
+
+    // take a new chunk for the shard: best fit for p_want, otherwise the largest extent left
+    bool Refill(Shard& p_shard, AddressType p_want) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        int domain = PickDomainLocked();
+        if (domain < 0) return false;
+        auto& bySize = m_bySize[domain];
+        auto it = bySize.lower_bound(std::make_pair(p_want, (AddressType)0));
+        if (it == bySize.end()) it = std::prev(bySize.end());
+        AddressType length = it->first, start = it->second;
+        AddressType take = std::min(length, p_want);
+        bySize.erase(it);
+        m_extents.erase(start);
+        m_domainFree[domain] -= take;
+        if (length > take) {
+            m_extents[start + take] = length - take;
+            bySize.emplace(length - take, start + take);
+        }
+        p_shard.start = start;
+        p_shard.length = take;
+        return true;
+    }
+
+    // cut [p_start, p_start + p_length) out of the free extent holding it
+    void TakeLocked(AddressType p_start, AddressType p_length) {
+        auto it = std::prev(m_extents.upper_bound(p_start));
+        AddressType start = it->first, length = it->second;
+        int domain = DomainOf(start);
+        auto& bySize = m_bySize[domain];
+        bySize.erase(std::make_pair(length, start));
+        m_extents.erase(it);
+        m_domainFree[domain] -= p_length;
+        if (p_start > start) {
+            m_extents[start] = p_start - start;
+            bySize.emplace(p_start - start, start);
+        }
+        AddressType tail = start + length - (p_start + p_length);
+        if (tail > 0) {
+            m_extents[p_start + p_length] = tail;
+            bySize.emplace(tail, p_start + p_length);
+        }
+    }
+
+    // a range crossing domain starts goes in as one extent per domain
+    void InsertLocked(AddressType p_start, AddressType p_length) {
+        while (p_length > 0) {
+            int domain = DomainOf(p_start);
+            AddressType end = domain + 1 < (int)m_domainStarts.size() ? std::min(p_start + p_length, m_domainStarts[domain + 1]) : p_start + p_length;
+            InsertDomainLocked(domain, p_start, end - p_start);
+            p_length -= end - p_start;
+            p_start = end;
+        }
+    }
+
+    void InsertDomainLocked(int p_domain, AddressType p_start, AddressType p_length) {
+        m_freeBlocks += p_length;
+        m_domainFree[p_domain] += p_length;
+        auto& bySize = m_bySize[p_domain];
+        auto next = m_extents.lower_bound(p_start);
+        // neighbours are only merged inside the domain
+        if (next != m_extents.begin() && p_start != m_domainStarts[p_domain]) {
+            auto prev = std::prev(next);
+            if (prev->first + prev->second == p_start) {
+                bySize.erase(std::make_pair(prev->second, prev->first));
+                p_start = prev->first;
+                p_length += prev->second;
+                m_extents.erase(prev);
+            }
+        }
+        bool lastDomain = p_domain + 1 == (int)m_domainStarts.size();
+        if (next != m_extents.end() && p_start + p_length == next->first && (lastDomain || next->first != m_domainStarts[p_domain + 1])) {
+            bySize.erase(std::make_pair(next->second, next->first));
+            p_length += next->second;
+            m_extents.erase(next);
+        }
+        m_extents[p_start] = p_length;
+        bySize.emplace(p_length, p_start);
+    }
+
+    std::mutex m_lock;
+    std::map<AddressType, AddressType> m_extents;                       // start -> length
+    std::vector<std::set<std::pair<AddressType, AddressType>>> m_bySize;  // (length, start) per domain
+    std::vector<AddressType> m_domainStarts = std::vector<AddressType>(1, 0);
+    std::vector<AddressType> m_domainFree = std::vector<AddressType>(1, 0);
+    std::function<AddressType(int)> m_domainLoad;
+    Shard m_shards[kShards];
+    AddressType m_chunkBlocks = kDefaultChunkBlocks;
+    std::atomic<AddressType> m_freeBlocks{0};
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_EXTENTALLOCATOR_H_
@@ -13,8 +13,24 @@
 #include "Core/Common/FineGrainedLock.h"
 #include "PersistentBuffer.h"
 #include "Core/Common/PostingSizeRecord.h"
+#include "Core/Common/PostingRadiusRecord.h"
+#include "Core/Common/PQQuantizer.h"
+#include "Core/Common/TwoMeans.h"
+#include "SelectionRuns.h"
+#include "BuildCheckpoint.h"
 #include "ExtraSPDKController.h"
+#include "CompressedKeyValueIO.h"
+#include "VectorStore.h"
+#include "PostingLayout.h"
+#include "PostingHeat.h"
+#include "TieredStorage.h"
+#include "Snapshot.h"
+#include "AutoTuner.h"
+#include "Tracepoints.h"
 #include "Core/BKT/Index.h"
+#include "Helper/WorkStealingThreadPool.h"
+#include "Helper/CoreMap.h"
+#include "Helper/TaskScheduler.h"
 
 using SPDKIO = SPTAG::SPANN::SPDKIO;
 #include <chrono>
@@ -26,6 +42,7 @@ using SPDKIO = SPTAG::SPANN::SPDKIO;
 #include <utility>
 #include <random>
 #include <tbb/concurrent_hash_map.h>
+#include <tbb/task_group.h>
 
 // enable rocksdb io_uring
 // extern "C" bool RocksDbIOUringEnable() { return true; }
@@ -33,7 +50,7 @@ using SPDKIO = SPTAG::SPANN::SPDKIO;
 namespace SPTAG::SPANN {
 template <typename ValueType>
 class ExtraDynamicSearcher {
-    class MergeAsyncJob : public Helper::ThreadPool::Job {
+    class MergeAsyncJob : public Helper::PooledJob<MergeAsyncJob> {
        private:
         SPTAG::BKT::Index<ValueType>* m_index;
         ExtraDynamicSearcher<ValueType>* m_extraIndex;
@@ -48,14 +65,17 @@ class ExtraDynamicSearcher {
         ~MergeAsyncJob() {}
 
         inline void exec(IAbortOperation* p_abort) override {
-            m_extraIndex->MergePostings(m_index, headID, !disableReassign);
+            {
+                WriteGate::Scope gate(&m_extraIndex->m_writeGate);
+                m_extraIndex->MergePostings(m_index, headID, !disableReassign);
+            }
             if (m_callback != nullptr) {
                 m_callback();
             }
         }
     };
 
-    class SplitAsyncJob : public Helper::ThreadPool::Job {
+    class SplitAsyncJob : public Helper::PooledJob<SplitAsyncJob> {
        private:
         SPTAG::BKT::Index<ValueType>* m_index;
         ExtraDynamicSearcher<ValueType>* m_extraIndex;
@@ -70,76 +90,153 @@ class ExtraDynamicSearcher {
         ~SplitAsyncJob() {}
 
         inline void exec(IAbortOperation* p_abort) override {
-            m_extraIndex->Split(m_index, headID, !disableReassign);
+            {
+                WriteGate::Scope gate(&m_extraIndex->m_writeGate);
+                m_extraIndex->Split(m_index, headID, !disableReassign);
+            }
             if (m_callback != nullptr) {
                 m_callback();
             }
         }
     };
 
-    class ReassignAsyncJob : public Helper::ThreadPool::Job {
+    // reassigns a batch of entries taken from the posting of HeadPrev, stored back to back in entries
+    class ReassignAsyncJob : public Helper::PooledJob<ReassignAsyncJob> {
        private:
         SPTAG::BKT::Index<ValueType>* m_index;
         ExtraDynamicSearcher<ValueType>* m_extraIndex;
-        std::shared_ptr<std::string> vectorInfo;
+        std::string entries;
         SizeType HeadPrev;
         std::function<void()> m_callback;
 
        public:
-        ReassignAsyncJob(SPTAG::BKT::Index<ValueType>* headIndex, ExtraDynamicSearcher<ValueType>* extraIndex, std::shared_ptr<std::string> vectorInfo, SizeType HeadPrev, std::function<void()> p_callback)
-            : m_index(headIndex), m_extraIndex(extraIndex), vectorInfo(std::move(vectorInfo)), HeadPrev(HeadPrev), m_callback(std::move(p_callback)) {}
+        ReassignAsyncJob(SPTAG::BKT::Index<ValueType>* headIndex, ExtraDynamicSearcher<ValueType>* extraIndex, std::string entries, SizeType HeadPrev, std::function<void()> p_callback)
+            : m_index(headIndex), m_extraIndex(extraIndex), entries(std::move(entries)), HeadPrev(HeadPrev), m_callback(std::move(p_callback)) {}
 
         ~ReassignAsyncJob() {}
 
         void exec(IAbortOperation* p_abort) override {
-            m_extraIndex->Reassign(m_index, vectorInfo, HeadPrev);
+            {
+                WriteGate::Scope gate(&m_extraIndex->m_writeGate);
+                m_extraIndex->Reassign(m_index, entries, HeadPrev);
+            }
             if (m_callback != nullptr) {
                 m_callback();
             }
         }
     };
 
-    class SPDKThreadPool : public Helper::ThreadPool {
-       public:
-        void initSPDK(int numberOfThreads, ExtraDynamicSearcher<ValueType>* extraIndex) {
-            m_abort.SetAbort(false);
-            for (int i = 0; i < numberOfThreads; i++) {
-                m_threads.emplace_back([this, extraIndex] {
-                    extraIndex->Initialize();
-                    Job* j;
-                    while (get(j)) {
-                        try {
-                            currentJobs++;
-                            j->exec(&m_abort);
-                            currentJobs--;
-                        } catch (std::exception& e) {
-                            LOG(Helper::LogLevel::LL_Error, "ThreadPool: exception in %s %s\n", typeid(*j).name(), e.what());
-                        }
+    // background jobs share one pool, a higher priority runs first on whichever worker is free
+    enum JobPriority { MergePriority = 0, ReassignPriority = 1, SplitPriority = 2, ForegroundSplitPriority = 3 };
 
-                        delete j;
+    class SPDKThreadPool : public Helper::WorkStealingThreadPool {
+       public:
+        // with p_cores the workers are pinned to them in turn
+        void initSPDK(int numberOfThreads, ExtraDynamicSearcher<ValueType>* extraIndex, const std::vector<int>& p_cores = {}) {
+            auto next = std::make_shared<std::atomic<int>>(0);
+            init(
+                numberOfThreads,
+                [extraIndex, p_cores, next] {
+                    if (!p_cores.empty()) {
+                        int slot = (*next)++;
+                        Helper::CoreMap::Pin(p_cores[slot % p_cores.size()], slot);
                     }
-                    extraIndex->ExitBlockController();
-                });
-            }
+                    // splits, reassigns and merges queue behind searches and appends on the device
+                    CurrentIOClass() = IOClass::Background;
+                    extraIndex->Initialize();
+                },
+                [extraIndex] { extraIndex->ExitBlockController(); });
         }
     };
 
    private:
-    std::shared_ptr<SPDKIO> db;
-
-    COMMON::VersionLabel* m_versionMap;
+    // postings SearchVectors reads per MultiGet
+    static constexpr size_t kSearchVectorsPage = 1024;
+
+    std::shared_ptr<KeyValueIO> db;
+    bool m_dbCompressed = false;
+    // the SPDK store under db, whose device the vector store shares
+    SPDKIO* m_postingIO = nullptr;
+    std::string m_dbPath;
+    SizeType m_dbCapacity = 0;
+    int m_dbBatchSize = 64;
+    bool m_dbMmapMapping = false;
+
+    // VectorStore: full vectors once by VID, postings keep only VID and PQ code. Declared after db
+    // so the store flushes and leaves the device before the posting store shuts it down
+    std::shared_ptr<KeyValueIO> m_vectorIO;
+    std::unique_ptr<VectorStore> m_vectorStore;
+
+    COMMON::VersionLabel* m_versionMap = nullptr;
     Options* m_opt;
 
-    std::mutex m_dataAddLock;
-
     std::mutex m_mergeLock;
 
-    COMMON::FineGrainedRWLock m_rwLocks;
+    COMMON::PostingLockTable m_postingLocks;
 
     COMMON::PostingSizeRecord m_postingSizes;
 
-    std::shared_ptr<SPDKThreadPool> m_splitThreadPool;
-    std::shared_ptr<SPDKThreadPool> m_reassignThreadPool;
+    // dead entries each posting is known to hold, seen by search scans or left behind by reassigns
+    COMMON::PostingSizeRecord m_postingGarbage;
+
+    // farthest entry of each posting from its head, the bound range searches prune postings with
+    COMMON::PostingRadiusRecord m_postingRadius;
+
+    // sampled, aging read / append / split counters per posting, see PostingHeat
+    PostingHeat m_heat;
+
+    // background GC: postings whose garbage ratio reached GCRatio, rewritten worst first
+    std::mutex m_gcLock;
+    std::condition_variable m_gcWake;
+    std::unordered_set<SizeType> m_gcCandidates;
+    std::once_flag m_gcStarted;
+    std::thread m_gcThread;
+    std::atomic<bool> m_gcStop{false};
+
+    // tiering: background passes placing postings on the storage tiers by their heat, see TierPostings
+    bool m_tiering = false;
+    std::mutex m_tieringLock;
+    std::condition_variable m_tieringWake;
+    std::once_flag m_tieringStarted;
+    std::thread m_tieringThread;
+    bool m_tieringStop = false;
+    // one pass at a time, and the postings the last one kept resident
+    std::mutex m_tieringPassLock;
+    std::unordered_set<SizeType> m_residentPostings;
+
+    // online backup: updates pass m_writeGate, which a backup closes while it copies the in-memory
+    // structures; the postings are streamed out afterwards by m_backupThread
+    static constexpr const char* kBackupManifest = "backup.ini";
+    static constexpr const char* kBackupData = "postings.bin";
+    static constexpr const char* kBackupMapping = "mapping.bin";
+    static constexpr const char* kBackupSizes = "ssdinfo.bin";
+    WriteGate m_writeGate;
+    std::mutex m_backupLock;
+    std::thread m_backupThread;
+    std::atomic<bool> m_backupRunning{false};
+    std::atomic<std::uint64_t> m_backupBytes{0};
+    ErrorCode m_backupResult = ErrorCode::Success;
+
+    // warm start: the postings listed in WarmPostingFile are read into the posting cache after a
+    // load by m_warmThread, kWarmBatch at a time at background priority
+    static constexpr int kWarmBatch = 256;
+    std::thread m_warmThread;
+    std::atomic<bool> m_warmStop{false};
+    std::atomic<bool> m_warmRunning{false};
+    std::atomic<SizeType> m_warmed{0};
+    SizeType m_warmTotal = 0;
+
+    // PersistentRecords: periodic msync checkpoints of the mapped version labels and posting sizes
+    static constexpr const char* kRecordMapSuffix = ".map";
+    std::mutex m_recordLock;
+    std::condition_variable m_recordWake;
+    std::thread m_recordThread;
+    bool m_recordStop = false;
+
+    std::shared_ptr<SPDKThreadPool> m_jobPool;
+
+    // set from the high watermark until the job queue is down to the low one
+    std::atomic<bool> m_insertThrottled{false};
 
     IndexStats m_stat;
 
@@ -151,17 +248,33 @@ class ExtraDynamicSearcher {
     tbb::concurrent_hash_map<SizeType, SizeType> m_mergeList;
 
    public:
-    ExtraDynamicSearcher(const char* dbPath, int dim, int postingBlockLimit, bool useDirectIO, float searchLatencyHardLimit, int mergeThreshold, int batchSize = 64, int bufferLength = 3, SizeType capacity = 1000000) {
-        db.reset(new SPDKIO(dbPath, 1024 * 1024, capacity, postingBlockLimit + bufferLength, 1024, batchSize, 1, capacity * 2));
+    ExtraDynamicSearcher(const char* dbPath, int dim, int postingBlockLimit, bool useDirectIO, float searchLatencyHardLimit, int mergeThreshold, int batchSize = 64, int bufferLength = 3, SizeType capacity = 1000000, bool mmapMapping = false, std::shared_ptr<BlockDevice> device = nullptr) {
+        auto postingIO = std::make_shared<SPDKIO>(dbPath, 1024 * 1024, capacity, postingBlockLimit + bufferLength, 1024, batchSize, 1, capacity * 2, mmapMapping, device);
+        m_postingIO = postingIO.get();
+        db = postingIO;
+        m_dbPath = dbPath;
+        m_dbCapacity = capacity;
+        m_dbBatchSize = batchSize;
+        m_dbMmapMapping = mmapMapping;
         m_postingSizeLimit = postingBlockLimit * PageSize / (sizeof(ValueType) * dim + sizeof(int) + sizeof(uint8_t));
+        m_postingPages = m_maxPostingPages = postingBlockLimit;
         m_metaDataSize = sizeof(int) + sizeof(uint8_t);
-        m_vectorInfoSize = dim * sizeof(ValueType) + m_metaDataSize;
+        m_vectorDataSize = dim * sizeof(ValueType);
+        m_vectorInfoSize = m_vectorDataSize + m_metaDataSize;
+        m_layoutPath = std::string(dbPath) + "_layout";
         m_hardLatencyLimit = std::chrono::microseconds::max();
         m_mergeThreshold = mergeThreshold;
-        LOG(Helper::LogLevel::LL_Info, "Posting size limit: %d, search limit: %f, merge threshold: %d\n", m_postingSizeLimit, searchLatencyHardLimit, m_mergeThreshold);
+        m_baseSquare = (float)COMMON::Utils::GetBase<ValueType>() * COMMON::Utils::GetBase<ValueType>();
+        LOG(Helper::LogLevel::LL_Info, "Posting size limit: %d, search limit: %f, merge threshold: %d\n", m_postingSizeLimit.load(), searchLatencyHardLimit, m_mergeThreshold.load());
     }
 
-    ~ExtraDynamicSearcher() {}
+    ~ExtraDynamicSearcher() {
+        StopWarmStart();
+        WaitBackup();
+        StopTiering();
+        StopGC();
+        StopRecordCheckpoints();
+    }
 
     // headCandidates: search data structrue for "vid" vector
     // headID: the head vector that stands for vid
@@ -329,10 +442,39 @@ class ExtraDynamicSearcher {
         return true;
     }
 
-    inline void Serialize(char* ptr, SizeType VID, std::uint8_t version, const void* vector) {
+    // bytes of one posting entry
+    inline int GetVectorInfoSize() const {
+        return m_vectorInfoSize;
+    }
+
+    // p_norm > 0 marks a Cosine vector as it was handed in, of that norm, normalized on its way into the entry
+    inline void Serialize(char* ptr, SizeType VID, std::uint8_t version, const void* vector, double p_norm = 0) {
         memcpy(ptr, &VID, sizeof(VID));
         memcpy(ptr + sizeof(VID), &version, sizeof(version));
-        memcpy(ptr + m_metaDataSize, vector, m_vectorInfoSize - m_metaDataSize);
+        const ValueType* source = (const ValueType*)vector;
+        int base = COMMON::Utils::GetBase<ValueType>();
+        std::vector<ValueType> normalized;
+        if (p_norm > 0 && m_quantizer != nullptr) {
+            normalized.resize(m_opt->m_dim);
+            COMMON::Utils::NormalizeTo(source, normalized.data(), m_opt->m_dim, base, p_norm);
+            source = normalized.data();
+        }
+        if (m_quantizer != nullptr)
+            m_quantizer->Encode(source, (std::uint8_t*)ptr + m_metaDataSize);
+        else if (p_norm > 0)
+            COMMON::Utils::NormalizeTo(source, (ValueType*)(ptr + m_metaDataSize), m_opt->m_dim, base, p_norm);
+        else
+            memcpy(ptr + m_metaDataSize, vector, m_vectorDataSize);
+        int header = PostingLayout::HeaderBytes(m_layout.norms);
+        if (m_layout.norms) {
+            float norm = p_norm > 0 ? (float)base : (float)COMMON::Utils::Norm(source, m_opt->m_dim);
+            memcpy(ptr + PostingLayout::kHeaderBytes, &norm, sizeof(norm));
+        }
+        // padding of aligned layouts, the buffers handed in are not always zeroed
+        if (m_metaDataSize > header)
+            memset(ptr + header, 0, m_metaDataSize - header);
+        if (m_vectorInfoSize > m_metaDataSize + m_vectorDataSize)
+            memset(ptr + m_metaDataSize + m_vectorDataSize, 0, m_vectorInfoSize - m_metaDataSize - m_vectorDataSize);
     }
 
     void CalculatePostingDistribution(SPTAG::BKT::Index<ValueType>* p_index) {
@@ -375,6 +517,76 @@ class ExtraDynamicSearcher {
             } else
                 LOG(Helper::LogLevel::LL_Info, "%d ~ %d KB: %d, \n", (i - 2) * 4, (i - 1) * 4, sizeDistribution[i]);
         }
+        if (!m_heat.Enabled())
+            return;
+        const char* kinds[] = {"Read", "Append", "Split"};
+        for (int k = 0; k < PostingHeat::kKinds; k++) {
+            LOG(Helper::LogLevel::LL_Info, "Posting Heat (%s, top 10):\n", kinds[k]);
+            for (auto& hot : HotPostings((HeatKind)k, 10))
+                LOG(Helper::LogLevel::LL_Info, "%d: ~%.0f, length %d\n", hot.first, PostingHeat::Estimate(hot.second, m_heat.SampleRate()), m_postingSizes.GetSize(hot.first));
+        }
+        if (!m_opt->m_postingHeatFile.empty())
+            DumpPostingHeat(m_opt->m_postingHeatFile, p_index);
+    }
+
+    // the p_top postings with the most sampled events of p_kind lately, hottest first
+    std::vector<PostingHeat::Entry> HotPostings(HeatKind p_kind, int p_top) {
+        return m_heat.Hottest(p_kind, p_top, m_postingSizes.GetPostingNum());
+    }
+
+    // one line per live posting with its length, heat counters and the event counts they stand
+    // for, to study workload skew offline
+    ErrorCode DumpPostingHeat(const std::string& p_path, SPTAG::BKT::Index<ValueType>* p_index) {
+        if (!m_heat.Enabled())
+            return ErrorCode::Fail;
+        FILE* out = fopen(p_path.c_str(), "w");
+        if (out == nullptr) {
+            LOG(Helper::LogLevel::LL_Error, "Cannot write posting heat to %s\n", p_path.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        fprintf(out, "posting\tlength\tread\tappend\tsplit\tread_est\tappend_est\tsplit_est\n");
+        SizeType postingNum = m_postingSizes.GetPostingNum();
+        for (SizeType i = 0; i < postingNum; i++) {
+            if (!p_index->ContainSample(i))
+                continue;
+            std::uint8_t read = m_heat.Get(i, HeatKind::Read), append = m_heat.Get(i, HeatKind::Append), split = m_heat.Get(i, HeatKind::Split);
+            fprintf(out, "%d\t%d\t%u\t%u\t%u\t%.0f\t%.0f\t%.0f\n", i, m_postingSizes.GetSize(i), read, append, split,
+                    PostingHeat::Estimate(read, m_heat.SampleRate()), PostingHeat::Estimate(append, m_heat.SampleRate()), PostingHeat::Estimate(split, m_heat.SampleRate()));
+        }
+        bool written = ferror(out) == 0;
+        fclose(out);
+        if (!written)
+            return ErrorCode::DiskIOFail;
+        LOG(Helper::LogLevel::LL_Info, "Posting heat of %d postings written to %s\n", postingNum, p_path.c_str());
+        return ErrorCode::Success;
+    }
+
+    // the ids of the WarmPostingNum most read live postings, hottest first, for the WarmStart of
+    // the next load. Without read heat there is nothing to list
+    ErrorCode SaveWarmPostings(const std::string& p_path, SPTAG::BKT::Index<ValueType>* p_index) {
+        if (!m_heat.Enabled()) {
+            LOG(Helper::LogLevel::LL_Warning, "SPFresh: posting heat is off (HeatSampleRate 0), no warm postings written to %s\n", p_path.c_str());
+            return ErrorCode::Success;
+        }
+        std::vector<SizeType> ids;
+        for (auto& hot : HotPostings(HeatKind::Read, m_opt->m_warmPostingNum))
+            if (p_index->ContainSample(hot.first))
+                ids.push_back(hot.first);
+        std::string tmpPath = p_path + "_tmp";
+        {
+            auto out = SPTAG::f_createIO();
+            if (out == nullptr || !out->Initialize(tmpPath.c_str(), std::ios::binary | std::ios::out))
+                return ErrorCode::FailedCreateFile;
+            SizeType count = (SizeType)ids.size();
+            IOBINARY(out, WriteBinary, sizeof(count), (char*)&count);
+            IOBINARY(out, WriteBinary, sizeof(SizeType) * ids.size(), (char*)ids.data());
+        }
+        if (std::rename(tmpPath.c_str(), p_path.c_str()) != 0) {
+            LOG(Helper::LogLevel::LL_Error, "Fail to rename %s to %s\n", tmpPath.c_str(), p_path.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        LOG(Helper::LogLevel::LL_Info, "SPFresh: %d warm postings written to %s\n", (int)ids.size(), p_path.c_str());
+        return ErrorCode::Success;
     }
 
     // TODO
@@ -439,48 +651,123 @@ class ExtraDynamicSearcher {
         }
     }
 
+    // read a posting without blocking its writers, retried until no write overlapped the read
+    bool ReadPosting(SizeType p_headID, std::string* p_posting) {
+        COMMON::SeqLock& seqLock = m_postingLocks[p_headID];
+        while (true) {
+            std::uint32_t seq = seqLock.WaitReadBegin();
+            if (db->Get(p_headID, p_posting) != ErrorCode::Success)
+                return false;
+            if (seqLock.ReadValidate(seq))
+                return true;
+        }
+    }
+
+    // Search reads postings without locks. A posting whose sequence moved while it was read is
+    // read once more and scanned again, the deduper drops the vectors already seen. A posting
+    // whose writer is still busy keeps the version read first, searches never wait for writers.
+    template <typename ScanFunc>
+    void RereadChanged(const std::vector<int>& p_postingIDs, const std::vector<std::uint32_t>& p_sequences, std::vector<PostingView>& p_postingLists, ScanFunc& p_scanPosting) {
+        std::string posting;
+        for (size_t pi = 0; pi < p_postingLists.size(); pi++) {
+            COMMON::SeqLock& seqLock = m_postingLocks[p_postingIDs[pi]];
+            if (seqLock.ReadValidate(p_sequences[pi]))
+                continue;
+            std::uint32_t seq = seqLock.ReadBegin();
+            if ((seq & 1) != 0 || db->Get(p_postingIDs[pi], &posting) != ErrorCode::Success || !seqLock.ReadValidate(seq))
+                continue;
+            m_stat.m_searchRereadNum++;
+            PostingView first = p_postingLists[pi];
+            p_postingLists[pi] = PostingView{posting.data(), (AddressType)posting.size(), 0};
+            p_scanPosting((int)pi);
+            p_postingLists[pi] = first;
+        }
+    }
+
+    // positions of the entries of p_posting whose version is still current
+    void LiveEntries(const std::string& p_posting, std::vector<int>& p_live) {
+        SizeType num = (SizeType)(p_posting.size() / m_vectorInfoSize);
+        p_live.clear();
+        const uint8_t* vectorId = reinterpret_cast<const uint8_t*>(p_posting.data());
+        for (int j = 0; j < num; j++, vectorId += m_vectorInfoSize) {
+            uint8_t version = *(vectorId + sizeof(int));
+            int VID = *((int*)(vectorId));
+            if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version)
+                continue;
+            p_live.push_back(j);
+        }
+    }
+
+    bool EntryLive(const std::string& p_posting, int p_position) {
+        const char* entry = p_posting.data() + (size_t)p_position * m_vectorInfoSize;
+        int VID = *((int*)entry);
+        return !m_versionMap->Deleted(VID) && m_versionMap->GetVersion(VID) == *(uint8_t*)(entry + sizeof(int));
+    }
+
+    // per worker buffers of Split, reused from split to split
+    struct SplitWorkSpace {
+        COMMON::TwoMeans<ValueType> m_clusterer;
+        std::vector<const void*> m_vectors;
+        std::string m_decoded;
+        std::vector<int> m_labels;  // cluster of each posting entry, -1 for dead ones
+        int m_representatives[2];   // posting positions of the centers, -1 for virtual centers
+    };
+
+    // 2-means over the entries of p_posting at the positions p_live
+    int ClusterEntries(std::string& p_posting, const std::vector<int>& p_live, SplitWorkSpace& p_space) {
+        int entrySize;
+        const uint8_t* entries = FullPosting(p_posting, p_space.m_decoded, entrySize);
+        p_space.m_vectors.resize(p_live.size());
+        for (size_t i = 0; i < p_live.size(); i++) p_space.m_vectors[i] = entries + (size_t)p_live[i] * entrySize + m_metaDataSize;
+        int numClusters = p_space.m_clusterer.Cluster(p_space.m_vectors.data(), (SizeType)p_live.size(), m_opt->m_splitIterations, m_opt->m_virtualHead);
+        p_space.m_labels.assign(p_posting.size() / m_vectorInfoSize, -1);
+        for (size_t i = 0; i < p_live.size(); i++) p_space.m_labels[p_live[i]] = p_space.m_clusterer.Label((SizeType)i);
+        for (int k = 0; k < 2; k++) {
+            SizeType representative = p_space.m_clusterer.Representative(k);
+            p_space.m_representatives[k] = representative < 0 ? -1 : p_live[representative];
+        }
+        return numClusters;
+    }
+
     ErrorCode Split(SPTAG::BKT::Index<ValueType>* p_index, const SizeType headID, bool reassign = false, bool preReassign = false) {
-        auto splitBegin = std::chrono::high_resolution_clock::now();
+        std::uint64_t splitBegin = StageNow();
+        SplitProbe probe(headID, m_postingSizes.GetSize(headID));
+        m_heat.Touch(headID, HeatKind::Split);
         // LOG(Helper::LogLevel::LL_Info, "into split: %d\n", headID);
         std::vector<SizeType> newHeadsID;
         std::vector<std::string> newPostingLists;
-        double elapsedMSeconds;
+        static thread_local SplitWorkSpace space;
+        space.m_clusterer.Initialize(m_opt->m_dim, p_index->GetDistCalcMethod());
+        std::vector<int> localIndices;
+
+        // 2-means runs on a snapshot read under the shared lock, so appends and searches on the
+        // posting are not blocked meanwhile. Appends only add entries at the end: if the posting
+        // still starts with the snapshot under the exclusive lock, the clustering stands and the
+        // new entries join the nearer center, otherwise it is redone under the lock.
+        std::string snapshot;
+        bool snapshotClustered = false;
+        if (!m_opt->m_inPlace) {
+            if (!ReadPosting(headID, &snapshot))
+                snapshot.clear();
+            LiveEntries(snapshot, localIndices);
+            if (preReassign || (int)localIndices.size() >= m_postingSizeLimit) {
+                StageTimer timer(m_stat.m_stages, Stage::SplitClustering);
+                snapshotClustered = ClusterEntries(snapshot, localIndices, space) > 1;
+            }
+        }
         {
-            std::unique_lock<std::shared_timed_mutex> lock(m_rwLocks[headID]);
+            std::unique_lock<COMMON::SeqLock> lock(m_postingLocks[headID]);
 
             std::string postingList;
-            auto splitGetBegin = std::chrono::high_resolution_clock::now();
+            std::uint64_t splitGetBegin = StageNow();
             if (db->Get(headID, &postingList) != ErrorCode::Success) {
                 LOG(Helper::LogLevel::LL_Info, "Split fail to get oversized postings\n");
                 exit(0);
             }
-            auto splitGetEnd = std::chrono::high_resolution_clock::now();
-            elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(splitGetEnd - splitGetBegin).count();
-            m_stat.m_getCost += elapsedMSeconds;
-            // reinterpret postingList to vectors and IDs
-            auto* postingP = reinterpret_cast<uint8_t*>(&postingList.front());
+            m_stat.m_stages.RecordSince(Stage::SplitRead, splitGetBegin);
             SizeType postVectorNum = (SizeType)(postingList.size() / m_vectorInfoSize);
-
-            COMMON::Dataset<ValueType> smallSample(postVectorNum, m_opt->m_dim, p_index->m_iDataBlockSize, p_index->m_iDataCapacity, (const void*)postingP, true, nullptr, m_metaDataSize, m_vectorInfoSize);
-            // COMMON::Dataset<ValueType> smallSample(0, m_opt->m_dim, p_index->m_iDataBlockSize, p_index->m_iDataCapacity);  // smallSample[i] -> VID
-            // std::vector<int> localIndicesInsert(postVectorNum);  // smallSample[i] = j <-> localindices[j] = i
-            // std::vector<uint8_t> localIndicesInsertVersion(postVectorNum);
-            std::vector<int> localIndices(postVectorNum);
-            int index = 0;
-            uint8_t* vectorId = postingP;
-            for (int j = 0; j < postVectorNum; j++, vectorId += m_vectorInfoSize) {
-                // LOG(Helper::LogLevel::LL_Info, "vector index/total:id: %d/%d:%d\n", j, m_postingSizes[headID].load(), *(reinterpret_cast<int*>(vectorId)));
-                uint8_t version = *(vectorId + sizeof(int));
-                int VID = *((int*)(vectorId));
-                if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version)
-                    continue;
-
-                // localIndicesInsert[index] = VID;
-                // localIndicesInsertVersion[index] = version;
-                // smallSample.AddBatch(1, (ValueType*)(vectorId + m_metaDataSize));
-                localIndices[index] = j;
-                index++;
-            }
+            LiveEntries(postingList, localIndices);
+            int index = (int)localIndices.size();
             // double gcEndTime = sw.getElapsedMs();
             // m_splitGcCost += gcEndTime;
             if (m_opt->m_inPlace || (!preReassign && index < m_postingSizeLimit)) {
@@ -493,37 +780,42 @@ class ExtraDynamicSearcher {
                 }
                 postingList.resize(index * m_vectorInfoSize);
                 m_postingSizes.UpdateSize(headID, index);
+                m_postingGarbage.UpdateSize(headID, 0);
                 if (db->Put(headID, postingList) != ErrorCode::Success) {
                     LOG(Helper::LogLevel::LL_Info, "Split Fail to write back postings\n");
                     exit(0);
                 }
                 m_stat.m_garbageNum++;
-                auto GCEnd = std::chrono::high_resolution_clock::now();
-                elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(GCEnd - splitBegin).count();
-                m_stat.m_garbageCost += elapsedMSeconds;
+                m_stat.m_stages.RecordSince(Stage::GC, splitBegin);
                 {
                     std::lock_guard<std::mutex> tmplock(m_runningLock);
                     // LOG(Helper::LogLevel::LL_Info,"erase: %d\n", headID);
                     m_splitList.erase(headID);
                 }
                 // LOG(Helper::LogLevel::LL_Info, "GC triggered: %d, new length: %d\n", headID, index);
+                probe.outcome = 0;
                 return ErrorCode::Success;
             }
-            // LOG(Helper::LogLevel::LL_Info, "Resize\n");
-            localIndices.resize(index);
-
-            auto clusterBegin = std::chrono::high_resolution_clock::now();
-            // k = 2, maybe we can change the split number, now it is fixed
-            SPTAG::COMMON::KmeansArgs<ValueType> args(2, smallSample.C(), (SizeType)localIndices.size(), 1, p_index->GetDistCalcMethod());
-            std::shuffle(localIndices.begin(), localIndices.end(), std::mt19937(std::random_device()()));
 
-            int numClusters = SPTAG::COMMON::KmeansClustering(smallSample, localIndices, 0, (SizeType)localIndices.size(), args, 1000, 100.0F, false, nullptr, m_opt->m_virtualHead);
-
-            auto clusterEnd = std::chrono::high_resolution_clock::now();
-            elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(clusterEnd - clusterBegin).count();
-            m_stat.m_clusteringCost += elapsedMSeconds;
-            // int numClusters = ClusteringSPFresh(smallSample, localIndices, 0, localIndices.size(), args, 10, false, m_opt->m_virtualHead);
-            // exit(0);
+            bool snapshotValid = snapshotClustered && postingList.size() >= snapshot.size() && memcmp(postingList.data(), snapshot.data(), snapshot.size()) == 0;
+            for (int k = 0; k < 2 && snapshotValid; k++) {
+                if (space.m_representatives[k] >= 0 && !EntryLive(postingList, space.m_representatives[k]))
+                    snapshotValid = false;
+            }
+            int numClusters = 2;
+            if (snapshotValid) {
+                SizeType snapshotNum = (SizeType)(snapshot.size() / m_vectorInfoSize);
+                std::vector<ValueType> scratch;
+                space.m_labels.resize(postVectorNum, -1);
+                for (int j : localIndices) {
+                    if (j >= snapshotNum)
+                        space.m_labels[j] = space.m_clusterer.Assign(EntryVector((const uint8_t*)postingList.data() + (size_t)j * m_vectorInfoSize, scratch));
+                }
+            } else {
+                m_stat.m_splitReclusterNum++;
+                StageTimer timer(m_stat.m_stages, Stage::SplitClustering);
+                numClusters = ClusterEntries(postingList, localIndices, space);
+            }
             if (numClusters <= 1) {
                 LOG(Helper::LogLevel::LL_Info, "Cluserting Failed (The same vector), Only Keep one\n");
                 std::string newpostingList(1 * m_vectorInfoSize, '\0');
@@ -533,6 +825,7 @@ class ExtraDynamicSearcher {
                     // Serialize(ptr, localIndicesInsert[j], localIndicesInsertVersion[j], smallSample[j]);
                 }
                 m_postingSizes.UpdateSize(headID, 1);
+                m_postingGarbage.UpdateSize(headID, 0);
                 if (db->Put(headID, newpostingList) != ErrorCode::Success) {
                     LOG(Helper::LogLevel::LL_Info, "Split fail to override postings cut to limit\n");
                     exit(0);
@@ -541,68 +834,83 @@ class ExtraDynamicSearcher {
                     std::lock_guard<std::mutex> tmplock(m_runningLock);
                     m_splitList.erase(headID);
                 }
+                probe.outcome = 1;
                 return ErrorCode::Success;
             }
 
+            // live entries grouped by cluster
+            SizeType counts[2] = {0, 0};
+            std::vector<int> clustered;
+            clustered.reserve(localIndices.size());
+            for (int k = 0; k < 2; k++) {
+                for (int j : localIndices) {
+                    if (space.m_labels[j] == k)
+                        clustered.push_back(j);
+                }
+                counts[k] = (SizeType)clustered.size() - (k > 0 ? counts[0] : 0);
+            }
+
             long long newHeadVID = -1;
             int first = 0;
             bool theSameHead = false;
+            // both halves are relocated next to the split posting's blocks
+            SizeType placeNear = m_opt->m_coAccessPlacement ? headID : -1;
             newPostingLists.resize(2);
             for (int k = 0; k < 2; k++) {
-                if (args.counts[k] == 0)
+                if (counts[k] == 0)
                     continue;
 
-                newPostingLists[k].resize(args.counts[k] * m_vectorInfoSize);
+                newPostingLists[k].resize(counts[k] * m_vectorInfoSize);
                 char* ptr = (char*)(newPostingLists[k].c_str());
-                for (int j = 0; j < args.counts[k]; j++, ptr += m_vectorInfoSize) {
-                    memcpy(ptr, postingList.c_str() + localIndices[first + j] * m_vectorInfoSize, m_vectorInfoSize);
+                for (int j = 0; j < counts[k]; j++, ptr += m_vectorInfoSize) {
+                    memcpy(ptr, postingList.c_str() + clustered[first + j] * m_vectorInfoSize, m_vectorInfoSize);
                     // Serialize(ptr, localIndicesInsert[localIndices[first + j]], localIndicesInsertVersion[localIndices[first + j]], smallSample[localIndices[first + j]]);
                 }
-                if (!theSameHead && p_index->ComputeDistance(args.centers + k * args._D, p_index->GetSample(headID)) < Epsilon) {
+                const ValueType* center = space.m_clusterer.Center(k);
+                if (!theSameHead && p_index->ComputeDistance(center, p_index->GetSample(headID)) < Epsilon) {
                     newHeadsID.push_back(headID);
                     newHeadVID = headID;
                     theSameHead = true;
-                    auto splitPutBegin = std::chrono::high_resolution_clock::now();
-                    if (!preReassign && db->Put(newHeadVID, newPostingLists[k]) != ErrorCode::Success) {
+                    std::uint64_t splitPutBegin = StageNow();
+                    if (!preReassign && db->PutNear(newHeadVID, newPostingLists[k], placeNear) != ErrorCode::Success) {
                         LOG(Helper::LogLevel::LL_Info, "Fail to override postings\n");
                         exit(0);
                     }
-                    auto splitPutEnd = std::chrono::high_resolution_clock::now();
-                    elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(splitPutEnd - splitPutBegin).count();
-                    m_stat.m_putCost += elapsedMSeconds;
+                    m_stat.m_stages.RecordSince(Stage::SplitWrite, splitPutBegin);
                     m_stat.m_theSameHeadNum++;
                 } else {
                     int begin, end = 0;
-                    p_index->AddIndexId(args.centers + k * args._D, 1, m_opt->m_dim, begin, end);
+                    p_index->AddIndexId(center, 1, m_opt->m_dim, begin, end);
                     newHeadVID = begin;
                     newHeadsID.push_back(begin);
-                    auto splitPutBegin = std::chrono::high_resolution_clock::now();
-                    if (!preReassign && db->Put(newHeadVID, newPostingLists[k]) != ErrorCode::Success) {
+                    std::uint64_t splitPutBegin = StageNow();
+                    if (!preReassign && db->PutNear(newHeadVID, newPostingLists[k], placeNear) != ErrorCode::Success) {
                         LOG(Helper::LogLevel::LL_Info, "Fail to add new postings\n");
                         exit(0);
                     }
-                    auto splitPutEnd = std::chrono::high_resolution_clock::now();
-                    elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(splitPutEnd - splitPutBegin).count();
-                    m_stat.m_putCost += elapsedMSeconds;
-                    auto updateHeadBegin = std::chrono::high_resolution_clock::now();
-                    p_index->AddIndexIdx(begin, end);
-                    auto updateHeadEnd = std::chrono::high_resolution_clock::now();
-                    elapsedMSeconds = std::chrono::duration_cast<std::chrono::milliseconds>(updateHeadEnd - updateHeadBegin).count();
-                    m_stat.m_updateHeadCost += elapsedMSeconds;
-
-                    std::lock_guard<std::mutex> tmplock(m_dataAddLock);
-                    if (m_postingSizes.AddBatch(1) == ErrorCode::MemoryOverFlow) {
+                    m_stat.m_stages.RecordSince(Stage::SplitWrite, splitPutBegin);
+                    std::uint64_t updateHeadBegin = StageNow();
+                    if (m_opt->m_deferHeadInsert)
+                        p_index->StageIndexIdx(begin, end);
+                    else
+                        p_index->AddIndexIdx(begin, end);
+                    m_stat.m_stages.RecordSince(Stage::UpdateHead, updateHeadBegin);
+
+                    if (m_postingSizes.AddBatch(1) == ErrorCode::MemoryOverFlow || m_postingGarbage.AddBatch(1) == ErrorCode::MemoryOverFlow || m_postingRadius.AddBatch(1) == ErrorCode::MemoryOverFlow) {
                         LOG(Helper::LogLevel::LL_Info, "MemoryOverFlow: NnewHeadVID: %d, Map Size:%d\n", newHeadVID, m_postingSizes.BufferSize());
                         exit(1);
                     }
                 }
-                // LOG(Helper::LogLevel::LL_Info, "Head id: %d split into : %d, length: %d\n", headID, newHeadVID, args.counts[k]);
-                first += args.counts[k];
-                m_postingSizes.UpdateSize(newHeadVID, args.counts[k]);
+                // LOG(Helper::LogLevel::LL_Info, "Head id: %d split into : %d, length: %d\n", headID, newHeadVID, counts[k]);
+                first += counts[k];
+                m_postingSizes.UpdateSize(newHeadVID, counts[k]);
+                m_postingGarbage.UpdateSize(newHeadVID, 0);
+                m_postingRadius.Set(newHeadVID, PostingRadius(p_index, newHeadVID, newPostingLists[k]));
             }
             if (!theSameHead) {
                 p_index->DeleteIndex(headID);
                 m_postingSizes.UpdateSize(headID, 0);
+                m_postingGarbage.UpdateSize(headID, 0);
             }
         }
         {
@@ -611,33 +919,29 @@ class ExtraDynamicSearcher {
             m_splitList.erase(headID);
         }
         m_stat.m_splitNum++;
+        probe.newHeads = (std::int64_t)newHeadsID.size();
         if (reassign) {
-            auto reassignScanBegin = std::chrono::high_resolution_clock::now();
-
+            StageTimer timer(m_stat.m_stages, Stage::ReassignScan);
             CollectReAssign(p_index, headID, newPostingLists, newHeadsID);
-
-            auto reassignScanEnd = std::chrono::high_resolution_clock::now();
-            elapsedMSeconds = std::chrono::duration_cast<std::chrono::milliseconds>(reassignScanEnd - reassignScanBegin).count();
-
-            m_stat.m_reassignScanCost += elapsedMSeconds;
         }
-        auto splitEnd = std::chrono::high_resolution_clock::now();
-        elapsedMSeconds = std::chrono::duration_cast<std::chrono::milliseconds>(splitEnd - splitBegin).count();
-        m_stat.m_splitCost += elapsedMSeconds;
+        m_stat.m_stages.RecordSince(Stage::Split, splitBegin);
         return ErrorCode::Success;
     }
 
     ErrorCode MergePostings(SPTAG::BKT::Index<ValueType>* p_index, SizeType headID, bool reassign = false) {
+        MergeProbe probe(headID);
         {
             if (!m_mergeLock.try_lock()) {
                 auto* curJob = new MergeAsyncJob(p_index, this, headID, reassign, nullptr);
-                m_splitThreadPool->add(curJob);
+                m_jobPool->add(curJob, MergePriority);
+                probe.outcome = 0;
                 return ErrorCode::Success;
             }
-            std::unique_lock<std::shared_timed_mutex> lock(m_rwLocks[headID]);
+            std::unique_lock<COMMON::SeqLock> lock(m_postingLocks[headID]);
 
             if (!p_index->ContainSample(headID)) {
                 m_mergeLock.unlock();
+                probe.outcome = 1;
                 return ErrorCode::Success;
             }
 
@@ -664,15 +968,18 @@ class ExtraDynamicSearcher {
                 currentLength++;
             }
             int totalLength = currentLength;
+            probe.length = currentLength;
 
             if (currentLength > m_mergeThreshold) {
                 m_postingSizes.UpdateSize(headID, currentLength);
+                m_postingGarbage.UpdateSize(headID, 0);
                 if (db->Put(headID, mergedPostingList) != ErrorCode::Success) {
                     LOG(Helper::LogLevel::LL_Info, "Merge Fail to write back postings\n");
                     exit(0);
                 }
                 m_mergeList.erase(headID);
                 m_mergeLock.unlock();
+                probe.outcome = 2;
                 return ErrorCode::Success;
             }
 
@@ -687,9 +994,9 @@ class ExtraDynamicSearcher {
                 tbb::concurrent_hash_map<SizeType, SizeType>::const_accessor headIDAccessor;
                 if (currentLength + nextLength < m_postingSizeLimit && !m_mergeList.find(headIDAccessor, queryResult->VID)) {
                     {
-                        std::unique_lock<std::shared_timed_mutex> anotherLock(m_rwLocks[queryResult->VID], std::defer_lock);
+                        std::unique_lock<COMMON::SeqLock> anotherLock(m_postingLocks[queryResult->VID], std::defer_lock);
                         // LOG(Helper::LogLevel::LL_Info,"Locked: %d, to be lock: %d\n", headID, queryResult->VID);
-                        if (m_rwLocks.hash_func(queryResult->VID) != m_rwLocks.hash_func(headID))
+                        if (queryResult->VID != headID)
                             anotherLock.lock();
                         if (!p_index->ContainSample(queryResult->VID))
                             continue;
@@ -715,22 +1022,28 @@ class ExtraDynamicSearcher {
                         }
                         if (currentLength > nextLength) {
                             p_index->DeleteIndex(queryResult->VID);
+                            m_postingRadius.Set(headID, PostingRadius(p_index, headID, mergedPostingList));
                             if (db->Put(headID, mergedPostingList) != ErrorCode::Success) {
                                 LOG(Helper::LogLevel::LL_Info, "Split fail to override postings after merge\n");
                                 exit(0);
                             }
                             m_postingSizes.UpdateSize(queryResult->VID, 0);
+                            m_postingGarbage.UpdateSize(queryResult->VID, 0);
                             m_postingSizes.UpdateSize(headID, totalLength);
+                            m_postingGarbage.UpdateSize(headID, 0);
                         } else {
                             p_index->DeleteIndex(headID);
+                            m_postingRadius.Set(queryResult->VID, PostingRadius(p_index, queryResult->VID, mergedPostingList));
                             if (db->Put(queryResult->VID, mergedPostingList) != ErrorCode::Success) {
                                 LOG(Helper::LogLevel::LL_Info, "Split fail to override postings after merge\n");
                                 exit(0);
                             }
                             m_postingSizes.UpdateSize(queryResult->VID, totalLength);
+                            m_postingGarbage.UpdateSize(queryResult->VID, 0);
                             m_postingSizes.UpdateSize(headID, 0);
+                            m_postingGarbage.UpdateSize(headID, 0);
                         }
-                        if (m_rwLocks.hash_func(queryResult->VID) != m_rwLocks.hash_func(headID))
+                        if (queryResult->VID != headID)
                             anotherLock.unlock();
                     }
 
@@ -740,40 +1053,48 @@ class ExtraDynamicSearcher {
 
                     if (reassign) {
                         /* ReAssign */
+                        std::vector<ValueType> scratch;
+                        std::string reassignBatch;
                         if (currentLength > nextLength) {
                             /* ReAssign queryResult->VID*/
                             postingP = nextPostingList.empty() ? nullptr : reinterpret_cast<uint8_t*>(&nextPostingList.front());
                             for (int j = 0; j < nextLength; j++) {
                                 uint8_t* vectorId = postingP + j * m_vectorInfoSize;
                                 // SizeType vid = *(reinterpret_cast<SizeType*>(vectorId));
-                                ValueType* vector = reinterpret_cast<ValueType*>(vectorId + m_metaDataSize);
+                                ValueType* vector = EntryVector(vectorId, scratch);
                                 float origin_dist = p_index->ComputeDistance(p_index->GetSample(queryResult->VID), vector);
                                 float current_dist = p_index->ComputeDistance(p_index->GetSample(headID), vector);
                                 if (current_dist > origin_dist)
-                                    ReassignAsync(p_index, std::make_shared<std::string>((char*)vectorId, m_vectorInfoSize), headID);
+                                    reassignBatch.append((char*)vectorId, m_vectorInfoSize);
                             }
+                            ReassignAsync(p_index, std::move(reassignBatch), headID);
                         } else {
                             /* ReAssign headID*/
                             postingP = currentPostingList.empty() ? nullptr : reinterpret_cast<uint8_t*>(&currentPostingList.front());
                             for (int j = 0; j < currentLength; j++) {
                                 uint8_t* vectorId = postingP + j * m_vectorInfoSize;
                                 // SizeType vid = *(reinterpret_cast<SizeType*>(vectorId));
-                                ValueType* vector = reinterpret_cast<ValueType*>(vectorId + m_metaDataSize);
+                                ValueType* vector = EntryVector(vectorId, scratch);
                                 float origin_dist = p_index->ComputeDistance(p_index->GetSample(headID), vector);
                                 float current_dist = p_index->ComputeDistance(p_index->GetSample(queryResult->VID), vector);
                                 if (current_dist > origin_dist)
-                                    ReassignAsync(p_index, std::make_shared<std::string>((char*)vectorId, m_vectorInfoSize), queryResult->VID);
+                                    reassignBatch.append((char*)vectorId, m_vectorInfoSize);
                             }
+                            ReassignAsync(p_index, std::move(reassignBatch), queryResult->VID);
                         }
                     }
 
                     m_mergeList.erase(headID);
                     m_stat.m_mergeNum++;
+                    probe.outcome = 3;
+                    probe.other = queryResult->VID;
+                    probe.length = totalLength;
 
                     return ErrorCode::Success;
                 }
             }
             m_postingSizes.UpdateSize(headID, currentLength);
+            m_postingGarbage.UpdateSize(headID, 0);
             if (db->Put(headID, mergedPostingList) != ErrorCode::Success) {
                 LOG(Helper::LogLevel::LL_Info, "Merge Fail to write back postings\n");
                 exit(0);
@@ -802,8 +1123,9 @@ class ExtraDynamicSearcher {
             m_splitList.insert(headID);
         }
 
+        // splits queued by an inserter hold up acknowledged writes, splits queued by jobs do not
         auto* curJob = new SplitAsyncJob(p_index, this, headID, m_opt->m_disableReassign, p_callback);
-        m_splitThreadPool->add(curJob);
+        m_jobPool->add(curJob, m_jobPool->inWorker() ? SplitPriority : ForegroundSplitPriority);
         // LOG(Helper::LogLevel::LL_Info, "Add to thread pool\n");
     }
 
@@ -818,20 +1140,26 @@ class ExtraDynamicSearcher {
         m_mergeList.insert(workPair);
 
         auto* curJob = new MergeAsyncJob(p_index, this, headID, m_opt->m_disableReassign, p_callback);
-        m_splitThreadPool->add(curJob);
+        m_jobPool->add(curJob, MergePriority);
     }
 
-    inline void ReassignAsync(SPTAG::BKT::Index<ValueType>* p_index, std::shared_ptr<std::string> vectorInfo, SizeType HeadPrev, std::function<void()> p_callback = nullptr) {
-        auto* curJob = new ReassignAsyncJob(p_index, this, std::move(vectorInfo), HeadPrev, p_callback);
-        m_splitThreadPool->add(curJob);
+    // p_entries holds one or more entries from the posting of HeadPrev, an empty batch is dropped
+    inline void ReassignAsync(SPTAG::BKT::Index<ValueType>* p_index, std::string p_entries, SizeType HeadPrev, std::function<void()> p_callback = nullptr) {
+        if (p_entries.empty())
+            return;
+        auto* curJob = new ReassignAsyncJob(p_index, this, std::move(p_entries), HeadPrev, p_callback);
+        m_jobPool->add(curJob, ReassignPriority);
     }
 
     ErrorCode CollectReAssign(SPTAG::BKT::Index<ValueType>* p_index, SizeType headID, std::vector<std::string>& postingLists, std::vector<SizeType>& newHeadsID) {
         auto headVector = reinterpret_cast<const ValueType*>(p_index->GetSample(headID));
         std::vector<float> newHeadsDist;
         std::set<SizeType> reAssignVectorsTopK;
+        std::vector<ValueType> scratch;
         newHeadsDist.push_back(p_index->ComputeDistance(p_index->GetSample(headID), p_index->GetSample(newHeadsID[0])));
         newHeadsDist.push_back(p_index->ComputeDistance(p_index->GetSample(headID), p_index->GetSample(newHeadsID[1])));
+        // one reassign job per source posting
+        std::string reassignBatch;
         for (int i = 0; i < postingLists.size(); i++) {
             auto& postingList = postingLists[i];
             size_t postVectorNum = postingList.size() / m_vectorInfoSize;
@@ -841,16 +1169,18 @@ class ExtraDynamicSearcher {
                 SizeType vid = *(reinterpret_cast<SizeType*>(vectorId));
                 // LOG(Helper::LogLevel::LL_Info, "VID: %d, Head: %d\n", vid, newHeadsID[i]);
                 uint8_t version = *(reinterpret_cast<uint8_t*>(vectorId + sizeof(int)));
-                ValueType* vector = reinterpret_cast<ValueType*>(vectorId + m_metaDataSize);
+                ValueType* vector = EntryVector(vectorId, scratch);
                 if (reAssignVectorsTopK.find(vid) == reAssignVectorsTopK.end() && !m_versionMap->Deleted(vid) && m_versionMap->GetVersion(vid) == version) {
                     m_stat.m_reAssignScanNum++;
                     float dist = p_index->ComputeDistance(p_index->GetSample(newHeadsID[i]), vector);
                     if (CheckIsNeedReassign(p_index, newHeadsID, vector, headID, newHeadsDist[i], dist, true, newHeadsID[i])) {
-                        ReassignAsync(p_index, std::make_shared<std::string>((char*)vectorId, m_vectorInfoSize), newHeadsID[i]);
+                        reassignBatch.append((char*)vectorId, m_vectorInfoSize);
                         reAssignVectorsTopK.insert(vid);
                     }
                 }
             }
+            ReassignAsync(p_index, std::move(reassignBatch), newHeadsID[i]);
+            reassignBatch.clear();
         }
         if (m_opt->m_reassignK > 0) {
             std::vector<SizeType> HeadPrevTopK;
@@ -872,14 +1202,12 @@ class ExtraDynamicSearcher {
                     newHeadsDist.push_back(queryResults[i].Dist);
                 }
             }
-            auto reassignScanIOBegin = std::chrono::high_resolution_clock::now();
+            std::uint64_t reassignScanIOBegin = StageNow();
             if (db->MultiGet(HeadPrevTopK, &postingLists) != ErrorCode::Success) {
                 LOG(Helper::LogLevel::LL_Info, "ReAssign can't get all the near postings\n");
                 exit(0);
             }
-            auto reassignScanIOEnd = std::chrono::high_resolution_clock::now();
-            auto elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(reassignScanIOEnd - reassignScanIOBegin).count();
-            m_stat.m_reassignScanIOCost += elapsedMSeconds;
+            m_stat.m_stages.RecordSince(Stage::ReassignScanIO, reassignScanIOBegin);
 
             for (int i = 0; i < postingLists.size(); i++) {
                 auto& postingList = postingLists[i];
@@ -890,25 +1218,43 @@ class ExtraDynamicSearcher {
                     SizeType vid = *(reinterpret_cast<SizeType*>(vectorId));
                     // LOG(Helper::LogLevel::LL_Info, "%d: VID: %d, Head: %d, size:%d/%d\n", i, vid, HeadPrevTopK[i], postingLists.size(), HeadPrevTopK.size());
                     uint8_t version = *(reinterpret_cast<uint8_t*>(vectorId + sizeof(int)));
-                    ValueType* vector = reinterpret_cast<ValueType*>(vectorId + m_metaDataSize);
+                    ValueType* vector = EntryVector(vectorId, scratch);
                     if (reAssignVectorsTopK.find(vid) == reAssignVectorsTopK.end() && !m_versionMap->Deleted(vid) && m_versionMap->GetVersion(vid) == version) {
                         m_stat.m_reAssignScanNum++;
                         float dist = p_index->ComputeDistance(p_index->GetSample(HeadPrevTopK[i]), vector);
                         if (CheckIsNeedReassign(p_index, newHeadsID, vector, headID, newHeadsDist[i], dist, false, HeadPrevTopK[i])) {
-                            ReassignAsync(p_index, std::make_shared<std::string>((char*)vectorId, m_vectorInfoSize), HeadPrevTopK[i]);
+                            reassignBatch.append((char*)vectorId, m_vectorInfoSize);
                             reAssignVectorsTopK.insert(vid);
                         }
                     }
                 }
+                ReassignAsync(p_index, std::move(reassignBatch), HeadPrevTopK[i]);
+                reassignBatch.clear();
             }
         }
         // exit(1);
         return ErrorCode::Success;
     }
 
-    bool RNGSelection(std::vector<Edge>& selections, ValueType* queryVector, SPTAG::BKT::Index<ValueType>* p_index, SizeType p_fullID, int& replicaCount, int checkHeadID = -1) {
+    bool RNGSelection(std::vector<Edge>& selections, ValueType* queryVector, SPTAG::BKT::Index<ValueType>* p_index, SizeType p_fullID, int& replicaCount, int checkHeadID = -1, double p_norm = 0) {
         QueryResult queryResults(queryVector, m_opt->m_internalResultNum, false);
+        return RNGSelection(selections.data(), queryResults, p_index, p_fullID, replicaCount, checkHeadID, p_norm);
+    }
+
+    // queryResults carries the target and is reused by callers selecting for many vectors in a row.
+    // p_norm > 0 marks a Cosine target that is not normalized: the dot products with the heads are
+    // scaled by base / p_norm into the distances its normalized copy would have, in the same order
+    bool RNGSelection(Edge* selections, QueryResult& queryResults, SPTAG::BKT::Index<ValueType>* p_index, SizeType p_fullID, int& replicaCount, int checkHeadID = -1, double p_norm = 0) {
+        queryResults.Reset();
         p_index->SearchIndex(queryResults);
+        if (p_norm > 0) {
+            float baseSquare = m_baseSquare, scale = (float)(COMMON::Utils::GetBase<ValueType>() / p_norm);
+            for (int i = 0; i < queryResults.GetResultNum(); ++i) {
+                BasicResult* queryResult = queryResults.GetResult(i);
+                if (queryResult->VID >= 0)
+                    queryResult->Dist = baseSquare - (baseSquare - queryResult->Dist) * scale;
+            }
+        }
 
         replicaCount = 0;
         for (int i = 0; i < queryResults.GetResultNum() && replicaCount < m_opt->m_replicaCount; ++i) {
@@ -939,7 +1285,9 @@ class ExtraDynamicSearcher {
     }
 
     ErrorCode Append(SPTAG::BKT::Index<ValueType>* p_index, SizeType headID, int appendNum, std::string& appendPosting, int reassignThreshold = 0) {
-        auto appendBegin = std::chrono::high_resolution_clock::now();
+        IOClassScope ioClass(IOClass::Update);
+        std::uint64_t appendBegin = StageNow();
+        AppendProbe probe(headID, appendNum);
         if (appendPosting.empty()) {
             LOG(Helper::LogLevel::LL_Error, "Error! empty append posting!\n");
         }
@@ -950,23 +1298,25 @@ class ExtraDynamicSearcher {
 
     checkDeleted:
         if (!p_index->ContainSample(headID)) {
+            std::string reassignBatch;
             for (int i = 0; i < appendNum; i++) {
                 uint32_t idx = i * m_vectorInfoSize;
                 SizeType VID = *(int*)(&appendPosting[idx]);
                 uint8_t version = *(uint8_t*)(&appendPosting[idx + sizeof(int)]);
-                auto vectorInfo = std::make_shared<std::string>(appendPosting.c_str() + idx, m_vectorInfoSize);
                 if (m_versionMap->GetVersion(VID) == version) {
                     // LOG(Helper::LogLevel::LL_Info, "Head Miss To ReAssign: VID: %d, current version: %d\n", *(int*)(&appendPosting[idx]), version);
                     m_stat.m_headMiss++;
-                    ReassignAsync(p_index, vectorInfo, headID);
+                    reassignBatch.append(appendPosting.c_str() + idx, m_vectorInfoSize);
                 }
                 // LOG(Helper::LogLevel::LL_Info, "Head Miss Do Not To ReAssign: VID: %d, version: %d, current version: %d\n", *(int*)(&appendPosting[idx]), m_versionMap->GetVersion(*(int*)(&appendPosting[idx])), version);
             }
+            ReassignAsync(p_index, std::move(reassignBatch), headID);
+            probe.outcome = 1;
             return ErrorCode::Undefined;
         }
-        double appendIOSeconds = 0;
+        std::uint64_t appendIOTicks = 0;
         {
-            std::unique_lock<std::shared_timed_mutex> lock(m_rwLocks[headID]);  // SPDK
+            std::unique_lock<COMMON::SeqLock> lock(m_postingLocks[headID]);  // SPDK
             if (!p_index->ContainSample(headID)) {
                 goto checkDeleted;
             }
@@ -974,23 +1324,27 @@ class ExtraDynamicSearcher {
                 static std::atomic<int> overflowLogCount{0};
                 if ((overflowLogCount.fetch_add(1) & 0x3FF) == 0) {
                     LOG(Helper::LogLevel::LL_Warning, "Posting %d would overflow (%d + %d > %d + %d), splitting before merge (logged %d total)\n",
-                        headID, m_postingSizes.GetSize(headID), appendNum, m_postingSizeLimit, m_mergeThreshold, overflowLogCount.load());
+                        headID, m_postingSizes.GetSize(headID), appendNum, m_postingSizeLimit.load(), m_mergeThreshold.load(), overflowLogCount.load());
                 }
                 lock.unlock();
                 Split(p_index, headID, !m_opt->m_disableReassign);
                 goto checkDeleted;
             }
-            auto appendIOBegin = std::chrono::high_resolution_clock::now();
+            // the bound covers the new entries before a range search can read them
+            m_postingRadius.Grow(headID, PostingRadius(p_index, headID, appendPosting));
+            std::uint64_t appendIOBegin = StageNow();
             ErrorCode mergeRet = db->Merge(headID, appendPosting);
             if (mergeRet != ErrorCode::Success) {
-                LOG(Helper::LogLevel::LL_Error, "Merge failed for %d! Posting Size:%d, limit: %d\n", headID, m_postingSizes.GetSize(headID), m_postingSizeLimit);
+                LOG(Helper::LogLevel::LL_Error, "Merge failed for %d! Posting Size:%d, limit: %d\n", headID, m_postingSizes.GetSize(headID), m_postingSizeLimit.load());
                 GetDBStats();
+                probe.outcome = 2;
                 return mergeRet;
             }
-            auto appendIOEnd = std::chrono::high_resolution_clock::now();
-            appendIOSeconds = std::chrono::duration_cast<std::chrono::microseconds>(appendIOEnd - appendIOBegin).count();
+            appendIOTicks = StageNow() - appendIOBegin;
             m_postingSizes.IncSize(headID, appendNum);
+            probe.size = m_postingSizes.GetSize(headID);
         }
+        m_heat.Touch(headID, HeatKind::Append);
         if (m_postingSizes.GetSize(headID) > (m_postingSizeLimit + reassignThreshold)) {
             // SizeType VID = *(int*)(&appendPosting[0]);
             // LOG(Helper::LogLevel::LL_Error, "Split Triggered by inserting VID: %d, reAssign: %d\n", VID, reassignThreshold);
@@ -1005,12 +1359,10 @@ class ExtraDynamicSearcher {
                 Split(p_index, headID, !m_opt->m_disableReassign);
             // SplitAsync(p_index, headID);
         }
-        auto appendEnd = std::chrono::high_resolution_clock::now();
-        double elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(appendEnd - appendBegin).count();
         if (!reassignThreshold) {
             m_stat.m_appendTaskNum++;
-            m_stat.m_appendIOCost += appendIOSeconds;
-            m_stat.m_appendCost += elapsedMSeconds;
+            m_stat.m_stages.Record(Stage::AppendIO, appendIOTicks);
+            m_stat.m_stages.RecordSince(Stage::Append, appendBegin);
         }
         // } else {
         //     LOG(Helper::LogLevel::LL_Info, "ReAssign Append To: %d\n", headID);
@@ -1018,62 +1370,110 @@ class ExtraDynamicSearcher {
         return ErrorCode::Success;
     }
 
-    void Reassign(SPTAG::BKT::Index<ValueType>* p_index, std::shared_ptr<std::string> vectorInfo, SizeType HeadPrev) {
-        SizeType VID = *((SizeType*)vectorInfo->c_str());
-        uint8_t version = *((uint8_t*)(vectorInfo->c_str() + sizeof(VID)));
-        // return;
-        // LOG(Helper::LogLevel::LL_Info, "ReassignID: %d, version: %d, current version: %d, HeadPrev: %d\n", VID, version, m_versionMap->GetVersion(VID), HeadPrev);
-        if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version) {
+    // Reassign the entries of p_entries, all taken from the posting of HeadPrev. The head searches
+    // share one result buffer, then every moved entry gets its new version and the appends are
+    // grouped per destination head like in AddIndex. An entry whose version moves on before its
+    // append is left out, whoever bumped the version owns it now.
+    void Reassign(SPTAG::BKT::Index<ValueType>* p_index, std::string& p_entries, SizeType HeadPrev) {
+        SizeType count = (SizeType)(p_entries.size() / m_vectorInfoSize);
+        if (count == 0)
             return;
-        }
-        auto reassignBegin = std::chrono::high_resolution_clock::now();
-
-        m_stat.m_reAssignNum++;
-
-        auto selectBegin = std::chrono::high_resolution_clock::now();
-        std::vector<Edge> selections(static_cast<size_t>(m_opt->m_replicaCount));
-        int replicaCount;
-        bool isNeedReassign = RNGSelection(selections, (ValueType*)(vectorInfo->c_str() + m_metaDataSize), p_index, VID, replicaCount, HeadPrev);
-        auto selectEnd = std::chrono::high_resolution_clock::now();
-        auto elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(selectEnd - selectBegin).count();
-        m_stat.m_selectCost += elapsedMSeconds;
-
-        auto reassignAppendBegin = std::chrono::high_resolution_clock::now();
-        // LOG(Helper::LogLevel::LL_Info, "Need ReAssign\n");
-        if (isNeedReassign && m_versionMap->GetVersion(VID) == version) {
+        SPTAG_PROBE2(reassign__entry, HeadPrev, count);
+        std::uint64_t reassignBegin = StageNow();
+        uint8_t* entries = reinterpret_cast<uint8_t*>(&p_entries.front());
+        int replicas = m_opt->m_replicaCount;
+
+        std::uint64_t selectBegin = StageNow();
+        std::vector<Edge> selections((size_t)count * replicas);
+        std::vector<int> replicaCounts(count, 0);
+        std::vector<ValueType> scratch;
+        QueryResult queryResults(nullptr, m_opt->m_internalResultNum, false);
+        for (SizeType v = 0; v < count; v++) {
+            uint8_t* entry = entries + (size_t)v * m_vectorInfoSize;
+            SizeType VID = *((SizeType*)entry);
+            uint8_t version = *(entry + sizeof(VID));
+            // LOG(Helper::LogLevel::LL_Info, "ReassignID: %d, version: %d, current version: %d, HeadPrev: %d\n", VID, version, m_versionMap->GetVersion(VID), HeadPrev);
+            if (m_versionMap->Deleted(VID) || m_versionMap->GetVersion(VID) != version)
+                continue;
+            m_stat.m_reAssignNum++;
+            queryResults.SetTarget(EntryVector(entry, scratch));
+            bool isNeedReassign = RNGSelection(selections.data() + (size_t)v * replicas, queryResults, p_index, VID, replicaCounts[v], HeadPrev);
+            if (!isNeedReassign || m_versionMap->GetVersion(VID) != version) {
+                replicaCounts[v] = 0;
+                continue;
+            }
             // LOG(Helper::LogLevel::LL_Info, "Update Version: VID: %d, version: %d, current version: %d\n", VID, version, m_versionMap.GetVersion(VID));
             m_versionMap->IncVersion(VID, &version);
-            (*vectorInfo)[sizeof(VID)] = version;
-
-            // LOG(Helper::LogLevel::LL_Info, "Reassign: oldVID:%d, replicaCount:%d, candidateNum:%d, dist0:%f\n", oldVID, replicaCount, i, selections[0].distance);
-            for (int i = 0; i < replicaCount && m_versionMap->GetVersion(VID) == version; i++) {
-                // LOG(Helper::LogLevel::LL_Info, "Reassign: headID :%d, oldVID:%d, newVID:%d, posting length: %d, dist: %f, string size: %d\n", headID, oldVID, VID, m_postingSizes[headID].load(), selections[i].distance, newPart.size());
-                if (ErrorCode::Undefined == Append(p_index, selections[i].node, 1, *vectorInfo, 3)) {
-                    // LOG(Helper::LogLevel::LL_Info, "Head Miss: VID: %d, current version: %d, another re-assign\n", VID, version);
-                    break;
-                }
+            entry[sizeof(VID)] = version;
+        }
+        m_stat.m_stages.RecordSince(Stage::ReassignSelect, selectBegin);
+        int moved = 0;
+        for (SizeType v = 0; v < count; v++) moved += replicaCounts[v] > 0 ? 1 : 0;
+        NoteGarbage(p_index, HeadPrev, moved);
+
+        std::uint64_t reassignAppendBegin = StageNow();
+        std::vector<std::pair<SizeType, SizeType>> targets;
+        for (SizeType v = 0; v < count; v++) {
+            for (int i = 0; i < replicaCounts[v]; i++) targets.emplace_back(selections[(size_t)v * replicas + i].node, v);
+        }
+        std::sort(targets.begin(), targets.end());
+
+        size_t chunkLimit = (size_t)(std::max)(m_mergeThreshold.load(), 1);
+        std::string appendPosting;
+        int appends = 0;
+        for (size_t first = 0; first < targets.size();) {
+            size_t last = first + 1;
+            while (last < targets.size() && last - first < chunkLimit && targets[last].first == targets[first].first) last++;
+            appendPosting.clear();
+            for (size_t i = first; i < last; i++) {
+                uint8_t* entry = entries + (size_t)targets[i].second * m_vectorInfoSize;
+                if (m_versionMap->GetVersion(*((SizeType*)entry)) == *(entry + sizeof(SizeType)))
+                    appendPosting.append((char*)entry, m_vectorInfoSize);
             }
+            // a missing head hands its part of the batch back to the reassign pool
+            if (!appendPosting.empty()) {
+                Append(p_index, targets[first].first, (int)(appendPosting.size() / m_vectorInfoSize), appendPosting, 3);
+                appends++;
+            }
+            first = last;
         }
-        auto reassignAppendEnd = std::chrono::high_resolution_clock::now();
-        elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(reassignAppendEnd - reassignAppendBegin).count();
-        m_stat.m_reAssignAppendCost += elapsedMSeconds;
-
-        auto reassignEnd = std::chrono::high_resolution_clock::now();
-        elapsedMSeconds = std::chrono::duration_cast<std::chrono::microseconds>(reassignEnd - reassignBegin).count();
-        m_stat.m_reAssignCost += elapsedMSeconds;
+        m_stat.m_stages.RecordSince(Stage::ReassignAppend, reassignAppendBegin);
+        m_stat.m_stages.RecordSince(Stage::Reassign, reassignBegin);
+        SPTAG_PROBE3(reassign__return, HeadPrev, moved, appends);
     }
 
     bool LoadIndex(Options& p_opt, COMMON::VersionLabel& p_versionMap) {
         m_versionMap = &p_versionMap;
         m_opt = &p_opt;
         LOG(Helper::LogLevel::LL_Info, "DataBlockSize: %d, Capacity: %d\n", m_opt->m_datasetRowsInBlock, m_opt->m_datasetCapacity);
+        ConfigureStorage();
+        ConfigureVectorStore();
+        m_distanceBatch = COMMON::DistanceBatchSelector<ValueType>(m_opt->m_distCalcMethod, m_opt->m_dim);
+        if (!ConfigureLayout(false))
+            return false;
+        if (!ConfigureQuantizer())
+            return false;
+        if (!MigrateLayout())
+            return false;
+        ConfigureCompression();
+
+        if (m_opt->m_persistentRecords && m_opt->m_recordCheckpointSeconds > 0 && !m_recordThread.joinable())
+            m_recordThread = std::thread([this] { RecordCheckpointLoop(); });
 
         if (m_opt->m_update) {
-            LOG(Helper::LogLevel::LL_Info, "SPFresh: initialize thread pools, append: %d, reassign %d\n", m_opt->m_appendThreadNum, m_opt->m_reassignThreadNum);
-            m_splitThreadPool = std::make_shared<SPDKThreadPool>();
-            m_splitThreadPool->initSPDK(m_opt->m_appendThreadNum, this);
-            m_reassignThreadPool = std::make_shared<SPDKThreadPool>();
-            m_reassignThreadPool->initSPDK(m_opt->m_reassignThreadNum, this);
+            LOG(Helper::LogLevel::LL_Info, "SPFresh: initialize job pool, append: %d, reassign %d\n", m_opt->m_appendThreadNum, m_opt->m_reassignThreadNum);
+            std::vector<int> backgroundCores;
+            if (!Helper::CoreMap::Parse(m_opt->m_backgroundCores, backgroundCores))
+                LOG(Helper::LogLevel::LL_Warning, "SPFresh: cannot parse BackgroundCores %s, background workers are not pinned\n", m_opt->m_backgroundCores.c_str());
+            // with AutoTuneThreadRange the pool holds the most workers the tuner may ask for, the
+            // ones beyond AppendThreadNum + ReassignThreadNum are parked
+            int workers = m_opt->m_appendThreadNum + m_opt->m_reassignThreadNum, low, high;
+            int threads = workers;
+            if (m_opt->m_autoTuneIntervalMs > 0 && AutoTuner::ParseRange(m_opt->m_autoTuneThreadRange, low, high))
+                threads = (std::max)(m_opt->m_appendThreadNum, high) + (std::max)(m_opt->m_reassignThreadNum, high);
+            m_jobPool = std::make_shared<SPDKThreadPool>();
+            m_jobPool->initSPDK(threads, this, backgroundCores);
+            m_jobPool->setActive(workers);
             LOG(Helper::LogLevel::LL_Info, "SPFresh: finish initialization\n");
         }
         return true;
@@ -1081,10 +1481,12 @@ class ExtraDynamicSearcher {
 
     void SearchIndex(ExtraWorkSpace* p_exWorkSpace, QueryResult& p_queryResults, std::shared_ptr<SPTAG::BKT::Index<ValueType>> p_index, SearchStats* p_stats, std::set<int>* truth, std::map<int, std::set<int>>* found) {
         auto exStart = std::chrono::high_resolution_clock::now();
+        SPTAG_PROBE1(search__entry, p_exWorkSpace->m_postingIDs.size());
 
         // const auto postingListCount = static_cast<uint32_t>(p_exWorkSpace->m_postingIDs.size());
 
-        p_exWorkSpace->m_deduper.clear();
+        // the deduper is cleared by the caller once per query, so that postings searched
+        // in several calls (probe waves, debug partitions) share it
 
         auto exSetUpEnd = std::chrono::high_resolution_clock::now();
 
@@ -1098,77 +1500,428 @@ class ExtraDynamicSearcher {
         int diskIO = 0;
         int listElements = 0;
 
-        double compLatency = 0;
-        double readLatency = 0;
+        std::uint64_t scanTicks = 0;
+        std::uint64_t readTicks = 0;
 
-        std::vector<std::string> postingLists;
+        auto& postingLists = p_exWorkSpace->m_postingViews;
+        postingLists.clear();
 
         std::chrono::microseconds remainLimit = m_hardLatencyLimit - (p_stats ? std::chrono::microseconds((int)p_stats->m_totalLatency) : std::chrono::microseconds(0));
+        if (queryResults.HasDeadline()) {
+            auto left = std::chrono::duration_cast<std::chrono::microseconds>(queryResults.GetDeadline() - std::chrono::steady_clock::now());
+            remainLimit = (std::min)(remainLimit, (std::max)(left, std::chrono::microseconds(0)));
+        }
+
+        // with PQ codes in the postings every distance is a sum of lookups in the query's table
+        const float* adcTable = nullptr;
+        if (m_quantizer != nullptr) {
+            p_exWorkSpace->m_adcTable.resize(m_quantizer->TableSize());
+            m_quantizer->BuildTable((const ValueType*)queryResults.GetTarget(), p_exWorkSpace->m_adcTable.data());
+            adcTable = p_exWorkSpace->m_adcTable.data();
+        }
+        p_exWorkSpace->m_scan.m_queryNorm = QueryNorm(queryResults.GetTarget(), adcTable);
+
+        const PostingFilter* filter = p_exWorkSpace->m_filter.Active() ? &p_exWorkSpace->m_filter : nullptr;
+        auto& scanned = p_exWorkSpace->m_scanned;
+        scanned.assign(p_exWorkSpace->m_postingIDs.size(), 0);
+        auto scanPosting = [&](int pi) {
+            scanned[pi] = 1;
+            auto curPostingID = p_exWorkSpace->m_postingIDs[pi];
+            const PostingView& postingList = postingLists[pi];
+
+            int vectorNum = (int)(postingList.size / m_vectorInfoSize);
+
+            diskIO += ((postingList.size + PageSize - 1) >> PageSizeEx);
+            diskRead += (int)(postingList.size);
 
-        auto readStart = std::chrono::high_resolution_clock::now();
-        db->MultiGet(p_exWorkSpace->m_postingIDs, &postingLists, remainLimit);
-        auto readEnd = std::chrono::high_resolution_clock::now();
+            std::uint64_t compStart = Tsc::Now();
+            int fresh = 0;
+            int realNum = ScanEntries(postingList, queryResults, p_exWorkSpace->m_deduper, nullptr, filter, adcTable, p_exWorkSpace->m_scan, fresh);
+            listElements += fresh;
+            scanTicks += Tsc::Now() - compStart;
+            NoteScan(p_index.get(), curPostingID, vectorNum, realNum);
 
+            if (truth) {
+                for (int i = 0; i < vectorNum; ++i) {
+                    const char* vectorInfo = postingList.data + i * m_vectorInfoSize;
+                    int vectorID = *(reinterpret_cast<const int*>(vectorInfo));
+                    if (truth->count(vectorID) != 0)
+                        (*found)[curPostingID].insert(vectorID);
+                }
+            }
+        };
+
+        // with the pipelined scan a posting is scanned as soon as its pages are in, overlapping
+        // distance computation with the reads of the remaining postings. postings are submitted
+        // in the order of their heads, so a deadline cuts off the farthest ones
+        // a query probing ParallelScanThreshold postings or more reads them all first and has them
+        // scanned by several helpers at once instead
+        int skipped = 0;
+        bool parallel = m_opt->m_parallelScanThreshold > 0 && m_opt->m_parallelScanWorkers > 1 && truth == nullptr &&
+                        (int)p_exWorkSpace->m_postingIDs.size() >= m_opt->m_parallelScanThreshold;
+        auto& sequences = p_exWorkSpace->m_sequences;
+        sequences.resize(p_exWorkSpace->m_postingIDs.size());
+        for (size_t pi = 0; pi < sequences.size(); pi++) sequences[pi] = m_postingLocks[p_exWorkSpace->m_postingIDs[pi]].ReadBegin();
+        std::uint64_t readStart = Tsc::Now();
+        if (remainLimit.count() <= 0)
+            skipped = (int)p_exWorkSpace->m_postingIDs.size();
+        else if (m_opt->m_pipelinedPostingScan && !parallel)
+            db->MultiGet(p_exWorkSpace->m_postingIDs, &postingLists, scanPosting, remainLimit);
+        else
+            db->MultiGet(p_exWorkSpace->m_postingIDs, &postingLists, remainLimit);
+        readTicks = Tsc::Now() - readStart - scanTicks;
+
+        // empty postings, postings cut off by the deadline, or all of them without the pipeline
+        bool expired = queryResults.HasDeadline() && std::chrono::steady_clock::now() >= queryResults.GetDeadline();
+        if (parallel && !postingLists.empty()) {
+            std::uint64_t compStart = Tsc::Now();
+            for (uint32_t pi = 0; pi < postingLists.size(); ++pi) {
+                if (expired && postingLists[pi].empty())
+                    skipped++;
+            }
+            ScanParallel(p_exWorkSpace, queryResults, adcTable, p_index.get(), diskIO, diskRead, listElements);
+            std::fill(scanned.begin(), scanned.begin() + postingLists.size(), 1);
+            scanTicks += Tsc::Now() - compStart;
+        }
         for (uint32_t pi = 0; pi < postingLists.size(); ++pi) {
-            diskIO += ((postingLists[pi].size() + PageSize - 1) >> PageSizeEx);
+            if (!scanned[pi]) {
+                if (expired && postingLists[pi].empty())
+                    skipped++;
+                scanPosting(pi);
+            }
         }
+        if (skipped == 0)
+            RereadChanged(p_exWorkSpace->m_postingIDs, sequences, postingLists, scanPosting);
+        db->ReleasePostingViews(&postingLists);
+        AddStageTicks(Stage::PostingScan, scanTicks);
+        SPTAG_PROBE4(search__return, p_exWorkSpace->m_postingIDs.size(), listElements, diskIO, skipped);
 
-        readLatency += ((double)std::chrono::duration_cast<std::chrono::microseconds>(readEnd - readStart).count());
-        for (uint32_t pi = 0; pi < postingLists.size(); ++pi) {
-            auto curPostingID = p_exWorkSpace->m_postingIDs[pi];
-            std::string& postingList = postingLists[pi];
+        if (p_stats) {
+            p_stats->m_compLatency = Tsc::ToUs(scanTicks) / 1000;
+            p_stats->m_diskReadLatency = Tsc::ToUs(readTicks) / 1000;
+            p_stats->m_totalListElementsCount = listElements;
+            p_stats->m_diskIOCount = diskIO;
+            p_stats->m_diskAccessCount = diskRead / 1024;
+            p_stats->m_skippedPostings = skipped;
+            p_stats->m_partial = skipped > 0;
+        }
+    }
 
-            int vectorNum = (int)(postingList.size() / m_vectorInfoSize);
+    // Range search over the postings in p_exWorkSpace->m_postingIDs: every live entry within p_radius
+    // of p_target goes to p_onResult as soon as its posting is scanned, until p_onResult returns false.
+    // The caller clears the deduper once per query. A posting read without a known radius, and not
+    // written while it was read, gets the radius measured by the scan
+    void SearchRange(ExtraWorkSpace* p_exWorkSpace, const ValueType* p_target, float p_radius, const std::function<bool(SizeType, float)>& p_onResult, SPTAG::BKT::Index<ValueType>* p_index, SearchStats* p_stats) {
+        const float* adcTable = nullptr;
+        if (m_quantizer != nullptr) {
+            p_exWorkSpace->m_adcTable.resize(m_quantizer->TableSize());
+            m_quantizer->BuildTable(p_target, p_exWorkSpace->m_adcTable.data());
+            adcTable = p_exWorkSpace->m_adcTable.data();
+        }
+        float queryNorm = QueryNorm(p_target, adcTable);
 
+        int diskRead = 0;
+        int diskIO = 0;
+        int listElements = 0;
+        std::uint64_t scanTicks = 0;
+        bool stopped = false;
+
+        auto& postingLists = p_exWorkSpace->m_postingViews;
+        postingLists.clear();
+        auto& sequences = p_exWorkSpace->m_sequences;
+        auto& scanned = p_exWorkSpace->m_scanned;
+        scanned.assign(p_exWorkSpace->m_postingIDs.size(), 0);
+        PostingScanScratch& scan = p_exWorkSpace->m_scan;
+        std::vector<ValueType> scratch;
+        auto scanPosting = [&](int pi) {
+            scanned[pi] = 1;
+            if (stopped)
+                return;
+            SizeType postingID = p_exWorkSpace->m_postingIDs[pi];
+            const PostingView& postingList = postingLists[pi];
+            int vectorNum = (int)(postingList.size / m_vectorInfoSize);
             int realNum = vectorNum;
 
-            diskRead += (int)(postingList.size());
-            listElements += vectorNum;
-
-            auto compStart = std::chrono::high_resolution_clock::now();
-            for (int i = 0; i < vectorNum; i++) {
-                char* vectorInfo = postingList.data() + i * m_vectorInfoSize;
-                int vectorID = *(reinterpret_cast<int*>(vectorInfo));
-                if (m_versionMap->Deleted(vectorID)) {
+            diskIO += ((postingList.size + PageSize - 1) >> PageSizeEx);
+            diskRead += (int)(postingList.size);
+
+            std::uint64_t compStart = Tsc::Now();
+            bool learn = !m_postingRadius.Known(postingID);
+            const ValueType* head = learn ? (const ValueType*)p_index->GetSample(postingID) : nullptr;
+            float radius = 0;
+            auto& deletedMask = scan.m_deletedMask;
+            deletedMask.resize(((size_t)vectorNum + 63) >> 6);
+            m_versionMap->DeletedMask(postingList.data, m_vectorInfoSize, vectorNum, deletedMask.data());
+            for (int i = 0; i < vectorNum && !stopped; i++) {
+                const char* vectorInfo = postingList.data + i * m_vectorInfoSize;
+                int vectorID = *(reinterpret_cast<const int*>(vectorInfo));
+                if ((deletedMask[i >> 6] >> (i & 63)) & 1) {
                     realNum--;
-                    listElements--;
                     continue;
                 }
-                if (p_exWorkSpace->m_deduper.CheckAndSet(vectorID)) {
-                    listElements--;
+                if (learn)
+                    radius = (std::max)(radius, p_index->ComputeDistance(head, EntryVector((const uint8_t*)vectorInfo, scratch)));
+                if (p_exWorkSpace->m_deduper.CheckAndSet(vectorID))
+                    continue;
+                if (queryNorm >= 0 && NormExcludes(queryNorm, vectorInfo, p_radius))
+                    continue;
+                listElements++;
+                if (adcTable) {
+                    float dist = m_quantizer->QueryDistance(adcTable, (const std::uint8_t*)vectorInfo + m_metaDataSize);
+                    if (dist <= p_radius)
+                        stopped = !p_onResult(vectorID, dist);
                     continue;
                 }
-                auto distance2leaf = p_index->ComputeDistance(queryResults.GetTarget(), vectorInfo + m_metaDataSize);
-                queryResults.AddPoint(vectorID, distance2leaf);
+                scan.m_scanIDs.push_back(vectorID);
+                scan.m_scanVectors.push_back(vectorInfo + m_metaDataSize);
+            }
+            if (!scan.m_scanIDs.empty()) {
+                scan.m_scanDists.resize(scan.m_scanIDs.size());
+                m_distanceBatch(p_target, scan.m_scanVectors.data(), (int)scan.m_scanIDs.size(), m_opt->m_dim, scan.m_scanDists.data());
+                for (size_t j = 0; j < scan.m_scanIDs.size() && !stopped; j++) {
+                    if (scan.m_scanDists[j] <= p_radius)
+                        stopped = !p_onResult(scan.m_scanIDs[j], scan.m_scanDists[j]);
+                }
+                scan.m_scanIDs.clear();
+                scan.m_scanVectors.clear();
             }
-            auto compEnd = std::chrono::high_resolution_clock::now();
-            if (realNum <= m_mergeThreshold && !m_opt->m_inPlace)
-                MergeAsync(p_index.get(), curPostingID);
+            // a cut-short scan measured part of the posting only
+            if (learn && !stopped && (sequences[pi] & 1) == 0 && m_postingLocks[postingID].ReadValidate(sequences[pi]))
+                m_postingRadius.Learn(postingID, radius);
+            scanTicks += Tsc::Now() - compStart;
+            NoteScan(p_index, postingID, vectorNum, realNum);
+        };
 
-            compLatency += ((double)std::chrono::duration_cast<std::chrono::microseconds>(compEnd - compStart).count());
+        sequences.resize(p_exWorkSpace->m_postingIDs.size());
+        for (size_t pi = 0; pi < sequences.size(); pi++) sequences[pi] = m_postingLocks[p_exWorkSpace->m_postingIDs[pi]].ReadBegin();
+        std::uint64_t readStart = Tsc::Now();
+        if (m_opt->m_pipelinedPostingScan)
+            db->MultiGet(p_exWorkSpace->m_postingIDs, &postingLists, scanPosting, m_hardLatencyLimit);
+        else
+            db->MultiGet(p_exWorkSpace->m_postingIDs, &postingLists, m_hardLatencyLimit);
+        std::uint64_t readTicks = Tsc::Now() - readStart - scanTicks;
+        for (uint32_t pi = 0; pi < postingLists.size(); ++pi) {
+            if (!scanned[pi])
+                scanPosting(pi);
+        }
+        if (!stopped)
+            RereadChanged(p_exWorkSpace->m_postingIDs, sequences, postingLists, scanPosting);
+        db->ReleasePostingViews(&postingLists);
+        AddStageTicks(Stage::PostingScan, scanTicks);
 
-            if (truth) {
-                for (int i = 0; i < vectorNum; ++i) {
-                    char* vectorInfo = postingList.data() + i * m_vectorInfoSize;
-                    int vectorID = *(reinterpret_cast<int*>(vectorInfo));
-                    if (truth->count(vectorID) != 0)
-                        (*found)[curPostingID].insert(vectorID);
+        if (p_stats) {
+            p_stats->m_compLatency = Tsc::ToUs(scanTicks) / 1000;
+            p_stats->m_diskReadLatency = Tsc::ToUs(readTicks) / 1000;
+            p_stats->m_totalListElementsCount = listElements;
+            p_stats->m_diskIOCount = diskIO;
+            p_stats->m_diskAccessCount = diskRead / 1024;
+        }
+    }
+
+    // farthest entry of a posting from its head, MaxDist while unknown
+    inline float GetPostingRadius(SizeType p_postingID) const {
+        return m_postingRadius.Get(p_postingID);
+    }
+
+    // scan the entries of one posting into p_results and return how many are live. Entries already
+    // in p_deduper, or in p_seen when given, are skipped, as are the ones p_filter drops before their
+    // distance is computed; p_fresh counts the ones compared
+    int ScanEntries(const PostingView& p_posting, COMMON::QueryResultSet<ValueType>& p_results, COMMON::EpochHashPosVector& p_deduper, const COMMON::EpochHashPosVector* p_seen, const PostingFilter* p_filter, const float* p_adcTable, PostingScanScratch& p_scan, int& p_fresh) const {
+        int vectorNum = (int)(p_posting.size / m_vectorInfoSize);
+        int realNum = vectorNum;
+        // the worst result only improves while the batch below is computed
+        float worst = p_results.worstDist();
+        // the deleted entries of the whole posting are found first, in one pass of bit gathers
+        auto& deletedMask = p_scan.m_deletedMask;
+        deletedMask.resize(((size_t)vectorNum + 63) >> 6);
+        m_versionMap->DeletedMask(p_posting.data, m_vectorInfoSize, vectorNum, deletedMask.data());
+        for (int i = 0; i < vectorNum; i++) {
+            const char* vectorInfo = p_posting.data + i * m_vectorInfoSize;
+            int vectorID = *(reinterpret_cast<const int*>(vectorInfo));
+            if ((deletedMask[i >> 6] >> (i & 63)) & 1) {
+                realNum--;
+                continue;
+            }
+            if (p_filter != nullptr && !p_filter->Keep(vectorID))
+                continue;
+            if ((p_seen != nullptr && p_seen->Contains(vectorID)) || p_deduper.CheckAndSet(vectorID))
+                continue;
+            if (p_scan.m_queryNorm >= 0 && NormExcludes(p_scan.m_queryNorm, vectorInfo, worst))
+                continue;
+            p_fresh++;
+            if (p_adcTable) {
+                p_results.AddPoint(vectorID, m_quantizer->QueryDistance(p_adcTable, (const std::uint8_t*)vectorInfo + m_metaDataSize));
+                continue;
+            }
+            p_scan.m_scanIDs.push_back(vectorID);
+            p_scan.m_scanVectors.push_back(vectorInfo + m_metaDataSize);
+        }
+        // the remaining vectors go through the batched kernel in one call
+        if (!p_scan.m_scanIDs.empty()) {
+            p_scan.m_scanDists.resize(p_scan.m_scanIDs.size());
+            m_distanceBatch((const ValueType*)p_results.GetTarget(), p_scan.m_scanVectors.data(), (int)p_scan.m_scanIDs.size(), m_opt->m_dim, p_scan.m_scanDists.data());
+            for (size_t j = 0; j < p_scan.m_scanIDs.size(); j++) p_results.AddPoint(p_scan.m_scanIDs[j], p_scan.m_scanDists[j]);
+            p_scan.m_scanIDs.clear();
+            p_scan.m_scanVectors.clear();
+        }
+        return realNum;
+    }
+
+    // intra-query parallel scan of all postings in m_postingViews: up to ParallelScanWorkers helpers
+    // on the TBB pool, the calling thread among them, take postings one at a time into their own
+    // top-k and deduper. The query's deduper, holding what earlier probe waves returned, is only
+    // read until the parts are merged into it and into p_results
+    void ScanParallel(ExtraWorkSpace* p_exWorkSpace, COMMON::QueryResultSet<ValueType>& p_results, const float* p_adcTable, SPTAG::BKT::Index<ValueType>* p_index, int& p_diskIO, int& p_diskRead, int& p_listElements) {
+        auto& postingLists = p_exWorkSpace->m_postingViews;
+        int parts = (std::min)(m_opt->m_parallelScanWorkers, (int)postingLists.size());
+        auto& scanParts = p_exWorkSpace->m_scanParts;
+        while ((int)scanParts.size() < parts) {
+            scanParts.emplace_back(new ScanPart());
+            scanParts.back()->m_deduper.Init(p_exWorkSpace->m_deduper.MaxCheck(), p_exWorkSpace->m_deduper.HashTableExponent());
+        }
+        for (int i = 0; i < parts; i++) {
+            ScanPart& part = *scanParts[i];
+            if (part.m_results.GetResultNum() != p_results.GetResultNum())
+                part.m_results.Init(p_results.GetTarget(), p_results.GetResultNum(), false);
+            else {
+                part.m_results.SetTarget(p_results.GetTarget());
+                part.m_results.Reset();
+            }
+            part.m_deduper.clear();
+            part.m_scan.m_queryNorm = p_exWorkSpace->m_scan.m_queryNorm;
+            part.m_diskIO = part.m_diskRead = part.m_listElements = 0;
+        }
+
+        const PostingFilter* filter = p_exWorkSpace->m_filter.Active() ? &p_exWorkSpace->m_filter : nullptr;
+        std::atomic<int> nextPosting(0);
+        auto scanPart = [&](ScanPart& part) {
+            COMMON::QueryResultSet<ValueType>& partResults = *((COMMON::QueryResultSet<ValueType>*)&part.m_results);
+            for (int pi = nextPosting++; pi < (int)postingLists.size(); pi = nextPosting++) {
+                const PostingView& postingList = postingLists[pi];
+                part.m_diskIO += (int)((postingList.size + PageSize - 1) >> PageSizeEx);
+                part.m_diskRead += (int)(postingList.size);
+                int realNum = ScanEntries(postingList, partResults, part.m_deduper, &p_exWorkSpace->m_deduper, filter, p_adcTable, part.m_scan, part.m_listElements);
+                NoteScan(p_index, p_exWorkSpace->m_postingIDs[pi], (int)(postingList.size / m_vectorInfoSize), realNum);
+            }
+        };
+        tbb::task_group helpers;
+        for (int i = 1; i < parts; i++) helpers.run([&, i] { scanPart(*scanParts[i]); });
+        scanPart(*scanParts[0]);
+        helpers.wait();
+
+        // a vector found by several parts carries the same distance in each
+        for (int i = 0; i < parts; i++) {
+            ScanPart& part = *scanParts[i];
+            for (int j = 0; j < part.m_results.GetResultNum(); j++) {
+                const BasicResult* res = part.m_results.GetResult(j);
+                if (res->VID < 0 || p_exWorkSpace->m_deduper.CheckAndSet(res->VID))
+                    continue;
+                p_results.AddPoint(res->VID, res->Dist);
+            }
+            p_diskIO += part.m_diskIO;
+            p_diskRead += part.m_diskRead;
+            p_listElements += part.m_listElements;
+        }
+    }
+
+    // search a batch of queries, p_exWorkSpace->m_postingIDs is the union of their postings and
+    // p_postingQueries[pi] lists the queries that selected posting pi. every posting is read once
+    // and each of its vectors is compared with all those queries while it is in cache
+    void SearchIndexBatch(ExtraWorkSpace* p_exWorkSpace, std::vector<QueryResult*>& p_queries, const std::vector<std::vector<int>>& p_postingQueries, std::shared_ptr<SPTAG::BKT::Index<ValueType>> p_index, SearchStats* p_stats) {
+        auto& dedupers = p_exWorkSpace->m_batchDedupers;
+        while (dedupers.size() < p_queries.size()) {
+            dedupers.emplace_back(new COMMON::EpochHashPosVector());
+            dedupers.back()->Init(p_exWorkSpace->m_deduper.MaxCheck(), p_exWorkSpace->m_deduper.HashTableExponent());
+        }
+        for (size_t qi = 0; qi < p_queries.size(); qi++)
+            dedupers[qi]->clear();
+
+        int diskRead = 0;
+        int diskIO = 0;
+        int listElements = 0;
+
+        std::uint64_t scanTicks = 0;
+        std::uint64_t readTicks = 0;
+
+        auto& postingLists = p_exWorkSpace->m_postingViews;
+        postingLists.clear();
+
+        std::chrono::microseconds remainLimit = m_hardLatencyLimit - (p_stats ? std::chrono::microseconds((int)p_stats->m_totalLatency) : std::chrono::microseconds(0));
+
+        std::vector<ValueType> scratch;
+        auto& scanned = p_exWorkSpace->m_scanned;
+        scanned.assign(p_exWorkSpace->m_postingIDs.size(), 0);
+        auto scanPosting = [&](int pi) {
+            scanned[pi] = 1;
+            const PostingView& postingList = postingLists[pi];
+            const std::vector<int>& queries = p_postingQueries[pi];
+
+            int vectorNum = (int)(postingList.size / m_vectorInfoSize);
+            int realNum = vectorNum;
+
+            diskIO += ((postingList.size + PageSize - 1) >> PageSizeEx);
+            diskRead += (int)(postingList.size);
+
+            std::uint64_t compStart = Tsc::Now();
+            auto& deletedMask = p_exWorkSpace->m_scan.m_deletedMask;
+            deletedMask.resize(((size_t)vectorNum + 63) >> 6);
+            m_versionMap->DeletedMask(postingList.data, m_vectorInfoSize, vectorNum, deletedMask.data());
+            for (int i = 0; i < vectorNum; i++) {
+                const char* vectorInfo = postingList.data + i * m_vectorInfoSize;
+                int vectorID = *(reinterpret_cast<const int*>(vectorInfo));
+                if ((deletedMask[i >> 6] >> (i & 63)) & 1) {
+                    realNum--;
+                    continue;
+                }
+                // PQ codes are decoded once and compared with all queries
+                const ValueType* vector = EntryVector((const uint8_t*)vectorInfo, scratch);
+                for (int qi : queries) {
+                    if (dedupers[qi]->CheckAndSet(vectorID))
+                        continue;
+                    COMMON::QueryResultSet<ValueType>& queryResults = *((COMMON::QueryResultSet<ValueType>*)p_queries[qi]);
+                    queryResults.AddPoint(vectorID, p_index->ComputeDistance(queryResults.GetTarget(), vector));
+                    listElements++;
                 }
             }
+            scanTicks += Tsc::Now() - compStart;
+            NoteScan(p_index.get(), p_exWorkSpace->m_postingIDs[pi], vectorNum, realNum);
+        };
+
+        auto& sequences = p_exWorkSpace->m_sequences;
+        sequences.resize(p_exWorkSpace->m_postingIDs.size());
+        for (size_t pi = 0; pi < sequences.size(); pi++) sequences[pi] = m_postingLocks[p_exWorkSpace->m_postingIDs[pi]].ReadBegin();
+        std::uint64_t readStart = Tsc::Now();
+        if (m_opt->m_pipelinedPostingScan)
+            db->MultiGet(p_exWorkSpace->m_postingIDs, &postingLists, scanPosting, remainLimit);
+        else
+            db->MultiGet(p_exWorkSpace->m_postingIDs, &postingLists, remainLimit);
+        readTicks = Tsc::Now() - readStart - scanTicks;
+
+        for (uint32_t pi = 0; pi < postingLists.size(); ++pi) {
+            if (!scanned[pi])
+                scanPosting(pi);
         }
+        RereadChanged(p_exWorkSpace->m_postingIDs, sequences, postingLists, scanPosting);
+        db->ReleasePostingViews(&postingLists);
+        AddStageTicks(Stage::PostingScan, scanTicks);
 
         if (p_stats) {
-            p_stats->m_compLatency = compLatency / 1000;
-            p_stats->m_diskReadLatency = readLatency / 1000;
+            p_stats->m_compLatency = Tsc::ToUs(scanTicks) / 1000;
+            p_stats->m_diskReadLatency = Tsc::ToUs(readTicks) / 1000;
             p_stats->m_totalListElementsCount = listElements;
             p_stats->m_diskIOCount = diskIO;
             p_stats->m_diskAccessCount = diskRead / 1024;
         }
     }
 
-    bool BuildIndex(std::shared_ptr<Helper::VectorSetReader<ValueType>>& p_reader, std::shared_ptr<SPTAG::BKT::Index<ValueType>> p_headIndex, Options& p_opt, COMMON::VersionLabel& p_versionMap, SizeType upperBound = -1) {
+    // with p_checkpoint enabled the selections are spilled after every batch and the batches an
+    // earlier run finished are read back instead of searched again
+    bool BuildIndex(std::shared_ptr<Helper::VectorSetReader<ValueType>>& p_reader, std::shared_ptr<SPTAG::BKT::Index<ValueType>> p_headIndex, Options& p_opt, COMMON::VersionLabel& p_versionMap, SizeType upperBound = -1, BuildCheckpoint* p_checkpoint = nullptr) {
         m_versionMap = &p_versionMap;
         m_opt = &p_opt;
+        ConfigureStorage();
+        ConfigureVectorStore();
+        m_distanceBatch = COMMON::DistanceBatchSelector<ValueType>(m_opt->m_distCalcMethod, m_opt->m_dim);
 
         int numThreads = m_opt->m_iSSDNumberOfThreads;
         int candidateNum = m_opt->m_internalResultNum;
@@ -1196,17 +1949,36 @@ class ExtraDynamicSearcher {
         {
             auto fullVectors = p_reader->GetVectorSet();
             fullCount = fullVectors->Count();
-            m_vectorInfoSize = fullVectors->PerVectorDataSize() + m_metaDataSize;
+            m_vectorDataSize = fullVectors->PerVectorDataSize();
         }
         if (upperBound > 0)
             fullCount = upperBound;
 
-        // m_metaDataSize = sizeof(int) + sizeof(uint8_t) + sizeof(float);
-        m_metaDataSize = sizeof(int) + sizeof(uint8_t);
+        if (!ConfigureLayout(true))
+            return false;
+        if (!ConfigureQuantizer(p_reader))
+            return false;
+        ConfigureCompression();
+        if (!BuildVectorStore(p_reader, fullCount))
+            return false;
 
         LOG(Helper::LogLevel::LL_Info, "Build SSD Index.\n");
 
-        Selection selections(static_cast<size_t>(fullCount) * m_opt->m_replicaCount, m_opt->m_tmpdir);
+        if (m_opt->m_streamingBuild) {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            std::vector<int> postingListSize;
+            if (!BuildPostingsStreaming(p_reader, p_headIndex, headVectorIDS, fullCount, postingListSize))
+                return false;
+            return FinishBuild(p_headIndex, postingListSize, t1);
+        }
+
+        bool spill = p_opt.m_batches > 1 || (p_checkpoint != nullptr && p_checkpoint->Enabled());
+        int resumed = p_checkpoint != nullptr ? (std::min)(p_checkpoint->CompletedBatches(), m_opt->m_batches) : 0;
+        if (resumed > 0 && !Selection(static_cast<size_t>(fullCount) * m_opt->m_replicaCount, m_opt->m_tmpdir, true).Spilled()) {
+            LOG(Helper::LogLevel::LL_Warning, "Spilled selections of %d finished batches are missing, searching all batches again\n", resumed);
+            resumed = 0;
+        }
+        Selection selections(static_cast<size_t>(fullCount) * m_opt->m_replicaCount, m_opt->m_tmpdir, resumed > 0);
         LOG(Helper::LogLevel::LL_Info, "Full vector count:%d Edge bytes:%llu selection size:%zu, capacity size:%zu\n", fullCount, sizeof(Edge), selections.m_selections.size(), selections.m_selections.capacity());
         std::vector<std::atomic_int> replicaCount(fullCount);
         std::vector<std::atomic_int> postingListSize(p_headIndex->GetNumSamples());
@@ -1216,7 +1988,7 @@ class ExtraDynamicSearcher {
         SizeType batchSize = (fullCount + m_opt->m_batches - 1) / m_opt->m_batches;
 
         auto t1 = std::chrono::high_resolution_clock::now();
-        if (p_opt.m_batches > 1) {
+        if (spill && resumed == 0) {
             if (selections.SaveBatch() != ErrorCode::Success) {
                 return false;
             }
@@ -1228,14 +2000,26 @@ class ExtraDynamicSearcher {
             for (int i = 0; i < m_opt->m_batches; i++) {
                 SizeType start = i * batchSize;
                 SizeType end = min(start + batchSize, fullCount);
+                if (i < resumed) {
+                    // finished by an earlier run, only the counts are rebuilt from its selections
+                    if (selections.LoadBatch(static_cast<size_t>(start) * p_opt.m_replicaCount, static_cast<size_t>(end) * p_opt.m_replicaCount) != ErrorCode::Success) {
+                        return false;
+                    }
+                    LOG(Helper::LogLevel::LL_Info, "Batch %d vector(%d,%d) restored from checkpoint.\n", i, start, end);
+                    CountReplicas(selections, headVectorIDS, start, end, replicaCount, postingListSize);
+                    selections.DropBatch();
+                    continue;
+                }
                 auto fullVectors = p_reader->GetVectorSet(start, end);
                 if (m_opt->m_distCalcMethod == DistCalcMethod::Cosine && !p_reader->IsNormalized())
                     fullVectors->Normalize(m_opt->m_iSSDNumberOfThreads);
 
-                if (p_opt.m_batches > 1) {
+                if (spill) {
                     if (selections.LoadBatch(static_cast<size_t>(start) * p_opt.m_replicaCount, static_cast<size_t>(end) * p_opt.m_replicaCount) != ErrorCode::Success) {
                         return false;
                     }
+                }
+                if (p_opt.m_batches > 1) {
                     emptySet.clear();
                     for (auto vid : headVectorIDS) {
                         if (vid >= start && vid < end)
@@ -1263,29 +2047,22 @@ class ExtraDynamicSearcher {
                 p_headIndex->ApproximateRNG(fullVectors, emptySet, candidateNum, selections.m_selections.data(), m_opt->m_replicaCount, numThreads, m_opt->m_gpuSSDNumTrees, m_opt->m_gpuSSDLeafSize, m_opt->m_rngFactor, m_opt->m_numGPUs);
                 LOG(Helper::LogLevel::LL_Info, "Batch %d finished!\n", i);
 
-                for (SizeType j = start; j < end; j++) {
-                    replicaCount[j] = 0;
-                    size_t vecOffset = j * (size_t)m_opt->m_replicaCount;
-                    if (headVectorIDS.count(j) == 0) {
-                        for (int resNum = 0; resNum < m_opt->m_replicaCount && selections[vecOffset + resNum].node != INT_MAX; resNum++) {
-                            ++postingListSize[selections[vecOffset + resNum].node];
-                            selections[vecOffset + resNum].tonode = j;
-                            ++replicaCount[j];
-                        }
-                    }
-                }
+                CountReplicas(selections, headVectorIDS, start, end, replicaCount, postingListSize);
 
-                if (p_opt.m_batches > 1) {
+                if (spill) {
                     if (selections.SaveBatch() != ErrorCode::Success) {
                         return false;
                     }
+                    if (p_checkpoint != nullptr && p_checkpoint->MarkBatches(i + 1) != ErrorCode::Success) {
+                        return false;
+                    }
                 }
             }
         }
         auto t2 = std::chrono::high_resolution_clock::now();
         LOG(Helper::LogLevel::LL_Info, "Searching replicas ended. Search Time: %.2lf mins\n", ((double)std::chrono::duration_cast<std::chrono::seconds>(t2 - t1).count()) / 60.0);
 
-        if (p_opt.m_batches > 1) {
+        if (spill) {
             if (selections.LoadBatch(0, static_cast<size_t>(fullCount) * p_opt.m_replicaCount) != ErrorCode::Success) {
                 return false;
             }
@@ -1297,7 +2074,7 @@ class ExtraDynamicSearcher {
         auto t3 = std::chrono::high_resolution_clock::now();
         LOG(Helper::LogLevel::LL_Info, "Time to sort selections:%.2lf sec.\n", ((double)std::chrono::duration_cast<std::chrono::seconds>(t3 - t2).count()) + ((double)std::chrono::duration_cast<std::chrono::milliseconds>(t3 - t2).count()) / 1000);
 
-        auto postingSizeLimit = m_postingSizeLimit;
+        int postingSizeLimit = m_postingSizeLimit;
         if (m_opt->m_postingPageLimit > 0) {
             postingSizeLimit = static_cast<int>(m_opt->m_postingPageLimit * PageSize / m_vectorInfoSize);
         }
@@ -1318,10 +2095,9 @@ class ExtraDynamicSearcher {
             }
         }
 
-#pragma omp parallel for schedule(dynamic)
-        for (int i = 0; i < postingListSize.size(); ++i) {
+        Helper::TaskScheduler::Instance().ParallelFor<int>(0, (int)postingListSize.size(), 1, [&](int i) {
             if (postingListSize[i] <= postingSizeLimit)
-                continue;
+                return;
 
             std::size_t selectIdx = std::lower_bound(selections.m_selections.begin(), selections.m_selections.end(), i, Selection::g_edgeComparer) - selections.m_selections.begin();
 
@@ -1330,7 +2106,7 @@ class ExtraDynamicSearcher {
                 --replicaCount[tonode];
             }
             postingListSize[i] = postingSizeLimit;
-        }
+        });
         {
             std::vector<int> replicaCountDist(m_opt->m_replicaCount + 1, 0);
             for (int i = 0; i < replicaCount.size(); ++i) {
@@ -1382,15 +2158,77 @@ class ExtraDynamicSearcher {
             fullVectors->Normalize(m_opt->m_iSSDNumberOfThreads);
 
         LOG(Helper::LogLevel::LL_Info, "SPFresh: initialize versionMap\n");
-        m_versionMap->Initialize(fullCount, p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity);
+        InitVersionMap(fullCount, p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity);
 
         LOG(Helper::LogLevel::LL_Info, "SPFresh: Writing values to DB\n");
 
         std::vector<int> postingListSize_int(postingListSize.begin(), postingListSize.end());
 
-        WriteDownAllPostingToDB(postingListSize_int, selections, fullVectors);
+        std::vector<SizeType> order;
+        PlacementOrder(p_headIndex, (SizeType)postingListSize_int.size(), order);
+        std::vector<float> radii;
+        WriteDownAllPostingToDB(postingListSize_int, order, selections, fullVectors, radii);
+        return FinishBuild(p_headIndex, postingListSize_int, t1, &radii);
+    }
+
+    // link the selections of vectors [p_start, p_end) to their vectors and count them per vector and per posting
+    void CountReplicas(Selection& p_selections, const std::unordered_set<SizeType>& p_headIDs, SizeType p_start, SizeType p_end, std::vector<std::atomic_int>& p_replicaCount, std::vector<std::atomic_int>& p_postingListSize) {
+        for (SizeType j = p_start; j < p_end; j++) {
+            p_replicaCount[j] = 0;
+            size_t vecOffset = j * (size_t)m_opt->m_replicaCount;
+            if (p_headIDs.count(j) == 0) {
+                for (int resNum = 0; resNum < m_opt->m_replicaCount && p_selections[vecOffset + resNum].node != INT_MAX; resNum++) {
+                    ++p_postingListSize[p_selections[vecOffset + resNum].node];
+                    p_selections[vecOffset + resNum].tonode = j;
+                    ++p_replicaCount[j];
+                }
+            }
+        }
+    }
+
+    // the state FinishBuild leaves behind, read back for a resumed build whose postings are written
+    bool RestoreBuild(std::shared_ptr<SPTAG::BKT::Index<ValueType>>& p_headIndex, Options& p_opt, COMMON::VersionLabel& p_versionMap) {
+        m_versionMap = &p_versionMap;
+        m_opt = &p_opt;
+        if (m_opt->m_persistentRecords) {
+            // the mappings FinishBuild checkpointed, nothing is read up front
+            if (m_postingSizes.Map(m_opt->m_ssdInfoFile + kRecordMapSuffix, 0, p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity, false) != ErrorCode::Success ||
+                m_versionMap->Map(m_opt->m_deleteIDFile + kRecordMapSuffix, 0, p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity, false) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "Cannot map posting sizes and version labels of %s and %s\n", m_opt->m_ssdInfoFile.c_str(), m_opt->m_deleteIDFile.c_str());
+                return false;
+            }
+        } else {
+            // two unrelated files, the labels are read while the sizes are
+            ErrorCode labelRet = ErrorCode::Success;
+            std::thread labelLoader([&] { labelRet = m_versionMap->Load(m_opt->m_deleteIDFile, p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity); });
+            ErrorCode sizeRet = m_postingSizes.Load(m_opt->m_ssdInfoFile, p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity);
+            labelLoader.join();
+            if (sizeRet != ErrorCode::Success || labelRet != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "Cannot restore posting sizes from %s and version labels from %s\n", m_opt->m_ssdInfoFile.c_str(), m_opt->m_deleteIDFile.c_str());
+                return false;
+            }
+        }
+        InitGarbageRecord(m_postingSizes.GetPostingNum(), p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity);
+        return true;
+    }
+
+    // make the written postings and their block mapping durable
+    inline void PersistStorage() {
+        db->ForceCompaction();
+        if (m_vectorStore != nullptr) {
+            m_vectorStore->Flush();
+            m_vectorIO->ForceCompaction();
+        }
+    }
 
-        m_postingSizes.Initialize((SizeType)(postingListSize.size()), p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity);
+    // posting sizes and version labels of a freshly written index, with the posting radii the
+    // write measured when given
+    bool FinishBuild(std::shared_ptr<SPTAG::BKT::Index<ValueType>>& p_headIndex, const std::vector<int>& postingListSize, const std::chrono::time_point<std::chrono::high_resolution_clock>& t1, const std::vector<float>* p_radii = nullptr) {
+        InitPostingSizes((SizeType)(postingListSize.size()), p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity);
+        InitGarbageRecord((SizeType)(postingListSize.size()), p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity);
+        if (p_radii != nullptr) {
+            for (SizeType i = 0; i < (SizeType)p_radii->size(); i++) m_postingRadius.Set(i, (*p_radii)[i]);
+        }
         for (int i = 0; i < postingListSize.size(); i++) {
             m_postingSizes.UpdateSize(i, postingListSize[i]);
         }
@@ -1405,40 +2243,265 @@ class ExtraDynamicSearcher {
         return true;
     }
 
-    void WriteDownAllPostingToDB(const std::vector<int>& p_postingListSizes, Selection& p_postingSelections, std::shared_ptr<VectorSet> p_fullVectors) {
-        // #pragma omp parallel for num_threads(10)
-        std::vector<std::thread> threads;
-        std::atomic_size_t vectorsSent(0);
-        auto func = [&]() {
+    // Out-of-core BuildIndex. One pass over the vector file assigns replicas run by run, each run's
+    // edges are sorted and spilled to TmpDir. Edges carry the head's rank in the placement order,
+    // so the k-way merge of the runs yields the postings in that order, nearest first, and the
+    // posting cut is taken there; merged postings are grouped
+    // into BulkLoadBatchMB batches that writer threads serialise straight from the vector file.
+    // Memory is one run of edges, a version byte and a replica count byte per vector.
+    bool BuildPostingsStreaming(std::shared_ptr<Helper::VectorSetReader<ValueType>>& p_reader, std::shared_ptr<SPTAG::BKT::Index<ValueType>>& p_headIndex, const std::unordered_set<SizeType>& p_headIDs, SizeType p_fullCount, std::vector<int>& p_postingListSize) {
+        int replicas = m_opt->m_replicaCount;
+        bool normalize = m_opt->m_distCalcMethod == DistCalcMethod::Cosine && !p_reader->IsNormalized();
+        SizeType runVectors = (SizeType)(std::max)(((size_t)(std::max)(m_opt->m_streamingRunMB, 1) << 20) / (sizeof(Edge) * replicas), (size_t)1);
+        std::vector<std::uint8_t> replicaCount(p_fullCount, 0);
+        SelectionRuns runs(m_opt->m_tmpdir);
+        SizeType heads = p_headIndex->GetNumSamples();
+        std::vector<SizeType> order, rank(heads);
+        PlacementOrder(p_headIndex, heads, order);
+        for (SizeType i = 0; i < heads; i++) rank[order[i]] = i;
+
+        auto t1 = std::chrono::high_resolution_clock::now();
+        for (SizeType start = 0; start < p_fullCount; start += runVectors) {
+            SizeType end = (std::min)(start + runVectors, p_fullCount);
+            auto vectors = p_reader->GetVectorSet(start, end);
+            if (normalize) {
+                // normalise a private copy, the reader's slice maps the input file
+                ByteArray copy = ByteArray::Alloc(vectors->Count() * vectors->PerVectorDataSize());
+                memcpy(copy.Data(), vectors->GetData(), copy.Length());
+                vectors.reset(new BasicVectorSet(copy, GetEnumValueType<ValueType>(), vectors->Dimension(), vectors->Count()));
+                vectors->Normalize(m_opt->m_iSSDNumberOfThreads);
+            }
+            std::unordered_set<SizeType> exceptIDs;
+            for (SizeType vid : p_headIDs) {
+                if (vid >= start && vid < end)
+                    exceptIDs.insert(vid - start);
+            }
+            std::vector<Edge> edges((size_t)(end - start) * replicas);
+            p_headIndex->ApproximateRNG(vectors, exceptIDs, m_opt->m_internalResultNum, edges.data(), replicas, m_opt->m_iSSDNumberOfThreads, m_opt->m_gpuSSDNumTrees, m_opt->m_gpuSSDLeafSize, m_opt->m_rngFactor, m_opt->m_numGPUs);
+
+            size_t kept = 0;
+            for (SizeType j = start; j < end; j++) {
+                if (p_headIDs.count(j) > 0)
+                    continue;
+                size_t offset = (size_t)(j - start) * replicas;
+                for (int r = 0; r < replicas && edges[offset + r].node != INT_MAX; r++) {
+                    edges[kept] = edges[offset + r];
+                    if (edges[kept].node >= 0 && edges[kept].node < heads)
+                        edges[kept].node = rank[edges[kept].node];
+                    edges[kept++].tonode = j;
+                    replicaCount[j]++;
+                }
+            }
+            edges.resize(kept);
+            if (runs.AddRun(edges) != ErrorCode::Success)
+                return false;
+            LOG(Helper::LogLevel::LL_Info, "Streaming build: vectors (%d,%d) spilled as run %d with %zu edges\n", start, end, (int)runs.RunCount() - 1, kept);
+        }
+        auto t2 = std::chrono::high_resolution_clock::now();
+        LOG(Helper::LogLevel::LL_Info, "Searching replicas ended. Search Time: %.2lf mins\n", ((double)std::chrono::duration_cast<std::chrono::seconds>(t2 - t1).count()) / 60.0);
+
+        int postingSizeLimit = m_postingSizeLimit;
+        if (m_opt->m_postingPageLimit > 0)
+            postingSizeLimit = static_cast<int>(m_opt->m_postingPageLimit * PageSize / m_vectorInfoSize);
+        LOG(Helper::LogLevel::LL_Info, "Posting size limit: %d\n", postingSizeLimit);
+
+        LOG(Helper::LogLevel::LL_Info, "SPFresh: initialize versionMap\n");
+        InitVersionMap(p_fullCount, p_headIndex->m_iDataBlockSize, p_headIndex->m_iDataCapacity);
+
+        // merged batches wait here for a writer, at most two per writer
+        struct PostingBatch {
+            std::vector<SizeType> keys;
+            std::vector<size_t> bytes;
+            std::vector<size_t> firstEntry;
+            std::vector<SizeType> vids;
+        };
+        int writers = (std::max)(m_opt->m_bulkLoadThreadNum, 1);
+        std::mutex queueLock;
+        std::condition_variable queueCond;
+        std::deque<PostingBatch> queue;
+        bool merged = false;
+        std::atomic<bool> failed(false);
+
+        auto allVectors = p_reader->GetVectorSet();
+        auto writer = [&]() {
+            Initialize();
+            std::vector<ValueType> scratch(normalize ? allVectors->Dimension() : 0);
+            while (true) {
+                PostingBatch batch;
+                {
+                    std::unique_lock<std::mutex> lock(queueLock);
+                    queueCond.wait(lock, [&]() { return !queue.empty() || merged; });
+                    if (queue.empty())
+                        break;
+                    batch = std::move(queue.front());
+                    queue.pop_front();
+                }
+                queueCond.notify_all();
+                ErrorCode ret = db->BulkPut(batch.keys, batch.bytes, [&](size_t i, char* ptr) {
+                    for (size_t e = batch.firstEntry[i]; e < batch.firstEntry[i + 1]; e++, ptr += m_vectorInfoSize) {
+                        SizeType vid = batch.vids[e];
+                        const void* vector = allVectors->GetVector(vid);
+                        if (normalize) {
+                            memcpy(scratch.data(), vector, sizeof(ValueType) * scratch.size());
+                            COMMON::Utils::Normalize(scratch.data(), (DimensionType)scratch.size(), COMMON::Utils::GetBase<ValueType>());
+                            vector = scratch.data();
+                        }
+                        Serialize(ptr, vid, m_versionMap->GetVersion(vid), vector);
+                    }
+                });
+                if (ret != ErrorCode::Success) {
+                    LOG(Helper::LogLevel::LL_Error, "Fail to write postings %d to %d\n", batch.keys.front(), batch.keys.back());
+                    failed = true;
+                }
+            }
+            ExitBlockController();
+        };
+        std::vector<std::thread> threads;
+        for (int i = 0; i < writers; i++) threads.emplace_back(writer);
+
+        p_postingListSize.assign(heads, 0);
+        size_t batchLimit = (size_t)(std::max)(m_opt->m_bulkLoadBatchMB, 1) << 20;
+        PostingBatch batch;
+        size_t batchBytes = 0;
+        auto flush = [&]() {
+            if (batch.keys.empty())
+                return;
+            batch.firstEntry.push_back(batch.vids.size());
+            {
+                std::unique_lock<std::mutex> lock(queueLock);
+                queueCond.wait(lock, [&]() { return queue.size() < (size_t)writers * 2; });
+                queue.push_back(std::move(batch));
+            }
+            queueCond.notify_all();
+            batch = PostingBatch();
+            batchBytes = 0;
+        };
+        // every head gets a posting, heads without edges an empty one; p_node is a rank
+        SizeType nextRank = 0;
+        auto addPosting = [&](SizeType p_head, const Edge* p_edges, size_t p_count) {
+            if (batchBytes + p_count * m_vectorInfoSize > batchLimit)
+                flush();
+            batch.keys.push_back(p_head);
+            batch.bytes.push_back(p_count * m_vectorInfoSize);
+            batch.firstEntry.push_back(batch.vids.size());
+            for (size_t i = 0; i < p_count; i++) batch.vids.push_back(p_edges[i].tonode);
+            batchBytes += p_count * m_vectorInfoSize;
+            p_postingListSize[p_head] = (int)p_count;
+        };
+        ErrorCode ret = runs.Merge([&](SizeType p_node, const Edge* p_edges, size_t p_count) {
+            if (p_node < 0 || p_node >= heads)
+                return true;
+            for (; nextRank < p_node; nextRank++) addPosting(order[nextRank], nullptr, 0);
+            size_t keep = (std::min)(p_count, (size_t)postingSizeLimit);
+            for (size_t i = keep; i < p_count; i++) replicaCount[p_edges[i].tonode]--;
+            addPosting(order[p_node], p_edges, keep);
+            nextRank = p_node + 1;
+            return !failed.load();
+        });
+        for (; ret == ErrorCode::Success && nextRank < heads; nextRank++) addPosting(order[nextRank], nullptr, 0);
+        flush();
+        {
+            std::lock_guard<std::mutex> lock(queueLock);
+            merged = true;
+        }
+        queueCond.notify_all();
+        for (auto& thread : threads) thread.join();
+        runs.Clear();
+        if (ret != ErrorCode::Success || failed.load()) {
+            LOG(Helper::LogLevel::LL_Error, "Streaming build: merging %zu edges failed\n", runs.EdgeCount());
+            return false;
+        }
+
+        std::vector<int> replicaCountDist(replicas + 1, 0);
+        for (SizeType i = 0; i < p_fullCount; i++) {
+            if (p_headIDs.count(i) == 0)
+                ++replicaCountDist[replicaCount[i]];
+        }
+        LOG(Helper::LogLevel::LL_Info, "After Posting Cut:\n");
+        for (int i = 0; i < (int)replicaCountDist.size(); ++i) {
+            LOG(Helper::LogLevel::LL_Info, "Replica Count Dist: %d, %d\n", i, replicaCountDist[i]);
+        }
+        auto t3 = std::chrono::high_resolution_clock::now();
+        LOG(Helper::LogLevel::LL_Info, "Merging runs and writing postings: %.2lf mins\n", ((double)std::chrono::duration_cast<std::chrono::seconds>(t3 - t2).count()) / 60.0);
+        return true;
+    }
+
+    // the order postings are laid out on the device in: the head tree's depth-first order with
+    // CoAccessPlacement, so heads of one tree leaf, which a query tends to probe together, end up
+    // in neighbouring blocks; the head IDs otherwise
+    void PlacementOrder(std::shared_ptr<SPTAG::BKT::Index<ValueType>>& p_headIndex, SizeType p_postings, std::vector<SizeType>& p_order) {
+        if (m_opt->m_coAccessPlacement && p_headIndex->GetNumSamples() == p_postings) {
+            p_headIndex->GetTreeOrder(p_order);
+            return;
+        }
+        p_order.resize(p_postings);
+        for (SizeType i = 0; i < p_postings; i++) p_order[i] = i;
+    }
+
+    // Postings are cut into batches of about BulkLoadBatchMB that follow p_order, each writer thread
+    // serialises a batch straight into the store's write buffer and hands it to BulkPut, so the
+    // batch lands in one sequential run of blocks with the device queue kept full by the writers.
+    // p_radii gets the farthest selection of each posting, the head search distances of the entries.
+    // Those are the index distance for L2 only, postings of other metrics are left unknown
+    void WriteDownAllPostingToDB(const std::vector<int>& p_postingListSizes, const std::vector<SizeType>& p_order, Selection& p_postingSelections, std::shared_ptr<VectorSet> p_fullVectors, std::vector<float>& p_radii) {
+        bool measured = m_opt->m_distCalcMethod == DistCalcMethod::L2 && m_quantizer == nullptr;
+        p_radii.assign(p_postingListSizes.size(), MaxDist);
+        std::vector<std::pair<size_t, size_t>> batches;
+        size_t batchLimit = (size_t)(std::max)(m_opt->m_bulkLoadBatchMB, 1) << 20;
+        for (size_t first = 0; first < p_order.size();) {
+            size_t last = first, bytes = 0;
+            while (last < p_order.size() && (last == first || bytes + (size_t)m_vectorInfoSize * p_postingListSizes[p_order[last]] <= batchLimit)) {
+                bytes += (size_t)m_vectorInfoSize * p_postingListSizes[p_order[last]];
+                last++;
+            }
+            batches.emplace_back(first, last);
+            first = last;
+        }
+
+        std::vector<std::thread> threads;
+        std::atomic_size_t batchesSent(0);
+        auto func = [&]() {
             Initialize();
-            size_t index = 0;
+            std::vector<SizeType> keys;
+            std::vector<size_t> bytes;
             while (true) {
-                index = vectorsSent.fetch_add(1);
-                if (index < p_postingListSizes.size()) {
-                    std::string postinglist(m_vectorInfoSize * p_postingListSizes[index], '\0');
-                    char* ptr = (char*)postinglist.c_str();
-                    std::size_t selectIdx = p_postingSelections.lower_bound(index);
-                    for (int j = 0; j < p_postingListSizes[index]; ++j) {
-                        if (p_postingSelections[selectIdx].node != index) {
+                size_t index = batchesSent.fetch_add(1);
+                if (index >= batches.size())
+                    break;
+                keys.clear();
+                bytes.clear();
+                for (size_t pos = batches[index].first; pos < batches[index].second; pos++) {
+                    keys.push_back(p_order[pos]);
+                    bytes.push_back((size_t)m_vectorInfoSize * p_postingListSizes[p_order[pos]]);
+                }
+                ErrorCode ret = db->BulkPut(keys, bytes, [&](size_t i, char* ptr) {
+                    SizeType posting = keys[i];
+                    std::size_t selectIdx = p_postingSelections.lower_bound(posting);
+                    float radius = 0;
+                    for (int j = 0; j < p_postingListSizes[posting]; ++j) {
+                        if (p_postingSelections[selectIdx].node != posting) {
                             LOG(Helper::LogLevel::LL_Error, "Selection ID NOT MATCH\n");
                             exit(1);
                         }
+                        radius = (std::max)(radius, p_postingSelections[selectIdx].distance);
                         SizeType fullID = p_postingSelections[selectIdx++].tonode;
-                        // if (id == 0) LOG(Helper::LogLevel::LL_Info, "ID: %d\n", fullID);
                         uint8_t version = m_versionMap->GetVersion(fullID);
                         // First Vector ID, then version, then Vector
                         Serialize(ptr, fullID, version, p_fullVectors->GetVector(fullID));
                         ptr += m_vectorInfoSize;
                     }
-                    db->Put(index, postinglist);
-                } else {
-                    ExitBlockController();
-                    return;
+                    if (measured)
+                        p_radii[posting] = radius;
+                });
+                if (ret != ErrorCode::Success) {
+                    LOG(Helper::LogLevel::LL_Error, "Fail to write postings %d to %d\n", keys.front(), keys.back());
+                    exit(1);
                 }
             }
+            ExitBlockController();
         };
 
-        for (int j = 0; j < 20; j++) {
+        for (int j = 0; j < (std::max)(m_opt->m_bulkLoadThreadNum, 1); j++) {
             threads.emplace_back(func);
         }
         for (auto& thread : threads) {
@@ -1446,28 +2509,86 @@ class ExtraDynamicSearcher {
         }
     }
 
-    ErrorCode AddIndex(std::shared_ptr<VectorSet>& p_vectorSet, std::shared_ptr<SPTAG::BKT::Index<ValueType>> p_index, SizeType begin) {
-        for (int v = 0; v < p_vectorSet->Count(); v++) {
-            SizeType VID = begin + v;
-            std::vector<Edge> selections(static_cast<size_t>(m_opt->m_replicaCount));
-            int replicaCount;
-            RNGSelection(selections, (ValueType*)(p_vectorSet->GetVector(v)), p_index.get(), VID, replicaCount);
+    // Head searches for the whole batch run first, then the entries are grouped by target head so
+    // every head gets one locked Merge per chunk instead of one per vector. A chunk holds at most
+    // m_mergeThreshold entries: Append only makes progress when a freshly split or collected posting
+    // plus the chunk fits under m_postingSizeLimit + m_mergeThreshold.
+    // p_norms, when given, holds the norms of Cosine vectors handed in without normalizing: the head
+    // search scales its distances by them and the vectors are normalized straight into the entries
+    ErrorCode AddIndex(std::shared_ptr<VectorSet>& p_vectorSet, std::shared_ptr<SPTAG::BKT::Index<ValueType>> p_index, SizeType begin, const double* p_norms = nullptr) {
+        SizeType count = p_vectorSet->Count();
+        int replicas = m_opt->m_replicaCount;
+        // the full vector goes in once, before any posting can return its VID to a rerank
+        if (m_vectorStore != nullptr) {
+            std::vector<ValueType> normalized(p_norms != nullptr ? m_opt->m_dim : 0);
+            for (SizeType v = 0; v < count; v++) {
+                const void* vector = p_vectorSet->GetVector(v);
+                if (p_norms != nullptr) {
+                    COMMON::Utils::NormalizeTo((const ValueType*)vector, normalized.data(), m_opt->m_dim, COMMON::Utils::GetBase<ValueType>(), p_norms[v]);
+                    vector = normalized.data();
+                }
+                ErrorCode ret = m_vectorStore->Put(begin + v, vector);
+                if (ret != ErrorCode::Success)
+                    return ret;
+            }
+        }
+        std::vector<Edge> selections((size_t)count * replicas);
+        std::vector<int> replicaCounts(count, 0);
+#pragma omp parallel for num_threads(m_opt->m_insertThreadNum) schedule(dynamic) if (count > 1)
+        for (SizeType v = 0; v < count; v++) {
+            std::vector<Edge> selection(static_cast<size_t>(replicas));
+            RNGSelection(selection, (ValueType*)(p_vectorSet->GetVector(v)), p_index.get(), begin + v, replicaCounts[v], -1, p_norms != nullptr ? p_norms[v] : 0);
+            std::copy(selection.begin(), selection.begin() + replicaCounts[v], selections.begin() + (size_t)v * replicas);
+        }
 
-            uint8_t version = m_versionMap->GetVersion(VID);
-            std::string appendPosting(m_vectorInfoSize, '\0');
-            Serialize((char*)(appendPosting.c_str()), VID, version, p_vectorSet->GetVector(v));
-            for (int i = 0; i < replicaCount; i++) {
-                // AppendAsync(selections[i].node, 1, appendPosting_ptr);
-                Append(p_index.get(), selections[i].node, 1, appendPosting);
+        // (head, vector) pairs sorted by head, each run of one head is a bucket
+        std::vector<std::pair<SizeType, SizeType>> targets;
+        targets.reserve(selections.size());
+        for (SizeType v = 0; v < count; v++) {
+            for (int i = 0; i < replicaCounts[v]; i++) targets.emplace_back(selections[(size_t)v * replicas + i].node, v);
+        }
+        std::sort(targets.begin(), targets.end());
+
+        std::vector<std::pair<size_t, size_t>> chunks;
+        size_t chunkLimit = (size_t)(std::max)(m_mergeThreshold.load(), 1);
+        for (size_t first = 0; first < targets.size();) {
+            size_t last = first + 1;
+            while (last < targets.size() && last - first < chunkLimit && targets[last].first == targets[first].first) last++;
+            chunks.emplace_back(first, last);
+            first = last;
+        }
+
+        ErrorCode ret = ErrorCode::Success;
+#pragma omp parallel for num_threads(m_opt->m_insertThreadNum) schedule(dynamic) if (chunks.size() > 1)
+        for (size_t c = 0; c < chunks.size(); c++) {
+            size_t first = chunks[c].first, last = chunks[c].second;
+            std::string appendPosting((last - first) * m_vectorInfoSize, '\0');
+            char* ptr = (char*)(appendPosting.c_str());
+            for (size_t i = first; i < last; i++, ptr += m_vectorInfoSize) {
+                SizeType VID = begin + targets[i].second;
+                Serialize(ptr, VID, m_versionMap->GetVersion(VID), p_vectorSet->GetVector(targets[i].second), p_norms != nullptr ? p_norms[targets[i].second] : 0);
+            }
+            // a deleted head hands its entries to the reassign pool, only a failed write is an error
+            ErrorCode appendRet = Append(p_index.get(), targets[first].first, (int)(last - first), appendPosting);
+            if (appendRet != ErrorCode::Success && appendRet != ErrorCode::Undefined) {
+#pragma omp critical
+                ret = appendRet;
             }
         }
-        return ErrorCode::Success;
+        return ret;
     }
 
     SizeType SearchVector(std::shared_ptr<VectorSet>& p_vectorSet, std::shared_ptr<SPTAG::BKT::Index<ValueType>> p_index, int testNum = 64, SizeType VID = -1) {
         QueryResult queryResults(p_vectorSet->GetVector(0), testNum, false);
         p_index->SearchIndex(queryResults);
 
+        // PQ codes are lossy, a vector is found when its code matches the query's
+        std::string code;
+        if (m_quantizer != nullptr) {
+            code.resize(m_quantizer->CodeSize());
+            m_quantizer->Encode((const ValueType*)queryResults.GetTarget(), (std::uint8_t*)&code[0]);
+        }
+
         std::set<SizeType> checked;
         std::string postingList;
         for (int i = 0; i < queryResults.GetResultNum(); ++i) {
@@ -1483,6 +2604,11 @@ class ExtraDynamicSearcher {
                 checked.insert(vectorID);
                 if (VID != -1 && VID == vectorID)
                     LOG(Helper::LogLevel::LL_Info, "Find %d in %dth posting\n", VID, i);
+                if (m_quantizer != nullptr) {
+                    if (memcmp(vectorInfo + m_metaDataSize, code.data(), code.size()) == 0)
+                        return vectorID;
+                    continue;
+                }
                 auto distance2leaf = p_index->ComputeDistance(queryResults.GetTarget(), vectorInfo + m_metaDataSize);
                 if (distance2leaf < 1e-6)
                     return vectorID;
@@ -1491,6 +2617,81 @@ class ExtraDynamicSearcher {
         return -1;
     }
 
+    // SearchVector for a batch: the head searches run in parallel first, then every candidate head
+    // is read once per page of kSearchVectorsPage heads and its entries are matched against all
+    // queries that picked it. p_ids[i] gets the VID of vector i, -1 when it is not found.
+    void SearchVectors(std::shared_ptr<VectorSet>& p_vectorSet, std::shared_ptr<SPTAG::BKT::Index<ValueType>> p_index, std::vector<SizeType>& p_ids, int testNum = 64) {
+        SizeType count = p_vectorSet->Count();
+        p_ids.assign(count, -1);
+        size_t codeSize = m_quantizer != nullptr ? m_quantizer->CodeSize() : 0;
+        std::string codes((size_t)count * codeSize, '\0');
+        std::vector<std::pair<SizeType, SizeType>> targets((size_t)count * testNum, std::make_pair(-1, -1));
+#pragma omp parallel for num_threads(m_opt->m_insertThreadNum) schedule(dynamic) if (count > 1)
+        for (SizeType v = 0; v < count; v++) {
+            QueryResult queryResults(p_vectorSet->GetVector(v), testNum, false);
+            p_index->SearchIndex(queryResults);
+            for (int i = 0; i < queryResults.GetResultNum(); i++) {
+                SizeType head = queryResults.GetResult(i)->VID;
+                if (head >= 0)
+                    targets[(size_t)v * testNum + i] = std::make_pair(head, v);
+            }
+            if (m_quantizer != nullptr)
+                m_quantizer->Encode((const ValueType*)p_vectorSet->GetVector(v), (std::uint8_t*)&codes[(size_t)v * codeSize]);
+        }
+        targets.erase(std::remove_if(targets.begin(), targets.end(), [](const std::pair<SizeType, SizeType>& p_target) { return p_target.first < 0; }), targets.end());
+        std::sort(targets.begin(), targets.end());
+
+        // runs of one head in targets
+        std::vector<SizeType> heads;
+        std::vector<size_t> runs;
+        for (size_t i = 0; i < targets.size(); i++) {
+            if (i == 0 || targets[i].first != targets[i - 1].first) {
+                heads.push_back(targets[i].first);
+                runs.push_back(i);
+            }
+        }
+        runs.push_back(targets.size());
+
+        std::vector<std::string> postingLists;
+        for (size_t page = 0; page < heads.size(); page += kSearchVectorsPage) {
+            size_t pageEnd = (std::min)(page + kSearchVectorsPage, heads.size());
+            std::vector<SizeType> pageHeads(heads.begin() + page, heads.begin() + pageEnd);
+            if (db->MultiGet(pageHeads, &postingLists) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "SearchVectors: cannot read %d postings\n", (int)pageHeads.size());
+                continue;
+            }
+            std::vector<std::vector<std::pair<SizeType, SizeType>>> found(pageHeads.size());
+#pragma omp parallel for num_threads(m_opt->m_insertThreadNum) schedule(dynamic)
+            for (size_t h = 0; h < pageHeads.size(); h++) {
+                size_t first = runs[page + h], last = runs[page + h + 1];
+                auto& postingList = postingLists[h];
+                int vectorNum = (int)(postingList.size() / m_vectorInfoSize);
+                for (int j = 0; j < vectorNum; j++) {
+                    char* vectorInfo = postingList.data() + (size_t)j * m_vectorInfoSize;
+                    int vectorID = *(reinterpret_cast<int*>(vectorInfo));
+                    if (m_versionMap->Deleted(vectorID))
+                        continue;
+                    for (size_t t = first; t < last; t++) {
+                        SizeType v = targets[t].second;
+                        // p_ids only changes between pages
+                        if (p_ids[v] != -1)
+                            continue;
+                        bool match = m_quantizer != nullptr ? memcmp(vectorInfo + m_metaDataSize, &codes[(size_t)v * codeSize], codeSize) == 0
+                                                            : p_index->ComputeDistance(p_vectorSet->GetVector(v), vectorInfo + m_metaDataSize) < 1e-6;
+                        if (match)
+                            found[h].emplace_back(v, vectorID);
+                    }
+                }
+            }
+            for (auto& matches : found) {
+                for (auto& match : matches) {
+                    if (p_ids[match.first] == -1)
+                        p_ids[match.first] = match.second;
+                }
+            }
+        }
+    }
+
     void ForceGC(SPTAG::BKT::Index<ValueType>* p_index) {
         for (int i = 0; i < p_index->GetNumSamples(); i++) {
             if (!p_index->ContainSample(i))
@@ -1500,31 +2701,157 @@ class ExtraDynamicSearcher {
     }
 
     bool AllFinished() {
-        return m_splitThreadPool->allClear() && m_reassignThreadPool->allClear();
+        return m_jobPool->allClear();
+    }
+
+    // Admission control for inserts. Once InsertHighWatermark background jobs are queued, inserts
+    // wait until the queue drains to the low watermark, so splits catch up before postings grow
+    // far past their limit. An insert that waits longer than p_timeoutMs (-1: no limit) fails with
+    // the retryable IndexBusy before anything was assigned or logged for it.
+    ErrorCode AdmitInsert(int p_timeoutMs) {
+        int high = m_opt->m_insertHighWatermark;
+        if (high <= 0)
+            return ErrorCode::Success;
+        int low = m_opt->m_insertLowWatermark > 0 ? (std::min)(m_opt->m_insertLowWatermark, high) : high / 2;
+        auto queued = [this]() {
+            int splitQueue, splitRunning, reassignQueue, reassignRunning;
+            GetJobCounts(splitQueue, splitRunning, reassignQueue, reassignRunning);
+            return splitQueue + reassignQueue;
+        };
+        if (!m_insertThrottled.load()) {
+            if (queued() < high)
+                return ErrorCode::Success;
+            m_insertThrottled = true;
+        }
+        m_stat.m_throttledInsertNum++;
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds((std::max)(p_timeoutMs, 0));
+        while (queued() > low) {
+            if (p_timeoutMs >= 0 && std::chrono::steady_clock::now() >= deadline) {
+                m_stat.m_rejectedInsertNum++;
+                return ErrorCode::IndexBusy;
+            }
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        m_insertThrottled = false;
+        return ErrorCode::Success;
     }
 
+    // split counts include merges, which run on the same pool
     void GetJobCounts(int& splitQueue, int& splitRunning, int& reassignQueue, int& reassignRunning) {
-        splitQueue = static_cast<int>(m_splitThreadPool->jobsize());
-        splitRunning = static_cast<int>(m_splitThreadPool->runningJobs());
-        reassignQueue = static_cast<int>(m_reassignThreadPool->jobsize());
-        reassignRunning = static_cast<int>(m_reassignThreadPool->runningJobs());
+        reassignQueue = static_cast<int>(m_jobPool->jobsize(ReassignPriority));
+        reassignRunning = static_cast<int>(m_jobPool->runningJobs(ReassignPriority));
+        splitQueue = static_cast<int>(m_jobPool->jobsize()) - reassignQueue;
+        splitRunning = static_cast<int>(m_jobPool->runningJobs()) - reassignRunning;
     }
     void ForceCompaction() {
-        db->ForceCompaction();
+        PersistStorage();
+    }
+
+    bool HasVectorStore() const {
+        return m_vectorStore != nullptr;
+    }
+
+    // the stored full vectors of p_vids into consecutive rows of p_vectors, see VectorStore::MultiGet
+    ErrorCode GetFullVectors(const std::vector<SizeType>& p_vids, ValueType* p_vectors, std::vector<bool>& p_found) {
+        if (m_vectorStore == nullptr)
+            return ErrorCode::Fail;
+        return m_vectorStore->MultiGet(p_vids, (char*)p_vectors, p_found);
     }
     void GetDBStats() {
         db->GetStat();
-        LOG(Helper::LogLevel::LL_Info, "remain splitJobs: %d, reassignJobs: %d, running split: %d, running reassign: %d\n", m_splitThreadPool->jobsize(), m_reassignThreadPool->jobsize(), m_splitThreadPool->runningJobs(), m_reassignThreadPool->runningJobs());
+        int splitQueue, splitRunning, reassignQueue, reassignRunning;
+        GetJobCounts(splitQueue, splitRunning, reassignQueue, reassignRunning);
+        LOG(Helper::LogLevel::LL_Info, "remain splitJobs: %d, reassignJobs: %d, running split: %d, running reassign: %d\n", splitQueue, reassignQueue, splitRunning, reassignRunning);
     }
 
     void GetIndexStats(int finishedInsert, bool cost, bool reset) {
         m_stat.PrintStat(finishedInsert, cost, reset);
     }
 
+    // counters of the update path, background job queues, stage latencies and the posting length
+    // distribution in the Prometheus text format. Safe to run next to searches and updates, the
+    // plain counters may be read while being written and the stage histograms never reset
+    void CollectMetrics(Helper::MetricsWriter& p_writer, SPTAG::BKT::Index<ValueType>* p_index) {
+        p_writer.Counter("sptag_append_total", "Appends to postings", m_stat.m_appendTaskNum);
+        p_writer.Counter("sptag_split_total", "Posting splits", m_stat.m_splitNum);
+        p_writer.Counter("sptag_merge_total", "Posting merges", m_stat.m_mergeNum);
+        p_writer.Counter("sptag_reassign_total", "Vectors reassigned after a split", m_stat.m_reAssignNum);
+        p_writer.Counter("sptag_head_miss_total", "Appends whose head was deleted meanwhile", m_stat.m_headMiss.load());
+        p_writer.Counter("sptag_throttled_insert_total", "Inserts that waited for the background jobs", m_stat.m_throttledInsertNum.load());
+        p_writer.Counter("sptag_rejected_insert_total", "Inserts that gave up waiting with IndexBusy", m_stat.m_rejectedInsertNum.load());
+        p_writer.Counter("sptag_gc_postings_total", "Postings rewritten by the background GC", (double)m_stat.m_gcPostingNum.load());
+        p_writer.Counter("sptag_gc_reclaimed_total", "Dead entries dropped by the background GC", (double)m_stat.m_gcReclaimedNum.load());
+        p_writer.Counter("sptag_tier_moves_total", "Postings moved between storage tiers", (double)m_stat.m_tierMoveNum.load());
+
+        if (m_jobPool != nullptr) {
+            int splitQueue, splitRunning, reassignQueue, reassignRunning;
+            GetJobCounts(splitQueue, splitRunning, reassignQueue, reassignRunning);
+            p_writer.Gauge("sptag_jobs_queued", "Background jobs waiting to run", splitQueue, Helper::MetricsWriter::Label("job", "split"));
+            p_writer.Gauge("sptag_jobs_queued", "Background jobs waiting to run", reassignQueue, Helper::MetricsWriter::Label("job", "reassign"));
+            p_writer.Gauge("sptag_jobs_running", "Background jobs running", splitRunning, Helper::MetricsWriter::Label("job", "split"));
+            p_writer.Gauge("sptag_jobs_running", "Background jobs running", reassignRunning, Helper::MetricsWriter::Label("job", "reassign"));
+        }
+
+        if constexpr (kStageTiming) {
+            std::vector<double> boundsUs, bounds;
+            for (double us = 1; us <= (1 << 24); us *= 2) {
+                boundsUs.push_back(us);
+                bounds.push_back(us / 1e6);
+            }
+            StageSnapshot snapshot = m_stat.m_stages.Take(false);
+            for (int s = 0; s < kStages; s++) {
+                Stage stage = (Stage)s;
+                p_writer.Histogram("sptag_stage_seconds", "Latency of the stages of searches and updates", bounds, snapshot.CumulativeCounts(stage, boundsUs),
+                                   snapshot.TotalUs(stage) / 1e6, snapshot.Count(stage), Helper::MetricsWriter::Label("stage", StageName(s)));
+            }
+        }
+
+        if (p_index != nullptr) {
+            std::vector<double> bounds;
+            for (int length = 1; length < m_postingSizeLimit; length *= 2) bounds.push_back(length);
+            bounds.push_back(m_postingSizeLimit);
+            std::vector<std::uint64_t> cumulative(bounds.size(), 0);
+            std::uint64_t live = 0;
+            double vectors = 0;
+            for (SizeType i = 0; i < p_index->GetNumSamples(); i++) {
+                if (!p_index->ContainSample(i))
+                    continue;
+                int length = m_postingSizes.GetSize(i);
+                live++;
+                vectors += length;
+                // postings over the limit waiting for their split only show in the +Inf bucket
+                size_t bucket = std::lower_bound(bounds.begin(), bounds.end(), (double)length) - bounds.begin();
+                if (bucket < bounds.size())
+                    cumulative[bucket]++;
+            }
+            std::uint64_t seen = 0;
+            for (auto& count : cumulative) count = seen += count;
+            p_writer.Gauge("sptag_postings", "Postings of live heads", (double)live);
+            p_writer.Histogram("sptag_posting_length", "Vectors per posting of live heads", bounds, cumulative, vectors, live);
+        }
+
+        db->CollectMetrics(p_writer);
+    }
+
+    // per stage latency histograms of this index, searches record theirs once done
+    inline StageRecorder& GetStageRecorder() {
+        return m_stat.m_stages;
+    }
+
     bool CheckValidPosting(SizeType postingID) {
         return m_postingSizes.GetSize(postingID) > 0;
     }
 
+    // version of a posting for readers keeping something derived from it: every append, split,
+    // merge, reassign, GC and tier move of the posting moves it, and it is odd while one runs
+    std::uint32_t PostingVersion(SizeType postingID) {
+        return m_postingLocks[postingID].ReadBegin();
+    }
+
+    bool PostingUnchanged(SizeType postingID, std::uint32_t version) {
+        return m_postingLocks[postingID].ReadValidate(version);
+    }
+
     bool Initialize() {
         return db->Initialize();
     }
@@ -1545,19 +2872,883 @@ class ExtraDynamicSearcher {
     }
 
     void InitPostingRecord(std::shared_ptr<SPTAG::BKT::Index<ValueType>> p_index) {
-        m_postingSizes.Initialize((SizeType)(p_index->GetNumSamples()), p_index->m_iDataBlockSize, p_index->m_iDataCapacity);
+        InitPostingSizes((SizeType)(p_index->GetNumSamples()), p_index->m_iDataBlockSize, p_index->m_iDataCapacity);
+        InitGarbageRecord((SizeType)(p_index->GetNumSamples()), p_index->m_iDataBlockSize, p_index->m_iDataCapacity);
+    }
+
+    // postings waiting for the background GC, postings it rewrote and dead entries it dropped
+    void GetGCProgress(size_t& p_pending, std::uint64_t& p_collected, std::uint64_t& p_reclaimed) {
+        {
+            std::lock_guard<std::mutex> lock(m_gcLock);
+            p_pending = m_gcCandidates.size();
+        }
+        p_collected = m_stat.m_gcPostingNum.load();
+        p_reclaimed = m_stat.m_gcReclaimedNum.load();
+    }
+
+    // One tiering pass. The hottest postings by read heat that fit into ResidentPostingMB are kept
+    // in DRAM. With several device tiers, postings on a slower tier read at least TierPromoteHeat
+    // times (in counter steps) move to the fastest one, the hottest first, and postings gone cold on
+    // a faster tier move one tier down, up to TieringBatch moves. Returns the postings moved
+    int TierPostings(SPTAG::BKT::Index<ValueType>* p_index) {
+        std::lock_guard<std::mutex> passLock(m_tieringPassLock);
+        if (!m_tiering || !m_heat.Enabled())
+            return 0;
+        IOClassScope ioClass(IOClass::Background);
+        SizeType postingNum = (std::min)(p_index->GetNumSamples(), m_postingSizes.GetPostingNum());
+        int moved = 0, tiers = db->Tiers();
+        if (tiers > 1) {
+            std::vector<std::pair<int, SizeType>> promote;
+            std::vector<SizeType> demote;
+            for (SizeType i = 0; i < postingNum; i++) {
+                if (!p_index->ContainSample(i))
+                    continue;
+                int read = m_heat.Get(i, HeatKind::Read), tier = db->GetTier(i);
+                if (tier > 0 && read >= m_opt->m_tierPromoteHeat)
+                    promote.emplace_back(read, i);
+                else if (tier >= 0 && tier < tiers - 1 && read <= m_opt->m_tierDemoteHeat && m_heat.Get(i, HeatKind::Append) <= m_opt->m_tierDemoteHeat)
+                    demote.push_back(i);
+            }
+            std::sort(promote.begin(), promote.end(), std::greater<std::pair<int, SizeType>>());
+            for (auto& hot : promote) {
+                if (moved >= m_opt->m_tieringBatch)
+                    break;
+                moved += MovePosting(p_index, hot.second, 0);
+            }
+            for (SizeType postingID : demote) {
+                if (moved >= m_opt->m_tieringBatch)
+                    break;
+                moved += MovePosting(p_index, postingID, db->GetTier(postingID) + 1);
+            }
+        }
+        // after the moves, which rewrite their postings and drop them from DRAM
+        if (m_opt->m_residentPostingMB > 0) {
+            size_t budget = (size_t)m_opt->m_residentPostingMB << 20, used = 0;
+            std::unordered_set<SizeType> keep;
+            for (auto& hot : m_heat.Hottest(HeatKind::Read, (int)(std::min)((size_t)postingNum, budget / m_vectorInfoSize + 1), postingNum)) {
+                size_t bytes = (size_t)m_postingSizes.GetSize(hot.first) * m_vectorInfoSize;
+                if (!p_index->ContainSample(hot.first) || used + bytes > budget)
+                    continue;
+                if (db->IsResident(hot.first) || db->MakeResident(hot.first)) {
+                    keep.insert(hot.first);
+                    used += bytes;
+                }
+            }
+            for (SizeType postingID : m_residentPostings) {
+                if (keep.count(postingID) == 0)
+                    db->DropResident(postingID);
+            }
+            m_residentPostings.swap(keep);
+        }
+        return moved;
+    }
+
+    // postings of live heads on each device tier and the bytes resident in DRAM
+    void GetTierState(SPTAG::BKT::Index<ValueType>* p_index, std::vector<SizeType>& p_postings, size_t& p_residentBytes) {
+        p_postings.assign(db->Tiers(), 0);
+        for (SizeType i = 0; i < p_index->GetNumSamples(); i++) {
+            int tier = p_index->ContainSample(i) ? db->GetTier(i) : -1;
+            if (tier >= 0 && tier < (int)p_postings.size())
+                p_postings[tier]++;
+        }
+        p_residentBytes = db->ResidentBytes();
+    }
+
+    // updates changing more than one structure run inside a WriteGate::Scope of this gate: the jobs,
+    // GC and tiering take it here, the owner of the index takes it around its inserts and deletes
+    WriteGate& GetWriteGate() {
+        return m_writeGate;
+    }
+
+    // Online backup into p_dir. With updates held at the write gate, the vector store is flushed,
+    // p_saveFrozen saves the structures of the caller and names them in the manifest, the posting
+    // sizes and PQ codebooks are saved and the block mappings snapshotted. Updates then go on while
+    // a background thread streams the snapshotted postings into one Uring layout file and writes
+    // backup.ini last. IndexBusy while a backup is running
+    ErrorCode StartBackup(const std::string& p_dir, const std::function<ErrorCode(BackupManifest&)>& p_saveFrozen) {
+        std::lock_guard<std::mutex> lock(m_backupLock);
+        if (m_backupRunning.load())
+            return ErrorCode::IndexBusy;
+        if (m_backupThread.joinable())
+            m_backupThread.join();
+        if (!direxists(p_dir.c_str()))
+            mkdir(p_dir.c_str());
+        std::string dir = p_dir + FolderSep;
+        std::remove((dir + kBackupManifest).c_str());
+        std::remove((dir + kBackupData).c_str());
+
+        BackupManifest manifest;
+        manifest["Base"]["IndexDirectory"] = p_dir;
+        auto& ssd = manifest["BuildSSDIndex"];
+        ssd["StorageBackend"] = "Uring";
+        ssd["UringFilePath"] = dir + kBackupData;
+        ssd["SpdkMappingPath"] = dir + kBackupMapping;
+        ssd["SsdInfoFile"] = dir + kBackupSizes;
+        // the backup is one flat file of records saved wholesale
+        if (!m_opt->m_capacityTierPath.empty())
+            ssd["CapacityTierPath"] = "";
+        if (m_opt->m_persistentRecords)
+            ssd["PersistentRecords"] = "false";
+
+        auto freezeBegin = std::chrono::high_resolution_clock::now();
+        m_writeGate.Freeze();
+        ErrorCode ret = m_vectorStore != nullptr ? m_vectorStore->Flush() : ErrorCode::Success;
+        if (ret == ErrorCode::Success)
+            ret = p_saveFrozen(manifest);
+        if (ret == ErrorCode::Success)
+            ret = m_postingSizes.Save(dir + kBackupSizes);
+        // the entry layout lives next to the block mapping it describes
+        if (ret == ErrorCode::Success)
+            ret = m_layout.Save(dir + kBackupMapping + "_layout");
+        if (ret == ErrorCode::Success && m_quantizer != nullptr) {
+            auto ptr = SPTAG::f_createIO();
+            if (ptr == nullptr || !ptr->Initialize((dir + m_opt->m_pqCodebookFile).c_str(), std::ios::binary | std::ios::out))
+                ret = ErrorCode::FailedCreateFile;
+            else
+                ret = m_quantizer->SaveQuantizer(ptr);
+        }
+        if (ret == ErrorCode::Success)
+            ret = db->CreateSnapshot();
+        if (ret == ErrorCode::Success && m_vectorIO != nullptr && (ret = m_vectorIO->CreateSnapshot()) != ErrorCode::Success)
+            db->ReleaseSnapshot();
+        m_writeGate.Thaw();
+        double frozenMs = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - freezeBegin).count();
+        if (ret != ErrorCode::Success) {
+            LOG(Helper::LogLevel::LL_Error, "SPFresh: backup to %s failed while updates were held, error %d\n", p_dir.c_str(), (int)ret);
+            return ret;
+        }
+        LOG(Helper::LogLevel::LL_Info, "SPFresh: backup to %s held updates for %.3f ms\n", p_dir.c_str(), frozenMs);
+
+        m_backupBytes.store(0);
+        m_backupResult = ErrorCode::Success;
+        m_backupRunning.store(true);
+        m_backupThread = std::thread([this, dir, manifest]() mutable { StreamBackup(dir, manifest); });
+        return ErrorCode::Success;
+    }
+
+    // joins the running backup, if any, and returns how the last one ended
+    ErrorCode WaitBackup() {
+        std::lock_guard<std::mutex> lock(m_backupLock);
+        if (m_backupThread.joinable())
+            m_backupThread.join();
+        return m_backupResult;
+    }
+
+    void GetBackupProgress(std::uint64_t& p_bytes, bool& p_running) {
+        p_bytes = m_backupBytes.load();
+        p_running = m_backupRunning.load();
+    }
+
+    // After a load: with WarmStartPrefault the mapped block mappings, posting sizes and version
+    // labels are faulted in before returning, and the postings WarmPostingFile lists are read into
+    // the posting cache by a background thread while searches are served
+    void WarmStart() {
+        StopWarmStart();
+        if (m_opt->m_warmStartPrefault) {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            db->Prefault();
+            if (m_vectorIO != nullptr)
+                m_vectorIO->Prefault();
+            m_postingSizes.Prefault();
+            if (m_versionMap != nullptr)
+                m_versionMap->Prefault();
+            LOG(Helper::LogLevel::LL_Info, "SPFresh: prefaulted the mapped metadata in %.3lf s\n", std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t1).count());
+        }
+        if (m_opt->m_warmPostingFile.empty() || !fileexists(m_opt->m_warmPostingFile.c_str()))
+            return;
+        if (m_opt->m_spdkPostingCacheMB <= 0) {
+            LOG(Helper::LogLevel::LL_Warning, "SPFresh: no posting cache (SpdkPostingCacheMB 0) to warm from %s\n", m_opt->m_warmPostingFile.c_str());
+            return;
+        }
+        std::vector<SizeType> ids;
+        {
+            auto in = SPTAG::f_createIO();
+            SizeType count = 0;
+            if (in == nullptr || !in->Initialize(m_opt->m_warmPostingFile.c_str(), std::ios::binary | std::ios::in) ||
+                in->ReadBinary(sizeof(count), (char*)&count) != sizeof(count) || count < 0) {
+                LOG(Helper::LogLevel::LL_Warning, "SPFresh: cannot read warm postings from %s\n", m_opt->m_warmPostingFile.c_str());
+                return;
+            }
+            ids.resize(count);
+            if (in->ReadBinary(sizeof(SizeType) * ids.size(), (char*)ids.data()) != sizeof(SizeType) * ids.size()) {
+                LOG(Helper::LogLevel::LL_Warning, "SPFresh: warm posting list %s is truncated\n", m_opt->m_warmPostingFile.c_str());
+                return;
+            }
+        }
+        // postings merged away since the list was written have no size any more
+        SizeType postingNum = m_postingSizes.GetPostingNum();
+        ids.erase(std::remove_if(ids.begin(), ids.end(), [&](SizeType id) { return id < 0 || id >= postingNum || m_postingSizes.GetSize(id) <= 0; }), ids.end());
+        m_warmTotal = (SizeType)ids.size();
+        m_warmed.store(0);
+        m_warmRunning.store(true);
+        m_warmThread = std::thread([this, ids = std::move(ids)]() {
+            auto t1 = std::chrono::high_resolution_clock::now();
+            Initialize();
+            {
+                IOClassScope ioClass(IOClass::Background);
+                std::vector<SizeType> batch;
+                std::vector<PostingView> views;
+                for (size_t begin = 0; begin < ids.size() && !m_warmStop.load(); begin += kWarmBatch) {
+                    batch.assign(ids.begin() + begin, ids.begin() + (std::min)(ids.size(), begin + kWarmBatch));
+                    if (db->MultiGet(batch, &views) == ErrorCode::Success)
+                        m_warmed.fetch_add((SizeType)batch.size());
+                    db->ReleasePostingViews(&views);
+                }
+            }
+            ExitBlockController();
+            LOG(Helper::LogLevel::LL_Info, "SPFresh: warm start read %d of %d postings into the cache in %.3lf s\n", m_warmed.load(), m_warmTotal,
+                std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t1).count());
+            m_warmRunning.store(false);
+        });
+    }
+
+    // joins the warm start thread once it has gone through its list
+    void WaitWarmStart() {
+        if (m_warmThread.joinable())
+            m_warmThread.join();
+    }
+
+    void StopWarmStart() {
+        m_warmStop.store(true);
+        WaitWarmStart();
+        m_warmStop.store(false);
+    }
+
+    void GetWarmStartProgress(SizeType& p_warmed, SizeType& p_total, bool& p_running) {
+        p_warmed = m_warmed.load();
+        p_total = m_warmTotal;
+        p_running = m_warmRunning.load();
+    }
+
+    // rows of the posting store hold this many pages, PostingPageLimit cannot grow past it
+    int MaxPostingPages() const {
+        return m_maxPostingPages;
+    }
+
+    // takes up an option changed on the running index, for the ones read once at load
+    void ApplyParameter(const std::string& p_param) {
+        if (Helper::StrUtils::StrEqualIgnoreCase(p_param.c_str(), "PostingPageLimit")) {
+            int pages = (std::min)((std::max)(m_opt->m_postingPageLimit, 1), m_maxPostingPages);
+            if (pages != m_opt->m_postingPageLimit)
+                LOG(Helper::LogLevel::LL_Warning, "SPFresh: PostingPageLimit %d is beyond the %d pages the posting store was opened with\n", m_opt->m_postingPageLimit, m_maxPostingPages);
+            if (pages != m_postingPages && m_postingSizeLimit < INT_MAX / pages) {
+                m_postingSizeLimit = m_postingSizeLimit * pages / m_postingPages;
+                m_postingPages = pages;
+            }
+        } else if (Helper::StrUtils::StrEqualIgnoreCase(p_param.c_str(), "MergeThreshold")) {
+            m_mergeThreshold = m_opt->m_mergeThreshold;
+        } else if (m_jobPool != nullptr && (Helper::StrUtils::StrEqualIgnoreCase(p_param.c_str(), "AppendThreadNum") || Helper::StrUtils::StrEqualIgnoreCase(p_param.c_str(), "ReassignThreadNum"))) {
+            int workers = m_opt->m_appendThreadNum + m_opt->m_reassignThreadNum;
+            if (workers > m_jobPool->size())
+                LOG(Helper::LogLevel::LL_Warning, "SPFresh: %d background workers asked for, the pool has %d\n", workers, m_jobPool->size());
+            m_jobPool->setActive(workers);
+        }
+    }
+
+    // the update side of an AutoTuner sample: job queues, splits so far and the live posting lengths
+    void SampleTuner(TunerSample& p_sample, std::uint64_t& p_splits, SPTAG::BKT::Index<ValueType>* p_index) {
+        if (m_jobPool != nullptr) {
+            int splitRunning, reassignRunning;
+            GetJobCounts(p_sample.m_splitQueue, splitRunning, p_sample.m_reassignQueue, reassignRunning);
+        }
+        p_splits = m_stat.m_splitNum;
+        int limit = m_postingSizeLimit;
+        SizeType postingNum = m_postingSizes.GetPostingNum(), live = 0, small = 0;
+        double length = 0;
+        for (SizeType i = 0; i < postingNum; i++) {
+            if (!p_index->ContainSample(i))
+                continue;
+            int size = m_postingSizes.GetSize(i);
+            live++;
+            length += size;
+            if (size < limit / 4)
+                small++;
+        }
+        if (live > 0) {
+            p_sample.m_postingFill = length / live / limit;
+            p_sample.m_smallPostingRatio = (double)small / live;
+        }
+    }
+
+    // p_count fresh version labels, mapped with PersistentRecords and on the heap otherwise
+    void InitVersionMap(SizeType p_count, SizeType p_blockSize, SizeType p_capacity) {
+        if (m_opt->m_persistentRecords) {
+            if (m_versionMap->Map(m_opt->m_deleteIDFile + kRecordMapSuffix, p_count, p_blockSize, p_capacity, true) == ErrorCode::Success)
+                return;
+            LOG(Helper::LogLevel::LL_Warning, "SPFresh: version labels stay on the heap, saved wholesale to %s\n", m_opt->m_deleteIDFile.c_str());
+        }
+        m_versionMap->Initialize(p_count, p_blockSize, p_capacity);
+    }
+
+    // make the mapped records durable, a crash then loses at most the updates since
+    ErrorCode CheckpointRecords() {
+        ErrorCode ret = m_postingSizes.Checkpoint();
+        if (ret != ErrorCode::Success)
+            return ret;
+        return m_versionMap == nullptr ? ErrorCode::Success : m_versionMap->Checkpoint();
+    }
+
+    // takes the last checkpoint, called by the owner of the version labels before they go away
+    void StopRecordCheckpoints() {
+        {
+            std::lock_guard<std::mutex> lock(m_recordLock);
+            m_recordStop = true;
+        }
+        m_recordWake.notify_all();
+        if (m_recordThread.joinable())
+            m_recordThread.join();
     }
 
    private:
+    // the background half of StartBackup: the postings and then the full vectors go into one data
+    // file as a device shared by both stores would hold them, the snapshots are released either way
+    void StreamBackup(const std::string& p_dir, BackupManifest& p_manifest) {
+        Initialize();
+        ErrorCode ret;
+        {
+            IOClassScope ioClass(IOClass::Background);
+            ret = db->WriteSnapshot(p_dir + kBackupData, p_dir + kBackupMapping, &m_backupBytes);
+            if (ret == ErrorCode::Success && m_vectorIO != nullptr)
+                ret = m_vectorIO->WriteSnapshot(p_dir + kBackupData, p_dir + kBackupMapping + "_vectors", &m_backupBytes);
+        }
+        ExitBlockController();
+        db->ReleaseSnapshot();
+        if (m_vectorIO != nullptr)
+            m_vectorIO->ReleaseSnapshot();
+        if (ret == ErrorCode::Success) {
+            p_manifest["Backup"]["Bytes"] = std::to_string(m_backupBytes.load());
+            p_manifest["Backup"]["Complete"] = "true";
+            ret = WriteBackupManifest(p_dir + kBackupManifest, p_manifest);
+        }
+        if (ret == ErrorCode::Success)
+            LOG(Helper::LogLevel::LL_Info, "SPFresh: backup to %s complete, %llu bytes of postings\n", p_dir.c_str(), (unsigned long long)m_backupBytes.load());
+        else
+            LOG(Helper::LogLevel::LL_Error, "SPFresh: backup to %s failed, error %d\n", p_dir.c_str(), (int)ret);
+        m_backupResult = ret;
+        m_backupRunning.store(false);
+    }
+
+    // one ini section per manifest section, written through a temporary so it appears complete
+    ErrorCode WriteBackupManifest(const std::string& p_path, const BackupManifest& p_manifest) {
+        std::string tmpPath = p_path + "_tmp";
+        {
+            auto out = SPTAG::f_createIO();
+            if (out == nullptr || !out->Initialize(tmpPath.c_str(), std::ios::out))
+                return ErrorCode::FailedCreateFile;
+            for (auto& section : p_manifest) {
+                IOSTRING(out, WriteString, ("[" + section.first + "]\n").c_str());
+                for (auto& param : section.second) IOSTRING(out, WriteString, (param.first + "=" + param.second + "\n").c_str());
+                IOSTRING(out, WriteString, "\n");
+            }
+        }
+        MappingJournal::SyncFile(tmpPath);
+        if (std::rename(tmpPath.c_str(), p_path.c_str()) != 0) {
+            LOG(Helper::LogLevel::LL_Error, "Fail to rename %s to %s\n", tmpPath.c_str(), p_path.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        return ErrorCode::Success;
+    }
+
+    void InitPostingSizes(SizeType p_count, SizeType p_blockSize, SizeType p_capacity) {
+        if (m_opt->m_persistentRecords) {
+            if (m_postingSizes.Map(m_opt->m_ssdInfoFile + kRecordMapSuffix, p_count, p_blockSize, p_capacity, true) == ErrorCode::Success)
+                return;
+            LOG(Helper::LogLevel::LL_Warning, "SPFresh: posting sizes stay on the heap, saved wholesale to %s\n", m_opt->m_ssdInfoFile.c_str());
+        }
+        m_postingSizes.Initialize(p_count, p_blockSize, p_capacity);
+    }
+
+    void RecordCheckpointLoop() {
+        auto interval = std::chrono::seconds(m_opt->m_recordCheckpointSeconds);
+        std::unique_lock<std::mutex> lock(m_recordLock);
+        while (!m_recordStop) {
+            m_recordWake.wait_for(lock, interval, [this] { return m_recordStop; });
+            if (CheckpointRecords() != ErrorCode::Success)
+                LOG(Helper::LogLevel::LL_Error, "SPFresh: checkpoint of the mapped records failed\n");
+        }
+    }
+
+    void InitGarbageRecord(SizeType p_postingNum, SizeType p_blockSize, SizeType p_capacity) {
+        m_postingGarbage.Initialize(p_postingNum, p_blockSize, p_capacity);
+        for (SizeType i = 0; i < p_postingNum; i++) m_postingGarbage.UpdateSize(i, 0);
+        m_postingRadius.Initialize(p_postingNum, p_blockSize, p_capacity);
+        m_heat.Initialize(p_capacity, m_opt->m_heatSampleRate, (std::uint64_t)max(0, m_opt->m_heatAgingInterval));
+    }
+
+    inline bool GCEnabled() const {
+        return m_opt->m_update && !m_opt->m_inPlace && m_opt->m_gcRatio > 0;
+    }
+
+    // A search scanned p_total entries of a posting, p_live of them current. With the GC service
+    // the scan only records what it saw and the GC thread decides between compacting and merging,
+    // without it a posting under the merge threshold is queued for merge right away.
+    inline void NoteScan(SPTAG::BKT::Index<ValueType>* p_index, SizeType p_postingID, int p_total, int p_live) {
+        m_heat.Touch(p_postingID, HeatKind::Read);
+        if (m_tiering && m_opt->m_tieringIntervalMs > 0)
+            std::call_once(m_tieringStarted, [this, p_index] { m_tieringThread = std::thread([this, p_index] { TieringLoop(p_index); }); });
+        if (!GCEnabled()) {
+            if (p_live <= m_mergeThreshold && !m_opt->m_inPlace)
+                MergeAsync(p_index, p_postingID);
+            return;
+        }
+        if (p_total == 0)
+            return;
+        m_postingGarbage.UpdateSize(p_postingID, p_total - p_live);
+        if (p_live <= m_mergeThreshold || p_total - p_live >= m_opt->m_gcRatio * p_total)
+            QueueGC(p_index, p_postingID);
+    }
+
+    // p_dead entries of p_postingID went stale, their vectors now live in other postings
+    inline void NoteGarbage(SPTAG::BKT::Index<ValueType>* p_index, SizeType p_postingID, int p_dead) {
+        if (!GCEnabled() || p_dead == 0 || !p_index->ContainSample(p_postingID))
+            return;
+        m_postingGarbage.IncSize(p_postingID, p_dead);
+        if (m_postingGarbage.GetSize(p_postingID) >= m_opt->m_gcRatio * (std::max)(m_postingSizes.GetSize(p_postingID), 1))
+            QueueGC(p_index, p_postingID);
+    }
+
+    void QueueGC(SPTAG::BKT::Index<ValueType>* p_index, SizeType p_postingID) {
+        std::call_once(m_gcStarted, [this, p_index] { m_gcThread = std::thread([this, p_index] { GCLoop(p_index); }); });
+        bool inserted;
+        {
+            std::lock_guard<std::mutex> lock(m_gcLock);
+            inserted = m_gcCandidates.insert(p_postingID).second;
+        }
+        if (inserted)
+            m_gcWake.notify_one();
+    }
+
+    void StopGC() {
+        {
+            std::lock_guard<std::mutex> lock(m_gcLock);
+            m_gcStop = true;
+        }
+        m_gcWake.notify_all();
+        if (m_gcThread.joinable())
+            m_gcThread.join();
+    }
+
+    // Takes the queued postings in rounds, the most garbage first, and keeps the bytes it reads
+    // and writes under GCBandwidthMB per second so it does not compete with searches for the SSD.
+    void GCLoop(SPTAG::BKT::Index<ValueType>* p_index) {
+        CurrentIOClass() = IOClass::Background;
+        Initialize();
+        std::vector<std::pair<float, SizeType>> worst;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(m_gcLock);
+                while (m_gcCandidates.empty() && !m_gcStop) m_gcWake.wait(lock);
+                if (m_gcStop)
+                    break;
+                worst.clear();
+                for (SizeType postingID : m_gcCandidates) {
+                    float ratio = (float)m_postingGarbage.GetSize(postingID) / (std::max)(m_postingSizes.GetSize(postingID), 1);
+                    worst.emplace_back(ratio, postingID);
+                }
+                m_gcCandidates.clear();
+            }
+            std::sort(worst.begin(), worst.end(), std::greater<std::pair<float, SizeType>>());
+
+            double bytesPerMicrosecond = (std::max)(m_opt->m_gcBandwidthMB, 1) * 1024.0 * 1024.0 / 1e6;
+            auto roundBegin = std::chrono::steady_clock::now();
+            double spent = 0;
+            for (auto& candidate : worst) {
+                while (!m_gcStop) {
+                    double elapsed = (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - roundBegin).count();
+                    if (spent <= elapsed * bytesPerMicrosecond)
+                        break;
+                    std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                }
+                if (m_gcStop)
+                    break;
+                spent += (double)CollectGarbage(p_index, candidate.second);
+            }
+        }
+        ExitBlockController();
+    }
+
+    // drop the dead entries of one posting, a posting left under the merge threshold is merged;
+    // returns the bytes read and written
+    size_t CollectGarbage(SPTAG::BKT::Index<ValueType>* p_index, SizeType headID) {
+        WriteGate::Scope gate(&m_writeGate);
+        size_t bytes = 0;
+        int liveNum = 0;
+        {
+            std::unique_lock<COMMON::SeqLock> lock(m_postingLocks[headID]);
+            std::string postingList;
+            if (!p_index->ContainSample(headID) || db->Get(headID, &postingList) != ErrorCode::Success)
+                return 0;
+            bytes += postingList.size();
+            std::vector<int> localIndices;
+            LiveEntries(postingList, localIndices);
+            liveNum = (int)localIndices.size();
+            int deadNum = (int)(postingList.size() / m_vectorInfoSize) - liveNum;
+            if (deadNum > 0) {
+                char* ptr = (char*)(postingList.c_str());
+                for (int j = 0; j < liveNum; j++, ptr += m_vectorInfoSize) {
+                    if (j != localIndices[j])
+                        memcpy(ptr, postingList.c_str() + (size_t)localIndices[j] * m_vectorInfoSize, m_vectorInfoSize);
+                }
+                postingList.resize((size_t)liveNum * m_vectorInfoSize);
+                if (db->Put(headID, postingList) != ErrorCode::Success) {
+                    LOG(Helper::LogLevel::LL_Error, "GC fails to write back posting %d\n", headID);
+                    return bytes;
+                }
+                bytes += postingList.size();
+                m_postingSizes.UpdateSize(headID, liveNum);
+                m_stat.m_gcPostingNum++;
+                m_stat.m_gcReclaimedNum += deadNum;
+            }
+            m_postingGarbage.UpdateSize(headID, 0);
+        }
+        if (liveNum <= m_mergeThreshold)
+            MergeAsync(p_index, headID);
+        m_stat.m_gcBytes += bytes;
+        return bytes;
+    }
+
+    void StopTiering() {
+        {
+            std::lock_guard<std::mutex> lock(m_tieringLock);
+            m_tieringStop = true;
+        }
+        m_tieringWake.notify_all();
+        if (m_tieringThread.joinable())
+            m_tieringThread.join();
+    }
+
+    void TieringLoop(SPTAG::BKT::Index<ValueType>* p_index) {
+        CurrentIOClass() = IOClass::Background;
+        Initialize();
+        auto interval = std::chrono::milliseconds(m_opt->m_tieringIntervalMs);
+        std::unique_lock<std::mutex> lock(m_tieringLock);
+        while (!m_tieringStop) {
+            m_tieringWake.wait_for(lock, interval, [this] { return m_tieringStop; });
+            if (m_tieringStop)
+                break;
+            lock.unlock();
+            TierPostings(p_index);
+            lock.lock();
+        }
+        lock.unlock();
+        ExitBlockController();
+    }
+
+    // rewrite one posting onto p_tier under its lock: the store gives it new blocks there and swaps
+    // its mapping row, searches meanwhile read the old blocks or retry on the new ones. 1 if it moved
+    int MovePosting(SPTAG::BKT::Index<ValueType>* p_index, SizeType p_postingID, int p_tier) {
+        WriteGate::Scope gate(&m_writeGate);
+        std::unique_lock<COMMON::SeqLock> lock(m_postingLocks[p_postingID]);
+        std::string postingList;
+        if (!p_index->ContainSample(p_postingID) || db->GetTier(p_postingID) == p_tier || db->Get(p_postingID, &postingList) != ErrorCode::Success)
+            return 0;
+        TierScope tier(p_tier);
+        if (db->Put(p_postingID, postingList) != ErrorCode::Success) {
+            LOG(Helper::LogLevel::LL_Error, "Tiering fails to move posting %d to tier %d\n", p_postingID, p_tier);
+            return 0;
+        }
+        m_stat.m_tierMoveNum++;
+        m_stat.m_tierMoveBytes += postingList.size() * 2;
+        return 1;
+    }
+
+    // apply the storage options to the SPDK key-value store
+    void ConfigureStorage() {
+        db->SetGroupCommit(m_opt->m_spdkGroupCommit, m_opt->m_spdkGroupCommitWindow, m_opt->m_spdkGroupCommitBytes);
+        db->SetTailCache((size_t)m_opt->m_spdkTailCacheMB << 20);
+        db->SetPostingCache((size_t)m_opt->m_spdkPostingCacheMB << 20);
+        db->SetMappingJournal(m_opt->m_spdkMappingJournal, (size_t)m_opt->m_spdkJournalCheckpointMB << 20);
+        db->SetResidentPostings((size_t)max(0, m_opt->m_residentPostingMB) << 20);
+        m_tiering = db->Tiers() > 1 || m_opt->m_residentPostingMB > 0;
+        if (m_tiering && m_opt->m_heatSampleRate <= 0)
+            LOG(Helper::LogLevel::LL_Warning, "SPFresh: tiering needs the posting heat, set HeatSampleRate\n");
+    }
+
+    // the vector store keeps its own mapping next to the posting one and takes its blocks from the
+    // posting device, so both are recovered, journaled and compacted the same way
+    void ConfigureVectorStore() {
+        if (!m_opt->m_vectorStore || m_vectorStore != nullptr)
+            return;
+        if (!m_opt->m_enableADC) {
+            LOG(Helper::LogLevel::LL_Warning, "VectorStore needs EnableADC, postings keep the full vectors\n");
+            return;
+        }
+        int vectorBytes = m_opt->m_dim * sizeof(ValueType);
+        SizeType capacity = (std::max)(m_dbCapacity, (SizeType)(m_opt->m_datasetCapacity / (std::max)(1, (int)(PageSize / vectorBytes)) + 1));
+        m_vectorIO = std::make_shared<SPDKIO>((m_dbPath + "_vectors").c_str(), 1024 * 1024, capacity, VectorStore::GroupPages(vectorBytes), 1024, m_dbBatchSize, 1, BlockDevice::kMaxNumBlocks, m_dbMmapMapping, nullptr, m_postingIO);
+        m_vectorIO->SetMappingJournal(m_opt->m_spdkMappingJournal, (size_t)m_opt->m_spdkJournalCheckpointMB << 20);
+        m_vectorStore.reset(new VectorStore(m_vectorIO, vectorBytes, m_opt->m_vectorStoreOpenGroups));
+        LOG(Helper::LogLevel::LL_Info, "SPFresh: vector store of %d vectors per group\n", m_vectorStore->GroupVectors());
+    }
+
+    // every full vector of the build into the store, normalized like the ones inserts bring
+    bool BuildVectorStore(std::shared_ptr<Helper::VectorSetReader<ValueType>>& p_reader, SizeType p_fullCount) {
+        if (m_vectorStore == nullptr)
+            return true;
+        bool normalize = m_opt->m_distCalcMethod == DistCalcMethod::Cosine && !p_reader->IsNormalized();
+        SizeType chunk = (SizeType)m_vectorStore->GroupVectors() * kLayoutMigrationChunk;
+        for (SizeType start = 0; start < p_fullCount; start += chunk) {
+            SizeType end = (std::min)(start + chunk, p_fullCount);
+            auto vectors = p_reader->GetVectorSet(start, end);
+            if (normalize)
+                vectors->Normalize(m_opt->m_iSSDNumberOfThreads);
+            if (m_vectorStore->PutRange(start, end - start, [&](SizeType vid) { return vectors->GetVector(vid - start); }) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "SPFresh: fail to write vectors %d to %d into the vector store\n", start, end);
+                return false;
+            }
+        }
+        if (m_vectorStore->Flush() != ErrorCode::Success)
+            return false;
+        LOG(Helper::LogLevel::LL_Info, "SPFresh: %d vectors written to the vector store\n", p_fullCount);
+        return true;
+    }
+
+    // entry geometry of the current alignment and payload. Postings keep their page budget, so the
+    // vector limit scales with the entry size
+    void SetEntryLayout() {
+        int infoSize = PostingLayout::EntrySize(m_layout.alignment, m_vectorDataSize, m_layout.norms);
+        if (m_vectorInfoSize > 0 && m_vectorInfoSize != infoSize && m_postingSizeLimit < INT_MAX / m_vectorInfoSize)
+            m_postingSizeLimit = m_postingSizeLimit * m_vectorInfoSize / infoSize;
+        m_metaDataSize = PostingLayout::MetaSize(m_layout.alignment, m_layout.norms);
+        m_vectorInfoSize = infoSize;
+        // every Cosine entry has the norm of the base, the bound cannot tell them apart
+        m_normBound = m_layout.norms && m_opt->m_distCalcMethod != DistCalcMethod::Cosine;
+    }
+
+    // a build writes its postings in the PostingAlignment layout, a loaded index starts from the
+    // recorded one and MigrateLayout moves it over
+    bool ConfigureLayout(bool p_build) {
+        if (!PostingLayout::ValidAlignment(m_opt->m_postingAlignment)) {
+            LOG(Helper::LogLevel::LL_Error, "PostingAlignment %d is neither 0 nor a power of two from 8 to %d\n", m_opt->m_postingAlignment, PostingLayout::kMaxAlignment);
+            return false;
+        }
+        if (p_build) {
+            m_layout = PostingLayout();
+            m_layout.alignment = m_opt->m_postingAlignment;
+            m_layout.norms = m_opt->m_postingNorms;
+            if (m_layout.Save(m_layoutPath) != ErrorCode::Success)
+                return false;
+        } else if (m_layout.Load(m_layoutPath) != ErrorCode::Success) {
+            return false;
+        } else if (m_layout.norms != m_opt->m_postingNorms) {
+            LOG(Helper::LogLevel::LL_Warning, "SPFresh: PostingNorms is fixed at build, the postings are kept %s norms\n", m_layout.norms ? "with" : "without");
+        }
+        SetEntryLayout();
+        LOG(Helper::LogLevel::LL_Info, "SPFresh: posting alignment %d%s, %d bytes per entry\n", m_layout.alignment, m_layout.norms ? " with norms" : "", m_vectorInfoSize);
+        return true;
+    }
+
+    // rewrite the postings into the PostingAlignment layout in key order. Progress is recorded after
+    // every durable chunk, so an interrupted migration goes on from there and a pending one to an
+    // earlier target is finished first
+    bool MigrateLayout() {
+        while (m_layout.target >= 0 || m_layout.alignment != m_opt->m_postingAlignment) {
+            if (m_dbCompressed) {
+                LOG(Helper::LogLevel::LL_Error, "SPFresh: cannot migrate postings behind the compressed store\n");
+                return false;
+            }
+            if (m_layout.target < 0) {
+                m_layout.target = m_opt->m_postingAlignment;
+                m_layout.migrated = 0;
+            }
+            int from = m_layout.alignment, to = m_layout.target;
+            int srcInfoSize = PostingLayout::EntrySize(from, m_vectorDataSize, m_layout.norms);
+            int dstInfoSize = PostingLayout::EntrySize(to, m_vectorDataSize, m_layout.norms);
+            // compressed postings decode with the entry size they were written with
+            std::shared_ptr<KeyValueIO> src = db, dst = db;
+            if (m_opt->m_spdkPostingCompression) {
+                src = std::make_shared<CompressedKeyValueIO>(db, srcInfoSize, m_opt->m_zstdCompressLevel);
+                dst = std::make_shared<CompressedKeyValueIO>(db, dstInfoSize, m_opt->m_zstdCompressLevel);
+            }
+            SizeType bound = db->KeyBound();
+            LOG(Helper::LogLevel::LL_Info, "SPFresh: migrating postings %d to %d from alignment %d to %d\n", m_layout.migrated, bound, from, to);
+            int numThreads = (std::max)(m_opt->m_iSSDNumberOfThreads, 1);
+            for (SizeType first = m_layout.migrated; first < bound; first += kLayoutMigrationChunk) {
+                SizeType last = (std::min)(bound, first + kLayoutMigrationChunk);
+                std::atomic<SizeType> next(first);
+                std::atomic<bool> failed(false);
+                auto migrate = [&]() {
+                    Initialize();
+                    std::string posting, converted;
+                    for (SizeType key = next++; key < last && !failed; key = next++) {
+                        // unmapped keys have nothing to move
+                        if (src->Get(key, &posting) != ErrorCode::Success || posting.empty())
+                            continue;
+                        size_t count = posting.size() / srcInfoSize;
+                        converted.resize(count * dstInfoSize);
+                        PostingLayout::Convert(posting.data(), count, from, &converted[0], to, m_vectorDataSize, m_layout.norms);
+                        if (dst->Put(key, converted) != ErrorCode::Success) {
+                            LOG(Helper::LogLevel::LL_Error, "SPFresh: fail to rewrite posting %d\n", key);
+                            failed = true;
+                        }
+                    }
+                    ExitBlockController();
+                };
+                std::vector<std::thread> threads;
+                for (int i = 0; i < numThreads; i++) threads.emplace_back(migrate);
+                for (auto& thread : threads) thread.join();
+                if (failed)
+                    return false;
+                PersistStorage();
+                m_layout.migrated = last;
+                if (m_layout.Save(m_layoutPath) != ErrorCode::Success)
+                    return false;
+            }
+            m_layout.alignment = to;
+            m_layout.target = -1;
+            m_layout.migrated = 0;
+            if (m_layout.Save(m_layoutPath) != ErrorCode::Success)
+                return false;
+            LOG(Helper::LogLevel::LL_Info, "SPFresh: postings migrated to alignment %d\n", to);
+        }
+        SetEntryLayout();
+        return true;
+    }
+
+    // with SpdkPostingCompression the store is wrapped once the entry size is final. Raw postings
+    // read through the wrapper as they are, so an index written without compression can turn it on
+    void ConfigureCompression() {
+        if (!m_opt->m_spdkPostingCompression || m_dbCompressed)
+            return;
+        db = std::make_shared<CompressedKeyValueIO>(db, m_vectorInfoSize, m_opt->m_zstdCompressLevel);
+        m_dbCompressed = true;
+        LOG(Helper::LogLevel::LL_Info, "SPFresh: compressing postings of %d byte entries\n", m_vectorInfoSize);
+    }
+
+    // with EnableADC postings store PQ codes instead of vectors: train the codebooks on a sample of
+    // p_reader when building, otherwise load the saved ones. Postings keep their page budget, so the
+    // vector limit grows by the compression ratio
+    bool ConfigureQuantizer(std::shared_ptr<Helper::VectorSetReader<ValueType>> p_reader = nullptr) {
+        if (!m_opt->m_enableADC)
+            return true;
+        std::string codebookFile = m_opt->m_indexDirectory + FolderSep + m_opt->m_pqCodebookFile;
+        if (m_quantizer == nullptr) {
+            int numSubvectors = m_opt->m_pqSubvectors > 0 ? m_opt->m_pqSubvectors : COMMON::PQQuantizer::DefaultSubvectors(m_opt->m_dim);
+            if (m_opt->m_dim % numSubvectors != 0) {
+                LOG(Helper::LogLevel::LL_Error, "PQSubvectors %d does not divide dimension %d\n", numSubvectors, m_opt->m_dim);
+                return false;
+            }
+            auto quantizer = std::make_shared<COMMON::PQQuantizer>(m_opt->m_dim, numSubvectors, m_opt->m_distCalcMethod, COMMON::Utils::GetBase<ValueType>());
+            auto ptr = SPTAG::f_createIO();
+            if (p_reader != nullptr) {
+                auto fullVectors = p_reader->GetVectorSet();
+                SizeType sampleNum = min(fullVectors->Count(), (SizeType)m_opt->m_pqTrainSamples);
+                std::vector<ValueType> samples((size_t)sampleNum * m_opt->m_dim);
+                std::mt19937 rng(0);
+                std::uniform_int_distribution<SizeType> pick(0, fullVectors->Count() - 1);
+                for (SizeType i = 0; i < sampleNum; i++) {
+                    SizeType vid = (sampleNum == fullVectors->Count()) ? i : pick(rng);
+                    memcpy(samples.data() + (size_t)i * m_opt->m_dim, fullVectors->GetVector(vid), sizeof(ValueType) * m_opt->m_dim);
+                }
+                if (m_opt->m_distCalcMethod == DistCalcMethod::Cosine && !p_reader->IsNormalized())
+                    COMMON::Utils::BatchNormalize(samples.data(), sampleNum, m_opt->m_dim, COMMON::Utils::GetBase<ValueType>(), m_opt->m_iSSDNumberOfThreads);
+                LOG(Helper::LogLevel::LL_Info, "Train PQ: %d subvectors on %d samples\n", numSubvectors, sampleNum);
+                quantizer->Train(samples.data(), sampleNum, m_opt->m_pqIterations, m_opt->m_iSSDNumberOfThreads);
+                if (ptr == nullptr || !ptr->Initialize(codebookFile.c_str(), std::ios::binary | std::ios::out) || quantizer->SaveQuantizer(ptr) != ErrorCode::Success) {
+                    LOG(Helper::LogLevel::LL_Error, "Failed to save PQ codebooks to %s\n", codebookFile.c_str());
+                    return false;
+                }
+            } else if (ptr == nullptr || !ptr->Initialize(codebookFile.c_str(), std::ios::binary | std::ios::in) || quantizer->LoadQuantizer(ptr) != ErrorCode::Success || quantizer->Dimension() != m_opt->m_dim) {
+                LOG(Helper::LogLevel::LL_Error, "Failed to load PQ codebooks from %s\n", codebookFile.c_str());
+                return false;
+            }
+            m_quantizer = quantizer;
+        }
+        if (m_vectorDataSize == m_quantizer->CodeSize())
+            return true;
+        m_vectorDataSize = m_quantizer->CodeSize();
+        SetEntryLayout();
+        LOG(Helper::LogLevel::LL_Info, "ADC postings: %d bytes per vector, posting size limit: %d\n", m_vectorInfoSize, m_postingSizeLimit.load());
+        return true;
+    }
+
+    // lower bound on the distance between a query and an entry from their norms alone: the dot
+    // product kernels return base^2 - q.x >= base^2 - |q||x| by Cauchy-Schwarz, and squared L2 is at
+    // least (|q| - |x|)^2. Entries whose bound is beyond the worst result are not computed
+    inline float NormBound(float p_queryNorm, float p_norm) const {
+        if (m_opt->m_distCalcMethod == DistCalcMethod::L2)
+            return (p_queryNorm - p_norm) * (p_queryNorm - p_norm);
+        return m_baseSquare - p_queryNorm * p_norm;
+    }
+
+    // true when the entry cannot come within p_limit, with slack for the rounding of the kernels
+    inline bool NormExcludes(float p_queryNorm, const char* p_entry, float p_limit) const {
+        float norm = PostingLayout::GetNorm(p_entry);
+        return NormBound(p_queryNorm, norm) > p_limit + 1e-4f * (p_queryNorm + norm) * (p_queryNorm + norm);
+    }
+
+    // the norm the bound is taken against, negative when the scan goes without it
+    inline float QueryNorm(const void* p_target, const float* p_adcTable) const {
+        return m_normBound && p_adcTable == nullptr ? (float)COMMON::Utils::Norm((const ValueType*)p_target, m_opt->m_dim) : -1;
+    }
+
+    // the vector of a posting entry, reconstructed into p_scratch when postings hold PQ codes
+    inline ValueType* EntryVector(const uint8_t* p_entry, std::vector<ValueType>& p_scratch) const {
+        if (m_quantizer == nullptr)
+            return (ValueType*)(p_entry + m_metaDataSize);
+        p_scratch.resize(m_opt->m_dim);
+        m_quantizer->Decode(p_entry + m_metaDataSize, p_scratch.data());
+        return p_scratch.data();
+    }
+
+    // farthest entry of p_posting from the head p_headID, over all entries stale or not
+    float PostingRadius(SPTAG::BKT::Index<ValueType>* p_index, SizeType p_headID, const std::string& p_posting) const {
+        std::vector<ValueType> scratch;
+        const ValueType* head = (const ValueType*)p_index->GetSample(p_headID);
+        float radius = 0;
+        for (size_t offset = 0; offset + m_vectorInfoSize <= p_posting.size(); offset += m_vectorInfoSize)
+            radius = (std::max)(radius, p_index->ComputeDistance(head, EntryVector((const uint8_t*)p_posting.data() + offset, scratch)));
+        return radius;
+    }
+
+    // p_posting with its entries laid out as [VID][version][vector], decoded into p_decoded when
+    // postings hold PQ codes, so the split can cluster the postings in place
+    const uint8_t* FullPosting(std::string& p_posting, std::string& p_decoded, int& p_entrySize) const {
+        if (m_quantizer == nullptr) {
+            p_entrySize = m_vectorInfoSize;
+            return reinterpret_cast<const uint8_t*>(p_posting.data());
+        }
+        p_entrySize = m_metaDataSize + m_opt->m_dim * sizeof(ValueType);
+        size_t num = p_posting.size() / m_vectorInfoSize;
+        p_decoded.resize(num * p_entrySize);
+        for (size_t j = 0; j < num; j++) {
+            const char* entry = p_posting.data() + j * m_vectorInfoSize;
+            char* decoded = &p_decoded[j * p_entrySize];
+            memcpy(decoded, entry, m_metaDataSize);
+            m_quantizer->Decode((const uint8_t*)entry + m_metaDataSize, (ValueType*)(decoded + m_metaDataSize));
+        }
+        return reinterpret_cast<const uint8_t*>(p_decoded.data());
+    }
+
+    std::shared_ptr<COMMON::PQQuantizer> m_quantizer;
+
+    COMMON::DistanceBatchReturn<ValueType> m_distanceBatch = nullptr;
+
     int m_metaDataSize = 0;
 
+    // bytes of the vector or PQ code in an entry, without the padding of aligned layouts
+    int m_vectorDataSize = 0;
+
     int m_vectorInfoSize = 0;
 
-    int m_postingSizeLimit = INT_MAX;
+    PostingLayout m_layout;
+    std::string m_layoutPath;
+    static constexpr SizeType kLayoutMigrationChunk = 1 << 16;
+
+    // the entries carry norms and the metric makes a bound of them, see NormBound
+    bool m_normBound = false;
+    // what the dot product kernels subtract the dot product from
+    float m_baseSquare = 1;
+
+    // vectors a posting holds before it splits, for m_postingPages pages of at most the
+    // m_maxPostingPages the store's rows are sized for. Moved at runtime by ApplyParameter
+    std::atomic<int> m_postingSizeLimit{INT_MAX};
+    int m_postingPages = 0;
+    int m_maxPostingPages = 0;
 
     std::chrono::microseconds m_hardLatencyLimit = std::chrono::microseconds::max();
 
-    int m_mergeThreshold = 10;
+    std::atomic<int> m_mergeThreshold{10};
 };
 }  // namespace SPTAG::SPANN
 #endif  // _SPTAG_SPANN_EXTRADYNAMICSEARCHER_H_
@@ -5,14 +5,32 @@
 #define _SPTAG_SPANN_EXTRASPDKCONTROLLER_H_
 
 #include "Core/Common/Dataset.h"
+#include "Core/Common/MappedFile.h"
+#include "Core/SPANN/EpochReclaimer.h"
+#include "Core/SPANN/IKeyValueIO.h"
+#include "Core/SPANN/IOClass.h"
+#include "Core/SPANN/IOTrace.h"
+#include "Core/SPANN/MappingJournal.h"
+#include "Core/SPANN/PostingCache.h"
+#include "Core/SPANN/SlotArena.h"
+#include "Core/SPANN/Snapshot.h"
+#include "Core/SPANN/StageLatency.h"
 #include "Helper/ThreadPool.h"
+#include <algorithm>
 #include <cstdlib>
 #include <memory>
+#include <limits>
 #include <atomic>
 #include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <unordered_map>
+#include <thread>
 #include <iostream>
 #include <tbb/concurrent_queue.h>
 #include <tbb/concurrent_hash_map.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 extern "C" {
 #include "spdk/env.h"
@@ -23,32 +41,75 @@ extern "C" {
 }
 
 namespace SPTAG::SPANN {
-typedef std::int64_t AddressType;
-class SPDKIO {
-    class BlockController {
-       public:
-        static constexpr AddressType kMaxNumBlocks = 1700 * 1024 * 256;  // 1.7T
 
+// Posting store keeping a block mapping (posting id -> address array) in DRAM over a BlockDevice.
+// The device defaults to the SPDK BlockController below.
+class SPDKIO : public KeyValueIO {
+    class BlockController : public BlockDevice {
        private:
         static constexpr const char* kSpdkConfEnv = "SPFRESH_SPDK_CONF";
         static constexpr const char* kSpdkBdevNameEnv = "SPFRESH_SPDK_BDEV";
         static constexpr const char* kSpdkIoDepth = "SPFRESH_SPDK_IO_DEPTH";
+        static constexpr const char* kSpdkMaxIoPages = "SPFRESH_SPDK_MAX_IO_PAGES";
+        static constexpr const char* kSpdkReactors = "SPFRESH_SPDK_REACTORS";
+        static constexpr const char* kSpdkReactorMask = "SPFRESH_SPDK_REACTOR_MASK";
+        static constexpr const char* kSpdkWaitMode = "SPFRESH_SPDK_WAIT_MODE";
+        static constexpr const char* kSpdkWaitSpinRounds = "SPFRESH_SPDK_WAIT_SPIN_ROUNDS";
+        // comma separated foreground,update,background commands in flight per reactor, 0 for no limit
+        static constexpr const char* kSpdkClassDepth = "SPFRESH_SPDK_CLASS_DEPTH";
+        static constexpr const char* kSpdkClassBudget = "SPFRESH_SPDK_CLASS_BUDGET";
+        static constexpr int kSsdSpdkDefaultWaitSpinRounds = 2048;
+        static constexpr std::chrono::microseconds kSsdSpdkMaxBlockWait = std::chrono::microseconds(1000);
         static constexpr int kSsdSpdkDefaultIoDepth = 1024;
+        static constexpr int kSsdSpdkDefaultMaxIoPages = 32;
 
-        tbb::concurrent_queue<AddressType> m_blockAddresses;
-
-        const char* m_ssdSpdkBdevName = nullptr;
+        // one bdev of the store. The block address space is cut into consecutive ranges, one per
+        // device, so a block address names its device and the block on it
+        struct Device {
+            std::string name;
+            struct spdk_bdev* bdev = nullptr;
+            struct spdk_bdev_desc* desc = nullptr;
+            AddressType base = 0;
+            AddressType blocks = 0;
+            // commands submitted and not completed yet, the load the allocator balances against
+            std::atomic<int> inflight{0};
+            std::atomic<std::uint64_t> completedPages{0};
+        };
+        // SPFRESH_SPDK_BDEV holds a comma separated list of bdev names
+        std::vector<std::unique_ptr<Device>> m_devices;
         pthread_t m_ssdSpdkTid;
         volatile bool m_ssdSpdkThreadStartFailed = false;
         volatile bool m_ssdSpdkThreadReady = false;
         volatile bool m_ssdSpdkThreadExiting = false;
-        struct spdk_bdev* m_ssdSpdkBdev = nullptr;
-        struct spdk_bdev_desc* m_ssdSpdkBdevDesc = nullptr;
-        struct spdk_io_channel* m_ssdSpdkBdevIoChannel = nullptr;
+        volatile bool m_ssdSpdkStopped = false;
+        struct spdk_thread* m_ssdSpdkAppThread = nullptr;
+
+        int m_ssdSpdkNumReactors = 1;
+        std::string m_ssdSpdkReactorMask;
+        std::atomic<int> m_readyReactors{0};
+        std::atomic<int> m_exitedReactors{0};
 
         int m_ssdSpdkIoDepth = kSsdSpdkDefaultIoDepth;
+        // upper bound of pages merged into one readv/writev command, 1 disables merging
+        int m_ssdSpdkMaxIoPages = kSsdSpdkDefaultMaxIoPages;
+
+        // how a client thread waits for its completions:
+        // spin: busy poll, yield: spin then yield the core, block: spin then sleep on a futex woken by the reactor
+        enum class WaitMode { Spin, Yield, Block };
+        WaitMode m_waitMode = WaitMode::Spin;
+        int m_waitSpinRounds = kSsdSpdkDefaultWaitSpinRounds;
+
+        // I/O classes: depth caps a class alone on a reactor, budget caps it while a higher class is busy
+        int m_classDepth[kIOClasses] = {0, 0, 64};
+        int m_classBudget[kIOClasses] = {0, 16, 4};
+        IOClassStats m_classStats[kIOClasses];
+        IOClassStats::Snapshot m_preClassStats[kIOClasses];
+        IOTraceWriter m_trace;
+        struct Reactor;
+        struct IoContext;
         struct SubIoRequest {
             tbb::concurrent_queue<SubIoRequest*>* completed_sub_io_requests;
+            IoContext* context;
             void* app_buff;
             void* dma_buff;
             AddressType real_size;
@@ -56,31 +117,104 @@ class SPDKIO {
             bool is_read;
             BlockController* ctrl;
             int posting_id;
+            // following pages of a merged run, only the head of a run is submitted
+            SubIoRequest* next;
+            std::vector<struct iovec> iovs;
+            // app_buff is DMA memory, transfer into it directly without dma_buff
+            bool direct;
+            Reactor* reactor;
+            // class of the issuing thread and when the run was handed to the reactor, set on the head
+            int io_class;
+            std::chrono::steady_clock::time_point submit_time;
+            // pairs the trace records of the run and the posting they name, set on the head when tracing
+            std::uint64_t trace_command;
+            std::int32_t trace_posting;
         };
-        tbb::concurrent_queue<SubIoRequest*> m_submittedSubIoRequests;
+        // lock-free ring from one client thread (producer) to its reactor (consumer)
+        struct SubmissionRing {
+            std::vector<SubIoRequest*> slots;
+            size_t mask;
+            alignas(64) std::atomic<size_t> head{0};
+            alignas(64) std::atomic<size_t> tail{0};
+
+            explicit SubmissionRing(size_t capacity) {
+                size_t cap = 1;
+                while (cap < capacity) cap <<= 1;
+                slots.resize(cap);
+                mask = cap - 1;
+            }
+
+            inline bool TryPush(SubIoRequest* p_subIo) {
+                size_t t = tail.load(std::memory_order_relaxed);
+                if (t - head.load(std::memory_order_acquire) > mask) return false;
+                slots[t & mask] = p_subIo;
+                tail.store(t + 1, std::memory_order_release);
+                return true;
+            }
+
+            inline bool TryPop(SubIoRequest*& p_subIo) {
+                size_t h = head.load(std::memory_order_relaxed);
+                if (h == tail.load(std::memory_order_acquire)) return false;
+                p_subIo = slots[h & mask];
+                head.store(h + 1, std::memory_order_release);
+                return true;
+            }
+        };
+        // one SPDK thread with its own I/O channel on every device, polling the rings of the client threads hashed to it
+        struct Reactor {
+            BlockController* ctrl = nullptr;
+            int id = 0;
+            struct spdk_thread* thread = nullptr;
+            std::vector<struct spdk_io_channel*> channels;
+            struct spdk_poller* poller = nullptr;
+            int inflight = 0;                  // touched on the reactor thread only
+            IOClassQueues<SubIoRequest*> queues;  // taken from the rings, waiting for their class's turn
+            std::mutex ringsMutex;
+            std::vector<SubmissionRing*> rings;
+            std::atomic<std::uint64_t> completedPages{0};
+            std::atomic<std::uint64_t> commands{0};
+        };
+        std::vector<std::unique_ptr<Reactor>> m_reactors;
+
         struct IoContext {
             std::vector<SubIoRequest> sub_io_requests;
             std::vector<SubIoRequest*> free_sub_io_requests;
             tbb::concurrent_queue<SubIoRequest*> completed_sub_io_requests;
             int in_flight = 0;
+            std::vector<PostingView> free_posting_buffers;
+            // request lists of the view reads, kept across queries
+            std::vector<SubIoRequest> read_requests;
+            std::vector<int> read_counts;
+            Reactor* reactor = nullptr;
+            std::unique_ptr<SubmissionRing> ring;
+            // bumped by the reactor after completions, the owner sleeps on it in WaitMode::Block
+            std::atomic<std::uint32_t> completion_seq{0};
+            std::atomic<bool> sleeping{false};
         };
         static thread_local struct IoContext m_currIoContext;
 
-        static int m_ssdInflight;
+        size_t m_ssdSpdkBufAlign = PageSize;
 
         std::mutex m_initMutex;
         int m_numInitCalled = 0;
 
         int m_batchSize;
-        static int m_ioCompleteCount;
-        int m_preIOCompleteCount = 0;
+        std::uint64_t m_preIOCompleteCount = 0;
+        std::uint64_t m_preIOCommandCount = 0;
         std::chrono::time_point<std::chrono::high_resolution_clock> m_preTime = std::chrono::high_resolution_clock::now();
 
         static void* InitializeSpdk(void* args);
 
         static void SpdkStart(void* args);
 
-        static void SpdkIoLoop(void* arg);
+        static void SpdkReactorStart(void* arg);
+
+        static int SpdkReactorPoll(void* arg);
+
+        static void SpdkReactorStop(Reactor* reactor);
+
+        // returns false if the bdev ran out of spdk_bdev_io and the request has to be retried
+        static bool SpdkSubmit(Reactor* reactor, SubIoRequest* currSubIo);
 
         static void SpdkBdevEventCallback(enum spdk_bdev_event_type type, struct spdk_bdev* bdev, void* event_ctx);
 
@@ -88,33 +222,104 @@ class SPDKIO {
 
         static void SpdkStop(void* args);
 
+        inline int DeviceOf(AddressType p_block) const {
+            return m_devices.size() == 1 ? 0 : m_blockAllocator.DomainOf(p_block);
+        }
+
+        // blocks from p_block to the end of its device, a command never crosses devices
+        inline AddressType BlocksToDeviceEnd(AddressType p_block) const {
+            if (m_devices.size() == 1) return (std::numeric_limits<AddressType>::max)();
+            const Device& device = *m_devices[DeviceOf(p_block)];
+            return device.base + device.blocks - p_block;
+        }
+
+        // number of blocks from p_data[0] with consecutive addresses on one device, at most p_limit
+        inline int ContiguousBlocks(const AddressType* p_data, int p_limit) const {
+            p_limit = (int)(std::min)((AddressType)p_limit, BlocksToDeviceEnd(p_data[0]));
+            int runLength = 1;
+            while (runLength < p_limit && p_data[runLength] == p_data[0] + runLength) runLength++;
+            return runLength;
+        }
+
+        // hand a sub I/O run to the reactor of the calling thread
+        inline void Submit(SubIoRequest* p_subIo) {
+            StageSpan span(Stage::IOSubmit);
+            p_subIo->io_class = (int)CurrentIOClass();
+            p_subIo->submit_time = std::chrono::steady_clock::now();
+            if (m_trace.Enabled()) {
+                std::uint32_t pages = 0;
+                for (SubIoRequest* s = p_subIo; s != nullptr; s = s->next) pages++;
+                p_subIo->trace_command = m_trace.NextCommand();
+                p_subIo->trace_posting = CurrentIOTraceTag().Of(p_subIo->posting_id);
+                m_trace.Record(IOTraceEvent::Submit, p_subIo->trace_command, p_subIo->is_read ? IOTraceOp::Read : IOTraceOp::Write, p_subIo->io_class, DeviceOf(p_subIo->offset >> PageSizeEx), p_subIo->offset, pages * PageSize, p_subIo->trace_posting);
+            }
+            while (!m_currIoContext.ring->TryPush(p_subIo))
+                ;
+        }
+
+        // called by a client thread when a round of its submit/complete loop made no progress
+        void WaitForCompletion(int& p_idleRounds, const std::chrono::microseconds& p_remain);
+
+        // wake the owner of p_context if it sleeps on its completions
+        static void NotifyCompletion(IoContext* p_context);
+
+        // drain I/Os left behind by a previous timeout
+        void ClearTimeoutIOs();
+
+        // submit sub I/Os in batches and complete them, subIoRequestCount[posting_id] counts the unfinished pages of each posting.
+        // p_onPostingDone, if set, is called with a posting_id once its last page is in
+        void ExecuteSubIoRequests(std::vector<SubIoRequest>& subIoRequests, std::vector<int>& subIoRequestCount, const std::chrono::time_point<std::chrono::high_resolution_clock>& startTime, const std::chrono::microseconds& timeout, const std::function<void(int)>& p_onPostingDone = std::function<void(int)>());
+
+        // take a thread-local DMA buffer of at least p_pages pages
+        PostingView AcquirePostingBuffer(AddressType p_pages);
+
+        // one page of a write batch, src is DMA memory when the batch is written directly
+        struct WritePage {
+            AddressType block;
+            const char* src;
+            AddressType size;
+        };
+
+        // submit the pages in merged runs of adjacent blocks and wait for all of them
+        bool ExecuteWrites(const std::vector<WritePage>& p_pages, bool p_direct);
+
        public:
-        bool Initialize(int batchSize, AddressType maxBlocks = kMaxNumBlocks);
+        bool Initialize(int batchSize, AddressType maxBlocks = kMaxNumBlocks) override;
 
-        // get p_size blocks from front, and fill in p_data array
-        bool GetBlocks(AddressType* p_data, int p_size);
+        bool ReadBlocks(AddressType* p_data, std::string* p_value, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override;
 
-        // release p_size blocks, put them at the end of the queue
-        bool ReleaseBlocks(AddressType* p_data, int p_size);
+        bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<std::string>* p_values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override;
 
-        // read a posting list. p_data[0] is the total data size,
-        // p_data[1], p_data[2], ..., p_data[((p_data[0] + PageSize - 1) >> PageSizeEx)] are the addresses of the blocks
-        // concat all the block contents together into p_value string.
-        bool ReadBlocks(AddressType* p_data, std::string* p_value, const std::chrono::microseconds& timeout = std::chrono::microseconds::max());
+        // the views point into pinned DMA buffers
+        bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<PostingView>* p_views, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override;
 
-        // parallel read a list of posting lists.
-        bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<std::string>* p_values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max());
+        using BlockDevice::ReadBlocks;
 
-        // write p_value into p_size blocks start from p_data
-        bool WriteBlocks(AddressType* p_data, int p_size, const std::string& p_value);
+        void ReleaseViews(std::vector<PostingView>* p_views) override;
 
-        bool IOStatistics();
+        using BlockDevice::WriteBlocks;
 
-        bool ShutDown();
+        bool WriteBlocks(std::vector<AddressType*>& p_data, std::vector<int>& p_sizes, std::vector<const std::string*>& p_values) override;
 
-        int RemainBlocks() {
-            return m_blockAddresses.unsafe_size();
-        }
+        // DMA buffer from the same thread-local pool as the read views
+        PostingView AcquireWriteBuffer(AddressType p_pages) override;
+
+        bool WriteBlocksDirect(const AddressType* p_blocks, AddressType p_pages, const char* p_buffer) override;
+
+        bool IOStatistics() override;
+
+        void CollectMetrics(Helper::MetricsWriter& p_writer) override;
+
+        bool ShutDown() override;
+    };
+
+    // a Put/Merge waiting in the group commit stage
+    struct PendingWrite {
+        AddressType* blocks;
+        int size;
+        const std::string* value;
+        bool done = false;
+        bool success = false;
     };
 
     class CompactionJob : public Helper::ThreadPool::Job {
@@ -127,26 +332,41 @@ class SPDKIO {
         ~CompactionJob() {}
 
         inline void exec(IAbortOperation* p_abort) override {
+            IOClassScope ioClass(IOClass::Background);
             m_spdkIO->ForceCompaction();
         }
     };
 
    public:
-    SPDKIO(const char* filePath, SizeType blockSize, SizeType capacity, SizeType postingBlocks, SizeType bufferSize = 1024, int batchSize = 64, int compactionThreads = 1, AddressType maxBlocks = BlockController::kMaxNumBlocks) {
+    // a device of its own on the SPDK environment, for stores placed on a shared BlockPool
+    static std::shared_ptr<BlockDevice> CreateDevice() {
+        return std::make_shared<BlockController>();
+    }
+
+    // with p_deviceOwner the store keeps its own mapping at filePath but takes its blocks from the
+    // device of p_deviceOwner, which stays in charge of starting and stopping it and outlives this one
+    SPDKIO(const char* filePath, SizeType blockSize, SizeType capacity, SizeType postingBlocks, SizeType bufferSize = 1024, int batchSize = 64, int compactionThreads = 1, AddressType maxBlocks = BlockDevice::kMaxNumBlocks, bool mmapMapping = false, std::shared_ptr<BlockDevice> device = nullptr, SPDKIO* p_deviceOwner = nullptr) {
         m_mappingPath = std::string(filePath);
         m_blockLimit = postingBlocks + 1;
-        m_bufferLimit = bufferSize;
+        m_slots.Initialize(sizeof(AddressType) * m_blockLimit, 0);
         if (fileexists(m_mappingPath.c_str())) {
-            Load(m_mappingPath, blockSize, capacity);
+            if (!mmapMapping || LoadMapped(m_mappingPath, blockSize, capacity) != ErrorCode::Success)
+                Load(m_mappingPath, blockSize, capacity);
         } else {
             m_pBlockMapping.Initialize(0, 1, blockSize, capacity);
         }
-        for (int i = 0; i < bufferSize; i++) {
-            m_buffer.push((uintptr_t)(new AddressType[m_blockLimit]));
-        }
         m_compactionThreadPool = std::make_shared<Helper::ThreadPool>();
         m_compactionThreadPool->init(compactionThreads);
-        m_pBlockController.Initialize(batchSize, maxBlocks);
+        if (p_deviceOwner != nullptr) {
+            m_deviceOwner = p_deviceOwner;
+            m_pBlockController = p_deviceOwner->m_pBlockController;
+            p_deviceOwner->m_deviceSharers.push_back(this);
+        } else {
+            m_pBlockController = (device != nullptr) ? device : std::make_shared<BlockController>();
+            m_pBlockController->Initialize(batchSize, maxBlocks);
+        }
+        if (m_pBlockMapping.R() > 0)
+            RecoverFreeBlocks();
         m_shutdownCalled = false;
     }
 
@@ -154,54 +374,164 @@ class SPDKIO {
         ShutDown();
     }
 
-    void ShutDown() {
+    void ShutDown() override {
         if (m_shutdownCalled) {
             return;
         }
-        Save(m_mappingPath);
-        for (int i = 0; i < m_pBlockMapping.R(); i++) {
-            if (At(i) != 0xffffffffffffffff)
-                delete[] ((AddressType*)At(i));
+        m_compactionThreadPool.reset();
+        {
+            std::lock_guard<std::mutex> lock(m_checkpointMutex);
+            // a complete snapshot supersedes the journal
+            if (Save(m_mappingPath) == ErrorCode::Success && m_journal.IsOpen()) {
+                m_journal.Close();
+                std::remove((m_mappingPath + kJournalSuffix).c_str());
+                std::remove((m_mappingPath + kOldJournalSuffix).c_str());
+            }
+        }
+        // the rows live in the slabs of m_slots or in the mapped snapshot
+        m_reclaimer.Drain();
+        m_slots.Clear();
+        if (m_mappedBase != nullptr) {
+            munmap(m_mappedBase, m_mappedLength);
+            m_mappedBase = nullptr;
         }
-        while (!m_buffer.empty()) {
-            uintptr_t ptr;
-            if (m_buffer.try_pop(ptr))
-                delete[] ((AddressType*)ptr);
+        if (m_deviceOwner != nullptr) {
+            auto& sharers = m_deviceOwner->m_deviceSharers;
+            sharers.erase(std::remove(sharers.begin(), sharers.end(), this), sharers.end());
+        } else {
+            m_pBlockController->ShutDown();
         }
-        m_pBlockController.ShutDown();
         m_shutdownCalled = true;
     }
 
+    // blocks [p_first, p_first + p_count) named by an unlinked row go back to the device, and the
+    // row to m_slots, once no reader that may have loaded the row is left. Blocks an open snapshot
+    // still reads are held back until it is released. p_lsn is the journal entry that unlinked the
+    // row: the blocks are reused only once it is durable, a replay after a crash would map them again
+    void RetireRow(AddressType* p_row, int p_first, int p_count, std::uint64_t p_lsn = 0) {
+        m_reclaimer.Retire([this, p_row, p_first, p_count, p_lsn]() {
+            if (p_count > 0 && p_lsn > 0 && !m_journal.SyncTo(p_lsn)) {
+                // leaked rather than handed out while the journal may still name them
+                LOG(Helper::LogLevel::LL_Error, "SPDKIO: journal not durable, %d blocks left unused\n", p_count);
+            } else {
+                int count = p_count > 0 ? m_snapshot.Hold(p_row + 1 + p_first, p_count) : 0;
+                if (count > 0)
+                    m_pBlockController->ReleaseBlocks(p_row + 1 + p_first, count);
+            }
+            m_slots.Retire(p_row);
+        });
+    }
+
     inline uintptr_t& At(SizeType key) {
         return *(m_pBlockMapping[key]);
     }
 
-    ErrorCode Get(SizeType key, std::string* value) {
+    // the row MultiGet reads for key, a key that was never written reads as an empty posting
+    inline AddressType* ReadRow(SizeType key) {
+        static AddressType emptyRow = 0;
+        uintptr_t row = At(key);
+        return row == 0xffffffffffffffff ? &emptyRow : (AddressType*)row;
+    }
+
+    ErrorCode Get(SizeType key, std::string* value) override {
         if (key >= m_pBlockMapping.R())
             return ErrorCode::Fail;
-        // DEBUG std::cout << "KEY: " << key << "AT: " << At(key) << std::endl;
-        if (At(key) == 0xffffffffffffffff)
+        EpochReclaimer::Guard guard(m_reclaimer);
+        IOTraceTagScope traceTag(key);
+        uintptr_t row = At(key);
+        if (row == 0xffffffffffffffff)
             return ErrorCode::Fail;
-        if (m_pBlockController.ReadBlocks((AddressType*)At(key), value))
+        if (m_pBlockController->ReadBlocks((AddressType*)row, value))
             return ErrorCode::Success;
         return ErrorCode::Fail;
     }
 
-    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) {
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        EpochReclaimer::Guard guard(m_reclaimer);
+        std::vector<SizeType> validKeys;
         std::vector<AddressType*> blocks;
         for (SizeType key : keys) {
-            if (key < m_pBlockMapping.R())
-                blocks.push_back((AddressType*)At(key));
-            else {
+            if (key < m_pBlockMapping.R()) {
+                validKeys.push_back(key);
+                blocks.push_back(ReadRow(key));
+            } else {
                 LOG(Helper::LogLevel::LL_Error, "Fail to read key:%d total key number:%d\n", key, m_pBlockMapping.R());
             }
         }
-        if (m_pBlockController.ReadBlocks(blocks, values, timeout))
+        IOTraceTagScope traceTag(validKeys.data(), validKeys.size());
+        if (m_pBlockController->ReadBlocks(blocks, values, timeout))
             return ErrorCode::Success;
         return ErrorCode::Fail;
     }
 
-    ErrorCode Put(SizeType key, const std::string& value) {
+    // zero-copy MultiGet, the views must be released by ReleasePostingViews on the calling thread
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        return MultiGet(keys, values, std::function<void(int)>(), timeout);
+    }
+
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        // the rows and the blocks they name stay in place until the reads completed
+        EpochReclaimer::Guard guard(m_reclaimer);
+        std::vector<SizeType>& validKeys = m_readKeys;
+        std::vector<AddressType*>& blocks = m_readBlocks;
+        std::vector<std::uint64_t>& generations = m_readGenerations;
+        validKeys.clear();
+        blocks.clear();
+        generations.clear();
+        bool cached = m_postingCache.Enabled();
+        for (SizeType key : keys) {
+            if (key < m_pBlockMapping.R()) {
+                validKeys.push_back(key);
+                // before the row is loaded, a write swapping it in between then voids the insert
+                if (cached)
+                    generations.push_back(m_postingCache.Generation(key));
+                blocks.push_back(ReadRow(key));
+            } else {
+                LOG(Helper::LogLevel::LL_Error, "Fail to read key:%d total key number:%d\n", key, m_pBlockMapping.R());
+            }
+        }
+        if (!cached) {
+            IOTraceTagScope traceTag(validKeys.data(), validKeys.size());
+            if (m_pBlockController->ReadBlocks(blocks, values, p_onPostingDone, timeout))
+                return ErrorCode::Success;
+            return ErrorCode::Fail;
+        }
+        return CachedMultiGet(validKeys, blocks, generations, values, p_onPostingDone, timeout);
+    }
+
+    void ReleasePostingViews(std::vector<PostingView>* values) override {
+        if (!m_pinnedPostings.empty()) {
+            for (auto& view : *values) {
+                if (view.capacity >= 0)
+                    continue;
+                auto iter = m_pinnedPostings.find(view.data);
+                if (iter != m_pinnedPostings.end() && --iter->second.second == 0)
+                    m_pinnedPostings.erase(iter);
+                view.data = nullptr;
+            }
+        }
+        m_pBlockController->ReleaseViews(values);
+    }
+
+    ErrorCode Put(SizeType key, const std::string& value) override {
+        return PutAt(key, value, -1);
+    }
+
+    // the new blocks go next to the first block of p_nearKey's posting, which may be key itself
+    ErrorCode PutNear(SizeType key, const std::string& value, SizeType p_nearKey) override {
+        AddressType nearAddress = -1;
+        if (p_nearKey >= 0 && p_nearKey < m_pBlockMapping.R()) {
+            EpochReclaimer::Guard guard(m_reclaimer);
+            uintptr_t row = At(p_nearKey);
+            if (row != 0xffffffffffffffff && ((AddressType*)row)[0] > 0)
+                nearAddress = ((AddressType*)row)[1];
+        }
+        return PutAt(key, value, nearAddress);
+    }
+
+    // Put with the blocks allocated around device address p_near, anywhere for p_near < 0
+    ErrorCode PutAt(SizeType key, const std::string& value, AddressType p_near) {
+        IOTraceTagScope traceTag(key);
         int blocks = ((value.size() + PageSize - 1) >> PageSizeEx);
         if (blocks >= m_blockLimit) {
             LOG(Helper::LogLevel::LL_Error, "Failt to put key:%d value:%lld since value too long!\n", key, value.size());
@@ -215,43 +545,146 @@ class SPDKIO {
             }
         }
         if (At(key) == 0xffffffffffffffff) {
-            if (m_buffer.unsafe_size() > m_bufferLimit) {
-                uintptr_t tmpblocks;
-                while (!m_buffer.try_pop(tmpblocks))
-                    ;
-                At(key) = tmpblocks;
-            } else {
-                At(key) = (uintptr_t)(new AddressType[m_blockLimit]);
+            uintptr_t row = (uintptr_t)m_slots.Allocate();
+            if (row == 0) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to put key:%d since no mapping slot can be allocated!\n", key);
+                return ErrorCode::MemoryOverFlow;
             }
-            memset((AddressType*)At(key), -1, sizeof(AddressType) * m_blockLimit);
+            memset((AddressType*)row, -1, sizeof(AddressType) * m_blockLimit);
+            At(key) = row;
         }
         int64_t* postingSize = (int64_t*)At(key);
+        int64_t* retired = nullptr;
         if (*postingSize < 0) {
-            m_pBlockController.GetBlocks(postingSize + 1, blocks);
-            m_pBlockController.WriteBlocks(postingSize + 1, blocks, value);
+            if (WriteNewBlocks(postingSize + 1, blocks, value, p_near) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to put key:%d since no free blocks left!\n", key);
+                return ErrorCode::DiskIOFail;
+            }
             *postingSize = value.size();
         } else {
-            uintptr_t tmpblocks;
-            while (!m_buffer.try_pop(tmpblocks))
-                ;
-            m_pBlockController.GetBlocks((AddressType*)tmpblocks + 1, blocks);
-            m_pBlockController.WriteBlocks((AddressType*)tmpblocks + 1, blocks, value);
+            uintptr_t tmpblocks = (uintptr_t)m_slots.Allocate();
+            if (tmpblocks == 0) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to put key:%d since no mapping slot can be allocated!\n", key);
+                return ErrorCode::MemoryOverFlow;
+            }
+            if (WriteNewBlocks((AddressType*)tmpblocks + 1, blocks, value, p_near) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to put key:%d since no free blocks left!\n", key);
+                m_slots.Retire((void*)tmpblocks);
+                return ErrorCode::DiskIOFail;
+            }
             *((int64_t*)tmpblocks) = value.size();
 
-            m_pBlockController.ReleaseBlocks(postingSize + 1, (*postingSize + PageSize - 1) >> PageSizeEx);
             while (InterlockedCompareExchange(&At(key), tmpblocks, (uintptr_t)postingSize) != (uintptr_t)postingSize) {
                 postingSize = (int64_t*)At(key);
             }
-            m_buffer.push((uintptr_t)postingSize);
+            retired = postingSize;
+        }
+        // the old row goes once the entry replacing it is in the journal
+        std::uint64_t lsn = JournalMapping(key);
+        if (retired != nullptr)
+            RetireRow(retired, 0, (int)((*retired + PageSize - 1) >> PageSizeEx), lsn);
+        if (m_tailCacheLimit > 0) {
+            size_t tailSize = value.size() % PageSize;
+            CacheTail(key, value.data() + value.size() - tailSize, tailSize);
+        }
+        if (m_postingCache.Enabled())
+            m_postingCache.Erase(key);
+        return ErrorCode::Success;
+    }
+
+    // The batch gets one run of blocks from the calling thread's extent and is serialised straight
+    // into a device write buffer, which goes out as merged sequential writes. Keys that already
+    // hold a posting and devices without a direct write path take the Put route.
+    ErrorCode BulkPut(const std::vector<SizeType>& p_keys, const std::vector<size_t>& p_bytes, const std::function<void(size_t, char*)>& p_fill) override {
+        std::vector<size_t> bulk, single;
+        std::vector<AddressType> firstPage;
+        AddressType totalPages = 0;
+        SizeType maxKey = -1;
+        for (size_t i = 0; i < p_keys.size(); i++) {
+            int blocks = (int)((p_bytes[i] + PageSize - 1) >> PageSizeEx);
+            if (blocks >= m_blockLimit) {
+                LOG(Helper::LogLevel::LL_Error, "Failt to put key:%d value:%lld since value too long!\n", p_keys[i], (long long)p_bytes[i]);
+                return ErrorCode::Fail;
+            }
+            if (p_keys[i] < m_pBlockMapping.R() && At(p_keys[i]) != 0xffffffffffffffff) {
+                single.push_back(i);
+                continue;
+            }
+            bulk.push_back(i);
+            firstPage.push_back(totalPages);
+            totalPages += blocks;
+            maxKey = (std::max)(maxKey, p_keys[i]);
+        }
+
+        PostingView buffer = totalPages > 0 ? m_pBlockController->AcquireWriteBuffer(totalPages) : PostingView();
+        if (buffer.data == nullptr) {
+            single.insert(single.end(), bulk.begin(), bulk.end());
+            bulk.clear();
+        }
+        if (!bulk.empty()) {
+            std::vector<AddressType> blocks(totalPages);
+            if (!m_pBlockController->GetBlocks(blocks.data(), (int)totalPages)) {
+                std::vector<PostingView> views(1, buffer);
+                m_pBlockController->ReleaseViews(&views);
+                LOG(Helper::LogLevel::LL_Error, "Fail to bulk put %d keys since no free blocks left!\n", (int)bulk.size());
+                return ErrorCode::DiskIOFail;
+            }
+            char* dst = const_cast<char*>(buffer.data);
+            for (size_t b = 0; b < bulk.size(); b++) p_fill(bulk[b], dst + firstPage[b] * PageSize);
+            std::vector<PostingView> views(1, buffer);
+            if (!m_pBlockController->WriteBlocksDirect(blocks.data(), totalPages, dst)) {
+                m_pBlockController->ReleaseViews(&views);
+                m_pBlockController->ReleaseBlocks(blocks.data(), (int)totalPages);
+                return ErrorCode::DiskIOFail;
+            }
+
+            if (maxKey + 1 > m_pBlockMapping.R()) {
+                std::lock_guard<std::mutex> lock(m_updateMutex);
+                if (maxKey + 1 > m_pBlockMapping.R())
+                    m_pBlockMapping.AddBatch(maxKey + 1 - m_pBlockMapping.R());
+            }
+            for (size_t b = 0; b < bulk.size(); b++) {
+                SizeType key = p_keys[bulk[b]];
+                uintptr_t row = (uintptr_t)m_slots.Allocate();
+                if (row == 0) {
+                    m_pBlockController->ReleaseViews(&views);
+                    LOG(Helper::LogLevel::LL_Error, "Fail to bulk put key:%d since no mapping slot can be allocated!\n", key);
+                    return ErrorCode::MemoryOverFlow;
+                }
+                AddressType* postingSize = (AddressType*)row;
+                memset(postingSize, -1, sizeof(AddressType) * m_blockLimit);
+                *postingSize = p_bytes[bulk[b]];
+                AddressType pages = (p_bytes[bulk[b]] + PageSize - 1) >> PageSizeEx;
+                memcpy(postingSize + 1, blocks.data() + firstPage[b], sizeof(AddressType) * pages);
+                At(key) = row;
+                JournalMapping(key);
+                if (m_tailCacheLimit > 0) {
+                    size_t tailSize = p_bytes[bulk[b]] % PageSize;
+                    CacheTail(key, dst + firstPage[b] * PageSize + p_bytes[bulk[b]] - tailSize, tailSize);
+                }
+                if (m_postingCache.Enabled())
+                    m_postingCache.Erase(key);
+            }
+            m_pBlockController->ReleaseViews(&views);
+        }
+
+        std::string value;
+        for (size_t i : single) {
+            value.resize(p_bytes[i]);
+            p_fill(i, &value[0]);
+            ErrorCode ret = Put(p_keys[i], value);
+            if (ret != ErrorCode::Success)
+                return ret;
         }
         return ErrorCode::Success;
     }
 
-    ErrorCode Merge(SizeType key, const std::string& value) {
+    ErrorCode Merge(SizeType key, const std::string& value) override {
         if (key >= m_pBlockMapping.R()) {
             LOG(Helper::LogLevel::LL_Error, "Key range error: key: %d, mapping size: %d\n", key, m_pBlockMapping.R());
             return ErrorCode::Fail;
         }
+        IOTraceTagScope traceTag(key);
 
         int64_t* postingSize = (int64_t*)At(key);
         auto newSize = *postingSize + value.size();
@@ -265,34 +698,58 @@ class SPDKIO {
         auto sizeInPage = (*postingSize) % PageSize;
         int oldblocks = (*postingSize >> PageSizeEx);
         int allocblocks = newblocks - oldblocks;
+        int64_t* retired = nullptr;
         if (sizeInPage != 0) {
             std::string newValue;
-            AddressType readreq[] = {sizeInPage, *(postingSize + 1 + oldblocks)};
-            m_pBlockController.ReadBlocks(readreq, &newValue);
+            // The partial tail page is rewritten together with the new bytes, take it from DRAM when cached
+            if (m_tailCacheLimit == 0 || !GetCachedTail(key, sizeInPage, &newValue)) {
+                AddressType readreq[] = {sizeInPage, *(postingSize + 1 + oldblocks)};
+                m_pBlockController->ReadBlocks(readreq, &newValue);
+            }
             newValue += value;
 
-            uintptr_t tmpblocks;
-            while (!m_buffer.try_pop(tmpblocks))
-                ;
+            uintptr_t tmpblocks = (uintptr_t)m_slots.Allocate();
+            if (tmpblocks == 0) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to merge key:%d since no mapping slot can be allocated!\n", key);
+                return ErrorCode::MemoryOverFlow;
+            }
             memcpy((AddressType*)tmpblocks, postingSize, sizeof(AddressType) * (oldblocks + 1));
-            m_pBlockController.GetBlocks((AddressType*)tmpblocks + 1 + oldblocks, allocblocks);
-            m_pBlockController.WriteBlocks((AddressType*)tmpblocks + 1 + oldblocks, allocblocks, newValue);
+            if (WriteNewBlocks((AddressType*)tmpblocks + 1 + oldblocks, allocblocks, newValue) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to merge key:%d since no free blocks left!\n", key);
+                m_slots.Retire((void*)tmpblocks);
+                return ErrorCode::DiskIOFail;
+            }
             *((int64_t*)tmpblocks) = newSize;
 
-            m_pBlockController.ReleaseBlocks(postingSize + 1 + oldblocks, 1);
             while (InterlockedCompareExchange(&At(key), tmpblocks, (uintptr_t)postingSize) != (uintptr_t)postingSize) {
                 postingSize = (int64_t*)At(key);
             }
-            m_buffer.push((uintptr_t)postingSize);
+            retired = postingSize;
+            if (m_tailCacheLimit > 0) {
+                size_t tailSize = newSize % PageSize;
+                CacheTail(key, newValue.data() + newValue.size() - tailSize, tailSize);
+            }
         } else {
-            m_pBlockController.GetBlocks(postingSize + 1 + oldblocks, allocblocks);
-            m_pBlockController.WriteBlocks(postingSize + 1 + oldblocks, allocblocks, value);
+            if (WriteNewBlocks(postingSize + 1 + oldblocks, allocblocks, value) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "Fail to merge key:%d since no free blocks left!\n", key);
+                return ErrorCode::DiskIOFail;
+            }
             *postingSize = newSize;
+            if (m_tailCacheLimit > 0) {
+                size_t tailSize = newSize % PageSize;
+                CacheTail(key, value.data() + value.size() - tailSize, tailSize);
+            }
         }
+        std::uint64_t lsn = JournalMapping(key);
+        // only the rewritten tail block is dropped, the full ones moved over to the new row
+        if (retired != nullptr)
+            RetireRow(retired, oldblocks, 1, lsn);
+        if (m_postingCache.Enabled())
+            m_postingCache.Erase(key);
         return ErrorCode::Success;
     }
 
-    ErrorCode Delete(SizeType key) {
+    ErrorCode Delete(SizeType key) override {
         if (key >= m_pBlockMapping.R())
             return ErrorCode::Fail;
         int64_t* postingSize = (int64_t*)At(key);
@@ -300,21 +757,166 @@ class SPDKIO {
             return ErrorCode::Fail;
 
         int blocks = ((*postingSize + PageSize - 1) >> PageSizeEx);
-        m_pBlockController.ReleaseBlocks(postingSize + 1, blocks);
-        m_buffer.push((uintptr_t)postingSize);
         At(key) = 0xffffffffffffffff;
+        RetireRow(postingSize, 0, blocks, JournalMapping(key));
+        if (m_tailCacheLimit > 0)
+            CacheTail(key, nullptr, 0);
+        if (m_postingCache.Enabled())
+            m_postingCache.Erase(key);
         return ErrorCode::Success;
     }
 
-    void ForceCompaction() {
-        Save(m_mappingPath);
+    SizeType KeyBound() override {
+        return m_pBlockMapping.R();
+    }
+
+    // keep the partial last page of postings in DRAM, up to p_maxBytes in total, so that
+    // Merge does not have to read it back before rewriting it. 0 disables the cache.
+    void SetTailCache(size_t p_maxBytes) override {
+        m_tailCacheLimit = p_maxBytes;
+        if (p_maxBytes > 0)
+            LOG(Helper::LogLevel::LL_Info, "SPDKIO: tail page cache enabled, budget %zu bytes\n", p_maxBytes);
+    }
+
+    size_t TailCacheBytes() const {
+        return m_tailCacheBytes.load();
+    }
+
+    // keep whole postings read by MultiGet in DRAM, up to p_maxBytes in total. Put, Merge and
+    // Delete invalidate the key, the next read caches the new content. 0 disables the cache.
+    void SetPostingCache(size_t p_maxBytes) override {
+        m_postingCache.SetCapacity(p_maxBytes);
+        if (p_maxBytes > 0)
+            LOG(Helper::LogLevel::LL_Info, "SPDKIO: posting cache enabled, budget %zu bytes\n", p_maxBytes);
+    }
+
+    const PostingCache& GetPostingCache() const {
+        return m_postingCache;
+    }
+
+    // resident postings are pinned into the posting cache, so MultiGet serves them like hits
+    void SetResidentPostings(size_t p_maxBytes) override {
+        m_postingCache.SetResidentCapacity(p_maxBytes);
+        if (p_maxBytes > 0)
+            LOG(Helper::LogLevel::LL_Info, "SPDKIO: resident postings enabled, budget %zu bytes\n", p_maxBytes);
+    }
+
+    // reads the posting and pins it, unless a write of key got in between
+    bool MakeResident(SizeType key) override {
+        if (!m_postingCache.Enabled() || key >= m_pBlockMapping.R())
+            return false;
+        std::uint64_t generation = m_postingCache.Generation(key);
+        std::string value;
+        if (Get(key, &value) != ErrorCode::Success)
+            return false;
+        return m_postingCache.Pin(key, value.data(), value.size(), generation);
+    }
+
+    bool IsResident(SizeType key) override {
+        return m_postingCache.Enabled() && m_postingCache.Resident(key);
+    }
+
+    void DropResident(SizeType key) override {
+        if (m_postingCache.Enabled())
+            m_postingCache.Unpin(key);
+    }
+
+    size_t ResidentBytes() override {
+        return m_postingCache.Enabled() ? m_postingCache.ResidentBytes() : 0;
+    }
+
+    // the rows of a mapping opened with SpdkMappingMmap are paged in on first touch otherwise
+    void Prefault() override {
+        if (m_mappedBase != nullptr)
+            COMMON::MappedFile::PrefaultRange(m_mappedBase, m_mappedLength);
     }
 
-    void GetStat() {
-        int remainBlocks = m_pBlockController.RemainBlocks();
-        int remainGB = remainBlocks >> 20 << 2;
-        LOG(Helper::LogLevel::LL_Info, "Remain %d blocks, totally %d GB\n", remainBlocks, remainGB);
-        m_pBlockController.IOStatistics();
+    int Tiers() override {
+        return m_pBlockController->Tiers();
+    }
+
+    int GetTier(SizeType key) override {
+        if (key >= m_pBlockMapping.R())
+            return -1;
+        EpochReclaimer::Guard guard(m_reclaimer);
+        uintptr_t row = At(key);
+        if (row == 0xffffffffffffffff || ((AddressType*)row)[0] < 0)
+            return -1;
+        AddressType* blocks = (AddressType*)row;
+        int tier = 0;
+        for (AddressType i = 0; i < ((blocks[0] + PageSize - 1) >> PageSizeEx); i++) tier = (std::max)(tier, m_pBlockController->TierOf(blocks[1 + i]));
+        return tier;
+    }
+
+    // Put/Merge calls arriving within p_windowUs of each other, or until p_maxBytes are pending,
+    // get their blocks allocated in one go and are written as one batch
+    void SetGroupCommit(bool p_enable, int p_windowUs, int p_maxBytes) override {
+        m_groupCommit = p_enable;
+        m_groupCommitWindow = std::chrono::microseconds(p_windowUs);
+        m_groupCommitBytes = p_maxBytes;
+        if (p_enable)
+            LOG(Helper::LogLevel::LL_Info, "SPDKIO: group commit enabled, window %dus, budget %d bytes\n", p_windowUs, p_maxBytes);
+    }
+
+    // log every mapping update to <mapping>.journal and fold the journal into the mapping snapshot
+    // once it grows beyond p_checkpointBytes. Journals left by a crash are replayed first.
+    ErrorCode SetMappingJournal(bool p_enable, size_t p_checkpointBytes) override {
+        std::lock_guard<std::mutex> lock(m_checkpointMutex);
+        m_journalCheckpointBytes = p_checkpointBytes;
+        if (!p_enable || m_journal.IsOpen())
+            return ErrorCode::Success;
+
+        std::uint64_t replayed = 0;
+        auto apply = [this](SizeType key, const AddressType* entries, int count) { ReplayMapping(key, entries, count); };
+        replayed += MappingJournal::Replay(m_mappingPath + kOldJournalSuffix, apply);
+        replayed += MappingJournal::Replay(m_mappingPath + kJournalSuffix, apply);
+        if (replayed > 0) {
+            LOG(Helper::LogLevel::LL_Info, "SPDKIO: recovered %llu mapping updates from journal\n", (unsigned long long)replayed);
+            RecoverFreeBlocks();
+        }
+        if (!m_journal.Open(m_mappingPath + kJournalSuffix))
+            return ErrorCode::FailedCreateFile;
+        LOG(Helper::LogLevel::LL_Info, "SPDKIO: mapping journal enabled, checkpoint every %zu bytes\n", p_checkpointBytes);
+        return ErrorCode::Success;
+    }
+
+    // with the journal enabled, only pays for a snapshot when the journal is large enough,
+    // otherwise just makes the journal durable
+    void ForceCompaction() override {
+        std::lock_guard<std::mutex> lock(m_checkpointMutex);
+        if (m_shutdownCalled)
+            return;
+        if (!m_journal.IsOpen()) {
+            Save(m_mappingPath);
+        } else if (m_journal.Size() >= m_journalCheckpointBytes) {
+            Checkpoint();
+        } else {
+            m_journal.Flush(true);
+        }
+        m_checkpointScheduled = false;
+    }
+
+    void GetStat() override {
+        AddressType remainBlocks = m_pBlockController->RemainBlocks();
+        AddressType remainGB = remainBlocks >> 20 << 2;
+        LOG(Helper::LogLevel::LL_Info, "Remain %lld blocks, totally %lld GB\n", (long long)remainBlocks, (long long)remainGB);
+        if (m_postingCache.Enabled()) {
+            std::uint64_t hits = m_postingCache.Hits(), misses = m_postingCache.Misses();
+            LOG(Helper::LogLevel::LL_Info, "Posting cache: %zu bytes, %llu hits, %llu misses, hit rate %.2f%%\n", m_postingCache.Bytes(), (unsigned long long)hits, (unsigned long long)misses, hits + misses == 0 ? 0.0 : hits * 100.0 / (hits + misses));
+        }
+        m_pBlockController->IOStatistics();
+    }
+
+    void CollectMetrics(Helper::MetricsWriter& p_writer) override {
+        p_writer.Gauge("sptag_free_blocks", "Blocks the posting store can still allocate", (double)m_pBlockController->RemainBlocks());
+        p_writer.Gauge("sptag_max_blocks", "Blocks of the device the posting store lays out on", (double)m_pBlockController->MaxBlocks());
+        if (m_postingCache.Enabled()) {
+            p_writer.Counter("sptag_posting_cache_hits_total", "Posting reads served by the posting cache", (double)m_postingCache.Hits());
+            p_writer.Counter("sptag_posting_cache_misses_total", "Posting reads that went to the device", (double)m_postingCache.Misses());
+            p_writer.Gauge("sptag_posting_cache_bytes", "Bytes held by the posting cache", (double)m_postingCache.Bytes());
+            p_writer.Gauge("sptag_resident_posting_bytes", "Bytes of the postings kept resident in DRAM", (double)m_postingCache.ResidentBytes());
+        }
+        m_pBlockController->CollectMetrics(p_writer);
     }
 
     ErrorCode Load(std::string path, SizeType blockSize, SizeType capacity) {
@@ -326,65 +928,530 @@ class SPDKIO {
         SizeType CR, mycols;
         IOBINARY(ptr, ReadBinary, sizeof(SizeType), (char*)&CR);
         IOBINARY(ptr, ReadBinary, sizeof(SizeType), (char*)&mycols);
-        if (mycols > m_blockLimit)
+        if (mycols > m_blockLimit) {
             m_blockLimit = mycols;
+            m_slots.Initialize(sizeof(AddressType) * m_blockLimit, 0);
+        }
 
         m_pBlockMapping.Initialize(CR, 1, blockSize, capacity);
         for (int i = 0; i < CR; i++) {
-            At(i) = (uintptr_t)(new AddressType[m_blockLimit]);
+            At(i) = (uintptr_t)m_slots.Allocate();
+            if (At(i) == 0)
+                return ErrorCode::MemoryOverFlow;
+            memset((AddressType*)At(i), -1, sizeof(AddressType) * m_blockLimit);
             IOBINARY(ptr, ReadBinary, sizeof(AddressType) * mycols, (char*)At(i));
         }
         LOG(Helper::LogLevel::LL_Info, "Load mapping (%d,%d) Finish!\n", CR, mycols);
         return ErrorCode::Success;
     }
 
+    // map the snapshot instead of reading it: the rows of the file serve as the address arrays in place.
+    // The mapping is private, so updates never reach the file, and rows are paged in on first touch.
+    ErrorCode LoadMapped(std::string path, SizeType blockSize, SizeType capacity) {
+        LOG(Helper::LogLevel::LL_Info, "Map mapping From %s\n", path.c_str());
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return ErrorCode::FailedOpenFile;
+        struct stat info;
+        SizeType header[2];
+        if (fstat(fd, &info) != 0 || pread(fd, header, sizeof(header), 0) != sizeof(header)) {
+            close(fd);
+            return ErrorCode::FailedOpenFile;
+        }
+        SizeType CR = header[0], mycols = header[1];
+        size_t length = sizeof(header) + sizeof(AddressType) * (size_t)CR * mycols;
+        // rows narrower than the slot arrays cannot be used in place
+        if (mycols < m_blockLimit || (size_t)info.st_size < length) {
+            LOG(Helper::LogLevel::LL_Info, "Mapping rows (%d,%d) cannot be mapped with block limit %d, fall back to Load\n", CR, mycols, m_blockLimit);
+            close(fd);
+            return ErrorCode::Fail;
+        }
+        void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED)
+            return ErrorCode::Fail;
+        madvise(base, length, MADV_WILLNEED);
+        m_mappedBase = (char*)base;
+        m_mappedLength = length;
+        m_blockLimit = mycols;
+        m_slots.Initialize(sizeof(AddressType) * m_blockLimit, 0);
+
+        m_pBlockMapping.Initialize(CR, 1, blockSize, capacity);
+        AddressType* rows = (AddressType*)(m_mappedBase + sizeof(header));
+#pragma omp parallel for schedule(static)
+        for (SizeType i = 0; i < CR; i++) {
+            At(i) = (uintptr_t)(rows + (size_t)i * mycols);
+        }
+        LOG(Helper::LogLevel::LL_Info, "Map mapping (%d,%d) Finish!\n", CR, mycols);
+        return ErrorCode::Success;
+    }
+
+    // written to path_tmp and renamed over path, so a crash never leaves a torn snapshot
     ErrorCode Save(std::string path) {
         LOG(Helper::LogLevel::LL_Info, "Save mapping To %s\n", path.c_str());
+        std::string tmpPath = path + "_tmp";
         auto ptr = f_createIO();
-        if (ptr == nullptr || !ptr->Initialize(path.c_str(), std::ios::binary | std::ios::out))
+        if (ptr == nullptr || !ptr->Initialize(tmpPath.c_str(), std::ios::binary | std::ios::out))
             return ErrorCode::FailedCreateFile;
 
         SizeType CR = m_pBlockMapping.R();
         IOBINARY(ptr, WriteBinary, sizeof(SizeType), (char*)&CR);
         IOBINARY(ptr, WriteBinary, sizeof(SizeType), (char*)&m_blockLimit);
-        std::vector<AddressType> empty(m_blockLimit, 0xffffffffffffffff);
-        for (int i = 0; i < CR; i++) {
-            if (At(i) == 0xffffffffffffffff) {
-                IOBINARY(ptr, WriteBinary, sizeof(AddressType) * m_blockLimit, (char*)(empty.data()));
-            } else {
-                int64_t* postingSize = (int64_t*)At(i);
-                IOBINARY(ptr, WriteBinary, sizeof(AddressType) * m_blockLimit, (char*)postingSize);
+        // rows are copied a chunk at a time under a guard, so writers may swap them meanwhile
+        const SizeType chunk = 4096;
+        std::vector<AddressType> rows((size_t)chunk * m_blockLimit);
+        for (SizeType first = 0; first < CR; first += chunk) {
+            SizeType count = (std::min)(chunk, CR - first);
+            {
+                EpochReclaimer::Guard guard(m_reclaimer);
+                for (SizeType i = 0; i < count; i++) {
+                    uintptr_t row = At(first + i);
+                    AddressType* dst = rows.data() + (size_t)i * m_blockLimit;
+                    if (row == 0xffffffffffffffff)
+                        std::fill(dst, dst + m_blockLimit, (AddressType)0xffffffffffffffff);
+                    else
+                        memcpy(dst, (AddressType*)row, sizeof(AddressType) * m_blockLimit);
+                }
             }
+            IOBINARY(ptr, WriteBinary, sizeof(AddressType) * m_blockLimit * count, (char*)(rows.data()));
+        }
+        ptr->ShutDown();
+        MappingJournal::SyncFile(tmpPath);
+        if (std::rename(tmpPath.c_str(), path.c_str()) != 0) {
+            LOG(Helper::LogLevel::LL_Error, "Fail to rename %s to %s\n", tmpPath.c_str(), path.c_str());
+            return ErrorCode::FailedCreateFile;
         }
         LOG(Helper::LogLevel::LL_Info, "Save mapping (%d,%d) Finish!\n", CR, m_blockLimit);
         return ErrorCode::Success;
     }
 
-    bool Initialize(bool debug = false) {
+    // the rows are copied under a guard while the caller keeps writers out, the blocks they name
+    // are marked in a bitmap over the device like RecoverFreeBlocks does
+    ErrorCode CreateSnapshot() override {
+        if (m_snapshot.Active()) {
+            LOG(Helper::LogLevel::LL_Error, "SPDKIO: a snapshot of %s is open already\n", m_mappingPath.c_str());
+            return ErrorCode::Fail;
+        }
+        SizeType CR = m_pBlockMapping.R();
+        std::vector<AddressType> rows((size_t)CR * m_blockLimit);
+        {
+            EpochReclaimer::Guard guard(m_reclaimer);
+#pragma omp parallel for schedule(dynamic, 4096)
+            for (SizeType i = 0; i < CR; i++) {
+                uintptr_t row = At(i);
+                AddressType* dst = rows.data() + (size_t)i * m_blockLimit;
+                if (row == 0xffffffffffffffff)
+                    std::fill(dst, dst + m_blockLimit, (AddressType)0xffffffffffffffff);
+                else
+                    memcpy(dst, (AddressType*)row, sizeof(AddressType) * m_blockLimit);
+            }
+        }
+        m_snapshot.Capture(std::move(rows), CR, m_blockLimit, m_pBlockController->MaxBlocks());
+        LOG(Helper::LogLevel::LL_Info, "SPDKIO: snapshot of %d keys, %lld blocks held\n", CR, (long long)m_snapshot.PinnedBlocks());
+        return ErrorCode::Success;
+    }
+
+    ErrorCode ReadSnapshot(SizeType key, std::string* value) override {
+        const AddressType* row = m_snapshot.Active() ? m_snapshot.Row(key) : nullptr;
+        if (row == nullptr)
+            return ErrorCode::Fail;
+        IOTraceTagScope traceTag(key);
+        return m_pBlockController->ReadBlocks(const_cast<AddressType*>(row), value) ? ErrorCode::Success : ErrorCode::Fail;
+    }
+
+    // The postings are laid out one after the other behind what p_dataPath holds already, at the
+    // offsets a Uring device on that file reads them at, so stores sharing a device can share the
+    // backup file too. p_mappingPath gets the rows naming them in the format of Save. Postings are
+    // read kSnapshotBatch at a time under the calling thread's I/O class
+    ErrorCode WriteSnapshot(const std::string& p_dataPath, const std::string& p_mappingPath, std::atomic<std::uint64_t>* p_bytes) override {
+        if (!m_snapshot.Active())
+            return ErrorCode::Fail;
+        std::string tmpPath = p_mappingPath + "_tmp";
+        auto data = f_createIO();
+        auto mapping = f_createIO();
+        int dataMode = fileexists(p_dataPath.c_str()) ? (std::ios::binary | std::ios::in | std::ios::out | std::ios::ate) : (std::ios::binary | std::ios::out);
+        if (data == nullptr || !data->Initialize(p_dataPath.c_str(), dataMode) || mapping == nullptr || !mapping->Initialize(tmpPath.c_str(), std::ios::binary | std::ios::out))
+            return ErrorCode::FailedCreateFile;
+
+        SizeType CR = m_snapshot.Keys();
+        IOBINARY(mapping, WriteBinary, sizeof(SizeType), (char*)&CR);
+        IOBINARY(mapping, WriteBinary, sizeof(SizeType), (char*)&m_blockLimit);
+        std::vector<AddressType> rows((size_t)kSnapshotBatch * m_blockLimit);
+        std::vector<AddressType*> reads;
+        std::vector<std::string> values;
+        AddressType start = (AddressType)(data->TellP() >> PageSizeEx), next = start;
+        for (SizeType first = 0; first < CR; first += kSnapshotBatch) {
+            SizeType count = (std::min)((SizeType)kSnapshotBatch, CR - first);
+            reads.clear();
+            for (SizeType i = 0; i < count; i++) {
+                const AddressType* row = m_snapshot.Row(first + i);
+                if (row != nullptr)
+                    reads.push_back(const_cast<AddressType*>(row));
+            }
+            if (!reads.empty() && !m_pBlockController->ReadBlocks(reads, &values)) {
+                LOG(Helper::LogLevel::LL_Error, "SPDKIO: snapshot read of keys %d to %d failed\n", first, first + count);
+                return ErrorCode::DiskIOFail;
+            }
+            std::fill(rows.begin(), rows.end(), (AddressType)0xffffffffffffffff);
+            size_t read = 0;
+            for (SizeType i = 0; i < count; i++) {
+                const AddressType* row = m_snapshot.Row(first + i);
+                if (row == nullptr)
+                    continue;
+                std::string& value = values[read++];
+                AddressType pages = MappingSnapshot::Pages(row);
+                AddressType* dst = rows.data() + (size_t)i * m_blockLimit;
+                dst[0] = row[0];
+                for (AddressType j = 0; j < pages; j++) dst[1 + j] = next++;
+                value.resize((size_t)pages * PageSize, 0);
+                IOBINARY(data, WriteBinary, value.size(), value.data());
+                if (p_bytes != nullptr)
+                    p_bytes->fetch_add(value.size());
+            }
+            IOBINARY(mapping, WriteBinary, sizeof(AddressType) * m_blockLimit * count, (char*)(rows.data()));
+        }
+        data->ShutDown();
+        mapping->ShutDown();
+        MappingJournal::SyncFile(p_dataPath);
+        MappingJournal::SyncFile(tmpPath);
+        if (std::rename(tmpPath.c_str(), p_mappingPath.c_str()) != 0) {
+            LOG(Helper::LogLevel::LL_Error, "Fail to rename %s to %s\n", tmpPath.c_str(), p_mappingPath.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        LOG(Helper::LogLevel::LL_Info, "SPDKIO: snapshot of %d keys written to %s, %lld blocks from block %lld\n", CR, p_dataPath.c_str(), (long long)(next - start), (long long)start);
+        return ErrorCode::Success;
+    }
+
+    void ReleaseSnapshot() override {
+        std::vector<AddressType> deferred = m_snapshot.Release();
+        if (!deferred.empty())
+            m_pBlockController->ReleaseBlocks(deferred.data(), (int)deferred.size());
+        LOG(Helper::LogLevel::LL_Info, "SPDKIO: snapshot released, %zu held blocks freed\n", deferred.size());
+    }
+
+    // a store sharing the device of another one relies on the owner's per-thread setup
+    bool Initialize(bool debug = false) override {
         if (debug)
             LOG(Helper::LogLevel::LL_Info, "Initialize SPDK for new threads\n");
-        return m_pBlockController.Initialize(64);
+        return m_deviceOwner != nullptr || m_pBlockController->Initialize(64);
     }
 
-    bool ExitBlockController(bool debug = false) {
+    bool ExitBlockController(bool debug = false) override {
         if (debug)
             LOG(Helper::LogLevel::LL_Info, "Exit SPDK for thread\n");
-        return m_pBlockController.ShutDown();
+        return m_deviceOwner != nullptr || m_pBlockController->ShutDown();
     }
 
    private:
+    // append the current mapping of key to the journal and return the LSN of the entry, 0 without
+    // a journal. The caller holds the posting lock
+    std::uint64_t JournalMapping(SizeType key) {
+        if (!m_journal.IsOpen())
+            return 0;
+        std::uint64_t lsn;
+        if (At(key) == 0xffffffffffffffff) {
+            lsn = m_journal.Append(key, nullptr, -1);
+        } else {
+            AddressType* postingSize = (AddressType*)At(key);
+            int count = (*postingSize < 0) ? 1 : 1 + (int)((*postingSize + PageSize - 1) >> PageSizeEx);
+            lsn = m_journal.Append(key, postingSize, count);
+        }
+        if (m_journal.Size() >= m_journalCheckpointBytes && !m_checkpointScheduled.exchange(true))
+            m_compactionThreadPool->add(new CompactionJob(this));
+        return lsn;
+    }
+
+    // The journal is rotated before the snapshot is taken, so updates racing with the snapshot
+    // are in the fresh journal and get replayed over it. The old journal is dropped once the
+    // snapshot is durable. Called with m_checkpointMutex held.
+    ErrorCode Checkpoint() {
+        std::string oldJournal = m_mappingPath + kOldJournalSuffix;
+        if (!m_journal.Rotate(oldJournal))
+            return ErrorCode::FailedCreateFile;
+        ErrorCode ret = Save(m_mappingPath);
+        if (ret != ErrorCode::Success)
+            return ret;
+        std::remove(oldJournal.c_str());
+        return ErrorCode::Success;
+    }
+
+    // apply one journal entry to the mapping, entries carry the full address array so this is idempotent
+    void ReplayMapping(SizeType key, const AddressType* entries, int count) {
+        if (key >= m_pBlockMapping.R())
+            m_pBlockMapping.AddBatch(key + 1 - m_pBlockMapping.R());
+        if (count < 0) {
+            if (At(key) != 0xffffffffffffffff) {
+                RetireRow((AddressType*)At(key), 0, 0);
+                At(key) = 0xffffffffffffffff;
+            }
+            return;
+        }
+        if (count > m_blockLimit) {
+            LOG(Helper::LogLevel::LL_Error, "SPDKIO: journal entry of key %d has %d blocks, limit %d\n", key, count - 1, m_blockLimit - 1);
+            return;
+        }
+        if (At(key) == 0xffffffffffffffff) {
+            void* row = m_slots.Allocate();
+            if (row == nullptr) {
+                LOG(Helper::LogLevel::LL_Error, "SPDKIO: no mapping slot for journal entry of key %d\n", key);
+                return;
+            }
+            At(key) = (uintptr_t)row;
+        }
+        memset((AddressType*)At(key), -1, sizeof(AddressType) * m_blockLimit);
+        memcpy((AddressType*)At(key), entries, sizeof(AddressType) * count);
+    }
+
+    // hand every block not referenced by the recovered mapping back to the allocator,
+    // the rows are scanned in parallel into a bitmap of used blocks
+    // every store on the device contributes its blocks, so no store frees the blocks of another
+    void RecoverFreeBlocks() {
+        AddressType maxBlocks = m_pBlockController->MaxBlocks();
+        std::vector<std::uint64_t> used((maxBlocks + 63) >> 6, 0);
+        SPDKIO* owner = (m_deviceOwner != nullptr) ? m_deviceOwner : this;
+        owner->MarkUsedBlocks(used);
+        for (SPDKIO* sharer : owner->m_deviceSharers) sharer->MarkUsedBlocks(used);
+        m_pBlockController->ResetBlocks(used);
+    }
+
+    void MarkUsedBlocks(std::vector<std::uint64_t>& p_used) {
+        AddressType maxBlocks = m_pBlockController->MaxBlocks();
+        SizeType rows = m_pBlockMapping.R();
+#pragma omp parallel for schedule(dynamic, 4096)
+        for (SizeType i = 0; i < rows; i++) {
+            if (At(i) == 0xffffffffffffffff)
+                continue;
+            AddressType* postingSize = (AddressType*)At(i);
+            if (*postingSize < 0)
+                continue;
+            int blocks = (int)((*postingSize + PageSize - 1) >> PageSizeEx);
+            for (int j = 1; j <= blocks; j++) {
+                AddressType block = postingSize[j];
+                if (block < 0 || block >= maxBlocks)
+                    continue;
+#pragma omp atomic
+                p_used[block >> 6] |= (1ULL << (block & 63));
+            }
+        }
+    }
+
+    // the caller holds the posting lock, so entries of one key never race with each other
+    bool GetCachedTail(SizeType key, AddressType p_size, std::string* p_value) {
+        tbb::concurrent_hash_map<SizeType, std::string>::const_accessor accessor;
+        if (!m_tailCache.find(accessor, key) || (AddressType)accessor->second.size() != p_size)
+            return false;
+        *p_value = accessor->second;
+        return true;
+    }
+
+    // replace the cached tail of key, entries not fitting into the budget are dropped
+    void CacheTail(SizeType key, const char* p_tail, size_t p_size) {
+        {
+            tbb::concurrent_hash_map<SizeType, std::string>::accessor accessor;
+            if (m_tailCache.find(accessor, key)) {
+                m_tailCacheBytes -= accessor->second.size();
+                if (p_size > 0 && m_tailCacheBytes + p_size <= m_tailCacheLimit) {
+                    accessor->second.assign(p_tail, p_size);
+                    m_tailCacheBytes += p_size;
+                    return;
+                }
+                m_tailCache.erase(accessor);
+                return;
+            }
+        }
+        if (p_size == 0 || m_tailCacheBytes + p_size > m_tailCacheLimit)
+            return;
+        tbb::concurrent_hash_map<SizeType, std::string>::accessor accessor;
+        if (m_tailCache.insert(accessor, key)) {
+            accessor->second.assign(p_tail, p_size);
+            m_tailCacheBytes += p_size;
+        }
+    }
+
+    // serve cached postings straight from DRAM and read only the misses, which are cached once
+    // complete. Views into the cache have capacity -1 and keep their entry pinned until released.
+    // p_generations[i] is the cache generation of keys[i] taken before blocks[i] was loaded
+    ErrorCode CachedMultiGet(const std::vector<SizeType>& keys, std::vector<AddressType*>& blocks, const std::vector<std::uint64_t>& p_generations, std::vector<PostingView>* values, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout) {
+        values->assign(keys.size(), PostingView());
+        std::vector<int> hits, misses;
+        std::vector<SizeType> missKeys;
+        std::vector<AddressType*> missBlocks;
+        std::vector<std::uint64_t> generations;
+        for (int i = 0; i < (int)keys.size(); i++) {
+            PostingCache::Entry entry = m_postingCache.Find(keys[i]);
+            if (entry != nullptr) {
+                auto& pin = m_pinnedPostings[entry->data()];
+                pin.first = entry;
+                pin.second++;
+                (*values)[i] = {entry->data(), (AddressType)entry->size(), -1};
+                hits.push_back(i);
+            } else {
+                generations.push_back(p_generations[i]);
+                missKeys.push_back(keys[i]);
+                missBlocks.push_back(blocks[i]);
+                misses.push_back(i);
+            }
+        }
+
+        // cached postings are scanned once the misses are on their way
+        bool hitsDone = false;
+        auto scanHits = [&]() {
+            hitsDone = true;
+            if (p_onPostingDone)
+                for (int i : hits) p_onPostingDone(i);
+        };
+        std::vector<PostingView> missViews;
+        bool success = true;
+        if (!misses.empty()) {
+            std::function<void(int)> onMissDone;
+            if (p_onPostingDone) {
+                onMissDone = [&](int m) {
+                    if (!hitsDone)
+                        scanHits();
+                    (*values)[misses[m]] = missViews[m];
+                    p_onPostingDone(misses[m]);
+                };
+            }
+            IOTraceTagScope traceTag(missKeys.data(), missKeys.size());
+            success = m_pBlockController->ReadBlocks(missBlocks, &missViews, onMissDone, timeout);
+            for (size_t m = 0; m < missViews.size(); m++) {
+                (*values)[misses[m]] = missViews[m];
+                if (missViews[m].size > 0 && missViews[m].size == missBlocks[m][0])
+                    m_postingCache.Insert(keys[misses[m]], missViews[m].data, missViews[m].size, generations[m]);
+            }
+        }
+        if (!hitsDone)
+            scanHits();
+        return success ? ErrorCode::Success : ErrorCode::Fail;
+    }
+
+    // allocate p_size blocks into p_data, around address p_near when it is set, and write p_value
+    // there. Group commits allocate for the whole group and ignore p_near
+    ErrorCode WriteNewBlocks(AddressType* p_data, int p_size, const std::string& p_value, AddressType p_near = -1) {
+        if (m_groupCommit && p_size > 0)
+            return GroupWrite(p_data, p_size, p_value);
+        if (!(p_near >= 0 ? m_pBlockController->GetBlocksNear(p_data, p_size, p_near) : m_pBlockController->GetBlocks(p_data, p_size)))
+            return ErrorCode::DiskIOFail;
+        // the caller keeps its old mapping, the blocks go back unused
+        if (!m_pBlockController->WriteBlocks(p_data, p_size, p_value)) {
+            m_pBlockController->ReleaseBlocks(p_data, p_size);
+            return ErrorCode::DiskIOFail;
+        }
+        return ErrorCode::Success;
+    }
+
+    // The first caller to find no open group becomes its leader: it waits for the window,
+    // takes every pending write, allocates their blocks together and submits them as one batch
+    ErrorCode GroupWrite(AddressType* p_data, int p_size, const std::string& p_value) {
+        PendingWrite write;
+        write.blocks = p_data;
+        write.size = p_size;
+        write.value = &p_value;
+
+        std::unique_lock<std::mutex> lock(m_groupMutex);
+        m_groupPending.push_back(&write);
+        m_groupPendingBytes += p_value.size();
+        if (m_groupLeaderActive) {
+            if (m_groupPendingBytes >= m_groupCommitBytes)
+                m_groupCond.notify_all();
+            m_groupCond.wait(lock, [&write]() { return write.done; });
+            return write.success ? ErrorCode::Success : ErrorCode::DiskIOFail;
+        }
+
+        m_groupLeaderActive = true;
+        m_groupCond.wait_for(lock, m_groupCommitWindow, [this]() { return m_groupPendingBytes >= m_groupCommitBytes; });
+        std::vector<PendingWrite*> group;
+        group.swap(m_groupPending);
+        m_groupPendingBytes = 0;
+        // later arrivals elect the next leader while this group is on the way
+        m_groupLeaderActive = false;
+        lock.unlock();
+
+        int totalBlocks = 0;
+        for (PendingWrite* w : group) totalBlocks += w->size;
+        std::vector<AddressType> allocated(totalBlocks);
+        bool success = m_pBlockController->GetBlocks(allocated.data(), totalBlocks);
+        if (success) {
+            std::vector<AddressType*> blocks;
+            std::vector<int> sizes;
+            std::vector<const std::string*> values;
+            int offset = 0;
+            for (PendingWrite* w : group) {
+                memcpy(w->blocks, allocated.data() + offset, sizeof(AddressType) * w->size);
+                offset += w->size;
+                blocks.push_back(w->blocks);
+                sizes.push_back(w->size);
+                values.push_back(w->value);
+            }
+            // the batch carries the postings of the whole group
+            IOTraceTagScope traceTag(-1);
+            success = m_pBlockController->WriteBlocks(blocks, sizes, values);
+            // the writers keep their old mappings, the blocks go back unused
+            if (!success)
+                m_pBlockController->ReleaseBlocks(allocated.data(), totalBlocks);
+        }
+
+        lock.lock();
+        for (PendingWrite* w : group) {
+            w->success = success;
+            w->done = true;
+        }
+        lock.unlock();
+        m_groupCond.notify_all();
+        return success ? ErrorCode::Success : ErrorCode::DiskIOFail;
+    }
+
     std::string m_mappingPath;
     SizeType m_blockLimit;
     COMMON::Dataset<uintptr_t> m_pBlockMapping;
-    SizeType m_bufferLimit;
-    tbb::concurrent_queue<uintptr_t> m_buffer;
+    SlotArena m_slots;
+    // open snapshot of the mapping and the releases it holds back, outlives the reclaimer's callbacks
+    static constexpr SizeType kSnapshotBatch = 256;
+    MappingSnapshot m_snapshot;
+    // rows and blocks unlinked by Put, Merge and Delete wait here for the readers of Get and MultiGet
+    EpochReclaimer m_reclaimer;
 
     // tbb::concurrent_hash_map<SizeType, std::string> *m_pCurrentCache, *m_pNextCache;
     std::shared_ptr<Helper::ThreadPool> m_compactionThreadPool;
-    BlockController m_pBlockController;
+    std::shared_ptr<BlockDevice> m_pBlockController;
+    // stores placed on the device of another one, or the owner of the device this one is on
+    std::vector<SPDKIO*> m_deviceSharers;
+    SPDKIO* m_deviceOwner = nullptr;
 
     bool m_shutdownCalled;
     std::mutex m_updateMutex;
+
+    size_t m_tailCacheLimit = 0;
+    std::atomic<size_t> m_tailCacheBytes{0};
+    tbb::concurrent_hash_map<SizeType, std::string> m_tailCache;
+
+    PostingCache m_postingCache;
+    // cache entries behind the views handed out to this thread, with their view count
+    static thread_local std::unordered_map<const char*, std::pair<PostingCache::Entry, int>> m_pinnedPostings;
+    // keys, block lists and cache generations of this thread's view MultiGet, kept across queries
+    static thread_local std::vector<SizeType> m_readKeys;
+    static thread_local std::vector<AddressType*> m_readBlocks;
+    static thread_local std::vector<std::uint64_t> m_readGenerations;
+
+    bool m_groupCommit = false;
+    std::chrono::microseconds m_groupCommitWindow = std::chrono::microseconds(50);
+    size_t m_groupCommitBytes = 1 << 20;
+    std::mutex m_groupMutex;
+    std::condition_variable m_groupCond;
+    std::vector<PendingWrite*> m_groupPending;
+    size_t m_groupPendingBytes = 0;
+    bool m_groupLeaderActive = false;
+
+    static constexpr const char* kJournalSuffix = ".journal";
+    static constexpr const char* kOldJournalSuffix = ".journal.old";
+    MappingJournal m_journal;
+    size_t m_journalCheckpointBytes = 64 << 20;
+    std::mutex m_checkpointMutex;
+    std::atomic<bool> m_checkpointScheduled{false};
+
+    // snapshot mapped by LoadMapped, rows inside it are not owned by new[]
+    char* m_mappedBase = nullptr;
+    size_t m_mappedLength = 0;
 };
 }  // namespace SPTAG::SPANN
 #endif  // _SPTAG_SPANN_EXTRASPDKCONTROLLER_H_
@@ -6,6 +6,7 @@
 
 #include "Helper/VectorSetReader.h"
 #include "Helper/AsyncFileReader.h"
+#include "Helper/UringFileReader.h"
 #include "IExtraSearcher.h"
 #include "Core/Common/TruthSet.h"
 #include "Core/BKT/Index.h"
@@ -30,11 +31,20 @@ struct Selection {
     std::vector<Edge> m_selections;
     static EdgeCompare g_edgeComparer;
 
-    Selection(size_t totalsize, std::string tmpdir) : m_tmpfile(tmpdir + FolderSep + "selection_tmp"), m_totalsize(totalsize), m_start(0), m_end(totalsize) {
+    // p_resume keeps the selections an earlier run spilled to the temp file, no batch is held
+    Selection(size_t totalsize, std::string tmpdir, bool p_resume = false) : m_tmpfile(tmpdir + FolderSep + "selection_tmp"), m_totalsize(totalsize), m_start(0), m_end(p_resume ? 0 : totalsize) {
+        if (p_resume)
+            return;
         remove(m_tmpfile.c_str());
         m_selections.resize(totalsize);
     }
 
+    // whether the temp file holds all the selections
+    bool Spilled() const {
+        struct stat info;
+        return stat(m_tmpfile.c_str(), &info) == 0 && (size_t)info.st_size >= sizeof(Edge) * m_totalsize;
+    }
+
     ErrorCode SaveBatch() {
         auto f_out = f_createIO();
         if (f_out == nullptr || !f_out->Initialize(m_tmpfile.c_str(), std::ios::out | std::ios::binary | (fileexists(m_tmpfile.c_str()) ? std::ios::in : 0))) {
@@ -51,6 +61,13 @@ struct Selection {
         return ErrorCode::Success;
     }
 
+    // release the loaded batch without writing it back
+    void DropBatch() {
+        std::vector<Edge> batch_selection;
+        m_selections.swap(batch_selection);
+        m_start = m_end = 0;
+    }
+
     ErrorCode LoadBatch(size_t start, size_t end) {
         auto f_in = f_createIO();
         if (f_in == nullptr || !f_in->Initialize(m_tmpfile.c_str(), std::ios::in | std::ios::binary)) {
@@ -128,8 +145,9 @@ class ExtraStaticSearcher {
     virtual bool LoadIndex(Options& p_opt, COMMON::VersionLabel& p_versionMap) {
         m_extraFullGraphFile = p_opt.m_indexDirectory + FolderSep + p_opt.m_ssdIndex;
         std::string curFile = m_extraFullGraphFile;
+        m_uring = Helper::StrUtils::StrEqualIgnoreCase(p_opt.m_staticIOEngine.c_str(), "Uring");
         do {
-            auto curIndexFile = f_createAsyncIO();
+            auto curIndexFile = m_uring ? std::make_shared<Helper::UringFileIO>(Helper::DiskIOScenario::DIS_UserRead, p_opt.m_uringSqPoll, p_opt.m_uringIoPoll) : f_createAsyncIO();
             if (curIndexFile == nullptr || !curIndexFile->Initialize(curFile.c_str(), std::ios::binary | std::ios::in,
 #ifdef BATCH_READ
                                                                      p_opt.m_searchInternalResultNum, 2, 2, p_opt.m_iSSDNumberOfThreads
@@ -192,6 +210,10 @@ class ExtraStaticSearcher {
 #if defined(ASYNC_READ) && !defined(BATCH_READ)
         int unprocessed = 0;
 #endif
+#ifdef BATCH_READ
+        if (m_uring)
+            RegisterPageBuffers(p_exWorkSpace);
+#endif
 
         for (uint32_t pi = 0; pi < postingListCount; ++pi) {
             auto curPostingID = p_exWorkSpace->m_postingIDs[pi];
@@ -217,9 +239,12 @@ class ExtraStaticSearcher {
             request.m_status = (fileid << 16) | p_exWorkSpace->m_spaceID;
             request.m_payload = (void*)listInfo;
             request.m_success = false;
+            request.m_bufferIndex = m_uring ? (int)pi : -1;
 
     #ifdef BATCH_READ  // async batch read
             request.m_callback = [&p_exWorkSpace, &queryResults, &p_index, &request, this](bool success) {
+                if (!success)
+                    return;
                 char* buffer = request.m_buffer;
                 ListInfo* listInfo = (ListInfo*)(request.m_payload);
 
@@ -260,7 +285,10 @@ class ExtraStaticSearcher {
 
 #ifdef ASYNC_READ
     #ifdef BATCH_READ
-        BatchReadFileAsync(m_indexFiles, (p_exWorkSpace->m_diskRequests).data(), postingListCount);
+        if (m_uring)
+            Helper::BatchReadFileUring(m_indexFiles, (p_exWorkSpace->m_diskRequests).data(), postingListCount);
+        else
+            BatchReadFileAsync(m_indexFiles, (p_exWorkSpace->m_diskRequests).data(), postingListCount);
     #else
         while (unprocessed > 0) {
             Helper::AsyncReadRequest* request;
@@ -1145,6 +1173,18 @@ class ExtraStaticSearcher {
         LOG(Helper::LogLevel::LL_Info, "Time to write results:%.2lf sec.\n", ((double)std::chrono::duration_cast<std::chrono::seconds>(t2 - t1).count()) + ((double)std::chrono::duration_cast<std::chrono::milliseconds>(t2 - t1).count()) / 1000);
     }
 
+    // the page buffers of the workspace become the fixed buffers of its rings, request pi reads into
+    // buffer pi. Checked on every query, registering only happens for a new workspace
+    void RegisterPageBuffers(ExtraWorkSpace* p_exWorkSpace) {
+        static thread_local std::vector<struct iovec> buffers;
+        buffers.resize(p_exWorkSpace->m_pageBuffers.size());
+        for (size_t pi = 0; pi < buffers.size(); pi++) {
+            buffers[pi].iov_base = p_exWorkSpace->m_pageBuffers[pi].GetBuffer();
+            buffers[pi].iov_len = p_exWorkSpace->m_pageBuffers[pi].GetPageSize();
+        }
+        for (auto& file : m_indexFiles) ((Helper::UringFileIO*)file.get())->RegisterBuffers(p_exWorkSpace->m_spaceID, buffers.data(), (int)buffers.size());
+    }
+
    public:
     void GetWritePosting(SizeType pid, std::string& posting, bool write = false) {
         if (write) {
@@ -1174,6 +1214,7 @@ class ExtraStaticSearcher {
     bool m_oneContext;
 
     std::vector<std::shared_ptr<Helper::DiskIO>> m_indexFiles;
+    bool m_uring = false;  // m_indexFiles are UringFileIO
     std::unique_ptr<Compressor> m_pCompressor;
     bool m_enableDeltaEncoding;
     bool m_enablePostingListRearrange;
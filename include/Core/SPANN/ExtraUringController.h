@@ -0,0 +1,147 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_EXTRAURINGCONTROLLER_H_
+#define _SPTAG_SPANN_EXTRAURINGCONTROLLER_H_
+
+#include "Core/SPANN/IKeyValueIO.h"
+#include "Core/SPANN/IOClass.h"
+#include "Core/SPANN/IOTrace.h"
+#include "Core/SPANN/StageLatency.h"
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <liburing.h>
+
+namespace SPTAG::SPANN {
+// BlockDevice on a plain file or block device driven by io_uring, no SPDK environment needed.
+// Every thread gets its own ring with a registered file and a registered staging buffer,
+// optionally with a kernel SQ polling thread shared by all rings of the device.
+class UringBlockController : public BlockDevice {
+   public:
+    static constexpr int kDefaultQueueDepth = 128;
+    static constexpr int kDefaultMaxIoPages = 8;
+
+    UringBlockController(const std::string& p_path, int p_queueDepth = kDefaultQueueDepth, int p_maxIoPages = kDefaultMaxIoPages, bool p_sqPoll = false);
+
+    ~UringBlockController();
+
+    bool Initialize(int batchSize, AddressType maxBlocks = kMaxNumBlocks) override;
+
+    bool ReadBlocks(AddressType* p_data, std::string* p_value, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override;
+
+    bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<std::string>* p_values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override;
+
+    // the views point into page aligned thread-local buffers
+    bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<PostingView>* p_views, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override;
+
+    using BlockDevice::ReadBlocks;
+
+    void ReleaseViews(std::vector<PostingView>* p_views) override;
+
+    using BlockDevice::WriteBlocks;
+
+    bool WriteBlocks(std::vector<AddressType*>& p_data, std::vector<int>& p_sizes, std::vector<const std::string*>& p_values) override;
+
+    PostingView AcquireWriteBuffer(AddressType p_pages) override;
+
+    bool WriteBlocksDirect(const AddressType* p_blocks, AddressType p_pages, const char* p_buffer) override;
+
+    bool IOStatistics() override;
+
+    void CollectMetrics(Helper::MetricsWriter& p_writer) override;
+
+    bool ShutDown() override;
+
+   private:
+    // one page of a batch, app_buff is where its bytes come from or go to
+    struct PageRequest {
+        AddressType offset;
+        char* app_buff;
+        AddressType real_size;
+        int posting_id;
+    };
+
+    // one submitted command covering pages [first, first + count) of the current batch
+    struct Command {
+        int first;
+        int count;
+        bool direct;  // transfer straight to or from the app buffers instead of the staging slot
+        bool busy = false;  // submitted and not reaped yet
+        std::vector<struct iovec> iovs;
+        std::uint64_t trace_command;  // set when tracing
+        std::chrono::steady_clock::time_point submit_time;
+    };
+
+    struct ThreadRing {
+        struct io_uring ring;
+        char* staging = nullptr;  // registered buffer, one slot of m_maxIoPages pages per command
+        std::vector<Command> commands;
+        std::vector<int> free_commands;
+        int in_flight = 0;
+        int queued = 0;  // commands prepared in the submission queue and not taken by the kernel yet
+        bool ready = false;
+        std::vector<PostingView> free_posting_buffers;
+    };
+
+    // ring of the calling thread, nullptr before Initialize was called on it or once it was lost
+    ThreadRing* CurrentRing();
+
+    // page aligned buffer of at least p_pages pages from the ring's pool of view buffers
+    PostingView AcquireBuffer(ThreadRing* p_ring, AddressType p_pages);
+
+    bool CreateRing(ThreadRing* p_ring);
+
+    void DestroyRing(ThreadRing* p_ring);
+
+    // replaces a ring with nothing in flight, dropping the entries still queued and freeing their commands
+    bool ResetRing(ThreadRing* p_ring);
+
+    // submits the queued entries and moves the commands the kernel took from queued to in_flight,
+    // returns what io_uring_submit returned
+    int Submit(ThreadRing* p_ring);
+
+    // user data of cancel requests, their completions are dropped
+    static const std::uint64_t kCancelData = ~0ULL;
+
+    // drain I/Os left behind by a previous timeout
+    void ClearTimeoutIOs(ThreadRing* p_ring);
+
+    // cancel the commands in flight and reap them all, no transfer into or out of a caller's buffer
+    // is left running once it returns
+    void CancelInFlight(ThreadRing* p_ring);
+
+    // submit the pages in runs of adjacent blocks and complete them, pageCount[posting_id] counts the
+    // unfinished pages of each posting, p_onPostingDone is called once a count drops to 0. A failed or
+    // short transfer makes the count of its postings negative, they get no callback.
+    // returns false when the deadline passed first or a transfer failed
+    bool Execute(ThreadRing* p_ring, std::vector<PageRequest>& p_pages, std::vector<int>& p_pageCount, bool p_isRead, bool p_direct, const std::chrono::time_point<std::chrono::high_resolution_clock>& p_startTime, const std::chrono::microseconds& p_timeout, const std::function<void(int)>& p_onPostingDone = std::function<void(int)>());
+
+    static thread_local std::unordered_map<std::uint64_t, ThreadRing*> m_threadRings;
+    static std::atomic<std::uint64_t> m_nextDeviceId;
+
+    std::uint64_t m_deviceId;
+    std::string m_path;
+    int m_fd = -1;
+    int m_queueDepth;
+    int m_maxIoPages;
+    bool m_sqPoll;
+    int m_sqPollFd = -1;  // ring owning the SQ polling thread, the others attach to it
+
+    std::mutex m_initMutex;
+    int m_numInitCalled = 0;
+    std::vector<std::unique_ptr<ThreadRing>> m_rings;
+
+    std::atomic<std::uint64_t> m_completedPages{0};
+    std::atomic<std::uint64_t> m_commands{0};
+    IOTraceWriter m_trace;
+    std::uint64_t m_preIOCompleteCount = 0;
+    std::uint64_t m_preIOCommandCount = 0;
+    std::chrono::time_point<std::chrono::high_resolution_clock> m_preTime = std::chrono::high_resolution_clock::now();
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_EXTRAURINGCONTROLLER_H_
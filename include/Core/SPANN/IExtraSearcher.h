@@ -5,9 +5,14 @@
 #define _SPTAG_SPANN_IEXTRASEARCHER_H_
 
 #include "Core/Common/WorkSpace.h"
+#include "Core/SearchQuery.h"
+#include "Core/SPANN/IKeyValueIO.h"
+#include "Core/SPANN/StageLatency.h"
+#include "Core/SPANN/VectorLabels.h"
 #include "Helper/AsyncFileReader.h"
 
 #include <memory>
+#include <unordered_map>
 #include <vector>
 #include <chrono>
 #include <atomic>
@@ -28,7 +33,11 @@ struct SearchStats {
           m_asyncLatency1(0),
           m_asyncLatency2(0),
           m_queueLatency(0),
-          m_sleepLatency(0) {
+          m_sleepLatency(0),
+          m_partial(false),
+          m_skippedPostings(0),
+          m_prunedPostings(0),
+          m_resultCacheHit(false) {
     }
 
     int m_check;
@@ -63,6 +72,20 @@ struct SearchStats {
 
     double m_exSetUpLatency;
 
+    // the query deadline passed before m_skippedPostings of its selected postings were read
+    bool m_partial;
+
+    int m_skippedPostings;
+
+    // postings a range search left unread, their radius kept them out of the query ball
+    int m_prunedPostings;
+
+    // answered from the result cache, nothing was searched
+    bool m_resultCacheHit;
+
+    // head search, I/O submit, I/O wait and posting scan time of the query
+    StageTicks m_stageTicks;
+
     std::chrono::steady_clock::time_point m_searchRequestTime;
 
     int m_threadID;
@@ -70,6 +93,14 @@ struct SearchStats {
 
 struct IndexStats {
     std::atomic_uint32_t m_headMiss{0};
+    std::atomic_uint32_t m_searchRereadNum{0};  // postings searches read again after a concurrent write
+    std::atomic_uint32_t m_throttledInsertNum{0};  // inserts that waited for the background jobs
+    std::atomic_uint32_t m_rejectedInsertNum{0};   // inserts that gave up waiting with IndexBusy
+    std::atomic_uint64_t m_gcPostingNum{0};        // postings rewritten by the background GC
+    std::atomic_uint64_t m_gcReclaimedNum{0};      // dead entries it dropped
+    std::atomic_uint64_t m_gcBytes{0};             // bytes it read and wrote
+    std::atomic_uint64_t m_tierMoveNum{0};         // postings moved between storage tiers
+    std::atomic_uint64_t m_tierMoveBytes{0};       // bytes the moves read and wrote
     uint32_t m_appendTaskNum{0};
     uint32_t m_splitNum{0};
     uint32_t m_theSameHeadNum{0};
@@ -77,70 +108,37 @@ struct IndexStats {
     uint32_t m_garbageNum{0};
     uint64_t m_reAssignScanNum{0};
     uint32_t m_mergeNum{0};
+    uint32_t m_splitReclusterNum{0};  // splits that clustered under the exclusive lock
 
-    // Split
-    double m_splitCost{0};
-    double m_getCost{0};
-    double m_putCost{0};
-    double m_clusteringCost{0};
-    double m_updateHeadCost{0};
-    double m_reassignScanCost{0};
-    double m_reassignScanIOCost{0};
-
-    // Append
-    double m_appendCost{0};
-    double m_appendIOCost{0};
-
-    // reAssign
-    double m_reAssignCost{0};
-    double m_selectCost{0};
-    double m_reAssignAppendCost{0};
-
-    // GC
-    double m_garbageCost{0};
+    // time spent in each stage of the updates, and of the searches
+    StageRecorder m_stages;
 
     void PrintStat(int finishedInsert, bool cost = false, bool reset = false) {
-        LOG(Helper::LogLevel::LL_Info, "After %d insertion, head vectors split %d times, head missing %d times, same head %d times, reassign %d times, reassign scan %ld times, garbage collection %d times, merge %d times\n",
-            finishedInsert, m_splitNum, m_headMiss.load(), m_theSameHeadNum, m_reAssignNum, m_reAssignScanNum, m_garbageNum, m_mergeNum);
+        LOG(Helper::LogLevel::LL_Info, "After %d insertion, head vectors split %d times, head missing %d times, same head %d times, reassign %d times, reassign scan %ld times, garbage collection %d times, merge %d times, search reread %d postings, throttled %d inserts, rejected %d inserts\n",
+            finishedInsert, m_splitNum, m_headMiss.load(), m_theSameHeadNum, m_reAssignNum, m_reAssignScanNum, m_garbageNum, m_mergeNum, m_searchRereadNum.load(), m_throttledInsertNum.load(), m_rejectedInsertNum.load());
 
         if (cost) {
-            LOG(Helper::LogLevel::LL_Info, "AppendTaskNum: %d, TotalCost: %.3lf us, PerCost: %.3lf us\n", m_appendTaskNum, m_appendCost, m_appendCost / m_appendTaskNum);
-            LOG(Helper::LogLevel::LL_Info, "AppendTaskNum: %d, AppendIO TotalCost: %.3lf us, PerCost: %.3lf us\n", m_appendTaskNum, m_appendIOCost, m_appendIOCost / m_appendTaskNum);
-            LOG(Helper::LogLevel::LL_Info, "SplitNum: %d, TotalCost: %.3lf ms, PerCost: %.3lf ms\n", m_splitNum, m_splitCost, m_splitCost / m_splitNum);
-            LOG(Helper::LogLevel::LL_Info, "SplitNum: %d, Read TotalCost: %.3lf us, PerCost: %.3lf us\n", m_splitNum, m_getCost, m_getCost / m_splitNum);
-            LOG(Helper::LogLevel::LL_Info, "SplitNum: %d, Clustering TotalCost: %.3lf us, PerCost: %.3lf us\n", m_splitNum, m_clusteringCost, m_clusteringCost / m_splitNum);
-            LOG(Helper::LogLevel::LL_Info, "SplitNum: %d, UpdateHead TotalCost: %.3lf ms, PerCost: %.3lf ms\n", m_splitNum, m_updateHeadCost, m_updateHeadCost / m_splitNum);
-            LOG(Helper::LogLevel::LL_Info, "SplitNum: %d, Write TotalCost: %.3lf us, PerCost: %.3lf us\n", m_splitNum, m_putCost, m_putCost / m_splitNum);
-            LOG(Helper::LogLevel::LL_Info, "SplitNum: %d, ReassignScan TotalCost: %.3lf ms, PerCost: %.3lf ms\n", m_splitNum, m_reassignScanCost, m_reassignScanCost / m_splitNum);
-            LOG(Helper::LogLevel::LL_Info, "SplitNum: %d, ReassignScanIO TotalCost: %.3lf us, PerCost: %.3lf us\n", m_splitNum, m_reassignScanIOCost, m_reassignScanIOCost / m_splitNum);
-            LOG(Helper::LogLevel::LL_Info, "GCNum: %d, TotalCost: %.3lf us, PerCost: %.3lf us\n", m_garbageNum, m_garbageCost, m_garbageCost / m_garbageNum);
-            LOG(Helper::LogLevel::LL_Info, "ReassignNum: %d, TotalCost: %.3lf us, PerCost: %.3lf us\n", m_reAssignNum, m_reAssignCost, m_reAssignCost / m_reAssignNum);
-            LOG(Helper::LogLevel::LL_Info, "ReassignNum: %d, Select TotalCost: %.3lf us, PerCost: %.3lf us\n", m_reAssignNum, m_selectCost, m_selectCost / m_reAssignNum);
-            LOG(Helper::LogLevel::LL_Info, "ReassignNum: %d, ReassignAppend TotalCost: %.3lf us, PerCost: %.3lf us\n", m_reAssignNum, m_reAssignAppendCost, m_reAssignAppendCost / m_reAssignNum);
+            LOG(Helper::LogLevel::LL_Info, "AppendTaskNum: %d, SplitNum: %d, Reclustered: %d, GCNum: %d, ReassignNum: %d\n", m_appendTaskNum, m_splitNum, m_splitReclusterNum, m_garbageNum, m_reAssignNum);
+            LOG(Helper::LogLevel::LL_Info, "Background GC: %llu postings rewritten, %llu dead entries dropped, %.2lf MB moved\n",
+                (unsigned long long)m_gcPostingNum.load(), (unsigned long long)m_gcReclaimedNum.load(), m_gcBytes.load() / 1048576.0);
+            LOG(Helper::LogLevel::LL_Info, "Tiering: %llu postings moved, %.2lf MB moved\n", (unsigned long long)m_tierMoveNum.load(), m_tierMoveBytes.load() / 1048576.0);
+            m_stages.Print();
         }
 
         if (reset) {
             m_splitNum = 0;
             m_headMiss = 0;
+            m_searchRereadNum = 0;
+            m_throttledInsertNum = 0;
+            m_rejectedInsertNum = 0;
             m_theSameHeadNum = 0;
             m_reAssignNum = 0;
             m_reAssignScanNum = 0;
             m_mergeNum = 0;
+            m_splitReclusterNum = 0;
             m_garbageNum = 0;
             m_appendTaskNum = 0;
-            m_splitCost = 0;
-            m_clusteringCost = 0;
-            m_garbageCost = 0;
-            m_updateHeadCost = 0;
-            m_getCost = 0;
-            m_putCost = 0;
-            m_reassignScanCost = 0;
-            m_reassignScanIOCost = 0;
-            m_appendCost = 0;
-            m_appendIOCost = 0;
-            m_reAssignCost = 0;
-            m_selectCost = 0;
-            m_reAssignAppendCost = 0;
+            m_stages.Reset();
         }
     }
 };
@@ -179,6 +177,29 @@ class PageBuffer {
     std::size_t m_pageBufferSize;
 };
 
+// what a posting scan reuses from one posting to the next
+struct PostingScanScratch {
+    // vectors of the posting being scanned that passed the delete and dedup checks
+    std::vector<int> m_scanIDs;
+    std::vector<const void*> m_scanVectors;
+    std::vector<float> m_scanDists;
+    // deleted bits of the entries of the posting being scanned, 64 entries per word
+    std::vector<std::uint64_t> m_deletedMask;
+    // norm of the query when the entries carry norms to bound their distance with, negative otherwise
+    float m_queryNorm = -1;
+};
+
+// one helper of an intra-query parallel scan: the postings it takes go into its own top-k and
+// deduper, merged into the query once all helpers are done
+struct ScanPart {
+    QueryResult m_results;
+    COMMON::EpochHashPosVector m_deduper;
+    PostingScanScratch m_scan;
+    int m_diskIO = 0;
+    int m_diskRead = 0;
+    int m_listElements = 0;
+};
+
 struct ExtraWorkSpace {
     ExtraWorkSpace() {}
 
@@ -192,6 +213,8 @@ struct ExtraWorkSpace {
 
     void Initialize(int p_maxCheck, int p_hashExp, int p_internalResultNum, int p_maxPages, bool enableDataCompression) {
         m_postingIDs.reserve(p_internalResultNum);
+        m_probeIDs.reserve(p_internalResultNum);
+        m_probeDists.reserve(p_internalResultNum);
         m_deduper.Init(p_maxCheck, p_hashExp);
         m_processIocp.reset(p_internalResultNum);
         m_pageBuffers.resize(p_internalResultNum);
@@ -222,9 +245,59 @@ struct ExtraWorkSpace {
         g_spaceCount = 0;
     }
 
+    // result set p_slot of the calling thread, pointed at p_target and emptied. It keeps its array
+    // across queries, so searching for fewer results than the internal result number allocates nothing
+    QueryResult& PooledResult(size_t p_slot, const void* p_target, int p_resultNum) {
+        while (m_resultPool.size() <= p_slot) m_resultPool.emplace_back(new QueryResult());
+        QueryResult& result = *m_resultPool[p_slot];
+        if (result.GetResultNum() != p_resultNum)
+            result.Init(p_target, p_resultNum, false);
+        else {
+            result.SetTarget(p_target);
+            result.Reset();
+        }
+        result.SetDeadline((std::chrono::steady_clock::time_point::max)());
+        return result;
+    }
+
     std::vector<int> m_postingIDs;
 
-    COMMON::OptHashPosVector m_deduper;
+    // all candidate postings of a staged probe and their head distances, m_postingIDs holds the current wave
+    std::vector<int> m_probeIDs;
+    std::vector<float> m_probeDists;
+
+    // ADC table of the current query when postings hold PQ codes
+    std::vector<float> m_adcTable;
+
+    // label filter of the current query, inactive for unfiltered ones
+    PostingFilter m_filter;
+
+    PostingScanScratch m_scan;
+
+    // helpers of the intra-query parallel scan, grown on demand
+    std::vector<std::unique_ptr<ScanPart>> m_scanParts;
+
+    // per query scratch of the posting scan, sized to m_postingIDs by the searcher
+    std::vector<PostingView> m_postingViews;
+    std::vector<char> m_scanned;
+    std::vector<std::uint32_t> m_sequences;
+
+    // distances of the current results, for the k-th one between probe waves
+    std::vector<float> m_waveDists;
+
+    // posting selection of a SearchIndexBatch call: slot of every posting in m_postingIDs and the
+    // queries that selected it, entries past m_postingIDs.size() are left over from larger batches
+    std::unordered_map<SizeType, int> m_postingSlots;
+    std::vector<std::vector<int>> m_postingQueries;
+    std::vector<QueryResult*> m_batchResults;
+
+    // internal result sets handed out by PooledResult
+    std::vector<std::unique_ptr<QueryResult>> m_resultPool;
+
+    COMMON::EpochHashPosVector m_deduper;
+
+    // one deduper per query of a SearchIndexBatch call, grown on demand
+    std::vector<std::unique_ptr<COMMON::EpochHashPosVector>> m_batchDedupers;
 
     Helper::RequestQueue m_processIocp;
 
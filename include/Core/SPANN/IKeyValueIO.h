@@ -0,0 +1,276 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_IKEYVALUEIO_H_
+#define _SPTAG_SPANN_IKEYVALUEIO_H_
+
+#include "Core/Common.h"
+#include "Core/SPANN/ExtentAllocator.h"
+#include "Helper/Metrics.h"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace SPTAG::SPANN {
+typedef std::int64_t AddressType;
+
+// read-only posting list held in a buffer owned by the calling thread,
+// valid until it is handed back with KeyValueIO::ReleasePostingViews on the same thread
+struct PostingView {
+    const char* data = nullptr;
+    AddressType size = 0;
+    AddressType capacity = 0;  // pages of the underlying buffer, -1 for a view into a posting cache
+
+    inline bool empty() const { return size == 0; }
+};
+
+// Page-addressed device the posting store lays its blocks out on. Free space is tracked
+// here, the I/O engine (SPDK, io_uring, ...) is up to the implementation. Initialize and
+// ShutDown are called by every thread doing I/O, the first and last call bring the device up and down.
+class BlockDevice {
+   public:
+    static constexpr AddressType kMaxNumBlocks = 1700 * 1024 * 256;  // 1.7T
+
+    virtual ~BlockDevice() {}
+
+    virtual bool Initialize(int batchSize, AddressType maxBlocks = kMaxNumBlocks) = 0;
+
+    virtual bool ShutDown() = 0;
+
+    // read a posting list. p_data[0] is the total data size,
+    // p_data[1], p_data[2], ..., p_data[((p_data[0] + PageSize - 1) >> PageSizeEx)] are the addresses of the blocks
+    // concat all the block contents together into p_value string.
+    virtual bool ReadBlocks(AddressType* p_data, std::string* p_value, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) = 0;
+
+    // parallel read a list of posting lists.
+    virtual bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<std::string>* p_values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) = 0;
+
+    // parallel read a list of posting lists straight into thread-local buffers without copying.
+    // p_onPostingDone(i), if set, runs on the calling thread as soon as posting i is complete, while
+    // the others are still in flight. views of postings not finished before timeout are left empty.
+    virtual bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<PostingView>* p_views, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) = 0;
+
+    bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<PostingView>* p_views, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) {
+        return ReadBlocks(p_data, p_views, std::function<void(int)>(), timeout);
+    }
+
+    // give the buffers behind p_views back to the thread-local pool
+    virtual void ReleaseViews(std::vector<PostingView>* p_views) = 0;
+
+    // write p_values[i] into the p_sizes[i] blocks of p_data[i] for all i as one batch
+    virtual bool WriteBlocks(std::vector<AddressType*>& p_data, std::vector<int>& p_sizes, std::vector<const std::string*>& p_values) = 0;
+
+    // write p_value into p_size blocks start from p_data
+    bool WriteBlocks(AddressType* p_data, int p_size, const std::string& p_value) {
+        std::vector<AddressType*> blocks(1, p_data);
+        std::vector<int> sizes(1, p_size);
+        std::vector<const std::string*> values(1, &p_value);
+        return WriteBlocks(blocks, sizes, values);
+    }
+
+    // buffer of at least p_pages pages WriteBlocksDirect can transfer from without a copy, handed
+    // back with ReleaseViews on the same thread. An empty view means the device has no direct path
+    virtual PostingView AcquireWriteBuffer(AddressType p_pages) {
+        return PostingView();
+    }
+
+    // write p_pages pages of p_buffer, taken from AcquireWriteBuffer, to the blocks p_blocks[0..p_pages)
+    virtual bool WriteBlocksDirect(const AddressType* p_blocks, AddressType p_pages, const char* p_buffer) {
+        return false;
+    }
+
+    virtual bool IOStatistics() = 0;
+
+    // add the device counters to a metrics scrape
+    virtual void CollectMetrics(Helper::MetricsWriter& p_writer) {}
+
+    // get p_size free blocks, and fill in p_data array. blocks are taken from the
+    // calling thread's current extent, so they are adjacent whenever possible
+    virtual bool GetBlocks(AddressType* p_data, int p_size) {
+        while (!m_blockAllocator.Allocate(p_data, p_size)) {
+            if (!Grow(p_size)) {
+                LOG(Helper::LogLevel::LL_Error, "BlockDevice::GetBlocks: out of free blocks, requested %d\n", p_size);
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // GetBlocks with the blocks placed as close to address p_near as free space allows
+    virtual bool GetBlocksNear(AddressType* p_data, int p_size, AddressType p_near) {
+        while (!m_blockAllocator.AllocateNear(p_data, p_size, p_near)) {
+            if (Grow(p_size))
+                continue;
+            LOG(Helper::LogLevel::LL_Error, "BlockDevice::GetBlocksNear: out of free blocks, requested %d\n", p_size);
+            return false;
+        }
+        return true;
+    }
+
+    // release p_size blocks, coalescing them with neighbouring free extents
+    virtual bool ReleaseBlocks(AddressType* p_data, int p_size) {
+        return m_blockAllocator.Release(p_data, p_size);
+    }
+
+    // mark exactly the blocks set in p_usedBits as allocated, used after the block mapping is recovered
+    virtual void ResetBlocks(const std::vector<std::uint64_t>& p_usedBits) {
+        m_blockAllocator.Initialize(m_maxBlocks, p_usedBits);
+    }
+
+    virtual AddressType RemainBlocks() {
+        return m_blockAllocator.FreeBlocks();
+    }
+
+    AddressType MaxBlocks() const {
+        return m_maxBlocks;
+    }
+
+    // storage tiers of the device, fastest first, and the one holding p_block
+    virtual int Tiers() {
+        return 1;
+    }
+
+    virtual int TierOf(AddressType p_block) {
+        return 0;
+    }
+
+   protected:
+    // called when the allocator cannot serve p_size blocks, a device that takes its space from a
+    // larger pool adds some and returns true, then the allocation is tried again
+    virtual bool Grow(int p_size) {
+        return false;
+    }
+
+    ExtentAllocator m_blockAllocator;
+    AddressType m_maxBlocks = kMaxNumBlocks;
+};
+
+// Key-value surface the dynamic searcher keeps its postings in
+class KeyValueIO {
+   public:
+    virtual ~KeyValueIO() {}
+
+    virtual ErrorCode Get(SizeType key, std::string* value) = 0;
+
+    virtual ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) = 0;
+
+    // zero-copy MultiGet, the views must be released by ReleasePostingViews on the calling thread
+    virtual ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) = 0;
+
+    // streaming zero-copy MultiGet, p_onPostingDone(i) runs on the calling thread once values[i] is complete
+    virtual ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) = 0;
+
+    virtual void ReleasePostingViews(std::vector<PostingView>* values) = 0;
+
+    virtual ErrorCode Put(SizeType key, const std::string& value) = 0;
+
+    // Put that lays the posting out next to the one of p_nearKey, postings probed together then
+    // share device extents. Stores without placement control do a plain Put
+    virtual ErrorCode PutNear(SizeType key, const std::string& value, SizeType p_nearKey) {
+        return Put(key, value);
+    }
+
+    virtual ErrorCode Merge(SizeType key, const std::string& value) = 0;
+
+    // Put for a batch of postings: p_fill(i, dst) serialises posting p_keys[i] of p_bytes[i] bytes
+    // into dst. Stores with a bulk path lay the batch out sequentially and write it in one go
+    virtual ErrorCode BulkPut(const std::vector<SizeType>& p_keys, const std::vector<size_t>& p_bytes, const std::function<void(size_t, char*)>& p_fill) {
+        std::string value;
+        for (size_t i = 0; i < p_keys.size(); i++) {
+            value.resize(p_bytes[i]);
+            p_fill(i, &value[0]);
+            ErrorCode ret = Put(p_keys[i], value);
+            if (ret != ErrorCode::Success)
+                return ret;
+        }
+        return ErrorCode::Success;
+    }
+
+    virtual ErrorCode Delete(SizeType key) = 0;
+
+    // every key holding a posting is below this bound, 0 when the store cannot enumerate its keys
+    virtual SizeType KeyBound() {
+        return 0;
+    }
+
+    virtual void ForceCompaction() = 0;
+
+    virtual void GetStat() = 0;
+
+    // add the store counters to a metrics scrape, runs concurrently with reads and writes
+    virtual void CollectMetrics(Helper::MetricsWriter& p_writer) {}
+
+    // called by every thread before and after it touches the store
+    virtual bool Initialize(bool debug = false) = 0;
+
+    virtual bool ExitBlockController(bool debug = false) = 0;
+
+    virtual void ShutDown() = 0;
+
+    // storage knobs, stores without the feature ignore them
+    virtual void SetGroupCommit(bool p_enable, int p_windowUs, int p_maxBytes) {}
+
+    virtual void SetTailCache(size_t p_maxBytes) {}
+
+    virtual void SetPostingCache(size_t p_maxBytes) {}
+
+    virtual ErrorCode SetMappingJournal(bool p_enable, size_t p_checkpointBytes) {
+        return ErrorCode::Success;
+    }
+
+    // device tiers the postings are spread over, fastest first, and the slowest one holding a
+    // block of key's posting, -1 without a posting
+    virtual int Tiers() {
+        return 1;
+    }
+
+    virtual int GetTier(SizeType key) {
+        return 0;
+    }
+
+    // DRAM tier: copies of postings kept in memory up to p_maxBytes, never evicted for other
+    // postings and dropped by the next write of their key. Their blocks stay where they are
+    virtual void SetResidentPostings(size_t p_maxBytes) {}
+
+    // false when the budget is full or the store keeps nothing in DRAM
+    virtual bool MakeResident(SizeType key) {
+        return false;
+    }
+
+    virtual bool IsResident(SizeType key) {
+        return false;
+    }
+
+    virtual void DropResident(SizeType key) {}
+
+    virtual size_t ResidentBytes() {
+        return 0;
+    }
+
+    // fault metadata the store maps lazily (a mapped block mapping) in up front, after a load
+    virtual void Prefault() {}
+
+    // copy-on-write snapshot: the postings as of the call, readable until ReleaseSnapshot while
+    // writes go on. The caller keeps writers out for the duration of the call, one at a time
+    virtual ErrorCode CreateSnapshot() {
+        return ErrorCode::Undefined;
+    }
+
+    virtual ErrorCode ReadSnapshot(SizeType key, std::string* value) {
+        return ErrorCode::Undefined;
+    }
+
+    // appends the snapshot to a block file and writes a mapping naming its blocks, adding the bytes
+    // written to p_bytes as it goes. Runs on a thread set up by Initialize
+    virtual ErrorCode WriteSnapshot(const std::string& p_dataPath, const std::string& p_mappingPath, std::atomic<std::uint64_t>* p_bytes) {
+        return ErrorCode::Undefined;
+    }
+
+    virtual void ReleaseSnapshot() {}
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_IKEYVALUEIO_H_
@@ -0,0 +1,190 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_IOCLASS_H_
+#define _SPTAG_SPANN_IOCLASS_H_
+
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+namespace SPTAG::SPANN {
+// What an I/O is for: searches read in the foreground, inserts append, splits, reassigns, merges,
+// GC and compaction run in the background. The class belongs to the thread issuing the I/O, a
+// device queueing the I/Os of many threads serves the classes in this order
+enum class IOClass : int { Foreground = 0, Update = 1, Background = 2 };
+static constexpr int kIOClasses = 3;
+
+inline const char* IOClassName(int p_class) {
+    static const char* names[kIOClasses] = {"foreground", "update", "background"};
+    return names[p_class];
+}
+
+// class of the I/Os the calling thread issues
+inline IOClass& CurrentIOClass() {
+    static thread_local IOClass ioClass = IOClass::Foreground;
+    return ioClass;
+}
+
+// lowers the class of the calling thread while in scope, never raises it, so an append made by a
+// reassign job stays background
+class IOClassScope {
+   public:
+    explicit IOClassScope(IOClass p_class)
+        : m_saved(CurrentIOClass()) {
+        if ((int)p_class > (int)m_saved)
+            CurrentIOClass() = p_class;
+    }
+
+    ~IOClassScope() {
+        CurrentIOClass() = m_saved;
+    }
+
+    IOClassScope(const IOClassScope&) = delete;
+    IOClassScope& operator=(const IOClassScope&) = delete;
+
+   private:
+    IOClass m_saved;
+};
+
+// Counters of one class, updated by whichever thread completes its commands. Latencies go into
+// power of two buckets of microseconds, enough for percentiles over an interval
+struct IOClassStats {
+    static constexpr int kLatencyBuckets = 32;
+
+    std::atomic<int> inflight{0};
+    std::atomic<std::uint64_t> commands{0};
+    std::atomic<std::uint64_t> pages{0};
+    std::atomic<std::uint64_t> latencyUs{0};
+    std::atomic<std::uint64_t> latency[kLatencyBuckets] = {};
+
+    inline void Record(std::uint64_t p_pages, std::uint64_t p_us) {
+        int bucket = 0;
+        while (bucket < kLatencyBuckets - 1 && (p_us >> bucket) > 0) bucket++;
+        commands.fetch_add(1, std::memory_order_relaxed);
+        pages.fetch_add(p_pages, std::memory_order_relaxed);
+        latencyUs.fetch_add(p_us, std::memory_order_relaxed);
+        latency[bucket].fetch_add(1, std::memory_order_relaxed);
+    }
+
+    // counts at one point in time, subtract two to get an interval
+    struct Snapshot {
+        std::uint64_t commands = 0;
+        std::uint64_t pages = 0;
+        std::uint64_t latencyUs = 0;
+        std::uint64_t latency[kLatencyBuckets] = {};
+
+        Snapshot operator-(const Snapshot& p_earlier) const {
+            Snapshot diff;
+            diff.commands = commands - p_earlier.commands;
+            diff.pages = pages - p_earlier.pages;
+            diff.latencyUs = latencyUs - p_earlier.latencyUs;
+            for (int b = 0; b < kLatencyBuckets; b++) diff.latency[b] = latency[b] - p_earlier.latency[b];
+            return diff;
+        }
+
+        inline double MeanUs() const {
+            return commands > 0 ? (double)latencyUs / commands : 0;
+        }
+
+        // upper bound of the bucket holding the p_fraction quantile
+        std::uint64_t PercentileUs(double p_fraction) const {
+            std::uint64_t rank = (std::uint64_t)(p_fraction * commands), seen = 0;
+            for (int b = 0; b < kLatencyBuckets; b++) {
+                seen += latency[b];
+                if (seen > rank)
+                    return b == 0 ? 0 : (std::uint64_t)1 << b;
+            }
+            return commands > 0 ? (std::uint64_t)1 << (kLatencyBuckets - 1) : 0;
+        }
+    };
+
+    Snapshot Take() const {
+        Snapshot snapshot;
+        snapshot.commands = commands.load(std::memory_order_relaxed);
+        snapshot.pages = pages.load(std::memory_order_relaxed);
+        snapshot.latencyUs = latencyUs.load(std::memory_order_relaxed);
+        for (int b = 0; b < kLatencyBuckets; b++) snapshot.latency[b] = latency[b].load(std::memory_order_relaxed);
+        return snapshot;
+    }
+};
+
+// Per class queues in front of a device queue, drained by one thread. Classes are served in
+// strict priority, each up to its depth of commands in flight. While a higher class has commands
+// in flight or waiting, a lower one is held to its budget instead, so background traffic is slowed
+// down under search load but never starved. A depth or budget of 0 means no limit
+template <typename T>
+class IOClassQueues {
+   public:
+    IOClassQueues() {
+        for (int c = 0; c < kIOClasses; c++) {
+            m_depth[c] = 0;
+            m_budget[c] = 0;
+        }
+    }
+
+    void Configure(const int* p_depth, const int* p_budget) {
+        for (int c = 0; c < kIOClasses; c++) {
+            m_depth[c] = p_depth[c];
+            m_budget[c] = p_budget[c];
+        }
+    }
+
+    inline void Push(T p_item, int p_class) {
+        m_pending[p_class].push_back(p_item);
+    }
+
+    // p_submit(item) hands one item to the device and returns false if the device refused it for
+    // now, the item then stays first in its queue and dispatching stops. Returns the items submitted
+    template <typename F>
+    int Dispatch(const F& p_submit) {
+        int submitted = 0;
+        bool higherBusy = false;
+        for (int c = 0; c < kIOClasses; c++) {
+            int limit = higherBusy && m_budget[c] > 0 ? m_budget[c] : m_depth[c];
+            if (limit <= 0)
+                limit = INT_MAX;
+            std::deque<T>& pending = m_pending[c];
+            while (!pending.empty() && m_inflight[c] < limit) {
+                if (!p_submit(pending.front()))
+                    return submitted;
+                pending.pop_front();
+                m_inflight[c]++;
+                submitted++;
+            }
+            higherBusy = higherBusy || m_inflight[c] > 0 || !pending.empty();
+        }
+        return submitted;
+    }
+
+    inline void Complete(int p_class) {
+        m_inflight[p_class]--;
+    }
+
+    inline int Inflight(int p_class) const {
+        return m_inflight[p_class];
+    }
+
+    inline size_t Pending(int p_class) const {
+        return m_pending[p_class].size();
+    }
+
+    inline bool Idle() const {
+        for (int c = 0; c < kIOClasses; c++) {
+            if (m_inflight[c] > 0 || !m_pending[c].empty())
+                return false;
+        }
+        return true;
+    }
+
+   private:
+    std::deque<T> m_pending[kIOClasses];
+    int m_inflight[kIOClasses] = {};
+    int m_depth[kIOClasses];
+    int m_budget[kIOClasses];
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_IOCLASS_H_
@@ -0,0 +1,232 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_IOTRACE_H_
+#define _SPTAG_SPANN_IOTRACE_H_
+
+#include "Core/Common.h"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <string>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Block-level I/O trace of a device: a submit and a complete record per command in a fixed-size
+// ring file, so the I/O pattern behind a latency anomaly can be replayed offline with io_replay.
+// SPFRESH_IO_TRACE names the file and turns tracing on, SPFRESH_IO_TRACE_MB sizes the ring; once
+// it is full the oldest records are overwritten. Further devices of the process trace into the
+// same name with .1, .2, ... appended
+static constexpr const char* kIOTraceEnv = "SPFRESH_IO_TRACE";
+static constexpr const char* kIOTraceMBEnv = "SPFRESH_IO_TRACE_MB";
+static constexpr int kIOTraceDefaultMB = 64;
+
+enum class IOTraceEvent : std::uint8_t { Submit = 0, Complete = 1 };
+enum class IOTraceOp : std::uint8_t { Read = 0, Write = 1 };
+
+struct IOTraceRecord {
+    std::uint64_t seq;        // 1-based position in the trace, written last; 0 marks an empty or torn slot
+    std::uint64_t command;    // the same for the submit and the complete of one command
+    std::uint64_t timeNs;     // steady clock
+    std::uint64_t offset;     // bytes into the block address space of the device
+    std::uint32_t length;     // bytes
+    std::int32_t posting;     // posting the command is for, -1 when unknown or shared by several
+    std::uint8_t event;       // IOTraceEvent
+    std::uint8_t op;          // IOTraceOp
+    std::uint8_t ioClass;     // IOClass of the issuing thread
+    std::uint8_t device;      // bdev of a multi-device SPDK store
+    std::uint32_t latencyUs;  // complete only, since the submit
+};
+static_assert(sizeof(IOTraceRecord) == 48, "trace records are read back as raw bytes");
+
+// first page of the file, the records follow it. next and commands are counted up atomically
+struct IOTraceHeader {
+    static constexpr std::uint64_t kMagic = 0x3143525430495053ull;  // "SPI0TRC1"
+    static constexpr std::size_t kBytes = 4096;
+
+    std::uint64_t magic;
+    std::uint32_t recordSize;
+    std::uint32_t pageSize;
+    std::uint64_t capacity;
+    std::uint64_t next;
+    std::uint64_t commands;
+};
+
+// posting of the I/O issued by the calling thread: one key, or the keys of a multi-posting read
+// indexed like its requests. Set by the key-value store, read by the device on submission
+struct IOTraceTag {
+    SizeType key = -1;
+    const SizeType* keys = nullptr;
+    std::size_t keyCount = 0;
+
+    inline std::int32_t Of(int p_request) const {
+        if (keys != nullptr)
+            return p_request >= 0 && (std::size_t)p_request < keyCount ? (std::int32_t)keys[p_request] : -1;
+        return (std::int32_t)key;
+    }
+};
+
+inline IOTraceTag& CurrentIOTraceTag() {
+    static thread_local IOTraceTag tag;
+    return tag;
+}
+
+class IOTraceTagScope {
+   public:
+    explicit IOTraceTagScope(SizeType p_key)
+        : m_saved(CurrentIOTraceTag()) {
+        CurrentIOTraceTag() = IOTraceTag();
+        CurrentIOTraceTag().key = p_key;
+    }
+
+    IOTraceTagScope(const SizeType* p_keys, std::size_t p_keyCount)
+        : m_saved(CurrentIOTraceTag()) {
+        CurrentIOTraceTag() = IOTraceTag();
+        CurrentIOTraceTag().keys = p_keys;
+        CurrentIOTraceTag().keyCount = p_keyCount;
+    }
+
+    ~IOTraceTagScope() {
+        CurrentIOTraceTag() = m_saved;
+    }
+
+    IOTraceTagScope(const IOTraceTagScope&) = delete;
+    IOTraceTagScope& operator=(const IOTraceTagScope&) = delete;
+
+   private:
+    IOTraceTag m_saved;
+};
+
+// Appends records to the ring of a shared file mapping: a slot is claimed with one atomic add and
+// filled in place, no lock and no system call on the I/O path, the page cache writes it back
+class IOTraceWriter {
+   public:
+    IOTraceWriter() = default;
+
+    ~IOTraceWriter() {
+        Close();
+    }
+
+    IOTraceWriter(const IOTraceWriter&) = delete;
+    IOTraceWriter& operator=(const IOTraceWriter&) = delete;
+
+    // the path and ring size from the environment, nothing happens when SPFRESH_IO_TRACE is unset
+    bool OpenFromEnv() {
+        const char* path = getenv(kIOTraceEnv);
+        if (path == nullptr || *path == '\0')
+            return false;
+        const char* mb = getenv(kIOTraceMBEnv);
+        static std::atomic<int> devices{0};
+        int device = devices.fetch_add(1);
+        std::string file = device == 0 ? std::string(path) : std::string(path) + "." + std::to_string(device);
+        return Open(file, (std::uint64_t)std::max(1, mb != nullptr ? atoi(mb) : kIOTraceDefaultMB) << 20);
+    }
+
+    bool Open(const std::string& p_path, std::uint64_t p_bytes) {
+        Close();
+        std::uint64_t capacity = std::max<std::uint64_t>(p_bytes / sizeof(IOTraceRecord), 1);
+        std::size_t length = IOTraceHeader::kBytes + capacity * sizeof(IOTraceRecord);
+        int fd = open(p_path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0 || ftruncate(fd, (off_t)length) != 0) {
+            LOG(Helper::LogLevel::LL_Error, "IOTrace: cannot create %s: %s\n", p_path.c_str(), strerror(errno));
+            if (fd >= 0)
+                close(fd);
+            return false;
+        }
+        void* base = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        close(fd);
+        if (base == MAP_FAILED) {
+            LOG(Helper::LogLevel::LL_Error, "IOTrace: cannot map %s: %s\n", p_path.c_str(), strerror(errno));
+            return false;
+        }
+        m_base = (char*)base;
+        m_length = length;
+        m_header = new (m_base) IOTraceHeader();
+        m_header->magic = IOTraceHeader::kMagic;
+        m_header->recordSize = sizeof(IOTraceRecord);
+        m_header->pageSize = PageSize;
+        m_header->capacity = capacity;
+        m_header->next = 0;
+        m_header->commands = 0;
+        m_records = (IOTraceRecord*)(m_base + IOTraceHeader::kBytes);
+        LOG(Helper::LogLevel::LL_Info, "IOTrace: recording into %s, %llu records\n", p_path.c_str(), (unsigned long long)capacity);
+        return true;
+    }
+
+    void Close() {
+        if (m_base == nullptr)
+            return;
+        msync(m_base, m_length, MS_SYNC);
+        munmap(m_base, m_length);
+        m_base = nullptr;
+        m_header = nullptr;
+        m_records = nullptr;
+    }
+
+    inline bool Enabled() const {
+        return m_records != nullptr;
+    }
+
+    // id pairing the records of a new command
+    inline std::uint64_t NextCommand() {
+        return __atomic_add_fetch(&m_header->commands, 1, __ATOMIC_RELAXED);
+    }
+
+    inline void Record(IOTraceEvent p_event, std::uint64_t p_command, IOTraceOp p_op, int p_ioClass, int p_device, std::uint64_t p_offset, std::uint32_t p_length, std::int32_t p_posting, std::uint32_t p_latencyUs = 0) {
+        std::uint64_t seq = __atomic_add_fetch(&m_header->next, 1, __ATOMIC_RELAXED);
+        IOTraceRecord& record = m_records[(seq - 1) % m_header->capacity];
+        __atomic_store_n(&record.seq, 0, __ATOMIC_RELAXED);
+        std::atomic_thread_fence(std::memory_order_release);
+        record.command = p_command;
+        record.timeNs = (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+        record.offset = p_offset;
+        record.length = p_length;
+        record.posting = p_posting;
+        record.event = (std::uint8_t)p_event;
+        record.op = (std::uint8_t)p_op;
+        record.ioClass = (std::uint8_t)p_ioClass;
+        record.device = (std::uint8_t)p_device;
+        record.latencyUs = p_latencyUs;
+        __atomic_store_n(&record.seq, seq, __ATOMIC_RELEASE);
+    }
+
+   private:
+    char* m_base = nullptr;
+    std::size_t m_length = 0;
+    IOTraceHeader* m_header = nullptr;
+    IOTraceRecord* m_records = nullptr;
+};
+
+// the records still in a trace file, oldest first; torn slots are skipped
+inline bool ReadIOTrace(const std::string& p_path, std::vector<IOTraceRecord>& p_records) {
+    p_records.clear();
+    FILE* in = fopen(p_path.c_str(), "rb");
+    if (in == nullptr)
+        return false;
+    IOTraceHeader header;
+    bool ok = fread(&header, sizeof(header), 1, in) == 1 && header.magic == IOTraceHeader::kMagic && header.recordSize == sizeof(IOTraceRecord) && fseek(in, (long)IOTraceHeader::kBytes, SEEK_SET) == 0;
+    if (ok) {
+        std::uint64_t next = header.next;
+        std::uint64_t count = std::min(next, header.capacity);
+        p_records.resize(count);
+        ok = count == 0 || fread(p_records.data(), sizeof(IOTraceRecord), count, in) == count;
+        std::uint64_t oldest = next - count;
+        p_records.erase(std::remove_if(p_records.begin(), p_records.end(), [oldest, next](const IOTraceRecord& r) { return r.seq <= oldest || r.seq > next; }), p_records.end());
+        std::sort(p_records.begin(), p_records.end(), [](const IOTraceRecord& a, const IOTraceRecord& b) { return a.seq < b.seq; });
+    }
+    fclose(in);
+    return ok;
+}
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_IOTRACE_H_
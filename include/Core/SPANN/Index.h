@@ -14,6 +14,7 @@
 #include "Utils/SIMDUtils.h"
 #include "Core/Common/QueryResultSet.h"
 #include "Core/Common/BKTree.h"
+#include "Core/Common/MiniBatchKmeans.h"
 #include "Core/Common/WorkSpacePool.h"
 
 #include "Core/Common/Labelset.h"
@@ -21,14 +22,21 @@
 #include "Helper/StringConvert.h"
 #include "Helper/ThreadPool.h"
 #include "Helper/ConcurrentSet.h"
+#include "Helper/Metrics.h"
 #include "Helper/VectorSetReader.h"
 
 #include "Core/Common/VersionLabel.h"
 #include "ExtraDynamicSearcher.h"
+#include "ResultCache.h"
+#include "WriteAheadLog.h"
 #include "Options.h"
 
+#include <condition_variable>
+#include <deque>
 #include <functional>
+#include <future>
 #include <shared_mutex>
+#include <thread>
 
 namespace SPTAG::SPANN {
 template <typename T>
@@ -40,18 +48,68 @@ class Index {
 
     std::shared_ptr<ExtraDynamicSearcher<T>> m_extraSearcher;
 
+    // full precision vectors rescoring the top ADC results, mapped from the vector file
+    std::shared_ptr<VectorSet> m_rerankVectors;
+    bool m_rerankNormalized = true;
+    // with VectorStore the exact vectors come from the store of the extra searcher instead
+    bool m_rerankFromStore = false;
+
     Options m_options;
 
     std::function<float(const T*, const T*, DimensionType)> m_fComputeDistance;
     int m_iBaseSquare;
 
+    // only taken when the log is open or metadata is kept: the version map hands out VIDs
+    // lock-free, but log records and metadata have to follow VID order
     std::mutex m_dataAddLock;
     COMMON::VersionLabel m_versionMap;
+    // label masks for filtered searches, allocated by the first SetVectorLabels
+    VectorLabels m_labels;
+    // inserts get their record under m_dataAddLock, so LSN order is VID order
+    WriteAheadLog m_wal;
+    // replayed inserts wait for the background jobs instead of failing the load
+    bool m_replayingWAL = false;
 
     bool m_bReady;
     std::shared_ptr<MetadataSet> m_pMetadata;
     MetaDataManager m_metadataManager;
 
+    // queries waiting for an async search thread, the threads start with the first SearchIndexAsync
+    struct AsyncRequest {
+        QueryResult* m_query;
+        std::function<void(ErrorCode)> m_callback;
+    };
+    mutable std::mutex m_asyncLock;
+    mutable std::condition_variable m_asyncCond;
+    mutable std::deque<AsyncRequest> m_asyncQueue;
+    mutable std::vector<std::thread> m_asyncThreads;
+    mutable bool m_asyncStop = false;
+
+    // searches answered, and the endpoint serving CollectMetrics when MetricsPort is set
+    mutable std::atomic<std::uint64_t> m_queryCount{0};
+    std::unique_ptr<Helper::MetricsServer> m_metricsServer;
+
+    // results of unfiltered searches, see ResultCache. Hits are not in m_queryCount. With
+    // ResultCacheInvalidation Global an entry holds until any update runs, otherwise until a
+    // posting it probed changes or a result is deleted
+    mutable ResultCache m_resultCache;
+    bool m_resultCacheGlobal = false;
+
+    // online tuning, see AutoTuner: queries whose farthest probed head was still within
+    // ProbeStopRatio of their k-th result, the controller thread and the totals at its last step
+    mutable std::atomic<std::uint64_t> m_probeLimitedCount{0};
+    AutoTuner m_tuner;
+    std::mutex m_tunerStepLock;
+    std::mutex m_tunerLock;
+    std::condition_variable m_tunerWake;
+    std::thread m_tunerThread;
+    bool m_tunerStop = false;
+    StageSnapshot m_tunerStages;
+    std::uint64_t m_tunerQueries = 0;
+    std::uint64_t m_tunerProbeLimited = 0;
+    std::uint64_t m_tunerSplits = 0;
+    SizeType m_tunerVectors = 0;
+
    public:
     int m_iDataBlockSize;
     int m_iDataCapacity;
@@ -63,10 +121,17 @@ class Index {
    public:
     Index() : m_bReady(false), m_iDataBlockSize(1024 * 1024), m_iDataCapacity(MaxSize), m_iMetaRecordSize(10) {
         m_fComputeDistance = std::function<float(const T*, const T*, DimensionType)>(COMMON::DistanceCalcSelector<T>(m_options.m_distCalcMethod));
-        m_iBaseSquare = (m_options.m_distCalcMethod == DistCalcMethod::Cosine) ? COMMON::Utils::GetBase<T>() * COMMON::Utils::GetBase<T>() : 1;
+        m_iBaseSquare = (m_options.m_distCalcMethod != DistCalcMethod::L2) ? COMMON::Utils::GetBase<T>() * COMMON::Utils::GetBase<T>() : 1;
     }
 
-    ~Index() {}
+    ~Index() {
+        StopAutoTuner();
+        if (m_metricsServer != nullptr)
+            m_metricsServer->Stop();
+        StopAsyncSearch();
+        if (m_extraSearcher != nullptr)
+            m_extraSearcher->StopRecordCheckpoints();
+    }
 
     inline std::shared_ptr<BKT::Index<T>> GetMemoryIndex() {
         return m_index;
@@ -78,6 +143,10 @@ class Index {
         return &m_options;
     }
 
+    // search scratch of the calling thread: result sets, posting views and scan buffers reused by
+    // every query this thread runs, created on first use. Valid until the thread exits
+    ExtraWorkSpace* GetWorkSpace() const;
+
     inline SizeType GetNumSamples() const {
         return m_versionMap.Count();
     }
@@ -151,6 +220,30 @@ class Index {
     ErrorCode BuildIndex(const void* p_data, SizeType p_vectorNum, DimensionType p_dimension, bool p_normalized = false, bool p_shareOwnership = false);
     ErrorCode BuildIndex(bool p_normalized = false);
     ErrorCode SearchIndex(QueryResult& p_query, bool p_searchDeleted = false, SearchStats* p_stats = nullptr) const;
+    // only vectors whose labels p_filter keeps are returned: the posting scan drops the others before
+    // computing their distances, and the fewer vectors the filter keeps the more postings are probed
+    ErrorCode SearchIndex(QueryResult& p_query, const LabelFilter& p_filter, SearchStats* p_stats = nullptr) const;
+    // label masks of vectors [p_begin, p_begin + p_count), bit i for attribute i; unlabeled vectors have none
+    ErrorCode SetVectorLabels(SizeType p_begin, SizeType p_count, const std::uint64_t* p_labels);
+    inline std::uint64_t GetVectorLabels(SizeType p_vid) const {
+        return m_labels.Get(p_vid);
+    }
+    // every vector within p_radius of p_target, handed to p_onResult as the postings are scanned, nearest
+    // heads first and unordered within them, until it returns false or p_limit results went out (no
+    // limit when p_limit <= 0). A posting is not read when its head is farther from p_target than
+    // p_radius plus the posting's radius, in the square root of the L2 or cosine distance
+    ErrorCode RangeSearch(const void* p_target, float p_radius, const std::function<bool(SizeType, float)>& p_onResult, int p_limit = 0, SearchStats* p_stats = nullptr) const;
+    // the same results collected into p_results, sorted by distance
+    ErrorCode RangeSearch(const void* p_target, float p_radius, std::vector<BasicResult>& p_results, int p_limit = 0, SearchStats* p_stats = nullptr) const;
+    // search a batch of queries together, postings selected by several of them are read and scanned once
+    ErrorCode SearchIndexBatch(std::vector<QueryResult>& p_queries, SearchStats* p_stats = nullptr) const;
+    // queue p_query and return at once, p_callback runs on an async search thread once the results are in
+    // p_query, which must stay alive until then. every thread takes up to AsyncBatchSize waiting queries
+    // and searches them as one batch, so a few threads keep the reads of many queries in flight
+    ErrorCode SearchIndexAsync(QueryResult& p_query, std::function<void(ErrorCode)> p_callback) const;
+    std::future<ErrorCode> SearchIndexAsync(QueryResult& p_query) const;
+    // search the queued queries and stop the async search threads, later SearchIndexAsync calls restart them
+    void StopAsyncSearch() const;
     ErrorCode SearchDiskIndex(QueryResult& p_query, SearchStats* p_stats = nullptr) const;
     ErrorCode DebugSearchDiskIndex(QueryResult& p_query, int p_subInternalResultNum, int p_internalResultNum, SearchStats* p_stats = nullptr, std::set<int>* truth = nullptr, std::map<int, std::set<int>>* found = nullptr) const;
     ErrorCode UpdateIndex();
@@ -232,7 +325,10 @@ class Index {
 
         size_t metaStart = p_index->GetIndexFiles()->size();
         if (iniReader.DoesSectionExist("MetaData")) {
-            p_index->SetMetadata(new SPTAG::MemMetadataSet(handles[metaStart], handles[metaStart + 1], p_index->m_iDataBlockSize, p_index->m_iDataCapacity, p_index->m_iMetaRecordSize));
+            if (p_index->m_options.m_mappedMetadata)
+                p_index->SetMetadata(new SPTAG::MappedMetadataSet(folderPath + p_index->m_metadataManager.GetMetadataFile(), folderPath + p_index->m_metadataManager.GetMetadataIndexFile()));
+            else
+                p_index->SetMetadata(new SPTAG::MemMetadataSet(handles[metaStart], handles[metaStart + 1], p_index->m_iDataBlockSize, p_index->m_iDataCapacity, p_index->m_iMetaRecordSize));
 
             if (!(p_index->GetMetadata()->Available())) {
                 LOG(Helper::LogLevel::LL_Error, "Error: Failed to load metadata.\n");
@@ -244,6 +340,8 @@ class Index {
             }
         }
         p_index->m_bReady = true;
+        p_index->StartMetricsExporter();
+        p_index->StartAutoTuner();
         return ErrorCode::Success;
     }
     ErrorCode RefineSearchIndex(QueryResult& p_query, bool p_searchDeleted = false) const {
@@ -257,6 +355,10 @@ class Index {
     ErrorCode AddIndexIdx(SizeType begin, SizeType end);
     ErrorCode DeleteIndex(const SizeType& p_id);
 
+    // batch deletes: the vector form looks all vectors up together, both forms log and apply
+    // the found IDs as one batch; Success only when every entry was found
+    ErrorCode DeleteIndex(const std::vector<SizeType>& p_ids);
+    ErrorCode DeleteIndex(const std::vector<ByteArray>& p_metas);
     ErrorCode DeleteIndex(const void* p_vectors, SizeType p_vectorNum);
     ErrorCode DeleteIndex(ByteArray p_meta);
     const void* GetSample(ByteArray p_meta, bool& deleteFlag);
@@ -269,7 +371,31 @@ class Index {
 
    private:
     bool CheckHeadIndexType();
+    // hand HugePageMB and NumaPlacement to the head index and the version labels before they allocate
+    void ApplyMemoryPolicy();
     void SelectHeadAdjustOptions(int p_vectorCount);
+    ErrorCode SearchIndexBatch(std::vector<QueryResult*>& p_queries, SearchStats* p_stats) const;
+    // both SearchIndex forms, p_filter is nullptr for an unfiltered query
+    ErrorCode SearchWithFilter(QueryResult& p_query, const LabelFilter* p_filter, SearchStats* p_stats) const;
+    // the labels saved at VectorLabelFile, if there are any
+    ErrorCode LoadVectorLabels();
+    void AsyncSearchLoop() const;
+    // open the log at WALPath, replaying it first when the index was loaded rather than built
+    ErrorCode OpenWriteAheadLog(bool p_replay);
+    // the gate inserts, deletes and label updates pass so a backup sees none of them half done,
+    // nullptr without an update-capable searcher
+    WriteGate* UpdateGate() {
+        return m_extraSearcher != nullptr ? &m_extraSearcher->GetWriteGate() : nullptr;
+    }
+    // the results p_query gets from m_resultCache under p_key, false when there are none still valid
+    bool SearchResultCache(QueryResult& p_query, const ResultCache::Key& p_key) const;
+    bool CachedResultValid(const ResultCache::Entry& p_entry) const;
+    // read the candidate postings in m_workspace->m_probeIDs wave by wave, closest heads first
+    void SearchPostingsInWaves(COMMON::QueryResultSet<T>& p_queryResults, int p_resultNum, SearchStats* p_stats) const;
+    // with EnableADC and ADCRerank > 0 keep the full vectors of p_reader, or of the vector file when it is nullptr
+    ErrorCode PrepareRerank(std::shared_ptr<Helper::VectorSetReader<T>> p_reader = nullptr);
+    // replace the ADC distances of the first ADCRerank results by the exact ones and re-sort them
+    void RerankResults(COMMON::QueryResultSet<T>& p_queryResults) const;
     int SelectHeadDynamicallyInternal(const std::shared_ptr<COMMON::BKTree> p_tree, int p_nodeID, const Options& p_opts, std::vector<int>& p_selected);
     void SelectHeadDynamically(const std::shared_ptr<COMMON::BKTree> p_tree, int p_vectorCount, std::vector<int>& p_selected);
 
@@ -288,10 +414,109 @@ class Index {
         LOG(Helper::LogLevel::LL_Info, "Current Vector Num: %d, Deleted: %d .\n", GetNumSamples(), GetNumDeleted());
     }
 
+    // everything the index counts in the Prometheus text format, what the metrics endpoint serves
+    void CollectMetrics(Helper::MetricsWriter& p_writer) {
+        p_writer.Counter("sptag_queries_total", "Queries searched", (double)m_queryCount.load(std::memory_order_relaxed));
+        p_writer.Gauge("sptag_vectors", "Vector ids handed out, deleted ones included", GetNumSamples());
+        p_writer.Gauge("sptag_deleted_vectors", "Vectors deleted", GetNumDeleted());
+        if (m_resultCache.Enabled()) {
+            p_writer.Counter("sptag_result_cache_hits_total", "Queries answered from the result cache", (double)m_resultCache.Hits());
+            p_writer.Counter("sptag_result_cache_misses_total", "Result cache lookups finding no valid entry", (double)m_resultCache.Misses());
+            p_writer.Gauge("sptag_result_cache_bytes", "Bytes held by the result cache", (double)m_resultCache.Bytes());
+        }
+        if (m_extraSearcher != nullptr)
+            m_extraSearcher->CollectMetrics(p_writer, m_index.get());
+    }
+
+    // serves CollectMetrics on MetricsBindAddress:MetricsPort once the index is ready, a failed
+    // bind is logged and the index runs on without it
+    void StartMetricsExporter() {
+        if (m_options.m_metricsPort <= 0 || m_metricsServer != nullptr)
+            return;
+        m_metricsServer.reset(new Helper::MetricsServer());
+        if (!m_metricsServer->Start(m_options.m_metricsBindAddress, m_options.m_metricsPort, [this] {
+                Helper::MetricsWriter writer;
+                CollectMetrics(writer);
+                return writer.Text();
+            }))
+            m_metricsServer.reset();
+    }
+
+    // every AutoTuneIntervalMs an AutoTuneStep, from the point the index is ready until StopAutoTuner
+    void StartAutoTuner();
+
+    void StopAutoTuner();
+
+    // one step of the tuner over what happened since the last one: the knobs with an AutoTune
+    // range are moved through SetParameter and the changes logged and returned
+    std::vector<TunerChange> AutoTuneStep();
+
+    // postings most often read, appended to or split lately, see PostingHeat
+    std::vector<PostingHeat::Entry> GetHotPostings(HeatKind p_kind, int p_top) {
+        return m_extraSearcher->HotPostings(p_kind, p_top);
+    }
+
+    ErrorCode DumpPostingHeat(const std::string& p_path) {
+        return m_extraSearcher->DumpPostingHeat(p_path, m_index.get());
+    }
+
     void GetIndexStat(int finishedInsert, bool cost, bool reset) {
         m_extraSearcher->GetIndexStats(finishedInsert, cost, reset);
     }
 
+    void GetGCProgress(size_t& p_pending, std::uint64_t& p_collected, std::uint64_t& p_reclaimed) {
+        m_extraSearcher->GetGCProgress(p_pending, p_collected, p_reclaimed);
+    }
+
+    // one pass of the tiering otherwise run every TieringIntervalMs, returns the postings moved
+    int TierPostings() {
+        return m_extraSearcher->TierPostings(m_index.get());
+    }
+
+    void GetTierState(std::vector<SizeType>& p_postings, size_t& p_residentBytes) {
+        m_extraSearcher->GetTierState(m_index.get(), p_postings, p_residentBytes);
+    }
+
+    // Online backup into p_dir, taken while inserts and deletes go on: they are held only while the
+    // in-memory structures are copied, the postings are streamed out in the background. p_dir gets
+    // backup.ini last, whose sections are the options that open the backup in place of the live
+    // files and whose [Backup] WALLSN is the last log record the backup contains
+    ErrorCode BeginBackup(const std::string& p_dir);
+
+    ErrorCode WaitBackup() {
+        return m_extraSearcher == nullptr ? ErrorCode::Success : m_extraSearcher->WaitBackup();
+    }
+
+    void GetBackupProgress(std::uint64_t& p_bytes, bool& p_running) {
+        p_bytes = 0;
+        p_running = false;
+        if (m_extraSearcher != nullptr)
+            m_extraSearcher->GetBackupProgress(p_bytes, p_running);
+    }
+
+    // fault in the mapped metadata and read the postings of WarmPostingFile into the posting cache
+    // in the background, done by every load. SaveWarmPostings lists the hottest postings by hand
+    void WarmStart() {
+        if (m_extraSearcher != nullptr)
+            m_extraSearcher->WarmStart();
+    }
+
+    void WaitWarmStart() {
+        if (m_extraSearcher != nullptr)
+            m_extraSearcher->WaitWarmStart();
+    }
+
+    ErrorCode SaveWarmPostings(const std::string& p_path) {
+        return m_extraSearcher == nullptr ? ErrorCode::EmptyIndex : m_extraSearcher->SaveWarmPostings(p_path, m_index.get());
+    }
+
+    void GetWarmStartProgress(SizeType& p_warmed, SizeType& p_total, bool& p_running) {
+        p_warmed = p_total = 0;
+        p_running = false;
+        if (m_extraSearcher != nullptr)
+            m_extraSearcher->GetWarmStartProgress(p_warmed, p_total, p_running);
+    }
+
     void StopMerge() {
         m_options.m_inPlace = true;
     }
@@ -322,28 +547,23 @@ class Index {
             return ErrorCode::EmptyData;
         if (p_dimension != GetFeatureDim())
             return ErrorCode::DimensionSizeMismatch;
+        ErrorCode admitted = m_extraSearcher->AdmitInsert(m_options.m_insertWaitTimeout);
+        if (admitted != ErrorCode::Success)
+            return admitted;
+        WriteGate::Scope gate(UpdateGate());
 
-        SizeType begin, end;
-        {
-            std::lock_guard<std::mutex> lock(m_dataAddLock);
-
-            begin = m_versionMap.GetVectorNum();
-            end = begin + p_vectorNum;
-
-            if (begin == 0) {
-                return ErrorCode::EmptyIndex;
-            }
-
-            if (m_versionMap.AddBatch(p_vectorNum) != ErrorCode::Success) {
-                LOG(Helper::LogLevel::LL_Info, "MemoryOverFlow: VID: %d, Map Size:%d\n", begin, m_versionMap.BufferSize());
-                exit(1);
-            }
-        }
-        for (int i = 0; i < p_vectorNum; i++)
-            VID[i] = begin + i;
-
+        // Cosine vectors go in with their norms, a zero vector among them takes the normalized copy
         std::shared_ptr<VectorSet> vectorSet;
+        std::vector<double> norms;
         if (m_options.m_distCalcMethod == DistCalcMethod::Cosine) {
+            norms.resize(p_vectorNum);
+            for (SizeType i = 0; i < p_vectorNum && !norms.empty(); i++) {
+                norms[i] = COMMON::Utils::Norm((const T*)p_data + (size_t)i * p_dimension, p_dimension);
+                if (norms[i] < 1e-6)
+                    norms.clear();
+            }
+        }
+        if (m_options.m_distCalcMethod == DistCalcMethod::Cosine && norms.empty()) {
             ByteArray arr = ByteArray::Alloc(sizeof(T) * p_vectorNum * p_dimension);
             memcpy(arr.Data(), p_data, sizeof(T) * p_vectorNum * p_dimension);
             vectorSet.reset(new BasicVectorSet(arr, GetEnumValueType<T>(), p_dimension, p_vectorNum));
@@ -355,7 +575,31 @@ class Index {
             vectorSet.reset(new BasicVectorSet(ByteArray((std::uint8_t*)p_data, sizeof(T) * p_vectorNum * p_dimension, false), GetEnumValueType<T>(), p_dimension, p_vectorNum));
         }
 
-        return m_extraSearcher->AddIndex(vectorSet, m_index, begin);
+        SizeType begin, end;
+        std::uint64_t lsn = 0;
+        {
+            std::unique_lock<std::mutex> lock(m_dataAddLock, std::defer_lock);
+            if (m_wal.IsOpen())
+                lock.lock();
+
+            if (m_versionMap.GetVectorNum() == 0) {
+                return ErrorCode::EmptyIndex;
+            }
+
+            if (m_versionMap.AddBatch(p_vectorNum, &begin) != ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Info, "MemoryOverFlow: VID: %d, Map Size:%d\n", m_versionMap.GetVectorNum(), m_versionMap.BufferSize());
+                exit(1);
+            }
+            end = begin + p_vectorNum;
+            if (m_wal.IsOpen())
+                lsn = m_wal.Append(norms.empty() ? WriteAheadLog::RecordType::Insert : WriteAheadLog::RecordType::InsertRaw, begin, p_vectorNum, vectorSet->GetData(), sizeof(T) * p_vectorNum * p_dimension);
+        }
+        for (int i = 0; i < p_vectorNum; i++)
+            VID[i] = begin + i;
+
+        if (lsn != 0 && !m_wal.Commit(lsn))
+            return ErrorCode::DiskIOFail;
+        return m_extraSearcher->AddIndex(vectorSet, m_index, begin, norms.empty() ? nullptr : norms.data());
     }
 };
 
@@ -0,0 +1,180 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_MAPPINGJOURNAL_H_
+#define _SPTAG_SPANN_MAPPINGJOURNAL_H_
+
+#include "Core/Common.h"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Append-only delta log of block mapping updates. Each entry is
+// [SizeType key][int count][count x std::int64_t]: the full address array of the
+// posting (size followed by its blocks), or count = -1 when the posting was deleted.
+// Entries are idempotent, so replaying a journal over any snapshot taken after the
+// journal was opened yields the latest mapping. A torn last entry is ignored.
+class MappingJournal {
+   public:
+    typedef std::int64_t AddressType;
+
+    static constexpr size_t kDefaultFlushBytes = 64 * 1024;
+
+    MappingJournal() {}
+
+    ~MappingJournal() {
+        Close();
+    }
+
+    bool Open(const std::string& p_path, size_t p_flushBytes = kDefaultFlushBytes) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_path = p_path;
+        m_flushBytes = p_flushBytes;
+        m_fd = open(p_path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if (m_fd < 0) {
+            LOG(Helper::LogLevel::LL_Error, "MappingJournal: cannot open %s\n", p_path.c_str());
+            return false;
+        }
+        m_size = lseek(m_fd, 0, SEEK_END);
+        return true;
+    }
+
+    bool IsOpen() const {
+        return m_fd >= 0;
+    }
+
+    // returns the LSN of the entry, the journal bytes appended through it over all rotations.
+    // 0 when the journal is closed
+    std::uint64_t Append(SizeType p_key, const AddressType* p_entries, int p_count) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_fd < 0) return 0;
+        size_t offset = m_buffer.size();
+        size_t bytes = sizeof(SizeType) + sizeof(int) + sizeof(AddressType) * (p_count > 0 ? p_count : 0);
+        m_buffer.resize(offset + bytes);
+        char* dst = m_buffer.data() + offset;
+        memcpy(dst, &p_key, sizeof(SizeType));
+        memcpy(dst + sizeof(SizeType), &p_count, sizeof(int));
+        if (p_count > 0) memcpy(dst + sizeof(SizeType) + sizeof(int), p_entries, sizeof(AddressType) * p_count);
+        m_size += bytes;
+        m_appended += bytes;
+        if (m_buffer.size() >= m_flushBytes) FlushLocked(false);
+        return m_appended;
+    }
+
+    // write buffered entries, p_sync also makes them durable
+    bool Flush(bool p_sync) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return FlushLocked(p_sync);
+    }
+
+    // make the entries up to p_lsn durable, syncing only when an earlier call did not. A closed
+    // journal was synced by Close
+    bool SyncTo(std::uint64_t p_lsn) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_fd < 0 || m_durable >= p_lsn) return true;
+        return FlushLocked(true);
+    }
+
+    // LSN of the last entry known to be on disk
+    std::uint64_t Durable() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_durable;
+    }
+
+    // bytes in the journal, including buffered ones
+    std::uint64_t Size() const {
+        return m_size;
+    }
+
+    // make the current journal durable, move it to p_oldPath and continue in a fresh file
+    bool Rotate(const std::string& p_oldPath) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_fd < 0) return false;
+        if (!FlushLocked(true)) return false;
+        close(m_fd);
+        m_fd = -1;
+        if (std::rename(m_path.c_str(), p_oldPath.c_str()) != 0) {
+            LOG(Helper::LogLevel::LL_Error, "MappingJournal: cannot rotate %s\n", m_path.c_str());
+        }
+        m_fd = open(m_path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_TRUNC, 0644);
+        m_size = 0;
+        return m_fd >= 0;
+    }
+
+    void Close() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_fd < 0) return;
+        FlushLocked(true);
+        close(m_fd);
+        m_fd = -1;
+    }
+
+    // call p_apply(key, entries, count) for every complete entry of the journal at p_path
+    static std::uint64_t Replay(const std::string& p_path, const std::function<void(SizeType, const AddressType*, int)>& p_apply) {
+        FILE* fp = fopen(p_path.c_str(), "rb");
+        if (fp == nullptr) return 0;
+        std::uint64_t count = 0;
+        std::vector<AddressType> entries;
+        SizeType key;
+        int num;
+        while (fread(&key, sizeof(SizeType), 1, fp) == 1 && fread(&num, sizeof(int), 1, fp) == 1) {
+            if (num > 0) {
+                entries.resize(num);
+                if (fread(entries.data(), sizeof(AddressType), num, fp) != (size_t)num) break;
+            }
+            p_apply(key, entries.data(), num);
+            count++;
+        }
+        fclose(fp);
+        return count;
+    }
+
+    // make a file written through buffered streams durable before it is renamed into place
+    static void SyncFile(const std::string& p_path) {
+        int fd = open(p_path.c_str(), O_RDONLY);
+        if (fd < 0) return;
+        fsync(fd);
+        close(fd);
+    }
+
+   private:
+    bool FlushLocked(bool p_sync) {
+        if (m_fd < 0) return false;
+        size_t written = 0;
+        while (written < m_buffer.size()) {
+            ssize_t ret = write(m_fd, m_buffer.data() + written, m_buffer.size() - written);
+            if (ret < 0) {
+                LOG(Helper::LogLevel::LL_Error, "MappingJournal: write to %s failed\n", m_path.c_str());
+                return false;
+            }
+            written += ret;
+        }
+        m_buffer.clear();
+        if (!p_sync) return true;
+        if (fdatasync(m_fd) != 0) {
+            LOG(Helper::LogLevel::LL_Error, "MappingJournal: sync of %s failed\n", m_path.c_str());
+            return false;
+        }
+        m_durable = m_appended;
+        return true;
+    }
+
+    std::mutex m_lock;
+    std::string m_path;
+    int m_fd = -1;
+    size_t m_flushBytes = kDefaultFlushBytes;
+    std::vector<char> m_buffer;
+    std::uint64_t m_size = 0;
+    std::uint64_t m_appended = 0;
+    std::uint64_t m_durable = 0;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_MAPPINGJOURNAL_H_
@@ -39,6 +39,8 @@ class Options {
     int m_ssdIndexFileNum;
     int m_datasetRowsInBlock;
     int m_datasetCapacity;
+    bool m_resumeBuild;
+    std::string m_buildCheckpointFile;
 
     // Section 2: for selecting head
     bool m_selectHead;
@@ -47,6 +49,8 @@ class Options {
     int m_iBKTLeafSize;
     int m_iSamples;
     float m_fBalanceFactor;
+    int m_iBKTKmeansBatch;
+    float m_fBKTKmeansTolerance;
     int m_iSelectHeadNumberOfThreads;
     bool m_saveBKT;
     // analyze
@@ -64,6 +68,10 @@ class Options {
     bool m_recursiveCheckSmallCluster;
     bool m_printSizeCount;
     std::string m_selectType;
+    int m_kmeansBatchSize;
+    int m_kmeansIterations;
+    int m_kmeansSamples;
+    bool m_kmeansRefine;
 
     // Section 3: for build head
     bool m_buildHead;
@@ -115,13 +123,46 @@ class Options {
     int m_ioThreads;
     int m_searchPostingPageLimit;
     int m_searchInternalResultNum;
+    bool m_pipelinedPostingScan;
+    int m_parallelScanThreshold;
+    int m_parallelScanWorkers;
+    int m_probeFirstWave;
+    int m_probeWaveSize;
+    float m_probeStopRatio;
+    float m_filterProbeScale;
+    std::string m_vectorLabelFile;
+    int m_rangeSearchHeadNum;
+    int m_resultCacheMB;
+    float m_resultCacheQuantum;
+    std::string m_resultCacheInvalidation;
     int m_rerank;
+    int m_hugePageMB;
+    std::string m_numaPlacement;
+    bool m_mappedMetadata;
     bool m_recall_analysis;
     int m_debugBuildInternalResultNum;
     bool m_enableADC;
+    int m_pqSubvectors;
+    int m_pqTrainSamples;
+    int m_pqIterations;
+    std::string m_pqCodebookFile;
+    int m_adcRerank;
+    bool m_vectorStore;
+    int m_vectorStoreOpenGroups;
     int m_iotimeout;
 
     int m_searchThreadNum;
+    int m_asyncSearchThreads;
+    int m_asyncBatchSize;
+    float m_searchDeadline;
+    int m_shardCells;
+    int m_shardProbe;
+    SizeType m_shardRouterSamples;
+    std::string m_servingCores;
+    std::string m_backgroundCores;
+    int m_servingRingSize;
+    int m_taskArenaThreads;
+    bool m_numaTaskArenas;
 
     // Calculating
     std::string m_truthFilePrefix;
@@ -139,6 +180,8 @@ class Options {
     bool m_searchDuringUpdate;
     int m_reassignK;
     bool m_virtualHead;
+    int m_splitIterations;
+    bool m_deferHeadInsert;
 
     // Updating(SPFresh Update Test)
     bool m_update;
@@ -147,8 +190,12 @@ class Options {
     float m_latencyLimit;
     int m_step;
     int m_insertThreadNum;
+    int m_insertHighWatermark;
+    int m_insertLowWatermark;
+    int m_insertWaitTimeout;
     int m_endVectorNum;
     std::string m_persistentBufferPath;
+    std::string m_walPath;
     int m_appendThreadNum;
     int m_reassignThreadNum;
     int m_batch;
@@ -162,12 +209,66 @@ class Options {
     int m_sampling;
     bool m_showUpdateProgress;
     int m_mergeThreshold;
+    float m_gcRatio;
+    int m_gcBandwidthMB;
     bool m_loadAllVectors;
     bool m_steadyState;
     int m_spdkBatchSize;
     bool m_stressTest;
     int m_bufferLength;
 
+    // SPDK storage
+    bool m_spdkGroupCommit;
+    int m_spdkGroupCommitWindow;
+    int m_spdkGroupCommitBytes;
+    int m_spdkTailCacheMB;
+    int m_spdkPostingCacheMB;
+    bool m_spdkMappingJournal;
+    int m_spdkJournalCheckpointMB;
+    bool m_spdkMappingMmap;
+    bool m_persistentRecords;
+    int m_recordCheckpointSeconds;
+    bool m_spdkPostingCompression;
+    int m_postingAlignment;
+    bool m_postingNorms;
+    int m_bulkLoadThreadNum;
+    int m_bulkLoadBatchMB;
+    bool m_streamingBuild;
+    int m_streamingRunMB;
+    bool m_coAccessPlacement;
+    std::string m_storageBackend;
+    std::string m_uringFilePath;
+    int m_uringQueueDepth;
+    int m_uringMaxIoPages;
+    bool m_uringSqPoll;
+    std::string m_staticIOEngine;
+    bool m_uringIoPoll;
+    std::string m_blockPoolTable;
+    std::string m_blockNamespace;
+    int m_blockNamespaceQuotaGB;
+    int m_metricsPort;
+    std::string m_metricsBindAddress;
+    int m_heatSampleRate;
+    int m_heatAgingInterval;
+    std::string m_postingHeatFile;
+    std::string m_capacityTierPath;
+    int m_fastTierMB;
+    int m_residentPostingMB;
+    int m_tieringIntervalMs;
+    int m_tieringBatch;
+    int m_tierPromoteHeat;
+    int m_tierDemoteHeat;
+    std::string m_warmPostingFile;
+    int m_warmPostingNum;
+    bool m_warmStartPrefault;
+    int m_autoTuneIntervalMs;
+    float m_autoTuneLatencyTargetUs;
+    std::string m_autoTuneProbeRange;
+    std::string m_autoTunePageLimitRange;
+    std::string m_autoTuneMergeRange;
+    std::string m_autoTuneReassignKRange;
+    std::string m_autoTuneThreadRange;
+
     Options() {
 #define DefineBasicParameter(VarName, VarType, DefaultValue, RepresentStr) \
     VarName = DefaultValue;
@@ -30,6 +30,9 @@ DefineBasicParameter(m_deleteHeadVectors, bool, false, "DeleteHeadVectors")
 DefineBasicParameter(m_ssdIndexFileNum, int, 1, "SSDIndexFileNum")
 DefineBasicParameter(m_datasetRowsInBlock, int, 1024 * 1024, "DataBlockSize")
 DefineBasicParameter(m_datasetCapacity, int, SPTAG::MaxSize, "DataCapacity")
+// keep a progress manifest in the index directory and skip the work an interrupted build finished
+DefineBasicParameter(m_resumeBuild, bool, false, "ResumeBuild")
+DefineBasicParameter(m_buildCheckpointFile, std::string, std::string("BuildCheckpoint.txt"), "BuildCheckpointFile")
 #endif
 
 #ifdef DefineSelectHeadParameter
@@ -40,6 +43,8 @@ DefineSelectHeadParameter(m_iBKTKmeansK, int, 32, "BKTKmeansK")
 DefineSelectHeadParameter(m_iBKTLeafSize, int, 8, "BKTLeafSize")
 DefineSelectHeadParameter(m_iSamples, int, 1000, "SamplesNumber")
 DefineSelectHeadParameter(m_fBalanceFactor, float, -1.0F, "BKTLambdaFactor")
+DefineSelectHeadParameter(m_iBKTKmeansBatch, int, 0, "BKTKmeansBatch")
+DefineSelectHeadParameter(m_fBKTKmeansTolerance, float, 1e-3F, "BKTKmeansTolerance")
 
 DefineSelectHeadParameter(m_iSelectHeadNumberOfThreads, int, 4, "NumberOfThreads")
 DefineSelectHeadParameter(m_saveBKT, bool, false, "SaveBKT")
@@ -58,6 +63,12 @@ DefineSelectHeadParameter(m_headVectorCount, int, 0, "Count")
 DefineSelectHeadParameter(m_recursiveCheckSmallCluster, bool, true, "RecursiveCheckSmallCluster")
 DefineSelectHeadParameter(m_printSizeCount, bool, true, "PrintSizeCount")
 DefineSelectHeadParameter(m_selectType, std::string, "BKT", "SelectHeadType")
+// SelectHeadType=Kmeans: hierarchical mini-batch k-means with BKTKmeansK branches, trained on
+// KmeansSamples vectors (0 for all) and with KmeansRefine re-picked from the whole set
+DefineSelectHeadParameter(m_kmeansBatchSize, int, 4096, "KmeansBatchSize")
+DefineSelectHeadParameter(m_kmeansIterations, int, 100, "KmeansIterations")
+DefineSelectHeadParameter(m_kmeansSamples, int, 0, "KmeansSamples")
+DefineSelectHeadParameter(m_kmeansRefine, bool, true, "KmeansRefine")
 #endif
 
 #ifdef DefineBuildHeadParameter
@@ -96,6 +107,77 @@ DefineSSDParameter(m_useDirectIO, bool, false, "UseDirectIO")
 DefineSSDParameter(m_preReassign, bool, false, "PreReassign")
 DefineSSDParameter(m_preReassignRatio, float, 0.7f, "PreReassignRatio")
 DefineSSDParameter(m_bufferLength, int, 3, "BufferLength")
+    // SPDK storage: group commit of concurrent Put/Merge writes
+DefineSSDParameter(m_spdkGroupCommit, bool, false, "SpdkGroupCommit")
+DefineSSDParameter(m_spdkGroupCommitWindow, int, 50, "SpdkGroupCommitWindowUs")
+DefineSSDParameter(m_spdkGroupCommitBytes, int, 1048576, "SpdkGroupCommitBytes")
+    // SPDK storage: DRAM budget for the partial tail pages of postings, 0 disables
+DefineSSDParameter(m_spdkTailCacheMB, int, 0, "SpdkTailCacheMB")
+DefineSSDParameter(m_spdkPostingCacheMB, int, 0, "SpdkPostingCacheMB")
+DefineSSDParameter(m_spdkMappingJournal, bool, false, "SpdkMappingJournal")
+DefineSSDParameter(m_spdkJournalCheckpointMB, int, 64, "SpdkJournalCheckpointMB")
+DefineSSDParameter(m_spdkMappingMmap, bool, false, "SpdkMappingMmap")
+    // version labels and posting sizes in shared mappings of DeletedIDs.map and SsdInfoFile.map, msync'ed every RecordCheckpointSeconds
+DefineSSDParameter(m_persistentRecords, bool, false, "PersistentRecords")
+DefineSSDParameter(m_recordCheckpointSeconds, int, 30, "RecordCheckpointSeconds")
+    // SPDK storage: byte-plane shuffled zstd postings at ZstdCompressLevel, appends stay raw until the next rewrite
+DefineSSDParameter(m_spdkPostingCompression, bool, false, "SpdkPostingCompression")
+    // posting entries: 0 packs [VID][version][vector], 8 to 64 starts every vector on that boundary. A changed value migrates the postings on load
+DefineSSDParameter(m_postingAlignment, int, 0, "PostingAlignment")
+    // posting entries carry the norm of their vector, fixed at build. InnerProduct and L2 scans skip entries it proves too far
+DefineSSDParameter(m_postingNorms, bool, false, "PostingNorms")
+    // initial posting write-out: writer threads and bytes each of them serialises per sequential batch
+DefineSSDParameter(m_bulkLoadThreadNum, int, 20, "BulkLoadThreadNum")
+DefineSSDParameter(m_bulkLoadBatchMB, int, 4, "BulkLoadBatchMB")
+    // out-of-core build: replica edges are spilled as sorted runs of StreamingRunMB and merged into the postings
+DefineSSDParameter(m_streamingBuild, bool, false, "StreamingBuild")
+DefineSSDParameter(m_streamingRunMB, int, 1024, "StreamingRunMB")
+    // postings are written in head tree order and split postings go next to their parent, so heads probed together share extents
+DefineSSDParameter(m_coAccessPlacement, bool, true, "CoAccessPlacement")
+    // Block device under the posting store: SPDK or Uring (io_uring on UringFilePath)
+DefineSSDParameter(m_storageBackend, std::string, std::string("SPDK"), "StorageBackend")
+DefineSSDParameter(m_uringFilePath, std::string, std::string(""), "UringFilePath")
+DefineSSDParameter(m_uringQueueDepth, int, 128, "UringQueueDepth")
+DefineSSDParameter(m_uringMaxIoPages, int, 8, "UringMaxIoPages")
+DefineSSDParameter(m_uringSqPoll, bool, false, "UringSqPoll")
+    // reads of the static posting files (SSDIndex): AIO (libaio) or Uring (io_uring with the page buffers registered,
+    // UringSqPoll applies and UringIoPoll polls for completions, which needs a device with poll queues)
+DefineSSDParameter(m_staticIOEngine, std::string, std::string("AIO"), "StaticIOEngine")
+DefineSSDParameter(m_uringIoPoll, bool, false, "UringIoPoll")
+    // shared drive: indexes naming the same BlockPoolTable share one device, each in its BlockNamespace of at most BlockNamespaceQuotaGB (0 no cap)
+DefineSSDParameter(m_blockPoolTable, std::string, std::string(""), "BlockPoolTable")
+DefineSSDParameter(m_blockNamespace, std::string, std::string("default"), "BlockNamespace")
+DefineSSDParameter(m_blockNamespaceQuotaGB, int, 0, "BlockNamespaceQuotaGB")
+    // Prometheus text endpoint at http://MetricsBindAddress:MetricsPort/metrics, 0 for none
+DefineSSDParameter(m_metricsPort, int, 0, "MetricsPort")
+DefineSSDParameter(m_metricsBindAddress, std::string, std::string("127.0.0.1"), "MetricsBindAddress")
+    // posting heat: one read / append / split in HeatSampleRate is counted (0 off), counters halve every HeatAgingInterval counted events; PostingHeatFile gets a dump on save
+DefineSSDParameter(m_heatSampleRate, int, 8, "HeatSampleRate")
+DefineSSDParameter(m_heatAgingInterval, int, 1048576, "HeatAgingInterval")
+DefineSSDParameter(m_postingHeatFile, std::string, std::string(""), "PostingHeatFile")
+    // storage tiers: postings spill from the primary device, of FastTierMB (0 the whole store), to an io_uring capacity drive on CapacityTierPath
+DefineSSDParameter(m_capacityTierPath, std::string, std::string(""), "CapacityTierPath")
+DefineSSDParameter(m_fastTierMB, int, 0, "FastTierMB")
+    // tiering: the hottest postings within ResidentPostingMB stay in DRAM; every TieringIntervalMs (0 no background pass) up to TieringBatch postings move, read counter at least TierPromoteHeat to the fastest tier, read and append counters at most TierDemoteHeat one tier down
+DefineSSDParameter(m_residentPostingMB, int, 0, "ResidentPostingMB")
+DefineSSDParameter(m_tieringIntervalMs, int, 1000, "TieringIntervalMs")
+DefineSSDParameter(m_tieringBatch, int, 256, "TieringBatch")
+DefineSSDParameter(m_tierPromoteHeat, int, 4, "TierPromoteHeat")
+DefineSSDParameter(m_tierDemoteHeat, int, 0, "TierDemoteHeat")
+    // warm start: saving lists the WarmPostingNum most read postings in WarmPostingFile, a load reads them back into the posting cache
+    // in the background; WarmStartPrefault faults the mapped block mapping and sizes in before the load returns
+DefineSSDParameter(m_warmPostingFile, std::string, std::string(""), "WarmPostingFile")
+DefineSSDParameter(m_warmPostingNum, int, 100000, "WarmPostingNum")
+DefineSSDParameter(m_warmStartPrefault, bool, false, "WarmStartPrefault")
+    // online tuning: every AutoTuneIntervalMs (0 off) the knobs with a "min:max" range move a step towards what the last interval's
+    // latency (against AutoTuneLatencyTargetUs, 0 none), probe budget, posting sizes and job queues ask for; ThreadNum bounds append and reassign workers each
+DefineSSDParameter(m_autoTuneIntervalMs, int, 0, "AutoTuneIntervalMs")
+DefineSSDParameter(m_autoTuneLatencyTargetUs, float, 0, "AutoTuneLatencyTargetUs")
+DefineSSDParameter(m_autoTuneProbeRange, std::string, std::string(""), "AutoTuneProbeRange")
+DefineSSDParameter(m_autoTunePageLimitRange, std::string, std::string(""), "AutoTunePageLimitRange")
+DefineSSDParameter(m_autoTuneMergeRange, std::string, std::string(""), "AutoTuneMergeRange")
+DefineSSDParameter(m_autoTuneReassignKRange, std::string, std::string(""), "AutoTuneReassignKRange")
+DefineSSDParameter(m_autoTuneThreadRange, std::string, std::string(""), "AutoTuneThreadRange")
 
     // GPU Building
 DefineSSDParameter(m_gpuSSDNumTrees, int, 100, "GPUSSDNumTrees")
@@ -115,8 +197,40 @@ DefineSSDParameter(m_maxDistRatio, float, 10000, "MaxDistRatio")
 DefineSSDParameter(m_ioThreads, int, 4, "IOThreadsPerHandler")
 DefineSSDParameter(m_searchInternalResultNum, int, 64, "SearchInternalResultNum")
 DefineSSDParameter(m_searchPostingPageLimit, int, (std::numeric_limits<int>::max)() - 1, "SearchPostingPageLimit")
+DefineSSDParameter(m_pipelinedPostingScan, bool, true, "PipelinedPostingScan")
+    // Queries probing at least this many postings have them scanned by ParallelScanWorkers helpers at once, 0 disables it
+DefineSSDParameter(m_parallelScanThreshold, int, 0, "ParallelScanThreshold")
+DefineSSDParameter(m_parallelScanWorkers, int, 4, "ParallelScanWorkers")
+DefineSSDParameter(m_probeFirstWave, int, 0, "ProbeFirstWave")  // 0 reads all postings at once
+DefineSSDParameter(m_probeWaveSize, int, 8, "ProbeWaveSize")
+DefineSSDParameter(m_probeStopRatio, float, 1.5, "ProbeStopRatio")
+    // filtered searches probe SearchInternalResultNum / selectivity postings, at most FilterProbeScale times as many; VectorLabelFile keeps the label masks with the index
+DefineSSDParameter(m_filterProbeScale, float, 4.0, "FilterProbeScale")
+DefineSSDParameter(m_vectorLabelFile, std::string, std::string(""), "VectorLabelFile")
+    // heads a range search takes from the head index, their postings are read unless the radius bound rules them out
+DefineSSDParameter(m_rangeSearchHeadNum, int, 256, "RangeSearchHeadNum")
+    // unfiltered searches answered from a cache of ResultCacheMB (0 off) keyed by the query rounded to ResultCacheQuantum (0 exact) and k;
+    // ResultCacheInvalidation Posting drops an entry once a posting it probed changed, Global once any update ran
+DefineSSDParameter(m_resultCacheMB, int, 0, "ResultCacheMB")
+DefineSSDParameter(m_resultCacheQuantum, float, 0, "ResultCacheQuantum")
+DefineSSDParameter(m_resultCacheInvalidation, std::string, std::string("Posting"), "ResultCacheInvalidation")
 DefineSSDParameter(m_rerank, int, 0, "Rerank")
+    // in-memory state: head vectors and graph on HugePageMB (2 or 1024) pages placed by NumaPlacement,
+    // Local, Interleave or Replicate (copies per socket, only without Update). Version labels are interleaved at most
+DefineSSDParameter(m_hugePageMB, int, 0, "HugePageMB")
+DefineSSDParameter(m_numaPlacement, std::string, std::string("Local"), "NumaPlacement")
+    // map the metadata files instead of reading them into memory, search results get views of the mapping
+DefineSSDParameter(m_mappedMetadata, bool, false, "MappedMetadata")
 DefineSSDParameter(m_enableADC, bool, false, "EnableADC")
+DefineSSDParameter(m_pqSubvectors, int, 0, "PQSubvectors")  // 0: largest divisor of the dimension giving at least 4 components each
+DefineSSDParameter(m_pqTrainSamples, int, 65536, "PQTrainSamples")
+DefineSSDParameter(m_pqIterations, int, 16, "PQIterations")
+DefineSSDParameter(m_pqCodebookFile, std::string, std::string("PQCodebook.bin"), "PQCodebookFile")
+DefineSSDParameter(m_adcRerank, int, 64, "ADCRerank")  // top ADC results rescored with the full vectors, 0 to keep the ADC distances
+    // with EnableADC keep each full vector once in a store of page groups on the posting device, so
+    // replicas cost a PQ code each and the rerank reads inserted vectors too
+DefineSSDParameter(m_vectorStore, bool, false, "VectorStore")
+DefineSSDParameter(m_vectorStoreOpenGroups, int, 1024, "VectorStoreOpenGroups")  // partially filled page groups buffered before the oldest is written
 DefineSSDParameter(m_recall_analysis, bool, false, "RecallAnalysis")
 DefineSSDParameter(m_debugBuildInternalResultNum, int, 64, "DebugBuildInternalResultNum")
 DefineSSDParameter(m_iotimeout, int, 30, "IOTimeout")
@@ -131,6 +245,25 @@ DefineSSDParameter(m_onlySearchFinalBatch, bool, false, "OnlySearchFinalBatch")
 DefineSSDParameter(m_searchTimes, int, 1, "SearchTimes")
     // Frontend search threadnum
 DefineSSDParameter(m_searchThreadNum, int, 16, "SearchThreadNum")
+    // Threads serving SearchIndexAsync and the most queued queries one of them searches as a batch
+DefineSSDParameter(m_asyncSearchThreads, int, 4, "AsyncSearchThreads")
+DefineSSDParameter(m_asyncBatchSize, int, 32, "AsyncBatchSize")
+    // Per-query deadline in ms set by the search tools, 0 waits for every posting
+DefineSSDParameter(m_searchDeadline, float, 0.0F, "SearchDeadline")
+    // Sharded serving: routing cells per shard, nearest cells whose shards a query visits, vectors sampled to train the cells
+DefineSSDParameter(m_shardCells, int, 64, "ShardCells")
+DefineSSDParameter(m_shardProbe, int, 8, "ShardProbe")
+DefineSSDParameter(m_shardRouterSamples, SPTAG::SizeType, 200000, "ShardRouterSamples")
+    // Thread-per-core serving: cores of the pinned search workers (empty keeps the shared thread pool),
+    // cores of the split/reassign workers and requests each worker ring holds. Reactor cores come
+    // from SPFRESH_SPDK_REACTOR_MASK and should not overlap either list
+DefineSSDParameter(m_servingCores, std::string, std::string(""), "ServingCores")
+DefineSSDParameter(m_backgroundCores, std::string, std::string(""), "BackgroundCores")
+DefineSSDParameter(m_servingRingSize, int, 1024, "ServingRingSize")
+    // Build phases share one TBB task scheduler: its threads (0 takes NumberOfThreads) and whether
+    // they are split into one arena per NUMA node
+DefineSSDParameter(m_taskArenaThreads, int, 0, "TaskArenaThreads")
+DefineSSDParameter(m_numaTaskArenas, bool, false, "NumaTaskArenas")
     // Show tradeoff of latency and acurracy
 DefineSSDParameter(m_minInternalResultNum, int, -1, "MinInternalResultNum")
 DefineSSDParameter(m_stepInternalResultNum, int, -1, "StepInternalResultNum")
@@ -148,10 +281,18 @@ DefineSSDParameter(m_latencyLimit, float, 2.0, "LatencyLimit")
 DefineSSDParameter(m_step, int, 0, "Step")
     // Frontend update threadnum
 DefineSSDParameter(m_insertThreadNum, int, 16, "InsertThreadNum")
+    // Inserts wait once this many background jobs are queued, 0 disables admission control
+DefineSSDParameter(m_insertHighWatermark, int, 0, "InsertHighWatermark")
+    // Waiting inserts resume when the queue is down to this many jobs, 0 means half the high watermark
+DefineSSDParameter(m_insertLowWatermark, int, 0, "InsertLowWatermark")
+    // Milliseconds an insert waits before failing with IndexBusy, -1 waits as long as it takes
+DefineSSDParameter(m_insertWaitTimeout, int, -1, "InsertWaitTimeout")
     // Update limit
 DefineSSDParameter(m_endVectorNum, int, -1, "EndVectorNum")
     // Persistent buffer path
 DefineSSDParameter(m_persistentBufferPath, std::string, std::string(""), "PersistentBufferPath")
+    // Write-ahead log of inserts and deletes, replayed on load; disabled when empty
+DefineSSDParameter(m_walPath, std::string, std::string(""), "WALPath")
     // Background append threadnum
 DefineSSDParameter(m_appendThreadNum, int, 16, "AppendThreadNum")
     // Background reassign threadnum
@@ -174,6 +315,10 @@ DefineSSDParameter(m_sampling, int, -1, "Sampling")
 DefineSSDParameter(m_showUpdateProgress, bool, true, "ShowUpdateProgress")
     // Steady State: Merge Threshold
 DefineSSDParameter(m_mergeThreshold, int, 10, "MergeThreshold")
+    // Background GC rewrites postings whose share of dead entries reaches this, 0 disables it
+DefineSSDParameter(m_gcRatio, float, 0.0, "GCRatio")
+    // Read and write budget of the background GC in MB per second
+DefineSSDParameter(m_gcBandwidthMB, int, 64, "GCBandwidthMB")
     // Steady State: showUpdateProgress
 DefineSSDParameter(m_loadAllVectors, bool, false, "LoadAllVectors")
     // Steady State: steady state
@@ -187,4 +332,8 @@ DefineSSDParameter(m_disableReassign, bool, false, "DisableReassign")
 DefineSSDParameter(m_searchDuringUpdate, bool, false, "SearchDuringUpdate")
 DefineSSDParameter(m_reassignK, int, 0, "ReassignK")
 DefineSSDParameter(m_virtualHead, bool, false, "VirtualHead")
+    // Lloyd iterations of the 2-means splitting an oversized posting
+DefineSSDParameter(m_splitIterations, int, 16, "SplitIterations")
+    // link new heads into the head graph on a background thread; searches scan them until then
+DefineSSDParameter(m_deferHeadInsert, bool, false, "DeferHeadInsert")
 #endif
@@ -2,10 +2,10 @@
 #include <atomic>
 
 namespace SPTAG::SPANN {
-// concurrently safe with SPDKIO
+// concurrently safe with the KeyValueIO it wraps
 class PersistentBuffer {
    public:
-    PersistentBuffer(std::shared_ptr<SPDKIO> db) : db(db), _size(0) {}
+    PersistentBuffer(std::shared_ptr<KeyValueIO> db) : db(db), _size(0) {}
 
     ~PersistentBuffer() {}
 
@@ -33,7 +33,7 @@ class PersistentBuffer {
     }
 
    private:
-    std::shared_ptr<SPDKIO> db;
+    std::shared_ptr<KeyValueIO> db;
     std::atomic_int _size;
 };
 }  // namespace SPTAG::SPANN
\ No newline at end of file
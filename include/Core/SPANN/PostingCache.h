@@ -0,0 +1,262 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_POSTINGCACHE_H_
+#define _SPTAG_SPANN_POSTINGCACHE_H_
+
+#include "Core/Common.h"
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Memory-budgeted cache of whole posting lists keyed by posting ID. Keys are spread over
+// shards with their own lock and CLOCK hand; an entry found since the hand last passed it
+// gets a second chance. Entries are handed out as shared pointers, so evicting one never
+// invalidates a reader still scanning it.
+// Resident entries, the DRAM tier of the postings, are pinned by the caller into a budget of
+// their own: the hand passes over them and only Unpin or a write of their key drops them.
+class PostingCache {
+   public:
+    typedef std::shared_ptr<const std::string> Entry;
+
+    static constexpr int kDefaultShards = 64;
+
+    PostingCache() {}
+
+    // p_maxBytes == 0 disables the cache, with no resident budget either all entries are dropped
+    void SetCapacity(size_t p_maxBytes, int p_shards = kDefaultShards) {
+        m_maxBytes = p_maxBytes;
+        Reshard(p_shards);
+    }
+
+    // budget of the resident entries next to the CLOCK ones, every entry is dropped
+    void SetResidentCapacity(size_t p_maxBytes, int p_shards = kDefaultShards) {
+        m_residentMaxBytes = p_maxBytes;
+        Reshard(p_shards);
+    }
+
+    inline bool Enabled() const {
+        return m_maxBytes > 0 || m_residentMaxBytes > 0;
+    }
+
+    Entry Find(SizeType p_key) {
+        Shard& shard = GetShard(p_key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto iter = shard.index.find(p_key);
+        if (iter == shard.index.end()) {
+            m_misses++;
+            return nullptr;
+        }
+        Slot& slot = shard.ring[iter->second];
+        slot.referenced = true;
+        m_hits++;
+        return slot.value;
+    }
+
+    // bumped by every Erase in the key's shard. Take it before reading the posting and pass it
+    // to Insert: a writer that invalidated the key meanwhile makes the insert a no-op
+    std::uint64_t Generation(SizeType p_key) {
+        Shard& shard = GetShard(p_key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        return shard.generation;
+    }
+
+    void Insert(SizeType p_key, const char* p_data, size_t p_size, std::uint64_t p_generation) {
+        Shard& shard = GetShard(p_key);
+        if (p_size == 0 || p_size > shard.limit)
+            return;
+        Entry value = std::make_shared<const std::string>(p_data, p_size);
+
+        std::lock_guard<std::mutex> lock(shard.lock);
+        if (shard.generation != p_generation)
+            return;
+        auto iter = shard.index.find(p_key);
+        if (iter != shard.index.end()) {
+            Slot& slot = shard.ring[iter->second];
+            if (slot.resident)
+                return;
+            shard.bytes -= slot.value->size();
+            slot.value = value;
+            shard.bytes += p_size;
+            return;
+        }
+        while (shard.bytes + p_size > shard.limit && EvictOne(shard))
+            ;
+        size_t pos = NewSlot(shard);
+        shard.ring[pos] = {p_key, value, false, false};
+        shard.index[p_key] = pos;
+        shard.bytes += p_size;
+    }
+
+    // make the posting of p_key resident, replacing a cached copy. false when the resident budget
+    // of the shard is full or a write invalidated the key since p_generation
+    bool Pin(SizeType p_key, const char* p_data, size_t p_size, std::uint64_t p_generation) {
+        Shard& shard = GetShard(p_key);
+        if (p_size == 0 || p_size > shard.residentLimit)
+            return false;
+        Entry value = std::make_shared<const std::string>(p_data, p_size);
+
+        std::lock_guard<std::mutex> lock(shard.lock);
+        if (shard.generation != p_generation)
+            return false;
+        auto iter = shard.index.find(p_key);
+        size_t replaced = (iter != shard.index.end() && shard.ring[iter->second].resident) ? shard.ring[iter->second].value->size() : 0;
+        if (shard.residentBytes - replaced + p_size > shard.residentLimit)
+            return false;
+        if (iter != shard.index.end()) {
+            Release(shard, iter->second);
+            shard.index.erase(iter);
+        }
+        size_t pos = NewSlot(shard);
+        shard.ring[pos] = {p_key, value, false, true};
+        shard.index[p_key] = pos;
+        shard.residentBytes += p_size;
+        return true;
+    }
+
+    // drop the resident entry of p_key, a CLOCK entry stays
+    void Unpin(SizeType p_key) {
+        Shard& shard = GetShard(p_key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto iter = shard.index.find(p_key);
+        if (iter == shard.index.end() || !shard.ring[iter->second].resident)
+            return;
+        Release(shard, iter->second);
+        shard.index.erase(iter);
+    }
+
+    bool Resident(SizeType p_key) {
+        Shard& shard = GetShard(p_key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto iter = shard.index.find(p_key);
+        return iter != shard.index.end() && shard.ring[iter->second].resident;
+    }
+
+    // called after every update of the key, cached or not
+    void Erase(SizeType p_key) {
+        Shard& shard = GetShard(p_key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        shard.generation++;
+        auto iter = shard.index.find(p_key);
+        if (iter == shard.index.end())
+            return;
+        Release(shard, iter->second);
+        shard.index.erase(iter);
+    }
+
+    size_t Bytes() const {
+        size_t bytes = 0;
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->lock);
+            bytes += shard->bytes;
+        }
+        return bytes;
+    }
+
+    size_t ResidentBytes() const {
+        size_t bytes = 0;
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->lock);
+            bytes += shard->residentBytes;
+        }
+        return bytes;
+    }
+
+    std::uint64_t Hits() const {
+        return m_hits.load();
+    }
+
+    std::uint64_t Misses() const {
+        return m_misses.load();
+    }
+
+   private:
+    struct Slot {
+        SizeType key;
+        Entry value;
+        bool referenced;
+        bool resident;
+    };
+
+    struct Shard {
+        mutable std::mutex lock;
+        std::unordered_map<SizeType, size_t> index;
+        std::vector<Slot> ring;
+        std::vector<size_t> freeSlots;
+        size_t hand = 0;
+        std::uint64_t generation = 0;
+        size_t bytes = 0;
+        size_t limit = 0;
+        size_t residentBytes = 0;
+        size_t residentLimit = 0;
+    };
+
+    void Reshard(int p_shards) {
+        std::vector<std::unique_ptr<Shard>> shards;
+        if (Enabled()) {
+            shards.resize(max(1, p_shards));
+            for (auto& shard : shards) {
+                shard.reset(new Shard());
+                shard->limit = m_maxBytes / shards.size();
+                shard->residentLimit = m_residentMaxBytes / shards.size();
+            }
+        }
+        m_shards.swap(shards);
+    }
+
+    inline Shard& GetShard(SizeType p_key) {
+        return *m_shards[(std::uint32_t)p_key % m_shards.size()];
+    }
+
+    size_t NewSlot(Shard& p_shard) {
+        if (!p_shard.freeSlots.empty()) {
+            size_t pos = p_shard.freeSlots.back();
+            p_shard.freeSlots.pop_back();
+            return pos;
+        }
+        p_shard.ring.emplace_back();
+        return p_shard.ring.size() - 1;
+    }
+
+    void Release(Shard& p_shard, size_t p_pos) {
+        Slot& slot = p_shard.ring[p_pos];
+        (slot.resident ? p_shard.residentBytes : p_shard.bytes) -= slot.value->size();
+        slot.value.reset();
+        slot.resident = false;
+        p_shard.freeSlots.push_back(p_pos);
+    }
+
+    // advance the hand to the first entry not referenced since the last pass and drop it
+    bool EvictOne(Shard& p_shard) {
+        for (size_t step = 0; step < 2 * p_shard.ring.size(); step++) {
+            if (p_shard.hand >= p_shard.ring.size())
+                p_shard.hand = 0;
+            size_t pos = p_shard.hand++;
+            Slot& slot = p_shard.ring[pos];
+            if (slot.value == nullptr || slot.resident)
+                continue;
+            if (slot.referenced) {
+                slot.referenced = false;
+                continue;
+            }
+            p_shard.index.erase(slot.key);
+            Release(p_shard, pos);
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    size_t m_maxBytes = 0;
+    size_t m_residentMaxBytes = 0;
+    std::atomic<std::uint64_t> m_hits{0};
+    std::atomic<std::uint64_t> m_misses{0};
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_POSTINGCACHE_H_
@@ -0,0 +1,169 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_POSTINGHEAT_H_
+#define _SPTAG_SPANN_POSTINGHEAT_H_
+
+#include "Core/Common.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace SPTAG::SPANN {
+enum class HeatKind : int { Read = 0, Append, Split };
+
+// Access heat of every posting: how often searches read it, appends land in it and it is split.
+// One event in SampleRate is taken, and bumps the 8-bit counter of its kind with probability
+// 1 / (1 + counter * kLogFactor) as in an LFU cache, so a counter spans about a million taken
+// events. Every AgingInterval taken events all counters are halved and the heat follows the
+// recent workload. Counters live in chunks allocated on the first touch of their posting range.
+class PostingHeat {
+   public:
+    static constexpr int kKinds = 3;
+    static constexpr int kChunkBits = 16;
+    static constexpr int kLogFactor = 10;
+
+    typedef std::pair<SizeType, std::uint8_t> Entry;
+
+    PostingHeat() = default;
+
+    ~PostingHeat() {
+        Release();
+    }
+
+    PostingHeat(const PostingHeat&) = delete;
+    PostingHeat& operator=(const PostingHeat&) = delete;
+
+    // p_sampleRate 0 turns the tracking off, p_agingInterval 0 never ages
+    void Initialize(SizeType p_capacity, int p_sampleRate, std::uint64_t p_agingInterval) {
+        Release();
+        m_sampleRate = max(0, p_sampleRate);
+        m_agingInterval = p_agingInterval;
+        m_taken = 0;
+        m_chunkNum = m_sampleRate > 0 ? (p_capacity >> kChunkBits) + 1 : 0;
+        m_chunks.reset(m_chunkNum > 0 ? new std::atomic<Chunk*>[m_chunkNum] : nullptr);
+        for (SizeType i = 0; i < m_chunkNum; i++) m_chunks[i] = nullptr;
+    }
+
+    inline bool Enabled() const {
+        return m_chunkNum > 0;
+    }
+
+    inline int SampleRate() const {
+        return m_sampleRate;
+    }
+
+    inline void Touch(SizeType p_postingID, HeatKind p_kind) {
+        if (!Enabled() || p_postingID < 0 || (p_postingID >> kChunkBits) >= m_chunkNum)
+            return;
+        std::uint64_t r = NextRandom();
+        if (m_sampleRate > 1 && r % (std::uint64_t)m_sampleRate != 0)
+            return;
+        std::atomic<std::uint8_t>& counter = GetChunk(p_postingID >> kChunkBits)->At(p_postingID, p_kind);
+        std::uint8_t value = counter.load(std::memory_order_relaxed);
+        if (value < 255 && (NextRandom() % (1 + (std::uint64_t)value * kLogFactor)) == 0)
+            counter.compare_exchange_strong(value, (std::uint8_t)(value + 1), std::memory_order_relaxed);
+        if (m_agingInterval > 0 && (m_taken.fetch_add(1, std::memory_order_relaxed) + 1) % m_agingInterval == 0)
+            Age();
+    }
+
+    inline std::uint8_t Get(SizeType p_postingID, HeatKind p_kind) const {
+        if (!Enabled() || p_postingID < 0 || (p_postingID >> kChunkBits) >= m_chunkNum)
+            return 0;
+        Chunk* chunk = m_chunks[p_postingID >> kChunkBits].load(std::memory_order_acquire);
+        return chunk == nullptr ? 0 : chunk->At(p_postingID, p_kind).load(std::memory_order_relaxed);
+    }
+
+    // events a counter stands for: the expected number of taken events to reach it, times the
+    // sample rate
+    static double Estimate(std::uint8_t p_counter, int p_sampleRate) {
+        double c = p_counter;
+        return (c + kLogFactor * c * (c - 1) / 2) * max(1, p_sampleRate);
+    }
+
+    // the p_top postings below p_postingNum with the highest counters of p_kind, hottest first
+    std::vector<Entry> Hottest(HeatKind p_kind, int p_top, SizeType p_postingNum) const {
+        std::vector<Entry> hot;
+        if (p_top <= 0)
+            return hot;
+        auto hotter = [](const Entry& a, const Entry& b) { return a.second > b.second || (a.second == b.second && a.first < b.first); };
+        for (SizeType i = 0; i < p_postingNum; i++) {
+            std::uint8_t value = Get(i, p_kind);
+            if (value == 0 || ((int)hot.size() == p_top && !hotter(Entry(i, value), hot.front())))
+                continue;
+            if ((int)hot.size() == p_top) {
+                std::pop_heap(hot.begin(), hot.end(), hotter);
+                hot.pop_back();
+            }
+            hot.emplace_back(i, value);
+            std::push_heap(hot.begin(), hot.end(), hotter);
+        }
+        std::sort_heap(hot.begin(), hot.end(), hotter);
+        return hot;
+    }
+
+    // halve every counter; concurrent bumps may be lost, which only makes the heat a bit cooler
+    void Age() {
+        bool expected = false;
+        if (!m_aging.compare_exchange_strong(expected, true))
+            return;
+        for (SizeType c = 0; c < m_chunkNum; c++) {
+            Chunk* chunk = m_chunks[c].load(std::memory_order_acquire);
+            if (chunk == nullptr)
+                continue;
+            for (auto& counter : chunk->counters) counter.store(counter.load(std::memory_order_relaxed) >> 1, std::memory_order_relaxed);
+        }
+        m_aging = false;
+    }
+
+   private:
+    struct Chunk {
+        std::atomic<std::uint8_t> counters[kKinds << kChunkBits];
+
+        Chunk() {
+            for (auto& counter : counters) counter.store(0, std::memory_order_relaxed);
+        }
+
+        inline std::atomic<std::uint8_t>& At(SizeType p_postingID, HeatKind p_kind) {
+            return counters[((p_postingID & ((1 << kChunkBits) - 1)) * kKinds) + (int)p_kind];
+        }
+    };
+
+    Chunk* GetChunk(SizeType p_chunk) {
+        Chunk* chunk = m_chunks[p_chunk].load(std::memory_order_acquire);
+        if (chunk != nullptr)
+            return chunk;
+        Chunk* fresh = new Chunk();
+        if (m_chunks[p_chunk].compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel))
+            return fresh;
+        delete fresh;
+        return chunk;
+    }
+
+    static inline std::uint64_t NextRandom() {
+        static thread_local std::uint64_t state = 0x9E3779B97F4A7C15ull ^ (std::uint64_t)(uintptr_t)&state;
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        return state;
+    }
+
+    void Release() {
+        for (SizeType c = 0; c < m_chunkNum; c++) delete m_chunks[c].load();
+        m_chunks.reset();
+        m_chunkNum = 0;
+    }
+
+    std::unique_ptr<std::atomic<Chunk*>[]> m_chunks;
+    SizeType m_chunkNum = 0;
+    int m_sampleRate = 0;
+    std::uint64_t m_agingInterval = 0;
+    std::atomic<std::uint64_t> m_taken{0};
+    std::atomic<bool> m_aging{false};
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_POSTINGHEAT_H_
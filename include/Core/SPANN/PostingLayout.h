@@ -0,0 +1,134 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_POSTINGLAYOUT_H_
+#define _SPTAG_SPANN_POSTINGLAYOUT_H_
+
+#include "Core/Common.h"
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <string>
+
+namespace SPTAG::SPANN {
+// Entry layout of the dynamic index's postings, kept in a Key=Value file next to the block
+// mapping. Alignment 0 is the packed [VID][version][vector] layout. With alignment A the VID and
+// version sit in a metadata slot of A bytes and the vector is padded to a multiple of A, so in a
+// page-aligned posting buffer every vector row starts on an A-byte boundary and a 64-byte row does
+// not straddle cache lines. With Norms the metadata also holds the float norm of the vector after
+// the version, fixed when the index is built. Entries stay fixed-size rows, so appends keep working unchanged.
+// A migration rewrites postings in ID order; Target and Migrated record how far it got, so an
+// interrupted one continues on the next load.
+struct PostingLayout {
+    static constexpr int kMaxAlignment = 64;
+    static constexpr int kHeaderBytes = sizeof(int) + sizeof(std::uint8_t);
+
+    int alignment = 0;
+    bool norms = false;
+    int target = -1;
+    SizeType migrated = 0;
+
+    static inline bool ValidAlignment(int p_alignment) {
+        return p_alignment == 0 || (p_alignment >= 8 && p_alignment <= kMaxAlignment && (p_alignment & (p_alignment - 1)) == 0);
+    }
+
+    static inline int RoundUp(int p_bytes, int p_alignment) {
+        return p_alignment <= 1 ? p_bytes : (p_bytes + p_alignment - 1) / p_alignment * p_alignment;
+    }
+
+    // metadata bytes in use, the norm follows VID and version
+    static inline int HeaderBytes(bool p_norms) {
+        return kHeaderBytes + (p_norms ? (int)sizeof(float) : 0);
+    }
+
+    // offset of the vector in an entry
+    static inline int MetaSize(int p_alignment, bool p_norms = false) {
+        return RoundUp(HeaderBytes(p_norms), p_alignment);
+    }
+
+    static inline int EntrySize(int p_alignment, int p_payloadBytes, bool p_norms = false) {
+        return MetaSize(p_alignment, p_norms) + RoundUp(p_payloadBytes, p_alignment);
+    }
+
+    static inline float GetNorm(const char* p_entry) {
+        float norm;
+        memcpy(&norm, p_entry + kHeaderBytes, sizeof(norm));
+        return norm;
+    }
+
+    // rewrite p_count entries of p_payloadBytes payload from one layout into the other, padding zeroed
+    static void Convert(const char* p_src, size_t p_count, int p_srcAlignment, char* p_dst, int p_dstAlignment, int p_payloadBytes, bool p_norms = false) {
+        int srcMeta = MetaSize(p_srcAlignment, p_norms), srcEntry = EntrySize(p_srcAlignment, p_payloadBytes, p_norms);
+        int dstMeta = MetaSize(p_dstAlignment, p_norms), dstEntry = EntrySize(p_dstAlignment, p_payloadBytes, p_norms);
+        memset(p_dst, 0, p_count * dstEntry);
+        for (size_t i = 0; i < p_count; i++) {
+            const char* src = p_src + i * srcEntry;
+            char* dst = p_dst + i * dstEntry;
+            memcpy(dst, src, HeaderBytes(p_norms));
+            memcpy(dst + dstMeta, src + srcMeta, p_payloadBytes);
+        }
+    }
+
+    // a missing file is the packed layout of indexes written before layouts were recorded
+    ErrorCode Load(const std::string& p_path) {
+        *this = PostingLayout();
+        if (!fileexists(p_path.c_str()))
+            return ErrorCode::Success;
+        FILE* fp = fopen(p_path.c_str(), "r");
+        if (fp == nullptr) {
+            LOG(Helper::LogLevel::LL_Error, "PostingLayout: cannot open %s\n", p_path.c_str());
+            return ErrorCode::FailedOpenFile;
+        }
+        std::map<std::string, std::string> values;
+        char line[256];
+        while (fgets(line, sizeof(line), fp) != nullptr) {
+            std::string entry(line);
+            while (!entry.empty() && (entry.back() == '\n' || entry.back() == '\r')) entry.pop_back();
+            size_t sep = entry.find('=');
+            if (sep != std::string::npos)
+                values[entry.substr(0, sep)] = entry.substr(sep + 1);
+        }
+        fclose(fp);
+        alignment = atoi(values["Alignment"].c_str());
+        norms = values["Norms"] == "1";
+        if (values.count("Target") > 0) {
+            target = atoi(values["Target"].c_str());
+            migrated = (SizeType)atoll(values["Migrated"].c_str());
+        }
+        if (!ValidAlignment(alignment) || (target >= 0 && !ValidAlignment(target))) {
+            LOG(Helper::LogLevel::LL_Error, "PostingLayout: %s holds an invalid alignment\n", p_path.c_str());
+            return ErrorCode::Fail;
+        }
+        return ErrorCode::Success;
+    }
+
+    ErrorCode Save(const std::string& p_path) const {
+        std::string tmp = p_path + ".tmp";
+        FILE* fp = fopen(tmp.c_str(), "w");
+        if (fp == nullptr) {
+            LOG(Helper::LogLevel::LL_Error, "PostingLayout: cannot create %s\n", tmp.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        bool written = fprintf(fp, "Version=1\nAlignment=%d\n", alignment) > 0;
+        if (norms)
+            written = fprintf(fp, "Norms=1\n") > 0 && written;
+        if (target >= 0)
+            written = fprintf(fp, "Target=%d\nMigrated=%lld\n", target, (long long)migrated) > 0 && written;
+        written = (fflush(fp) == 0) && written;
+        written = (fclose(fp) == 0) && written;
+        // rename does not replace an existing file on Windows
+        if (written && std::rename(tmp.c_str(), p_path.c_str()) != 0) {
+            std::remove(p_path.c_str());
+            written = std::rename(tmp.c_str(), p_path.c_str()) == 0;
+        }
+        if (!written) {
+            LOG(Helper::LogLevel::LL_Error, "PostingLayout: cannot write %s\n", p_path.c_str());
+            std::remove(tmp.c_str());
+            return ErrorCode::DiskIOFail;
+        }
+        return ErrorCode::Success;
+    }
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_POSTINGLAYOUT_H_
@@ -0,0 +1,264 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_RESULTCACHE_H_
+#define _SPTAG_SPANN_RESULTCACHE_H_
+
+#include "Core/Common.h"
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Memory-budgeted cache of search results keyed by the query vector and k. The vector is rounded
+// to a quantum first, so queries differing by less than it share an entry and get the results of
+// the one that filled it. Keys are two independent 64-bit hashes of the rounded vector, the
+// second one telling apart the rare vectors the first one puts together.
+// An entry keeps what it needs to be checked against the index by the caller: the postings the
+// search probed with the version each had, and the update epoch it started at. Shards, CLOCK
+// eviction and shared pointer entries work as in PostingCache
+class ResultCache {
+   public:
+    struct Key {
+        std::uint64_t m_hash = 0;
+        std::uint64_t m_check = 0;
+    };
+
+    struct Entry {
+        std::vector<std::pair<SizeType, float>> m_results;
+        std::vector<std::pair<SizeType, std::uint32_t>> m_postings;
+        std::uint64_t m_epoch = 0;
+
+        size_t Bytes() const {
+            return sizeof(Entry) + m_results.size() * sizeof(m_results[0]) + m_postings.size() * sizeof(m_postings[0]);
+        }
+    };
+    typedef std::shared_ptr<const Entry> EntryPtr;
+
+    static constexpr int kDefaultShards = 64;
+
+    // p_quantum <= 0 keys on the exact values
+    template <typename T>
+    static Key MakeKey(const T* p_query, DimensionType p_dim, int p_k, float p_quantum) {
+        Key key;
+        key.m_hash = Mix((std::uint64_t)p_k);
+        key.m_check = Mix((std::uint64_t)p_k ^ 0x9e3779b97f4a7c15ULL);
+        for (DimensionType i = 0; i < p_dim; i++) {
+            std::uint64_t code = Code(p_query[i], p_quantum);
+            key.m_hash = Mix(key.m_hash + code);
+            key.m_check = Mix(key.m_check ^ (code * 0xff51afd7ed558ccdULL + 1));
+        }
+        return key;
+    }
+
+    // p_maxBytes == 0 disables the cache. Drops every entry, not to be called while searching
+    void SetCapacity(size_t p_maxBytes, int p_shards = kDefaultShards) {
+        m_maxBytes = p_maxBytes;
+        std::vector<std::unique_ptr<Shard>> shards;
+        if (m_maxBytes > 0) {
+            shards.resize(max(1, p_shards));
+            for (auto& shard : shards) {
+                shard.reset(new Shard());
+                shard->limit = m_maxBytes / shards.size();
+            }
+        }
+        m_shards.swap(shards);
+        m_generation++;
+    }
+
+    inline bool Enabled() const {
+        return m_maxBytes > 0;
+    }
+
+    EntryPtr Find(const Key& p_key) {
+        Shard& shard = GetShard(p_key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto iter = shard.index.find(p_key.m_hash);
+        if (iter == shard.index.end())
+            return nullptr;
+        Slot& slot = shard.ring[iter->second];
+        if (slot.check != p_key.m_check)
+            return nullptr;
+        slot.referenced = true;
+        return slot.value;
+    }
+
+    // bumped by every Clear. Take it before searching and pass it to Insert: results of a search
+    // that ran across a Clear are dropped
+    std::uint64_t Generation() const {
+        return m_generation.load();
+    }
+
+    void Insert(const Key& p_key, Entry&& p_entry, std::uint64_t p_generation) {
+        Shard& shard = GetShard(p_key);
+        size_t bytes = p_entry.Bytes();
+        if (bytes > shard.limit)
+            return;
+        EntryPtr value = std::make_shared<const Entry>(std::move(p_entry));
+
+        std::lock_guard<std::mutex> lock(shard.lock);
+        if (m_generation.load() != p_generation)
+            return;
+        auto iter = shard.index.find(p_key.m_hash);
+        if (iter != shard.index.end()) {
+            Slot& slot = shard.ring[iter->second];
+            shard.bytes -= slot.value->Bytes();
+            slot.value = value;
+            slot.check = p_key.m_check;
+            shard.bytes += bytes;
+            return;
+        }
+        while (shard.bytes + bytes > shard.limit && EvictOne(shard))
+            ;
+        size_t pos = NewSlot(shard);
+        shard.ring[pos] = {p_key.m_hash, p_key.m_check, value, false};
+        shard.index[p_key.m_hash] = pos;
+        shard.bytes += bytes;
+    }
+
+    // drop p_entry found for p_key once the caller found it stale, a newer entry stays
+    void Erase(const Key& p_key, const EntryPtr& p_entry) {
+        Shard& shard = GetShard(p_key);
+        std::lock_guard<std::mutex> lock(shard.lock);
+        auto iter = shard.index.find(p_key.m_hash);
+        if (iter == shard.index.end() || shard.ring[iter->second].value != p_entry)
+            return;
+        Release(shard, iter->second);
+        shard.index.erase(iter);
+    }
+
+    // drop every entry, searches running meanwhile insert nothing
+    void Clear() {
+        m_generation++;
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->lock);
+            shard->index.clear();
+            shard->ring.clear();
+            shard->freeSlots.clear();
+            shard->hand = 0;
+            shard->bytes = 0;
+        }
+    }
+
+    // lookups answered, and those finding no entry or a stale one
+    inline void Count(bool p_hit) {
+        (p_hit ? m_hits : m_misses).fetch_add(1, std::memory_order_relaxed);
+    }
+
+    size_t Bytes() const {
+        size_t bytes = 0;
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> lock(shard->lock);
+            bytes += shard->bytes;
+        }
+        return bytes;
+    }
+
+    std::uint64_t Hits() const {
+        return m_hits.load();
+    }
+
+    std::uint64_t Misses() const {
+        return m_misses.load();
+    }
+
+   private:
+    struct Slot {
+        std::uint64_t key;
+        std::uint64_t check;
+        EntryPtr value;
+        bool referenced;
+    };
+
+    struct Shard {
+        mutable std::mutex lock;
+        std::unordered_map<std::uint64_t, size_t> index;
+        std::vector<Slot> ring;
+        std::vector<size_t> freeSlots;
+        size_t hand = 0;
+        size_t bytes = 0;
+        size_t limit = 0;
+    };
+
+    static inline std::uint64_t Mix(std::uint64_t p_x) {
+        p_x ^= p_x >> 30;
+        p_x *= 0xbf58476d1ce4e5b9ULL;
+        p_x ^= p_x >> 27;
+        p_x *= 0x94d049bb133111ebULL;
+        return p_x ^ (p_x >> 31);
+    }
+
+    template <typename T>
+    static inline std::uint64_t Code(T p_value, float p_quantum) {
+        if (p_quantum > 0)
+            return (std::uint64_t)std::llround((double)p_value / p_quantum);
+        return (std::uint64_t)(std::int64_t)p_value;
+    }
+
+    static inline std::uint64_t Code(float p_value, float p_quantum) {
+        if (p_quantum > 0 && std::isfinite(p_value))
+            return (std::uint64_t)std::llround((double)p_value / p_quantum);
+        // -0 and 0 are the same query
+        if (p_value == 0)
+            return 0;
+        std::uint32_t bits;
+        memcpy(&bits, &p_value, sizeof(bits));
+        return bits;
+    }
+
+    inline Shard& GetShard(const Key& p_key) {
+        return *m_shards[(p_key.m_hash >> 32) % m_shards.size()];
+    }
+
+    size_t NewSlot(Shard& p_shard) {
+        if (!p_shard.freeSlots.empty()) {
+            size_t pos = p_shard.freeSlots.back();
+            p_shard.freeSlots.pop_back();
+            return pos;
+        }
+        p_shard.ring.emplace_back();
+        return p_shard.ring.size() - 1;
+    }
+
+    void Release(Shard& p_shard, size_t p_pos) {
+        Slot& slot = p_shard.ring[p_pos];
+        p_shard.bytes -= slot.value->Bytes();
+        slot.value.reset();
+        p_shard.freeSlots.push_back(p_pos);
+    }
+
+    // advance the hand to the first entry not referenced since the last pass and drop it
+    bool EvictOne(Shard& p_shard) {
+        for (size_t step = 0; step < 2 * p_shard.ring.size(); step++) {
+            if (p_shard.hand >= p_shard.ring.size())
+                p_shard.hand = 0;
+            size_t pos = p_shard.hand++;
+            Slot& slot = p_shard.ring[pos];
+            if (slot.value == nullptr)
+                continue;
+            if (slot.referenced) {
+                slot.referenced = false;
+                continue;
+            }
+            p_shard.index.erase(slot.key);
+            Release(p_shard, pos);
+            return true;
+        }
+        return false;
+    }
+
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    size_t m_maxBytes = 0;
+    std::atomic<std::uint64_t> m_generation{0};
+    std::atomic<std::uint64_t> m_hits{0};
+    std::atomic<std::uint64_t> m_misses{0};
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_RESULTCACHE_H_
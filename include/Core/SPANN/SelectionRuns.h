@@ -0,0 +1,161 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_SELECTIONRUNS_H_
+#define _SPTAG_SPANN_SELECTIONRUNS_H_
+
+#include "Core/Common.h"
+#include "Core/SearchResult.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <functional>
+#include <queue>
+#include <string>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// External sort of the (head, vector) edges of a build. AddRun sorts one batch of edges by head,
+// distance and vector and spills it to its own file under the temp directory; Merge streams all
+// runs back in one k-way pass and hands every head its edges, nearest first. Only a read buffer
+// of kReadEdges per run and the edges of the current head are held in memory.
+class SelectionRuns {
+   public:
+    static constexpr size_t kReadEdges = 1 << 16;
+
+    // the process and a per-process count name the files, so concurrent builds sharing the temp
+    // directory, in one process or several, never write or remove each other's runs
+    explicit SelectionRuns(const std::string& p_tmpdir)
+        : m_prefix(p_tmpdir + FolderSep + "selection_run_" + std::to_string((long long)getpid()) + "_" + std::to_string(NextInstance()) + "_") {}
+
+    ~SelectionRuns() {
+        Clear();
+    }
+
+    // p_edges is sorted in place
+    ErrorCode AddRun(std::vector<Edge>& p_edges) {
+        if (p_edges.empty())
+            return ErrorCode::Success;
+        std::sort(p_edges.begin(), p_edges.end(), EdgeCompare());
+        std::string path = m_prefix + std::to_string(m_runs.size());
+        FILE* fp = fopen(path.c_str(), "wb");
+        if (fp == nullptr) {
+            LOG(Helper::LogLevel::LL_Error, "SelectionRuns: cannot create %s\n", path.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        bool written = fwrite(p_edges.data(), sizeof(Edge), p_edges.size(), fp) == p_edges.size();
+        written = (fclose(fp) == 0) && written;
+        if (!written) {
+            LOG(Helper::LogLevel::LL_Error, "SelectionRuns: cannot write %zu edges to %s\n", p_edges.size(), path.c_str());
+            std::remove(path.c_str());
+            return ErrorCode::DiskIOFail;
+        }
+        m_runs.push_back(path);
+        m_edges += p_edges.size();
+        return ErrorCode::Success;
+    }
+
+    inline size_t RunCount() const {
+        return m_runs.size();
+    }
+
+    inline size_t EdgeCount() const {
+        return m_edges;
+    }
+
+    // p_posting(node, edges, count) for every head with edges, in head order; returning false
+    // stops the merge with ExternalAbort
+    ErrorCode Merge(const std::function<bool(SizeType, const Edge*, size_t)>& p_posting) {
+        std::vector<Reader> readers(m_runs.size());
+        ErrorCode ret = ErrorCode::Success;
+        for (size_t r = 0; r < m_runs.size(); r++) {
+            readers[r].fp = fopen(m_runs[r].c_str(), "rb");
+            if (readers[r].fp == nullptr) {
+                LOG(Helper::LogLevel::LL_Error, "SelectionRuns: cannot open %s\n", m_runs[r].c_str());
+                ret = ErrorCode::FailedOpenFile;
+            }
+        }
+
+        auto later = [&readers](size_t a, size_t b) { return EdgeCompare()(readers[b].Top(), readers[a].Top()); };
+        std::priority_queue<size_t, std::vector<size_t>, decltype(later)> heap(later);
+        if (ret == ErrorCode::Success) {
+            for (size_t r = 0; r < readers.size(); r++) {
+                if (readers[r].Fill())
+                    heap.push(r);
+            }
+        }
+
+        std::vector<Edge> posting;
+        while (ret == ErrorCode::Success && !heap.empty()) {
+            size_t r = heap.top();
+            heap.pop();
+            const Edge& edge = readers[r].Top();
+            if (!posting.empty() && posting[0].node != edge.node) {
+                if (!p_posting(posting[0].node, posting.data(), posting.size()))
+                    ret = ErrorCode::ExternalAbort;
+                posting.clear();
+            }
+            posting.push_back(edge);
+            if (readers[r].Advance())
+                heap.push(r);
+        }
+        if (ret == ErrorCode::Success && !posting.empty() && !p_posting(posting[0].node, posting.data(), posting.size()))
+            ret = ErrorCode::ExternalAbort;
+
+        for (size_t r = 0; r < readers.size(); r++) {
+            if (readers[r].failed && ret == ErrorCode::Success) {
+                LOG(Helper::LogLevel::LL_Error, "SelectionRuns: cannot read %s\n", m_runs[r].c_str());
+                ret = ErrorCode::DiskIOFail;
+            }
+            if (readers[r].fp != nullptr)
+                fclose(readers[r].fp);
+        }
+        return ret;
+    }
+
+    // remove the run files
+    void Clear() {
+        for (auto& path : m_runs) std::remove(path.c_str());
+        m_runs.clear();
+        m_edges = 0;
+    }
+
+   private:
+    static std::uint64_t NextInstance() {
+        static std::atomic<std::uint64_t> next{0};
+        return next.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    struct Reader {
+        FILE* fp = nullptr;
+        std::vector<Edge> buffer;
+        size_t pos = 0;
+        size_t count = 0;
+        bool failed = false;
+
+        inline const Edge& Top() const {
+            return buffer[pos];
+        }
+
+        // false once the run is exhausted
+        bool Fill() {
+            buffer.resize(kReadEdges);
+            count = fread(buffer.data(), sizeof(Edge), kReadEdges, fp);
+            pos = 0;
+            if (count < kReadEdges && ferror(fp))
+                failed = true;
+            return count > 0;
+        }
+
+        inline bool Advance() {
+            return ++pos < count || Fill();
+        }
+    };
+
+    std::string m_prefix;
+    std::vector<std::string> m_runs;
+    size_t m_edges = 0;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_SELECTIONRUNS_H_
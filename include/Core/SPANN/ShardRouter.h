@@ -0,0 +1,238 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_SHARDROUTER_H_
+#define _SPTAG_SPANN_SHARDROUTER_H_
+
+#include "Core/Common.h"
+#include "Helper/DiskIO.h"
+#include "Utils/DistanceUtils.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Routing layer of a sharded deployment, replicated on every rank. The corpus is cut into cells
+// by k-means over a sample and every cell is owned by one shard, the cells being spread so the
+// shards get about the same number of vectors. A vector lives on the shard of its nearest cell,
+// a query visits the shards owning its nearest cells. Distances are L2 between float copies,
+// unit length ones under cosine so the order matches the index
+class ShardRouter {
+   public:
+    ShardRouter() = default;
+
+    inline int Shards() const {
+        return m_shards;
+    }
+
+    inline int Cells() const {
+        return (int)m_cellShard.size();
+    }
+
+    inline DimensionType Dimension() const {
+        return m_dim;
+    }
+
+    inline int CellShard(int p_cell) const {
+        return m_cellShard[p_cell];
+    }
+
+    // k-means over at most p_samples of the p_count vectors into p_shards * p_cellsPerShard cells
+    template <typename T>
+    ErrorCode Build(const T* p_data, SizeType p_count, DimensionType p_dim, int p_shards, int p_cellsPerShard, DistCalcMethod p_method, SizeType p_samples = 200000, int p_iterations = 10) {
+        if (p_count <= 0 || p_dim <= 0 || p_shards <= 0) {
+            LOG(Helper::LogLevel::LL_Error, "ShardRouter: nothing to route, %d vectors for %d shards\n", p_count, p_shards);
+            return ErrorCode::EmptyData;
+        }
+        m_dim = p_dim;
+        m_shards = p_shards;
+        m_cosine = p_method == DistCalcMethod::Cosine;
+
+        std::mt19937 rng(0);
+        std::vector<SizeType> sampleIds(p_count);
+        std::iota(sampleIds.begin(), sampleIds.end(), 0);
+        SizeType samples = (std::min)(p_count, (std::max)(p_samples, (SizeType)p_shards));
+        for (SizeType i = 0; i < samples; i++) std::swap(sampleIds[i], sampleIds[i + rng() % (p_count - i)]);
+        std::vector<float> sample((size_t)samples * m_dim);
+        for (SizeType i = 0; i < samples; i++) ToFloat(p_data + (size_t)sampleIds[i] * m_dim, sample.data() + (size_t)i * m_dim);
+
+        int cells = (int)(std::min)((SizeType)p_shards * (std::max)(p_cellsPerShard, 1), samples);
+        m_centroids.assign(sample.begin(), sample.begin() + (size_t)cells * m_dim);
+        std::vector<int> label(samples);
+        std::vector<SizeType> counts(cells);
+        for (int iter = 0; iter < p_iterations; iter++) {
+#pragma omp parallel for schedule(dynamic, 1024)
+            for (SizeType i = 0; i < samples; i++) label[i] = NearestCell(sample.data() + (size_t)i * m_dim);
+            std::vector<double> sums((size_t)cells * m_dim, 0);
+            std::fill(counts.begin(), counts.end(), 0);
+            for (SizeType i = 0; i < samples; i++) {
+                counts[label[i]]++;
+                const float* v = sample.data() + (size_t)i * m_dim;
+                double* sum = sums.data() + (size_t)label[i] * m_dim;
+                for (DimensionType d = 0; d < m_dim; d++) sum[d] += v[d];
+            }
+            for (int c = 0; c < cells; c++) {
+                // an empty cell restarts on a random sample
+                if (counts[c] == 0) {
+                    std::copy_n(sample.data() + (size_t)(rng() % samples) * m_dim, m_dim, m_centroids.data() + (size_t)c * m_dim);
+                    continue;
+                }
+                float* centroid = m_centroids.data() + (size_t)c * m_dim;
+                for (DimensionType d = 0; d < m_dim; d++) centroid[d] = (float)(sums[(size_t)c * m_dim + d] / counts[c]);
+                if (m_cosine)
+                    Normalize(centroid);
+            }
+        }
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (SizeType i = 0; i < samples; i++) label[i] = NearestCell(sample.data() + (size_t)i * m_dim);
+        std::fill(counts.begin(), counts.end(), 0);
+        for (SizeType i = 0; i < samples; i++) counts[label[i]]++;
+
+        // largest cells first, each to the shard holding the fewest samples so far
+        std::vector<int> order(cells);
+        std::iota(order.begin(), order.end(), 0);
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return counts[a] > counts[b]; });
+        std::vector<SizeType> load(p_shards, 0);
+        m_cellShard.assign(cells, 0);
+        for (int c : order) {
+            int shard = (int)(std::min_element(load.begin(), load.end()) - load.begin());
+            m_cellShard[c] = shard;
+            load[shard] += counts[c];
+        }
+        LOG(Helper::LogLevel::LL_Info, "ShardRouter: %d cells over %d shards from %d samples, largest shard %.1f%% of the samples\n", cells, p_shards, samples, *std::max_element(load.begin(), load.end()) * 100.0 / samples);
+        return ErrorCode::Success;
+    }
+
+    // the shard a new vector goes to
+    template <typename T>
+    int Owner(const T* p_vector) const {
+        std::vector<float> v(m_dim);
+        ToFloat(p_vector, v.data());
+        return m_cellShard[NearestCell(v.data())];
+    }
+
+    // the distinct shards owning the p_probe cells nearest to p_query, nearest first
+    template <typename T>
+    void Route(const T* p_query, int p_probe, std::vector<int>& p_shards) const {
+        std::vector<float> q(m_dim);
+        ToFloat(p_query, q.data());
+        std::vector<std::pair<float, int>> dists(m_cellShard.size());
+        for (int c = 0; c < (int)dists.size(); c++) dists[c] = std::make_pair(CellDistance(q.data(), c), c);
+        int probe = (std::min)((std::max)(p_probe, 1), (int)dists.size());
+        std::partial_sort(dists.begin(), dists.begin() + probe, dists.end());
+        p_shards.clear();
+        for (int i = 0; i < probe; i++) {
+            int shard = m_cellShard[dists[i].second];
+            if (std::find(p_shards.begin(), p_shards.end(), shard) == p_shards.end())
+                p_shards.push_back(shard);
+        }
+    }
+
+    // the whole router as one buffer, for a broadcast or a file
+    std::vector<char> ToBytes() const {
+        int cells = Cells();
+        std::int32_t header[4] = {m_shards, cells, m_dim, m_cosine ? 1 : 0};
+        std::vector<char> bytes(sizeof(header) + sizeof(int) * cells + sizeof(float) * m_centroids.size());
+        char* p = bytes.data();
+        memcpy(p, header, sizeof(header));
+        memcpy(p + sizeof(header), m_cellShard.data(), sizeof(int) * cells);
+        memcpy(p + sizeof(header) + sizeof(int) * cells, m_centroids.data(), sizeof(float) * m_centroids.size());
+        return bytes;
+    }
+
+    ErrorCode FromBytes(const char* p_bytes, size_t p_size) {
+        std::int32_t header[4];
+        if (p_size < sizeof(header))
+            return ErrorCode::FailedParseValue;
+        memcpy(header, p_bytes, sizeof(header));
+        size_t cells = (size_t)header[1], centroidFloats = cells * header[2];
+        if (header[0] <= 0 || header[2] <= 0 || p_size != sizeof(header) + sizeof(int) * cells + sizeof(float) * centroidFloats) {
+            LOG(Helper::LogLevel::LL_Error, "ShardRouter: corrupted router of %zu bytes\n", p_size);
+            return ErrorCode::FailedParseValue;
+        }
+        m_shards = header[0];
+        m_dim = header[2];
+        m_cosine = header[3] != 0;
+        m_cellShard.resize(cells);
+        m_centroids.resize(centroidFloats);
+        memcpy(m_cellShard.data(), p_bytes + sizeof(header), sizeof(int) * cells);
+        memcpy(m_centroids.data(), p_bytes + sizeof(header) + sizeof(int) * cells, sizeof(float) * centroidFloats);
+        return ErrorCode::Success;
+    }
+
+    ErrorCode Save(const std::string& p_file) const {
+        auto ptr = f_createIO();
+        if (ptr == nullptr || !ptr->Initialize(p_file.c_str(), std::ios::binary | std::ios::out)) {
+            LOG(Helper::LogLevel::LL_Error, "ShardRouter: cannot open %s to write\n", p_file.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        std::vector<char> bytes = ToBytes();
+        std::uint64_t size = bytes.size();
+        IOBINARY(ptr, WriteBinary, sizeof(size), (char*)&size);
+        IOBINARY(ptr, WriteBinary, size, bytes.data());
+        return ErrorCode::Success;
+    }
+
+    ErrorCode Load(const std::string& p_file) {
+        auto ptr = f_createIO();
+        if (ptr == nullptr || !ptr->Initialize(p_file.c_str(), std::ios::binary | std::ios::in)) {
+            LOG(Helper::LogLevel::LL_Error, "ShardRouter: cannot open %s\n", p_file.c_str());
+            return ErrorCode::FailedOpenFile;
+        }
+        std::uint64_t size = 0;
+        IOBINARY(ptr, ReadBinary, sizeof(size), (char*)&size);
+        std::vector<char> bytes(size);
+        IOBINARY(ptr, ReadBinary, size, bytes.data());
+        return FromBytes(bytes.data(), bytes.size());
+    }
+
+   private:
+    template <typename T>
+    void ToFloat(const T* p_vector, float* p_out) const {
+        for (DimensionType d = 0; d < m_dim; d++) p_out[d] = (float)p_vector[d];
+        if (m_cosine)
+            Normalize(p_out);
+    }
+
+    void Normalize(float* p_vector) const {
+        double norm = 0;
+        for (DimensionType d = 0; d < m_dim; d++) norm += (double)p_vector[d] * p_vector[d];
+        if (norm <= 0)
+            return;
+        float scale = (float)(1.0 / std::sqrt(norm));
+        for (DimensionType d = 0; d < m_dim; d++) p_vector[d] *= scale;
+    }
+
+    inline float CellDistance(const float* p_vector, int p_cell) const {
+        static const COMMON::DistanceCalcReturn<float> distance = COMMON::DistanceCalcSelector<float>(DistCalcMethod::L2);
+        return distance(p_vector, m_centroids.data() + (size_t)p_cell * m_dim, m_dim);
+    }
+
+    int NearestCell(const float* p_vector) const {
+        int best = 0;
+        float bestDist = (std::numeric_limits<float>::max)();
+        int cells = (int)(m_centroids.size() / m_dim);
+        for (int c = 0; c < cells; c++) {
+            float dist = CellDistance(p_vector, c);
+            if (dist < bestDist) {
+                bestDist = dist;
+                best = c;
+            }
+        }
+        return best;
+    }
+
+    int m_shards = 0;
+    DimensionType m_dim = 0;
+    bool m_cosine = false;
+    std::vector<float> m_centroids;
+    std::vector<int> m_cellShard;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_SHARDROUTER_H_
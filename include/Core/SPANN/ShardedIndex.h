@@ -0,0 +1,385 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_SHARDEDINDEX_H_
+#define _SPTAG_SPANN_SHARDEDINDEX_H_
+
+#include "Core/SPANN/Index.h"
+#include "Core/SPANN/ShardRouter.h"
+#include <mpi.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// A corpus spread over the ranks of an MPI communicator, one shard per rank. Every rank runs a
+// full SPANN index (head index and postings) over the vectors of its shard and holds a replica of
+// the ShardRouter, which places vectors and picks the shards a query visits. Rank 0 coordinates:
+// queries and inserts are scattered to the ranks that own them and the top k of each rank is
+// gathered back and merged. IDs are global, each shard maps its local VIDs to them.
+// Every call is collective: all ranks make it, in the same order, with the same arguments except
+// for the vectors, which only rank 0 passes
+template <typename T>
+class ShardedIndex {
+   public:
+    static constexpr int kRoot = 0;
+
+    explicit ShardedIndex(MPI_Comm p_comm = MPI_COMM_WORLD) : m_comm(p_comm) {
+        MPI_Comm_rank(m_comm, &m_rank);
+        MPI_Comm_size(m_comm, &m_ranks);
+    }
+
+    inline int Rank() const {
+        return m_rank;
+    }
+
+    inline int Ranks() const {
+        return m_ranks;
+    }
+
+    inline Index<T>* Local() const {
+        return m_index.get();
+    }
+
+    inline const ShardRouter& Router() const {
+        return m_router;
+    }
+
+    // vectors stored over all shards, known on every rank
+    inline SizeType Count() const {
+        return m_nextId;
+    }
+
+    static std::string ShardFolder(const std::string& p_folder, int p_rank) {
+        return p_folder + FolderSep + "shard_" + std::to_string(p_rank);
+    }
+
+    // split the p_count vectors of rank 0 over the ranks and build the shard of every rank under
+    // ShardFolder(p_folder, rank). p_params are the sections of a build configuration, applied
+    // to each shard index before its IndexDirectory and VectorPath are pointed at the shard
+    ErrorCode Build(const std::string& p_folder, const T* p_vectors, SizeType p_count, DimensionType p_dim, const std::map<std::string, std::map<std::string, std::string>>& p_params, int p_cellsPerShard, SizeType p_routerSamples) {
+        ErrorCode ret = ErrorCode::Success;
+        std::vector<char> router;
+        if (m_rank == kRoot) {
+            DistCalcMethod method = DistCalcMethod::L2;
+            auto base = p_params.find("Base");
+            if (base != p_params.end()) {
+                auto it = base->second.find("DistCalcMethod");
+                if (it != base->second.end())
+                    Helper::Convert::ConvertStringTo<DistCalcMethod>(it->second.c_str(), method);
+            }
+            ret = m_router.Build(p_vectors, p_count, p_dim, m_ranks, p_cellsPerShard, method, p_routerSamples);
+            if (ret == ErrorCode::Success)
+                router = m_router.ToBytes();
+        }
+        if (!AllSucceeded(ret) || (ret = BroadcastRouter(router)) != ErrorCode::Success)
+            return ret;
+
+        // rows of each shard in the order of the input, their global IDs along
+        std::vector<std::vector<SizeType>> rows;
+        if (m_rank == kRoot)
+            Partition(p_vectors, p_count, rows);
+        std::vector<T> local;
+        std::vector<SizeType> ids;
+        Scatter(p_vectors, rows, [](SizeType p_row) { return p_row; }, local, ids);
+        m_nextId = p_count;
+        MPI_Bcast(&m_nextId, 1, MPI_INT, kRoot, m_comm);
+
+        std::string folder = ShardFolder(p_folder, m_rank);
+        if (ids.empty()) {
+            LOG(Helper::LogLevel::LL_Error, "ShardedIndex: shard %d got no vectors\n", m_rank);
+            ret = ErrorCode::EmptyData;
+        } else if (!direxists(p_folder.c_str()) && mkdir(p_folder.c_str()) != 0 && !direxists(p_folder.c_str())) {
+            ret = ErrorCode::FailedCreateFile;
+        } else if (!direxists(folder.c_str()) && mkdir(folder.c_str()) != 0) {
+            ret = ErrorCode::FailedCreateFile;
+        }
+        if (ret == ErrorCode::Success)
+            ret = m_router.Save(folder + FolderSep + kRouterFile);
+        if (ret == ErrorCode::Success) {
+            BasicVectorSet shardVectors(ByteArray((std::uint8_t*)local.data(), sizeof(T) * local.size(), false), GetEnumValueType<T>(), p_dim, (SizeType)ids.size());
+            ret = shardVectors.Save(folder + FolderSep + kVectorFile);
+        }
+        if (ret == ErrorCode::Success) {
+            m_globalIds = ids;
+            ret = AppendGlobalIds(folder, ids.data(), (SizeType)ids.size(), false);
+        }
+        if (ret == ErrorCode::Success) {
+            m_index.reset(new Index<T>());
+            for (auto& section : p_params) {
+                for (auto& param : section.second) m_index->SetParameter(param.first.c_str(), param.second.c_str(), section.first.c_str());
+            }
+            m_index->SetParameter("IndexDirectory", folder.c_str(), "Base");
+            m_index->SetParameter("VectorPath", (folder + FolderSep + kVectorFile).c_str(), "Base");
+            m_index->SetParameter("VectorSize", std::to_string(ids.size()).c_str(), "Base");
+            LOG(Helper::LogLevel::LL_Info, "ShardedIndex: building shard %d of %d with %zu vectors in %s\n", m_rank, m_ranks, ids.size(), folder.c_str());
+            ret = m_index->BuildIndex();
+        }
+        if (ret == ErrorCode::Success) {
+            auto ptr = f_createIO();
+            if (ptr == nullptr || !ptr->Initialize((folder + FolderSep + "indexloader.ini").c_str(), std::ios::out))
+                ret = ErrorCode::FailedCreateFile;
+            else
+                ret = m_index->SaveIndexConfig(ptr);
+        }
+        AllSucceeded(ret);
+        return ret;
+    }
+
+    // open the shard of this rank under ShardFolder(p_folder, rank)
+    ErrorCode Load(const std::string& p_folder) {
+        std::string folder = ShardFolder(p_folder, m_rank);
+        ErrorCode ret = m_router.Load(folder + FolderSep + kRouterFile);
+        if (ret == ErrorCode::Success && m_router.Shards() != m_ranks) {
+            LOG(Helper::LogLevel::LL_Error, "ShardedIndex: %d shards served by %d ranks\n", m_router.Shards(), m_ranks);
+            ret = ErrorCode::Fail;
+        }
+        if (ret == ErrorCode::Success)
+            ret = LoadGlobalIds(folder);
+        if (ret == ErrorCode::Success)
+            ret = Index<T>::LoadIndex(folder, m_index);
+        if (!AllSucceeded(ret))
+            return ret == ErrorCode::Success ? ErrorCode::Fail : ret;
+
+        SizeType maxId = -1;
+        for (SizeType id : m_globalIds) maxId = (std::max)(maxId, id);
+        MPI_Allreduce(MPI_IN_PLACE, &maxId, 1, MPI_INT, MPI_MAX, m_comm);
+        m_nextId = maxId + 1;
+        LOG(Helper::LogLevel::LL_Info, "ShardedIndex: rank %d serves %zu of %d vectors\n", m_rank, m_globalIds.size(), m_nextId);
+        return ErrorCode::Success;
+    }
+
+    // top p_k of each of the p_count queries of rank 0 over the shards owning their p_probe
+    // nearest routing cells, searched by p_threads threads per rank. p_results is filled on rank 0
+    ErrorCode SearchBatch(const T* p_queries, SizeType p_count, int p_k, int p_probe, int p_threads, std::vector<std::vector<BasicResult>>* p_results) {
+        int args[2] = {p_k, p_probe};
+        MPI_Bcast(args, 2, MPI_INT, kRoot, m_comm);
+        int k = args[0], probe = args[1];
+
+        // rows routed to each shard
+        std::vector<std::vector<SizeType>> rows(m_ranks);
+        if (m_rank == kRoot) {
+            std::vector<std::vector<int>> routes(p_count);
+#pragma omp parallel for schedule(dynamic, 64)
+            for (SizeType q = 0; q < p_count; q++) m_router.Route(p_queries + (size_t)q * m_router.Dimension(), probe, routes[q]);
+            for (SizeType q = 0; q < p_count; q++) {
+                for (int shard : routes[q]) rows[shard].push_back(q);
+            }
+        }
+        std::vector<T> local;
+        std::vector<SizeType> unused;
+        Scatter(p_queries, rows, nullptr, local, unused);
+
+        // search the local queries, global IDs in the hits
+        SizeType localCount = (SizeType)(local.size() / m_router.Dimension());
+        std::vector<Hit> hits((size_t)localCount * k);
+        std::atomic<SizeType> next(0);
+        auto worker = [&]() {
+            m_index->Initialize();
+            for (SizeType q = next++; q < localCount; q = next++) {
+                QueryResult result(local.data() + (size_t)q * m_router.Dimension(), k, false);
+                m_index->SearchIndex(result);
+                for (int i = 0; i < k; i++) {
+                    const BasicResult* res = result.GetResult(i);
+                    bool valid = res->VID >= 0 && res->VID < (SizeType)m_globalIds.size();
+                    hits[(size_t)q * k + i] = Hit{valid ? m_globalIds[res->VID] : -1, valid ? res->Dist : MaxDist};
+                }
+            }
+            m_index->ExitBlockController();
+        };
+        std::vector<std::thread> threads;
+        for (int t = 0; t < (std::max)(p_threads, 1); t++) threads.emplace_back(worker);
+        for (auto& thread : threads) thread.join();
+
+        // gather k hits per query, shard by shard
+        MPI_Datatype hitsType;
+        MPI_Type_contiguous((int)(sizeof(Hit) * k), MPI_BYTE, &hitsType);
+        MPI_Type_commit(&hitsType);
+        std::vector<int> counts(m_ranks), displs(m_ranks);
+        for (int r = 0; r < m_ranks; r++) counts[r] = (int)rows[r].size();
+        for (int r = 1; r < m_ranks; r++) displs[r] = displs[r - 1] + counts[r - 1];
+        std::vector<Hit> gathered(m_rank == kRoot ? (size_t)(displs.back() + counts.back()) * k : 0);
+        MPI_Gatherv(hits.data(), (int)localCount, hitsType, gathered.data(), counts.data(), displs.data(), hitsType, kRoot, m_comm);
+        MPI_Type_free(&hitsType);
+
+        if (m_rank != kRoot)
+            return ErrorCode::Success;
+        p_results->assign(p_count, std::vector<BasicResult>());
+        std::vector<std::vector<Hit>> merged(p_count);
+        for (int r = 0; r < m_ranks; r++) {
+            for (size_t j = 0; j < rows[r].size(); j++) {
+                const Hit* first = gathered.data() + ((size_t)displs[r] + j) * k;
+                merged[rows[r][j]].insert(merged[rows[r][j]].end(), first, first + k);
+            }
+        }
+#pragma omp parallel for schedule(dynamic, 64)
+        for (SizeType q = 0; q < p_count; q++) {
+            auto& candidates = merged[q];
+            // shards are disjoint, the best k of the union is the answer
+            int keep = (std::min)((int)candidates.size(), k);
+            std::partial_sort(candidates.begin(), candidates.begin() + keep, candidates.end(), [](const Hit& a, const Hit& b) { return a.dist < b.dist; });
+            auto& results = (*p_results)[q];
+            results.assign(k, BasicResult(-1, MaxDist));
+            for (int i = 0; i < keep; i++) results[i] = BasicResult(candidates[i].vid, candidates[i].dist);
+        }
+        return ErrorCode::Success;
+    }
+
+    // insert the p_count vectors of rank 0 on the shards the router places them on. Their global
+    // IDs, consecutive from Count(), go to p_ids on rank 0 when given
+    ErrorCode AddBatch(const T* p_vectors, SizeType p_count, std::vector<SizeType>* p_ids) {
+        SizeType firstId = m_nextId;
+        std::vector<std::vector<SizeType>> rows;
+        if (m_rank == kRoot)
+            Partition(p_vectors, p_count, rows);
+        MPI_Bcast(&p_count, 1, MPI_INT, kRoot, m_comm);
+        std::vector<T> local;
+        std::vector<SizeType> ids;
+        Scatter(p_vectors, rows, [firstId](SizeType p_row) { return firstId + p_row; }, local, ids);
+        m_nextId += p_count;
+
+        ErrorCode ret = ErrorCode::Success;
+        if (!ids.empty()) {
+            m_index->Initialize();
+            // the shard appends the batch at its local end, the map follows in the same order
+            SizeType begin = m_index->GetNumSamples();
+            while ((ret = m_index->AddIndex(local.data(), (SizeType)ids.size(), m_router.Dimension(), nullptr)) == ErrorCode::IndexBusy)
+                std::this_thread::yield();
+            m_index->ExitBlockController();
+            if (ret == ErrorCode::Success) {
+                // rows added to the shard directly have no global ID
+                std::vector<SizeType> tail((size_t)(std::max)(begin - (SizeType)m_globalIds.size(), (SizeType)0), -1);
+                tail.insert(tail.end(), ids.begin(), ids.end());
+                m_globalIds.insert(m_globalIds.end(), tail.begin(), tail.end());
+                ret = AppendGlobalIds(m_index->GetOptions()->m_indexDirectory, tail.data(), (SizeType)tail.size(), true);
+            }
+        }
+        if (!AllSucceeded(ret))
+            return ret == ErrorCode::Success ? ErrorCode::Fail : ret;
+        if (m_rank == kRoot && p_ids != nullptr) {
+            p_ids->resize(p_count);
+            for (SizeType i = 0; i < p_count; i++) (*p_ids)[i] = firstId + i;
+        }
+        return ErrorCode::Success;
+    }
+
+   private:
+    struct Hit {
+        SizeType vid;
+        float dist;
+    };
+
+    static constexpr const char* kRouterFile = "ShardRouter.bin";
+    static constexpr const char* kVectorFile = "ShardVectors.bin";
+    static constexpr const char* kGlobalIdFile = "ShardGlobalIDs.bin";
+
+    // true on every rank when p_ret is Success on every rank
+    bool AllSucceeded(ErrorCode p_ret) {
+        int ok = p_ret == ErrorCode::Success ? 1 : 0;
+        MPI_Allreduce(MPI_IN_PLACE, &ok, 1, MPI_INT, MPI_MIN, m_comm);
+        return ok == 1;
+    }
+
+    ErrorCode BroadcastRouter(std::vector<char>& p_bytes) {
+        std::uint64_t size = p_bytes.size();
+        MPI_Bcast(&size, 1, MPI_UINT64_T, kRoot, m_comm);
+        p_bytes.resize(size);
+        MPI_Bcast(p_bytes.data(), (int)size, MPI_BYTE, kRoot, m_comm);
+        ErrorCode ret = m_rank == kRoot ? ErrorCode::Success : m_router.FromBytes(p_bytes.data(), p_bytes.size());
+        return AllSucceeded(ret) ? ErrorCode::Success : ErrorCode::Fail;
+    }
+
+    // rows of each shard in input order, on rank 0
+    void Partition(const T* p_vectors, SizeType p_count, std::vector<std::vector<SizeType>>& p_rows) const {
+        std::vector<int> owner(p_count);
+#pragma omp parallel for schedule(dynamic, 1024)
+        for (SizeType i = 0; i < p_count; i++) owner[i] = m_router.Owner(p_vectors + (size_t)i * m_router.Dimension());
+        p_rows.assign(m_ranks, std::vector<SizeType>());
+        for (SizeType i = 0; i < p_count; i++) p_rows[owner[i]].push_back(i);
+    }
+
+    // send every rank the rows of rank 0's p_vectors listed for it in p_rows, and their IDs when p_id is set
+    void Scatter(const T* p_vectors, std::vector<std::vector<SizeType>>& p_rows, const std::function<SizeType(SizeType)>& p_id, std::vector<T>& p_local, std::vector<SizeType>& p_ids) {
+        DimensionType dim = m_router.Dimension();
+        std::vector<int> counts(m_ranks), displs(m_ranks);
+        std::vector<T> packed;
+        std::vector<SizeType> packedIds;
+        if (m_rank == kRoot) {
+            p_rows.resize(m_ranks);
+            for (int r = 0; r < m_ranks; r++) counts[r] = (int)p_rows[r].size();
+            for (int r = 1; r < m_ranks; r++) displs[r] = displs[r - 1] + counts[r - 1];
+            packed.resize((size_t)(displs.back() + counts.back()) * dim);
+            for (int r = 0; r < m_ranks; r++) {
+                for (size_t j = 0; j < p_rows[r].size(); j++) {
+                    memcpy(packed.data() + ((size_t)displs[r] + j) * dim, p_vectors + (size_t)p_rows[r][j] * dim, sizeof(T) * dim);
+                    if (p_id)
+                        packedIds.push_back(p_id(p_rows[r][j]));
+                }
+            }
+        }
+        MPI_Bcast(counts.data(), m_ranks, MPI_INT, kRoot, m_comm);
+        // the row counts tell the other ranks what they are sent and, later, what they answer
+        if (m_rank != kRoot) {
+            p_rows.assign(m_ranks, std::vector<SizeType>());
+            for (int r = 0; r < m_ranks; r++) p_rows[r].resize(counts[r]);
+            for (int r = 1; r < m_ranks; r++) displs[r] = displs[r - 1] + counts[r - 1];
+        }
+        MPI_Datatype vectorType;
+        MPI_Type_contiguous((int)(sizeof(T) * dim), MPI_BYTE, &vectorType);
+        MPI_Type_commit(&vectorType);
+        p_local.resize((size_t)counts[m_rank] * dim);
+        MPI_Scatterv(packed.data(), counts.data(), displs.data(), vectorType, p_local.data(), counts[m_rank], vectorType, kRoot, m_comm);
+        MPI_Type_free(&vectorType);
+        int withIds = p_id ? 1 : 0;
+        MPI_Bcast(&withIds, 1, MPI_INT, kRoot, m_comm);
+        p_ids.clear();
+        if (withIds) {
+            p_ids.resize(counts[m_rank]);
+            MPI_Scatterv(packedIds.data(), counts.data(), displs.data(), MPI_INT, p_ids.data(), counts[m_rank], MPI_INT, kRoot, m_comm);
+        }
+    }
+
+    ErrorCode AppendGlobalIds(const std::string& p_folder, const SizeType* p_ids, SizeType p_count, bool p_append) {
+        auto ptr = f_createIO();
+        std::string file = p_folder + FolderSep + kGlobalIdFile;
+        if (ptr == nullptr || !ptr->Initialize(file.c_str(), std::ios::binary | std::ios::out | (p_append ? std::ios::app : std::ios::trunc))) {
+            LOG(Helper::LogLevel::LL_Error, "ShardedIndex: cannot write %s\n", file.c_str());
+            return ErrorCode::FailedCreateFile;
+        }
+        IOBINARY(ptr, WriteBinary, sizeof(SizeType) * p_count, (char*)p_ids);
+        return ErrorCode::Success;
+    }
+
+    ErrorCode LoadGlobalIds(const std::string& p_folder) {
+        auto ptr = f_createIO();
+        std::string file = p_folder + FolderSep + kGlobalIdFile;
+        if (ptr == nullptr || !ptr->Initialize(file.c_str(), std::ios::binary | std::ios::in)) {
+            LOG(Helper::LogLevel::LL_Error, "ShardedIndex: cannot open %s\n", file.c_str());
+            return ErrorCode::FailedOpenFile;
+        }
+        m_globalIds.clear();
+        std::vector<SizeType> chunk(1 << 16);
+        std::uint64_t read;
+        while ((read = ptr->ReadBinary(sizeof(SizeType) * chunk.size(), (char*)chunk.data())) > 0) {
+            m_globalIds.insert(m_globalIds.end(), chunk.begin(), chunk.begin() + read / sizeof(SizeType));
+            if (read < sizeof(SizeType) * chunk.size())
+                break;
+        }
+        return ErrorCode::Success;
+    }
+
+    MPI_Comm m_comm;
+    int m_rank = 0;
+    int m_ranks = 1;
+    ShardRouter m_router;
+    std::shared_ptr<Index<T>> m_index;
+    // local VID -> global ID, -1 for local rows not added through this class
+    std::vector<SizeType> m_globalIds;
+    SizeType m_nextId = 0;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_SHARDEDINDEX_H_
@@ -0,0 +1,136 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_SLOTARENA_H_
+#define _SPTAG_SPANN_SLOTARENA_H_
+
+#include "Core/Common.h"
+#include <atomic>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <tbb/concurrent_queue.h>
+
+namespace SPTAG::SPANN {
+// Fixed-size slots carved from slabs of about kSlabBytes, for the address arrays of the SPDK block
+// mapping. Free slots sit in per-thread shards that a thread refills from its neighbours before it
+// cuts a new slab, so Allocate never waits for a slot to come back. Retired slots go through a FIFO
+// quarantine first and become reusable only after quarantine later retirements: a reader that
+// loaded the old array before the swap still reads valid addresses, as with the former spare queue.
+// Slots are only ever returned to the slabs, which go away with the arena
+class SlotArena {
+   public:
+    SlotArena() {}
+    SlotArena(const SlotArena&) = delete;
+    SlotArena& operator=(const SlotArena&) = delete;
+
+    ~SlotArena() {
+        Clear();
+    }
+
+    // drops every slot, so it is called before any is handed out or once none is referenced
+    void Initialize(size_t p_slotBytes, size_t p_quarantine) {
+        Clear();
+        m_slotBytes = (p_slotBytes + sizeof(std::uint64_t) - 1) / sizeof(std::uint64_t) * sizeof(std::uint64_t);
+        m_slabSlots = (std::max)(kSlabBytes / m_slotBytes, (size_t)1);
+        m_quarantineLimit = p_quarantine;
+    }
+
+    // frees the slabs, every slot handed out is gone with them
+    void Clear() {
+        for (Shard& shard : m_shards) shard.m_free.clear();
+        m_quarantine.clear();
+        m_quarantined = 0;
+        std::lock_guard<std::mutex> lock(m_slabLock);
+        for (char* slab : m_slabs) ALIGN_FREE(slab);
+        m_slabs.clear();
+    }
+
+    // nullptr only when no slab can be allocated
+    void* Allocate() {
+        size_t home = Home();
+        for (size_t i = 0; i < kShards; i++) {
+            Shard& shard = m_shards[(home + i) % kShards];
+            // neighbours are only raided when they are not busy themselves
+            std::unique_lock<std::mutex> lock(shard.m_lock, std::defer_lock);
+            if (i == 0)
+                lock.lock();
+            else if (!lock.try_lock())
+                continue;
+            if (!shard.m_free.empty()) {
+                void* slot = shard.m_free.back();
+                shard.m_free.pop_back();
+                return slot;
+            }
+        }
+        return CutSlab(m_shards[home]);
+    }
+
+    void Retire(void* p_slot) {
+        m_quarantine.push(p_slot);
+        if (m_quarantined.fetch_add(1) < m_quarantineLimit)
+            return;
+        void* oldest;
+        if (!m_quarantine.try_pop(oldest)) {
+            m_quarantined--;
+            return;
+        }
+        m_quarantined--;
+        Shard& shard = m_shards[Home()];
+        std::lock_guard<std::mutex> lock(shard.m_lock);
+        shard.m_free.push_back(oldest);
+    }
+
+    inline size_t SlotBytes() const {
+        return m_slotBytes;
+    }
+
+    // bytes held by the slabs, in use or not
+    size_t ReservedBytes() {
+        std::lock_guard<std::mutex> lock(m_slabLock);
+        return m_slabs.size() * m_slabSlots * m_slotBytes;
+    }
+
+   private:
+    static constexpr size_t kShards = 16;
+    static constexpr size_t kSlabBytes = 1 << 20;
+
+    struct alignas(64) Shard {
+        std::mutex m_lock;
+        std::vector<void*> m_free;
+    };
+
+    static inline size_t Home() {
+        static thread_local size_t home = std::hash<std::thread::id>()(std::this_thread::get_id()) % kShards;
+        return home;
+    }
+
+    // the first slot goes to the caller, the rest of the slab to its shard
+    void* CutSlab(Shard& p_shard) {
+        char* slab = (char*)ALIGN_ALLOC(m_slabSlots * m_slotBytes);
+        if (slab == nullptr)
+            return nullptr;
+        {
+            std::lock_guard<std::mutex> lock(m_slabLock);
+            m_slabs.push_back(slab);
+        }
+        std::lock_guard<std::mutex> lock(p_shard.m_lock);
+        for (size_t i = m_slabSlots - 1; i > 0; i--) p_shard.m_free.push_back(slab + i * m_slotBytes);
+        return slab;
+    }
+
+    size_t m_slotBytes = sizeof(std::uint64_t);
+    size_t m_slabSlots = 1;
+    size_t m_quarantineLimit = 0;
+
+    Shard m_shards[kShards];
+    tbb::concurrent_queue<void*> m_quarantine;
+    std::atomic<size_t> m_quarantined{0};
+
+    std::mutex m_slabLock;
+    std::vector<char*> m_slabs;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_SLOTARENA_H_
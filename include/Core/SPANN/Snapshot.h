@@ -0,0 +1,229 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_SNAPSHOT_H_
+#define _SPTAG_SPANN_SNAPSHOT_H_
+
+#include "Core/Common.h"
+#include "Core/SPANN/IKeyValueIO.h"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Lets a snapshot freeze the index between two updates. Every update that changes more than one
+// structure (the posting, its size, the version labels, the head index) runs inside a Scope; Freeze
+// waits for the scopes in flight to leave and holds new ones at the door until Thaw. Scopes nest on
+// one thread, so an append that splits or a reassign that appends does not wait for itself. New
+// scopes wait once a freeze is pending, so a steady stream of updates cannot starve it
+class WriteGate {
+   public:
+    class Scope {
+       public:
+        // a nullptr gate is no gate
+        explicit Scope(WriteGate* p_gate)
+            : m_gate(p_gate) {
+            if (m_gate != nullptr && Depth()[m_gate]++ == 0)
+                m_gate->Enter();
+        }
+
+        ~Scope() {
+            if (m_gate == nullptr)
+                return;
+            auto& depth = Depth();
+            if (--depth[m_gate] == 0) {
+                depth.erase(m_gate);
+                m_gate->Exit();
+            }
+        }
+
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+       private:
+        static std::unordered_map<const WriteGate*, int>& Depth() {
+            static thread_local std::unordered_map<const WriteGate*, int> depth;
+            return depth;
+        }
+
+        WriteGate* m_gate;
+    };
+
+    // one freeze at a time, returns once no update is in flight
+    void Freeze() {
+        m_freezeLock.lock();
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_frozen.store(true);
+        m_drained.wait(lock, [this] { return m_active.load() == 0; });
+    }
+
+    void Thaw() {
+        {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_frozen.store(false);
+        }
+        m_open.notify_all();
+        m_freezeLock.unlock();
+    }
+
+    bool Frozen() const {
+        return m_frozen.load();
+    }
+
+    // moves as every scope enters and leaves. Nothing was updated between two reads returning the
+    // same epoch, the first taken with no scope in flight
+    std::uint64_t Epoch() const {
+        return m_epoch.load();
+    }
+
+    bool Idle() const {
+        return m_active.load() == 0;
+    }
+
+   private:
+    void Enter() {
+        while (true) {
+            m_active.fetch_add(1);
+            if (!m_frozen.load()) {
+                m_epoch.fetch_add(1);
+                return;
+            }
+            Exit();
+            std::unique_lock<std::mutex> lock(m_lock);
+            m_open.wait(lock, [this] { return !m_frozen.load(); });
+        }
+    }
+
+    void Exit() {
+        m_epoch.fetch_add(1);
+        if (m_active.fetch_sub(1) == 1 && m_frozen.load()) {
+            std::lock_guard<std::mutex> lock(m_lock);
+            m_drained.notify_all();
+        }
+    }
+
+    std::atomic<int> m_active{0};
+    std::atomic<std::uint64_t> m_epoch{0};
+    std::atomic<bool> m_frozen{false};
+    std::mutex m_lock;
+    std::mutex m_freezeLock;
+    std::condition_variable m_drained;
+    std::condition_variable m_open;
+};
+
+// The block mapping of a store as of one moment, copied row by row, and the blocks it names kept
+// from reuse until it is released. Postings are never rewritten in place, a write takes new blocks
+// and releases the old ones once its row is swapped, so holding the releases back is all it takes
+// for the copied rows to keep reading the content they had when the snapshot was taken
+class MappingSnapshot {
+   public:
+    bool Active() const {
+        return m_active.load();
+    }
+
+    // p_rows[key * p_cols] in the layout of the live mapping: the posting size, then its blocks.
+    // Releases arriving while the blocks are marked wait for the marking to finish
+    void Capture(std::vector<AddressType>&& p_rows, SizeType p_keys, int p_cols, AddressType p_maxBlocks) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_active.store(true);
+        m_rows = std::move(p_rows);
+        m_keys = p_keys;
+        m_cols = p_cols;
+        m_maxBlocks = p_maxBlocks;
+        m_pinned.assign((p_maxBlocks + 63) >> 6, 0);
+        m_pinnedNum = 0;
+        for (SizeType key = 0; key < p_keys; key++) {
+            const AddressType* row = Row(key);
+            if (row == nullptr)
+                continue;
+            for (AddressType i = 0; i < Pages(row); i++) {
+                AddressType block = row[1 + i];
+                if (block >= 0 && block < p_maxBlocks && (m_pinned[block >> 6] & (1ULL << (block & 63))) == 0) {
+                    m_pinned[block >> 6] |= 1ULL << (block & 63);
+                    m_pinnedNum++;
+                }
+            }
+        }
+    }
+
+    // the row of key, nullptr when key held no posting at the snapshot
+    const AddressType* Row(SizeType p_key) const {
+        if (p_key < 0 || p_key >= m_keys)
+            return nullptr;
+        const AddressType* row = m_rows.data() + (size_t)p_key * m_cols;
+        return row[0] < 0 ? nullptr : row;
+    }
+
+    static AddressType Pages(const AddressType* p_row) {
+        return (p_row[0] + PageSize - 1) >> PageSizeEx;
+    }
+
+    SizeType Keys() const {
+        return m_keys;
+    }
+
+    AddressType PinnedBlocks() const {
+        return m_pinnedNum;
+    }
+
+    // moves the blocks the snapshot still reads from p_blocks to the deferred list and returns how
+    // many of p_blocks, now compacted to the front, may go back to the device right away
+    int Hold(AddressType* p_blocks, int p_count) {
+        if (!m_active.load())
+            return p_count;
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (!m_active.load())
+            return p_count;
+        int kept = 0;
+        for (int i = 0; i < p_count; i++) {
+            AddressType block = p_blocks[i];
+            if (block >= 0 && block < m_maxBlocks && (m_pinned[block >> 6] & (1ULL << (block & 63))) != 0)
+                m_deferred.push_back(block);
+            else
+                p_blocks[kept++] = block;
+        }
+        return kept;
+    }
+
+    // ends the snapshot and returns the blocks whose release it held back
+    std::vector<AddressType> Release() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        m_active.store(false);
+        std::vector<AddressType> deferred;
+        deferred.swap(m_deferred);
+        std::vector<AddressType>().swap(m_rows);
+        std::vector<std::uint64_t>().swap(m_pinned);
+        m_keys = 0;
+        m_pinnedNum = 0;
+        return deferred;
+    }
+
+    size_t Deferred() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_deferred.size();
+    }
+
+   private:
+    std::atomic<bool> m_active{false};
+    std::mutex m_lock;
+    std::vector<AddressType> m_rows;
+    SizeType m_keys = 0;
+    int m_cols = 0;
+    AddressType m_maxBlocks = 0;
+    std::vector<std::uint64_t> m_pinned;
+    AddressType m_pinnedNum = 0;
+    std::vector<AddressType> m_deferred;
+};
+
+// backup.ini of an online backup: by section, the option values that open the backup in place of
+// the live files, and in [Backup] the WAL position it was taken at and whether it is complete
+typedef std::map<std::string, std::map<std::string, std::string>> BackupManifest;
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_SNAPSHOT_H_
@@ -0,0 +1,405 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_STAGELATENCY_H_
+#define _SPTAG_SPANN_STAGELATENCY_H_
+
+#include "Core/Common.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+// 0 compiles every stage timer and histogram down to nothing
+#ifndef SPTAG_STAGE_TIMING
+#define SPTAG_STAGE_TIMING 1
+#endif
+
+namespace SPTAG::SPANN {
+static constexpr bool kStageTiming = SPTAG_STAGE_TIMING != 0;
+
+// Stages of searches and updates timed separately. The search stages come first, a query records
+// all of them once it is done
+enum class Stage : int {
+    HeadSearch = 0,
+    IOSubmit,
+    IOWait,
+    PostingScan,
+    Append,
+    AppendIO,
+    Split,
+    SplitRead,
+    SplitClustering,
+    SplitWrite,
+    UpdateHead,
+    ReassignScan,
+    ReassignScanIO,
+    Reassign,
+    ReassignSelect,
+    ReassignAppend,
+    GC
+};
+static constexpr int kStages = 17;
+static constexpr int kSearchStages = 4;
+
+inline const char* StageName(int p_stage) {
+    static const char* names[kStages] = {"head search", "I/O submit", "I/O wait", "posting scan", "append", "append I/O", "split", "split read",
+                                         "split clustering", "split write", "update head", "reassign scan", "reassign scan I/O", "reassign",
+                                         "reassign select", "reassign append", "GC"};
+    return names[p_stage];
+}
+
+// Time stamp counter, a few cycles to read against tens of nanoseconds for a clock call. Ticks are
+// only turned into time when reported, with a rate measured once against the steady clock
+namespace Tsc {
+inline std::uint64_t Now() {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return (std::uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+inline double TicksPerUs() {
+    static const double rate = [] {
+#if defined(__x86_64__) || defined(__i386__)
+        auto start = std::chrono::steady_clock::now();
+        std::uint64_t startTicks = __rdtsc();
+        while (std::chrono::steady_clock::now() - start < std::chrono::milliseconds(10)) {
+        }
+        std::uint64_t ticks = __rdtsc() - startTicks;
+        double us = (double)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count() / 1000;
+        return ticks > 0 && us > 0 ? ticks / us : 1000.0;
+#else
+        return 1000.0;
+#endif
+    }();
+    return rate;
+}
+
+inline double ToUs(std::uint64_t p_ticks) {
+    return p_ticks / TicksPerUs();
+}
+}  // namespace Tsc
+
+inline std::uint64_t StageNow() {
+    if constexpr (kStageTiming)
+        return Tsc::Now();
+    else
+        return 0;
+}
+
+// Ticks one operation spent in each stage, summed over the calls it made
+struct StageTicks {
+    std::uint64_t m_ticks[kStages] = {};
+
+    inline void Add(Stage p_stage, std::uint64_t p_ticks) {
+        m_ticks[(int)p_stage] += p_ticks;
+    }
+
+    inline double Us(Stage p_stage) const {
+        return Tsc::ToUs(m_ticks[(int)p_stage]);
+    }
+
+    inline void Clear() {
+        for (int s = 0; s < kStages; s++) m_ticks[s] = 0;
+    }
+};
+
+// where the stages timed deep in a call, such as the I/O of a search, are summed for the calling
+// thread, nullptr when nobody asked
+inline StageTicks*& CurrentStageTicks() {
+    static thread_local StageTicks* ticks = nullptr;
+    return ticks;
+}
+
+class StageTicksScope {
+   public:
+    explicit StageTicksScope(StageTicks* p_ticks)
+        : m_saved(CurrentStageTicks()) {
+        CurrentStageTicks() = p_ticks;
+    }
+
+    ~StageTicksScope() {
+        CurrentStageTicks() = m_saved;
+    }
+
+    StageTicksScope(const StageTicksScope&) = delete;
+    StageTicksScope& operator=(const StageTicksScope&) = delete;
+
+   private:
+    StageTicks* m_saved;
+};
+
+// adds p_ticks to the stage of the calling thread's operation, if it has one
+inline void AddStageTicks(Stage p_stage, std::uint64_t p_ticks) {
+    if constexpr (kStageTiming) {
+        if (StageTicks* ticks = CurrentStageTicks())
+            ticks->Add(p_stage, p_ticks);
+    }
+}
+
+// adds the time in scope to the stage of the calling thread's operation, free when there is none
+class StageSpan {
+   public:
+    explicit StageSpan(Stage p_stage)
+        : m_stage(p_stage), m_ticks(kStageTiming ? CurrentStageTicks() : nullptr), m_begin(m_ticks ? Tsc::Now() : 0) {
+    }
+
+    ~StageSpan() {
+        if (m_ticks != nullptr)
+            m_ticks->Add(m_stage, Tsc::Now() - m_begin);
+    }
+
+    StageSpan(const StageSpan&) = delete;
+    StageSpan& operator=(const StageSpan&) = delete;
+
+   private:
+    Stage m_stage;
+    StageTicks* m_ticks;
+    std::uint64_t m_begin;
+};
+
+// Log-linear buckets as in HDR histograms: 16 per power of two, so a percentile is off by at most
+// 1/32 of its value, up to 2^48 ticks
+struct StageBuckets {
+    static constexpr int kSubBits = 4;
+    static constexpr int kSub = 1 << kSubBits;
+    static constexpr int kMaxBits = 48;
+    static constexpr int kCount = (kMaxBits - kSubBits + 1) * kSub;
+
+    static inline int Of(std::uint64_t p_ticks) {
+        if (p_ticks < (std::uint64_t)kSub)
+            return (int)p_ticks;
+        int msb = 63 - __builtin_clzll(p_ticks);
+        if (msb >= kMaxBits)
+            return kCount - 1;
+        return (msb - kSubBits + 1) * kSub + (int)((p_ticks >> (msb - kSubBits)) & (kSub - 1));
+    }
+
+    static inline std::uint64_t Low(int p_bucket) {
+        if (p_bucket < 2 * kSub)
+            return (std::uint64_t)p_bucket;
+        int msb = p_bucket / kSub + kSubBits - 1;
+        return (std::uint64_t)(kSub + p_bucket % kSub) << (msb - kSubBits);
+    }
+
+    static inline std::uint64_t Width(int p_bucket) {
+        if (p_bucket < 2 * kSub)
+            return 1;
+        return (std::uint64_t)1 << (p_bucket / kSub - 1);
+    }
+};
+
+// counts of all stages at one point in time, subtract two to get an interval
+struct StageSnapshot {
+    std::vector<std::uint64_t> m_counts = std::vector<std::uint64_t>((size_t)kStages * StageBuckets::kCount, 0);
+    std::uint64_t m_ticks[kStages] = {};
+
+    StageSnapshot operator-(const StageSnapshot& p_earlier) const {
+        StageSnapshot diff;
+        for (size_t i = 0; i < m_counts.size(); i++) diff.m_counts[i] = m_counts[i] - p_earlier.m_counts[i];
+        for (int s = 0; s < kStages; s++) diff.m_ticks[s] = m_ticks[s] - p_earlier.m_ticks[s];
+        return diff;
+    }
+
+    std::uint64_t Count(Stage p_stage) const {
+        std::uint64_t count = 0;
+        const std::uint64_t* counts = m_counts.data() + (size_t)p_stage * StageBuckets::kCount;
+        for (int b = 0; b < StageBuckets::kCount; b++) count += counts[b];
+        return count;
+    }
+
+    double MeanUs(Stage p_stage) const {
+        std::uint64_t count = Count(p_stage);
+        return count > 0 ? Tsc::ToUs(m_ticks[(int)p_stage]) / count : 0;
+    }
+
+    double TotalUs(Stage p_stage) const {
+        return Tsc::ToUs(m_ticks[(int)p_stage]);
+    }
+
+    // middle of the bucket holding the p_fraction quantile
+    double PercentileUs(Stage p_stage, double p_fraction) const {
+        std::uint64_t count = Count(p_stage);
+        if (count == 0)
+            return 0;
+        std::uint64_t rank = (std::min)((std::uint64_t)(p_fraction * count), count - 1), seen = 0;
+        const std::uint64_t* counts = m_counts.data() + (size_t)p_stage * StageBuckets::kCount;
+        int b = 0;
+        for (; b < StageBuckets::kCount - 1; b++) {
+            seen += counts[b];
+            if (seen > rank)
+                break;
+        }
+        return Tsc::ToUs(StageBuckets::Low(b)) + Tsc::ToUs(StageBuckets::Width(b)) / 2;
+    }
+
+    // samples at most p_boundsUs[i] for ascending bounds, a bucket straddling a bound counts
+    // towards the next one, so the counts are low by at most a bucket width
+    std::vector<std::uint64_t> CumulativeCounts(Stage p_stage, const std::vector<double>& p_boundsUs) const {
+        std::vector<std::uint64_t> cumulative(p_boundsUs.size(), 0);
+        const std::uint64_t* counts = m_counts.data() + (size_t)p_stage * StageBuckets::kCount;
+        std::uint64_t seen = 0;
+        size_t i = 0;
+        for (int b = 0; b < StageBuckets::kCount && i < p_boundsUs.size(); b++) {
+            while (i < p_boundsUs.size() && Tsc::ToUs(StageBuckets::Low(b) + StageBuckets::Width(b)) > p_boundsUs[i]) cumulative[i++] = seen;
+            seen += counts[b];
+        }
+        for (; i < p_boundsUs.size(); i++) cumulative[i] = seen;
+        return cumulative;
+    }
+};
+
+// Histograms of every stage, one shard per recording thread. A thread only ever adds to its own
+// shard with plain loads and stores, so recording takes no lock and no atomic read-modify-write;
+// readers sum the shards as they go. Reset keeps a baseline to subtract instead of clearing
+// counters still written by other threads
+class StageRecorder {
+   public:
+    StageRecorder()
+        : m_id(NextId().fetch_add(1) + 1) {
+        if constexpr (kStageTiming)
+            Tsc::TicksPerUs();
+    }
+
+    ~StageRecorder() {
+        Shard* shard = m_shards.load();
+        while (shard != nullptr) {
+            Shard* next = shard->m_next;
+            delete shard;
+            shard = next;
+        }
+    }
+
+    StageRecorder(const StageRecorder&) = delete;
+    StageRecorder& operator=(const StageRecorder&) = delete;
+
+    inline void Record(Stage p_stage, std::uint64_t p_ticks) {
+        if constexpr (kStageTiming)
+            LocalShard()->Add((int)p_stage, p_ticks);
+    }
+
+    // records the time since p_begin, a StageNow() reading
+    inline void RecordSince(Stage p_stage, std::uint64_t p_begin) {
+        if constexpr (kStageTiming)
+            Record(p_stage, Tsc::Now() - p_begin);
+    }
+
+    // one sample of each search stage of a finished query
+    inline void RecordQuery(const StageTicks& p_ticks) {
+        if constexpr (kStageTiming) {
+            Shard* shard = LocalShard();
+            for (int s = 0; s < kSearchStages; s++) shard->Add(s, p_ticks.m_ticks[s]);
+        }
+    }
+
+    // samples since the last Reset, or since the start for p_sinceReset false as monotonic
+    // counters for a metrics scrape need
+    StageSnapshot Take(bool p_sinceReset = true) const {
+        StageSnapshot snapshot;
+        for (Shard* shard = m_shards.load(std::memory_order_acquire); shard != nullptr; shard = shard->m_next) {
+            for (size_t i = 0; i < snapshot.m_counts.size(); i++) snapshot.m_counts[i] += shard->m_counts[i].load(std::memory_order_relaxed);
+            for (int s = 0; s < kStages; s++) snapshot.m_ticks[s] += shard->m_ticks[s].load(std::memory_order_relaxed);
+        }
+        if (!p_sinceReset)
+            return snapshot;
+        std::lock_guard<std::mutex> lock(m_baselineLock);
+        return snapshot - m_baseline;
+    }
+
+    void Reset() {
+        StageSnapshot now = Take();
+        std::lock_guard<std::mutex> lock(m_baselineLock);
+        for (size_t i = 0; i < now.m_counts.size(); i++) m_baseline.m_counts[i] += now.m_counts[i];
+        for (int s = 0; s < kStages; s++) m_baseline.m_ticks[s] += now.m_ticks[s];
+    }
+
+    void Print() const {
+        if constexpr (!kStageTiming)
+            return;
+        StageSnapshot snapshot = Take();
+        for (int s = 0; s < kStages; s++) {
+            Stage stage = (Stage)s;
+            std::uint64_t count = snapshot.Count(stage);
+            if (count == 0)
+                continue;
+            LOG(Helper::LogLevel::LL_Info, "Stage %s: %llu samples, mean %.1lf us, P50 %.1lf us, P99 %.1lf us, P99.9 %.1lf us, max %.1lf us\n",
+                StageName(s), (unsigned long long)count, snapshot.MeanUs(stage), snapshot.PercentileUs(stage, 0.5), snapshot.PercentileUs(stage, 0.99),
+                snapshot.PercentileUs(stage, 0.999), snapshot.PercentileUs(stage, 1.0));
+        }
+    }
+
+   private:
+    struct Shard {
+        std::atomic<std::uint64_t> m_counts[(size_t)kStages * StageBuckets::kCount] = {};
+        std::atomic<std::uint64_t> m_ticks[kStages] = {};
+        Shard* m_next = nullptr;
+
+        inline void Add(int p_stage, std::uint64_t p_ticks) {
+            std::atomic<std::uint64_t>& count = m_counts[(size_t)p_stage * StageBuckets::kCount + StageBuckets::Of(p_ticks)];
+            count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            m_ticks[p_stage].store(m_ticks[p_stage].load(std::memory_order_relaxed) + p_ticks, std::memory_order_relaxed);
+        }
+    };
+
+    static std::atomic<std::uint64_t>& NextId() {
+        static std::atomic<std::uint64_t> id(0);
+        return id;
+    }
+
+    // shards are found by recorder id, never reused, so entries of destroyed recorders are never hit
+    Shard* LocalShard() {
+        static thread_local std::uint64_t lastId = 0;
+        static thread_local Shard* lastShard = nullptr;
+        if (lastId == m_id)
+            return lastShard;
+        static thread_local std::unordered_map<std::uint64_t, Shard*> shards;
+        Shard*& shard = shards[m_id];
+        if (shard == nullptr) {
+            shard = new Shard();
+            shard->m_next = m_shards.load(std::memory_order_relaxed);
+            while (!m_shards.compare_exchange_weak(shard->m_next, shard, std::memory_order_release, std::memory_order_relaxed)) {
+            }
+        }
+        lastId = m_id;
+        lastShard = shard;
+        return shard;
+    }
+
+    const std::uint64_t m_id;
+    std::atomic<Shard*> m_shards{nullptr};
+    mutable std::mutex m_baselineLock;
+    StageSnapshot m_baseline;
+};
+
+// records the time in scope into a recorder
+class StageTimer {
+   public:
+    StageTimer(StageRecorder& p_recorder, Stage p_stage)
+        : m_recorder(p_recorder), m_stage(p_stage), m_begin(StageNow()) {
+    }
+
+    ~StageTimer() {
+        m_recorder.RecordSince(m_stage, m_begin);
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+   private:
+    StageRecorder& m_recorder;
+    Stage m_stage;
+    std::uint64_t m_begin;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_STAGELATENCY_H_
@@ -0,0 +1,445 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_TIEREDSTORAGE_H_
+#define _SPTAG_SPANN_TIEREDSTORAGE_H_
+
+#include "Core/Common.h"
+#include "Core/SPANN/IKeyValueIO.h"
+#include <algorithm>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// device tier the blocks allocated by the calling thread go to, -1 for the write tier of the device
+inline int& CurrentTier() {
+    static thread_local int tier = -1;
+    return tier;
+}
+
+// places the blocks the calling thread allocates on p_tier while in scope, a tiering move
+// rewrites its posting under one
+class TierScope {
+   public:
+    explicit TierScope(int p_tier)
+        : m_saved(CurrentTier()) {
+        CurrentTier() = p_tier;
+    }
+
+    ~TierScope() {
+        CurrentTier() = m_saved;
+    }
+
+    TierScope(const TierScope&) = delete;
+    TierScope& operator=(const TierScope&) = delete;
+
+   private:
+    int m_saved;
+};
+
+// Block devices of different speed and cost under one address space, fastest first: tier i holds
+// the addresses [base_i, base_i + blocks_i) and sees them from 0 on. Every tier keeps its own free
+// space, new blocks come from the tier of the calling thread's TierScope and spill over to the
+// slower, then the faster tiers once it is full. A posting moved to another tier is rewritten to
+// new blocks and its mapping row swapped, so readers following the row never see the move.
+// Appends after a move may leave a posting on two tiers, its reads are split per tier
+class TieredBlockDevice : public BlockDevice {
+   public:
+    // p_blocks[i] blocks of p_devices[i], 0 for the maxBlocks the first Initialize is given
+    TieredBlockDevice(const std::vector<std::shared_ptr<BlockDevice>>& p_devices, const std::vector<AddressType>& p_blocks, int p_writeTier = 0)
+        : m_writeTier(p_writeTier) {
+        for (size_t i = 0; i < p_devices.size(); i++) {
+            m_tiers.emplace_back();
+            m_tiers.back().device = p_devices[i];
+            m_tiers.back().blocks = i < p_blocks.size() ? p_blocks[i] : 0;
+            m_tiers.back().allocator.reset(new ExtentAllocator());
+        }
+    }
+
+    bool Initialize(int batchSize, AddressType maxBlocks = kMaxNumBlocks) override {
+        std::lock_guard<std::mutex> lock(m_initMutex);
+        for (size_t i = 0; i < m_tiers.size(); i++) {
+            Tier& tier = m_tiers[i];
+            if (!tier.device->Initialize(batchSize, tier.blocks > 0 ? tier.blocks : maxBlocks)) {
+                LOG(Helper::LogLevel::LL_Error, "TieredBlockDevice: tier %d fails to initialize\n", (int)i);
+                for (size_t j = 0; j < i; j++) m_tiers[j].device->ShutDown();
+                return false;
+            }
+        }
+        if (!m_bases.empty())
+            return true;
+        AddressType base = 0;
+        for (size_t i = 0; i < m_tiers.size(); i++) {
+            Tier& tier = m_tiers[i];
+            tier.base = base;
+            tier.blocks = tier.device->MaxBlocks();
+            tier.allocator->Initialize(0);
+            tier.allocator->AddFree(base, tier.blocks);
+            m_bases.push_back(base);
+            base += tier.blocks;
+            LOG(Helper::LogLevel::LL_Info, "TieredBlockDevice: tier %d holds blocks [%lld, %lld)\n", (int)i, (long long)tier.base, (long long)base);
+        }
+        m_maxBlocks = base;
+        return true;
+    }
+
+    bool ShutDown() override {
+        bool success = true;
+        for (auto& tier : m_tiers) success = tier.device->ShutDown() && success;
+        return success;
+    }
+
+    bool ReadBlocks(AddressType* p_data, std::string* p_value, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        int tier = RowTier(p_data);
+        if (tier < 0)
+            return ReadSpanning(p_data, p_value, timeout);
+        if (m_tiers[tier].base == 0)
+            return m_tiers[tier].device->ReadBlocks(p_data, p_value, timeout);
+        std::vector<AddressType> row;
+        Translate(p_data, tier, row);
+        return m_tiers[tier].device->ReadBlocks(row.data(), p_value, timeout);
+    }
+
+    bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<std::string>* p_values, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        p_values->resize(p_data.size());
+        bool success = true;
+        Batch& batch = Split(p_data);
+        for (size_t t = 0; t < m_tiers.size(); t++) {
+            if (batch.rows[t].empty())
+                continue;
+            std::vector<std::string> values;
+            success = m_tiers[t].device->ReadBlocks(batch.rows[t], &values, timeout) && success;
+            for (size_t j = 0; j < values.size(); j++) (*p_values)[batch.index[t][j]].swap(values[j]);
+        }
+        for (int i : batch.spanning) success = ReadSpanning(p_data[i], &(*p_values)[i], timeout) && success;
+        return success;
+    }
+
+    // every tier is read in turn, the fastest first, so the scan starts on its postings while the
+    // slower ones are still to come. Postings on two tiers are assembled in a buffer of their own
+    bool ReadBlocks(std::vector<AddressType*>& p_data, std::vector<PostingView>* p_views, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout = std::chrono::microseconds::max()) override {
+        p_views->assign(p_data.size(), PostingView());
+        auto& owners = ViewOwners();
+        bool success = true;
+        Batch& batch = Split(p_data);
+        for (size_t t = 0; t < m_tiers.size(); t++) {
+            if (batch.rows[t].empty())
+                continue;
+            std::vector<PostingView>& views = batch.views[t];
+            const std::vector<int>& index = batch.index[t];
+            std::function<void(int)> onDone;
+            if (p_onPostingDone) {
+                onDone = [&](int j) {
+                    (*p_views)[index[j]] = views[j];
+                    p_onPostingDone(index[j]);
+                };
+            }
+            success = m_tiers[t].device->ReadBlocks(batch.rows[t], &views, onDone, timeout) && success;
+            for (size_t j = 0; j < views.size(); j++) {
+                (*p_views)[index[j]] = views[j];
+                if (views[j].data != nullptr)
+                    owners[views[j].data] = m_tiers[t].device.get();
+            }
+        }
+        for (int i : batch.spanning) {
+            std::unique_ptr<std::string> buffer(new std::string());
+            if (!ReadSpanning(p_data[i], buffer.get(), timeout) || buffer->empty()) {
+                success = false;
+                continue;
+            }
+            PostingView& view = (*p_views)[i];
+            view = {buffer->data(), (AddressType)buffer->size(), (AddressType)((buffer->size() + PageSize - 1) >> PageSizeEx)};
+            owners[view.data] = nullptr;
+            SpanBuffers()[view.data] = std::move(buffer);
+            if (p_onPostingDone)
+                p_onPostingDone(i);
+        }
+        return success;
+    }
+
+    using BlockDevice::ReadBlocks;
+
+    void ReleaseViews(std::vector<PostingView>* p_views) override {
+        auto& owners = ViewOwners();
+        std::vector<std::vector<PostingView>> back(m_tiers.size());
+        for (auto& view : *p_views) {
+            if (view.data == nullptr)
+                continue;
+            auto iter = owners.find(view.data);
+            if (iter == owners.end())
+                continue;
+            BlockDevice* owner = iter->second;
+            owners.erase(iter);
+            if (owner == nullptr) {
+                SpanBuffers().erase(view.data);
+                continue;
+            }
+            for (size_t t = 0; t < m_tiers.size(); t++) {
+                if (m_tiers[t].device.get() == owner)
+                    back[t].push_back(view);
+            }
+        }
+        for (size_t t = 0; t < m_tiers.size(); t++) {
+            if (!back[t].empty())
+                m_tiers[t].device->ReleaseViews(&back[t]);
+        }
+        p_views->clear();
+    }
+
+    using BlockDevice::WriteBlocks;
+
+    // each write goes to the tier of its blocks, a write over blocks of two tiers is cut into one
+    // part per run of same-tier blocks
+    bool WriteBlocks(std::vector<AddressType*>& p_data, std::vector<int>& p_sizes, std::vector<const std::string*>& p_values) override {
+        std::vector<std::vector<AddressType*>> rows(m_tiers.size());
+        std::vector<std::vector<int>> sizes(m_tiers.size());
+        std::vector<std::vector<const std::string*>> values(m_tiers.size());
+        std::deque<std::vector<AddressType>> translated;
+        std::deque<std::string> parts;
+        for (size_t i = 0; i < p_data.size(); i++) {
+            AddressType* blocks = p_data[i];
+            for (int first = 0; first < p_sizes[i];) {
+                int tier = TierOf(blocks[first]), last = first + 1;
+                while (last < p_sizes[i] && TierOf(blocks[last]) == tier) last++;
+                const std::string* value = p_values[i];
+                if (first > 0 || last < p_sizes[i]) {
+                    size_t begin = (size_t)first * PageSize;
+                    parts.emplace_back(begin < value->size() ? value->substr(begin, (size_t)(last - first) * PageSize) : std::string());
+                    value = &parts.back();
+                }
+                AddressType* local = blocks + first;
+                if (m_tiers[tier].base != 0) {
+                    translated.emplace_back(blocks + first, blocks + last);
+                    for (auto& block : translated.back()) block -= m_tiers[tier].base;
+                    local = translated.back().data();
+                }
+                rows[tier].push_back(local);
+                sizes[tier].push_back(last - first);
+                values[tier].push_back(value);
+                first = last;
+            }
+        }
+        bool success = true;
+        for (size_t t = 0; t < m_tiers.size(); t++) {
+            if (!rows[t].empty())
+                success = m_tiers[t].device->WriteBlocks(rows[t], sizes[t], values[t]) && success;
+        }
+        return success;
+    }
+
+    // the buffer of the tier new blocks of the calling thread come from
+    PostingView AcquireWriteBuffer(AddressType p_pages) override {
+        BlockDevice* device = m_tiers[WriteTier()].device.get();
+        PostingView view = device->AcquireWriteBuffer(p_pages);
+        if (view.data != nullptr)
+            ViewOwners()[view.data] = device;
+        return view;
+    }
+
+    // blocks the allocation spilled to another tier than the buffer's go the copying way
+    bool WriteBlocksDirect(const AddressType* p_blocks, AddressType p_pages, const char* p_buffer) override {
+        if (p_pages <= 0)
+            return true;
+        int tier = TierOf(p_blocks[0]);
+        bool single = true;
+        for (AddressType i = 1; i < p_pages && single; i++) single = TierOf(p_blocks[i]) == tier;
+        auto iter = ViewOwners().find(p_buffer);
+        std::vector<AddressType> blocks(p_blocks, p_blocks + p_pages);
+        if (single && iter != ViewOwners().end() && iter->second == m_tiers[tier].device.get()) {
+            for (auto& block : blocks) block -= m_tiers[tier].base;
+            return m_tiers[tier].device->WriteBlocksDirect(blocks.data(), p_pages, p_buffer);
+        }
+        std::string value(p_buffer, (size_t)p_pages * PageSize);
+        return WriteBlocks(blocks.data(), (int)p_pages, value);
+    }
+
+    bool IOStatistics() override {
+        bool success = true;
+        for (auto& tier : m_tiers) success = tier.device->IOStatistics() && success;
+        return success;
+    }
+
+    // device counters of the fastest tier under their usual names, the space of every tier by label
+    void CollectMetrics(Helper::MetricsWriter& p_writer) override {
+        m_tiers[0].device->CollectMetrics(p_writer);
+        for (size_t t = 0; t < m_tiers.size(); t++) {
+            std::string label = Helper::MetricsWriter::Label("tier", std::to_string(t));
+            p_writer.Gauge("sptag_tier_blocks", "Blocks of each storage tier", (double)m_tiers[t].blocks, label);
+            p_writer.Gauge("sptag_tier_free_blocks", "Free blocks of each storage tier", (double)m_tiers[t].allocator->FreeBlocks(), label);
+        }
+    }
+
+    bool GetBlocks(AddressType* p_data, int p_size) override {
+        int first = WriteTier(), tiers = (int)m_tiers.size();
+        for (int step = 0; step < tiers; step++) {
+            int tier = step < tiers - first ? first + step : tiers - 1 - step;
+            if (m_tiers[tier].allocator->Allocate(p_data, p_size))
+                return true;
+        }
+        LOG(Helper::LogLevel::LL_Error, "TieredBlockDevice::GetBlocks: out of free blocks on every tier, requested %d\n", p_size);
+        return false;
+    }
+
+    bool GetBlocksNear(AddressType* p_data, int p_size, AddressType p_near) override {
+        int tier = WriteTier();
+        if (p_near >= 0 && p_near < m_maxBlocks && TierOf(p_near) == tier && m_tiers[tier].allocator->AllocateNear(p_data, p_size, p_near))
+            return true;
+        return GetBlocks(p_data, p_size);
+    }
+
+    bool ReleaseBlocks(AddressType* p_data, int p_size) override {
+        for (int first = 0; first < p_size;) {
+            int tier = TierOf(p_data[first]), last = first + 1;
+            while (last < p_size && TierOf(p_data[last]) == tier) last++;
+            m_tiers[tier].allocator->Release(p_data + first, last - first);
+            first = last;
+        }
+        return true;
+    }
+
+    void ResetBlocks(const std::vector<std::uint64_t>& p_usedBits) override {
+        for (auto& tier : m_tiers) {
+            tier.allocator->Initialize(0);
+            tier.allocator->AddFree(tier.base, tier.blocks, p_usedBits);
+        }
+    }
+
+    AddressType RemainBlocks() override {
+        AddressType free = 0;
+        for (auto& tier : m_tiers) free += tier.allocator->FreeBlocks();
+        return free;
+    }
+
+    int Tiers() override {
+        return (int)m_tiers.size();
+    }
+
+    int TierOf(AddressType p_block) override {
+        if (m_bases.size() <= 1)
+            return 0;
+        return (int)(std::upper_bound(m_bases.begin() + 1, m_bases.end(), p_block) - m_bases.begin()) - 1;
+    }
+
+    AddressType TierBlocks(int p_tier) const {
+        return m_tiers[p_tier].blocks;
+    }
+
+    AddressType TierFreeBlocks(int p_tier) const {
+        return m_tiers[p_tier].allocator->FreeBlocks();
+    }
+
+   private:
+    struct Tier {
+        std::shared_ptr<BlockDevice> device;
+        AddressType base = 0;
+        AddressType blocks = 0;
+        std::unique_ptr<ExtentAllocator> allocator;
+    };
+
+    // the postings of one multi-posting read grouped by tier, kept per thread across reads
+    struct Batch {
+        std::vector<std::vector<AddressType*>> rows;
+        std::vector<std::vector<int>> index;
+        std::vector<std::vector<PostingView>> views;
+        std::vector<std::vector<AddressType>> translated;
+        std::vector<int> spanning;
+    };
+
+    inline int WriteTier() const {
+        int tier = CurrentTier();
+        return tier >= 0 && tier < (int)m_tiers.size() ? tier : m_writeTier;
+    }
+
+    // the tier of every block of the row, -1 if they lie on several
+    int RowTier(const AddressType* p_row) {
+        AddressType pages = (p_row[0] + PageSize - 1) >> PageSizeEx;
+        if (pages <= 0)
+            return 0;
+        int tier = TierOf(p_row[1]);
+        for (AddressType i = 1; i < pages; i++) {
+            if (TierOf(p_row[1 + i]) != tier)
+                return -1;
+        }
+        return tier;
+    }
+
+    void Translate(const AddressType* p_row, int p_tier, std::vector<AddressType>& p_out) {
+        AddressType pages = (p_row[0] + PageSize - 1) >> PageSizeEx;
+        p_out.assign(p_row, p_row + 1 + pages);
+        for (AddressType i = 1; i <= pages; i++) p_out[i] -= m_tiers[p_tier].base;
+    }
+
+    Batch& Split(std::vector<AddressType*>& p_data) {
+        static thread_local Batch batch;
+        batch.rows.resize(m_tiers.size());
+        batch.index.resize(m_tiers.size());
+        batch.views.resize(m_tiers.size());
+        for (size_t t = 0; t < m_tiers.size(); t++) {
+            batch.rows[t].clear();
+            batch.index[t].clear();
+        }
+        batch.spanning.clear();
+        if (batch.translated.size() < p_data.size())
+            batch.translated.resize(p_data.size());
+        for (size_t i = 0; i < p_data.size(); i++) {
+            int tier = RowTier(p_data[i]);
+            if (tier < 0) {
+                batch.spanning.push_back((int)i);
+                continue;
+            }
+            AddressType* row = p_data[i];
+            if (m_tiers[tier].base != 0) {
+                Translate(p_data[i], tier, batch.translated[i]);
+                row = batch.translated[i].data();
+            }
+            batch.rows[tier].push_back(row);
+            batch.index[tier].push_back((int)i);
+        }
+        return batch;
+    }
+
+    // a posting with blocks on several tiers, read one run of same-tier pages at a time
+    bool ReadSpanning(const AddressType* p_row, std::string* p_value, const std::chrono::microseconds& timeout) {
+        AddressType size = p_row[0], pages = (size + PageSize - 1) >> PageSizeEx;
+        p_value->clear();
+        p_value->reserve((size_t)size);
+        std::vector<AddressType> run;
+        std::string part;
+        for (AddressType first = 0; first < pages;) {
+            int tier = TierOf(p_row[1 + first]);
+            AddressType last = first + 1;
+            while (last < pages && TierOf(p_row[1 + last]) == tier) last++;
+            run.assign(1, (std::min)(size, last * PageSize) - first * PageSize);
+            for (AddressType i = first; i < last; i++) run.push_back(p_row[1 + i] - m_tiers[tier].base);
+            if (!m_tiers[tier].device->ReadBlocks(run.data(), &part, timeout))
+                return false;
+            p_value->append(part);
+            first = last;
+        }
+        return true;
+    }
+
+    // device each view handed out on this thread came from, nullptr for an assembled one
+    static std::unordered_map<const char*, BlockDevice*>& ViewOwners() {
+        static thread_local std::unordered_map<const char*, BlockDevice*> owners;
+        return owners;
+    }
+
+    static std::unordered_map<const char*, std::unique_ptr<std::string>>& SpanBuffers() {
+        static thread_local std::unordered_map<const char*, std::unique_ptr<std::string>> buffers;
+        return buffers;
+    }
+
+    std::vector<Tier> m_tiers;
+    // first address of every tier, set by the first Initialize
+    std::vector<AddressType> m_bases;
+    int m_writeTier;
+    std::mutex m_initMutex;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_TIEREDSTORAGE_H_
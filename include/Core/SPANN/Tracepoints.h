@@ -0,0 +1,113 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_TRACEPOINTS_H_
+#define _SPTAG_SPANN_TRACEPOINTS_H_
+
+#include "Core/Common.h"
+#include <cstdint>
+
+// Static tracepoints (USDT) of provider "spfresh" on the update and search paths and the SPDK
+// device, for bpftrace and perf. A probe is a single nop until a tracer attaches, and its
+// arguments are values the code holds anyway. Built with SPTAG_USDT=1 (the default) and
+// <sys/sdt.h> from systemtap-sdt-dev present; otherwise every probe compiles to nothing.
+//
+//   split__entry(head, entries)                 split__return(head, outcome, new heads)
+//       outcome: 0 garbage collected in place, 1 one cluster left, 2 split
+//   merge__entry(head)                          merge__return(head, outcome, other head, length)
+//       outcome: 0 deferred, 1 head gone, 2 long enough alone, 3 merged, 4 no partner found
+//   reassign__entry(previous head, entries)     reassign__return(previous head, moved, appends)
+//   append__entry(head, entries)                append__return(head, outcome, posting size)
+//       outcome: 0 appended, 1 head gone and reassigned, 2 write failed; posting size after it
+//   search__entry(postings)                     search__return(postings, entries, pages, skipped)
+//   io__submit(device, offset, pages, read, class)
+//   io__complete(device, offset, pages, read, latency us)
+//
+//   bpftrace -e 'usdt:./spfresh:spfresh:split__entry { @s[arg0] = nsecs; }
+//                usdt:./spfresh:spfresh:split__return /@s[arg0]/ { @us = hist((nsecs - @s[arg0]) / 1000); delete(@s[arg0]); }'
+#ifndef SPTAG_USDT
+#define SPTAG_USDT 1
+#endif
+
+#if SPTAG_USDT && defined(__has_include)
+#if __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define SPTAG_HAS_USDT 1
+#endif
+#endif
+
+#ifdef SPTAG_HAS_USDT
+#define SPTAG_PROBE1(name, a1) DTRACE_PROBE1(spfresh, name, a1)
+#define SPTAG_PROBE2(name, a1, a2) DTRACE_PROBE2(spfresh, name, a1, a2)
+#define SPTAG_PROBE3(name, a1, a2, a3) DTRACE_PROBE3(spfresh, name, a1, a2, a3)
+#define SPTAG_PROBE4(name, a1, a2, a3, a4) DTRACE_PROBE4(spfresh, name, a1, a2, a3, a4)
+#define SPTAG_PROBE5(name, a1, a2, a3, a4, a5) DTRACE_PROBE5(spfresh, name, a1, a2, a3, a4, a5)
+#else
+#define SPTAG_PROBE1(name, a1) \
+    do {                       \
+    } while (0)
+#define SPTAG_PROBE2(name, a1, a2) \
+    do {                           \
+    } while (0)
+#define SPTAG_PROBE3(name, a1, a2, a3) \
+    do {                               \
+    } while (0)
+#define SPTAG_PROBE4(name, a1, a2, a3, a4) \
+    do {                                   \
+    } while (0)
+#define SPTAG_PROBE5(name, a1, a2, a3, a4, a5) \
+    do {                                       \
+    } while (0)
+#endif
+
+namespace SPTAG::SPANN {
+// Entry and return probes of the functions with several ways out: the entry fires on
+// construction, the return with whatever the function filled in when the scope ends
+struct SplitProbe {
+    std::int64_t head;
+    std::int64_t outcome = 2;
+    std::int64_t newHeads = 0;
+
+    SplitProbe(SizeType p_head, std::int64_t p_entries)
+        : head(p_head) {
+        SPTAG_PROBE2(split__entry, head, p_entries);
+    }
+
+    ~SplitProbe() {
+        SPTAG_PROBE3(split__return, head, outcome, newHeads);
+    }
+};
+
+struct MergeProbe {
+    std::int64_t head;
+    std::int64_t outcome = 4;
+    std::int64_t other = -1;
+    std::int64_t length = 0;
+
+    explicit MergeProbe(SizeType p_head)
+        : head(p_head) {
+        SPTAG_PROBE1(merge__entry, head);
+    }
+
+    ~MergeProbe() {
+        SPTAG_PROBE4(merge__return, head, outcome, other, length);
+    }
+};
+
+struct AppendProbe {
+    std::int64_t head;
+    std::int64_t outcome = 0;
+    std::int64_t size = 0;
+
+    AppendProbe(SizeType p_head, std::int64_t p_entries)
+        : head(p_head) {
+        SPTAG_PROBE2(append__entry, head, p_entries);
+    }
+
+    ~AppendProbe() {
+        SPTAG_PROBE3(append__return, head, outcome, size);
+    }
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_TRACEPOINTS_H_
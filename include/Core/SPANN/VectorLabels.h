@@ -0,0 +1,140 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_VECTORLABELS_H_
+#define _SPTAG_SPANN_VECTORLABELS_H_
+
+#include "Core/Common.h"
+#include "Core/Common/Dataset.h"
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// attributes a filtered search keeps: labels holding every bit of m_all and, when m_any is not
+// empty, at least one bit of m_any. The empty filter keeps everything
+struct LabelFilter {
+    std::uint64_t m_all = 0;
+    std::uint64_t m_any = 0;
+
+    inline bool Empty() const {
+        return m_all == 0 && m_any == 0;
+    }
+
+    inline bool Matches(std::uint64_t p_labels) const {
+        return (p_labels & m_all) == m_all && (m_any == 0 || (p_labels & m_any) != 0);
+    }
+};
+
+// A 64-bit label mask per VID, bit i set when the vector has attribute i. The masks sit in the
+// blocks of a Dataset that never move, so posting scans test them while inserts add rows, one
+// 8-byte load per entry instead of a call over its metadata. VIDs past the last row have no labels.
+// The vectors per bit are counted for the selectivity estimate of a filter
+class VectorLabels {
+   private:
+    COMMON::Dataset<std::uint64_t> m_data;
+    std::atomic<SizeType> m_bitCounts[64];
+    std::mutex m_growLock;
+    std::atomic<bool> m_ready{false};
+
+    void Count(std::uint64_t p_labels, SizeType p_delta) {
+        for (; p_labels != 0; p_labels &= p_labels - 1) m_bitCounts[__builtin_ctzll(p_labels)].fetch_add(p_delta, std::memory_order_relaxed);
+    }
+
+   public:
+    VectorLabels() {
+        m_data.SetName("VectorLabels");
+        for (auto& count : m_bitCounts) count = 0;
+    }
+
+    void Initialize(SizeType blockSize, SizeType capacity) {
+        m_data.Initialize(0, 1, blockSize, capacity);
+        for (auto& count : m_bitCounts) count = 0;
+        m_ready = true;
+    }
+
+    inline bool IsReady() const {
+        return m_ready;
+    }
+
+    inline SizeType R() const {
+        return m_data.R();
+    }
+
+    inline std::uint64_t Get(SizeType p_vid) const {
+        if (p_vid < 0 || p_vid >= m_data.R())
+            return 0;
+        return __atomic_load_n(m_data[p_vid], __ATOMIC_RELAXED);
+    }
+
+    // labels of [p_begin, p_begin + p_count), rows up to there are added without labels first
+    ErrorCode Set(SizeType p_begin, SizeType p_count, const std::uint64_t* p_labels) {
+        SizeType end = p_begin + p_count;
+        if (end > m_data.R()) {
+            std::lock_guard<std::mutex> lock(m_growLock);
+            if (end > m_data.R()) {
+                std::vector<std::uint64_t> empty((size_t)(end - m_data.R()), 0);
+                ErrorCode ret = m_data.AddBatch((SizeType)empty.size(), empty.data());
+                if (ret != ErrorCode::Success)
+                    return ret;
+            }
+        }
+        for (SizeType i = 0; i < p_count; i++) {
+            std::uint64_t old = __atomic_exchange_n(m_data[p_begin + i], p_labels[i], __ATOMIC_RELAXED);
+            Count(old & ~p_labels[i], -1);
+            Count(p_labels[i] & ~old, 1);
+        }
+        return ErrorCode::Success;
+    }
+
+    // share of p_total vectors p_filter keeps, an upper bound from the per-bit counts: the rarest
+    // bit of m_all and the sum over m_any. Deleted vectors keep their counts until overwritten
+    float Selectivity(const LabelFilter& p_filter, SizeType p_total) const {
+        if (p_filter.Empty() || p_total <= 0)
+            return 1.0f;
+        double share = 1.0;
+        for (std::uint64_t bits = p_filter.m_all; bits != 0; bits &= bits - 1)
+            share = (std::min)(share, (double)m_bitCounts[__builtin_ctzll(bits)].load(std::memory_order_relaxed) / p_total);
+        if (p_filter.m_any != 0) {
+            double any = 0;
+            for (std::uint64_t bits = p_filter.m_any; bits != 0; bits &= bits - 1) any += (double)m_bitCounts[__builtin_ctzll(bits)].load(std::memory_order_relaxed) / p_total;
+            share = (std::min)(share, any);
+        }
+        return (float)(std::min)(share, 1.0);
+    }
+
+    inline ErrorCode Save(const std::string& p_path) const {
+        return m_data.Save(p_path);
+    }
+
+    ErrorCode Load(const std::string& p_path, SizeType blockSize, SizeType capacity) {
+        COMMON::Dataset<std::uint64_t> loaded;
+        loaded.SetName(m_data.Name());
+        ErrorCode ret = loaded.Load(p_path, blockSize, capacity);
+        if (ret != ErrorCode::Success)
+            return ret;
+        Initialize(blockSize, capacity);
+        std::vector<std::uint64_t> labels(loaded.R());
+        for (SizeType i = 0; i < loaded.R(); i++) labels[i] = *loaded[i];
+        return Set(0, (SizeType)labels.size(), labels.data());
+    }
+};
+
+// the filter of the query a workspace is searching, tested on every posting entry ahead of its distance
+struct PostingFilter {
+    const VectorLabels* m_labels = nullptr;
+    LabelFilter m_filter;
+
+    inline bool Active() const {
+        return m_labels != nullptr;
+    }
+
+    inline bool Keep(SizeType p_vid) const {
+        return m_filter.Matches(m_labels->Get(p_vid));
+    }
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_VECTORLABELS_H_
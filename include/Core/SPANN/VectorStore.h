@@ -0,0 +1,257 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_VECTORSTORE_H_
+#define _SPTAG_SPANN_VECTORSTORE_H_
+
+#include "Core/SPANN/IKeyValueIO.h"
+#include <algorithm>
+#include <cstring>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Full vectors kept once and addressed by VID, for postings that only hold VID and PQ code. VIDs
+// are packed into groups of one page (one vector per group when it is larger), group g holding
+// [g * n, (g + 1) * n) under key g of its own KeyValueIO. New VIDs come in ascending order, so a
+// group fills in DRAM and is written once, when its last vector arrives or at Flush: an insert
+// costs its share of a page instead of a full vector in every replica posting. Buffered vectors
+// are visible to readers before they are written
+class VectorStore {
+   public:
+    VectorStore(std::shared_ptr<KeyValueIO> p_io, int p_vectorBytes, int p_maxOpenGroups = 1024)
+        : m_io(p_io), m_vectorBytes(p_vectorBytes), m_maxOpenGroups((size_t)(std::max)(p_maxOpenGroups, 1)) {
+        m_groupVectors = (std::max)(1, (int)(PageSize / p_vectorBytes));
+        m_groupBytes = (size_t)m_groupVectors * m_vectorBytes;
+    }
+
+    ~VectorStore() {
+        Flush();
+    }
+
+    // pages a group takes, the block limit of the KeyValueIO underneath
+    static int GroupPages(int p_vectorBytes) {
+        return (int)((p_vectorBytes + PageSize - 1) / PageSize);
+    }
+
+    inline int GroupVectors() const {
+        return m_groupVectors;
+    }
+
+    inline int VectorBytes() const {
+        return m_vectorBytes;
+    }
+
+    ErrorCode Put(SizeType p_vid, const void* p_vector) {
+        SizeType group = p_vid / m_groupVectors;
+        int slot = (int)(p_vid % m_groupVectors);
+        bool full = false;
+        SizeType evict = -1;
+        {
+            std::lock_guard<std::mutex> lock(m_openLock);
+            auto it = m_open.find(group);
+            if (it == m_open.end()) {
+                it = m_open.emplace(group, OpenGroup()).first;
+                it->second.data.assign(m_groupBytes, '\0');
+                it->second.filled.assign(m_groupVectors, false);
+            }
+            OpenGroup& open = it->second;
+            memcpy(&open.data[(size_t)slot * m_vectorBytes], p_vector, m_vectorBytes);
+            if (!open.filled[slot]) {
+                open.filled[slot] = true;
+                open.count++;
+            }
+            open.stamp = ++m_stamp;
+            full = open.count == m_groupVectors;
+            // the lowest group is the one inserts have left behind
+            if (!full && m_open.size() > m_maxOpenGroups)
+                evict = m_open.begin()->first;
+        }
+        if (full)
+            return FlushGroup(group);
+        if (evict >= 0)
+            return FlushGroup(evict);
+        return ErrorCode::Success;
+    }
+
+    // the vectors of [p_begin, p_begin + p_count), whole groups go straight to the device in one BulkPut
+    ErrorCode PutRange(SizeType p_begin, SizeType p_count, const std::function<const void*(SizeType)>& p_vector) {
+        SizeType end = p_begin + p_count;
+        SizeType firstGroup = (p_begin + m_groupVectors - 1) / m_groupVectors, lastGroup = end / m_groupVectors;
+        if (firstGroup >= lastGroup) {
+            for (SizeType vid = p_begin; vid < end; vid++) {
+                ErrorCode ret = Put(vid, p_vector(vid));
+                if (ret != ErrorCode::Success)
+                    return ret;
+            }
+            return ErrorCode::Success;
+        }
+        for (SizeType vid = p_begin; vid < firstGroup * m_groupVectors; vid++) {
+            ErrorCode ret = Put(vid, p_vector(vid));
+            if (ret != ErrorCode::Success)
+                return ret;
+        }
+        std::vector<SizeType> keys;
+        for (SizeType group = firstGroup; group < lastGroup; group++) keys.push_back(group);
+        std::vector<size_t> bytes(keys.size(), m_groupBytes);
+        ErrorCode ret = m_io->BulkPut(keys, bytes, [&](size_t i, char* p_dst) {
+            SizeType first = keys[i] * m_groupVectors;
+            for (int j = 0; j < m_groupVectors; j++) memcpy(p_dst + (size_t)j * m_vectorBytes, p_vector(first + j), m_vectorBytes);
+        });
+        if (ret != ErrorCode::Success)
+            return ret;
+        for (SizeType vid = lastGroup * m_groupVectors; vid < end; vid++) {
+            ret = Put(vid, p_vector(vid));
+            if (ret != ErrorCode::Success)
+                return ret;
+        }
+        return ErrorCode::Success;
+    }
+
+    ErrorCode Get(SizeType p_vid, void* p_vector) {
+        std::vector<SizeType> vids(1, p_vid);
+        std::vector<bool> found;
+        ErrorCode ret = MultiGet(vids, (char*)p_vector, found);
+        if (ret != ErrorCode::Success)
+            return ret;
+        return found[0] ? ErrorCode::Success : ErrorCode::VectorNotFound;
+    }
+
+    // the vectors of p_vids into consecutive rows of p_vectors, reading every group once. p_found
+    // tells which VIDs were ever stored, their rows are left alone otherwise
+    ErrorCode MultiGet(const std::vector<SizeType>& p_vids, char* p_vectors, std::vector<bool>& p_found) {
+        p_found.assign(p_vids.size(), false);
+        std::unordered_map<SizeType, size_t> groupIndex;
+        std::vector<SizeType> groups;
+        // groups past the bound were never written, asking the store for them would misalign the
+        // values. Unwritten groups below it come back empty
+        SizeType bound = m_io->KeyBound();
+        {
+            std::lock_guard<std::mutex> lock(m_openLock);
+            for (size_t i = 0; i < p_vids.size(); i++) {
+                if (p_vids[i] < 0)
+                    continue;
+                SizeType group = p_vids[i] / m_groupVectors;
+                int slot = (int)(p_vids[i] % m_groupVectors);
+                auto it = m_open.find(group);
+                if (it != m_open.end() && it->second.filled[slot]) {
+                    memcpy(p_vectors + i * m_vectorBytes, &it->second.data[(size_t)slot * m_vectorBytes], m_vectorBytes);
+                    p_found[i] = true;
+                } else if ((bound <= 0 || group < bound) && groupIndex.emplace(group, groups.size()).second) {
+                    groups.push_back(group);
+                }
+            }
+        }
+        if (groups.empty())
+            return ErrorCode::Success;
+
+        std::vector<std::string> values;
+        ErrorCode ret = m_io->MultiGet(groups, &values);
+        if (ret != ErrorCode::Success)
+            return ret;
+        for (size_t i = 0; i < p_vids.size(); i++) {
+            if (p_found[i] || p_vids[i] < 0)
+                continue;
+            auto it = groupIndex.find(p_vids[i] / m_groupVectors);
+            if (it == groupIndex.end() || it->second >= values.size())
+                continue;
+            const std::string& value = values[it->second];
+            size_t offset = (size_t)(p_vids[i] % m_groupVectors) * m_vectorBytes;
+            if (value.size() >= offset + m_vectorBytes) {
+                memcpy(p_vectors + i * m_vectorBytes, value.data() + offset, m_vectorBytes);
+                p_found[i] = true;
+            }
+        }
+        return ErrorCode::Success;
+    }
+
+    // write every buffered group, partial ones on top of what the device already holds
+    ErrorCode Flush() {
+        std::vector<SizeType> groups;
+        {
+            std::lock_guard<std::mutex> lock(m_openLock);
+            for (auto& open : m_open) groups.push_back(open.first);
+        }
+        ErrorCode ret = ErrorCode::Success;
+        for (SizeType group : groups) {
+            ErrorCode groupRet = FlushGroup(group);
+            if (groupRet != ErrorCode::Success)
+                ret = groupRet;
+        }
+        return ret;
+    }
+
+    size_t OpenGroups() {
+        std::lock_guard<std::mutex> lock(m_openLock);
+        return m_open.size();
+    }
+
+   private:
+    struct OpenGroup {
+        std::string data;
+        std::vector<bool> filled;
+        int count = 0;
+        std::uint64_t stamp = 0;
+    };
+
+    static constexpr size_t kFlushStripes = 64;
+
+    // the group stays readable in m_open until it is written, and only leaves when no vector
+    // arrived meanwhile. Flushes of one group are serialised so a read-modify-write sees the last one
+    ErrorCode FlushGroup(SizeType p_group) {
+        std::lock_guard<std::mutex> flushLock(m_flushLocks[p_group % kFlushStripes]);
+        std::string data;
+        std::vector<bool> filled;
+        std::uint64_t stamp;
+        int count;
+        {
+            std::lock_guard<std::mutex> lock(m_openLock);
+            auto it = m_open.find(p_group);
+            if (it == m_open.end())
+                return ErrorCode::Success;
+            data = it->second.data;
+            filled = it->second.filled;
+            count = it->second.count;
+            stamp = it->second.stamp;
+        }
+        if (count < m_groupVectors) {
+            std::string stored;
+            if (m_io->Get(p_group, &stored) == ErrorCode::Success) {
+                for (int j = 0; j < m_groupVectors; j++) {
+                    size_t offset = (size_t)j * m_vectorBytes;
+                    if (!filled[j] && stored.size() >= offset + m_vectorBytes)
+                        memcpy(&data[offset], stored.data() + offset, m_vectorBytes);
+                }
+            }
+        }
+        ErrorCode ret = m_io->Put(p_group, data);
+        if (ret != ErrorCode::Success) {
+            LOG(Helper::LogLevel::LL_Error, "VectorStore: failed to write group %d\n", p_group);
+            return ret;
+        }
+        std::lock_guard<std::mutex> lock(m_openLock);
+        auto it = m_open.find(p_group);
+        if (it != m_open.end() && it->second.stamp == stamp)
+            m_open.erase(it);
+        return ErrorCode::Success;
+    }
+
+    std::shared_ptr<KeyValueIO> m_io;
+    int m_vectorBytes;
+    int m_groupVectors;
+    size_t m_groupBytes;
+    size_t m_maxOpenGroups;
+
+    std::mutex m_openLock;
+    std::map<SizeType, OpenGroup> m_open;
+    std::uint64_t m_stamp = 0;
+    std::mutex m_flushLocks[kFlushStripes];
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_VECTORSTORE_H_
@@ -0,0 +1,227 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_SPANN_WRITEAHEADLOG_H_
+#define _SPTAG_SPANN_WRITEAHEADLOG_H_
+
+#include "Core/Common.h"
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <unistd.h>
+#include <vector>
+
+namespace SPTAG::SPANN {
+// Sequential log of inserts and deletes, appended before they are applied to the postings.
+// Each record is [uint32 payload bytes][uint32 checksum][uint64 LSN][uint8 type][SizeType first]
+// [SizeType count][payload]: an insert carries the count vectors assigned VIDs first..first+count-1,
+// normalized for Cosine, an InsertRaw the Cosine vectors as they were handed in, a delete carries no payload. Writers buffer their record under a short lock and then Commit:
+// the first committer becomes the leader and writes and syncs everything buffered so far, the
+// others wait for it, so concurrent writers share one fdatasync. A record whose checksum does
+// not match ends the log, which is how a torn tail is detected and cut off on Open.
+class WriteAheadLog {
+   public:
+    enum class RecordType : std::uint8_t { Insert = 1, Delete = 2, InsertRaw = 3 };
+
+    struct Record {
+        std::uint64_t m_lsn;
+        RecordType m_type;
+        SizeType m_first;
+        SizeType m_count;
+        const char* m_payload;
+        size_t m_bytes;
+    };
+
+    static constexpr size_t kHeaderSize = sizeof(std::uint32_t) * 2 + sizeof(std::uint64_t) + sizeof(std::uint8_t) + sizeof(SizeType) * 2;
+
+    WriteAheadLog() {}
+
+    ~WriteAheadLog() {
+        Close();
+    }
+
+    // p_reset starts an empty log, otherwise the valid prefix of an existing log is kept and appended to
+    bool Open(const std::string& p_path, bool p_reset) {
+        std::unique_lock<std::mutex> lock(m_lock);
+        m_path = p_path;
+        std::uint64_t validBytes = 0;
+        m_lastLSN = 0;
+        if (!p_reset)
+            Replay(p_path, [this](const Record& p_record) { m_lastLSN = p_record.m_lsn; }, &validBytes);
+        m_fd = open(p_path.c_str(), O_WRONLY | O_CREAT | (p_reset ? O_TRUNC : 0), 0644);
+        if (m_fd < 0) {
+            LOG(Helper::LogLevel::LL_Error, "WriteAheadLog: cannot open %s\n", p_path.c_str());
+            return false;
+        }
+        if (ftruncate(m_fd, (off_t)validBytes) != 0 || lseek(m_fd, (off_t)validBytes, SEEK_SET) < 0) {
+            LOG(Helper::LogLevel::LL_Error, "WriteAheadLog: cannot cut %s to %llu bytes\n", p_path.c_str(), (unsigned long long)validBytes);
+            close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+        m_durableLSN = m_lastLSN;
+        m_failed = false;
+        return true;
+    }
+
+    bool IsOpen() const {
+        return m_fd >= 0;
+    }
+
+    // buffer a record and return its LSN, 0 when the log is not open
+    std::uint64_t Append(RecordType p_type, SizeType p_first, SizeType p_count, const void* p_payload = nullptr, size_t p_bytes = 0) {
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_fd < 0)
+            return 0;
+        std::uint64_t lsn = ++m_lastLSN;
+        size_t offset = m_buffer.size();
+        m_buffer.resize(offset + kHeaderSize + p_bytes);
+        char* dst = m_buffer.data() + offset;
+        std::uint32_t bytes = (std::uint32_t)p_bytes;
+        std::uint8_t type = (std::uint8_t)p_type;
+        memcpy(dst, &bytes, sizeof(bytes));
+        char* body = dst + sizeof(std::uint32_t) * 2;
+        memcpy(body, &lsn, sizeof(lsn));
+        memcpy(body + sizeof(lsn), &type, sizeof(type));
+        memcpy(body + sizeof(lsn) + sizeof(type), &p_first, sizeof(SizeType));
+        memcpy(body + sizeof(lsn) + sizeof(type) + sizeof(SizeType), &p_count, sizeof(SizeType));
+        if (p_bytes > 0)
+            memcpy(dst + kHeaderSize, p_payload, p_bytes);
+        std::uint32_t checksum = Checksum(body, kHeaderSize - sizeof(std::uint32_t) * 2 + p_bytes);
+        memcpy(dst + sizeof(std::uint32_t), &checksum, sizeof(checksum));
+        return lsn;
+    }
+
+    // block until the record p_lsn is durable, false when the log failed or is closed
+    bool Commit(std::uint64_t p_lsn) {
+        std::unique_lock<std::mutex> lock(m_lock);
+        while (m_durableLSN < p_lsn) {
+            if (m_fd < 0 || m_failed)
+                return false;
+            if (m_flushing) {
+                m_flushed.wait(lock);
+                continue;
+            }
+            m_flushing = true;
+            std::vector<char> batch;
+            batch.swap(m_buffer);
+            std::uint64_t upTo = m_lastLSN;
+            lock.unlock();
+            bool ok = WriteAll(batch) && fdatasync(m_fd) == 0;
+            lock.lock();
+            m_flushing = false;
+            m_syncs++;
+            if (ok)
+                m_durableLSN = upTo;
+            else
+                m_failed = true;
+            m_flushed.notify_all();
+        }
+        return true;
+    }
+
+    std::uint64_t LastLSN() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_lastLSN;
+    }
+
+    // number of fdatasync calls, fewer than commits when writers were grouped
+    std::uint64_t SyncCount() {
+        std::lock_guard<std::mutex> lock(m_lock);
+        return m_syncs;
+    }
+
+    void Close() {
+        if (m_fd < 0)
+            return;
+        std::uint64_t lsn = LastLSN();
+        Commit(lsn);
+        std::lock_guard<std::mutex> lock(m_lock);
+        if (m_fd < 0)
+            return;
+        close(m_fd);
+        m_fd = -1;
+    }
+
+    // call p_apply for every intact record of the log at p_path in LSN order, p_validBytes
+    // gets the length of the intact prefix
+    static std::uint64_t Replay(const std::string& p_path, const std::function<void(const Record&)>& p_apply, std::uint64_t* p_validBytes = nullptr) {
+        if (p_validBytes != nullptr)
+            *p_validBytes = 0;
+        FILE* fp = fopen(p_path.c_str(), "rb");
+        if (fp == nullptr)
+            return 0;
+        std::uint64_t count = 0, offset = 0;
+        std::vector<char> record;
+        char header[kHeaderSize];
+        while (fread(header, kHeaderSize, 1, fp) == 1) {
+            std::uint32_t bytes, checksum;
+            memcpy(&bytes, header, sizeof(bytes));
+            memcpy(&checksum, header + sizeof(bytes), sizeof(checksum));
+            record.resize(kHeaderSize - sizeof(std::uint32_t) * 2 + bytes);
+            memcpy(record.data(), header + sizeof(std::uint32_t) * 2, kHeaderSize - sizeof(std::uint32_t) * 2);
+            char* payload = record.data() + kHeaderSize - sizeof(std::uint32_t) * 2;
+            if (bytes > 0 && fread(payload, bytes, 1, fp) != 1)
+                break;
+            if (Checksum(record.data(), record.size()) != checksum)
+                break;
+
+            Record entry;
+            std::uint8_t type;
+            memcpy(&entry.m_lsn, record.data(), sizeof(entry.m_lsn));
+            memcpy(&type, record.data() + sizeof(entry.m_lsn), sizeof(type));
+            memcpy(&entry.m_first, record.data() + sizeof(entry.m_lsn) + sizeof(type), sizeof(SizeType));
+            memcpy(&entry.m_count, record.data() + sizeof(entry.m_lsn) + sizeof(type) + sizeof(SizeType), sizeof(SizeType));
+            entry.m_type = (RecordType)type;
+            entry.m_payload = payload;
+            entry.m_bytes = bytes;
+            p_apply(entry);
+            count++;
+            offset += kHeaderSize + bytes;
+        }
+        fclose(fp);
+        if (p_validBytes != nullptr)
+            *p_validBytes = offset;
+        return count;
+    }
+
+   private:
+    // FNV-1a, enough to tell a torn or stale record from a complete one
+    static std::uint32_t Checksum(const char* p_data, size_t p_bytes) {
+        std::uint32_t hash = 2166136261u;
+        for (size_t i = 0; i < p_bytes; i++) hash = (hash ^ (std::uint8_t)p_data[i]) * 16777619u;
+        return hash;
+    }
+
+    bool WriteAll(const std::vector<char>& p_batch) {
+        size_t written = 0;
+        while (written < p_batch.size()) {
+            ssize_t ret = write(m_fd, p_batch.data() + written, p_batch.size() - written);
+            if (ret < 0) {
+                LOG(Helper::LogLevel::LL_Error, "WriteAheadLog: write to %s failed\n", m_path.c_str());
+                return false;
+            }
+            written += ret;
+        }
+        return true;
+    }
+
+    std::mutex m_lock;
+    std::condition_variable m_flushed;
+    std::string m_path;
+    int m_fd = -1;
+    std::vector<char> m_buffer;
+    std::uint64_t m_lastLSN = 0;
+    std::uint64_t m_durableLSN = 0;
+    std::uint64_t m_syncs = 0;
+    bool m_flushing = false;
+    bool m_failed = false;
+};
+}  // namespace SPTAG::SPANN
+
+#endif  // _SPTAG_SPANN_WRITEAHEADLOG_H_
@@ -6,6 +6,7 @@
 
 #include "SearchResult.h"
 
+#include <chrono>
 #include <cstring>
 
 namespace SPTAG {
@@ -38,6 +39,7 @@ class QueryResult {
         if (m_resultNum > 0) {
             std::copy(p_other.m_results.Data(), p_other.m_results.Data() + m_resultNum, m_results.Data());
         }
+        m_deadline = p_other.m_deadline;
     }
 
     QueryResult& operator=(const QueryResult& p_other) {
@@ -45,6 +47,7 @@ class QueryResult {
         if (m_resultNum > 0) {
             std::copy(p_other.m_results.Data(), p_other.m_results.Data() + m_resultNum, m_results.Data());
         }
+        m_deadline = p_other.m_deadline;
         return *this;
     }
 
@@ -71,6 +74,19 @@ class QueryResult {
         m_target = p_target;
     }
 
+    // a search past the deadline stops reading and returns what it has found so far
+    inline void SetDeadline(std::chrono::steady_clock::time_point p_deadline) {
+        m_deadline = p_deadline;
+    }
+
+    inline std::chrono::steady_clock::time_point GetDeadline() const {
+        return m_deadline;
+    }
+
+    inline bool HasDeadline() const {
+        return m_deadline != (std::chrono::steady_clock::time_point::max)();
+    }
+
     inline BasicResult* GetResult(int i) const {
         return i < m_resultNum ? m_results.Data() + i : nullptr;
     }
@@ -136,6 +152,8 @@ class QueryResult {
     bool m_withMeta;
 
     Array<BasicResult> m_results;
+
+    std::chrono::steady_clock::time_point m_deadline = (std::chrono::steady_clock::time_point::max)();
 };
 }  // namespace SPTAG
 
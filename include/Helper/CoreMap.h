@@ -0,0 +1,93 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_HELPER_COREMAP_H_
+#define _SPTAG_HELPER_COREMAP_H_
+
+#include "Core/Common.h"
+#include <pthread.h>
+#include <sched.h>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace SPTAG::Helper {
+// Which cores a role runs on. Lists are written like taskset, "0-3,8,10-11", and an SPDK reactor
+// mask is accepted in either of its forms, "[0-3]" or "0xF"
+class CoreMap {
+   public:
+    // false on a malformed list, an empty list is valid and leaves p_cores empty
+    static bool Parse(const std::string& p_list, std::vector<int>& p_cores) {
+        p_cores.clear();
+        std::string list = p_list;
+        if (list.size() >= 2 && list.front() == '[' && list.back() == ']')
+            list = list.substr(1, list.size() - 2);
+        if (list.size() > 2 && list[0] == '0' && (list[1] == 'x' || list[1] == 'X')) {
+            char* end = nullptr;
+            unsigned long long mask = strtoull(list.c_str() + 2, &end, 16);
+            if (*end != '\0')
+                return false;
+            for (int core = 0; core < 64; core++) {
+                if ((mask >> core) & 1)
+                    p_cores.push_back(core);
+            }
+            return true;
+        }
+        size_t pos = 0;
+        while (pos < list.size()) {
+            size_t comma = list.find(',', pos);
+            std::string item = list.substr(pos, comma == std::string::npos ? std::string::npos : comma - pos);
+            pos = comma == std::string::npos ? list.size() : comma + 1;
+            if (item.empty())
+                continue;
+            char* end = nullptr;
+            long first = strtol(item.c_str(), &end, 10), last = first;
+            if (end == item.c_str() || first < 0)
+                return false;
+            if (*end == '-') {
+                const char* second = end + 1;
+                last = strtol(second, &end, 10);
+                if (end == second || last < first)
+                    return false;
+            }
+            if (*end != '\0')
+                return false;
+            for (long core = first; core <= last; core++) p_cores.push_back((int)core);
+        }
+        return true;
+    }
+
+    // bind the calling thread to p_core and remember p_slot, its rank among the threads of its role
+    static bool Pin(int p_core, int p_slot = -1) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(p_core, &cpuset);
+        int rc = pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuset);
+        if (rc != 0) {
+            LOG(Helper::LogLevel::LL_Error, "CoreMap: cannot pin thread to core %d: %d\n", p_core, rc);
+            return false;
+        }
+        Slot() = p_slot;
+        return true;
+    }
+
+    // slot given to Pin by the calling thread, -1 when it is not a pinned worker
+    static int& Slot() {
+        static thread_local int slot = -1;
+        return slot;
+    }
+
+    // true when the two lists share a core
+    static bool Overlap(const std::vector<int>& p_a, const std::vector<int>& p_b) {
+        for (int a : p_a) {
+            for (int b : p_b) {
+                if (a == b)
+                    return true;
+            }
+        }
+        return false;
+    }
+};
+}  // namespace SPTAG::Helper
+
+#endif  // _SPTAG_HELPER_COREMAP_H_
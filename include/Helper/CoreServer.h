@@ -0,0 +1,175 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_HELPER_CORESERVER_H_
+#define _SPTAG_HELPER_CORESERVER_H_
+
+#include "Core/Common.h"
+#include "CoreMap.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <vector>
+
+namespace SPTAG::Helper {
+// Bounded lock-free ring, any number of producers and one consumer. Every slot carries a sequence
+// number telling whose turn it is, so producers only race on the tail and the consumer never
+// waits on a producer that has claimed a slot but not filled it yet
+template <typename T>
+class MPSCRing {
+   public:
+    explicit MPSCRing(size_t p_capacity) {
+        size_t cap = 2;
+        while (cap < p_capacity) cap <<= 1;
+        m_slots.reset(new Slot[cap]);
+        m_mask = cap - 1;
+        for (size_t i = 0; i < cap; i++) m_slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+
+    inline bool TryPush(const T& p_item) {
+        size_t t = m_tail.load(std::memory_order_relaxed);
+        while (true) {
+            Slot& slot = m_slots[t & m_mask];
+            size_t seq = slot.seq.load(std::memory_order_acquire);
+            if (seq == t) {
+                if (m_tail.compare_exchange_weak(t, t + 1, std::memory_order_relaxed)) {
+                    slot.item = p_item;
+                    slot.seq.store(t + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (seq < t) {
+                return false;
+            } else {
+                t = m_tail.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    inline bool TryPop(T& p_item) {
+        Slot& slot = m_slots[m_head & m_mask];
+        if (slot.seq.load(std::memory_order_acquire) != m_head + 1)
+            return false;
+        p_item = slot.item;
+        slot.seq.store(m_head + m_mask + 1, std::memory_order_release);
+        m_head++;
+        return true;
+    }
+
+   private:
+    struct alignas(64) Slot {
+        std::atomic<size_t> seq;
+        T item;
+    };
+
+    std::unique_ptr<Slot[]> m_slots;
+    size_t m_mask;
+    alignas(64) std::atomic<size_t> m_tail{0};
+    alignas(64) size_t m_head = 0;
+};
+
+// Thread-per-core runtime: one worker pinned to each core of the list, each draining its own
+// MPSCRing. Whatever a worker sets up in p_init (thread local workspace, SPDK submission ring, DMA
+// buffers) stays on its core and is only touched by it. Idle workers poll their ring and yield,
+// the core is theirs anyway
+template <typename Request>
+class CoreServer {
+   public:
+    typedef std::function<void(int, Request&)> Handler;
+
+    CoreServer() = default;
+    CoreServer(const CoreServer&) = delete;
+    CoreServer& operator=(const CoreServer&) = delete;
+
+    ~CoreServer() {
+        Stop();
+    }
+
+    // p_init and p_exit run on every worker, pinned already, before its first and after its last request
+    void Start(const std::vector<int>& p_cores, size_t p_ringSize, Handler p_handler, std::function<void(int)> p_init = nullptr, std::function<void(int)> p_exit = nullptr) {
+        m_stop = false;
+        m_handler = p_handler;
+        m_ready = 0;
+        for (size_t i = 0; i < p_cores.size(); i++) m_workers.emplace_back(new Worker(p_ringSize));
+        for (int i = 0; i < (int)p_cores.size(); i++) {
+            m_workers[i]->thread = std::thread([this, i, core = p_cores[i], p_init, p_exit] {
+                CoreMap::Pin(core, i);
+                if (p_init != nullptr)
+                    p_init(i);
+                m_ready++;
+                Run(i);
+                if (p_exit != nullptr)
+                    p_exit(i);
+            });
+        }
+        while (m_ready.load() < (int)m_workers.size()) std::this_thread::yield();
+    }
+
+    inline int Workers() const {
+        return (int)m_workers.size();
+    }
+
+    // hand p_request to p_worker, spinning while its ring is full
+    void Submit(int p_worker, const Request& p_request) {
+        Worker& worker = *m_workers[p_worker];
+        while (!worker.ring.TryPush(p_request)) std::this_thread::yield();
+    }
+
+    // to the workers in turn
+    void Submit(const Request& p_request) {
+        Submit((int)(m_next.fetch_add(1, std::memory_order_relaxed) % m_workers.size()), p_request);
+    }
+
+    // requests already in the rings are served before the workers exit
+    void Stop() {
+        m_stop = true;
+        for (auto& worker : m_workers) {
+            if (worker->thread.joinable())
+                worker->thread.join();
+        }
+        m_workers.clear();
+    }
+
+   private:
+    struct Worker {
+        explicit Worker(size_t p_ringSize)
+            : ring(p_ringSize) {}
+
+        MPSCRing<Request> ring;
+        std::thread thread;
+    };
+
+    void Run(int p_self) {
+        MPSCRing<Request>& ring = m_workers[p_self]->ring;
+        Request request;
+        int idle = 0;
+        while (true) {
+            if (ring.TryPop(request)) {
+                m_handler(p_self, request);
+                idle = 0;
+                continue;
+            }
+            if (m_stop.load(std::memory_order_acquire)) {
+                if (!ring.TryPop(request))
+                    return;
+                m_handler(p_self, request);
+                continue;
+            }
+            if (++idle >= kSpinRounds) {
+                std::this_thread::yield();
+                idle = 0;
+            }
+        }
+    }
+
+    static constexpr int kSpinRounds = 256;
+
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    Handler m_handler;
+    std::atomic<bool> m_stop{false};
+    std::atomic<int> m_ready{0};
+    std::atomic<std::uint64_t> m_next{0};
+};
+}  // namespace SPTAG::Helper
+
+#endif  // _SPTAG_HELPER_CORESERVER_H_
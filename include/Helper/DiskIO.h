@@ -35,7 +35,10 @@ struct AsyncReadRequest {
     // Carry exension metadata needed by some DiskIO implementations
     void* m_extension;
 
-    AsyncReadRequest() : m_offset(0), m_readSize(0), m_buffer(nullptr), m_status(0), m_payload(nullptr), m_success(false), m_extension(nullptr) {}
+    // buffer registered with the DiskIO that m_buffer lies in, -1 for none
+    int m_bufferIndex;
+
+    AsyncReadRequest() : m_offset(0), m_readSize(0), m_buffer(nullptr), m_status(0), m_payload(nullptr), m_success(false), m_extension(nullptr), m_bufferIndex(-1) {}
 };
 
 class DiskIO {
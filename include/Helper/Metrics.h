@@ -0,0 +1,210 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_HELPER_METRICS_H_
+#define _SPTAG_HELPER_METRICS_H_
+
+#include "Core/Common.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace SPTAG::Helper {
+// Metrics in the Prometheus text exposition format. All series of one metric have to be written
+// one after the other, its HELP and TYPE lines go in front of the first
+class MetricsWriter {
+   public:
+    void Counter(const char* p_name, const char* p_help, double p_value, const std::string& p_labels = std::string()) {
+        Declare(p_name, p_help, "counter");
+        Sample(p_name, "", p_labels, p_value);
+    }
+
+    void Gauge(const char* p_name, const char* p_help, double p_value, const std::string& p_labels = std::string()) {
+        Declare(p_name, p_help, "gauge");
+        Sample(p_name, "", p_labels, p_value);
+    }
+
+    // p_cumulative[i] observations are at most p_bounds[i], the +Inf bucket is p_count
+    void Histogram(const char* p_name, const char* p_help, const std::vector<double>& p_bounds, const std::vector<std::uint64_t>& p_cumulative, double p_sum, std::uint64_t p_count, const std::string& p_labels = std::string()) {
+        Declare(p_name, p_help, "histogram");
+        std::string prefix = p_labels.empty() ? std::string() : p_labels + ",";
+        char bound[64];
+        for (size_t i = 0; i < p_bounds.size(); i++) {
+            snprintf(bound, sizeof(bound), "le=\"%.9g\"", p_bounds[i]);
+            Sample(p_name, "_bucket", prefix + bound, (double)p_cumulative[i]);
+        }
+        Sample(p_name, "_bucket", prefix + "le=\"+Inf\"", (double)p_count);
+        Sample(p_name, "_sum", p_labels, p_sum);
+        Sample(p_name, "_count", p_labels, (double)p_count);
+    }
+
+    inline const std::string& Text() const {
+        return m_text;
+    }
+
+    // "name=\"value\"" with the value escaped
+    static std::string Label(const char* p_name, const std::string& p_value) {
+        std::string label = std::string(p_name) + "=\"";
+        for (char c : p_value) {
+            if (c == '\\' || c == '"')
+                label += '\\';
+            if (c == '\n') {
+                label += "\\n";
+                continue;
+            }
+            label += c;
+        }
+        return label + "\"";
+    }
+
+   private:
+    void Declare(const char* p_name, const char* p_help, const char* p_type) {
+        if (!m_declared.insert(p_name).second)
+            return;
+        m_text.append("# HELP ").append(p_name).append(" ").append(p_help).append("\n");
+        m_text.append("# TYPE ").append(p_name).append(" ").append(p_type).append("\n");
+    }
+
+    void Sample(const char* p_name, const char* p_suffix, const std::string& p_labels, double p_value) {
+        char value[64];
+        snprintf(value, sizeof(value), "%.17g", p_value);
+        m_text.append(p_name).append(p_suffix);
+        if (!p_labels.empty())
+            m_text.append("{").append(p_labels).append("}");
+        m_text.append(" ").append(value).append("\n");
+    }
+
+    std::string m_text;
+    std::set<std::string> m_declared;
+};
+
+// Minimal HTTP endpoint for scrapers: one thread accepts a connection at a time and answers
+// GET /metrics with whatever p_render returns at that moment. Meant for a loopback or cluster
+// internal address, it does no authentication
+class MetricsServer {
+   public:
+    typedef std::function<std::string()> Render;
+
+    MetricsServer() = default;
+
+    ~MetricsServer() {
+        Stop();
+    }
+
+    MetricsServer(const MetricsServer&) = delete;
+    MetricsServer& operator=(const MetricsServer&) = delete;
+
+    // p_port 0 takes a free port, see Port()
+    bool Start(const std::string& p_address, int p_port, Render p_render) {
+        Stop();
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons((uint16_t)p_port);
+        if (inet_pton(AF_INET, p_address.c_str(), &addr.sin_addr) != 1) {
+            LOG(LogLevel::LL_Error, "MetricsServer: bad address %s\n", p_address.c_str());
+            return false;
+        }
+        m_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (m_fd < 0) {
+            LOG(LogLevel::LL_Error, "MetricsServer: socket failed: %s\n", strerror(errno));
+            return false;
+        }
+        int reuse = 1;
+        setsockopt(m_fd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+        if (bind(m_fd, (sockaddr*)&addr, sizeof(addr)) != 0 || listen(m_fd, 16) != 0) {
+            LOG(LogLevel::LL_Error, "MetricsServer: cannot listen on %s:%d: %s\n", p_address.c_str(), p_port, strerror(errno));
+            close(m_fd);
+            m_fd = -1;
+            return false;
+        }
+        socklen_t len = sizeof(addr);
+        getsockname(m_fd, (sockaddr*)&addr, &len);
+        m_port = ntohs(addr.sin_port);
+        m_render = std::move(p_render);
+        m_stop = false;
+        m_thread = std::thread([this] { Serve(); });
+        LOG(LogLevel::LL_Info, "MetricsServer: serving http://%s:%d/metrics\n", p_address.c_str(), m_port);
+        return true;
+    }
+
+    void Stop() {
+        if (m_fd < 0)
+            return;
+        m_stop = true;
+        if (m_thread.joinable())
+            m_thread.join();
+        close(m_fd);
+        m_fd = -1;
+    }
+
+    inline int Port() const {
+        return m_port;
+    }
+
+   private:
+    void Serve() {
+        while (!m_stop.load()) {
+            pollfd pfd = {m_fd, POLLIN, 0};
+            if (poll(&pfd, 1, 100) <= 0)
+                continue;
+            int client = accept4(m_fd, nullptr, nullptr, SOCK_CLOEXEC);
+            if (client < 0)
+                continue;
+            Answer(client);
+            close(client);
+        }
+    }
+
+    void Answer(int p_client) {
+        timeval timeout = {1, 0};
+        setsockopt(p_client, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        setsockopt(p_client, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+        std::string request;
+        char buffer[1024];
+        while (request.find("\r\n\r\n") == std::string::npos && request.size() < 8192) {
+            ssize_t got = recv(p_client, buffer, sizeof(buffer), 0);
+            if (got <= 0)
+                break;
+            request.append(buffer, (size_t)got);
+        }
+        std::string status = "200 OK", body;
+        if (request.compare(0, 13, "GET /metrics ") == 0 || request.compare(0, 14, "GET /metrics?") == 0 || request.compare(0, 6, "GET / ") == 0) {
+            body = m_render();
+        } else {
+            status = "404 Not Found";
+            body = "GET /metrics\n";
+        }
+        std::string response = "HTTP/1.1 " + status + "\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        size_t sent = 0;
+        while (sent < response.size()) {
+            ssize_t n = send(p_client, response.data() + sent, response.size() - sent, MSG_NOSIGNAL);
+            if (n <= 0)
+                break;
+            sent += (size_t)n;
+        }
+    }
+
+    int m_fd = -1;
+    int m_port = 0;
+    Render m_render;
+    std::atomic<bool> m_stop{false};
+    std::thread m_thread;
+};
+}  // namespace SPTAG::Helper
+
+#endif  // _SPTAG_HELPER_METRICS_H_
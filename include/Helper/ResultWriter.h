@@ -8,10 +8,13 @@
 #include <condition_variable>
 #include <cstddef>
 #include <cstdint>
+#include <cstdlib>
 #include <cstring>
 #include <fcntl.h>
+#include <functional>
 #include <memory>
 #include <mutex>
+#include <queue>
 #include <stdexcept>
 #include <string>
 #include <thread>
@@ -25,8 +28,15 @@ enum class ResultRecordType : std::uint8_t {
     Read = 1    // seqNum (u64) + k * resultId (u64)
 };
 
+// Records of every thread go to a buffer of its own, so writers never contend with each other.
+// Full buffers become aligned blocks that one flusher appends to a spill file next to the output
+// with O_DIRECT. Close merges the blocks by sequence number into the output, which keeps the plain
+// record stream ResultReader reads. A thread is expected to write its records in increasing
+// sequence order, as it gets them from TracePlayer; otherwise the output is still complete but
+// ordered per thread only
 class ResultWriter {
    public:
+    // p_numSlots records fit in the buffer of one thread
     ResultWriter(const std::string& p_filepath, std::size_t p_k, std::size_t p_numSlots = 4096);
     ~ResultWriter();
 
@@ -36,7 +46,7 @@ class ResultWriter {
     ResultWriter(ResultWriter&&) = delete;
     ResultWriter& operator=(ResultWriter&&) = delete;
 
-    // Lockless write methods - thread-safe, non-blocking (spins if buffer full)
+    // Thread-safe, a thread only waits when the flusher is kBuffersPerShard blocks behind it
     // p_seqNum: the sequence number of the trace record (for a insert)
     // p_internalId: the returned internal id by vector database
     void WriteInsertRecord(std::uint64_t p_seqNum, std::uint64_t p_internalId);
@@ -44,10 +54,10 @@ class ResultWriter {
     // p_resultIds: the returned internl ids of query result (sorted by distance incr)
     void WriteSearchRecord(std::uint64_t p_seqNum, const std::uint64_t* p_resultIds);
 
-    // Flush all pending writes to disk
+    // Flush all pending writes to the spill file on disk
     void Flush();
 
-    // Close the writer (flushes first)
+    // Close the writer (flushes and merges the spill file into the output)
     void Close();
 
     // Accessors
@@ -55,31 +65,46 @@ class ResultWriter {
     std::size_t GetNumSlots() const;
     std::size_t GetWriteRecordSize() const;
     std::size_t GetReadRecordSize() const;
+    std::size_t GetShards();
 
    private:
-    // Slot states
-    static constexpr std::uint32_t SLOT_FREE = 0;
-    static constexpr std::uint32_t SLOT_CLAIMED = 1;
-    static constexpr std::uint32_t SLOT_READY = 2;
+    static constexpr std::size_t kAlign = 4096;
+    static constexpr std::size_t kBlockHeader = 64;
+    static constexpr std::size_t kBuffersPerShard = 4;
+    static constexpr std::size_t kCachedShards = 8;
+
+    // Head of every block in the spill file, the records follow at kBlockHeader
+    struct BlockHeader {
+        std::uint32_t m_shard;
+        std::uint32_t m_records;
+        std::uint64_t m_bytes;
+    };
 
-    struct alignas(64) Slot {  // Cache-line aligned to prevent false sharing
-        std::atomic<std::uint32_t> m_status{SLOT_FREE};
-        ResultRecordType m_type;
-        std::uint8_t m_padding[3];
-        // Data follows in m_slotData buffer
+    // Buffer of one writing thread, its lock is only contended by Flush
+    struct Shard {
+        std::mutex m_lock;
+        std::uint32_t m_id = 0;
+        char* m_buffer = nullptr;
+        std::size_t m_used = kBlockHeader;
+        std::uint32_t m_records = 0;
     };
 
+    Shard& LocalShard();
+    void AppendRecord(const char* p_record, std::size_t p_size);
+    void HandOff(Shard& p_shard);
+    char* TakeBuffer();
     void StartFlusher();
     void StopFlusher();
     void FlusherLoop();
-    std::size_t ClaimSlot();
-    char* GetSlotData(std::size_t p_slotIdx);
-    void MarkSlotReady(std::size_t p_slotIdx, ResultRecordType p_type);
-    void WriteSlotToFile(std::size_t p_slotIdx);
+    void MergeSpill();
+    std::size_t RecordSize(char p_type) const;
 
-    // File
+    // Files
     int m_fd;
+    int m_spillFd;
+    std::string m_spillPath;
     bool m_closed;
+    std::uint64_t m_id;
 
     // Parameters
     std::size_t m_k;
@@ -87,26 +112,25 @@ class ResultWriter {
     std::size_t m_writeRecordSize;  // 1 + 2*8 bytes (type + seqNum + internalId)
     std::size_t m_readRecordSize;   // 1 + (1+k)*8 bytes (type + seqNum + k resultIds)
     std::size_t m_maxRecordSize;
-    std::size_t m_slotDataSize;
-
-    // Slot management
-    std::unique_ptr<Slot[]> m_slots;
-    std::unique_ptr<char[]> m_slotData;  // m_numSlots * m_slotDataSize
-
-    // Position tracking
-    std::atomic<std::size_t> m_claimPos{0};  // Next slot index to claim (mod m_numSlots)
-    std::atomic<std::size_t> m_flushPos{0};  // Next slot index to flush (mod m_numSlots)
+    std::size_t m_blockBytes;
+
+    // Shards and their block buffers
+    std::mutex m_shardsLock;
+    std::vector<std::unique_ptr<Shard>> m_shards;
+    std::vector<char*> m_allBuffers;
+    std::vector<char*> m_freeBuffers;
+
+    // Blocks waiting for the flusher and, per shard, where its flushed blocks went in the spill file
+    std::mutex m_queueLock;
+    std::condition_variable m_queueCv;
+    std::vector<char*> m_fullBlocks;
+    std::size_t m_writing = 0;
+    std::size_t m_spillBlocks = 0;
+    std::vector<std::vector<std::size_t>> m_shardBlocks;
 
     // Flusher thread
     std::thread m_flusherThread;
-    std::atomic<bool> m_flusherRunning{false};
-    std::atomic<bool> m_flushRequested{false};
-
-    // For synchronous flush
-    std::mutex m_flushMutex;
-    std::condition_variable m_flushCv;
-    std::atomic<std::size_t> m_totalClaimed{0};
-    std::atomic<std::size_t> m_totalFlushed{0};
+    bool m_flusherRunning = false;
 };
 
 // =============================================================================
@@ -115,13 +139,16 @@ class ResultWriter {
 
 inline ResultWriter::ResultWriter(const std::string& p_filepath, std::size_t p_k, std::size_t p_numSlots)
     : m_closed(false), m_k(p_k), m_numSlots(p_numSlots) {
+    static std::atomic<std::uint64_t> s_writers{0};
+    m_id = ++s_writers;
+
     // Calculate record sizes
     // Write record: type (1 byte) + seqNum (8 bytes) + internalId (8 bytes) = 17 bytes
     m_writeRecordSize = 1 + 2 * sizeof(std::uint64_t);
     // Read record: type (1 byte) + seqNum (8 bytes) + k * resultId (k * 8 bytes)
     m_readRecordSize = 1 + (1 + m_k) * sizeof(std::uint64_t);
     m_maxRecordSize = (m_writeRecordSize > m_readRecordSize) ? m_writeRecordSize : m_readRecordSize;
-    m_slotDataSize = m_maxRecordSize;
+    m_blockBytes = (kBlockHeader + (m_numSlots > 0 ? m_numSlots : 1) * m_maxRecordSize + kAlign - 1) / kAlign * kAlign;
 
     // Open file
     m_fd = open(p_filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
@@ -136,13 +163,15 @@ inline ResultWriter::ResultWriter(const std::string& p_filepath, std::size_t p_k
         throw std::runtime_error("ResultWriter: Failed to write header");
     }
 
-    // Allocate slots
-    m_slots = std::make_unique<Slot[]>(m_numSlots);
-    m_slotData = std::make_unique<char[]>(m_numSlots * m_slotDataSize);
-
-    // Initialize slots
-    for (std::size_t i = 0; i < m_numSlots; ++i) {
-        m_slots[i].m_status.store(SLOT_FREE, std::memory_order_relaxed);
+    // Spill file, O_DIRECT unless the file system refuses it
+    m_spillPath = p_filepath + ".blocks";
+    m_spillFd = open(m_spillPath.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_DIRECT, 0644);
+    if (m_spillFd < 0) {
+        m_spillFd = open(m_spillPath.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    }
+    if (m_spillFd < 0) {
+        close(m_fd);
+        throw std::runtime_error("ResultWriter: Failed to open spill file: " + m_spillPath);
     }
 
     // Start flusher thread
@@ -153,125 +182,270 @@ inline ResultWriter::~ResultWriter() {
     if (!m_closed) {
         Close();
     }
+    for (char* buffer : m_allBuffers) {
+        std::free(buffer);
+    }
 }
 
 inline void ResultWriter::StartFlusher() {
-    m_flusherRunning.store(true, std::memory_order_release);
+    m_flusherRunning = true;
     m_flusherThread = std::thread(&ResultWriter::FlusherLoop, this);
 }
 
 inline void ResultWriter::StopFlusher() {
-    m_flusherRunning.store(false, std::memory_order_release);
-    m_flushRequested.store(true, std::memory_order_release);
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+        m_flusherRunning = false;
+    }
+    m_queueCv.notify_all();
     if (m_flusherThread.joinable()) {
         m_flusherThread.join();
     }
 }
 
+// Appends full blocks to the spill file in the order they were handed off, one aligned write each
 inline void ResultWriter::FlusherLoop() {
-    while (m_flusherRunning.load(std::memory_order_acquire) ||
-           m_totalFlushed.load(std::memory_order_acquire) < m_totalClaimed.load(std::memory_order_acquire)) {
-        std::size_t flushIdx = m_flushPos.load(std::memory_order_acquire);
-        std::size_t slotIdx = flushIdx % m_numSlots;
-
-        // Check if slot is ready to flush
-        if (m_slots[slotIdx].m_status.load(std::memory_order_acquire) == SLOT_READY) {
-            // Write to file
-            WriteSlotToFile(slotIdx);
-
-            // Mark slot as free
-            m_slots[slotIdx].m_status.store(SLOT_FREE, std::memory_order_release);
-
-            // Advance flush position
-            m_flushPos.fetch_add(1, std::memory_order_release);
-            m_totalFlushed.fetch_add(1, std::memory_order_release);
-
-            // Notify waiters
-            m_flushCv.notify_all();
-        } else {
-            // No ready slot, yield
-            std::this_thread::yield();
+    std::unique_lock<std::mutex> lock(m_queueLock);
+    while (true) {
+        m_queueCv.wait(lock, [this]() { return !m_fullBlocks.empty() || !m_flusherRunning; });
+        if (m_fullBlocks.empty()) {
+            return;
+        }
+        std::vector<char*> blocks;
+        blocks.swap(m_fullBlocks);
+        m_writing = blocks.size();
+        std::size_t first = m_spillBlocks;
+        m_spillBlocks += blocks.size();
+        lock.unlock();
+
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            off_t offset = static_cast<off_t>((first + i) * m_blockBytes);
+            ssize_t written = pwrite(m_spillFd, blocks[i], m_blockBytes, offset);
+            if (written != static_cast<ssize_t>(m_blockBytes) && (fcntl(m_spillFd, F_GETFL) & O_DIRECT) != 0) {
+                // some file systems accept O_DIRECT at open and refuse the write, go through the page cache
+                fcntl(m_spillFd, F_SETFL, fcntl(m_spillFd, F_GETFL) & ~O_DIRECT);
+                written = pwrite(m_spillFd, blocks[i], m_blockBytes, offset);
+            }
+            if (written != static_cast<ssize_t>(m_blockBytes)) {
+                // In production, handle error properly
+                // For now, a block that failed to land is dropped from the merge
+                reinterpret_cast<BlockHeader*>(blocks[i])->m_records = 0;
+            }
         }
+
+        lock.lock();
+        for (std::size_t i = 0; i < blocks.size(); ++i) {
+            const BlockHeader* head = reinterpret_cast<const BlockHeader*>(blocks[i]);
+            if (head->m_records > 0) {
+                m_shardBlocks[head->m_shard].push_back(first + i);
+            }
+            m_freeBuffers.push_back(blocks[i]);
+        }
+        m_writing = 0;
+        m_queueCv.notify_all();
     }
 }
 
-inline std::size_t ResultWriter::ClaimSlot() {
-    std::size_t claimIdx = m_claimPos.fetch_add(1, std::memory_order_acq_rel);
-    std::size_t slotIdx = claimIdx % m_numSlots;
-
-    // Spin-wait until slot is free
-    std::uint32_t expected = SLOT_FREE;
-    while (!m_slots[slotIdx].m_status.compare_exchange_weak(
-        expected, SLOT_CLAIMED,
-        std::memory_order_acq_rel,
-        std::memory_order_acquire)) {
-        expected = SLOT_FREE;
-        std::this_thread::yield();
+inline char* ResultWriter::TakeBuffer() {
+    std::unique_lock<std::mutex> lock(m_queueLock);
+    if (m_freeBuffers.empty() && m_allBuffers.size() < kBuffersPerShard * (m_shardBlocks.size() + 1)) {
+        char* buffer = static_cast<char*>(std::aligned_alloc(kAlign, m_blockBytes));
+        if (buffer == nullptr) {
+            throw std::runtime_error("ResultWriter: Failed to allocate block buffer");
+        }
+        m_allBuffers.push_back(buffer);
+        return buffer;
     }
-
-    m_totalClaimed.fetch_add(1, std::memory_order_release);
-    return slotIdx;
+    m_queueCv.wait(lock, [this]() { return !m_freeBuffers.empty(); });
+    char* buffer = m_freeBuffers.back();
+    m_freeBuffers.pop_back();
+    return buffer;
 }
 
-inline char* ResultWriter::GetSlotData(std::size_t p_slotIdx) {
-    return m_slotData.get() + p_slotIdx * m_slotDataSize;
+inline ResultWriter::Shard& ResultWriter::LocalShard() {
+    // writer id to shard for the writers this thread used last, ids are never reused so a stale
+    // entry can not match
+    static thread_local std::vector<std::pair<std::uint64_t, Shard*>> cache;
+    for (auto& entry : cache) {
+        if (entry.first == m_id) {
+            return *entry.second;
+        }
+    }
+    Shard* shard;
+    {
+        std::lock_guard<std::mutex> lock(m_shardsLock);
+        m_shards.emplace_back(new Shard());
+        shard = m_shards.back().get();
+        shard->m_id = static_cast<std::uint32_t>(m_shards.size() - 1);
+        std::lock_guard<std::mutex> queueLock(m_queueLock);
+        m_shardBlocks.emplace_back();
+    }
+    if (cache.size() >= kCachedShards) {
+        cache.erase(cache.begin());
+    }
+    cache.emplace_back(m_id, shard);
+    return *shard;
 }
 
-inline void ResultWriter::MarkSlotReady(std::size_t p_slotIdx, ResultRecordType p_type) {
-    m_slots[p_slotIdx].m_type = p_type;
-    m_slots[p_slotIdx].m_status.store(SLOT_READY, std::memory_order_release);
+// queues the filled part of p_shard's buffer as a block, caller holds the shard lock
+inline void ResultWriter::HandOff(Shard& p_shard) {
+    if (p_shard.m_records == 0) {
+        return;
+    }
+    BlockHeader* head = reinterpret_cast<BlockHeader*>(p_shard.m_buffer);
+    head->m_shard = p_shard.m_id;
+    head->m_records = p_shard.m_records;
+    head->m_bytes = p_shard.m_used - kBlockHeader;
+    {
+        std::lock_guard<std::mutex> lock(m_queueLock);
+        m_fullBlocks.push_back(p_shard.m_buffer);
+    }
+    m_queueCv.notify_all();
+    p_shard.m_buffer = nullptr;
+    p_shard.m_used = kBlockHeader;
+    p_shard.m_records = 0;
 }
 
-inline void ResultWriter::WriteSlotToFile(std::size_t p_slotIdx) {
-    char* data = GetSlotData(p_slotIdx);
-    ResultRecordType type = m_slots[p_slotIdx].m_type;
-
-    std::size_t recordSize = (type == ResultRecordType::Write) ? m_writeRecordSize : m_readRecordSize;
-
-    ssize_t written = write(m_fd, data, recordSize);
-    if (written != static_cast<ssize_t>(recordSize)) {
-        // In production, handle error properly
-        // For now, we'll ignore partial writes
+inline void ResultWriter::AppendRecord(const char* p_record, std::size_t p_size) {
+    Shard& shard = LocalShard();
+    std::lock_guard<std::mutex> lock(shard.m_lock);
+    if (shard.m_used + p_size > m_blockBytes) {
+        HandOff(shard);
     }
+    if (shard.m_buffer == nullptr) {
+        shard.m_buffer = TakeBuffer();
+    }
+    std::memcpy(shard.m_buffer + shard.m_used, p_record, p_size);
+    shard.m_used += p_size;
+    ++shard.m_records;
 }
 
 inline void ResultWriter::WriteInsertRecord(std::uint64_t p_seqNum, std::uint64_t p_internalId) {
-    std::size_t slotIdx = ClaimSlot();
-    char* data = GetSlotData(slotIdx);
+    char data[1 + 2 * sizeof(std::uint64_t)];
 
     // Write record: type + seqNum + internalId
     data[0] = static_cast<char>(ResultRecordType::Write);
     std::memcpy(data + 1, &p_seqNum, sizeof(p_seqNum));
     std::memcpy(data + 1 + sizeof(p_seqNum), &p_internalId, sizeof(p_internalId));
 
-    MarkSlotReady(slotIdx, ResultRecordType::Write);
+    AppendRecord(data, m_writeRecordSize);
 }
 
 inline void ResultWriter::WriteSearchRecord(std::uint64_t p_seqNum, const std::uint64_t* p_resultIds) {
-    std::size_t slotIdx = ClaimSlot();
-    char* data = GetSlotData(slotIdx);
+    Shard& shard = LocalShard();
+    std::lock_guard<std::mutex> lock(shard.m_lock);
+    if (shard.m_used + m_readRecordSize > m_blockBytes) {
+        HandOff(shard);
+    }
+    if (shard.m_buffer == nullptr) {
+        shard.m_buffer = TakeBuffer();
+    }
 
-    // Read record: type + seqNum + k resultIds
+    // Read record: type + seqNum + k resultIds, built in place
+    char* data = shard.m_buffer + shard.m_used;
     data[0] = static_cast<char>(ResultRecordType::Read);
     std::memcpy(data + 1, &p_seqNum, sizeof(p_seqNum));
     std::memcpy(data + 1 + sizeof(p_seqNum), p_resultIds, m_k * sizeof(std::uint64_t));
-
-    MarkSlotReady(slotIdx, ResultRecordType::Read);
+    shard.m_used += m_readRecordSize;
+    ++shard.m_records;
 }
 
 inline void ResultWriter::Flush() {
-    // Wait until all claimed slots have been flushed
-    std::size_t targetFlushed = m_totalClaimed.load(std::memory_order_acquire);
-
-    m_flushRequested.store(true, std::memory_order_release);
+    // Hand every partly filled buffer to the flusher
+    {
+        std::lock_guard<std::mutex> lock(m_shardsLock);
+        for (auto& shard : m_shards) {
+            std::lock_guard<std::mutex> shardLock(shard->m_lock);
+            HandOff(*shard);
+        }
+    }
 
-    std::unique_lock<std::mutex> lock(m_flushMutex);
-    m_flushCv.wait(lock, [this, targetFlushed]() {
-        return m_totalFlushed.load(std::memory_order_acquire) >= targetFlushed;
-    });
+    // Wait until all of them are written
+    {
+        std::unique_lock<std::mutex> lock(m_queueLock);
+        m_queueCv.wait(lock, [this]() { return m_fullBlocks.empty() && m_writing == 0; });
+    }
 
     // Sync to disk
-    fsync(m_fd);
+    fsync(m_spillFd);
+}
+
+inline std::size_t ResultWriter::RecordSize(char p_type) const {
+    return static_cast<ResultRecordType>(p_type) == ResultRecordType::Write ? m_writeRecordSize : m_readRecordSize;
+}
+
+// k-way merge of the shards, each a chain of blocks already in sequence order, into the output
+inline void ResultWriter::MergeSpill() {
+    struct Cursor {
+        std::vector<std::size_t>* m_blocks;
+        std::size_t m_next = 0;
+        char* m_buffer = nullptr;
+        std::size_t m_pos = 0;
+        std::size_t m_end = 0;
+    };
+    int readFd = open(m_spillPath.c_str(), O_RDONLY);
+    if (readFd < 0) {
+        return;
+    }
+    char* buffer = static_cast<char*>(std::aligned_alloc(kAlign, m_blockBytes * (m_shardBlocks.size() + 1)));
+    std::vector<Cursor> cursors(m_shardBlocks.size());
+    auto advance = [&](Cursor& p_cursor) {
+        while (p_cursor.m_pos >= p_cursor.m_end) {
+            if (p_cursor.m_next >= p_cursor.m_blocks->size()) {
+                return false;
+            }
+            std::size_t block = (*p_cursor.m_blocks)[p_cursor.m_next++];
+            if (pread(readFd, p_cursor.m_buffer, m_blockBytes, static_cast<off_t>(block * m_blockBytes)) != static_cast<ssize_t>(m_blockBytes)) {
+                continue;
+            }
+            p_cursor.m_pos = kBlockHeader;
+            p_cursor.m_end = kBlockHeader + reinterpret_cast<const BlockHeader*>(p_cursor.m_buffer)->m_bytes;
+        }
+        return true;
+    };
+    auto seqOf = [](const Cursor& p_cursor) {
+        std::uint64_t seq;
+        std::memcpy(&seq, p_cursor.m_buffer + p_cursor.m_pos + 1, sizeof(seq));
+        return seq;
+    };
+
+    using Entry = std::pair<std::uint64_t, std::size_t>;
+    std::priority_queue<Entry, std::vector<Entry>, std::greater<Entry>> heap;
+    for (std::size_t i = 0; i < cursors.size(); ++i) {
+        cursors[i].m_blocks = &m_shardBlocks[i];
+        cursors[i].m_buffer = buffer + i * m_blockBytes;
+        if (advance(cursors[i])) {
+            heap.emplace(seqOf(cursors[i]), i);
+        }
+    }
+
+    // Output goes through the last block sized buffer
+    char* out = buffer + cursors.size() * m_blockBytes;
+    std::size_t outUsed = 0;
+    auto drain = [&]() {
+        if (outUsed > 0 && write(m_fd, out, outUsed) != static_cast<ssize_t>(outUsed)) {
+            // In production, handle error properly
+        }
+        outUsed = 0;
+    };
+    while (!heap.empty()) {
+        Cursor& cursor = cursors[heap.top().second];
+        std::size_t shard = heap.top().second;
+        heap.pop();
+        std::size_t size = RecordSize(cursor.m_buffer[cursor.m_pos]);
+        if (outUsed + size > m_blockBytes) {
+            drain();
+        }
+        std::memcpy(out + outUsed, cursor.m_buffer + cursor.m_pos, size);
+        outUsed += size;
+        cursor.m_pos += size;
+        if (advance(cursor)) {
+            heap.emplace(seqOf(cursor), shard);
+        }
+    }
+    drain();
+    std::free(buffer);
+    close(readFd);
 }
 
 inline void ResultWriter::Close() {
@@ -285,8 +459,15 @@ inline void ResultWriter::Close() {
     // Stop flusher thread
     StopFlusher();
 
+    // Merge the spill file into the output, then drop it
+    MergeSpill();
+    close(m_spillFd);
+    m_spillFd = -1;
+    unlink(m_spillPath.c_str());
+
     // Close file
     if (m_fd >= 0) {
+        fsync(m_fd);
         close(m_fd);
         m_fd = -1;
     }
@@ -310,6 +491,11 @@ inline std::size_t ResultWriter::GetReadRecordSize() const {
     return m_readRecordSize;
 }
 
+inline std::size_t ResultWriter::GetShards() {
+    std::lock_guard<std::mutex> lock(m_shardsLock);
+    return m_shards.size();
+}
+
 // =============================================================================
 // ResultReader - for reading back result files (useful for testing)
 // =============================================================================
@@ -0,0 +1,148 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_HELPER_TASKSCHEDULER_H_
+#define _SPTAG_HELPER_TASKSCHEDULER_H_
+
+#include "Core/Common.h"
+#include <tbb/blocked_range.h>
+#include <tbb/info.h>
+#include <tbb/parallel_for.h>
+#include <tbb/task_arena.h>
+#include <tbb/task_group.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SPTAG::Helper {
+// The one task scheduler the build runs on: a TBB arena of a fixed number of threads, or one arena
+// per NUMA node splitting them, shared by every phase instead of each phase sizing its own OpenMP
+// team or thread vector. A parallel loop started from inside a task nests into the arena it runs
+// in rather than adding threads, so a phase calling into another never oversubscribes the cores
+class TaskScheduler {
+   public:
+    static TaskScheduler& Instance() {
+        static TaskScheduler scheduler;
+        return scheduler;
+    }
+
+    // size the arenas, 0 threads for all cores. Only call between phases, no task may be running
+    void Configure(int p_threads, bool p_numaArenas) {
+        std::lock_guard<std::mutex> lock(m_configLock);
+        int threads = p_threads > 0 ? p_threads : (int)(std::max)(std::thread::hardware_concurrency(), 1u);
+        std::vector<tbb::numa_node_id> nodes;
+        if (p_numaArenas)
+            nodes = tbb::info::numa_nodes();
+        if (nodes.size() <= 1 || (int)nodes.size() > threads)
+            nodes.assign(1, tbb::task_arena::automatic);
+        if (threads == m_threads && nodes == m_nodes)
+            return;
+        m_arenas.clear();
+        for (size_t i = 0; i < nodes.size(); i++) {
+            int share = threads / (int)nodes.size() + ((int)i < threads % (int)nodes.size() ? 1 : 0);
+            tbb::task_arena::constraints constraints;
+            constraints.set_numa_id(nodes[i]);
+            constraints.set_max_concurrency(share);
+            m_arenas.emplace_back(new tbb::task_arena(constraints));
+        }
+        m_threads = threads;
+        m_nodes = nodes;
+        LOG(Helper::LogLevel::LL_Info, "TaskScheduler: %d threads in %zu arena(s)\n", threads, m_arenas.size());
+    }
+
+    inline int Concurrency() {
+        EnsureConfigured();
+        return m_threads;
+    }
+
+    // p_body(i) for every i of [p_begin, p_end), taken p_grain at a time. With NUMA arenas every
+    // arena gets one contiguous slice
+    template <typename I, typename F>
+    void ParallelFor(I p_begin, I p_end, I p_grain, const F& p_body) {
+        if (p_end <= p_begin)
+            return;
+        p_grain = (std::max)(p_grain, (I)1);
+        auto loop = [&](I p_first, I p_last) {
+            tbb::parallel_for(tbb::blocked_range<I>(p_first, p_last, p_grain), [&](const tbb::blocked_range<I>& p_range) {
+                Nested nested;
+                for (I i = p_range.begin(); i != p_range.end(); ++i) p_body(i);
+            });
+        };
+        if (Depth() > 0) {
+            loop(p_begin, p_end);
+            return;
+        }
+        EnsureConfigured();
+        size_t arenas = m_arenas.size();
+        if (arenas == 1 || (std::uint64_t)(p_end - p_begin) < arenas) {
+            m_arenas[0]->execute([&] { loop(p_begin, p_end); });
+            return;
+        }
+        std::vector<tbb::task_group> groups(arenas);
+        I total = p_end - p_begin;
+        for (size_t a = 0; a < arenas; a++) {
+            I first = p_begin + (I)(total * (std::uint64_t)a / arenas), last = p_begin + (I)(total * (std::uint64_t)(a + 1) / arenas);
+            m_arenas[a]->execute([&, a, first, last] { groups[a].run([&loop, first, last] { loop(first, last); }); });
+        }
+        for (size_t a = 0; a < arenas; a++) m_arenas[a]->execute([&, a] { groups[a].wait(); });
+    }
+
+    // p_tasks calls p_body(task), for workers that keep state over many items and pull them from a
+    // shared counter. How many run at once is up to the arena, tasks go to the arenas in turn
+    template <typename F>
+    void Run(int p_tasks, const F& p_body) {
+        if (p_tasks <= 0)
+            return;
+        auto task = [&p_body](int p_task) {
+            Nested nested;
+            p_body(p_task);
+        };
+        if (Depth() > 0) {
+            tbb::task_group group;
+            for (int t = 0; t < p_tasks; t++) group.run([&task, t] { task(t); });
+            group.wait();
+            return;
+        }
+        EnsureConfigured();
+        size_t arenas = m_arenas.size();
+        std::vector<tbb::task_group> groups(arenas);
+        for (int t = 0; t < p_tasks; t++) {
+            size_t a = (size_t)t % arenas;
+            m_arenas[a]->execute([&, a, t] { groups[a].run([&task, t] { task(t); }); });
+        }
+        for (size_t a = 0; a < arenas; a++) m_arenas[a]->execute([&, a] { groups[a].wait(); });
+    }
+
+   private:
+    TaskScheduler() = default;
+
+    // marks the calling thread as running one of our tasks while in scope
+    struct Nested {
+        Nested() {
+            Depth()++;
+        }
+        ~Nested() {
+            Depth()--;
+        }
+    };
+
+    static int& Depth() {
+        static thread_local int depth = 0;
+        return depth;
+    }
+
+    void EnsureConfigured() {
+        if (m_arenas.empty())
+            Configure(0, false);
+    }
+
+    std::mutex m_configLock;
+    int m_threads = 0;
+    std::vector<tbb::numa_node_id> m_nodes;
+    std::vector<std::unique_ptr<tbb::task_arena>> m_arenas;
+};
+}  // namespace SPTAG::Helper
+
+#endif  // _SPTAG_HELPER_TASKSCHEDULER_H_
@@ -4,7 +4,9 @@
 #ifndef _SPTAG_HELPER_TRACEPLAYER_H_
 #define _SPTAG_HELPER_TRACEPLAYER_H_
 
+#include <algorithm>
 #include <atomic>
+#include <cerrno>
 #include <cstddef>
 #include <cstdint>
 #include <cstring>
@@ -14,9 +16,11 @@
 #include <optional>
 #include <stdexcept>
 #include <string>
+#include <sys/mman.h>
 #include <thread>
 #include <unistd.h>
 #include <vector>
+#include <liburing.h>
 
 namespace SPTAG::Helper {
 
@@ -66,12 +70,17 @@ class TraceRecordGuard {
     TraceRecord<T> m_record;
 };
 
+// Replays a vector file as a stream of operations. Consumers copy every record into one of
+// m_windowSize slots, which a TraceRecordGuard pins until it is dropped. Behind them, loader threads
+// read the file in chunks of several windows with batched O_DIRECT io_uring reads into a ring of
+// hugepage buffers, so a record costs a memcpy instead of a syscall
 template <typename T>
 class TracePlayer {
    public:
     using HashFunction = std::function<std::uint64_t(std::uint64_t)>;
 
-    TracePlayer(const std::string& p_filepath, std::size_t p_windowSize, HashFunction p_hashFn);
+    // p_loaders threads keep up to p_readAhead chunks loaded ahead of the consumers
+    TracePlayer(const std::string& p_filepath, std::size_t p_windowSize, HashFunction p_hashFn, std::size_t p_loaders = 1, std::size_t p_readAhead = 8);
     ~TracePlayer();
 
     // Non-copyable, non-movable
@@ -85,19 +94,38 @@ class TracePlayer {
     std::size_t GetDimension() const;
     std::size_t GetTotalVectors() const;
     std::size_t GetWindowSize() const;
+    std::size_t GetChunkVectors() const;
 
    private:
     friend class TraceRecordGuard<T>;
 
+    // One buffer of the read-ahead ring. m_loaded is the chunk it holds plus one, m_pending the
+    // records of it not copied out yet; the buffer takes the next chunk once that reaches 0
+    struct Chunk {
+        std::atomic<std::size_t> m_loaded{0};
+        std::atomic<std::size_t> m_pending{0};
+        char* m_data = nullptr;
+        std::size_t m_skip = 0;  // bytes before the first record, reads start on an aligned offset
+    };
+
+    static constexpr std::size_t kAlign = 4096;
+    static constexpr std::size_t kChunkBytes = 1 << 20;
+    static constexpr std::size_t kHugePage = 2 << 20;
+
     void ReleaseSlot(std::size_t p_slot);
     void LoadIntoSlot(std::size_t p_slot, std::size_t p_seqNum);
     OperationKind DetermineOp(std::size_t p_seqNum) const;
-    void StartPrefetcher();
+    void StartPrefetcher(std::size_t p_loaders);
     void StopPrefetcher();
-    void PrefetcherLoop();
+    void PrefetcherLoop(std::size_t p_loader, std::size_t p_loaders);
+    bool ChunkFree(std::size_t p_chunk) const;
+    void ChunkRange(std::size_t p_chunk, std::size_t& p_offset, std::size_t& p_length, std::size_t& p_required, std::size_t& p_skip) const;
+    bool ReadChunk(std::size_t p_chunk);
+    void PublishChunk(std::size_t p_chunk, std::size_t p_skip);
 
-    // File handle
+    // File handles, m_directFd is -1 when the file system refuses O_DIRECT
     int m_fd;
+    int m_directFd = -1;
     std::size_t m_totalVectors;
     std::size_t m_dim;
     std::size_t m_vectorBytes;
@@ -107,11 +135,17 @@ class TracePlayer {
     std::size_t m_windowSize;
     std::vector<T> m_buffer;  // m_windowSize * m_dim elements
 
-    // Double buffer for prefetching
-    std::vector<T> m_prefetchBuffer;
-    std::atomic<std::size_t> m_prefetchedUpTo{0};
+    // Read-ahead ring, one mapping of m_readAhead buffers of m_chunkBytes
+    std::size_t m_chunkVectors;
+    std::size_t m_totalChunks;
+    std::size_t m_readAhead;
+    std::size_t m_chunkBytes;
+    void* m_mapping = MAP_FAILED;
+    std::size_t m_mappingBytes = 0;
+    std::unique_ptr<Chunk[]> m_chunks;
     std::atomic<bool> m_prefetcherRunning{false};
-    std::thread m_prefetcherThread;
+    std::atomic<bool> m_readFailed{false};
+    std::vector<std::thread> m_loaders;
 
     // Per-slot reference counts (lock-free)
     // Using unique_ptr array because std::atomic is not copyable/movable
@@ -211,7 +245,7 @@ bool TraceRecordGuard<T>::Valid() const {
 // =============================================================================
 
 template <typename T>
-TracePlayer<T>::TracePlayer(const std::string& p_filepath, std::size_t p_windowSize, HashFunction p_hashFn)
+TracePlayer<T>::TracePlayer(const std::string& p_filepath, std::size_t p_windowSize, HashFunction p_hashFn, std::size_t p_loaders, std::size_t p_readAhead)
     : m_windowSize(p_windowSize), m_hashFn(std::move(p_hashFn)) {
     m_fd = open(p_filepath.c_str(), O_RDONLY);
     if (m_fd < 0) {
@@ -238,67 +272,212 @@ TracePlayer<T>::TracePlayer(const std::string& p_filepath, std::size_t p_windowS
         m_slotRefs[i].store(0, std::memory_order_relaxed);
     }
 
-    // Allocate prefetch buffer (double buffer)
-    m_prefetchBuffer.resize(m_windowSize * m_dim);
-    m_prefetchedUpTo.store(0, std::memory_order_relaxed);
+    // Read-ahead ring: chunks of at least one window and about kChunkBytes, each buffer large
+    // enough for the aligned read around its records
+    m_chunkVectors = (std::max)(m_windowSize, kChunkBytes / (std::max)(m_vectorBytes, (std::size_t)1));
+    m_totalChunks = (m_totalVectors + m_chunkVectors - 1) / m_chunkVectors;
+    m_readAhead = (std::max)(p_readAhead, (std::size_t)2);
+    m_chunkBytes = (m_chunkVectors * m_vectorBytes + 2 * kAlign - 1) / kAlign * kAlign;
+    m_mappingBytes = m_readAhead * m_chunkBytes;
+    if (m_mappingBytes >= kHugePage) {
+        std::size_t length = (m_mappingBytes + kHugePage - 1) / kHugePage * kHugePage;
+        m_mapping = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (m_mapping != MAP_FAILED)
+            m_mappingBytes = length;
+    }
+    if (m_mapping == MAP_FAILED) {
+        m_mapping = mmap(nullptr, m_mappingBytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (m_mapping == MAP_FAILED) {
+            close(m_fd);
+            throw std::runtime_error("TracePlayer: Failed to map read-ahead buffers");
+        }
+        madvise(m_mapping, m_mappingBytes, MADV_HUGEPAGE);
+    }
+    m_chunks = std::make_unique<Chunk[]>(m_readAhead);
+    for (std::size_t i = 0; i < m_readAhead; ++i) {
+        m_chunks[i].m_data = (char*)m_mapping + i * m_chunkBytes;
+    }
+    m_directFd = open(p_filepath.c_str(), O_RDONLY | O_DIRECT);
 
-    // Start background prefetcher
-    StartPrefetcher();
+    // Start background loaders
+    StartPrefetcher((std::max)(p_loaders, (std::size_t)1));
 }
 
 template <typename T>
 TracePlayer<T>::~TracePlayer() {
     StopPrefetcher();
+    if (m_mapping != MAP_FAILED) {
+        munmap(m_mapping, m_mappingBytes);
+    }
+    if (m_directFd >= 0) {
+        close(m_directFd);
+    }
     if (m_fd >= 0) {
         close(m_fd);
     }
 }
 
 template <typename T>
-void TracePlayer<T>::StartPrefetcher() {
+void TracePlayer<T>::StartPrefetcher(std::size_t p_loaders) {
     m_prefetcherRunning.store(true, std::memory_order_release);
-    m_prefetcherThread = std::thread(&TracePlayer<T>::PrefetcherLoop, this);
+    for (std::size_t i = 0; i < p_loaders; ++i) {
+        m_loaders.emplace_back(&TracePlayer<T>::PrefetcherLoop, this, i, p_loaders);
+    }
 }
 
 template <typename T>
 void TracePlayer<T>::StopPrefetcher() {
     m_prefetcherRunning.store(false, std::memory_order_release);
-    if (m_prefetcherThread.joinable()) {
-        m_prefetcherThread.join();
+    for (auto& loader : m_loaders) {
+        if (loader.joinable()) {
+            loader.join();
+        }
     }
+    m_loaders.clear();
 }
 
 template <typename T>
-void TracePlayer<T>::PrefetcherLoop() {
-    std::size_t prefetchSeq = 0;
+bool TracePlayer<T>::ChunkFree(std::size_t p_chunk) const {
+    if (p_chunk < m_readAhead) {
+        return true;
+    }
+    const Chunk& buffer = m_chunks[p_chunk % m_readAhead];
+    return buffer.m_loaded.load(std::memory_order_acquire) == p_chunk - m_readAhead + 1 &&
+           buffer.m_pending.load(std::memory_order_acquire) == 0;
+}
 
-    while (m_prefetcherRunning.load(std::memory_order_acquire)) {
-        std::size_t currentNext = m_nextSeq.load(std::memory_order_acquire);
+template <typename T>
+void TracePlayer<T>::ChunkRange(std::size_t p_chunk, std::size_t& p_offset, std::size_t& p_length, std::size_t& p_required, std::size_t& p_skip) const {
+    std::size_t first = p_chunk * m_chunkVectors;
+    std::size_t count = (std::min)(m_chunkVectors, m_totalVectors - first);
+    std::size_t begin = m_headerBytes + first * m_vectorBytes;
+    p_offset = begin / kAlign * kAlign;
+    p_skip = begin - p_offset;
+    p_required = p_skip + count * m_vectorBytes;
+    p_length = (p_required + kAlign - 1) / kAlign * kAlign;
+}
 
-        // Prefetch up to windowSize ahead of current consumption
-        std::size_t targetPrefetch = currentNext + m_windowSize;
-        if (targetPrefetch > m_totalVectors) {
-            targetPrefetch = m_totalVectors;
+// synchronous read of a whole chunk through the page cache, for when io_uring is unavailable or
+// a read came back short
+template <typename T>
+bool TracePlayer<T>::ReadChunk(std::size_t p_chunk) {
+    std::size_t offset, length, required, skip;
+    ChunkRange(p_chunk, offset, length, required, skip);
+    char* dest = m_chunks[p_chunk % m_readAhead].m_data;
+    std::size_t done = 0;
+    while (done < required) {
+        ssize_t bytesRead = pread(m_fd, dest + done, length - done, static_cast<off_t>(offset + done));
+        if (bytesRead <= 0) {
+            return false;
         }
+        done += static_cast<std::size_t>(bytesRead);
+    }
+    PublishChunk(p_chunk, skip);
+    return true;
+}
 
-        while (prefetchSeq < targetPrefetch) {
-            std::size_t slot = prefetchSeq % m_windowSize;
-            off_t offset = static_cast<off_t>(m_headerBytes + prefetchSeq * m_vectorBytes);
-            T* dest = m_prefetchBuffer.data() + slot * m_dim;
+template <typename T>
+void TracePlayer<T>::PublishChunk(std::size_t p_chunk, std::size_t p_skip) {
+    Chunk& buffer = m_chunks[p_chunk % m_readAhead];
+    buffer.m_skip = p_skip;
+    buffer.m_pending.store((std::min)(m_chunkVectors, m_totalVectors - p_chunk * m_chunkVectors), std::memory_order_relaxed);
+    buffer.m_loaded.store(p_chunk + 1, std::memory_order_release);
+}
 
-            ssize_t bytesRead = pread(m_fd, dest, m_vectorBytes, offset);
-            if (bytesRead != static_cast<ssize_t>(m_vectorBytes)) {
-                // IO error, retry or break
-                std::this_thread::yield();
+// Loader p_loader of p_loaders owns every p_loaders-th chunk. Each round it queues reads for all of
+// its chunks whose buffers are free, submits them with one syscall and publishes them as they
+// complete
+template <typename T>
+void TracePlayer<T>::PrefetcherLoop(std::size_t p_loader, std::size_t p_loaders) {
+    struct io_uring ring;
+    unsigned depth = (unsigned)((m_readAhead + p_loaders - 1) / p_loaders);
+    bool useRing = io_uring_queue_init(depth, &ring, 0) == 0;
+    int fd = m_directFd >= 0 ? m_directFd : m_fd;
+    std::size_t next = p_loader;
+    std::vector<std::size_t> round;
+    round.reserve(depth);
+
+    while (m_prefetcherRunning.load(std::memory_order_acquire) && next < m_totalChunks) {
+        unsigned queued = 0;
+        round.clear();
+        for (; queued < depth && next < m_totalChunks && ChunkFree(next); next += p_loaders) {
+            if (!useRing) {
+                if (!ReadChunk(next)) {
+                    m_readFailed.store(true, std::memory_order_release);
+                    return;
+                }
+                ++queued;
                 continue;
             }
-
-            ++prefetchSeq;
-            m_prefetchedUpTo.store(prefetchSeq, std::memory_order_release);
+            std::size_t offset, length, required, skip;
+            ChunkRange(next, offset, length, required, skip);
+            struct io_uring_sqe* sqe = io_uring_get_sqe(&ring);
+            io_uring_prep_read(sqe, fd, m_chunks[next % m_readAhead].m_data, (unsigned)length, offset);
+            io_uring_sqe_set_data64(sqe, next);
+            round.push_back(next);
+            ++queued;
+        }
+        if (queued == 0) {
+            // Yield to avoid busy spinning when the consumers are behind
+            std::this_thread::yield();
+            continue;
+        }
+        if (!useRing) {
+            continue;
+        }
+        // only what the kernel took is in flight. A short or busy submit leaves the rest queued and
+        // is retried once completions were reaped; a hard one with nothing in flight drops the ring
+        // and reads the rest of the round, and every later chunk, through ReadChunk
+        unsigned inFlight = 0;
+        while (queued > 0 || inFlight > 0) {
+            if (queued > 0) {
+                int submitted = io_uring_submit(&ring);
+                if (submitted > 0) {
+                    unsigned taken = (std::min)((unsigned)submitted, queued);
+                    queued -= taken;
+                    inFlight += taken;
+                } else if (inFlight == 0 && submitted != -EAGAIN && submitted != -EBUSY && submitted != -EINTR) {
+                    io_uring_queue_exit(&ring);
+                    useRing = false;
+                    for (std::size_t i = round.size() - queued; i < round.size(); ++i) {
+                        if (!ReadChunk(round[i])) {
+                            m_readFailed.store(true, std::memory_order_release);
+                            return;
+                        }
+                    }
+                    break;
+                } else if (inFlight == 0) {
+                    if (!m_prefetcherRunning.load(std::memory_order_acquire)) {
+                        break;
+                    }
+                    std::this_thread::yield();
+                    continue;
+                }
+            }
+            if (inFlight == 0) {
+                continue;
+            }
+            --inFlight;
+            struct io_uring_cqe* cqe;
+            if (io_uring_wait_cqe(&ring, &cqe) != 0) {
+                m_readFailed.store(true, std::memory_order_release);
+                io_uring_queue_exit(&ring);
+                return;
+            }
+            std::size_t chunk = (std::size_t)io_uring_cqe_get_data64(cqe);
+            int res = cqe->res;
+            io_uring_cqe_seen(&ring, cqe);
+            std::size_t offset, length, required, skip;
+            ChunkRange(chunk, offset, length, required, skip);
+            if (res >= 0 && (std::size_t)res >= required) {
+                PublishChunk(chunk, skip);
+            } else if (!ReadChunk(chunk)) {
+                m_readFailed.store(true, std::memory_order_release);
+            }
         }
-
-        // Yield to avoid busy spinning when caught up
-        std::this_thread::yield();
+    }
+    if (useRing) {
+        io_uring_queue_exit(&ring);
     }
 }
 
@@ -309,24 +488,11 @@ void TracePlayer<T>::ReleaseSlot(std::size_t p_slot) {
 
 template <typename T>
 void TracePlayer<T>::LoadIntoSlot(std::size_t p_slot, std::size_t p_seqNum) {
-    // Check if prefetcher has this data ready
-    std::size_t prefetched = m_prefetchedUpTo.load(std::memory_order_acquire);
-
-    if (p_seqNum < prefetched) {
-        // Copy from prefetch buffer
-        T* src = m_prefetchBuffer.data() + p_slot * m_dim;
-        T* dest = m_buffer.data() + p_slot * m_dim;
-        std::memcpy(dest, src, m_vectorBytes);
-    } else {
-        // Fallback: direct read (prefetcher hasn't caught up)
-        off_t offset = static_cast<off_t>(m_headerBytes + p_seqNum * m_vectorBytes);
-        T* dest = m_buffer.data() + p_slot * m_dim;
-
-        ssize_t bytesRead = pread(m_fd, dest, m_vectorBytes, offset);
-        if (bytesRead != static_cast<ssize_t>(m_vectorBytes)) {
-            throw std::runtime_error("TracePlayer: Failed to read vector from file");
-        }
-    }
+    std::size_t chunk = p_seqNum / m_chunkVectors;
+    Chunk& buffer = m_chunks[chunk % m_readAhead];
+    const char* src = buffer.m_data + buffer.m_skip + (p_seqNum - chunk * m_chunkVectors) * m_vectorBytes;
+    std::memcpy(m_buffer.data() + p_slot * m_dim, src, m_vectorBytes);
+    buffer.m_pending.fetch_sub(1, std::memory_order_release);
 }
 
 template <typename T>
@@ -354,6 +520,17 @@ std::optional<TraceRecordGuard<T>> TracePlayer<T>::Next() {
         }
     }
 
+    // Wait for the loaders to bring in the chunk holding this record. The buffer cannot be reused
+    // before this record is copied out, so waiting here holds no slot another consumer needs
+    std::size_t chunk = seq / m_chunkVectors;
+    const Chunk& buffer = m_chunks[chunk % m_readAhead];
+    while (buffer.m_loaded.load(std::memory_order_acquire) != chunk + 1) {
+        if (m_readFailed.load(std::memory_order_acquire)) {
+            throw std::runtime_error("TracePlayer: Failed to read vector from file");
+        }
+        std::this_thread::yield();
+    }
+
     std::size_t slot = seq % m_windowSize;
 
     // Atomically acquire the slot: spin-wait until slot is free (ref_count == 0)
@@ -368,7 +545,7 @@ std::optional<TraceRecordGuard<T>> TracePlayer<T>::Next() {
     }
 
     // Now we exclusively own the slot with ref_count = 1
-    // Load vector data into the slot
+    // Copy the vector out of the read-ahead ring into the slot
     LoadIntoSlot(slot, seq);
 
     // ref_count is already set to 1, guard will decrement when dropped
@@ -397,6 +574,11 @@ std::size_t TracePlayer<T>::GetWindowSize() const {
     return m_windowSize;
 }
 
+template <typename T>
+std::size_t TracePlayer<T>::GetChunkVectors() const {
+    return m_chunkVectors;
+}
+
 }  // namespace SPTAG::Helper
 
 #endif  // _SPTAG_HELPER_TRACEPLAYER_H_
@@ -0,0 +1,132 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_HELPER_URINGFILEREADER_H_
+#define _SPTAG_HELPER_URINGFILEREADER_H_
+
+#include "Helper/DiskIO.h"
+#include "Core/Common.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <fcntl.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <liburing.h>
+
+namespace SPTAG::Helper {
+// Read-only DiskIO on one file driven by io_uring, the io_uring counterpart of AsyncFileIO.
+// Every channel (the m_status & 0xffff of a request, a search workspace) has its own ring with
+// the file registered, and a batch goes out with one submit per ring. Buffers registered for a
+// channel with RegisterBuffers are read into as fixed buffers, so the kernel does not map them
+// again for every read. Optionally the rings share an SQ polling thread (SQPOLL) and poll the
+// device for completions instead of waiting for interrupts (IOPOLL, needs O_DIRECT)
+class UringFileIO : public DiskIO {
+   public:
+    UringFileIO(DiskIOScenario scenario = DiskIOScenario::DIS_UserRead, bool p_sqPoll = false, bool p_ioPoll = false) : m_sqPoll(p_sqPoll), m_ioPoll(p_ioPoll) {}
+
+    virtual ~UringFileIO() {
+        ShutDown();
+    }
+
+    // maxIOSize is the queue depth of each ring, threadPoolSize the number of channels
+    virtual bool Initialize(const char* filePath, int openMode, std::uint64_t maxIOSize = (1 << 20), std::uint32_t maxReadRetries = 2, std::uint32_t maxWriteRetries = 2, std::uint16_t threadPoolSize = 4);
+
+    virtual std::uint64_t ReadBinary(std::uint64_t readSize, char* buffer, std::uint64_t offset = UINT64_MAX) {
+        return pread(m_fileHandle, (void*)buffer, readSize, offset);
+    }
+
+    virtual std::uint64_t WriteBinary(std::uint64_t writeSize, const char* buffer, std::uint64_t offset = UINT64_MAX) {
+        return 0;
+    }
+
+    virtual std::uint64_t ReadString(std::uint64_t& readSize, std::unique_ptr<char[]>& buffer, char delim = '\n', std::uint64_t offset = UINT64_MAX) {
+        return 0;
+    }
+
+    virtual std::uint64_t WriteString(const char* buffer, std::uint64_t offset = UINT64_MAX) {
+        return 0;
+    }
+
+    // reads the request and calls its callback before returning
+    virtual bool ReadFileAsync(AsyncReadRequest& readRequest) {
+        return BatchReadFile(&readRequest, 1);
+    }
+
+    // reads all requests, which go to the channel of the first one, calling each callback as soon as
+    // its read is done. false when a read failed
+    virtual bool BatchReadFile(AsyncReadRequest* readRequests, std::uint32_t requestCount);
+
+    // make p_buffers the fixed buffers of channel p_channel, request.m_bufferIndex then names the one
+    // request.m_buffer lies in. Cheap when they already are. false when the kernel refused them
+    // (RLIMIT_MEMLOCK), reads then go to the buffers without registration
+    bool RegisterBuffers(int p_channel, const struct iovec* p_buffers, int p_count);
+
+    virtual std::uint64_t TellP() {
+        return 0;
+    }
+
+    virtual void ShutDown();
+
+    int GetFileHandler() {
+        return m_fileHandle;
+    }
+
+    // BatchReadFileUring, handlers all UringFileIO
+    static bool BatchRead(std::vector<std::shared_ptr<DiskIO>>& p_handlers, AsyncReadRequest* p_requests, int p_num);
+
+   private:
+    struct Channel {
+        std::mutex m_lock;  // held by the batch using the ring
+        struct io_uring m_ring;
+        unsigned m_entries = 0;
+        bool m_ready = false;
+        std::vector<struct iovec> m_fixed;
+    };
+
+    // requests of one batch going to one file, read on the ring of their channel. m_pending lists
+    // the requests still to be submitted from m_next on, retried ones are appended again
+    struct FileBatch {
+        UringFileIO* m_file = nullptr;
+        Channel* m_channel = nullptr;
+        std::vector<AsyncReadRequest*> m_requests;
+        std::vector<std::uint32_t> m_retries;
+        std::vector<std::uint32_t> m_pending;
+        size_t m_next = 0;
+        // prepared in the submission queue and not taken by the kernel yet, the last ones before m_next
+        int m_queued = 0;
+        int m_inFlight = 0;
+    };
+
+    Channel& GetChannel(int p_status) {
+        return *m_channels[(p_status & 0xffff) % m_channels.size()];
+    }
+
+    bool CreateRing(Channel& p_channel, unsigned p_entries);
+
+    // replaces the ring of a channel with nothing in flight, dropping the entries still queued
+    bool ResetRing(Channel& p_channel);
+
+    // locks the channels of the batches with requests in file order and runs them to completion
+    static bool Execute(std::vector<FileBatch>& p_batches);
+
+    void Prepare(struct io_uring_sqe* p_sqe, FileBatch& p_batch, std::uint64_t p_batchIndex, std::uint32_t p_request);
+
+    int m_fileHandle = -1;
+    bool m_sqPoll;
+    bool m_ioPoll;
+    int m_sqPollFd = -1;  // ring owning the SQ polling thread, the others attach to it
+    std::uint32_t m_maxReadRetries = 2;
+    std::vector<std::unique_ptr<Channel>> m_channels;
+    std::atomic<bool> m_fixedRefused{false};
+};
+
+// BatchReadFileAsync for files opened with UringFileIO: the requests are spread over the files by
+// m_status >> 16 and all read on the rings of the channel m_status & 0xffff. false when a read failed
+bool BatchReadFileUring(std::vector<std::shared_ptr<DiskIO>>& handlers, AsyncReadRequest* readRequests, int num);
+}  // namespace SPTAG::Helper
+
+#endif  // _SPTAG_HELPER_URINGFILEREADER_H_
@@ -72,6 +72,11 @@ class VectorSetReader : public std::enable_shared_from_this<VectorSetReader<T>>
     void* m_mappedData;
     size_t m_fileSize;
     int m_fd;
+
+    // bytes of the .fbin/.u8bin style header before the first vector, 0 for raw files
+    size_t m_dataOffset;
+    // vectors the file holds
+    SizeType m_fileVectors;
 };
 
 }  // namespace SPTAG::Helper
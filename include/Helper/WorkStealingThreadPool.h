@@ -0,0 +1,309 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#ifndef _SPTAG_HELPER_WORKSTEALINGTHREADPOOL_H_
+#define _SPTAG_HELPER_WORKSTEALINGTHREADPOOL_H_
+
+#include "Core/Common.h"
+#include "ThreadPool.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace SPTAG::Helper {
+// Fixed size blocks for one job type. Every thread keeps a small cache of free blocks and trades
+// them in batches with a shared list, so jobs allocated by inserters and freed by workers are
+// recycled without a lock per job.
+template <typename T>
+class JobBlockPool {
+   public:
+    static void* Allocate() {
+        Cache& cache = LocalCache();
+        if (cache.m_blocks.empty()) {
+            Shared& shared = GetShared();
+            std::lock_guard<std::mutex> lock(shared.m_lock);
+            for (size_t i = 0; i < kBatch && !shared.m_blocks.empty(); i++) {
+                cache.m_blocks.push_back(shared.m_blocks.back());
+                shared.m_blocks.pop_back();
+            }
+        }
+        if (cache.m_blocks.empty())
+            return ::operator new(sizeof(T));
+        void* block = cache.m_blocks.back();
+        cache.m_blocks.pop_back();
+        return block;
+    }
+
+    static void Free(void* p_block) {
+        Cache& cache = LocalCache();
+        cache.m_blocks.push_back(p_block);
+        if (cache.m_blocks.size() >= 2 * kBatch)
+            cache.Spill(kBatch);
+    }
+
+   private:
+    static constexpr size_t kBatch = 64;
+
+    struct Shared {
+        std::mutex m_lock;
+        std::vector<void*> m_blocks;
+
+        ~Shared() {
+            for (void* block : m_blocks) ::operator delete(block);
+        }
+    };
+
+    struct Cache {
+        std::vector<void*> m_blocks;
+
+        void Spill(size_t p_count) {
+            Shared& shared = GetShared();
+            std::lock_guard<std::mutex> lock(shared.m_lock);
+            for (size_t i = 0; i < p_count && !m_blocks.empty(); i++) {
+                shared.m_blocks.push_back(m_blocks.back());
+                m_blocks.pop_back();
+            }
+        }
+
+        // blocks of an exiting thread go back to the shared list
+        ~Cache() {
+            Spill(m_blocks.size());
+        }
+    };
+
+    static Shared& GetShared() {
+        static Shared shared;
+        return shared;
+    }
+
+    static Cache& LocalCache() {
+        static thread_local Cache cache;
+        return cache;
+    }
+};
+
+// Job whose storage comes from JobBlockPool<T>, T is the deriving job class
+template <typename T>
+class PooledJob : public ThreadPool::Job {
+   public:
+    static void* operator new(size_t p_size) {
+        return JobBlockPool<T>::Allocate();
+    }
+
+    static void operator delete(void* p_block) {
+        JobBlockPool<T>::Free(p_block);
+    }
+};
+
+// Thread pool with a deque per worker and priority. Jobs added by a worker go to its own deques,
+// jobs added from other threads are spread round robin. An idle worker takes the highest priority
+// job it can find, first from its own deque (newest first) and then by stealing from the others
+// (oldest first). Like ThreadPool it owns the jobs and deletes them after exec.
+class WorkStealingThreadPool {
+   public:
+    typedef ThreadPool::Job Job;
+
+    static constexpr int kPriorities = 4;
+
+    WorkStealingThreadPool() {}
+
+    ~WorkStealingThreadPool() {
+        stop();
+    }
+
+    // p_threadInit and p_threadExit run on every worker before its first and after its last job
+    void init(int numberOfThreads, std::function<void()> p_threadInit = nullptr, std::function<void()> p_threadExit = nullptr) {
+        numberOfThreads = (std::max)(numberOfThreads, 1);
+        m_abort.SetAbort(false);
+        m_stop = false;
+        m_workers.clear();
+        m_active = numberOfThreads;
+        for (int i = 0; i < numberOfThreads; i++) m_workers.emplace_back(new Worker());
+        for (int i = 0; i < numberOfThreads; i++) {
+            m_threads.emplace_back([this, i, p_threadInit, p_threadExit] {
+                CurrentPool() = this;
+                CurrentWorker() = i;
+                if (p_threadInit != nullptr)
+                    p_threadInit();
+                run(i);
+                if (p_threadExit != nullptr)
+                    p_threadExit();
+                CurrentPool() = nullptr;
+            });
+        }
+    }
+
+    void add(Job* j, int priority = 0) {
+        priority = (std::min)((std::max)(priority, 0), kPriorities - 1);
+        int target = inWorker() ? CurrentWorker() : (int)(m_next.fetch_add(1, std::memory_order_relaxed) % (std::uint64_t)m_active.load());
+        {
+            std::lock_guard<std::mutex> lock(m_workers[target]->m_lock);
+            m_workers[target]->m_jobs[priority].push_back(j);
+            m_queued[priority]++;
+            m_pending++;
+        }
+        if (m_sleepers.load() > 0) {
+            { std::lock_guard<std::mutex> lock(m_sleepLock); }
+            m_cond.notify_one();
+        }
+    }
+
+    // only the first p_active workers take jobs, the others sleep until they are let in again.
+    // Jobs left on the deques of parked workers are stolen by the active ones
+    void setActive(int p_active) {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepLock);
+            m_active = (std::min)((std::max)(p_active, 1), (int)m_workers.size());
+        }
+        m_cond.notify_all();
+        m_parked.notify_all();
+    }
+
+    inline int active() const {
+        return m_active.load();
+    }
+
+    inline int size() const {
+        return (int)m_workers.size();
+    }
+
+    // true on the worker threads of this pool
+    inline bool inWorker() const {
+        return CurrentPool() == this;
+    }
+
+    inline size_t jobsize() const {
+        return (size_t)(std::max)(m_pending.load(), (std::int64_t)0);
+    }
+
+    inline size_t jobsize(int priority) const {
+        return (size_t)(std::max)(m_queued[priority].load(), (std::int64_t)0);
+    }
+
+    inline uint32_t runningJobs() const {
+        uint32_t running = 0;
+        for (int p = 0; p < kPriorities; p++) running += m_running[p].load();
+        return running;
+    }
+
+    inline uint32_t runningJobs(int priority) const {
+        return m_running[priority].load();
+    }
+
+    inline bool allClear() const {
+        return runningJobs() == 0 && jobsize() == 0;
+    }
+
+    // wake and join the workers, jobs still queued are deleted without running
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(m_sleepLock);
+            m_stop = true;
+        }
+        m_cond.notify_all();
+        m_parked.notify_all();
+        for (auto&& t : m_threads) t.join();
+        m_threads.clear();
+        m_abort.SetAbort(true);
+        for (auto& worker : m_workers) {
+            for (auto& jobs : worker->m_jobs) {
+                for (Job* j : jobs) delete j;
+                jobs.clear();
+            }
+        }
+        for (int p = 0; p < kPriorities; p++) m_queued[p] = 0;
+        m_pending = 0;
+    }
+
+   private:
+    struct Worker {
+        std::mutex m_lock;
+        std::deque<Job*> m_jobs[kPriorities];
+    };
+
+    static const WorkStealingThreadPool*& CurrentPool() {
+        static thread_local const WorkStealingThreadPool* pool = nullptr;
+        return pool;
+    }
+
+    static int& CurrentWorker() {
+        static thread_local int worker = -1;
+        return worker;
+    }
+
+    void run(int p_self) {
+        while (!m_stop.load()) {
+            Job* j;
+            int priority;
+            if (p_self >= m_active.load()) {
+                std::unique_lock<std::mutex> lock(m_sleepLock);
+                while (p_self >= m_active.load() && !m_stop.load()) m_parked.wait(lock);
+                continue;
+            }
+            if (!take(p_self, j, priority)) {
+                std::unique_lock<std::mutex> lock(m_sleepLock);
+                m_sleepers++;
+                while (m_pending.load() <= 0 && p_self < m_active.load() && !m_stop.load()) m_cond.wait(lock);
+                m_sleepers--;
+                continue;
+            }
+            try {
+                j->exec(&m_abort);
+            } catch (std::exception& e) {
+                LOG(Helper::LogLevel::LL_Error, "WorkStealingThreadPool: exception in %s %s\n", typeid(*j).name(), e.what());
+            }
+            delete j;
+            m_running[priority]--;
+        }
+    }
+
+    // the job is counted as running before it stops being queued, so allClear never sees a gap
+    bool take(int p_self, Job*& j, int& priority) {
+        int workers = (int)m_workers.size();
+        for (priority = kPriorities - 1; priority >= 0; priority--) {
+            if (m_queued[priority].load() <= 0)
+                continue;
+            for (int i = 0; i < workers; i++) {
+                Worker& worker = *m_workers[(p_self + i) % workers];
+                std::lock_guard<std::mutex> lock(worker.m_lock);
+                auto& jobs = worker.m_jobs[priority];
+                if (jobs.empty())
+                    continue;
+                if (i == 0) {
+                    j = jobs.back();
+                    jobs.pop_back();
+                } else {
+                    j = jobs.front();
+                    jobs.pop_front();
+                }
+                m_running[priority]++;
+                m_queued[priority]--;
+                m_pending--;
+                return true;
+            }
+        }
+        return false;
+    }
+
+    ThreadPool::Abort m_abort{false};
+    std::vector<std::unique_ptr<Worker>> m_workers;
+    std::vector<std::thread> m_threads;
+    std::atomic<std::int64_t> m_queued[kPriorities]{};
+    std::atomic<std::uint32_t> m_running[kPriorities]{};
+    std::atomic<std::int64_t> m_pending{0};
+    std::atomic<bool> m_stop{false};
+    std::atomic<std::uint64_t> m_next{0};
+    std::atomic<int> m_active{1};
+    std::atomic<int> m_sleepers{0};
+    std::mutex m_sleepLock;
+    std::condition_variable m_cond;
+    std::condition_variable m_parked;
+};
+}  // namespace SPTAG::Helper
+
+#endif  // _SPTAG_HELPER_WORKSTEALINGTHREADPOOL_H_
@@ -48,27 +48,43 @@ class Utils {
 
     template <typename T>
     static inline int GetBase() {
-        if (GetEnumValueType<T>() != VectorValueType::Float) {
-            return (int)(std::numeric_limits<T>::max)();
+        if (std::is_floating_point<T>::value || IsHalfFloat<T>::value) {
+            return 1;
         }
-        return 1;
+        return (int)(std::numeric_limits<T>::max)();
     }
 
     template <typename T>
     static void Normalize(T* arr, DimensionType col, int base) {
+        NormalizeTo(arr, arr, col, base);
+    }
+
+    template <typename T>
+    static double Norm(const T* src, DimensionType col) {
         double vecLen = 0;
         for (DimensionType j = 0; j < col; j++) {
-            double val = arr[j];
+            double val = src[j];
             vecLen += val * val;
         }
-        vecLen = std::sqrt(vecLen);
+        return std::sqrt(vecLen);
+    }
+
+    // normalised copy of src in dst, one pass instead of a copy followed by Normalize; dst may be src
+    template <typename T>
+    static void NormalizeTo(const T* src, T* dst, DimensionType col, int base) {
+        NormalizeTo(src, dst, col, base, Norm(src, col));
+    }
+
+    // NormalizeTo with the norm of src known already
+    template <typename T>
+    static void NormalizeTo(const T* src, T* dst, DimensionType col, int base, double vecLen) {
         if (vecLen < 1e-6) {
             T val = (T)(1.0 / std::sqrt((double)col) * base);
             for (DimensionType j = 0; j < col; j++)
-                arr[j] = val;
+                dst[j] = val;
         } else {
             for (DimensionType j = 0; j < col; j++)
-                arr[j] = (T)(arr[j] / vecLen * base);
+                dst[j] = (T)(src[j] / vecLen * base);
         }
     }
 
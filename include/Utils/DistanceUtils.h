@@ -15,6 +15,10 @@ template <typename T>
 using DistanceCalcReturn = float (*)(const T*, const T*, DimensionType);
 template <typename T>
 inline DistanceCalcReturn<T> DistanceCalcSelector(SPTAG::DistCalcMethod p_method);
+template <typename T>
+using DistanceBatchReturn = void (*)(const T*, const void* const*, int, DimensionType, float*);
+template <typename T>
+inline DistanceBatchReturn<T> DistanceBatchSelector(SPTAG::DistCalcMethod p_method);
 
 class DistanceUtils {
    public:
@@ -58,6 +62,14 @@ class DistanceUtils {
     static float ComputeL2Distance_AVX(const float* pX, const float* pY, DimensionType length);
     static float ComputeL2Distance_AVX512(const float* pX, const float* pY, DimensionType length);
 
+    static float ComputeL2Distance_SSE(const Float16* pX, const Float16* pY, DimensionType length);
+    static float ComputeL2Distance_AVX(const Float16* pX, const Float16* pY, DimensionType length);
+    static float ComputeL2Distance_AVX512(const Float16* pX, const Float16* pY, DimensionType length);
+
+    static float ComputeL2Distance_SSE(const BFloat16* pX, const BFloat16* pY, DimensionType length);
+    static float ComputeL2Distance_AVX(const BFloat16* pX, const BFloat16* pY, DimensionType length);
+    static float ComputeL2Distance_AVX512(const BFloat16* pX, const BFloat16* pY, DimensionType length);
+
     template <typename T>
     static float ComputeCosineDistance(const T* pX, const T* pY, DimensionType length) {
         const T* pEnd4 = pX + ((length >> 2) << 2);
@@ -97,6 +109,109 @@ class DistanceUtils {
     static float ComputeCosineDistance_AVX(const float* pX, const float* pY, DimensionType length);
     static float ComputeCosineDistance_AVX512(const float* pX, const float* pY, DimensionType length);
 
+    static float ComputeCosineDistance_SSE(const Float16* pX, const Float16* pY, DimensionType length);
+    static float ComputeCosineDistance_AVX(const Float16* pX, const Float16* pY, DimensionType length);
+    static float ComputeCosineDistance_AVX512(const Float16* pX, const Float16* pY, DimensionType length);
+
+    static float ComputeCosineDistance_SSE(const BFloat16* pX, const BFloat16* pY, DimensionType length);
+    static float ComputeCosineDistance_AVX(const BFloat16* pX, const BFloat16* pY, DimensionType length);
+    static float ComputeCosineDistance_AVX512(const BFloat16* pX, const BFloat16* pY, DimensionType length);
+    // bf16 pairs multiplied and summed into float lanes by VDPBF16PS
+    static float ComputeCosineDistance_AVX512BF16(const BFloat16* pX, const BFloat16* pY, DimensionType length);
+
+    // distances of one query to count vectors, the query stays in registers while four vectors are
+    // processed at a time and their sums are reduced together
+    template <typename T>
+    static void ComputeL2DistanceBatch(const T* pX, const void* const* pY, int count, DimensionType length, float* dists) {
+        for (int i = 0; i < count; i++) dists[i] = ComputeL2Distance(pX, (const T*)pY[i], length);
+    }
+
+    static void ComputeL2DistanceBatch_SSE(const std::int8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX(const std::int8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX512(const std::int8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeL2DistanceBatch_SSE(const std::uint8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX(const std::uint8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX512(const std::uint8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeL2DistanceBatch_SSE(const std::int16_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX(const std::int16_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX512(const std::int16_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeL2DistanceBatch_SSE(const float* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX(const float* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX512(const float* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeL2DistanceBatch_SSE(const Float16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX(const Float16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX512(const Float16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeL2DistanceBatch_SSE(const BFloat16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX(const BFloat16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeL2DistanceBatch_AVX512(const BFloat16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    template <typename T>
+    static void ComputeCosineDistanceBatch(const T* pX, const void* const* pY, int count, DimensionType length, float* dists) {
+        for (int i = 0; i < count; i++) dists[i] = ComputeCosineDistance(pX, (const T*)pY[i], length);
+    }
+
+    static void ComputeCosineDistanceBatch_SSE(const std::int8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX(const std::int8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX512(const std::int8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeCosineDistanceBatch_SSE(const std::uint8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX(const std::uint8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX512(const std::uint8_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeCosineDistanceBatch_SSE(const std::int16_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX(const std::int16_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX512(const std::int16_t* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeCosineDistanceBatch_SSE(const float* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX(const float* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX512(const float* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeCosineDistanceBatch_SSE(const Float16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX(const Float16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX512(const Float16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    static void ComputeCosineDistanceBatch_SSE(const BFloat16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX(const BFloat16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+    static void ComputeCosineDistanceBatch_AVX512(const BFloat16* pX, const void* const* pY, int count, DimensionType length, float* dists);
+
+    // sum of p_table[i * 256 + p_codes[i]] over the p_count subspaces of a product quantization code
+    static float ComputeLookupSum(const float* p_table, const std::uint8_t* p_codes, DimensionType p_count) {
+        float sum0 = 0, sum1 = 0, sum2 = 0, sum3 = 0;
+        DimensionType i = 0;
+        for (; i + 4 <= p_count; i += 4, p_table += 1024) {
+            sum0 += p_table[p_codes[i]];
+            sum1 += p_table[256 + p_codes[i + 1]];
+            sum2 += p_table[512 + p_codes[i + 2]];
+            sum3 += p_table[768 + p_codes[i + 3]];
+        }
+        for (; i < p_count; i++, p_table += 256)
+            sum0 += p_table[p_codes[i]];
+        return (sum0 + sum1) + (sum2 + sum3);
+    }
+
+    static float ComputeLookupSum_AVX(const float* p_table, const std::uint8_t* p_codes, DimensionType p_count);
+
+    // dimensions with kernels of their own: the AVX and AVX512 kernels above with the length a
+    // compile-time constant, so every loop runs a fixed number of times and the tails fold away
+    static constexpr DimensionType FixedDimensions[] = {96, 100, 128, 200, 256, 384, 768, 1024};
+
+    // the kernel of one of FixedDimensions, which ignores its length argument. nullptr for other
+    // dimensions, for element types without such kernels and on CPUs without AVX2
+    template <typename T>
+    static DistanceCalcReturn<T> FixedDimensionKernel(SPTAG::DistCalcMethod p_method, DimensionType p_dim) {
+        return nullptr;
+    }
+
+    template <typename T>
+    static DistanceBatchReturn<T> FixedDimensionBatchKernel(SPTAG::DistCalcMethod p_method, DimensionType p_dim) {
+        return nullptr;
+    }
+
     template <typename T>
     static inline float ComputeDistance(const T* p1, const T* p2, DimensionType length, SPTAG::DistCalcMethod distCalcMethod) {
         auto func = DistanceCalcSelector<T>(distCalcMethod);
@@ -114,15 +229,44 @@ class DistanceUtils {
         return 1 - d;
     }
 };
+template <>
+DistanceCalcReturn<float> DistanceUtils::FixedDimensionKernel<float>(SPTAG::DistCalcMethod p_method, DimensionType p_dim);
+template <>
+DistanceCalcReturn<std::int8_t> DistanceUtils::FixedDimensionKernel<std::int8_t>(SPTAG::DistCalcMethod p_method, DimensionType p_dim);
+template <>
+DistanceCalcReturn<std::uint8_t> DistanceUtils::FixedDimensionKernel<std::uint8_t>(SPTAG::DistCalcMethod p_method, DimensionType p_dim);
+template <>
+DistanceBatchReturn<float> DistanceUtils::FixedDimensionBatchKernel<float>(SPTAG::DistCalcMethod p_method, DimensionType p_dim);
+template <>
+DistanceBatchReturn<std::int8_t> DistanceUtils::FixedDimensionBatchKernel<std::int8_t>(SPTAG::DistCalcMethod p_method, DimensionType p_dim);
+template <>
+DistanceBatchReturn<std::uint8_t> DistanceUtils::FixedDimensionBatchKernel<std::uint8_t>(SPTAG::DistCalcMethod p_method, DimensionType p_dim);
+
+using LookupSumReturn = float (*)(const float*, const std::uint8_t*, DimensionType);
+
+inline LookupSumReturn LookupSumSelector() {
+    if (InstructionSet::AVX2())
+        return &(DistanceUtils::ComputeLookupSum_AVX);
+    return &(DistanceUtils::ComputeLookupSum);
+}
+
 template <typename T>
 inline DistanceCalcReturn<T> DistanceCalcSelector(SPTAG::DistCalcMethod p_method) {
     bool isSize4 = (sizeof(T) == 4);
+    bool canAVX = InstructionSet::AVX2() || (isSize4 && InstructionSet::AVX());
+    // the 256-bit Float16 kernels widen with F16C, AVX512F has its own conversion
+    if (std::is_same<T, Float16>::value)
+        canAVX = canAVX && InstructionSet::F16C();
     switch (p_method) {
         case SPTAG::DistCalcMethod::InnerProduct:
         case SPTAG::DistCalcMethod::Cosine:
+            if constexpr (std::is_same<T, BFloat16>::value) {
+                if (InstructionSet::AVX512BF16())
+                    return &(DistanceUtils::ComputeCosineDistance_AVX512BF16);
+            }
             if (InstructionSet::AVX512()) {
                 return &(DistanceUtils::ComputeCosineDistance_AVX512);
-            } else if (InstructionSet::AVX2() || (isSize4 && InstructionSet::AVX())) {
+            } else if (canAVX) {
                 return &(DistanceUtils::ComputeCosineDistance_AVX);
             } else if (InstructionSet::SSE2() || (isSize4 && InstructionSet::SSE())) {
                 return &(DistanceUtils::ComputeCosineDistance_SSE);
@@ -133,7 +277,7 @@ inline DistanceCalcReturn<T> DistanceCalcSelector(SPTAG::DistCalcMethod p_method
         case SPTAG::DistCalcMethod::L2:
             if (InstructionSet::AVX512()) {
                 return &(DistanceUtils::ComputeL2Distance_AVX512);
-            } else if (InstructionSet::AVX2() || (isSize4 && InstructionSet::AVX())) {
+            } else if (canAVX) {
                 return &(DistanceUtils::ComputeL2Distance_AVX);
             } else if (InstructionSet::SSE2() || (isSize4 && InstructionSet::SSE())) {
                 return &(DistanceUtils::ComputeL2Distance_SSE);
@@ -146,6 +290,56 @@ inline DistanceCalcReturn<T> DistanceCalcSelector(SPTAG::DistCalcMethod p_method
     }
     return nullptr;
 }
+
+// the kernel for vectors of p_dim components, a fixed-dimension one where there is one. It is
+// picked once for an index and must only be called with p_dim as the length
+template <typename T>
+inline DistanceCalcReturn<T> DistanceCalcSelector(SPTAG::DistCalcMethod p_method, DimensionType p_dim) {
+    DistanceCalcReturn<T> fixed = DistanceUtils::FixedDimensionKernel<T>(p_method, p_dim);
+    return fixed != nullptr ? fixed : DistanceCalcSelector<T>(p_method);
+}
+
+template <typename T>
+inline DistanceBatchReturn<T> DistanceBatchSelector(SPTAG::DistCalcMethod p_method) {
+    bool isSize4 = (sizeof(T) == 4);
+    bool canAVX = InstructionSet::AVX2() || (isSize4 && InstructionSet::AVX());
+    if (std::is_same<T, Float16>::value)
+        canAVX = canAVX && InstructionSet::F16C();
+    switch (p_method) {
+        case SPTAG::DistCalcMethod::InnerProduct:
+        case SPTAG::DistCalcMethod::Cosine:
+            if (InstructionSet::AVX512()) {
+                return &(DistanceUtils::ComputeCosineDistanceBatch_AVX512);
+            } else if (canAVX) {
+                return &(DistanceUtils::ComputeCosineDistanceBatch_AVX);
+            } else if (InstructionSet::SSE2() || (isSize4 && InstructionSet::SSE())) {
+                return &(DistanceUtils::ComputeCosineDistanceBatch_SSE);
+            } else {
+                return &(DistanceUtils::ComputeCosineDistanceBatch);
+            }
+
+        case SPTAG::DistCalcMethod::L2:
+            if (InstructionSet::AVX512()) {
+                return &(DistanceUtils::ComputeL2DistanceBatch_AVX512);
+            } else if (canAVX) {
+                return &(DistanceUtils::ComputeL2DistanceBatch_AVX);
+            } else if (InstructionSet::SSE2() || (isSize4 && InstructionSet::SSE())) {
+                return &(DistanceUtils::ComputeL2DistanceBatch_SSE);
+            } else {
+                return &(DistanceUtils::ComputeL2DistanceBatch);
+            }
+
+        default:
+            break;
+    }
+    return nullptr;
+}
+
+template <typename T>
+inline DistanceBatchReturn<T> DistanceBatchSelector(SPTAG::DistCalcMethod p_method, DimensionType p_dim) {
+    DistanceBatchReturn<T> fixed = DistanceUtils::FixedDimensionBatchKernel<T>(p_method, p_dim);
+    return fixed != nullptr ? fixed : DistanceBatchSelector<T>(p_method);
+}
 }  // namespace SPTAG::COMMON
 
 #endif  // _SPTAG_COMMON_DISTANCEUTILS_H_
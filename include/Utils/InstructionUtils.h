@@ -25,6 +25,8 @@ class InstructionSet {
     static bool SSE2(void);
     static bool AVX2(void);
     static bool AVX512(void);
+    static bool F16C(void);
+    static bool AVX512BF16(void);
     static void PrintInstructionSet(void);
 
    private:
@@ -38,6 +40,8 @@ class InstructionSet {
         bool HW_AVX;
         bool HW_AVX2;
         bool HW_AVX512;
+        bool HW_F16C;
+        bool HW_AVX512BF16;
     };
 };
 
@@ -16,6 +16,10 @@ using SumCalcReturn = void (*)(T*, const T*, DimensionType);
 template <typename T>
 inline SumCalcReturn<T> SumCalcSelector();
 
+// bit i of the result is the bit of p_bits named by the int at p_entries + i * p_stride, for up to 64 entries
+using BitTestReturn = std::uint64_t (*)(const std::uint32_t*, const char*, int, int);
+inline BitTestReturn BitTestSelector();
+
 class SIMDUtils {
    public:
     template <typename T>
@@ -42,6 +46,18 @@ class SIMDUtils {
     static void ComputeSum_AVX(float* pX, const float* pY, DimensionType length);
     static void ComputeSum_AVX512(float* pX, const float* pY, DimensionType length);
 
+    static std::uint64_t BitTestStrided_Naive(const std::uint32_t* p_bits, const char* p_entries, int p_stride, int p_count) {
+        std::uint64_t mask = 0;
+        for (int i = 0; i < p_count; i++) {
+            std::uint32_t key = (std::uint32_t)*(const int*)(p_entries + (size_t)i * p_stride);
+            mask |= (std::uint64_t)((p_bits[key >> 5] >> (key & 31)) & 1) << i;
+        }
+        return mask;
+    }
+    // gather the keys and then their bit words, 8 or 16 entries at a time
+    static std::uint64_t BitTestStrided_AVX(const std::uint32_t* p_bits, const char* p_entries, int p_stride, int p_count);
+    static std::uint64_t BitTestStrided_AVX512(const std::uint32_t* p_bits, const char* p_entries, int p_stride, int p_count);
+
     template <typename T>
     static inline void ComputeSum(T* p1, const T* p2, DimensionType length) {
         auto func = SumCalcSelector<T>();
@@ -51,17 +67,32 @@ class SIMDUtils {
 
 template <typename T>
 inline SumCalcReturn<T> SumCalcSelector() {
-    if (InstructionSet::AVX512()) {
-        return &(SIMDUtils::ComputeSum_AVX512);
+    // 16-bit floats are added one value at a time, each sum rounded back to 16 bits
+    if constexpr (IsHalfFloat<T>::value) {
+        return &(SIMDUtils::ComputeSum_Naive<T>);
+    } else {
+        if (InstructionSet::AVX512()) {
+            return &(SIMDUtils::ComputeSum_AVX512);
+        }
+        bool isSize4 = (sizeof(T) == 4);
+        if (InstructionSet::AVX2() || (isSize4 && InstructionSet::AVX())) {
+            return &(SIMDUtils::ComputeSum_AVX);
+        }
+        if (InstructionSet::SSE2() || (isSize4 && InstructionSet::SSE())) {
+            return &(SIMDUtils::ComputeSum_SSE);
+        }
+        return &(SIMDUtils::ComputeSum_Naive);
     }
-    bool isSize4 = (sizeof(T) == 4);
-    if (InstructionSet::AVX2() || (isSize4 && InstructionSet::AVX())) {
-        return &(SIMDUtils::ComputeSum_AVX);
+}
+
+inline BitTestReturn BitTestSelector() {
+    if (InstructionSet::AVX512()) {
+        return &(SIMDUtils::BitTestStrided_AVX512);
     }
-    if (InstructionSet::SSE2() || (isSize4 && InstructionSet::SSE())) {
-        return &(SIMDUtils::ComputeSum_SSE);
+    if (InstructionSet::AVX2()) {
+        return &(SIMDUtils::BitTestStrided_AVX);
     }
-    return &(SIMDUtils::ComputeSum_Naive);
+    return &(SIMDUtils::BitTestStrided_Naive);
 }
 }  // namespace SPTAG::COMMON
 
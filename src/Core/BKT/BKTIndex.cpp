@@ -3,6 +3,7 @@
 
 #include "Core/BKT/Index.h"
 #include <chrono>
+#include <thread>
 
 #pragma warning(disable : 4242)  // '=' : conversion from 'int' to 'short', possible loss of data
 #pragma warning(disable : 4244)  // '=' : conversion from 'int' to 'short', possible loss of data
@@ -27,11 +28,15 @@ ErrorCode Index<T>::LoadIndexDataFromMemory(const std::vector<ByteArray>& p_inde
     if (p_indexBlobs.size() < 3)
         return ErrorCode::LackOfInputs;
 
-    if (m_pSamples.Load((char*)p_indexBlobs[0].Data(), m_iDataBlockSize, m_iDataCapacity) != ErrorCode::Success)
-        return ErrorCode::FailedParseValue;
-    if (m_pTrees.LoadTrees((char*)p_indexBlobs[1].Data()) != ErrorCode::Success)
-        return ErrorCode::FailedParseValue;
-    if (m_pGraph.LoadGraph((char*)p_indexBlobs[2].Data(), m_iDataBlockSize, m_iDataCapacity) != ErrorCode::Success)
+    ApplyMemoryPolicy();
+    // the structures are independent, the graph and the trees are copied while the samples are
+    ErrorCode graphRet = ErrorCode::Success, treeRet = ErrorCode::Success;
+    std::thread graphLoader([&] { graphRet = m_pGraph.LoadGraph((char*)p_indexBlobs[2].Data(), m_iDataBlockSize, m_iDataCapacity); });
+    std::thread treeLoader([&] { treeRet = m_pTrees.LoadTrees((char*)p_indexBlobs[1].Data()); });
+    ErrorCode sampleRet = m_pSamples.Load((char*)p_indexBlobs[0].Data(), m_iDataBlockSize, m_iDataCapacity);
+    graphLoader.join();
+    treeLoader.join();
+    if (sampleRet != ErrorCode::Success || treeRet != ErrorCode::Success || graphRet != ErrorCode::Success)
         return ErrorCode::FailedParseValue;
     if (p_indexBlobs.size() <= 3)
         m_deletedID.Initialize(m_pSamples.R(), m_iDataBlockSize, m_iDataCapacity);
@@ -40,7 +45,9 @@ ErrorCode Index<T>::LoadIndexDataFromMemory(const std::vector<ByteArray>& p_inde
 
     omp_set_num_threads(m_iNumberOfThreads);
     m_threadPool.init();
-    return ErrorCode::Success;
+    BindDistanceKernel();
+    BuildQuantizedSamples();
+    return ReplicatePerNode();
 }
 
 template <typename T>
@@ -48,21 +55,40 @@ ErrorCode Index<T>::LoadIndexData(const std::vector<std::shared_ptr<Helper::Disk
     if (p_indexStreams.size() < 4)
         return ErrorCode::LackOfInputs;
 
-    ErrorCode ret = ErrorCode::Success;
-    if (p_indexStreams[0] == nullptr || (ret = m_pSamples.Load(p_indexStreams[0], m_iDataBlockSize, m_iDataCapacity)) != ErrorCode::Success)
-        return ret;
-    if (p_indexStreams[1] == nullptr || (ret = m_pTrees.LoadTrees(p_indexStreams[1])) != ErrorCode::Success)
-        return ret;
-    if (p_indexStreams[2] == nullptr || (ret = m_pGraph.LoadGraph(p_indexStreams[2], m_iDataBlockSize, m_iDataCapacity)) != ErrorCode::Success)
+    ApplyMemoryPolicy();
+    for (int i = 0; i < 3; i++)
+        if (p_indexStreams[i] == nullptr)
+            return ErrorCode::LackOfInputs;
+    // every structure has a stream of its own, the graph, the trees and the deleted ids are read
+    // while the samples are, so a load takes as long as the largest file
+    auto t1 = std::chrono::high_resolution_clock::now();
+    ErrorCode graphRet = ErrorCode::Success, treeRet = ErrorCode::Success, deletedRet = ErrorCode::Success;
+    std::thread graphLoader([&] { graphRet = m_pGraph.LoadGraph(p_indexStreams[2], m_iDataBlockSize, m_iDataCapacity); });
+    std::thread treeLoader([&] {
+        treeRet = m_pTrees.LoadTrees(p_indexStreams[1]);
+        if (p_indexStreams[3] != nullptr)
+            deletedRet = m_deletedID.Load(p_indexStreams[3], m_iDataBlockSize, m_iDataCapacity);
+    });
+    ErrorCode ret = m_pSamples.Load(p_indexStreams[0], m_iDataBlockSize, m_iDataCapacity);
+    graphLoader.join();
+    treeLoader.join();
+    if (ret != ErrorCode::Success)
         return ret;
+    if (treeRet != ErrorCode::Success)
+        return treeRet;
+    if (graphRet != ErrorCode::Success)
+        return graphRet;
     if (p_indexStreams[3] == nullptr)
         m_deletedID.Initialize(m_pSamples.R(), m_iDataBlockSize, m_iDataCapacity);
-    else if ((ret = m_deletedID.Load(p_indexStreams[3], m_iDataBlockSize, m_iDataCapacity)) != ErrorCode::Success)
-        return ret;
+    else if (deletedRet != ErrorCode::Success)
+        return deletedRet;
+    LOG(Helper::LogLevel::LL_Info, "Loaded %d head vectors, graph and trees in %.3lf s\n", m_pSamples.R(), std::chrono::duration<double>(std::chrono::high_resolution_clock::now() - t1).count());
 
     omp_set_num_threads(m_iNumberOfThreads);
     m_threadPool.init();
-    return ret;
+    BindDistanceKernel();
+    BuildQuantizedSamples();
+    return ReplicatePerNode();
 }
 
 template <typename T>
@@ -86,7 +112,9 @@ ErrorCode Index<T>::SaveIndexData(const std::vector<std::shared_ptr<Helper::Disk
     if (p_indexStreams.size() < 4)
         return ErrorCode::LackOfInputs;
 
-    std::lock_guard<std::mutex> lock(m_dataAddLock);
+    FlushStaged();
+
+    std::unique_lock<std::shared_timed_mutex> lock(m_dataAddLock);
     std::unique_lock<std::shared_timed_mutex> uniquelock(m_dataDeleteLock);
 
     ErrorCode ret = ErrorCode::Success;
@@ -218,11 +246,22 @@ ErrorCode Index<T>::SaveIndexData(const std::vector<std::shared_ptr<Helper::Disk
 
 
 template <typename T>
-template <bool (*notDeleted)(const COMMON::Labelset&, SizeType), bool (*isDup)(COMMON::QueryResultSet<T>&, SizeType, float), bool (*checkFilter)(const std::shared_ptr<MetadataSet>&, SizeType, std::function<bool(const ByteArray&)>)>
-void Index<T>::Search(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, std::function<bool(const ByteArray&)> filterFunc) const {
-    std::shared_lock<std::shared_timed_mutex> lock(*(m_pTrees.m_lock));
-    m_pTrees.InitSearchTrees(m_pSamples, m_fComputeDistance, p_query, p_space);
-    m_pTrees.SearchTrees(m_pSamples, m_fComputeDistance, p_query, p_space, m_iNumberOfInitialDynamicPivots);
+template <typename S, bool (*notDeleted)(const COMMON::Labelset&, SizeType), bool (*isDup)(COMMON::QueryResultSet<T>&, SizeType, float), bool (*checkFilter)(const std::shared_ptr<MetadataSet>&, SizeType, std::function<bool(const ByteArray&)>)>
+void Index<T>::SearchGraph(const COMMON::Dataset<S>& p_data, const std::function<float(const S*, const S*, DimensionType)>& p_fComputeDistance, COMMON::QueryResultSet<S>& p_target, COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, std::function<bool(const ByteArray&)> filterFunc) const {
+    m_pTrees.InitSearchTrees(p_data, p_fComputeDistance, p_target, p_space);
+    m_pTrees.SearchTrees(p_data, p_fComputeDistance, p_target, p_space, m_iNumberOfInitialDynamicPivots);
+    if (m_stagedCount.load() > 0) {
+        // staged nodes have no in-edges yet, so the walk cannot reach them; seed them like tree leaves
+        std::shared_lock<std::shared_timed_mutex> stagedLock(m_stagedLock);
+        for (SizeType node : m_stagedNodes) {
+            if (p_space.CheckAndSet(node))
+                continue;
+            float dist = p_fComputeDistance(p_target.GetTarget(), p_data[node], GetFeatureDim());
+            p_space.m_iNumberOfCheckedLeaves++;
+            if (p_space.m_Results.insert(dist))
+                p_space.m_NGQueue.insert(NodeDistPair(node, dist));
+        }
+    }
     const DimensionType checkPos = m_pGraph.m_iNeighborhoodSize - 1;
 
     while (!p_space.m_NGQueue.empty()) {
@@ -232,9 +271,9 @@ void Index<T>::Search(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_s
         _mm_prefetch((const char*)node, _MM_HINT_T0);
         for (DimensionType i = 0; i <= checkPos; i++) {
             auto futureNode = node[i];
-            if (futureNode < 0 || futureNode >= m_pSamples.R())
+            if (futureNode < 0 || futureNode >= p_data.R())
                 break;
-            _mm_prefetch((const char*)(m_pSamples)[futureNode], _MM_HINT_T0);
+            _mm_prefetch((const char*)(p_data)[futureNode], _MM_HINT_T0);
         }
 
         if (gnode.distance <= p_query.worstDist()) {
@@ -273,19 +312,46 @@ void Index<T>::Search(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_s
             // IF_NDEBUG(if (nn_index >= m_pSamples.R()) continue; )
             if (p_space.CheckAndSet(nn_index))
                 continue;
-            float distance2leaf = m_fComputeDistance(p_query.GetTarget(), (m_pSamples)[nn_index], GetFeatureDim());
+            float distance2leaf = p_fComputeDistance(p_target.GetTarget(), (p_data)[nn_index], GetFeatureDim());
             p_space.m_iNumberOfCheckedLeaves++;
             if (p_space.m_Results.insert(distance2leaf)) {
                 p_space.m_NGQueue.insert(NodeDistPair(nn_index, distance2leaf));
             }
         }
         if (p_space.m_NGQueue.Top().distance > p_space.m_SPTQueue.Top().distance) {
-            m_pTrees.SearchTrees(m_pSamples, m_fComputeDistance, p_query, p_space, m_iNumberOfOtherDynamicPivots + p_space.m_iNumberOfCheckedLeaves);
+            m_pTrees.SearchTrees(p_data, p_fComputeDistance, p_target, p_space, m_iNumberOfOtherDynamicPivots + p_space.m_iNumberOfCheckedLeaves);
         }
     }
     p_query.SortResult();
 }
 
+template <typename T>
+template <bool (*notDeleted)(const COMMON::Labelset&, SizeType), bool (*isDup)(COMMON::QueryResultSet<T>&, SizeType, float), bool (*checkFilter)(const std::shared_ptr<MetadataSet>&, SizeType, std::function<bool(const ByteArray&)>)>
+void Index<T>::Search(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, bool p_quantized, std::function<bool(const ByteArray&)> filterFunc) const {
+    std::shared_lock<std::shared_timed_mutex> lock(*(m_pTrees.m_lock));
+    if (!p_quantized) {
+        SearchGraph<T, notDeleted, isDup, checkFilter>(m_pSamples, m_fComputeDistance, p_query, p_query, p_space, filterFunc);
+        return;
+    }
+
+    p_space.m_quantizedQuery.resize(GetFeatureDim());
+    m_quantizer.Encode(p_query.GetTarget(), p_space.m_quantizedQuery.data());
+    COMMON::QueryResultSet<std::int8_t> target(p_space.m_quantizedQuery.data(), 1);
+    SearchGraph<std::int8_t, notDeleted, isDup, checkFilter>(m_pQuantizedSamples, m_fComputeQuantizedDistance, target, p_query, p_space, filterFunc);
+
+    // rescore the head of the list with the full vectors, the rest keep their quantized distances
+    int recheck = min(m_iQuantizedRecheck, p_query.GetResultNum());
+    BasicResult* res = p_query.GetResults();
+    int valid = 0;
+    while (valid < recheck && res[valid].VID >= 0) {
+        res[valid].Dist = m_fComputeDistance(p_query.GetTarget(), m_pSamples[res[valid].VID], GetFeatureDim());
+        valid++;
+    }
+    std::sort(res, res + valid, [](const BasicResult& a, const BasicResult& b) {
+        return a.Dist < b.Dist || (a.Dist == b.Dist && a.VID < b.VID);
+    });
+}
+
 namespace StaticDispatch {
 template <typename... Args>
 bool AlwaysTrue(Args...) {
@@ -314,7 +380,7 @@ bool CheckFilter(const std::shared_ptr<MetadataSet>& metadata, SizeType node, st
 };  // namespace StaticDispatch
 
 template <typename T>
-void Index<T>::SearchIndex(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, bool p_searchDeleted, bool p_searchDuplicated, std::function<bool(const ByteArray&)> filterFunc) const {
+void Index<T>::SearchIndex(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace& p_space, bool p_searchDeleted, bool p_searchDuplicated, bool p_quantized, std::function<bool(const ByteArray&)> filterFunc) const {
     // bitflags for which dispatch to take
     uint8_t flags = 0;
     flags += (m_deletedID.Count() == 0 || p_searchDeleted) << 2;
@@ -323,28 +389,28 @@ void Index<T>::SearchIndex(COMMON::QueryResultSet<T>& p_query, COMMON::WorkSpace
 
     switch (flags) {
         case 0b000:
-            Search<StaticDispatch::CheckIfNotDeleted, StaticDispatch::NeverDup, StaticDispatch::CheckFilter>(p_query, p_space, filterFunc);
+            Search<StaticDispatch::CheckIfNotDeleted, StaticDispatch::NeverDup, StaticDispatch::CheckFilter>(p_query, p_space, p_quantized, filterFunc);
             break;
         case 0b001:
-            Search<StaticDispatch::CheckIfNotDeleted, StaticDispatch::NeverDup, StaticDispatch::AlwaysTrue>(p_query, p_space, filterFunc);
+            Search<StaticDispatch::CheckIfNotDeleted, StaticDispatch::NeverDup, StaticDispatch::AlwaysTrue>(p_query, p_space, p_quantized, filterFunc);
             break;
         case 0b010:
-            Search<StaticDispatch::CheckIfNotDeleted, StaticDispatch::CheckDup, StaticDispatch::CheckFilter>(p_query, p_space, filterFunc);
+            Search<StaticDispatch::CheckIfNotDeleted, StaticDispatch::CheckDup, StaticDispatch::CheckFilter>(p_query, p_space, p_quantized, filterFunc);
             break;
         case 0b011:
-            Search<StaticDispatch::CheckIfNotDeleted, StaticDispatch::CheckDup, StaticDispatch::AlwaysTrue>(p_query, p_space, filterFunc);
+            Search<StaticDispatch::CheckIfNotDeleted, StaticDispatch::CheckDup, StaticDispatch::AlwaysTrue>(p_query, p_space, p_quantized, filterFunc);
             break;
         case 0b100:
-            Search<StaticDispatch::AlwaysTrue, StaticDispatch::NeverDup, StaticDispatch::CheckFilter>(p_query, p_space, filterFunc);
+            Search<StaticDispatch::AlwaysTrue, StaticDispatch::NeverDup, StaticDispatch::CheckFilter>(p_query, p_space, p_quantized, filterFunc);
             break;
         case 0b101:
-            Search<StaticDispatch::AlwaysTrue, StaticDispatch::NeverDup, StaticDispatch::AlwaysTrue>(p_query, p_space, filterFunc);
+            Search<StaticDispatch::AlwaysTrue, StaticDispatch::NeverDup, StaticDispatch::AlwaysTrue>(p_query, p_space, p_quantized, filterFunc);
             break;
         case 0b110:
-            Search<StaticDispatch::AlwaysTrue, StaticDispatch::CheckDup, StaticDispatch::CheckFilter>(p_query, p_space, filterFunc);
+            Search<StaticDispatch::AlwaysTrue, StaticDispatch::CheckDup, StaticDispatch::CheckFilter>(p_query, p_space, p_quantized, filterFunc);
             break;
         case 0b111:
-            Search<StaticDispatch::AlwaysTrue, StaticDispatch::CheckDup, StaticDispatch::AlwaysTrue>(p_query, p_space, filterFunc);
+            Search<StaticDispatch::AlwaysTrue, StaticDispatch::CheckDup, StaticDispatch::AlwaysTrue>(p_query, p_space, p_quantized, filterFunc);
             break;
         default:
             std::ostringstream oss;
@@ -363,14 +429,11 @@ ErrorCode Index<T>::SearchIndex(QueryResult& p_query, bool p_searchDeleted) cons
         m_workspace->Initialize(max(m_iMaxCheck, m_pGraph.m_iMaxCheckForRefineGraph), m_iHashTableExp);
     }
     m_workspace->Reset(m_iMaxCheck, p_query.GetResultNum());
-    SearchIndex(*((COMMON::QueryResultSet<T>*)&p_query), *m_workspace, p_searchDeleted, true);
+    SearchIndex(*((COMMON::QueryResultSet<T>*)&p_query), *m_workspace, p_searchDeleted, true, UseQuantizedSamples());
 
-    if (p_query.WithMeta() && nullptr != m_pMetadata) {
-        for (int i = 0; i < p_query.GetResultNum(); ++i) {
-            SizeType result = p_query.GetResult(i)->VID;
-            p_query.SetMetadata(i, (result < 0) ? ByteArray::c_empty : m_pMetadata->GetMetadataCopy(result));
-        }
-    }
+    // views of the metadata set, valid as long as the index keeps it
+    if (p_query.WithMeta() && nullptr != m_pMetadata)
+        m_pMetadata->GetMetadataViews(p_query.GetResults(), p_query.GetResultNum());
     return ErrorCode::Success;
 }
 
@@ -381,7 +444,7 @@ ErrorCode Index<T>::RefineSearchIndex(QueryResult& p_query, bool p_searchDeleted
         m_workspace->Initialize(max(m_iMaxCheck, m_pGraph.m_iMaxCheckForRefineGraph), m_iHashTableExp);
     }
     m_workspace->Reset(m_pGraph.m_iMaxCheckForRefineGraph, p_query.GetResultNum());
-    SearchIndex(*((COMMON::QueryResultSet<T>*)&p_query), *m_workspace, p_searchDeleted, false);
+    SearchIndex(*((COMMON::QueryResultSet<T>*)&p_query), *m_workspace, p_searchDeleted, false, false);
 
     return ErrorCode::Success;
 }
@@ -414,15 +477,16 @@ ErrorCode Index<T>::BuildIndex(const void* p_data, SizeType p_vectorNum, Dimensi
 
     omp_set_num_threads(m_iNumberOfThreads);
 
+    ApplyMemoryPolicy();
     m_pSamples.Initialize(p_vectorNum, p_dimension, m_iDataBlockSize, m_iDataCapacity, p_data, p_shareOwnership);
     m_deletedID.Initialize(p_vectorNum, m_iDataBlockSize, m_iDataCapacity);
+    BindDistanceKernel();
 
     if (DistCalcMethod::Cosine == m_iDistCalcMethod && !p_normalized) {
         int base = COMMON::Utils::GetBase<T>();
-#pragma omp parallel for
-        for (SizeType i = 0; i < GetNumSamples(); i++) {
+        Helper::TaskScheduler::Instance().ParallelFor<SizeType>(0, GetNumSamples(), 1, [&](SizeType i) {
             COMMON::Utils::Normalize(m_pSamples[i], GetFeatureDim(), base);
-        }
+        });
     }
 
     m_threadPool.init();
@@ -437,12 +501,100 @@ ErrorCode Index<T>::BuildIndex(const void* p_data, SizeType p_vectorNum, Dimensi
     auto t3 = std::chrono::high_resolution_clock::now();
     LOG(Helper::LogLevel::LL_Info, "Build Graph time (s): %lld\n", std::chrono::duration_cast<std::chrono::seconds>(t3 - t2).count());
 
+    BuildQuantizedSamples();
     m_bReady = true;
     return ErrorCode::Success;
 }
 
+template <typename T>
+void Index<T>::BuildQuantizedSamples() {
+    m_pQuantizedSamples.SetR(0);
+    if (!m_bQuantizedSearch || GetNumSamples() == 0)
+        return;
+    if (sizeof(T) == 1) {
+        LOG(Helper::LogLevel::LL_Warning, "QuantizedSearch is ignored for 8-bit vectors.\n");
+        return;
+    }
+
+    float maxAbs = 0;
+    for (SizeType i = 0; i < GetNumSamples(); i++) {
+        maxAbs = max(maxAbs, COMMON::SQ8Quantizer::MaxAbs(m_pSamples[i], GetFeatureDim()));
+    }
+    m_quantizer = COMMON::SQ8Quantizer(GetFeatureDim(), m_iDistCalcMethod, COMMON::Utils::GetBase<T>(), maxAbs);
+    m_fComputeQuantizedDistance = m_quantizer.DistanceFunction();
+    m_pQuantizedSamples.Initialize(GetNumSamples(), GetFeatureDim(), m_iDataBlockSize, m_iDataCapacity);
+    EncodeQuantizedSamples(0, GetNumSamples());
+    LOG(Helper::LogLevel::LL_Info, "Quantized %d head vectors with scale %f\n", GetNumSamples(), m_quantizer.Scale());
+}
+
+template <typename T>
+void Index<T>::ApplyMemoryPolicy() {
+    m_memoryPolicy = COMMON::MemoryPolicy();
+    m_memoryPolicy.hugePageMB = m_iHugePageMB;
+    if (!COMMON::MemoryPolicy::ParsePlacement(m_sNumaPlacement, m_memoryPolicy.placement))
+        LOG(Helper::LogLevel::LL_Warning, "Unknown NumaPlacement %s, keeping Local.\n", m_sNumaPlacement.c_str());
+    m_pSamples.SetMemoryPolicy(m_memoryPolicy);
+    m_pQuantizedSamples.SetMemoryPolicy(m_memoryPolicy);
+    m_pGraph.SetMemoryPolicy(m_memoryPolicy);
+    m_deletedID.SetMemoryPolicy(m_memoryPolicy);
+}
+
+template <typename T>
+ErrorCode Index<T>::ReplicatePerNode() {
+    if (m_memoryPolicy.placement != COMMON::NumaPlacement::Replicate)
+        return ErrorCode::Success;
+    ErrorCode ret = ErrorCode::Success;
+    if ((ret = m_pSamples.Replicate()) != ErrorCode::Success)
+        return ret;
+    if ((ret = m_pQuantizedSamples.Replicate()) != ErrorCode::Success)
+        return ret;
+    return m_pGraph.Replicate();
+}
+
+template <typename T>
+ErrorCode Index<T>::AppendRows(const void* p_data, SizeType p_vectorNum, SizeType& p_begin) {
+    bool quantized = UseQuantizedSamples();
+    ErrorCode ret = quantized ? m_pQuantizedSamples.ReserveBatch(p_vectorNum, p_begin) : m_pSamples.ReserveBatch(p_vectorNum, p_begin);
+    if (ret != ErrorCode::Success)
+        return ret;
+    // every dataset holds the blocks before any of them publishes the range, so all of them publish
+    // the same rows; a range one of them cannot take is abandoned in all
+    auto abandon = [&]() {
+        if (quantized)
+            m_pQuantizedSamples.Abandon(p_begin);
+        m_pSamples.Abandon(p_begin);
+        m_pGraph.Abandon(p_begin);
+        m_deletedID.Abandon(p_begin);
+    };
+    if ((quantized && (ret = m_pQuantizedSamples.AllocateBlocks(p_begin, p_vectorNum)) != ErrorCode::Success) ||
+        (ret = m_pSamples.AllocateBlocks(p_begin, p_vectorNum)) != ErrorCode::Success ||
+        (ret = m_pGraph.AllocateBlocks(p_begin, p_vectorNum)) != ErrorCode::Success ||
+        (ret = m_deletedID.AllocateBlocks(p_begin, p_vectorNum)) != ErrorCode::Success) {
+        abandon();
+        return ret;
+    }
+    // quantized rows go first so a concurrent quantized walk never sees a node it cannot read. The
+    // fills cannot fail now, only a range abandoned before this one stops them, in every dataset
+    if ((quantized && (ret = m_pQuantizedSamples.AddBatchAt(p_begin, p_vectorNum)) != ErrorCode::Success) ||
+        (ret = m_pSamples.AddBatchAt(p_begin, p_vectorNum, (const T*)p_data)) != ErrorCode::Success ||
+        (ret = m_pGraph.AddBatchAt(p_begin, p_vectorNum)) != ErrorCode::Success ||
+        (ret = m_deletedID.AddBatchAt(p_begin, p_vectorNum)) != ErrorCode::Success) {
+        abandon();
+        return ret;
+    }
+    return ErrorCode::Success;
+}
+
+template <typename T>
+void Index<T>::EncodeQuantizedSamples(SizeType p_begin, SizeType p_end) {
+    Helper::TaskScheduler::Instance().ParallelFor<SizeType>(p_begin, p_end, 1024, [&](SizeType i) {
+        m_quantizer.Encode(m_pSamples[i], m_pQuantizedSamples[i]);
+    });
+}
+
 template <typename T>
 ErrorCode Index<T>::RefineIndex(std::shared_ptr<Index<T>>& p_newIndex) {
+    FlushStaged();
     p_newIndex.reset(new Index<T>());
     Index<T>* ptr = p_newIndex.get();
 
@@ -452,7 +604,7 @@ ErrorCode Index<T>::RefineIndex(std::shared_ptr<Index<T>>& p_newIndex) {
 #include "Core/BKT/ParameterDefinitionList.h"
 #undef DefineBKTParameter
 
-    std::lock_guard<std::mutex> lock(m_dataAddLock);
+    std::unique_lock<std::shared_timed_mutex> lock(m_dataAddLock);
     std::unique_lock<std::shared_timed_mutex> uniquelock(m_dataDeleteLock);
 
     SizeType newR = GetNumSamples();
@@ -479,6 +631,7 @@ ErrorCode Index<T>::RefineIndex(std::shared_ptr<Index<T>>& p_newIndex) {
         return ErrorCode::EmptyIndex;
 
     ptr->m_threadPool.init();
+    ptr->ApplyMemoryPolicy();
 
     ErrorCode ret = ErrorCode::Success;
     if ((ret = m_pSamples.Refine(indices, ptr->m_pSamples)) != ErrorCode::Success)
@@ -492,13 +645,16 @@ ErrorCode Index<T>::RefineIndex(std::shared_ptr<Index<T>>& p_newIndex) {
     m_pGraph.RefineGraph<T>(this, indices, reverseIndices, nullptr, &(ptr->m_pGraph), &(ptr->m_pTrees.GetSampleMap()));
     if (HasMetaMapping())
         ptr->BuildMetaMapping(false);
+    ptr->BindDistanceKernel();
+    ptr->BuildQuantizedSamples();
     ptr->m_bReady = true;
     return ret;
 }
 
 template <typename T>
 ErrorCode Index<T>::RefineIndex(const std::vector<std::shared_ptr<Helper::DiskIO>>& p_indexStreams, IAbortOperation* p_abort) {
-    std::lock_guard<std::mutex> lock(m_dataAddLock);
+    FlushStaged();
+    std::unique_lock<std::shared_timed_mutex> lock(m_dataAddLock);
     std::unique_lock<std::shared_timed_mutex> uniquelock(m_dataDeleteLock);
 
     SizeType newR = GetNumSamples();
@@ -591,12 +747,16 @@ ErrorCode Index<T>::AddIndex(const void* p_data, SizeType p_vectorNum, Dimension
     SizeType begin, end;
     ErrorCode ret;
     {
-        std::lock_guard<std::mutex> lock(m_dataAddLock);
-
-        begin = GetNumSamples();
-        end = begin + p_vectorNum;
-
-        if (begin == 0) {
+        // the first batch builds the index and metadata is kept in row order, both exclusive;
+        // other batches only reserve rows and append side by side
+        std::unique_lock<std::shared_timed_mutex> lock(m_dataAddLock, std::defer_lock);
+        std::shared_lock<std::shared_timed_mutex> sharedLock(m_dataAddLock, std::defer_lock);
+        if (GetNumSamples() == 0 || m_pMetadata != nullptr || p_metadataSet != nullptr)
+            lock.lock();
+        else
+            sharedLock.lock();
+
+        if (GetNumSamples() == 0) {
             if (p_metadataSet != nullptr) {
                 m_pMetadata.reset(new MemMetadataSet(m_iDataBlockSize, m_iDataCapacity, m_iMetaRecordSize));
                 m_pMetadata->AddBatch(*p_metadataSet);
@@ -611,15 +771,11 @@ ErrorCode Index<T>::AddIndex(const void* p_data, SizeType p_vectorNum, Dimension
         if (p_dimension != GetFeatureDim())
             return ErrorCode::DimensionSizeMismatch;
 
-        if (m_pSamples.AddBatch(p_vectorNum, (const T*)p_data) != ErrorCode::Success ||
-            m_pGraph.AddBatch(p_vectorNum) != ErrorCode::Success ||
-            m_deletedID.AddBatch(p_vectorNum) != ErrorCode::Success) {
+        if ((ret = AppendRows(p_data, p_vectorNum, begin)) != ErrorCode::Success) {
             LOG(Helper::LogLevel::LL_Error, "Memory Error: Cannot alloc space for vectors!\n");
-            m_pSamples.SetR(begin);
-            m_pGraph.SetR(begin);
-            m_deletedID.SetR(begin);
-            return ErrorCode::MemoryOverFlow;
+            return ret;
         }
+        end = begin + p_vectorNum;
 
         if (m_pMetadata != nullptr) {
             if (p_metadataSet != nullptr) {
@@ -644,14 +800,16 @@ ErrorCode Index<T>::AddIndex(const void* p_data, SizeType p_vectorNum, Dimension
             COMMON::Utils::Normalize((T*)m_pSamples[i], GetFeatureDim(), base);
         }
     }
+    if (UseQuantizedSamples())
+        EncodeQuantizedSamples(begin, end);
 
     if (end - m_pTrees.sizePerTree() >= m_addCountForRebuild && m_threadPool.jobsize() == 0) {
         m_threadPool.add(new RebuildJob(&m_pSamples, &m_pTrees, &m_pGraph, m_iDistCalcMethod));
     }
 
-    for (SizeType node = begin; node < end; node++) {
-        m_pGraph.RefineNode<T>(this, node, true, true, m_pGraph.m_iAddCEF);
-    }
+    std::vector<SizeType> nodes(end - begin);
+    for (SizeType node = begin; node < end; node++) nodes[node - begin] = node;
+    m_pGraph.RefineNodes<T>(this, nodes.data(), end - begin, true, m_pGraph.m_iAddCEF);
     return ErrorCode::Success;
 }
 
@@ -662,12 +820,9 @@ ErrorCode Index<T>::AddIndexId(const void* p_data, SizeType p_vectorNum, Dimensi
 
     SizeType begin, end;
     {
-        std::lock_guard<std::mutex> lock(m_dataAddLock);
+        std::shared_lock<std::shared_timed_mutex> lock(m_dataAddLock);
 
-        begin = GetNumSamples();
-        end = begin + p_vectorNum;
-
-        if (begin == 0) {
+        if (GetNumSamples() == 0) {
             LOG(Helper::LogLevel::LL_Error, "Index Error: No vector in Index!\n");
             return ErrorCode::EmptyIndex;
         }
@@ -675,15 +830,14 @@ ErrorCode Index<T>::AddIndexId(const void* p_data, SizeType p_vectorNum, Dimensi
         if (p_dimension != GetFeatureDim())
             return ErrorCode::DimensionSizeMismatch;
 
-        if (m_pSamples.AddBatch(p_vectorNum, (const T*)p_data) != ErrorCode::Success ||
-            m_pGraph.AddBatch(p_vectorNum) != ErrorCode::Success ||
-            m_deletedID.AddBatch(p_vectorNum) != ErrorCode::Success) {
+        ErrorCode ret = AppendRows(p_data, p_vectorNum, begin);
+        if (ret != ErrorCode::Success) {
             LOG(Helper::LogLevel::LL_Error, "Memory Error: Cannot alloc space for vectors!\n");
-            m_pSamples.SetR(begin);
-            m_pGraph.SetR(begin);
-            m_deletedID.SetR(begin);
-            return ErrorCode::MemoryOverFlow;
+            return ret;
         }
+        end = begin + p_vectorNum;
+        if (UseQuantizedSamples())
+            EncodeQuantizedSamples(begin, end);
     }
     beginHead = begin;
     endHead = end;
@@ -696,12 +850,70 @@ ErrorCode Index<T>::AddIndexIdx(SizeType begin, SizeType end) {
     //     m_threadPool.add(new RebuildJob(&m_pSamples, &m_pTrees, &m_pGraph, m_iDistCalcMethod));
     // }
 
-    for (SizeType node = begin; node < end; node++) {
-        m_pGraph.RefineNode<T>(this, node, true, true, m_pGraph.m_iAddCEF);
+    std::vector<SizeType> nodes(end - begin);
+    for (SizeType node = begin; node < end; node++) nodes[node - begin] = node;
+    m_pGraph.RefineNodes<T>(this, nodes.data(), end - begin, true, m_pGraph.m_iAddCEF);
+    return ErrorCode::Success;
+}
+
+template <typename T>
+ErrorCode Index<T>::StageIndexIdx(SizeType begin, SizeType end) {
+    if (begin >= end)
+        return ErrorCode::Success;
+    {
+        std::unique_lock<std::shared_timed_mutex> lock(m_stagedLock);
+        for (SizeType node = begin; node < end; node++) m_stagedNodes.push_back(node);
+        m_stagedCount = (SizeType)m_stagedNodes.size();
     }
+    if (!m_linkJobQueued.exchange(true))
+        m_threadPool.add(new LinkStagedJob(this));
     return ErrorCode::Success;
 }
 
+template <typename T>
+void Index<T>::LinkStaged(IAbortOperation* p_abort) {
+    std::lock_guard<std::mutex> linkLock(m_stagedLinkLock);
+    while (true) {
+        std::vector<SizeType> batch;
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(m_stagedLock);
+            batch = m_stagedNodes;
+        }
+        if (batch.empty()) {
+            m_linkJobQueued = false;
+            // a node staged between the copy and the flag reset would otherwise wait for the next stage call
+            std::shared_lock<std::shared_timed_mutex> lock(m_stagedLock);
+            if (m_stagedNodes.empty() || m_linkJobQueued.exchange(true))
+                return;
+            continue;
+        }
+        // the batch stays visible to searches until it is linked, so nothing is missed in between
+        size_t linked = 0;
+        while (linked < batch.size()) {
+            if (p_abort != nullptr && p_abort->ShouldAbort())
+                break;
+            size_t count = (std::min)(batch.size() - linked, (size_t)COMMON::RelativeNeighborhoodGraph::kLinkChunk);
+            m_pGraph.RefineNodes<T>(this, batch.data() + linked, (SizeType)count, true, m_pGraph.m_iAddCEF);
+            linked += count;
+        }
+        {
+            std::unique_lock<std::shared_timed_mutex> lock(m_stagedLock);
+            m_stagedNodes.erase(m_stagedNodes.begin(), m_stagedNodes.begin() + linked);
+            m_stagedCount = (SizeType)m_stagedNodes.size();
+        }
+        if (linked < batch.size()) {
+            m_linkJobQueued = false;
+            return;
+        }
+    }
+}
+
+template <typename T>
+void Index<T>::FlushStaged() {
+    if (m_stagedCount.load() > 0)
+        LinkStaged(nullptr);
+}
+
 template <typename T>
 ErrorCode Index<T>::MergeIndex(Index<T>* p_addindex, int p_threadnum, IAbortOperation* p_abort) {
     SPTAG::ErrorCode ret = SPTAG::ErrorCode::Success;
@@ -768,8 +980,8 @@ Index<T>::SetParameter(const char* p_param, const char* p_value, const char* p_s
 #undef DefineBKTParameter
 
     if (SPTAG::Helper::StrUtils::StrEqualIgnoreCase(p_param, "DistCalcMethod")) {
-        m_fComputeDistance = COMMON::DistanceCalcSelector<T>(m_iDistCalcMethod);
-        m_iBaseSquare = (m_iDistCalcMethod == DistCalcMethod::Cosine) ? COMMON::Utils::GetBase<T>() * COMMON::Utils::GetBase<T>() : 1;
+        BindDistanceKernel();
+        m_iBaseSquare = (m_iDistCalcMethod != DistCalcMethod::L2) ? COMMON::Utils::GetBase<T>() * COMMON::Utils::GetBase<T>() : 1;
     }
     return ErrorCode::Success;
 }
@@ -1197,73 +1409,110 @@ void Index<T>::SortSelections(std::vector<Edge>* selections) {
     std::sort(selections->begin(), selections->end(), edgeComparer);
 }
 
+// Vectors are taken in windows; each window is routed down the first tree and searched in leaf
+// order, so the blocks a thread takes hold neighbouring vectors that walk the same heads and the
+// head vectors stay in cache. Head-to-head distances of the RNG check are memoised per block in a
+// direct-mapped table, since the vectors of a block mostly share their candidate heads.
 template <typename T>
 void Index<T>::ApproximateRNG(std::shared_ptr<VectorSet>& fullVectors, std::unordered_set<SizeType>& exceptIDS, int candidateNum, Edge* selections, int replicaCount, int numThreads, int numTrees, int leafSize, float RNGFactor, int numGPUs) {
-    std::vector<std::thread> threads;
-    threads.reserve(numThreads);
-
-    std::atomic_int nextFullID(0);
+    const SizeType windowSize = 1 << 18;
+    const SizeType blockSize = 64;
+    const int memoBits = 12;
+    const SizeType fullCount = fullVectors->Count();
+
+    // (leaf, full vector ID), excepted vectors get leaf -1
+    std::vector<std::pair<SizeType, SizeType>> order;
+    order.reserve((std::min)(windowSize, fullCount));
     std::atomic_size_t rngFailedCountTotal(0);
+    std::atomic_size_t memoHitTotal(0);
+
+    for (SizeType windowStart = 0; windowStart < fullCount; windowStart += windowSize) {
+        SizeType windowEnd = (std::min)(fullCount, windowStart + windowSize);
+        order.resize(windowEnd - windowStart);
+        {
+            std::shared_lock<std::shared_timed_mutex> lock(*(m_pTrees.m_lock));
+            Helper::TaskScheduler::Instance().ParallelFor<SizeType>(windowStart, windowEnd, 1024, [&](SizeType fullID) {
+                SizeType leaf = -1;
+                if (exceptIDS.count(fullID) == 0)
+                    leaf = m_pTrees.NearestLeaf(m_pSamples, m_fComputeDistance, (const T*)fullVectors->GetVector(fullID));
+                order[fullID - windowStart] = std::make_pair(leaf, fullID);
+            });
+        }
+        std::sort(order.begin(), order.end());
+        SizeType first = (SizeType)(std::lower_bound(order.begin(), order.end(), std::make_pair((SizeType)0, (SizeType)-1)) - order.begin());
 
-    for (int tid = 0; tid < numThreads; ++tid) {
-        threads.emplace_back([&, tid]() {
+        std::atomic<SizeType> nextBlock(first);
+        Helper::TaskScheduler::Instance().Run(numThreads, [&](int) {
             QueryResult resultSet(NULL, candidateNum, false);
-
+            std::vector<std::uint64_t> memoKeys((size_t)1 << memoBits);
+            std::vector<float> memoDists((size_t)1 << memoBits);
             size_t rngFailedCount = 0;
+            size_t memoHit = 0;
 
             while (true) {
-                int fullID = nextFullID.fetch_add(1);
-                if (fullID >= fullVectors->Count()) {
+                SizeType blockStart = nextBlock.fetch_add(blockSize);
+                if (blockStart >= (SizeType)order.size())
                     break;
-                }
-
-                if (exceptIDS.count(fullID) > 0) {
-                    continue;
-                }
+                SizeType blockEnd = (std::min)((SizeType)order.size(), blockStart + blockSize);
+                std::fill(memoKeys.begin(), memoKeys.end(), (std::uint64_t)-1);
 
-                resultSet.SetTarget(fullVectors->GetVector(fullID));
-                resultSet.Reset();
+                for (SizeType pos = blockStart; pos < blockEnd; pos++) {
+                    SizeType fullID = order[pos].second;
+                    resultSet.SetTarget(fullVectors->GetVector(fullID));
+                    resultSet.Reset();
 
-                SearchIndex(resultSet);
+                    SearchIndex(resultSet);
 
-                size_t selectionOffset = static_cast<size_t>(fullID) * replicaCount;
+                    size_t selectionOffset = static_cast<size_t>(fullID) * replicaCount;
 
-                BasicResult* queryResults = resultSet.GetResults();
-                int currReplicaCount = 0;
-                for (int i = 0; i < candidateNum && currReplicaCount < replicaCount; ++i) {
-                    if (queryResults[i].VID == -1) {
-                        break;
-                    }
+                    BasicResult* queryResults = resultSet.GetResults();
+                    int currReplicaCount = 0;
+                    for (int i = 0; i < candidateNum && currReplicaCount < replicaCount; ++i) {
+                        SizeType candidate = queryResults[i].VID;
+                        if (candidate == -1) {
+                            break;
+                        }
 
-                    // RNG Check.
-                    bool rngAccpeted = true;
-                    for (int j = 0; j < currReplicaCount; ++j) {
-                        float nnDist = ComputeDistance(GetSample(queryResults[i].VID), GetSample(selections[selectionOffset + j].node));
+                        // RNG Check, head pairs already seen in this block are not computed again.
+                        bool rngAccpeted = true;
+                        for (int j = 0; j < currReplicaCount; ++j) {
+                            SizeType head = selections[selectionOffset + j].node;
+                            std::uint64_t key = candidate < head ? ((std::uint64_t)candidate << 32) | (std::uint32_t)head : ((std::uint64_t)head << 32) | (std::uint32_t)candidate;
+                            size_t slot = (size_t)((key * 0x9E3779B97F4A7C15ULL) >> (64 - memoBits));
+                            float nnDist;
+                            if (memoKeys[slot] == key) {
+                                nnDist = memoDists[slot];
+                                ++memoHit;
+                            } else {
+                                nnDist = ComputeDistance(GetSample(candidate), GetSample(head));
+                                memoKeys[slot] = key;
+                                memoDists[slot] = nnDist;
+                            }
+
+                            if (RNGFactor * nnDist <= queryResults[i].Dist) {
+                                rngAccpeted = false;
+                                break;
+                            }
+                        }
 
-                        if (RNGFactor * nnDist <= queryResults[i].Dist) {
-                            rngAccpeted = false;
-                            break;
+                        if (!rngAccpeted) {
+                            ++rngFailedCount;
+                            continue;
                         }
-                    }
 
-                    if (!rngAccpeted) {
-                        ++rngFailedCount;
-                        continue;
+                        selections[selectionOffset + currReplicaCount].node = candidate;
+                        selections[selectionOffset + currReplicaCount].distance = queryResults[i].Dist;
+                        ++currReplicaCount;
                     }
-
-                    selections[selectionOffset + currReplicaCount].node = queryResults[i].VID;
-                    selections[selectionOffset + currReplicaCount].distance = queryResults[i].Dist;
-                    ++currReplicaCount;
                 }
             }
             rngFailedCountTotal += rngFailedCount;
+            memoHitTotal += memoHit;
         });
+        if (windowEnd < fullCount && (windowStart / windowSize) % 16 == 15)
+            LOG(Helper::LogLevel::LL_Info, "Searching replicas: %d of %d vectors\n", windowEnd, fullCount);
     }
-
-    for (int tid = 0; tid < numThreads; ++tid) {
-        threads[tid].join();
-    }
-    LOG(Helper::LogLevel::LL_Info, "Searching replicas ended. RNG failed count: %llu\n", static_cast<uint64_t>(rngFailedCountTotal.load()));
+    LOG(Helper::LogLevel::LL_Info, "Searching replicas ended. RNG failed count: %llu, memoised head distances: %llu\n", static_cast<uint64_t>(rngFailedCountTotal.load()), static_cast<uint64_t>(memoHitTotal.load()));
 }
 #endif
 }  // namespace SPTAG::BKT
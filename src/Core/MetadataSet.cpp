@@ -3,8 +3,12 @@
 
 #include "Core/MetadataSet.h"
 
+#include <fcntl.h>
 #include <string.h>
 #include <shared_mutex>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "Helper/LockFree.h"
 typedef typename SPTAG::Helper::LockFree::LockFreeVector<std::uint64_t> MetadataOffsets;
@@ -65,6 +69,17 @@ void SPTAG::MetadataSet::AddBatch(SPTAG::MetadataSet& data) {
     }
 }
 
+SPTAG::ByteArray
+SPTAG::MetadataSet::GetMetadataView(SPTAG::SizeType p_vectorID) const {
+    return GetMetadataCopy(p_vectorID);
+}
+
+void SPTAG::MetadataSet::GetMetadataViews(SPTAG::BasicResult* p_results, int p_count) const {
+    for (int i = 0; i < p_count; i++) {
+        p_results[i].Meta = (p_results[i].VID < 0) ? SPTAG::ByteArray::c_empty : GetMetadataView(p_results[i].VID);
+    }
+}
+
 SPTAG::MetadataSet::MetadataSet() {
 }
 
@@ -322,6 +337,16 @@ SPTAG::MemMetadataSet::GetMetadataCopy(SPTAG::SizeType p_vectorID) const {
     }
 }
 
+SPTAG::ByteArray
+SPTAG::MemMetadataSet::GetMetadataView(SPTAG::SizeType p_vectorID) const {
+    if (p_vectorID < m_count) {
+        auto& m_offsets = *static_cast<MetadataOffsets*>(m_pOffsets.get());
+        std::uint64_t startoff = m_offsets[p_vectorID];
+        return SPTAG::ByteArray(m_metadataHolder.Data() + startoff, m_offsets[p_vectorID + 1] - startoff, false);
+    }
+    return GetMetadataCopy(p_vectorID);
+}
+
 SPTAG::SizeType
 SPTAG::MemMetadataSet::Count() const {
     auto& m_offsets = *static_cast<MetadataOffsets*>(m_pOffsets.get());
@@ -387,3 +412,177 @@ SPTAG::MemMetadataSet::SaveMetadata(const std::string& p_metaFile, const std::st
     std::rename((p_metaindexFile + "_tmp").c_str(), p_metaindexFile.c_str());
     return SPTAG::ErrorCode::Success;
 }
+
+namespace {
+const std::uint8_t* MapReadOnly(const std::string& p_file, size_t& p_length) {
+    p_length = 0;
+    int fd = open(p_file.c_str(), O_RDONLY);
+    if (fd < 0)
+        return nullptr;
+    struct stat info;
+    if (fstat(fd, &info) != 0) {
+        close(fd);
+        return nullptr;
+    }
+    p_length = (size_t)info.st_size;
+    // an empty file maps to nothing, its records all have length 0
+    if (p_length == 0) {
+        close(fd);
+        return (const std::uint8_t*)"";
+    }
+    void* base = mmap(nullptr, p_length, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+        p_length = 0;
+        return nullptr;
+    }
+    return (const std::uint8_t*)base;
+}
+}  // namespace
+
+SPTAG::MappedMetadataSet::MappedMetadataSet(const std::string& p_metafile, const std::string& p_metaindexfile) {
+    m_index = MapReadOnly(p_metaindexfile, m_indexLength);
+    m_data = MapReadOnly(p_metafile, m_dataLength);
+    if (m_index == nullptr || m_data == nullptr) {
+        SPTAG::LOG(SPTAG::Helper::LogLevel::LL_Error, "ERROR: Cannot map meta files %s or %s!\n", p_metafile.c_str(), p_metaindexfile.c_str());
+        Unmap();
+        throw std::runtime_error("Cannot map meta files");
+    }
+    if (m_indexLength >= sizeof(m_count))
+        memcpy(&m_count, m_index, sizeof(m_count));
+    m_offsets = m_index + sizeof(m_count);
+    if (m_indexLength < sizeof(m_count) || m_count < 0 || sizeof(m_count) + sizeof(std::uint64_t) * ((size_t)m_count + 1) > m_indexLength || Offset(m_count) > m_dataLength) {
+        SPTAG::LOG(SPTAG::Helper::LogLevel::LL_Error, "ERROR: %s is not a metadata index of %s!\n", p_metaindexfile.c_str(), p_metafile.c_str());
+        Unmap();
+        throw std::runtime_error("Cannot read meta files");
+    }
+    // lookups land anywhere, readahead around them would only evict other records
+    if (m_dataLength > 0)
+        madvise((void*)m_data, m_dataLength, MADV_RANDOM);
+    m_lock.reset(new std::shared_timed_mutex, std::default_delete<std::shared_timed_mutex>());
+    SPTAG::LOG(SPTAG::Helper::LogLevel::LL_Info, "Map MetaIndex(%d) Meta(%llu)\n", m_count, Offset(m_count));
+}
+
+SPTAG::MappedMetadataSet::~MappedMetadataSet() {
+    Unmap();
+}
+
+void SPTAG::MappedMetadataSet::Unmap() {
+    if (m_index != nullptr && m_indexLength > 0)
+        munmap((void*)m_index, m_indexLength);
+    if (m_data != nullptr && m_dataLength > 0)
+        munmap((void*)m_data, m_dataLength);
+    m_index = m_data = nullptr;
+    m_indexLength = m_dataLength = 0;
+}
+
+SPTAG::ByteArray
+SPTAG::MappedMetadataSet::GetMetadata(SPTAG::SizeType p_vectorID) const {
+    return GetMetadataView(p_vectorID);
+}
+
+SPTAG::ByteArray
+SPTAG::MappedMetadataSet::GetMetadataCopy(SPTAG::SizeType p_vectorID) const {
+    SPTAG::ByteArray view = GetMetadataView(p_vectorID);
+    SPTAG::ByteArray b = SPTAG::ByteArray::Alloc(view.Length());
+    if (view.Length() > 0)
+        memcpy(b.Data(), view.Data(), view.Length());
+    return b;
+}
+
+SPTAG::ByteArray
+SPTAG::MappedMetadataSet::GetMetadataView(SPTAG::SizeType p_vectorID) const {
+    if (p_vectorID < m_count) {
+        std::uint64_t startoff = Offset(p_vectorID);
+        return SPTAG::ByteArray(const_cast<std::uint8_t*>(m_data) + startoff, Offset(p_vectorID + 1) - startoff, false);
+    }
+    std::shared_lock<std::shared_timed_mutex> lock(*static_cast<std::shared_timed_mutex*>(m_lock.get()));
+    if ((size_t)(p_vectorID - m_count) >= m_newdata.size())
+        return SPTAG::ByteArray::c_empty;
+    return m_newdata[p_vectorID - m_count];
+}
+
+void SPTAG::MappedMetadataSet::GetMetadataViews(SPTAG::BasicResult* p_results, int p_count) const {
+    // touch the offsets and then the records of the whole batch before reading any of them, so
+    // their misses overlap instead of being paid one after the other
+    for (int i = 0; i < p_count; i++) {
+        if (p_results[i].VID >= 0 && p_results[i].VID < m_count)
+            __builtin_prefetch(m_offsets + sizeof(std::uint64_t) * p_results[i].VID);
+    }
+    for (int i = 0; i < p_count; i++) {
+        if (p_results[i].VID >= 0 && p_results[i].VID < m_count)
+            __builtin_prefetch(m_data + Offset(p_results[i].VID));
+    }
+    for (int i = 0; i < p_count; i++) {
+        p_results[i].Meta = (p_results[i].VID < 0) ? SPTAG::ByteArray::c_empty : GetMetadataView(p_results[i].VID);
+    }
+}
+
+SPTAG::SizeType
+SPTAG::MappedMetadataSet::Count() const {
+    std::shared_lock<std::shared_timed_mutex> lock(*static_cast<std::shared_timed_mutex*>(m_lock.get()));
+    return m_count + static_cast<SPTAG::SizeType>(m_newdata.size());
+}
+
+bool SPTAG::MappedMetadataSet::Available() const {
+    return m_index != nullptr && Count() > 0;
+}
+
+std::pair<std::uint64_t, std::uint64_t>
+SPTAG::MappedMetadataSet::BufferSize() const {
+    std::shared_lock<std::shared_timed_mutex> lock(*static_cast<std::shared_timed_mutex*>(m_lock.get()));
+    std::uint64_t count = (std::uint64_t)m_count + m_newdata.size();
+    return std::make_pair(Offset(m_count) + m_newBytes, sizeof(SPTAG::SizeType) + sizeof(std::uint64_t) * (count + 1));
+}
+
+void SPTAG::MappedMetadataSet::Add(const SPTAG::ByteArray& data) {
+    SPTAG::ByteArray b = SPTAG::ByteArray::Alloc(data.Length());
+    if (data.Length() > 0)
+        memcpy(b.Data(), data.Data(), data.Length());
+    std::unique_lock<std::shared_timed_mutex> lock(*static_cast<std::shared_timed_mutex*>(m_lock.get()));
+    m_newdata.push_back(std::move(b));
+    m_newBytes += data.Length();
+}
+
+SPTAG::ErrorCode
+SPTAG::MappedMetadataSet::SaveMetadata(std::shared_ptr<SPTAG::Helper::DiskIO> p_metaOut, std::shared_ptr<SPTAG::Helper::DiskIO> p_metaIndexOut) {
+    std::shared_lock<std::shared_timed_mutex> lock(*static_cast<std::shared_timed_mutex*>(m_lock.get()));
+    SPTAG::SizeType count = m_count + static_cast<SPTAG::SizeType>(m_newdata.size());
+    IOBINARY(p_metaIndexOut, WriteBinary, sizeof(SPTAG::SizeType), (const char*)&count);
+    IOBINARY(p_metaIndexOut, WriteBinary, sizeof(std::uint64_t) * ((size_t)m_count + 1), (const char*)m_offsets);
+    std::uint64_t offset = Offset(m_count);
+    for (auto& meta : m_newdata) {
+        offset += meta.Length();
+        IOBINARY(p_metaIndexOut, WriteBinary, sizeof(std::uint64_t), (const char*)&offset);
+    }
+
+    if (Offset(m_count) > 0)
+        IOBINARY(p_metaOut, WriteBinary, Offset(m_count), (const char*)m_data);
+    for (auto& meta : m_newdata) {
+        if (meta.Length() > 0)
+            IOBINARY(p_metaOut, WriteBinary, meta.Length(), (const char*)meta.Data());
+    }
+    SPTAG::LOG(SPTAG::Helper::LogLevel::LL_Info, "Save MetaIndex(%d) Meta(%llu)\n", count, offset);
+    return SPTAG::ErrorCode::Success;
+}
+
+SPTAG::ErrorCode
+SPTAG::MappedMetadataSet::SaveMetadata(const std::string& p_metaFile, const std::string& p_metaindexFile) {
+    {
+        std::shared_ptr<SPTAG::Helper::DiskIO> metaOut = SPTAG::f_createIO(), metaIndexOut = SPTAG::f_createIO();
+        if (metaOut == nullptr || metaIndexOut == nullptr || !metaOut->Initialize((p_metaFile + "_tmp").c_str(), std::ios::binary | std::ios::out) || !metaIndexOut->Initialize((p_metaindexFile + "_tmp").c_str(), std::ios::binary | std::ios::out))
+            return SPTAG::ErrorCode::FailedCreateFile;
+
+        SPTAG::ErrorCode ret = SaveMetadata(metaOut, metaIndexOut);
+        if (ret != SPTAG::ErrorCode::Success)
+            return ret;
+    }
+    // the mapping keeps the replaced files alive, views handed out stay valid
+    if (fileexists(p_metaFile.c_str()))
+        std::remove(p_metaFile.c_str());
+    if (fileexists(p_metaindexFile.c_str()))
+        std::remove(p_metaindexFile.c_str());
+    std::rename((p_metaFile + "_tmp").c_str(), p_metaFile.c_str());
+    std::rename((p_metaindexFile + "_tmp").c_str(), p_metaindexFile.c_str());
+    return SPTAG::ErrorCode::Success;
+}
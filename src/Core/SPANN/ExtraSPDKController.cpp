@@ -2,13 +2,79 @@
 // Licensed under the MIT License.
 
 #include "Core/SPANN/ExtraSPDKController.h"
+#include "Core/SPANN/Tracepoints.h"
+#include "Helper/CoreMap.h"
+#include <algorithm>
 #include <iostream>
+#include <cstring>
+#include <immintrin.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
 
 namespace SPTAG::SPANN {
 
 thread_local struct SPDKIO::BlockController::IoContext SPDKIO::BlockController::m_currIoContext;
-int SPDKIO::BlockController::m_ssdInflight = 0;
-int SPDKIO::BlockController::m_ioCompleteCount = 0;
+thread_local std::unordered_map<const char*, std::pair<PostingCache::Entry, int>> SPDKIO::m_pinnedPostings;
+thread_local std::vector<SizeType> SPDKIO::m_readKeys;
+thread_local std::vector<AddressType*> SPDKIO::m_readBlocks;
+thread_local std::vector<std::uint64_t> SPDKIO::m_readGenerations;
+
+// "a,b,c" into one limit per I/O class, missing or empty entries keep their default
+static void ParseClassLimits(const char* p_list, int* p_limits) {
+    if (p_list == nullptr)
+        return;
+    const char* pos = p_list;
+    for (int c = 0; c < kIOClasses && *pos != '\0'; c++) {
+        char* end = nullptr;
+        long value = strtol(pos, &end, 10);
+        if (end != pos)
+            p_limits[c] = (int)std::max(0L, value);
+        pos = strchr(end, ',');
+        if (pos == nullptr)
+            break;
+        pos++;
+    }
+}
+
+static inline void FutexWait(std::atomic<std::uint32_t>* addr, std::uint32_t expected, const std::chrono::microseconds& timeout) {
+    struct timespec ts;
+    ts.tv_sec = timeout.count() / 1000000;
+    ts.tv_nsec = (timeout.count() % 1000000) * 1000;
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(addr), FUTEX_WAIT_PRIVATE, expected, &ts, NULL, 0);
+}
+
+static inline void FutexWake(std::atomic<std::uint32_t>* addr) {
+    syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(addr), FUTEX_WAKE_PRIVATE, 1, NULL, NULL, 0);
+}
+
+void SPDKIO::BlockController::NotifyCompletion(IoContext* p_context) {
+    p_context->completion_seq.fetch_add(1, std::memory_order_seq_cst);
+    if (p_context->sleeping.load(std::memory_order_seq_cst)) {
+        FutexWake(&p_context->completion_seq);
+    }
+}
+
+void SPDKIO::BlockController::WaitForCompletion(int& p_idleRounds, const std::chrono::microseconds& p_remain) {
+    StageSpan span(Stage::IOWait);
+    if (m_waitMode == WaitMode::Spin || ++p_idleRounds < m_waitSpinRounds) {
+        _mm_pause();
+        return;
+    }
+    if (m_waitMode == WaitMode::Yield) {
+        std::this_thread::yield();
+        return;
+    }
+    // Publish that we sleep before the last check, so a completion either shows up in the queue
+    // or changes completion_seq and makes the futex return at once
+    IoContext& ctx = m_currIoContext;
+    ctx.sleeping.store(true, std::memory_order_seq_cst);
+    std::uint32_t seq = ctx.completion_seq.load(std::memory_order_seq_cst);
+    if (ctx.completed_sub_io_requests.empty() && p_remain.count() > 0) {
+        FutexWait(&ctx.completion_seq, seq, std::min(p_remain, kSsdSpdkMaxBlockWait));
+    }
+    ctx.sleeping.store(false, std::memory_order_relaxed);
+}
 
 void SPDKIO::BlockController::SpdkBdevEventCallback(enum spdk_bdev_event_type type, struct spdk_bdev* bdev, void* event_ctx) {
     fprintf(stderr, "SpdkBdevEventCallback: supported bdev event type %d\n", type);
@@ -17,11 +83,38 @@ void SPDKIO::BlockController::SpdkBdevEventCallback(enum spdk_bdev_event_type ty
 void SPDKIO::BlockController::SpdkBdevIoCallback(struct spdk_bdev_io* bdev_io, bool success, void* cb_arg) {
     SubIoRequest* currSubIo = (SubIoRequest*)cb_arg;
     if (success) {
-        m_ioCompleteCount++;
+        Reactor* reactor = currSubIo->reactor;
+        IoContext* context = currSubIo->context;
+        BlockController* ctrl = reactor->ctrl;
+        Device& device = *ctrl->m_devices[ctrl->DeviceOf(currSubIo->offset >> PageSizeEx)];
         spdk_bdev_free_io(bdev_io);
-        currSubIo->completed_sub_io_requests->push(currSubIo);
-        m_ssdInflight--;
-        SpdkIoLoop(currSubIo->ctrl);
+        int ioClass = currSubIo->io_class;
+        auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - currSubIo->submit_time);
+        // the head is gone once pushed, keep what its trace record needs
+        std::uint64_t traceCommand = currSubIo->trace_command;
+        std::int32_t tracePosting = currSubIo->trace_posting;
+        AddressType offset = currSubIo->offset;
+        bool isRead = currSubIo->is_read;
+        std::uint64_t pages = 0;
+        // the owner may reuse a sub I/O as soon as it is pushed, so fetch next first
+        while (currSubIo) {
+            SubIoRequest* nextSubIo = currSubIo->next;
+            pages++;
+            currSubIo->completed_sub_io_requests->push(currSubIo);
+            currSubIo = nextSubIo;
+        }
+        SPTAG_PROBE5(io__complete, ctrl->DeviceOf(offset >> PageSizeEx), offset - (device.base << PageSizeEx), pages, isRead, latency.count());
+        if (ctrl->m_trace.Enabled())
+            ctrl->m_trace.Record(IOTraceEvent::Complete, traceCommand, isRead ? IOTraceOp::Read : IOTraceOp::Write, ioClass, ctrl->DeviceOf(offset >> PageSizeEx), offset, (std::uint32_t)pages * PageSize, tracePosting, (std::uint32_t)latency.count());
+        NotifyCompletion(context);
+        reactor->inflight--;
+        reactor->queues.Complete(ioClass);
+        ctrl->m_classStats[ioClass].inflight.fetch_sub(1, std::memory_order_relaxed);
+        ctrl->m_classStats[ioClass].Record(pages, (std::uint64_t)latency.count());
+        reactor->commands.fetch_add(1, std::memory_order_relaxed);
+        reactor->completedPages.fetch_add(pages, std::memory_order_relaxed);
+        device.inflight.fetch_sub(1, std::memory_order_relaxed);
+        device.completedPages.fetch_add(pages, std::memory_order_relaxed);
     } else {
         fprintf(stderr, "SpdkBdevIoCallback: I/O failed %p\n", currSubIo);
         spdk_app_stop(-1);
@@ -30,76 +123,169 @@ void SPDKIO::BlockController::SpdkBdevIoCallback(struct spdk_bdev_io* bdev_io, b
 
 void SPDKIO::BlockController::SpdkStop(void* arg) {
     SPDKIO::BlockController* ctrl = (SPDKIO::BlockController*)arg;
-    // Close I/O channel and bdev
-    spdk_put_io_channel(ctrl->m_ssdSpdkBdevIoChannel);
-    spdk_bdev_close(ctrl->m_ssdSpdkBdevDesc);
+    // All reactors have released their I/O channels, close the bdevs
+    for (auto& device : ctrl->m_devices) {
+        spdk_bdev_close(device->desc);
+        device->desc = nullptr;
+    }
+    ctrl->m_ssdSpdkStopped = true;
     fprintf(stdout, "SPDKIO::BlockController::SpdkStop: finalized\n");
 }
 
-void SPDKIO::BlockController::SpdkIoLoop(void* arg) {
-    SPDKIO::BlockController* ctrl = (SPDKIO::BlockController*)arg;
+bool SPDKIO::BlockController::SpdkSubmit(Reactor* reactor, SubIoRequest* currSubIo) {
+    BlockController* ctrl = reactor->ctrl;
     int rc = 0;
-    SubIoRequest* currSubIo = nullptr;
-    while (!ctrl->m_ssdSpdkThreadExiting) {
-        if (ctrl->m_submittedSubIoRequests.try_pop(currSubIo)) {
-            if (currSubIo->is_read) {
-                rc = spdk_bdev_read(
-                    ctrl->m_ssdSpdkBdevDesc, ctrl->m_ssdSpdkBdevIoChannel,
-                    currSubIo->dma_buff, currSubIo->offset, PageSize, SpdkBdevIoCallback, currSubIo);
-            } else {
-                rc = spdk_bdev_write(
-                    ctrl->m_ssdSpdkBdevDesc, ctrl->m_ssdSpdkBdevIoChannel,
-                    currSubIo->dma_buff, currSubIo->offset, PageSize, SpdkBdevIoCallback, currSubIo);
-            }
-            if (rc && rc != -ENOMEM) {
-                fprintf(stderr, "SPDKIO::BlockController::SpdkStart %s failed: %d, shutting down, offset: %ld\n", currSubIo->is_read ? "spdk_bdev_read" : "spdk_bdev_write", rc, currSubIo->offset);
-                spdk_app_stop(-1);
-                break;
-            } else {
-                m_ssdInflight++;
+    currSubIo->reactor = reactor;
+    // runs never cross devices, the head names the device of the whole command
+    int deviceId = ctrl->DeviceOf(currSubIo->offset >> PageSizeEx);
+    Device& device = *ctrl->m_devices[deviceId];
+    struct spdk_io_channel* channel = reactor->channels[deviceId];
+    uint64_t offset = (uint64_t)(currSubIo->offset - (device.base << PageSizeEx));
+    int iovcnt = 1;
+    if (currSubIo->next) {
+        iovcnt = 0;
+        for (SubIoRequest* sub = currSubIo; sub; sub = sub->next) {
+            currSubIo->iovs[iovcnt].iov_base = sub->direct ? sub->app_buff : sub->dma_buff;
+            currSubIo->iovs[iovcnt].iov_len = PageSize;
+            iovcnt++;
+        }
+        if (currSubIo->is_read) {
+            rc = spdk_bdev_readv(
+                device.desc, channel,
+                currSubIo->iovs.data(), iovcnt, offset, (uint64_t)iovcnt * PageSize, SpdkBdevIoCallback, currSubIo);
+        } else {
+            rc = spdk_bdev_writev(
+                device.desc, channel,
+                currSubIo->iovs.data(), iovcnt, offset, (uint64_t)iovcnt * PageSize, SpdkBdevIoCallback, currSubIo);
+        }
+    } else if (currSubIo->is_read) {
+        rc = spdk_bdev_read(
+            device.desc, channel,
+            currSubIo->direct ? currSubIo->app_buff : currSubIo->dma_buff, offset, PageSize, SpdkBdevIoCallback, currSubIo);
+    } else {
+        rc = spdk_bdev_write(
+            device.desc, channel,
+            currSubIo->direct ? currSubIo->app_buff : currSubIo->dma_buff, offset, PageSize, SpdkBdevIoCallback, currSubIo);
+    }
+    if (rc == -ENOMEM) {
+        return false;
+    }
+    if (rc) {
+        fprintf(stderr, "SPDKIO::BlockController::SpdkSubmit %s failed on %s: %d, shutting down, offset: %lu\n", currSubIo->is_read ? "spdk_bdev_read" : "spdk_bdev_write", device.name.c_str(), rc, offset);
+        spdk_app_stop(-1);
+        return true;
+    }
+    SPTAG_PROBE5(io__submit, deviceId, offset, iovcnt, currSubIo->is_read, currSubIo->io_class);
+    reactor->inflight++;
+    device.inflight.fetch_add(1, std::memory_order_relaxed);
+    ctrl->m_classStats[currSubIo->io_class].inflight.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+int SPDKIO::BlockController::SpdkReactorPoll(void* arg) {
+    Reactor* reactor = (Reactor*)arg;
+    BlockController* ctrl = reactor->ctrl;
+    int taken = 0;
+
+    // Sort what the client threads handed in by class, then let the classes onto the device in
+    // priority order. A run refused for lack of spdk_bdev_io stays first in its queue
+    {
+        std::unique_lock<std::mutex> lock(reactor->ringsMutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            SubIoRequest* currSubIo = nullptr;
+            for (SubmissionRing* ring : reactor->rings) {
+                while (ring->TryPop(currSubIo)) {
+                    reactor->queues.Push(currSubIo, currSubIo->io_class);
+                    taken++;
+                }
             }
-        } else if (m_ssdInflight) {
-            break;
         }
     }
-    if (ctrl->m_ssdSpdkThreadExiting) {
-        SpdkStop(ctrl);
+    int submitted = reactor->queues.Dispatch([reactor](SubIoRequest* p_subIo) { return SpdkSubmit(reactor, p_subIo); });
+
+    if (ctrl->m_ssdSpdkThreadExiting && reactor->inflight == 0) {
+        SpdkReactorStop(reactor);
+        return SPDK_POLLER_BUSY;
+    }
+    return taken || submitted ? SPDK_POLLER_BUSY : SPDK_POLLER_IDLE;
+}
+
+void SPDKIO::BlockController::SpdkReactorStop(Reactor* reactor) {
+    BlockController* ctrl = reactor->ctrl;
+    spdk_poller_unregister(&reactor->poller);
+    for (auto& channel : reactor->channels) {
+        spdk_put_io_channel(channel);
+    }
+    reactor->channels.clear();
+    spdk_thread_exit(spdk_get_thread());
+    if (++ctrl->m_exitedReactors == ctrl->m_ssdSpdkNumReactors) {
+        spdk_thread_send_msg(ctrl->m_ssdSpdkAppThread, SpdkStop, ctrl);
+    }
+}
+
+void SPDKIO::BlockController::SpdkReactorStart(void* arg) {
+    Reactor* reactor = (Reactor*)arg;
+    BlockController* ctrl = reactor->ctrl;
+
+    // Open one I/O channel per device, channels are per SPDK thread
+    for (auto& device : ctrl->m_devices) {
+        struct spdk_io_channel* channel = spdk_bdev_get_io_channel(device->desc);
+        if (channel == NULL) {
+            fprintf(stderr, "SPDKIO::BlockController::SpdkReactorStart: spdk_bdev_get_io_channel failed for %s on reactor %d\n", device->name.c_str(), reactor->id);
+            ctrl->m_ssdSpdkThreadStartFailed = true;
+            spdk_app_stop(-1);
+            return;
+        }
+        reactor->channels.push_back(channel);
+    }
+    reactor->poller = spdk_poller_register(SpdkReactorPoll, reactor, 0);
+    if (++ctrl->m_readyReactors == ctrl->m_ssdSpdkNumReactors) {
+        ctrl->m_ssdSpdkThreadReady = true;
     }
 }
 
 void SPDKIO::BlockController::SpdkStart(void* arg) {
     SPDKIO::BlockController* ctrl = (SPDKIO::BlockController*)arg;
 
-    fprintf(stdout, "SPDKIO::BlockController::SpdkStart: using bdev %s\n", ctrl->m_ssdSpdkBdevName);
+    fprintf(stdout, "SPDKIO::BlockController::SpdkStart: using %zu bdevs with %d reactors\n", ctrl->m_devices.size(), ctrl->m_ssdSpdkNumReactors);
 
     int rc = 0;
-    ctrl->m_ssdSpdkBdev = NULL;
-    ctrl->m_ssdSpdkBdevDesc = NULL;
-
-    // Open bdev
-    rc = spdk_bdev_open_ext(ctrl->m_ssdSpdkBdevName, true, SpdkBdevEventCallback, NULL, &ctrl->m_ssdSpdkBdevDesc);
-    if (rc) {
-        fprintf(stderr, "SPDKIO::BlockController::SpdkStart: spdk_bdev_open_ext failed, %d\n", rc);
-        ctrl->m_ssdSpdkThreadStartFailed = true;
-        spdk_app_stop(-1);
-        return;
+    ctrl->m_ssdSpdkAppThread = spdk_get_thread();
+
+    // Open the bdevs
+    for (auto& device : ctrl->m_devices) {
+        rc = spdk_bdev_open_ext(device->name.c_str(), true, SpdkBdevEventCallback, NULL, &device->desc);
+        if (rc) {
+            fprintf(stderr, "SPDKIO::BlockController::SpdkStart: spdk_bdev_open_ext failed for %s, %d\n", device->name.c_str(), rc);
+            for (auto& opened : ctrl->m_devices) {
+                if (opened->desc) spdk_bdev_close(opened->desc);
+                opened->desc = nullptr;
+            }
+            ctrl->m_ssdSpdkThreadStartFailed = true;
+            spdk_app_stop(-1);
+            return;
+        }
+        device->bdev = spdk_bdev_desc_get_bdev(device->desc);
+        fprintf(stdout, "SPDKIO::BlockController::SpdkStart: bdev %s has %lu pages\n", device->name.c_str(), spdk_bdev_get_num_blocks(device->bdev) * spdk_bdev_get_block_size(device->bdev) / PageSize);
     }
-    ctrl->m_ssdSpdkBdev = spdk_bdev_desc_get_bdev(ctrl->m_ssdSpdkBdevDesc);
 
-    // Open I/O channel
-    ctrl->m_ssdSpdkBdevIoChannel = spdk_bdev_get_io_channel(ctrl->m_ssdSpdkBdevDesc);
-    if (ctrl->m_ssdSpdkBdevIoChannel == NULL) {
-        fprintf(stderr, "SPDKIO::BlockController::SpdkStart: spdk_bdev_get_io_channel failed\n");
-        spdk_bdev_close(ctrl->m_ssdSpdkBdevDesc);
-        ctrl->m_ssdSpdkThreadStartFailed = true;
-        spdk_app_stop(-1);
-        return;
+    // Spawn one SPDK thread per reactor, the SPDK scheduler spreads them over the cores of reactor_mask
+    for (int i = 0; i < ctrl->m_ssdSpdkNumReactors; i++) {
+        Reactor* reactor = ctrl->m_reactors[i].get();
+        std::string name = "spfresh_reactor_" + std::to_string(i);
+        reactor->thread = spdk_thread_create(name.c_str(), NULL);
+        if (reactor->thread == NULL) {
+            fprintf(stderr, "SPDKIO::BlockController::SpdkStart: spdk_thread_create failed for reactor %d\n", i);
+            for (auto& device : ctrl->m_devices) {
+                spdk_bdev_close(device->desc);
+                device->desc = nullptr;
+            }
+            ctrl->m_ssdSpdkThreadStartFailed = true;
+            spdk_app_stop(-1);
+            return;
+        }
+        spdk_thread_send_msg(reactor->thread, SpdkReactorStart, reactor);
     }
-
-    ctrl->m_ssdSpdkThreadReady = true;
-    m_ssdInflight = 0;
-
-    SpdkIoLoop(ctrl);
 }
 
 void* SPDKIO::BlockController::InitializeSpdk(void* arg) {
@@ -111,10 +297,57 @@ void* SPDKIO::BlockController::InitializeSpdk(void* arg) {
     const char* spdkConf = getenv(kSpdkConfEnv);
     opts.json_config_file = spdkConf ? spdkConf : "";
     const char* spdkBdevName = getenv(kSpdkBdevNameEnv);
-    ctrl->m_ssdSpdkBdevName = spdkBdevName ? spdkBdevName : "";
+    std::string bdevNames = spdkBdevName ? spdkBdevName : "";
+    ctrl->m_devices.clear();
+    for (size_t begin = 0;;) {
+        size_t end = bdevNames.find(',', begin);
+        std::string name = bdevNames.substr(begin, end == std::string::npos ? std::string::npos : end - begin);
+        if (!name.empty() || (ctrl->m_devices.empty() && end == std::string::npos)) {
+            ctrl->m_devices.emplace_back(new Device());
+            ctrl->m_devices.back()->name = name;
+        }
+        if (end == std::string::npos) break;
+        begin = end + 1;
+    }
     const char* spdkIoDepth = getenv(kSpdkIoDepth);
     if (spdkIoDepth)
         ctrl->m_ssdSpdkIoDepth = atoi(spdkIoDepth);
+    const char* spdkMaxIoPages = getenv(kSpdkMaxIoPages);
+    if (spdkMaxIoPages)
+        ctrl->m_ssdSpdkMaxIoPages = std::max(1, atoi(spdkMaxIoPages));
+    const char* spdkWaitMode = getenv(kSpdkWaitMode);
+    if (spdkWaitMode) {
+        if (strcmp(spdkWaitMode, "yield") == 0) {
+            ctrl->m_waitMode = WaitMode::Yield;
+        } else if (strcmp(spdkWaitMode, "block") == 0) {
+            ctrl->m_waitMode = WaitMode::Block;
+        } else if (strcmp(spdkWaitMode, "spin") != 0) {
+            fprintf(stderr, "SPDKIO::BlockController::InitializeSpdk: unknown %s '%s', using spin\n", kSpdkWaitMode, spdkWaitMode);
+        }
+    }
+    const char* spdkWaitSpinRounds = getenv(kSpdkWaitSpinRounds);
+    if (spdkWaitSpinRounds)
+        ctrl->m_waitSpinRounds = std::max(0, atoi(spdkWaitSpinRounds));
+    ParseClassLimits(getenv(kSpdkClassDepth), ctrl->m_classDepth);
+    ParseClassLimits(getenv(kSpdkClassBudget), ctrl->m_classBudget);
+
+    // Number of reactors, by default they run on cores [0, reactors)
+    const char* spdkReactors = getenv(kSpdkReactors);
+    if (spdkReactors)
+        ctrl->m_ssdSpdkNumReactors = std::max(1, atoi(spdkReactors));
+    const char* spdkReactorMask = getenv(kSpdkReactorMask);
+    if (spdkReactorMask) {
+        ctrl->m_ssdSpdkReactorMask = spdkReactorMask;
+    } else {
+        ctrl->m_ssdSpdkReactorMask = "[0-" + std::to_string(ctrl->m_ssdSpdkNumReactors - 1) + "]";
+    }
+    opts.reactor_mask = ctrl->m_ssdSpdkReactorMask.c_str();
+    for (int i = 0; i < ctrl->m_ssdSpdkNumReactors; i++) {
+        ctrl->m_reactors.emplace_back(new Reactor());
+        ctrl->m_reactors.back()->ctrl = ctrl;
+        ctrl->m_reactors.back()->id = i;
+        ctrl->m_reactors.back()->queues.Configure(ctrl->m_classDepth, ctrl->m_classBudget);
+    }
 
     // Configure IOVA mode from environment variable
     // Use "va" for virtual addresses (no root required)
@@ -141,9 +374,6 @@ bool SPDKIO::BlockController::Initialize(int batchSize, AddressType maxBlocks) {
 
     if (m_numInitCalled == 1) {
         m_batchSize = batchSize;
-        for (AddressType i = 0; i < maxBlocks; i++) {
-            m_blockAddresses.push(i);
-        }
         pthread_create(&m_ssdSpdkTid, NULL, &InitializeSpdk, this);
         while (!m_ssdSpdkThreadReady && !m_ssdSpdkThreadStartFailed)
             ;
@@ -151,37 +381,49 @@ bool SPDKIO::BlockController::Initialize(int batchSize, AddressType maxBlocks) {
             fprintf(stderr, "SPDKIO::BlockController::Initialize failed\n");
             return false;
         }
+        m_trace.OpenFromEnv();
+        // A single device keeps the whole address space as before. With several, each one gets an
+        // even share of maxBlocks as far as its capacity allows
+        std::vector<AddressType> starts;
+        AddressType total = 0;
+        for (auto& device : m_devices) {
+            AddressType pages = (AddressType)(spdk_bdev_get_num_blocks(device->bdev) * spdk_bdev_get_block_size(device->bdev) / PageSize);
+            device->base = total;
+            device->blocks = m_devices.size() == 1 ? maxBlocks : std::min(pages, (maxBlocks + (AddressType)m_devices.size() - 1) / (AddressType)m_devices.size());
+            starts.push_back(total);
+            total += device->blocks;
+            m_ssdSpdkBufAlign = std::max(m_ssdSpdkBufAlign, (size_t)spdk_bdev_get_buf_align(device->bdev));
+        }
+        m_maxBlocks = total;
+        m_blockAllocator.SetDomains(starts, [this](int p_device) { return (AddressType)m_devices[p_device]->inflight.load(std::memory_order_relaxed); });
+        m_blockAllocator.Initialize(m_maxBlocks);
     }
     // Create sub I/O request pool
     m_currIoContext.sub_io_requests.resize(m_ssdSpdkIoDepth);
     m_currIoContext.in_flight = 0;
-    uint32_t buf_align;
-    buf_align = spdk_bdev_get_buf_align(m_ssdSpdkBdev);
+    size_t buf_align = m_ssdSpdkBufAlign;
     for (auto& sr : m_currIoContext.sub_io_requests) {
         sr.completed_sub_io_requests = &(m_currIoContext.completed_sub_io_requests);
+        sr.context = &m_currIoContext;
         sr.app_buff = nullptr;
         sr.dma_buff = spdk_dma_zmalloc(PageSize, buf_align, NULL);
         sr.ctrl = this;
+        sr.next = nullptr;
+        sr.direct = false;
+        sr.reactor = nullptr;
+        sr.iovs.resize(m_ssdSpdkMaxIoPages);
         m_currIoContext.free_sub_io_requests.push_back(&sr);
     }
-    return true;
-}
-
-// get p_size blocks from front, and fill in p_data array
-bool SPDKIO::BlockController::GetBlocks(AddressType* p_data, int p_size) {
-    AddressType currBlockAddress = 0;
-    for (int i = 0; i < p_size; i++) {
-        while (!m_blockAddresses.try_pop(currBlockAddress))
-            ;
-        p_data[i] = currBlockAddress;
-    }
-    return true;
-}
-
-// release p_size blocks, put them at the end of the queue
-bool SPDKIO::BlockController::ReleaseBlocks(AddressType* p_data, int p_size) {
-    for (int i = 0; i < p_size; i++) {
-        m_blockAddresses.push(p_data[i]);
+    // Register a submission ring on the reactor this thread hashes to, pinned workers are spread
+    // over the reactors by their slot so none of them doubles up while another idles
+    if (m_currIoContext.ring == nullptr) {
+        m_currIoContext.ring.reset(new SubmissionRing(m_ssdSpdkIoDepth));
+        int slot = Helper::CoreMap::Slot();
+        size_t pick = slot >= 0 ? (size_t)slot : std::hash<std::thread::id>{}(std::this_thread::get_id());
+        Reactor* reactor = m_reactors[pick % m_reactors.size()].get();
+        std::lock_guard<std::mutex> ringLock(reactor->ringsMutex);
+        reactor->rings.push_back(m_currIoContext.ring.get());
+        m_currIoContext.reactor = reactor;
     }
     return true;
 }
@@ -195,34 +437,44 @@ bool SPDKIO::BlockController::ReadBlocks(AddressType* p_data, std::string* p_val
     AddressType dataIdx = 1;
     SubIoRequest* currSubIo;
 
-    // Clear timeout I/Os
-    while (m_currIoContext.in_flight) {
-        if (m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
-            currSubIo->app_buff = nullptr;
-            m_currIoContext.free_sub_io_requests.push_back(currSubIo);
-            m_currIoContext.in_flight--;
-        }
-    }
+    ClearTimeoutIOs();
 
     auto t1 = std::chrono::high_resolution_clock::now();
+    int idleRounds = 0;
     // Submit all I/Os
     while (currOffset < p_data[0] || m_currIoContext.in_flight) {
         auto t2 = std::chrono::high_resolution_clock::now();
-        if (std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1) > timeout) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1);
+        if (elapsed > timeout) {
             return false;
         }
+        bool progress = false;
         // Try submit
         if (currOffset < p_data[0] && m_currIoContext.free_sub_io_requests.size()) {
-            currSubIo = m_currIoContext.free_sub_io_requests.back();
-            m_currIoContext.free_sub_io_requests.pop_back();
-            currSubIo->app_buff = p_value->data() + currOffset;
-            currSubIo->real_size = (p_data[0] - currOffset) < PageSize ? (p_data[0] - currOffset) : PageSize;
-            currSubIo->is_read = true;
-            currSubIo->offset = p_data[dataIdx] * PageSize;
-            m_submittedSubIoRequests.push(currSubIo);
-            currOffset += PageSize;
-            dataIdx++;
-            m_currIoContext.in_flight++;
+            progress = true;
+            // Merge adjacent blocks into one command
+            int remainBlocks = (p_data[0] - currOffset + PageSize - 1) >> PageSizeEx;
+            int runLength = ContiguousBlocks(p_data + dataIdx, std::min({remainBlocks, m_ssdSpdkMaxIoPages, (int)m_currIoContext.free_sub_io_requests.size()}));
+            SubIoRequest* headSubIo = nullptr;
+            SubIoRequest* prevSubIo = nullptr;
+            for (int i = 0; i < runLength; i++) {
+                currSubIo = m_currIoContext.free_sub_io_requests.back();
+                m_currIoContext.free_sub_io_requests.pop_back();
+                currSubIo->app_buff = p_value->data() + currOffset;
+                currSubIo->real_size = (p_data[0] - currOffset) < PageSize ? (p_data[0] - currOffset) : PageSize;
+                currSubIo->is_read = true;
+                currSubIo->offset = p_data[dataIdx] * PageSize;
+                currSubIo->posting_id = 0;
+                currSubIo->next = nullptr;
+                currSubIo->direct = false;
+                if (prevSubIo) prevSubIo->next = currSubIo;
+                else headSubIo = currSubIo;
+                prevSubIo = currSubIo;
+                currOffset += PageSize;
+                dataIdx++;
+                m_currIoContext.in_flight++;
+            }
+            Submit(headSubIo);
         }
         // Try complete
         if (m_currIoContext.in_flight && m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
@@ -230,15 +482,108 @@ bool SPDKIO::BlockController::ReadBlocks(AddressType* p_data, std::string* p_val
             currSubIo->app_buff = nullptr;
             m_currIoContext.free_sub_io_requests.push_back(currSubIo);
             m_currIoContext.in_flight--;
+            progress = true;
         }
+        if (progress)
+            idleRounds = 0;
+        else
+            WaitForCompletion(idleRounds, timeout - elapsed);
     }
     return true;
 }
 
+void SPDKIO::BlockController::ClearTimeoutIOs() {
+    SubIoRequest* currSubIo;
+    int idleRounds = 0;
+    while (m_currIoContext.in_flight) {
+        if (m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
+            currSubIo->app_buff = nullptr;
+            m_currIoContext.free_sub_io_requests.push_back(currSubIo);
+            m_currIoContext.in_flight--;
+            idleRounds = 0;
+        } else {
+            WaitForCompletion(idleRounds, std::chrono::microseconds::max());
+        }
+    }
+}
+
+void SPDKIO::BlockController::ExecuteSubIoRequests(std::vector<SubIoRequest>& subIoRequests, std::vector<int>& subIoRequestCount, const std::chrono::time_point<std::chrono::high_resolution_clock>& startTime, const std::chrono::microseconds& timeout, const std::function<void(int)>& p_onPostingDone) {
+    ClearTimeoutIOs();
+
+    const int batch_size = m_batchSize;
+    for (int currSubIoStartId = 0; currSubIoStartId < subIoRequests.size(); currSubIoStartId += batch_size) {
+        int currSubIoEndId = (currSubIoStartId + batch_size) > subIoRequests.size() ? subIoRequests.size() : currSubIoStartId + batch_size;
+        int currSubIoIdx = currSubIoStartId;
+        SubIoRequest* currSubIo;
+        int idleRounds = 0;
+        while (currSubIoIdx < currSubIoEndId || m_currIoContext.in_flight) {
+            auto t2 = std::chrono::high_resolution_clock::now();
+            auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(t2 - startTime);
+            if (elapsed > timeout) {
+                break;
+            }
+            bool progress = false;
+            // Try submit
+            if (currSubIoIdx < currSubIoEndId && m_currIoContext.free_sub_io_requests.size()) {
+                progress = true;
+                // Merge adjacent blocks into one command, also across postings
+                int limit = std::min({currSubIoEndId - currSubIoIdx, m_ssdSpdkMaxIoPages, (int)m_currIoContext.free_sub_io_requests.size()});
+                limit = (int)std::min((AddressType)limit, BlocksToDeviceEnd(subIoRequests[currSubIoIdx].offset >> PageSizeEx));
+                int runLength = 1;
+                while (runLength < limit && subIoRequests[currSubIoIdx + runLength].offset == subIoRequests[currSubIoIdx].offset + runLength * PageSize) runLength++;
+                SubIoRequest* headSubIo = nullptr;
+                SubIoRequest* prevSubIo = nullptr;
+                for (int i = 0; i < runLength; i++) {
+                    currSubIo = m_currIoContext.free_sub_io_requests.back();
+                    m_currIoContext.free_sub_io_requests.pop_back();
+                    currSubIo->app_buff = subIoRequests[currSubIoIdx].app_buff;
+                    currSubIo->real_size = subIoRequests[currSubIoIdx].real_size;
+                    currSubIo->is_read = true;
+                    currSubIo->offset = subIoRequests[currSubIoIdx].offset;
+                    currSubIo->posting_id = subIoRequests[currSubIoIdx].posting_id;
+                    currSubIo->direct = subIoRequests[currSubIoIdx].direct;
+                    currSubIo->next = nullptr;
+                    if (prevSubIo) prevSubIo->next = currSubIo;
+                    else headSubIo = currSubIo;
+                    prevSubIo = currSubIo;
+                    m_currIoContext.in_flight++;
+                    currSubIoIdx++;
+                }
+                Submit(headSubIo);
+            }
+            // Try complete
+            if (m_currIoContext.in_flight && m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
+                if (!currSubIo->direct)
+                    memcpy(currSubIo->app_buff, currSubIo->dma_buff, currSubIo->real_size);
+                currSubIo->app_buff = nullptr;
+                int postingId = currSubIo->posting_id;
+                m_currIoContext.free_sub_io_requests.push_back(currSubIo);
+                m_currIoContext.in_flight--;
+                progress = true;
+                // the other postings keep streaming in while the callback works on this one
+                if (--subIoRequestCount[postingId] == 0 && p_onPostingDone)
+                    p_onPostingDone(postingId);
+            }
+            if (progress)
+                idleRounds = 0;
+            else
+                WaitForCompletion(idleRounds, timeout - elapsed);
+        }
+
+        auto t2 = std::chrono::high_resolution_clock::now();
+        if (std::chrono::duration_cast<std::chrono::microseconds>(t2 - startTime) > timeout) {
+            break;
+        }
+    }
+
+    // direct reads cut off by the deadline still transfer into the caller's buffers, which go back
+    // to the pool once it returns, so they are reaped here. Buffered ones land in their dma_buff
+    if (m_currIoContext.in_flight && !subIoRequests.empty() && subIoRequests[0].direct)
+        ClearTimeoutIOs();
+}
+
 // parallel read a list of posting lists.
 bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, std::vector<std::string>* p_values, const std::chrono::microseconds& timeout) {
-    // Temporarily disable timeout
-
     // Convert request format to SubIoRequests
     auto t1 = std::chrono::high_resolution_clock::now();
     p_values->resize(p_data.size());
@@ -260,6 +605,7 @@ bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, std:
             currSubIo.is_read = true;
             currSubIo.offset = p_data_i[dataIdx] * PageSize;
             currSubIo.posting_id = i;
+            currSubIo.direct = false;
             subIoRequests.push_back(currSubIo);
             subIoRequestCount[i]++;
             currOffset += PageSize;
@@ -267,98 +613,181 @@ bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, std:
         }
     }
 
-    // Clear timeout I/Os
-    while (m_currIoContext.in_flight) {
-        SubIoRequest* currSubIo;
-        if (m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
-            currSubIo->app_buff = nullptr;
-            m_currIoContext.free_sub_io_requests.push_back(currSubIo);
-            m_currIoContext.in_flight--;
+    ExecuteSubIoRequests(subIoRequests, subIoRequestCount, t1, timeout);
+
+    // postings the deadline cut off come back empty and fail the call
+    bool complete = true;
+    for (int i = 0; i < subIoRequestCount.size(); i++) {
+        if (subIoRequestCount[i] != 0) {
+            (*p_values)[i].clear();
+            complete = false;
         }
     }
+    return complete;
+}
 
-    const int batch_size = m_batchSize;
-    for (int currSubIoStartId = 0; currSubIoStartId < subIoRequests.size(); currSubIoStartId += batch_size) {
-        int currSubIoEndId = (currSubIoStartId + batch_size) > subIoRequests.size() ? subIoRequests.size() : currSubIoStartId + batch_size;
-        int currSubIoIdx = currSubIoStartId;
-        SubIoRequest* currSubIo;
-        while (currSubIoIdx < currSubIoEndId || m_currIoContext.in_flight) {
-            auto t2 = std::chrono::high_resolution_clock::now();
-            if (std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1) > timeout) {
-                break;
-            }
-            // Try submit
-            if (currSubIoIdx < currSubIoEndId && m_currIoContext.free_sub_io_requests.size()) {
-                currSubIo = m_currIoContext.free_sub_io_requests.back();
-                m_currIoContext.free_sub_io_requests.pop_back();
-                currSubIo->app_buff = subIoRequests[currSubIoIdx].app_buff;
-                currSubIo->real_size = subIoRequests[currSubIoIdx].real_size;
-                currSubIo->is_read = true;
-                currSubIo->offset = subIoRequests[currSubIoIdx].offset;
-                currSubIo->posting_id = subIoRequests[currSubIoIdx].posting_id;
-                m_submittedSubIoRequests.push(currSubIo);
-                m_currIoContext.in_flight++;
-                currSubIoIdx++;
-            }
-            // Try complete
-            if (m_currIoContext.in_flight && m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
-                memcpy(currSubIo->app_buff, currSubIo->dma_buff, currSubIo->real_size);
-                currSubIo->app_buff = nullptr;
-                subIoRequestCount[currSubIo->posting_id]--;
-                m_currIoContext.free_sub_io_requests.push_back(currSubIo);
-                m_currIoContext.in_flight--;
-            }
-        }
+PostingView SPDKIO::BlockController::AcquirePostingBuffer(AddressType p_pages) {
+    PostingView view;
+    auto& pool = m_currIoContext.free_posting_buffers;
+    if (!pool.empty()) {
+        view = pool.back();
+        pool.pop_back();
+        if (view.capacity >= p_pages)
+            return view;
+        spdk_free(const_cast<char*>(view.data));
+    }
+    view.capacity = std::max<AddressType>(p_pages, 1);
+    view.data = (const char*)spdk_dma_zmalloc(view.capacity * PageSize, m_ssdSpdkBufAlign, NULL);
+    view.size = 0;
+    return view;
+}
 
-        auto t2 = std::chrono::high_resolution_clock::now();
-        if (std::chrono::duration_cast<std::chrono::microseconds>(t2 - t1) > timeout) {
-            break;
+// parallel read a list of posting lists into DMA buffers.
+bool SPDKIO::BlockController::ReadBlocks(std::vector<AddressType*>& p_data, std::vector<PostingView>* p_views, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    p_views->resize(p_data.size());
+    // the requests are copied into the context's pool on submission, so the lists outlive no read
+    std::vector<SubIoRequest>& subIoRequests = m_currIoContext.read_requests;
+    std::vector<int>& subIoRequestCount = m_currIoContext.read_counts;
+    subIoRequests.clear();
+    subIoRequestCount.assign(p_data.size(), 0);
+    for (size_t i = 0; i < p_data.size(); i++) {
+        AddressType* p_data_i = p_data[i];
+        PostingView& view = (*p_views)[i];
+
+        view = AcquirePostingBuffer((p_data_i[0] + PageSize - 1) >> PageSizeEx);
+        view.size = p_data_i[0];
+        AddressType currOffset = 0;
+        AddressType dataIdx = 1;
+
+        while (currOffset < p_data_i[0]) {
+            SubIoRequest currSubIo;
+            currSubIo.app_buff = const_cast<char*>(view.data) + currOffset;
+            currSubIo.real_size = PageSize;
+            currSubIo.is_read = true;
+            currSubIo.offset = p_data_i[dataIdx] * PageSize;
+            currSubIo.posting_id = i;
+            currSubIo.direct = true;
+            subIoRequests.push_back(currSubIo);
+            subIoRequestCount[i]++;
+            currOffset += PageSize;
+            dataIdx++;
         }
     }
 
+    ExecuteSubIoRequests(subIoRequests, subIoRequestCount, t1, timeout, p_onPostingDone);
+
+    // postings the deadline cut off come back empty and fail the call
+    bool complete = true;
     for (int i = 0; i < subIoRequestCount.size(); i++) {
         if (subIoRequestCount[i] != 0) {
-            (*p_values)[i].clear();
+            (*p_views)[i].size = 0;
+            complete = false;
         }
     }
-    return true;
+    return complete;
 }
 
-// write p_value into p_size blocks start from p_data
-bool SPDKIO::BlockController::WriteBlocks(AddressType* p_data, int p_size, const std::string& p_value) {
-    AddressType currBlockIdx = 0;
-    int inflight = 0;
+void SPDKIO::BlockController::ReleaseViews(std::vector<PostingView>* p_views) {
+    for (auto& view : *p_views) {
+        if (view.data != nullptr) {
+            view.size = 0;
+            m_currIoContext.free_posting_buffers.push_back(view);
+        }
+    }
+    p_views->clear();
+}
+
+// write a group of postings together, adjacent blocks are merged also across postings
+bool SPDKIO::BlockController::WriteBlocks(std::vector<AddressType*>& p_data, std::vector<int>& p_sizes, std::vector<const std::string*>& p_values) {
+    std::vector<WritePage> pages;
+    for (size_t i = 0; i < p_data.size(); i++) {
+        AddressType totalSize = p_values[i]->size();
+        for (int j = 0; j < p_sizes[i]; j++) {
+            AddressType size = (PageSize * (AddressType)(j + 1)) > totalSize ? (totalSize - (AddressType)j * PageSize) : PageSize;
+            pages.push_back({p_data[i][j], p_values[i]->data() + (AddressType)j * PageSize, size});
+        }
+    }
+    return ExecuteWrites(pages, false);
+}
+
+PostingView SPDKIO::BlockController::AcquireWriteBuffer(AddressType p_pages) {
+    return AcquirePostingBuffer(p_pages);
+}
+
+// the pages go out of p_buffer itself, no staging copy
+bool SPDKIO::BlockController::WriteBlocksDirect(const AddressType* p_blocks, AddressType p_pages, const char* p_buffer) {
+    std::vector<WritePage> pages((size_t)p_pages);
+    for (AddressType j = 0; j < p_pages; j++) pages[j] = {p_blocks[j], p_buffer + j * PageSize, PageSize};
+    return ExecuteWrites(pages, true);
+}
+
+bool SPDKIO::BlockController::ExecuteWrites(const std::vector<WritePage>& pages, bool p_direct) {
+    ClearTimeoutIOs();
+
+    int currPageIdx = 0;
+    int totalPages = pages.size();
     SubIoRequest* currSubIo;
-    int totalSize = p_value.size();
+    int idleRounds = 0;
     // Submit all I/Os
-    while (currBlockIdx < p_size || inflight) {
+    while (currPageIdx < totalPages || m_currIoContext.in_flight) {
+        bool progress = false;
         // Try submit
-        if (currBlockIdx < p_size && m_currIoContext.free_sub_io_requests.size()) {
-            currSubIo = m_currIoContext.free_sub_io_requests.back();
-            m_currIoContext.free_sub_io_requests.pop_back();
-            currSubIo->app_buff = const_cast<char*>(p_value.data()) + currBlockIdx * PageSize;
-            currSubIo->real_size = (PageSize * (currBlockIdx + 1)) > totalSize ? (totalSize - currBlockIdx * PageSize) : PageSize;
-            currSubIo->is_read = false;
-            currSubIo->offset = p_data[currBlockIdx] * PageSize;
-            memcpy(currSubIo->dma_buff, currSubIo->app_buff, currSubIo->real_size);
-            m_submittedSubIoRequests.push(currSubIo);
-            currBlockIdx++;
-            inflight++;
+        if (currPageIdx < totalPages && m_currIoContext.free_sub_io_requests.size()) {
+            progress = true;
+            // Merge adjacent blocks into one command
+            int limit = std::min({totalPages - currPageIdx, m_ssdSpdkMaxIoPages, (int)m_currIoContext.free_sub_io_requests.size()});
+            limit = (int)std::min((AddressType)limit, BlocksToDeviceEnd(pages[currPageIdx].block));
+            int runLength = 1;
+            while (runLength < limit && pages[currPageIdx + runLength].block == pages[currPageIdx].block + runLength) runLength++;
+            SubIoRequest* headSubIo = nullptr;
+            SubIoRequest* prevSubIo = nullptr;
+            for (int i = 0; i < runLength; i++) {
+                currSubIo = m_currIoContext.free_sub_io_requests.back();
+                m_currIoContext.free_sub_io_requests.pop_back();
+                currSubIo->app_buff = const_cast<char*>(pages[currPageIdx].src);
+                currSubIo->real_size = pages[currPageIdx].size;
+                currSubIo->is_read = false;
+                currSubIo->offset = pages[currPageIdx].block * PageSize;
+                currSubIo->posting_id = 0;
+                currSubIo->next = nullptr;
+                currSubIo->direct = p_direct;
+                if (!p_direct)
+                    memcpy(currSubIo->dma_buff, currSubIo->app_buff, currSubIo->real_size);
+                if (prevSubIo) prevSubIo->next = currSubIo;
+                else headSubIo = currSubIo;
+                prevSubIo = currSubIo;
+                currPageIdx++;
+                m_currIoContext.in_flight++;
+            }
+            Submit(headSubIo);
         }
         // Try complete
-        if (inflight && m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
+        if (m_currIoContext.in_flight && m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
             currSubIo->app_buff = nullptr;
             m_currIoContext.free_sub_io_requests.push_back(currSubIo);
-            inflight--;
+            m_currIoContext.in_flight--;
+            progress = true;
         }
+        if (progress)
+            idleRounds = 0;
+        else
+            WaitForCompletion(idleRounds, std::chrono::microseconds::max());
     }
     return true;
 }
 
 bool SPDKIO::BlockController::IOStatistics() {
-    int currIOCount = m_ioCompleteCount;
-    int diffIOCount = currIOCount - m_preIOCompleteCount;
+    std::uint64_t currIOCount = 0;
+    std::uint64_t currCommandCount = 0;
+    for (auto& reactor : m_reactors) {
+        currIOCount += reactor->completedPages.load(std::memory_order_relaxed);
+        currCommandCount += reactor->commands.load(std::memory_order_relaxed);
+    }
+    std::uint64_t diffIOCount = currIOCount - m_preIOCompleteCount;
     m_preIOCompleteCount = currIOCount;
+    std::uint64_t diffCommandCount = currCommandCount - m_preIOCommandCount;
+    m_preIOCommandCount = currCommandCount;
 
     auto currTime = std::chrono::high_resolution_clock::now();
     auto duration = std::chrono::duration_cast<std::chrono::microseconds>(currTime - m_preTime);
@@ -367,41 +796,99 @@ bool SPDKIO::BlockController::IOStatistics() {
     double currIOPS = (double)diffIOCount * 1000 / duration.count();
     double currBandWidth = (double)diffIOCount * PageSize / 1024 * 1000 / 1024 * 1000 / duration.count();
 
-    std::cout << "IOPS: " << currIOPS << "k Bandwidth: " << currBandWidth << "MB/s" << std::endl;
+    double currCommandRate = (double)diffCommandCount * 1000 / duration.count();
+    double mergeRatio = diffCommandCount > 0 ? (double)diffIOCount / diffCommandCount : 0;
+
+    std::cout << "IOPS: " << currIOPS << "k Bandwidth: " << currBandWidth << "MB/s Commands: " << currCommandRate << "k Merge ratio: " << mergeRatio << " pages/command Reactors: " << m_reactors.size() << std::endl;
+    if (m_devices.size() > 1) {
+        // share of the pages served by each device since the start
+        std::uint64_t totalPages = std::max<std::uint64_t>(currIOCount, 1);
+        for (auto& device : m_devices) {
+            std::cout << "  " << device->name << ": " << device->completedPages.load(std::memory_order_relaxed) * 100.0 / totalPages << "% of pages, " << device->inflight.load(std::memory_order_relaxed) << " in flight" << std::endl;
+        }
+    }
+    // latency from the hand-off to the reactor to the completion, so waiting behind other classes counts
+    for (int c = 0; c < kIOClasses; c++) {
+        IOClassStats::Snapshot curr = m_classStats[c].Take();
+        IOClassStats::Snapshot diff = curr - m_preClassStats[c];
+        m_preClassStats[c] = curr;
+        if (diff.commands == 0 && m_classStats[c].inflight.load(std::memory_order_relaxed) == 0)
+            continue;
+        std::cout << "  " << IOClassName(c) << ": " << (double)diff.pages * 1000 / duration.count() << "k IOPS, " << m_classStats[c].inflight.load(std::memory_order_relaxed) << " in flight, latency mean " << diff.MeanUs() << "us p99 <" << diff.PercentileUs(0.99) << "us p99.9 <" << diff.PercentileUs(0.999) << "us" << std::endl;
+    }
 
     return true;
 }
 
+void SPDKIO::BlockController::CollectMetrics(Helper::MetricsWriter& p_writer) {
+    std::uint64_t pages = 0, commands = 0;
+    for (auto& reactor : m_reactors) {
+        pages += reactor->completedPages.load(std::memory_order_relaxed);
+        commands += reactor->commands.load(std::memory_order_relaxed);
+    }
+    p_writer.Counter("sptag_io_pages_total", "Pages transferred by the block device", (double)pages);
+    p_writer.Counter("sptag_io_commands_total", "Commands completed by the block device", (double)commands);
+    for (int c = 0; c < kIOClasses; c++) {
+        p_writer.Gauge("sptag_io_inflight", "Commands of an I/O class handed to a reactor and not completed yet", m_classStats[c].inflight.load(std::memory_order_relaxed), Helper::MetricsWriter::Label("class", IOClassName(c)));
+    }
+    for (int c = 0; c < kIOClasses; c++) {
+        p_writer.Counter("sptag_io_class_pages_total", "Pages transferred per I/O class", (double)m_classStats[c].pages.load(std::memory_order_relaxed), Helper::MetricsWriter::Label("class", IOClassName(c)));
+    }
+    // bucket b holds the commands that took less than 2^b us
+    std::vector<double> bounds(IOClassStats::kLatencyBuckets);
+    for (int b = 0; b < IOClassStats::kLatencyBuckets; b++) bounds[b] = (double)((std::uint64_t)1 << b) / 1e6;
+    for (int c = 0; c < kIOClasses; c++) {
+        IOClassStats::Snapshot curr = m_classStats[c].Take();
+        std::vector<std::uint64_t> cumulative(IOClassStats::kLatencyBuckets);
+        std::uint64_t seen = 0;
+        for (int b = 0; b < IOClassStats::kLatencyBuckets; b++) cumulative[b] = seen += curr.latency[b];
+        p_writer.Histogram("sptag_io_latency_seconds", "Time from the hand-off to the reactor to the completion per I/O class", bounds, cumulative, curr.latencyUs / 1e6, seen, Helper::MetricsWriter::Label("class", IOClassName(c)));
+    }
+    for (auto& device : m_devices) {
+        p_writer.Counter("sptag_io_device_pages_total", "Pages transferred per device of a striped store", (double)device->completedPages.load(std::memory_order_relaxed), Helper::MetricsWriter::Label("device", device->name));
+    }
+}
+
 bool SPDKIO::BlockController::ShutDown() {
     std::lock_guard<std::mutex> lock(m_initMutex);
     m_numInitCalled--;
 
+    // Wait for our own I/Os before the reactors may go away
+    ClearTimeoutIOs();
+    if (m_currIoContext.ring != nullptr) {
+        Reactor* reactor = m_currIoContext.reactor;
+        {
+            std::lock_guard<std::mutex> ringLock(reactor->ringsMutex);
+            reactor->rings.erase(std::remove(reactor->rings.begin(), reactor->rings.end(), m_currIoContext.ring.get()), reactor->rings.end());
+        }
+        m_currIoContext.ring.reset();
+        m_currIoContext.reactor = nullptr;
+    }
+
     if (m_numInitCalled == 0) {
         m_ssdSpdkThreadExiting = true;
+        while (!m_ssdSpdkStopped && !m_ssdSpdkThreadStartFailed)
+            std::this_thread::yield();
         spdk_app_start_shutdown();
         pthread_join(m_ssdSpdkTid, NULL);
-        while (!m_blockAddresses.empty()) {
-            AddressType currBlockAddress;
-            m_blockAddresses.try_pop(currBlockAddress);
-        }
+        m_reactors.clear();
+        m_trace.Close();
+        m_blockAllocator.Clear();
     }
 
-    SubIoRequest* currSubIo;
-    while (m_currIoContext.in_flight) {
-        if (m_currIoContext.completed_sub_io_requests.try_pop(currSubIo)) {
-            currSubIo->app_buff = nullptr;
-            m_currIoContext.free_sub_io_requests.push_back(currSubIo);
-            m_currIoContext.in_flight--;
-        }
-    }
     // Free memory buffers
     for (auto& sr : m_currIoContext.sub_io_requests) {
         sr.completed_sub_io_requests = nullptr;
         sr.app_buff = nullptr;
+        sr.next = nullptr;
         spdk_free(sr.dma_buff);
         sr.dma_buff = nullptr;
     }
     m_currIoContext.free_sub_io_requests.clear();
+    for (auto& view : m_currIoContext.free_posting_buffers) {
+        spdk_free(const_cast<char*>(view.data));
+    }
+    m_currIoContext.free_posting_buffers.clear();
     return true;
 }
 
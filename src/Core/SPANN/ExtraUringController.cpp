@@ -0,0 +1,576 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/ExtraUringController.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <iostream>
+#include <unistd.h>
+
+namespace SPTAG::SPANN {
+
+thread_local std::unordered_map<std::uint64_t, UringBlockController::ThreadRing*> UringBlockController::m_threadRings;
+std::atomic<std::uint64_t> UringBlockController::m_nextDeviceId{0};
+
+UringBlockController::UringBlockController(const std::string& p_path, int p_queueDepth, int p_maxIoPages, bool p_sqPoll)
+    : m_deviceId(m_nextDeviceId++), m_path(p_path), m_queueDepth(std::max(1, p_queueDepth)), m_maxIoPages(std::max(1, p_maxIoPages)), m_sqPoll(p_sqPoll) {}
+
+UringBlockController::~UringBlockController() {
+    std::lock_guard<std::mutex> lock(m_initMutex);
+    for (auto& ring : m_rings) {
+        DestroyRing(ring.get());
+    }
+    m_rings.clear();
+    if (m_fd >= 0) {
+        close(m_fd);
+        m_fd = -1;
+    }
+}
+
+UringBlockController::ThreadRing* UringBlockController::CurrentRing() {
+    auto it = m_threadRings.find(m_deviceId);
+    return it == m_threadRings.end() || !it->second->ready ? nullptr : it->second;
+}
+
+bool UringBlockController::CreateRing(ThreadRing* p_ring) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if (m_sqPoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 2000;
+        if (m_sqPollFd >= 0) {
+            params.flags |= IORING_SETUP_ATTACH_WQ;
+            params.wq_fd = m_sqPollFd;
+        }
+    }
+    int ret = io_uring_queue_init_params(m_queueDepth, &p_ring->ring, &params);
+    if (ret < 0 && m_sqPoll) {
+        LOG(Helper::LogLevel::LL_Warning, "UringBlockController: SQPOLL not available (%s), falling back to syscall submission\n", strerror(-ret));
+        m_sqPoll = false;
+        memset(&params, 0, sizeof(params));
+        ret = io_uring_queue_init_params(m_queueDepth, &p_ring->ring, &params);
+    }
+    if (ret < 0) {
+        LOG(Helper::LogLevel::LL_Error, "UringBlockController: io_uring_queue_init failed: %s\n", strerror(-ret));
+        return false;
+    }
+    if (m_sqPoll && m_sqPollFd < 0)
+        m_sqPollFd = p_ring->ring.ring_fd;
+
+    ret = io_uring_register_files(&p_ring->ring, &m_fd, 1);
+    if (ret < 0) {
+        LOG(Helper::LogLevel::LL_Error, "UringBlockController: io_uring_register_files failed: %s\n", strerror(-ret));
+        io_uring_queue_exit(&p_ring->ring);
+        return false;
+    }
+
+    size_t stagingSize = (size_t)m_queueDepth * m_maxIoPages * PageSize;
+    p_ring->staging = (char*)aligned_alloc(PageSize, stagingSize);
+    if (p_ring->staging == nullptr) {
+        io_uring_queue_exit(&p_ring->ring);
+        return false;
+    }
+    struct iovec iov = {p_ring->staging, stagingSize};
+    ret = io_uring_register_buffers(&p_ring->ring, &iov, 1);
+    if (ret < 0) {
+        LOG(Helper::LogLevel::LL_Error, "UringBlockController: io_uring_register_buffers failed: %s, check RLIMIT_MEMLOCK\n", strerror(-ret));
+        free(p_ring->staging);
+        p_ring->staging = nullptr;
+        io_uring_queue_exit(&p_ring->ring);
+        return false;
+    }
+
+    p_ring->commands.resize(m_queueDepth);
+    for (int i = 0; i < m_queueDepth; i++) {
+        p_ring->commands[i].iovs.reserve(m_maxIoPages);
+        p_ring->free_commands.push_back(i);
+    }
+    p_ring->in_flight = 0;
+    p_ring->queued = 0;
+    p_ring->ready = true;
+    return true;
+}
+
+void UringBlockController::DestroyRing(ThreadRing* p_ring) {
+    if (p_ring->ready)
+        io_uring_queue_exit(&p_ring->ring);
+    p_ring->ready = false;
+    free(p_ring->staging);
+    p_ring->staging = nullptr;
+    for (auto& view : p_ring->free_posting_buffers) {
+        free(const_cast<char*>(view.data));
+    }
+    p_ring->free_posting_buffers.clear();
+}
+
+bool UringBlockController::ResetRing(ThreadRing* p_ring) {
+    std::lock_guard<std::mutex> lock(m_initMutex);
+    if (p_ring->ready && m_sqPollFd == p_ring->ring.ring_fd)
+        m_sqPollFd = -1;
+    DestroyRing(p_ring);
+    p_ring->commands.clear();
+    p_ring->free_commands.clear();
+    p_ring->in_flight = 0;
+    p_ring->queued = 0;
+    return CreateRing(p_ring);
+}
+
+int UringBlockController::Submit(ThreadRing* p_ring) {
+    // the kernel takes entries in queue order, queued commands come before any cancel behind them
+    int submitted = io_uring_submit(&p_ring->ring);
+    if (submitted > 0) {
+        int taken = std::min(submitted, p_ring->queued);
+        p_ring->queued -= taken;
+        p_ring->in_flight += taken;
+    }
+    return submitted;
+}
+
+bool UringBlockController::Initialize(int batchSize, AddressType maxBlocks) {
+    std::lock_guard<std::mutex> lock(m_initMutex);
+    m_numInitCalled++;
+
+    if (m_numInitCalled == 1) {
+        m_maxBlocks = maxBlocks;
+        m_blockAllocator.Initialize(maxBlocks);
+        m_fd = open(m_path.c_str(), O_RDWR | O_CREAT | O_DIRECT, 0644);
+        if (m_fd < 0 && errno == EINVAL) {
+            LOG(Helper::LogLevel::LL_Warning, "UringBlockController: %s does not support O_DIRECT, using buffered I/O\n", m_path.c_str());
+            m_fd = open(m_path.c_str(), O_RDWR | O_CREAT, 0644);
+        }
+        if (m_fd < 0) {
+            LOG(Helper::LogLevel::LL_Error, "UringBlockController: cannot open %s: %s\n", m_path.c_str(), strerror(errno));
+            return false;
+        }
+        m_trace.OpenFromEnv();
+        LOG(Helper::LogLevel::LL_Info, "UringBlockController: %s, queue depth %d, max I/O pages %d, sqpoll %d\n", m_path.c_str(), m_queueDepth, m_maxIoPages, (int)m_sqPoll);
+    }
+    if (m_fd < 0)
+        return false;
+    if (CurrentRing() == nullptr) {
+        std::unique_ptr<ThreadRing> ring(new ThreadRing());
+        if (!CreateRing(ring.get()))
+            return false;
+        m_threadRings[m_deviceId] = ring.get();
+        m_rings.push_back(std::move(ring));
+    }
+    return true;
+}
+
+void UringBlockController::ClearTimeoutIOs(ThreadRing* p_ring) {
+    while (p_ring->in_flight) {
+        struct io_uring_cqe* cqe;
+        if (io_uring_wait_cqe(&p_ring->ring, &cqe) != 0)
+            continue;
+        std::uint64_t data = io_uring_cqe_get_data64(cqe);
+        io_uring_cqe_seen(&p_ring->ring, cqe);
+        if (data == kCancelData)
+            continue;
+        p_ring->commands[data].busy = false;
+        p_ring->free_commands.push_back((int)data);
+        p_ring->in_flight--;
+    }
+}
+
+void UringBlockController::CancelInFlight(ThreadRing* p_ring) {
+    // entries left in the submission queue
+    int unsent = p_ring->queued;
+    for (int commandId = 0; commandId < (int)p_ring->commands.size(); commandId++) {
+        if (!p_ring->commands[commandId].busy)
+            continue;
+        struct io_uring_sqe* sqe = io_uring_get_sqe(&p_ring->ring);
+        if (sqe == nullptr) {
+            unsent -= std::max(0, Submit(p_ring));
+            sqe = io_uring_get_sqe(&p_ring->ring);
+        }
+        // without a slot the command is just waited for
+        if (sqe == nullptr)
+            continue;
+        io_uring_prep_cancel64(sqe, (std::uint64_t)commandId, 0);
+        io_uring_sqe_set_data64(sqe, kCancelData);
+        unsent++;
+    }
+    unsent -= std::max(0, Submit(p_ring));
+    // a transfer already running on the device is not cancelled, it finishes first
+    ClearTimeoutIOs(p_ring);
+    // entries a refused submit left behind must not reach the kernel later, their commands never ran
+    if (unsent > 0 && !ResetRing(p_ring))
+        LOG(Helper::LogLevel::LL_Error, "UringBlockController: cannot replace the ring of %s\n", m_path.c_str());
+}
+
+bool UringBlockController::Execute(ThreadRing* p_ring, std::vector<PageRequest>& p_pages, std::vector<int>& p_pageCount, bool p_isRead, bool p_direct, const std::chrono::time_point<std::chrono::high_resolution_clock>& p_startTime, const std::chrono::microseconds& p_timeout, const std::function<void(int)>& p_onPostingDone) {
+    ClearTimeoutIOs(p_ring);
+
+    int currPageIdx = 0;
+    int totalPages = p_pages.size();
+    bool success = true;
+    // the buffers of direct commands go back to the caller, they must be left alone by then. Staged
+    // ones only touch the ring's slots and are reaped by the next Execute, unless some are still
+    // queued and would be submitted by it for pages it does not know
+    auto expire = [&]() {
+        bool cancel = p_ring->queued > 0;
+        for (auto& command : p_ring->commands) {
+            if (command.busy && command.direct)
+                cancel = true;
+        }
+        if (cancel)
+            CancelInFlight(p_ring);
+        return false;
+    };
+    while (currPageIdx < totalPages || p_ring->in_flight || p_ring->queued) {
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - p_startTime);
+        if (elapsed > p_timeout) {
+            return expire();
+        }
+        // Queue runs of adjacent blocks, one command each
+        std::uint64_t submitBegin = StageNow();
+        int queued = 0;
+        while (currPageIdx < totalPages && !p_ring->free_commands.empty()) {
+            struct io_uring_sqe* sqe = io_uring_get_sqe(&p_ring->ring);
+            if (sqe == nullptr)
+                break;
+            int limit = std::min(totalPages - currPageIdx, m_maxIoPages);
+            int runLength = 1;
+            while (runLength < limit && p_pages[currPageIdx + runLength].offset == p_pages[currPageIdx].offset + runLength * PageSize) runLength++;
+
+            int commandId = p_ring->free_commands.back();
+            p_ring->free_commands.pop_back();
+            Command& command = p_ring->commands[commandId];
+            command.first = currPageIdx;
+            command.count = runLength;
+            command.direct = p_direct;
+            char* slot = p_ring->staging + (size_t)commandId * m_maxIoPages * PageSize;
+            unsigned bytes = (unsigned)runLength * PageSize;
+            if (p_direct) {
+                command.iovs.resize(runLength);
+                for (int i = 0; i < runLength; i++) {
+                    command.iovs[i].iov_base = p_pages[currPageIdx + i].app_buff;
+                    command.iovs[i].iov_len = PageSize;
+                }
+                if (p_isRead)
+                    io_uring_prep_readv(sqe, 0, command.iovs.data(), runLength, p_pages[currPageIdx].offset);
+                else
+                    io_uring_prep_writev(sqe, 0, command.iovs.data(), runLength, p_pages[currPageIdx].offset);
+            } else if (p_isRead) {
+                io_uring_prep_read_fixed(sqe, 0, slot, bytes, p_pages[currPageIdx].offset, 0);
+            } else {
+                for (int i = 0; i < runLength; i++) {
+                    memcpy(slot + (size_t)i * PageSize, p_pages[currPageIdx + i].app_buff, p_pages[currPageIdx + i].real_size);
+                }
+                io_uring_prep_write_fixed(sqe, 0, slot, bytes, p_pages[currPageIdx].offset, 0);
+            }
+            sqe->flags |= IOSQE_FIXED_FILE;
+            io_uring_sqe_set_data64(sqe, commandId);
+            if (m_trace.Enabled()) {
+                command.trace_command = m_trace.NextCommand();
+                command.submit_time = std::chrono::steady_clock::now();
+                m_trace.Record(IOTraceEvent::Submit, command.trace_command, p_isRead ? IOTraceOp::Read : IOTraceOp::Write, (int)CurrentIOClass(), 0, p_pages[currPageIdx].offset, bytes, CurrentIOTraceTag().Of(p_pages[currPageIdx].posting_id));
+            }
+            currPageIdx += runLength;
+            command.busy = true;
+            p_ring->queued++;
+            queued++;
+        }
+        if (p_ring->queued) {
+            // only what the kernel took is in flight. A short or busy submit leaves the rest queued
+            // and is retried once completions were reaped
+            int submitted = Submit(p_ring);
+            if (submitted <= 0 && p_ring->in_flight == 0 && submitted != -EAGAIN && submitted != -EBUSY && submitted != -EINTR) {
+                LOG(Helper::LogLevel::LL_Error, "UringBlockController: io_uring_submit returned %d\n", submitted);
+                // with nothing in flight every busy command is a queued one, it fails with its
+                // postings and a new ring drops its entry
+                for (auto& command : p_ring->commands) {
+                    if (!command.busy)
+                        continue;
+                    for (int i = 0; i < command.count; i++) p_pageCount[p_pages[command.first + i].posting_id] = -1;
+                }
+                success = false;
+                if (!ResetRing(p_ring)) {
+                    LOG(Helper::LogLevel::LL_Error, "UringBlockController: cannot replace the ring of %s\n", m_path.c_str());
+                    return false;
+                }
+            }
+            if (queued)
+                AddStageTicks(Stage::IOSubmit, StageNow() - submitBegin);
+        }
+
+        // Complete one command, waiting at most until the deadline
+        struct io_uring_cqe* cqe;
+        if (io_uring_peek_cqe(&p_ring->ring, &cqe) != 0) {
+            if (!p_ring->in_flight)
+                continue;
+            auto elapsedNow = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - p_startTime);
+            if (elapsedNow > p_timeout)
+                return expire();
+            long long waitUs = std::min<long long>(1000, (p_timeout - elapsedNow).count());
+            struct __kernel_timespec ts = {0, waitUs * 1000};
+            StageSpan span(Stage::IOWait);
+            if (io_uring_wait_cqe_timeout(&p_ring->ring, &cqe, &ts) != 0)
+                continue;
+        }
+        std::uint64_t data = io_uring_cqe_get_data64(cqe);
+        if (data == kCancelData) {
+            io_uring_cqe_seen(&p_ring->ring, cqe);
+            continue;
+        }
+        int commandId = (int)data;
+        Command& command = p_ring->commands[commandId];
+        bool failed = cqe->res < command.count * PageSize;
+        if (failed) {
+            LOG(Helper::LogLevel::LL_Error, "UringBlockController: %s of %d pages at %lld returned %d\n", p_isRead ? "read" : "write", command.count, (long long)p_pages[command.first].offset, cqe->res);
+            success = false;
+        }
+        char* slot = p_ring->staging + (size_t)commandId * m_maxIoPages * PageSize;
+        int first = command.first, count = command.count;
+        if (m_trace.Enabled()) {
+            auto latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - command.submit_time);
+            m_trace.Record(IOTraceEvent::Complete, command.trace_command, p_isRead ? IOTraceOp::Read : IOTraceOp::Write, (int)CurrentIOClass(), 0, p_pages[first].offset, (std::uint32_t)count * PageSize, CurrentIOTraceTag().Of(p_pages[first].posting_id), (std::uint32_t)latency.count());
+        }
+        for (int i = 0; i < count && !failed; i++) {
+            PageRequest& page = p_pages[first + i];
+            if (p_isRead && !command.direct)
+                memcpy(page.app_buff, slot + (size_t)i * PageSize, page.real_size);
+        }
+        m_completedPages.fetch_add(count, std::memory_order_relaxed);
+        m_commands.fetch_add(1, std::memory_order_relaxed);
+        io_uring_cqe_seen(&p_ring->ring, cqe);
+        command.busy = false;
+        p_ring->free_commands.push_back(commandId);
+        p_ring->in_flight--;
+        // the other postings keep streaming in while the callback works on this one. A failed
+        // posting stays below 0 whatever its other pages do
+        for (int i = 0; i < count; i++) {
+            int& pending = p_pageCount[p_pages[first + i].posting_id];
+            if (failed)
+                pending = -1;
+            else if (pending > 0 && --pending == 0 && p_onPostingDone)
+                p_onPostingDone(p_pages[first + i].posting_id);
+        }
+    }
+    return success;
+}
+
+bool UringBlockController::ReadBlocks(AddressType* p_data, std::string* p_value, const std::chrono::microseconds& timeout) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    ThreadRing* ring = CurrentRing();
+    if (ring == nullptr) {
+        LOG(Helper::LogLevel::LL_Error, "UringBlockController::ReadBlocks: thread is not initialized\n");
+        return false;
+    }
+    p_value->resize(p_data[0]);
+    std::vector<PageRequest> pages;
+    for (AddressType currOffset = 0, dataIdx = 1; currOffset < p_data[0]; currOffset += PageSize, dataIdx++) {
+        pages.push_back({p_data[dataIdx] * PageSize, p_value->data() + currOffset, std::min<AddressType>(p_data[0] - currOffset, PageSize), 0});
+    }
+    std::vector<int> pageCount(1, (int)pages.size());
+    if (Execute(ring, pages, pageCount, true, false, t1, timeout))
+        return true;
+    p_value->clear();
+    return false;
+}
+
+// parallel read a list of posting lists.
+bool UringBlockController::ReadBlocks(std::vector<AddressType*>& p_data, std::vector<std::string>* p_values, const std::chrono::microseconds& timeout) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    ThreadRing* ring = CurrentRing();
+    if (ring == nullptr) {
+        LOG(Helper::LogLevel::LL_Error, "UringBlockController::ReadBlocks: thread is not initialized\n");
+        return false;
+    }
+    p_values->resize(p_data.size());
+    std::vector<PageRequest> pages;
+    std::vector<int> pageCount(p_data.size(), 0);
+    pages.reserve(256);
+    for (size_t i = 0; i < p_data.size(); i++) {
+        AddressType* p_data_i = p_data[i];
+        std::string* p_value = &((*p_values)[i]);
+        p_value->resize(p_data_i[0]);
+        for (AddressType currOffset = 0, dataIdx = 1; currOffset < p_data_i[0]; currOffset += PageSize, dataIdx++) {
+            pages.push_back({p_data_i[dataIdx] * PageSize, p_value->data() + currOffset, std::min<AddressType>(p_data_i[0] - currOffset, PageSize), (int)i});
+            pageCount[i]++;
+        }
+    }
+
+    Execute(ring, pages, pageCount, true, false, t1, timeout);
+
+    // postings the deadline cut off come back empty, failed ones fail the call
+    bool success = true;
+    for (size_t i = 0; i < pageCount.size(); i++) {
+        if (pageCount[i] != 0) {
+            (*p_values)[i].clear();
+            success = success && pageCount[i] > 0;
+        }
+    }
+    return success;
+}
+
+// parallel read a list of posting lists into page aligned buffers.
+bool UringBlockController::ReadBlocks(std::vector<AddressType*>& p_data, std::vector<PostingView>* p_views, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    ThreadRing* ring = CurrentRing();
+    if (ring == nullptr) {
+        LOG(Helper::LogLevel::LL_Error, "UringBlockController::ReadBlocks: thread is not initialized\n");
+        return false;
+    }
+    p_views->resize(p_data.size());
+    std::vector<PageRequest> pages;
+    std::vector<int> pageCount(p_data.size(), 0);
+    pages.reserve(256);
+    for (size_t i = 0; i < p_data.size(); i++) {
+        AddressType* p_data_i = p_data[i];
+        PostingView& view = (*p_views)[i];
+        view = AcquireBuffer(ring, (p_data_i[0] + PageSize - 1) >> PageSizeEx);
+        view.size = p_data_i[0];
+        for (AddressType currOffset = 0, dataIdx = 1; currOffset < p_data_i[0]; currOffset += PageSize, dataIdx++) {
+            pages.push_back({p_data_i[dataIdx] * PageSize, const_cast<char*>(view.data) + currOffset, PageSize, (int)i});
+            pageCount[i]++;
+        }
+    }
+
+    Execute(ring, pages, pageCount, true, true, t1, timeout, p_onPostingDone);
+
+    // postings the deadline cut off come back empty, failed ones fail the call
+    bool success = true;
+    for (size_t i = 0; i < pageCount.size(); i++) {
+        if (pageCount[i] != 0) {
+            (*p_views)[i].size = 0;
+            success = success && pageCount[i] > 0;
+        }
+    }
+    return success;
+}
+
+PostingView UringBlockController::AcquireBuffer(ThreadRing* p_ring, AddressType p_pages) {
+    AddressType needPages = std::max<AddressType>(p_pages, 1);
+    PostingView view;
+    if (!p_ring->free_posting_buffers.empty()) {
+        view = p_ring->free_posting_buffers.back();
+        p_ring->free_posting_buffers.pop_back();
+        if (view.capacity < needPages) {
+            free(const_cast<char*>(view.data));
+            view.data = nullptr;
+        }
+    }
+    if (view.data == nullptr) {
+        view.capacity = needPages;
+        view.data = (const char*)aligned_alloc(PageSize, view.capacity * PageSize);
+    }
+    view.size = 0;
+    return view;
+}
+
+PostingView UringBlockController::AcquireWriteBuffer(AddressType p_pages) {
+    ThreadRing* ring = CurrentRing();
+    if (ring == nullptr)
+        return PostingView();
+    return AcquireBuffer(ring, p_pages);
+}
+
+// written with writev straight from p_buffer instead of through the registered staging slots
+bool UringBlockController::WriteBlocksDirect(const AddressType* p_blocks, AddressType p_pages, const char* p_buffer) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    ThreadRing* ring = CurrentRing();
+    if (ring == nullptr) {
+        LOG(Helper::LogLevel::LL_Error, "UringBlockController::WriteBlocksDirect: thread is not initialized\n");
+        return false;
+    }
+    std::vector<PageRequest> pages((size_t)p_pages);
+    for (AddressType j = 0; j < p_pages; j++) pages[j] = {p_blocks[j] * PageSize, const_cast<char*>(p_buffer) + j * PageSize, PageSize, 0};
+    std::vector<int> pageCount(1, (int)pages.size());
+    return Execute(ring, pages, pageCount, false, true, t1, std::chrono::microseconds::max());
+}
+
+void UringBlockController::ReleaseViews(std::vector<PostingView>* p_views) {
+    ThreadRing* ring = CurrentRing();
+    for (auto& view : *p_views) {
+        if (view.data == nullptr)
+            continue;
+        view.size = 0;
+        if (ring != nullptr)
+            ring->free_posting_buffers.push_back(view);
+        else
+            free(const_cast<char*>(view.data));
+    }
+    p_views->clear();
+}
+
+// write a group of postings together, adjacent blocks are merged also across postings
+bool UringBlockController::WriteBlocks(std::vector<AddressType*>& p_data, std::vector<int>& p_sizes, std::vector<const std::string*>& p_values) {
+    auto t1 = std::chrono::high_resolution_clock::now();
+    ThreadRing* ring = CurrentRing();
+    if (ring == nullptr) {
+        LOG(Helper::LogLevel::LL_Error, "UringBlockController::WriteBlocks: thread is not initialized\n");
+        return false;
+    }
+    std::vector<PageRequest> pages;
+    for (size_t i = 0; i < p_data.size(); i++) {
+        AddressType totalSize = p_values[i]->size();
+        for (int j = 0; j < p_sizes[i]; j++) {
+            AddressType size = (PageSize * (AddressType)(j + 1)) > totalSize ? (totalSize - (AddressType)j * PageSize) : PageSize;
+            pages.push_back({p_data[i][j] * PageSize, const_cast<char*>(p_values[i]->data()) + (AddressType)j * PageSize, size, 0});
+        }
+    }
+    std::vector<int> pageCount(1, (int)pages.size());
+    return Execute(ring, pages, pageCount, false, false, t1, std::chrono::microseconds::max());
+}
+
+bool UringBlockController::IOStatistics() {
+    std::uint64_t currIOCount = m_completedPages.load(std::memory_order_relaxed);
+    std::uint64_t currCommandCount = m_commands.load(std::memory_order_relaxed);
+    std::uint64_t diffIOCount = currIOCount - m_preIOCompleteCount;
+    m_preIOCompleteCount = currIOCount;
+    std::uint64_t diffCommandCount = currCommandCount - m_preIOCommandCount;
+    m_preIOCommandCount = currCommandCount;
+
+    auto currTime = std::chrono::high_resolution_clock::now();
+    auto duration = std::chrono::duration_cast<std::chrono::microseconds>(currTime - m_preTime);
+    m_preTime = currTime;
+
+    double currIOPS = (double)diffIOCount * 1000 / duration.count();
+    double currBandWidth = (double)diffIOCount * PageSize / 1024 * 1000 / 1024 * 1000 / duration.count();
+    double currCommandRate = (double)diffCommandCount * 1000 / duration.count();
+    double mergeRatio = diffCommandCount > 0 ? (double)diffIOCount / diffCommandCount : 0;
+
+    std::cout << "IOPS: " << currIOPS << "k Bandwidth: " << currBandWidth << "MB/s Commands: " << currCommandRate << "k Merge ratio: " << mergeRatio << " pages/command Rings: " << m_rings.size() << std::endl;
+
+    return true;
+}
+
+void UringBlockController::CollectMetrics(Helper::MetricsWriter& p_writer) {
+    p_writer.Counter("sptag_io_pages_total", "Pages transferred by the block device", (double)m_completedPages.load(std::memory_order_relaxed));
+    p_writer.Counter("sptag_io_commands_total", "Commands completed by the block device", (double)m_commands.load(std::memory_order_relaxed));
+}
+
+bool UringBlockController::ShutDown() {
+    std::lock_guard<std::mutex> lock(m_initMutex);
+    m_numInitCalled--;
+
+    ThreadRing* ring = CurrentRing();
+    if (ring != nullptr) {
+        ClearTimeoutIOs(ring);
+        DestroyRing(ring);
+        m_threadRings.erase(m_deviceId);
+        m_rings.erase(std::remove_if(m_rings.begin(), m_rings.end(), [ring](const std::unique_ptr<ThreadRing>& r) { return r.get() == ring; }), m_rings.end());
+    }
+    if (m_numInitCalled == 0) {
+        // rings of threads that never exited
+        for (auto& r : m_rings) {
+            DestroyRing(r.get());
+        }
+        m_rings.clear();
+        m_sqPollFd = -1;
+        m_trace.Close();
+        // ring pointers other threads still cache for the old id are never looked up again
+        m_deviceId = m_nextDeviceId++;
+        if (m_fd >= 0) {
+            close(m_fd);
+            m_fd = -1;
+        }
+        m_blockAllocator.Clear();
+    }
+    return true;
+}
+}  // namespace SPTAG::SPANN
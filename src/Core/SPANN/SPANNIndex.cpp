@@ -6,6 +6,9 @@
 
 #include "Core/SPANN/ExtraStaticSearcher.h"
 #include "Core/SPANN/ExtraDynamicSearcher.h"
+#include "Core/SPANN/ExtraUringController.h"
+#include "Core/SPANN/BlockPool.h"
+#include "Core/SPANN/TieredStorage.h"
 #include <shared_mutex>
 #include <chrono>
 #include <random>
@@ -22,6 +25,42 @@ thread_local std::shared_ptr<ExtraWorkSpace> Index<T>::m_workspace;
 
 std::function<std::shared_ptr<Helper::DiskIO>(void)> f_createAsyncIO = []() -> std::shared_ptr<Helper::DiskIO> { return std::shared_ptr<Helper::DiskIO>(new Helper::AsyncFileIO()); };
 
+// block device selected by StorageBackend, nullptr keeps the SPDK controller of SPDKIO. With a
+// BlockPoolTable the device is the index's namespace on the pool shared by the process, with a
+// CapacityTierPath the primary device is the fast tier over an io_uring capacity drive
+static ErrorCode CreateBlockDevice(const Options& p_opt, std::shared_ptr<BlockDevice>& p_device) {
+    BlockPool::DeviceFactory factory;
+    if (Helper::StrUtils::StrEqualIgnoreCase(p_opt.m_storageBackend.c_str(), "Uring")) {
+        factory = [&p_opt]() -> std::shared_ptr<BlockDevice> { return std::make_shared<UringBlockController>(p_opt.m_uringFilePath, p_opt.m_uringQueueDepth, p_opt.m_uringMaxIoPages, p_opt.m_uringSqPoll); };
+    } else {
+        if (!Helper::StrUtils::StrEqualIgnoreCase(p_opt.m_storageBackend.c_str(), "SPDK")) {
+            LOG(Helper::LogLevel::LL_Warning, "Unknown StorageBackend %s, using SPDK\n", p_opt.m_storageBackend.c_str());
+        }
+        factory = []() { return SPDKIO::CreateDevice(); };
+    }
+    if (!p_opt.m_capacityTierPath.empty() && !p_opt.m_blockPoolTable.empty()) {
+        LOG(Helper::LogLevel::LL_Warning, "CapacityTierPath is ignored on the shared drive of BlockPoolTable %s\n", p_opt.m_blockPoolTable.c_str());
+    } else if (!p_opt.m_capacityTierPath.empty()) {
+        std::vector<std::shared_ptr<BlockDevice>> tiers = {factory(), std::make_shared<UringBlockController>(p_opt.m_capacityTierPath, p_opt.m_uringQueueDepth, p_opt.m_uringMaxIoPages, p_opt.m_uringSqPoll)};
+        p_device = std::make_shared<TieredBlockDevice>(tiers, std::vector<AddressType>{(AddressType)p_opt.m_fastTierMB << 8, 0});
+        LOG(Helper::LogLevel::LL_Info, "Postings tiered over the %s device and %s\n", p_opt.m_storageBackend.c_str(), p_opt.m_capacityTierPath.c_str());
+        return ErrorCode::Success;
+    }
+    if (p_opt.m_blockPoolTable.empty()) {
+        p_device = Helper::StrUtils::StrEqualIgnoreCase(p_opt.m_storageBackend.c_str(), "Uring") ? factory() : nullptr;
+        return ErrorCode::Success;
+    }
+    // a store of its own would claim the whole drive, so a pool that fails to open fails the index
+    std::shared_ptr<BlockPool> pool = BlockPool::Attach(p_opt.m_blockPoolTable, factory);
+    if (pool == nullptr)
+        return ErrorCode::FailedOpenFile;
+    p_device = pool->Open(p_opt.m_blockNamespace, (AddressType)p_opt.m_blockNamespaceQuotaGB << 18);
+    if (p_device == nullptr)
+        return ErrorCode::Fail;
+    LOG(Helper::LogLevel::LL_Info, "Postings in namespace %s of %s\n", p_opt.m_blockNamespace.c_str(), p_opt.m_blockPoolTable.c_str());
+    return ErrorCode::Success;
+}
+
 template <typename T>
 bool Index<T>::CheckHeadIndexType() {
     SPTAG::VectorValueType v1 = m_index->GetVectorValueType(), v2 = GetEnumValueType<T>();
@@ -59,8 +98,29 @@ ErrorCode Index<T>::LoadConfig(Helper::IniReader& p_reader) {
     return ErrorCode::Success;
 }
 
+template <typename T>
+void Index<T>::ApplyMemoryPolicy() {
+    COMMON::MemoryPolicy policy;
+    policy.hugePageMB = m_options.m_hugePageMB;
+    std::string placement = m_options.m_numaPlacement;
+    if (!COMMON::MemoryPolicy::ParsePlacement(placement, policy.placement)) {
+        LOG(Helper::LogLevel::LL_Warning, "Unknown NumaPlacement %s, keeping Local.\n", placement.c_str());
+        placement = "Local";
+    } else if (policy.placement == COMMON::NumaPlacement::Replicate && m_options.m_update) {
+        // inserts rewrite head graph rows in place, which would reach a single copy
+        LOG(Helper::LogLevel::LL_Warning, "NumaPlacement Replicate needs a read-only head index, interleaving instead.\n");
+        placement = "Interleave";
+    }
+    if (m_index != nullptr) {
+        m_index->SetParameter("HugePageMB", std::to_string(policy.hugePageMB).c_str());
+        m_index->SetParameter("NumaPlacement", placement.c_str());
+    }
+    m_versionMap.SetMemoryPolicy(policy);
+}
+
 template <typename T>
 ErrorCode Index<T>::LoadIndexDataFromMemory(const std::vector<ByteArray>& p_indexBlobs) {
+    ApplyMemoryPolicy();
     if (m_index->LoadIndexDataFromMemory(p_indexBlobs) != ErrorCode::Success)
         return ErrorCode::Fail;
 
@@ -70,20 +130,29 @@ ErrorCode Index<T>::LoadIndexDataFromMemory(const std::vector<ByteArray>& p_inde
     m_index->UpdateIndex();
     m_index->SetReady(true);
 
-    m_extraSearcher.reset(new ExtraDynamicSearcher<T>(m_options.m_spdkMappingPath.c_str(), m_options.m_dim, m_options.m_postingPageLimit, m_options.m_useDirectIO, m_options.m_latencyLimit, m_options.m_mergeThreshold, m_options.m_spdkBatchSize, m_options.m_bufferLength, m_options.m_spdkCapacity));
+    std::shared_ptr<BlockDevice> device;
+    if (CreateBlockDevice(m_options, device) != ErrorCode::Success)
+        return ErrorCode::Fail;
+    m_extraSearcher.reset(new ExtraDynamicSearcher<T>(m_options.m_spdkMappingPath.c_str(), m_options.m_dim, m_options.m_postingPageLimit, m_options.m_useDirectIO, m_options.m_latencyLimit, m_options.m_mergeThreshold, m_options.m_spdkBatchSize, m_options.m_bufferLength, m_options.m_spdkCapacity, m_options.m_spdkMappingMmap, device));
 
     if (!m_extraSearcher->LoadIndex(m_options, m_versionMap))
         return ErrorCode::Fail;
+    if (LoadVectorLabels() != ErrorCode::Success)
+        return ErrorCode::Fail;
 
     if (m_options.m_excludehead)
         m_vectorTranslateMap.reset((std::uint64_t*)(p_indexBlobs.back().Data()), [=](std::uint64_t* ptr) {});
 
     omp_set_num_threads(m_options.m_iSSDNumberOfThreads);
-    return ErrorCode::Success;
+    ErrorCode ret = PrepareRerank();
+    if (ret == ErrorCode::Success)
+        m_extraSearcher->WarmStart();
+    return ret;
 }
 
 template <typename T>
 ErrorCode Index<T>::LoadIndexData(const std::vector<std::shared_ptr<Helper::DiskIO>>& p_indexStreams) {
+    ApplyMemoryPolicy();
     if (m_index->LoadIndexData(p_indexStreams) != ErrorCode::Success)
         return ErrorCode::Fail;
 
@@ -93,10 +162,15 @@ ErrorCode Index<T>::LoadIndexData(const std::vector<std::shared_ptr<Helper::Disk
     m_index->UpdateIndex();
     m_index->SetReady(true);
 
-    m_extraSearcher.reset(new ExtraDynamicSearcher<T>(m_options.m_spdkMappingPath.c_str(), m_options.m_dim, m_options.m_postingPageLimit, m_options.m_useDirectIO, m_options.m_latencyLimit, m_options.m_mergeThreshold, m_options.m_spdkBatchSize, m_options.m_bufferLength, m_options.m_spdkCapacity));
+    std::shared_ptr<BlockDevice> device;
+    if (CreateBlockDevice(m_options, device) != ErrorCode::Success)
+        return ErrorCode::Fail;
+    m_extraSearcher.reset(new ExtraDynamicSearcher<T>(m_options.m_spdkMappingPath.c_str(), m_options.m_dim, m_options.m_postingPageLimit, m_options.m_useDirectIO, m_options.m_latencyLimit, m_options.m_mergeThreshold, m_options.m_spdkBatchSize, m_options.m_bufferLength, m_options.m_spdkCapacity, m_options.m_spdkMappingMmap, device));
 
     if (!m_extraSearcher->LoadIndex(m_options, m_versionMap))
         return ErrorCode::Fail;
+    if (LoadVectorLabels() != ErrorCode::Success)
+        return ErrorCode::Fail;
 
     if (m_options.m_excludehead) {
         m_vectorTranslateMap.reset(new std::uint64_t[m_index->GetNumSamples()], std::default_delete<std::uint64_t[]>());
@@ -105,9 +179,12 @@ ErrorCode Index<T>::LoadIndexData(const std::vector<std::shared_ptr<Helper::Disk
 
     omp_set_num_threads(m_options.m_iSSDNumberOfThreads);
 
-    int m_vectorLimit = m_options.m_postingPageLimit * PageSize / (sizeof(T) * m_options.m_dim + sizeof(int) + sizeof(uint8_t));
-    m_versionMap.Initialize(m_options.m_vectorSize, m_index->m_iDataBlockSize, m_index->m_iDataCapacity);
+    // labels are rebuilt from the static index and the WAL here, so a mapping starts over as well
+    m_extraSearcher->InitVersionMap(m_options.m_vectorSize, m_index->m_iDataBlockSize, m_index->m_iDataCapacity);
     int m_vectorInfoSize = sizeof(T) * m_options.m_dim + sizeof(int) + sizeof(uint8_t);
+    int entrySize = m_extraSearcher->GetVectorInfoSize();
+    // padded entries of an aligned layout take more of the page budget, PQ codes keep the full-vector count
+    int m_vectorLimit = m_options.m_postingPageLimit * PageSize / (std::max)(m_vectorInfoSize, entrySize);
     LOG(Helper::LogLevel::LL_Info, "Copying data from static to SPDK\n");
     auto storeExtraSearcher = std::make_shared<ExtraStaticSearcher<T>>();
     if (!storeExtraSearcher->LoadIndex(m_options, m_versionMap)) {
@@ -136,26 +213,22 @@ ErrorCode Index<T>::LoadIndexData(const std::vector<std::shared_ptr<Helper::Disk
                 if (vectorNum > m_vectorLimit)
                     vectorNum = m_vectorLimit;
 
+                // the dynamic searcher serializes the entries, encoding them when its postings hold PQ codes
                 auto* postingP = reinterpret_cast<char*>(&tempPosting.front());
-                std::string newPosting(m_vectorInfoSize * vectorNum, '\0');
+                std::string newPosting(entrySize * vectorNum, '\0');
                 char* ptr = (char*)(newPosting.c_str());
-                for (int j = 0; j < vectorNum; ++j, ptr += m_vectorInfoSize) {
+                for (int j = 0; j < vectorNum; ++j, ptr += entrySize) {
                     char* vectorInfo = postingP + j * (m_vectorInfoSize - sizeof(uint8_t));
                     int VID = *(reinterpret_cast<int*>(vectorInfo));
                     uint8_t version = m_versionMap.GetVersion(VID);
-                    memcpy(ptr, &VID, sizeof(int));
-                    memcpy(ptr + sizeof(int), &version, sizeof(uint8_t));
-                    memcpy(ptr + sizeof(int) + sizeof(uint8_t), vectorInfo + sizeof(int), m_vectorInfoSize - sizeof(uint8_t) - sizeof(int));
+                    m_extraSearcher->Serialize(ptr, VID, version, vectorInfo + sizeof(int));
                 }
 
                 if (m_options.m_excludehead) {
                     auto VIDTrans = static_cast<SizeType>((m_vectorTranslateMap.get())[index]);
                     uint8_t version = m_versionMap.GetVersion(VIDTrans);
-                    std::string appendPosting(m_vectorInfoSize, '\0');
-                    char* ptr = (char*)(appendPosting.c_str());
-                    memcpy(ptr, &VIDTrans, sizeof(VIDTrans));
-                    memcpy(ptr + sizeof(VIDTrans), &version, sizeof(version));
-                    memcpy(ptr + sizeof(int) + sizeof(uint8_t), m_index->GetSample(index), m_vectorInfoSize - sizeof(int) + sizeof(uint8_t));
+                    std::string appendPosting(entrySize, '\0');
+                    m_extraSearcher->Serialize((char*)(appendPosting.c_str()), VIDTrans, version, m_index->GetSample(index));
                     newPosting = appendPosting + newPosting;
                 }
 
@@ -186,6 +259,10 @@ ErrorCode Index<T>::LoadIndexData(const std::vector<std::shared_ptr<Helper::Disk
         m_extraSearcher->RefineIndex(vectorReader, m_index);
     }
 
+    ErrorCode ret;
+    if ((ret = OpenWriteAheadLog(true)) != ErrorCode::Success || (ret = PrepareRerank()) != ErrorCode::Success)
+        return ret;
+    m_extraSearcher->WarmStart();
     return ErrorCode::Success;
 }
 
@@ -257,74 +334,625 @@ ErrorCode Index<T>::SaveIndexData(const std::vector<std::shared_ptr<Helper::Disk
     if (m_options.m_excludehead)
         IOBINARY(p_indexStreams[m_index->GetIndexFiles()->size()], WriteBinary, sizeof(std::uint64_t) * m_index->GetNumSamples(), (char*)(m_vectorTranslateMap.get()));
     m_versionMap.Save(m_options.m_deleteIDFile);
+    if (!m_options.m_vectorLabelFile.empty() && m_labels.IsReady() && (ret = m_labels.Save(m_options.m_vectorLabelFile)) != ErrorCode::Success)
+        return ret;
+    if (m_extraSearcher != nullptr && !m_options.m_postingHeatFile.empty())
+        m_extraSearcher->DumpPostingHeat(m_options.m_postingHeatFile, m_index.get());
+    if (m_extraSearcher != nullptr && !m_options.m_warmPostingFile.empty() && (ret = m_extraSearcher->SaveWarmPostings(m_options.m_warmPostingFile, m_index.get())) != ErrorCode::Success)
+        return ret;
     return ErrorCode::Success;
 }
 
 #pragma region K-NN search
 
+template <typename T>
+ExtraWorkSpace* Index<T>::GetWorkSpace() const {
+    if (m_workspace.get() == nullptr) {
+        m_workspace.reset(new ExtraWorkSpace());
+        m_workspace->Initialize(m_options.m_maxCheck, m_options.m_hashExp, m_options.m_searchInternalResultNum, min(m_options.m_postingPageLimit, m_options.m_searchPostingPageLimit + 1) << PageSizeEx, m_options.m_enableDataCompression);
+    }
+    return m_workspace.get();
+}
+
 template <typename T>
 ErrorCode Index<T>::SearchIndex(QueryResult& p_query, bool p_searchDeleted, SearchStats* p_stats) const {
+    return SearchWithFilter(p_query, nullptr, p_stats);
+}
+
+template <typename T>
+ErrorCode Index<T>::SearchIndex(QueryResult& p_query, const LabelFilter& p_filter, SearchStats* p_stats) const {
+    return SearchWithFilter(p_query, p_filter.Empty() ? nullptr : &p_filter, p_stats);
+}
+
+template <typename T>
+ErrorCode Index<T>::RangeSearch(const void* p_target, float p_radius, const std::function<bool(SizeType, float)>& p_onResult, int p_limit, SearchStats* p_stats) const {
+    if (!m_bReady)
+        return ErrorCode::EmptyIndex;
+    if (p_radius < 0)
+        return ErrorCode::Fail;
+
+    StageTicks stageTicks;
+    StageTicksScope stageScope(kStageTiming ? &stageTicks : nullptr);
+
+    int emitted = 0;
+    bool stopped = false;
+    auto emit = [&](SizeType p_vid, float p_dist) {
+        if (!stopped && (!p_onResult(p_vid, p_dist) || (p_limit > 0 && ++emitted >= p_limit)))
+            stopped = true;
+        return !stopped;
+    };
+
+    ExtraWorkSpace* workspace = GetWorkSpace();
+    QueryResult& heads = workspace->PooledResult(0, p_target, (std::max)(m_options.m_rangeSearchHeadNum, 1));
+    {
+        StageSpan span(Stage::HeadSearch);
+        m_index->SearchIndex(heads);
+    }
+
+    // by the triangle inequality no entry of a posting is within p_radius when its head is farther
+    // than p_radius plus the posting radius. Squared L2 and cosine on normalized vectors are a metric
+    // after the square root, up to a scale that drops out of the comparison
+    bool prune = m_options.m_distCalcMethod == DistCalcMethod::L2 || m_options.m_distCalcMethod == DistCalcMethod::Cosine;
+    float reach = std::sqrt(p_radius);
+    workspace->m_deduper.clear();
+    workspace->m_postingIDs.clear();
+    int pruned = 0;
+    for (int i = 0; i < heads.GetResultNum() && !stopped; ++i) {
+        auto res = heads.GetResult(i);
+        if (res->VID == -1)
+            break;
+        SizeType postingID = res->VID;
+        float headDist = res->Dist;
+        if (m_vectorTranslateMap.get() != nullptr && headDist <= p_radius) {
+            SizeType vid = static_cast<SizeType>((m_vectorTranslateMap.get())[postingID]);
+            if (vid >= 0 && vid < m_versionMap.GetVectorNum() && !m_versionMap.Deleted(vid) && !workspace->m_deduper.CheckAndSet(vid))
+                emit(vid, headDist);
+        }
+        if (m_extraSearcher == nullptr || !m_extraSearcher->CheckValidPosting(postingID))
+            continue;
+        float radius = m_extraSearcher->GetPostingRadius(postingID);
+        if (prune && radius < MaxDist && std::sqrt((std::max)(headDist, 0.0f)) > (reach + std::sqrt(radius)) * (1.0f + 1e-4f)) {
+            pruned++;
+            continue;
+        }
+        workspace->m_postingIDs.emplace_back(postingID);
+    }
+
+    if (p_stats)
+        p_stats->m_prunedPostings = pruned;
+    if (!stopped && !workspace->m_postingIDs.empty())
+        m_extraSearcher->SearchRange(workspace, (const T*)p_target, p_radius, emit, m_index.get(), p_stats);
+
+    m_queryCount.fetch_add(1, std::memory_order_relaxed);
+    if (m_extraSearcher != nullptr)
+        m_extraSearcher->GetStageRecorder().RecordQuery(stageTicks);
+    if (p_stats)
+        p_stats->m_stageTicks = stageTicks;
+    return ErrorCode::Success;
+}
+
+template <typename T>
+ErrorCode Index<T>::RangeSearch(const void* p_target, float p_radius, std::vector<BasicResult>& p_results, int p_limit, SearchStats* p_stats) const {
+    p_results.clear();
+    ErrorCode ret = RangeSearch(
+        p_target, p_radius, [&p_results](SizeType p_vid, float p_dist) {
+            p_results.emplace_back(p_vid, p_dist);
+            return true;
+        },
+        p_limit, p_stats);
+    std::sort(p_results.begin(), p_results.end(), [](const BasicResult& p_a, const BasicResult& p_b) { return p_a.Dist < p_b.Dist; });
+    return ret;
+}
+
+template <typename T>
+ErrorCode Index<T>::SetVectorLabels(SizeType p_begin, SizeType p_count, const std::uint64_t* p_labels) {
+    if (p_begin < 0 || p_count < 0 || p_begin + p_count > m_versionMap.GetVectorNum())
+        return ErrorCode::VectorNotFound;
+    WriteGate::Scope gate(UpdateGate());
+    if (!m_labels.IsReady()) {
+        std::lock_guard<std::mutex> lock(m_dataAddLock);
+        if (!m_labels.IsReady())
+            m_labels.Initialize(m_index->m_iDataBlockSize, m_index->m_iDataCapacity);
+    }
+    return m_labels.Set(p_begin, p_count, p_labels);
+}
+
+template <typename T>
+ErrorCode Index<T>::LoadVectorLabels() {
+    if (m_options.m_vectorLabelFile.empty() || !fileexists(m_options.m_vectorLabelFile.c_str()))
+        return ErrorCode::Success;
+    return m_labels.Load(m_options.m_vectorLabelFile, m_index->m_iDataBlockSize, m_index->m_iDataCapacity);
+}
+
+template <typename T>
+ErrorCode Index<T>::SearchWithFilter(QueryResult& p_query, const LabelFilter* p_filter, SearchStats* p_stats) const {
     if (!m_bReady)
         return ErrorCode::EmptyIndex;
 
+    // only unfiltered queries are cached, the key has no room for a filter
+    bool cacheResults = p_filter == nullptr && m_extraSearcher != nullptr && m_resultCache.Enabled();
+    ResultCache::Key cacheKey;
+    ResultCache::Entry cacheEntry;
+    std::uint64_t cacheGeneration = 0;
+    if (cacheResults) {
+        cacheKey = ResultCache::MakeKey((const T*)p_query.GetTarget(), GetFeatureDim(), p_query.GetResultNum(), m_options.m_resultCacheQuantum);
+        if (SearchResultCache(p_query, cacheKey)) {
+            if (p_stats)
+                p_stats->m_resultCacheHit = true;
+            return ErrorCode::Success;
+        }
+        // taken before searching, a Clear or an update overlapping the search keeps its results out
+        cacheGeneration = m_resultCache.Generation();
+        WriteGate& gate = m_extraSearcher->GetWriteGate();
+        cacheEntry.m_epoch = gate.Epoch();
+        cacheResults = !m_resultCacheGlobal || gate.Idle();
+    }
+
+    // the reads and scans below add their time here, recorded as one sample per stage at the end
+    StageTicks stageTicks;
+    StageTicksScope stageScope(kStageTiming ? &stageTicks : nullptr);
+
+    // a filter keeping few vectors leaves few matches in every posting, so the postings probed
+    // for the same k grow with the inverse of its estimated selectivity, up to FilterProbeScale
+    int probeNum = m_options.m_searchInternalResultNum;
+    if (p_filter != nullptr) {
+        float selectivity = (std::max)(m_labels.Selectivity(*p_filter, (SizeType)m_versionMap.Count()), 1e-6f);
+        probeNum = (int)std::ceil(probeNum * (std::max)(1.0f, (std::min)(m_options.m_filterProbeScale, 1.0f / selectivity)));
+    }
+
+    // fewer results than the postings probed are searched in a pooled set of the workspace
+    ExtraWorkSpace* workspace = GetWorkSpace();
     COMMON::QueryResultSet<T>* p_queryResults;
-    if (p_query.GetResultNum() >= m_options.m_searchInternalResultNum)
+    if (p_query.GetResultNum() >= probeNum)
         p_queryResults = (COMMON::QueryResultSet<T>*)&p_query;
-    else
-        p_queryResults = new COMMON::QueryResultSet<T>((const T*)p_query.GetTarget(), m_options.m_searchInternalResultNum);
+    else {
+        p_queryResults = (COMMON::QueryResultSet<T>*)&workspace->PooledResult(0, p_query.GetTarget(), probeNum);
+        p_queryResults->SetDeadline(p_query.GetDeadline());
+    }
 
-    m_index->SearchIndex(*p_queryResults);
+    {
+        StageSpan span(Stage::HeadSearch);
+        m_index->SearchIndex(*p_queryResults);
+    }
 
     if (m_extraSearcher != nullptr) {
-        if (m_workspace.get() == nullptr) {
-            m_workspace.reset(new ExtraWorkSpace());
-            m_workspace->Initialize(m_options.m_maxCheck, m_options.m_hashExp, m_options.m_searchInternalResultNum, min(m_options.m_postingPageLimit, m_options.m_searchPostingPageLimit + 1) << PageSizeEx, m_options.m_enableDataCompression);
-        }
         m_workspace->m_deduper.clear();
         m_workspace->m_postingIDs.clear();
+        m_workspace->m_probeIDs.clear();
+        m_workspace->m_probeDists.clear();
 
+        bool staged = m_options.m_probeFirstWave > 0;
+        auto& candidates = staged ? m_workspace->m_probeIDs : m_workspace->m_postingIDs;
         float limitDist = p_queryResults->GetResult(0)->Dist * m_options.m_maxDistRatio;
+        float farthestProbe = 0;
         for (int i = 0; i < p_queryResults->GetResultNum(); ++i) {
             auto res = p_queryResults->GetResult(i);
             if (res->VID == -1)
                 break;
 
             auto postingID = res->VID;
+            float headDist = res->Dist;
             if (m_vectorTranslateMap.get() != nullptr)
                 res->VID = static_cast<SizeType>((m_vectorTranslateMap.get())[res->VID]);
             else {
                 res->VID = -1;
                 res->Dist = MaxDist;
             }
+            // a head vector the filter drops leaves the results, its posting is probed all the same
+            if (p_filter != nullptr && res->VID >= 0 && !p_filter->Matches(m_labels.Get(res->VID))) {
+                res->VID = -1;
+                res->Dist = MaxDist;
+            }
 
             // Don't do disk reads for irrelevant pages
-            if (m_workspace->m_postingIDs.size() >= m_options.m_searchInternalResultNum ||
-                (limitDist > 0.1 && res->Dist > limitDist) ||
+            if (candidates.size() >= (size_t)probeNum ||
+                (limitDist > 0.1 && headDist > limitDist) ||
                 !m_extraSearcher->CheckValidPosting(postingID))
                 continue;
-            m_workspace->m_postingIDs.emplace_back(postingID);
+            candidates.emplace_back(postingID);
+            farthestProbe = headDist;
+            if (staged)
+                m_workspace->m_probeDists.emplace_back(headDist);
         }
 
         if (m_vectorTranslateMap.get() != nullptr)
             p_queryResults->Reverse();
-        m_extraSearcher->SearchIndex(m_workspace.get(), *p_queryResults, m_index, p_stats, nullptr, nullptr);
+        // versions before reading, a posting written meanwhile then fails the check of the entry.
+        // One being written right now may be read half way
+        if (cacheResults && !m_resultCacheGlobal) {
+            for (SizeType postingID : candidates) {
+                std::uint32_t version = m_extraSearcher->PostingVersion(postingID);
+                cacheResults = cacheResults && (version & 1) == 0;
+                cacheEntry.m_postings.emplace_back(postingID, version);
+            }
+        }
+        if (p_filter != nullptr) {
+            m_workspace->m_filter.m_labels = &m_labels;
+            m_workspace->m_filter.m_filter = *p_filter;
+        }
+        if (staged)
+            SearchPostingsInWaves(*p_queryResults, p_query.GetResultNum(), p_stats);
+        else
+            m_extraSearcher->SearchIndex(m_workspace.get(), *p_queryResults, m_index, p_stats, nullptr, nullptr);
+        m_workspace->m_filter = PostingFilter();
         p_queryResults->SortResult();
+        RerankResults(*p_queryResults);
+
+        // heads up to the farthest one probed were all worth reading by the wave stop rule, so
+        // the budget rather than the distances ended the probe and the next head might have helped
+        float kthDist = p_queryResults->GetResult((std::max)(1, (std::min)(p_query.GetResultNum(), p_queryResults->GetResultNum())) - 1)->Dist;
+        if (!candidates.empty() && kthDist < MaxDist && farthestProbe <= kthDist * m_options.m_probeStopRatio)
+            m_probeLimitedCount.fetch_add(1, std::memory_order_relaxed);
     }
 
-    if (p_query.GetResultNum() < m_options.m_searchInternalResultNum) {
+    if (p_query.GetResultNum() < probeNum) {
         std::copy(p_queryResults->GetResults(), p_queryResults->GetResults() + p_query.GetResultNum(), p_query.GetResults());
-        delete p_queryResults;
     }
 
-    if (p_query.WithMeta() && nullptr != m_pMetadata) {
-        for (int i = 0; i < p_query.GetResultNum(); ++i) {
-            SizeType result = p_query.GetResult(i)->VID;
-            p_query.SetMetadata(i, (result < 0) ? ByteArray::c_empty : m_pMetadata->GetMetadataCopy(result));
+    // results cut short by the deadline stay out, and so do those an update already made stale
+    if (cacheResults && !(p_query.HasDeadline() && std::chrono::steady_clock::now() > p_query.GetDeadline())) {
+        for (int i = 0; i < p_query.GetResultNum(); i++) cacheEntry.m_results.emplace_back(p_query.GetResult(i)->VID, p_query.GetResult(i)->Dist);
+        if (CachedResultValid(cacheEntry))
+            m_resultCache.Insert(cacheKey, std::move(cacheEntry), cacheGeneration);
+    }
+
+    // views of the metadata set, valid as long as the index keeps it
+    if (p_query.WithMeta() && nullptr != m_pMetadata)
+        m_pMetadata->GetMetadataViews(p_query.GetResults(), p_query.GetResultNum());
+    m_queryCount.fetch_add(1, std::memory_order_relaxed);
+    if (m_extraSearcher != nullptr)
+        m_extraSearcher->GetStageRecorder().RecordQuery(stageTicks);
+    if (p_stats)
+        p_stats->m_stageTicks = stageTicks;
+    return ErrorCode::Success;
+}
+
+template <typename T>
+bool Index<T>::SearchResultCache(QueryResult& p_query, const ResultCache::Key& p_key) const {
+    ResultCache::EntryPtr entry = m_resultCache.Find(p_key);
+    if (entry == nullptr || !CachedResultValid(*entry)) {
+        if (entry != nullptr)
+            m_resultCache.Erase(p_key, entry);
+        m_resultCache.Count(false);
+        return false;
+    }
+    m_resultCache.Count(true);
+    // k is part of the key, the entry has a result for every slot
+    for (int i = 0; i < p_query.GetResultNum() && i < (int)entry->m_results.size(); i++) p_query.SetResult(i, entry->m_results[i].first, entry->m_results[i].second);
+    if (p_query.WithMeta() && nullptr != m_pMetadata)
+        m_pMetadata->GetMetadataViews(p_query.GetResults(), p_query.GetResultNum());
+    return true;
+}
+
+template <typename T>
+bool Index<T>::CachedResultValid(const ResultCache::Entry& p_entry) const {
+    // every update passes the write gate, deletes included
+    if (m_resultCacheGlobal)
+        return m_extraSearcher->GetWriteGate().Epoch() == p_entry.m_epoch;
+    // inserts, splits, merges and reassigns change the postings they land in. A deleted vector
+    // stays in its postings until GC, only the version labels know about it. Heads added by a split
+    // elsewhere are not seen until then
+    for (auto& posting : p_entry.m_postings) {
+        if (!m_extraSearcher->PostingUnchanged(posting.first, posting.second))
+            return false;
+    }
+    for (auto& result : p_entry.m_results) {
+        if (result.first >= 0 && m_versionMap.Deleted(result.first))
+            return false;
+    }
+    return true;
+}
+
+template <typename T>
+ErrorCode Index<T>::SearchIndexBatch(std::vector<QueryResult>& p_queries, SearchStats* p_stats) const {
+    std::vector<QueryResult*> queries(p_queries.size());
+    for (size_t qi = 0; qi < p_queries.size(); qi++)
+        queries[qi] = &p_queries[qi];
+    return SearchIndexBatch(queries, p_stats);
+}
+
+template <typename T>
+ErrorCode Index<T>::SearchIndexBatch(std::vector<QueryResult*>& p_queries, SearchStats* p_stats) const {
+    if (!m_bReady)
+        return ErrorCode::EmptyIndex;
+
+    // the batch is timed as one operation
+    StageTicks stageTicks;
+    StageTicksScope stageScope(kStageTiming ? &stageTicks : nullptr);
+
+    // query qi searches in pooled set qi of the workspace when it wants fewer results than the
+    // internal result number, so the async threads reuse the same sets batch after batch
+    ExtraWorkSpace* workspace = GetWorkSpace();
+    std::vector<QueryResult*>& queryResults = workspace->m_batchResults;
+    queryResults.resize(p_queries.size());
+    for (size_t qi = 0; qi < p_queries.size(); qi++) {
+        if (p_queries[qi]->GetResultNum() >= m_options.m_searchInternalResultNum)
+            queryResults[qi] = p_queries[qi];
+        else
+            queryResults[qi] = &workspace->PooledResult(qi, p_queries[qi]->GetTarget(), m_options.m_searchInternalResultNum);
+        StageSpan span(Stage::HeadSearch);
+        m_index->SearchIndex(*queryResults[qi]);
+    }
+
+    if (m_extraSearcher != nullptr) {
+        m_workspace->m_postingIDs.clear();
+
+        // slot of every selected posting in m_postingIDs, and the queries that selected it
+        auto& postingSlots = m_workspace->m_postingSlots;
+        auto& postingQueries = m_workspace->m_postingQueries;
+        postingSlots.clear();
+        for (auto& queries : postingQueries) queries.clear();
+        for (size_t qi = 0; qi < queryResults.size(); qi++) {
+            COMMON::QueryResultSet<T>* results = (COMMON::QueryResultSet<T>*)queryResults[qi];
+            float limitDist = results->GetResult(0)->Dist * m_options.m_maxDistRatio;
+            int selected = 0;
+            for (int i = 0; i < results->GetResultNum(); ++i) {
+                auto res = results->GetResult(i);
+                if (res->VID == -1)
+                    break;
+
+                auto postingID = res->VID;
+                float headDist = res->Dist;
+                if (m_vectorTranslateMap.get() != nullptr)
+                    res->VID = static_cast<SizeType>((m_vectorTranslateMap.get())[res->VID]);
+                else {
+                    res->VID = -1;
+                    res->Dist = MaxDist;
+                }
+
+                if (selected >= m_options.m_searchInternalResultNum ||
+                    (limitDist > 0.1 && headDist > limitDist) ||
+                    !m_extraSearcher->CheckValidPosting(postingID))
+                    continue;
+                selected++;
+
+                auto slot = postingSlots.emplace(postingID, (int)m_workspace->m_postingIDs.size());
+                if (slot.second) {
+                    m_workspace->m_postingIDs.emplace_back(postingID);
+                    if (postingQueries.size() < m_workspace->m_postingIDs.size())
+                        postingQueries.emplace_back();
+                }
+                postingQueries[slot.first->second].push_back((int)qi);
+            }
+            if (m_vectorTranslateMap.get() != nullptr)
+                results->Reverse();
+        }
+
+        m_extraSearcher->SearchIndexBatch(m_workspace.get(), queryResults, postingQueries, m_index, p_stats);
+        for (auto results : queryResults) {
+            ((COMMON::QueryResultSet<T>*)results)->SortResult();
+            RerankResults(*(COMMON::QueryResultSet<T>*)results);
+        }
+    }
+
+    for (size_t qi = 0; qi < p_queries.size(); qi++) {
+        QueryResult& query = *p_queries[qi];
+        if (queryResults[qi] != p_queries[qi])
+            std::copy(queryResults[qi]->GetResults(), queryResults[qi]->GetResults() + query.GetResultNum(), query.GetResults());
+
+        // views of the metadata set, valid as long as the index keeps it
+        if (query.WithMeta() && nullptr != m_pMetadata)
+            m_pMetadata->GetMetadataViews(query.GetResults(), query.GetResultNum());
+    }
+    m_queryCount.fetch_add(p_queries.size(), std::memory_order_relaxed);
+    if (m_extraSearcher != nullptr)
+        m_extraSearcher->GetStageRecorder().RecordQuery(stageTicks);
+    if (p_stats)
+        p_stats->m_stageTicks = stageTicks;
+    return ErrorCode::Success;
+}
+
+template <typename T>
+ErrorCode Index<T>::SearchIndexAsync(QueryResult& p_query, std::function<void(ErrorCode)> p_callback) const {
+    if (!m_bReady)
+        return ErrorCode::EmptyIndex;
+
+    std::lock_guard<std::mutex> lock(m_asyncLock);
+    if (m_asyncStop)
+        return ErrorCode::Fail;
+    if (m_asyncThreads.empty()) {
+        for (int i = 0; i < max(1, m_options.m_asyncSearchThreads); i++)
+            m_asyncThreads.emplace_back(&Index<T>::AsyncSearchLoop, this);
+    }
+    m_asyncQueue.push_back({&p_query, std::move(p_callback)});
+    m_asyncCond.notify_one();
+    return ErrorCode::Success;
+}
+
+template <typename T>
+std::future<ErrorCode> Index<T>::SearchIndexAsync(QueryResult& p_query) const {
+    auto promise = std::make_shared<std::promise<ErrorCode>>();
+    std::future<ErrorCode> result = promise->get_future();
+    ErrorCode ret = SearchIndexAsync(p_query, [promise](ErrorCode p_ret) { promise->set_value(p_ret); });
+    if (ret != ErrorCode::Success)
+        promise->set_value(ret);
+    return result;
+}
+
+template <typename T>
+void Index<T>::StopAsyncSearch() const {
+    std::vector<std::thread> threads;
+    {
+        std::lock_guard<std::mutex> lock(m_asyncLock);
+        m_asyncStop = true;
+        threads.swap(m_asyncThreads);
+    }
+    m_asyncCond.notify_all();
+    for (auto& thread : threads)
+        thread.join();
+
+    std::lock_guard<std::mutex> lock(m_asyncLock);
+    m_asyncStop = false;
+}
+
+template <typename T>
+void Index<T>::AsyncSearchLoop() const {
+    if (m_extraSearcher != nullptr)
+        m_extraSearcher->Initialize();
+
+    std::vector<AsyncRequest> batch;
+    std::vector<QueryResult*> queries;
+    while (true) {
+        {
+            std::unique_lock<std::mutex> lock(m_asyncLock);
+            m_asyncCond.wait(lock, [this] { return m_asyncStop || !m_asyncQueue.empty(); });
+            if (m_asyncQueue.empty())
+                break;
+            auto end = m_asyncQueue.begin() + min((int)m_asyncQueue.size(), max(1, m_options.m_asyncBatchSize));
+            batch.assign(std::make_move_iterator(m_asyncQueue.begin()), std::make_move_iterator(end));
+            m_asyncQueue.erase(m_asyncQueue.begin(), end);
+        }
+
+        queries.clear();
+        for (auto& request : batch)
+            queries.push_back(request.m_query);
+        ErrorCode ret = SearchIndexBatch(queries, nullptr);
+        for (auto& request : batch)
+            request.m_callback(ret);
+        batch.clear();
+    }
+
+    if (m_extraSearcher != nullptr)
+        m_extraSearcher->ExitBlockController();
+}
+
+template <typename T>
+void Index<T>::SearchPostingsInWaves(COMMON::QueryResultSet<T>& p_queryResults, int p_resultNum, SearchStats* p_stats) const {
+    const auto& probeIDs = m_workspace->m_probeIDs;
+    const auto& probeDists = m_workspace->m_probeDists;
+    int resultNum = max(1, min(p_resultNum, p_queryResults.GetResultNum()));
+
+    SearchStats waveStats;
+    if (p_stats) {
+        waveStats = *p_stats;
+        p_stats->m_exSetUpLatency = p_stats->m_compLatency = p_stats->m_diskReadLatency = 0;
+        p_stats->m_totalListElementsCount = p_stats->m_diskIOCount = p_stats->m_diskAccessCount = 0;
+        p_stats->m_skippedPostings = 0;
+        p_stats->m_partial = false;
+    }
+
+    auto& dists = m_workspace->m_waveDists;
+    dists.resize(p_queryResults.GetResultNum());
+    auto probeStart = std::chrono::high_resolution_clock::now();
+    size_t next = 0;
+    int waveSize = m_options.m_probeFirstWave;
+    while (next < probeIDs.size()) {
+        if (p_queryResults.HasDeadline() && std::chrono::steady_clock::now() >= p_queryResults.GetDeadline()) {
+            if (p_stats) {
+                p_stats->m_skippedPostings += (int)(probeIDs.size() - next);
+                p_stats->m_partial = true;
+            }
+            break;
+        }
+        size_t end = min(probeIDs.size(), next + (size_t)waveSize);
+        m_workspace->m_postingIDs.assign(probeIDs.begin() + next, probeIDs.begin() + end);
+        next = end;
+
+        if (p_stats) {
+            // the searcher's deadline counts from the query start, not from this wave
+            waveStats.m_totalLatency = p_stats->m_totalLatency + (double)std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::high_resolution_clock::now() - probeStart).count();
         }
+        m_extraSearcher->SearchIndex(m_workspace.get(), p_queryResults, m_index, p_stats ? &waveStats : nullptr, nullptr, nullptr);
+        if (p_stats) {
+            p_stats->m_exSetUpLatency += waveStats.m_exSetUpLatency;
+            p_stats->m_compLatency += waveStats.m_compLatency;
+            p_stats->m_diskReadLatency += waveStats.m_diskReadLatency;
+            p_stats->m_totalListElementsCount += waveStats.m_totalListElementsCount;
+            p_stats->m_diskIOCount += waveStats.m_diskIOCount;
+            p_stats->m_diskAccessCount += waveStats.m_diskAccessCount;
+            p_stats->m_skippedPostings += waveStats.m_skippedPostings;
+            p_stats->m_partial = p_stats->m_partial || waveStats.m_partial;
+        }
+        if (next >= probeIDs.size())
+            break;
+
+        // a posting is still worth reading while its head is not much farther away than the
+        // current k-th result, its members are spread around the head
+        for (int i = 0; i < p_queryResults.GetResultNum(); ++i)
+            dists[i] = p_queryResults.GetResult(i)->Dist;
+        std::nth_element(dists.begin(), dists.begin() + (resultNum - 1), dists.end());
+        float kthDist = dists[resultNum - 1];
+        if (kthDist < MaxDist && probeDists[next] > kthDist * m_options.m_probeStopRatio)
+            break;
+        waveSize = max(1, m_options.m_probeWaveSize);
+    }
+}
+
+template <typename T>
+ErrorCode Index<T>::PrepareRerank(std::shared_ptr<Helper::VectorSetReader<T>> p_reader) {
+    m_rerankVectors.reset();
+    m_rerankFromStore = false;
+    if (!m_options.m_enableADC || m_options.m_adcRerank <= 0)
+        return ErrorCode::Success;
+
+    // a build fills the store with every vector. One configured on load may hold only what was
+    // inserted since, the vector file covers the VIDs it lacks
+    if (m_extraSearcher != nullptr && m_extraSearcher->HasVectorStore()) {
+        m_rerankFromStore = true;
+        LOG(Helper::LogLevel::LL_Info, "ADC rerank: top %d results from the vector store\n", m_options.m_adcRerank);
+        if (p_reader != nullptr)
+            return ErrorCode::Success;
     }
+
+    if (p_reader == nullptr) {
+        std::string path = m_options.m_fullVectorPath.empty() ? m_options.m_vectorPath : m_options.m_fullVectorPath;
+        if (path.empty() || !fileexists(path.c_str())) {
+            if (!m_rerankFromStore)
+                LOG(Helper::LogLevel::LL_Warning, "No vector file for ADC rerank, keeping the ADC distances.\n");
+            return ErrorCode::Success;
+        }
+        p_reader = Helper::VectorSetReader<T>::CreateInstance(0, m_options.m_dim, m_options.m_vectorDelimiter, m_options.m_iSSDNumberOfThreads);
+        if (ErrorCode::Success != p_reader->LoadFile(path)) {
+            LOG(Helper::LogLevel::LL_Error, "Failed to read vector file %s for ADC rerank.\n", path.c_str());
+            return ErrorCode::Fail;
+        }
+    }
+    m_rerankVectors = p_reader->GetVectorSet();
+    m_rerankNormalized = m_options.m_distCalcMethod != DistCalcMethod::Cosine || p_reader->IsNormalized();
+    LOG(Helper::LogLevel::LL_Info, "ADC rerank: top %d results over %d full vectors\n", m_options.m_adcRerank, m_rerankVectors->Count());
     return ErrorCode::Success;
 }
 
+template <typename T>
+void Index<T>::RerankResults(COMMON::QueryResultSet<T>& p_queryResults) const {
+    if (!m_rerankFromStore && m_rerankVectors == nullptr)
+        return;
+
+    int rerankNum = min(m_options.m_adcRerank, p_queryResults.GetResultNum());
+    std::vector<bool> found(rerankNum, false);
+    if (m_rerankFromStore) {
+        // the store holds the vectors as inserted, normalized already, and covers the inserted ones too
+        std::vector<SizeType> vids(rerankNum);
+        for (int i = 0; i < rerankNum; ++i) vids[i] = p_queryResults.GetResult(i)->VID;
+        std::vector<T> vectors((size_t)rerankNum * m_options.m_dim);
+        if (m_extraSearcher->GetFullVectors(vids, vectors.data(), found) != ErrorCode::Success)
+            found.assign(rerankNum, false);
+        for (int i = 0; i < rerankNum; ++i) {
+            if (found[i])
+                p_queryResults.GetResult(i)->Dist = m_fComputeDistance((const T*)p_queryResults.GetTarget(), vectors.data() + (size_t)i * m_options.m_dim, m_options.m_dim);
+        }
+    }
+
+    // the vector file is mapped read-only, the dot product with a Cosine vector that is not
+    // normalized is scaled by its norm instead
+    int base = COMMON::Utils::GetBase<T>();
+    for (int i = 0; i < rerankNum && m_rerankVectors != nullptr; ++i) {
+        auto res = p_queryResults.GetResult(i);
+        if (found[i] || res->VID < 0 || res->VID >= m_rerankVectors->Count())
+            continue;
+        const T* vector = (const T*)m_rerankVectors->GetVector(res->VID);
+        res->Dist = m_fComputeDistance((const T*)p_queryResults.GetTarget(), vector, m_options.m_dim);
+        if (!m_rerankNormalized) {
+            double norm = COMMON::Utils::Norm(vector, m_options.m_dim);
+            if (norm >= 1e-6)
+                res->Dist = m_iBaseSquare - (m_iBaseSquare - res->Dist) * (float)(base / norm);
+        }
+    }
+    std::sort(p_queryResults.GetResults(), p_queryResults.GetResults() + rerankNum, [](const BasicResult& a, const BasicResult& b) {
+        return a.Dist < b.Dist;
+    });
+}
+
 template <typename T>
 ErrorCode Index<T>::SearchDiskIndex(QueryResult& p_query, SearchStats* p_stats) const {
     if (nullptr == m_extraSearcher)
@@ -332,10 +960,7 @@ ErrorCode Index<T>::SearchDiskIndex(QueryResult& p_query, SearchStats* p_stats)
 
     COMMON::QueryResultSet<T>* p_queryResults = (COMMON::QueryResultSet<T>*)&p_query;
 
-    if (m_workspace.get() == nullptr) {
-        m_workspace.reset(new ExtraWorkSpace());
-        m_workspace->Initialize(m_options.m_maxCheck, m_options.m_hashExp, m_options.m_searchInternalResultNum, min(m_options.m_postingPageLimit, m_options.m_searchPostingPageLimit + 1) << PageSizeEx, m_options.m_enableDataCompression);
-    }
+    GetWorkSpace();
     m_workspace->m_deduper.clear();
     m_workspace->m_postingIDs.clear();
 
@@ -397,10 +1022,7 @@ ErrorCode Index<T>::DebugSearchDiskIndex(QueryResult& p_query, int p_subInternal
         newResults.reset(new COMMON::QueryResultSet<T>((T*)p_query.GetTarget(), p_query.GetResultNum()));
     }
 
-    if (m_workspace.get() == nullptr) {
-        m_workspace.reset(new ExtraWorkSpace());
-        m_workspace->Initialize(m_options.m_maxCheck, m_options.m_hashExp, m_options.m_searchInternalResultNum, min(m_options.m_postingPageLimit, m_options.m_searchPostingPageLimit + 1) << PageSizeEx, m_options.m_enableDataCompression);
-    }
+    GetWorkSpace();
     m_workspace->m_deduper.clear();
 
     int partitions = (p_internalResultNum + p_subInternalResultNum - 1) / p_subInternalResultNum;
@@ -600,6 +1222,26 @@ bool Index<T>::SelectHeadInternal(std::shared_ptr<Helper::VectorSetReader<T>>& p
         std::shuffle(selected.begin(), selected.end(), rg);
         int headCnt = static_cast<int>(std::round(m_options.m_ratio * data.R()));
         selected.resize(headCnt);
+    } else if (Helper::StrUtils::StrEqualIgnoreCase(m_options.m_selectType.c_str(), "Kmeans")) {
+        COMMON::MiniBatchKmeans<InternalDataType> kmeans;
+        kmeans.m_branch = (std::max)(m_options.m_iBKTKmeansK, 2);
+        kmeans.m_batchSize = (std::max)(m_options.m_kmeansBatchSize, 1);
+        kmeans.m_iterations = m_options.m_kmeansIterations;
+        kmeans.m_samples = m_options.m_kmeansSamples;
+        kmeans.m_refine = m_options.m_kmeansRefine;
+        kmeans.m_threads = m_options.m_iSelectHeadNumberOfThreads;
+        int headCnt = static_cast<int>(std::round(m_options.m_ratio * data.R()));
+        LOG(Helper::LogLevel::LL_Info, "Start selecting %d heads by mini-batch k-means. Branch: %d, BatchSize: %d, Iterations: %d, Samples: %d, Refine: %d, ThreadNum: %d.\n",
+            headCnt, kmeans.m_branch, kmeans.m_batchSize, kmeans.m_iterations, kmeans.m_samples, (int)kmeans.m_refine, kmeans.m_threads);
+        kmeans.SelectHeads(data, m_options.m_distCalcMethod, headCnt, selected);
+        auto t2 = std::chrono::high_resolution_clock::now();
+        LOG(Helper::LogLevel::LL_Info, "Finish k-means head selection over %zu clusters in %.2lf minutes.\n", kmeans.NodeCount(),
+            std::chrono::duration_cast<std::chrono::seconds>(t2 - t1).count() / 60.0);
+
+        if (selected.empty()) {
+            LOG(Helper::LogLevel::LL_Error, "Can't select any vector as head with current settings\n");
+            return false;
+        }
     } else if (Helper::StrUtils::StrEqualIgnoreCase(m_options.m_selectType.c_str(), "BKT")) {
         LOG(Helper::LogLevel::LL_Info, "Start generating BKT.\n");
         std::shared_ptr<COMMON::BKTree> bkt = std::make_shared<COMMON::BKTree>();
@@ -608,6 +1250,8 @@ bool Index<T>::SelectHeadInternal(std::shared_ptr<Helper::VectorSetReader<T>>& p
         bkt->m_iSamples = m_options.m_iSamples;
         bkt->m_iTreeNumber = m_options.m_iTreeNumber;
         bkt->m_fBalanceFactor = m_options.m_fBalanceFactor;
+        bkt->m_iKmeansBatch = m_options.m_iBKTKmeansBatch;
+        bkt->m_fKmeansTolerance = m_options.m_fBKTKmeansTolerance;
         LOG(Helper::LogLevel::LL_Info, "Start invoking BuildTrees.\n");
         LOG(Helper::LogLevel::LL_Info, "BKTKmeansK: %d, BKTLeafSize: %d, Samples: %d, BKTLambdaFactor:%f TreeNumber: %d, ThreadNum: %d.\n",
             bkt->m_iBKTKmeansK, bkt->m_iBKTLeafSize, bkt->m_iSamples, bkt->m_fBalanceFactor, bkt->m_iTreeNumber, m_options.m_iSelectHeadNumberOfThreads);
@@ -692,9 +1336,21 @@ ErrorCode Index<T>::BuildIndexInternal(std::shared_ptr<Helper::VectorSetReader<T
         }
     }
 
+    // a manifest left by a build over another input or with another replica layout is ignored
+    BuildCheckpoint checkpoint;
+    std::string fingerprint = std::to_string(m_options.m_vectorSize) + "," + std::to_string(m_options.m_dim) + "," +
+                              Helper::Convert::ConvertToString(m_options.m_valueType) + "," + Helper::Convert::ConvertToString(m_options.m_distCalcMethod) + "," +
+                              std::to_string(m_options.m_replicaCount) + "," + std::to_string(m_options.m_batches);
+    if (checkpoint.Open(m_options.m_indexDirectory + FolderSep + m_options.m_buildCheckpointFile, fingerprint, m_options.m_resumeBuild) != ErrorCode::Success)
+        return ErrorCode::Fail;
+    ApplyMemoryPolicy();
+    Helper::TaskScheduler::Instance().Configure(m_options.m_taskArenaThreads > 0 ? m_options.m_taskArenaThreads : m_options.m_iSSDNumberOfThreads, m_options.m_numaTaskArenas);
+
     LOG(Helper::LogLevel::LL_Info, "Begin Select Head...\n");
     auto t1 = std::chrono::high_resolution_clock::now();
-    if (m_options.m_selectHead) {
+    if (m_options.m_selectHead && checkpoint.Done(BuildCheckpoint::kSelectHead)) {
+        LOG(Helper::LogLevel::LL_Info, "Heads were selected by an earlier run, skipping.\n");
+    } else if (m_options.m_selectHead) {
         omp_set_num_threads(m_options.m_iSelectHeadNumberOfThreads);
         bool success = false;
         success = SelectHeadInternal<T>(p_reader);
@@ -702,13 +1358,17 @@ ErrorCode Index<T>::BuildIndexInternal(std::shared_ptr<Helper::VectorSetReader<T
             LOG(Helper::LogLevel::LL_Error, "SelectHead Failed!\n");
             return ErrorCode::Fail;
         }
+        if (checkpoint.MarkDone(BuildCheckpoint::kSelectHead) != ErrorCode::Success)
+            return ErrorCode::Fail;
     }
     auto t2 = std::chrono::high_resolution_clock::now();
     double selectHeadTime = std::chrono::duration_cast<std::chrono::seconds>(t2 - t1).count();
     LOG(Helper::LogLevel::LL_Info, "select head time: %.2lfs\n", selectHeadTime);
 
     LOG(Helper::LogLevel::LL_Info, "Begin Build Head...\n");
-    if (m_options.m_buildHead) {
+    if (m_options.m_buildHead && checkpoint.Done(BuildCheckpoint::kBuildHead)) {
+        LOG(Helper::LogLevel::LL_Info, "Head index was built by an earlier run, skipping.\n");
+    } else if (m_options.m_buildHead) {
         auto valueType = m_options.m_valueType;
         auto dims = m_options.m_dim;
 
@@ -718,6 +1378,7 @@ ErrorCode Index<T>::BuildIndexInternal(std::shared_ptr<Helper::VectorSetReader<T
         for (const auto& iter : m_headParameters) {
             m_index->SetParameter(iter.first.c_str(), iter.second.c_str());
         }
+        ApplyMemoryPolicy();
 
         std::shared_ptr<Helper::ReaderOptions> vectorOptions(new Helper::ReaderOptions(valueType, dims));
         auto vectorReader = Helper::VectorSetReader<T>::CreateInstance(0, dims, m_options.m_vectorDelimiter);
@@ -743,6 +1404,8 @@ ErrorCode Index<T>::BuildIndexInternal(std::shared_ptr<Helper::VectorSetReader<T
         } else {
             m_index = tmpIndex;
         }
+        if (checkpoint.MarkDone(BuildCheckpoint::kBuildHead) != ErrorCode::Success)
+            return ErrorCode::Fail;
     }
     auto t3 = std::chrono::high_resolution_clock::now();
     double buildHeadTime = std::chrono::duration_cast<std::chrono::seconds>(t3 - t2).count();
@@ -772,9 +1435,16 @@ ErrorCode Index<T>::BuildIndexInternal(std::shared_ptr<Helper::VectorSetReader<T
             LOG(Helper::LogLevel::LL_Info, "Currently unsupport SPDK with inplace!\n");
             exit(1);
         }
-        m_extraSearcher.reset(new ExtraDynamicSearcher<T>(m_options.m_spdkMappingPath.c_str(), m_options.m_dim, m_options.m_postingPageLimit, m_options.m_useDirectIO, m_options.m_latencyLimit, m_options.m_mergeThreshold, m_options.m_spdkBatchSize, m_options.m_spdkCapacity));
+        std::shared_ptr<BlockDevice> device;
+        if (CreateBlockDevice(m_options, device) != ErrorCode::Success)
+            return ErrorCode::Fail;
+        m_extraSearcher.reset(new ExtraDynamicSearcher<T>(m_options.m_spdkMappingPath.c_str(), m_options.m_dim, m_options.m_postingPageLimit, m_options.m_useDirectIO, m_options.m_latencyLimit, m_options.m_mergeThreshold, m_options.m_spdkBatchSize, m_options.m_bufferLength, m_options.m_spdkCapacity, false, device));
 
-        if (m_options.m_buildSsdIndex) {
+        if (m_options.m_buildSsdIndex && checkpoint.Done(BuildCheckpoint::kPostings)) {
+            LOG(Helper::LogLevel::LL_Info, "Postings were written by an earlier run, skipping.\n");
+            if (!m_extraSearcher->RestoreBuild(m_index, m_options, m_versionMap))
+                return ErrorCode::Fail;
+        } else if (m_options.m_buildSsdIndex) {
             if (!m_options.m_excludehead) {
                 LOG(Helper::LogLevel::LL_Info, "Include all vectors into SSD index...\n");
                 if (fileexists((m_options.m_indexDirectory + FolderSep + m_options.m_headIDFile).c_str()) &&
@@ -783,7 +1453,7 @@ ErrorCode Index<T>::BuildIndexInternal(std::shared_ptr<Helper::VectorSetReader<T
                 }
             }
 
-            if (!m_extraSearcher->BuildIndex(p_reader, m_index, m_options, m_versionMap)) {
+            if (!m_extraSearcher->BuildIndex(p_reader, m_index, m_options, m_versionMap, -1, &checkpoint)) {
                 LOG(Helper::LogLevel::LL_Error, "BuildSSDIndex Failed!\n");
                 if (m_options.m_buildSsdIndex) {
                     return ErrorCode::Fail;
@@ -791,6 +1461,12 @@ ErrorCode Index<T>::BuildIndexInternal(std::shared_ptr<Helper::VectorSetReader<T
                     m_extraSearcher.reset();
                 }
             }
+            // postings can only be skipped on restart if their sizes were saved
+            if (checkpoint.Enabled() && !m_options.m_ssdInfoFile.empty()) {
+                m_extraSearcher->PersistStorage();
+                if (checkpoint.MarkDone(BuildCheckpoint::kPostings) != ErrorCode::Success)
+                    return ErrorCode::Fail;
+            }
         }
         if (!m_extraSearcher->LoadIndex(m_options, m_versionMap)) {
             LOG(Helper::LogLevel::LL_Error, "Cannot Load SSDIndex!\n");
@@ -807,9 +1483,18 @@ ErrorCode Index<T>::BuildIndexInternal(std::shared_ptr<Helper::VectorSetReader<T
                 }
                 IOBINARY(ptr, ReadBinary, sizeof(std::uint64_t) * m_index->GetNumSamples(), (char*)(m_vectorTranslateMap.get()));
             }
-            if (m_options.m_preReassign) {
+            if (m_options.m_preReassign && checkpoint.Done(BuildCheckpoint::kRefine)) {
+                LOG(Helper::LogLevel::LL_Info, "Index was refined by an earlier run, skipping.\n");
+            } else if (m_options.m_preReassign) {
                 m_extraSearcher->RefineIndex(p_reader, m_index);
+                if (checkpoint.Enabled()) {
+                    m_extraSearcher->PersistStorage();
+                    if (checkpoint.MarkDone(BuildCheckpoint::kRefine) != ErrorCode::Success)
+                        return ErrorCode::Fail;
+                }
             }
+            if (PrepareRerank(p_reader) != ErrorCode::Success)
+                return ErrorCode::Fail;
         }
     }
 
@@ -824,7 +1509,13 @@ ErrorCode Index<T>::BuildIndexInternal(std::shared_ptr<Helper::VectorSetReader<T
         }
     }
 
+    if (OpenWriteAheadLog(false) != ErrorCode::Success)
+        return ErrorCode::Fail;
+
+    checkpoint.Remove();
     m_bReady = true;
+    StartMetricsExporter();
+    StartAutoTuner();
     return ErrorCode::Success;
 }
 
@@ -839,7 +1530,8 @@ ErrorCode Index<T>::BuildIndex(bool p_normalized) {
     SPTAG::VectorValueType valueType = m_options.m_valueType;
     SizeType dim = m_options.m_dim;
     std::shared_ptr<Helper::ReaderOptions> vectorOptions(new Helper::ReaderOptions(valueType, dim, m_options.m_vectorDelimiter, m_options.m_iSSDNumberOfThreads, p_normalized));
-    auto vectorReader = Helper::VectorSetReader<T>::CreateInstance(0, m_options.m_dim, m_options.m_vectorDelimiter);
+    // VectorSize, when set, builds on a prefix of the vector file
+    auto vectorReader = Helper::VectorSetReader<T>::CreateInstance((std::max)(m_options.m_vectorSize, (SizeType)0), m_options.m_dim, m_options.m_vectorDelimiter);
     if (m_options.m_vectorPath.empty()) {
         LOG(Helper::LogLevel::LL_Info, "Vector file is empty. Skipping loading.\n");
     } else {
@@ -872,11 +1564,24 @@ ErrorCode Index<T>::SetParameter(const char* p_param, const char* p_value, const
             m_headParameters[p_param] = p_value;
     } else {
         m_options.SetParameter(p_section, p_param, p_value);
+        if (m_extraSearcher != nullptr)
+            m_extraSearcher->ApplyParameter(p_param);
     }
-    if (SPTAG::Helper::StrUtils::StrEqualIgnoreCase(p_param, "DistCalcMethod")) {
-        m_fComputeDistance = COMMON::DistanceCalcSelector<T>(m_options.m_distCalcMethod);
-        m_iBaseSquare = (m_options.m_distCalcMethod == DistCalcMethod::Cosine) ? COMMON::Utils::GetBase<T>() * COMMON::Utils::GetBase<T>() : 1;
-    }
+    // the kernel is the one of the configured dimension, the head index picks its own
+    if (SPTAG::Helper::StrUtils::StrEqualIgnoreCase(p_param, "DistCalcMethod") || SPTAG::Helper::StrUtils::StrEqualIgnoreCase(p_param, "Dim"))
+        m_fComputeDistance = COMMON::DistanceCalcSelector<T>(m_options.m_distCalcMethod, m_options.m_dim);
+    if (SPTAG::Helper::StrUtils::StrEqualIgnoreCase(p_param, "DistCalcMethod"))
+        m_iBaseSquare = (m_options.m_distCalcMethod != DistCalcMethod::L2) ? COMMON::Utils::GetBase<T>() * COMMON::Utils::GetBase<T>() : 1;
+    // any other parameter may change what a search returns, the cached results go
+    if (SPTAG::Helper::StrUtils::StrEqualIgnoreCase(p_param, "ResultCacheMB"))
+        m_resultCache.SetCapacity((size_t)(std::max)(m_options.m_resultCacheMB, 0) << 20);
+    else if (SPTAG::Helper::StrUtils::StrEqualIgnoreCase(p_param, "ResultCacheInvalidation")) {
+        m_resultCacheGlobal = SPTAG::Helper::StrUtils::StrEqualIgnoreCase(m_options.m_resultCacheInvalidation.c_str(), "Global");
+        if (!m_resultCacheGlobal && !SPTAG::Helper::StrUtils::StrEqualIgnoreCase(m_options.m_resultCacheInvalidation.c_str(), "Posting"))
+            LOG(Helper::LogLevel::LL_Warning, "Unknown ResultCacheInvalidation %s, using Posting.\n", m_options.m_resultCacheInvalidation.c_str());
+        m_resultCache.Clear();
+    } else
+        m_resultCache.Clear();
     return ErrorCode::Success;
 }
 
@@ -908,22 +1613,54 @@ ErrorCode Index<T>::AddIndex(const void* p_data, SizeType p_vectorNum, Dimension
         return ErrorCode::EmptyData;
     if (p_dimension != GetFeatureDim())
         return ErrorCode::DimensionSizeMismatch;
+    ErrorCode admitted = m_extraSearcher->AdmitInsert(m_replayingWAL ? -1 : m_options.m_insertWaitTimeout);
+    if (admitted != ErrorCode::Success)
+        return admitted;
+    // from the log record on, so every record up to the LSN a backup notes is applied in it
+    WriteGate::Scope gate(UpdateGate());
+
+    // Cosine vectors go in as they are with their norms, normalized only as they are written out
+    std::shared_ptr<VectorSet> vectorSet;
+    std::vector<double> norms;
+    if (m_options.m_distCalcMethod == DistCalcMethod::Cosine && !p_normalized) {
+        norms.resize(p_vectorNum);
+        for (SizeType i = 0; i < p_vectorNum && !norms.empty(); i++) {
+            norms[i] = COMMON::Utils::Norm((const T*)p_data + (size_t)i * p_dimension, p_dimension);
+            // a zero vector has no direction to scale to, such batches take the normalized copy
+            if (norms[i] < 1e-6)
+                norms.clear();
+        }
+    }
+    if (m_options.m_distCalcMethod == DistCalcMethod::Cosine && !p_normalized && norms.empty()) {
+        ByteArray arr = ByteArray::Alloc(sizeof(T) * p_vectorNum * p_dimension);
+        vectorSet.reset(new BasicVectorSet(arr, GetEnumValueType<T>(), p_dimension, p_vectorNum));
+        int base = COMMON::Utils::GetBase<T>();
+        for (SizeType i = 0; i < p_vectorNum; i++) {
+            COMMON::Utils::NormalizeTo((const T*)p_data + (size_t)i * p_dimension, (T*)(vectorSet->GetVector(i)), p_dimension, base);
+        }
+    } else {
+        vectorSet.reset(new BasicVectorSet(ByteArray((std::uint8_t*)p_data, sizeof(T) * p_vectorNum * p_dimension, false), GetEnumValueType<T>(), p_dimension, p_vectorNum));
+    }
 
     SizeType begin, end;
+    std::uint64_t lsn = 0;
     {
-        std::lock_guard<std::mutex> lock(m_dataAddLock);
-
-        begin = m_versionMap.GetVectorNum();
-        end = begin + p_vectorNum;
+        std::unique_lock<std::mutex> lock(m_dataAddLock, std::defer_lock);
+        if (m_wal.IsOpen() || m_pMetadata != nullptr)
+            lock.lock();
 
-        if (begin == 0) {
+        if (m_versionMap.GetVectorNum() == 0) {
             return ErrorCode::EmptyIndex;
         }
 
-        if (m_versionMap.AddBatch(p_vectorNum) != ErrorCode::Success) {
-            LOG(Helper::LogLevel::LL_Info, "MemoryOverFlow: VID: %d, Map Size:%d\n", begin, m_versionMap.BufferSize());
+        if (m_versionMap.AddBatch(p_vectorNum, &begin) != ErrorCode::Success) {
+            LOG(Helper::LogLevel::LL_Info, "MemoryOverFlow: VID: %d, Map Size:%d\n", m_versionMap.GetVectorNum(), m_versionMap.BufferSize());
             exit(1);
         }
+        end = begin + p_vectorNum;
+        // the vectors are logged as they go in, raw ones are normalized again on replay; metadata is not logged
+        if (m_wal.IsOpen())
+            lsn = m_wal.Append(norms.empty() ? WriteAheadLog::RecordType::Insert : WriteAheadLog::RecordType::InsertRaw, begin, p_vectorNum, vectorSet->GetData(), sizeof(T) * p_vectorNum * p_dimension);
 
         if (m_pMetadata != nullptr) {
             if (p_metadataSet != nullptr) {
@@ -942,50 +1679,186 @@ ErrorCode Index<T>::AddIndex(const void* p_data, SizeType p_vectorNum, Dimension
         }
     }
 
-    std::shared_ptr<VectorSet> vectorSet;
-    if (m_options.m_distCalcMethod == DistCalcMethod::Cosine && !p_normalized) {
-        ByteArray arr = ByteArray::Alloc(sizeof(T) * p_vectorNum * p_dimension);
-        memcpy(arr.Data(), p_data, sizeof(T) * p_vectorNum * p_dimension);
-        vectorSet.reset(new BasicVectorSet(arr, GetEnumValueType<T>(), p_dimension, p_vectorNum));
-        int base = COMMON::Utils::GetBase<T>();
-        for (SizeType i = 0; i < p_vectorNum; i++) {
-            COMMON::Utils::Normalize((T*)(vectorSet->GetVector(i)), p_dimension, base);
-        }
-    } else {
-        vectorSet.reset(new BasicVectorSet(ByteArray((std::uint8_t*)p_data, sizeof(T) * p_vectorNum * p_dimension, false), GetEnumValueType<T>(), p_dimension, p_vectorNum));
-    }
-
-    return m_extraSearcher->AddIndex(vectorSet, m_index, begin);
+    if (lsn != 0 && !m_wal.Commit(lsn))
+        return ErrorCode::DiskIOFail;
+    return m_extraSearcher->AddIndex(vectorSet, m_index, begin, norms.empty() ? nullptr : norms.data());
 }
 
 template <typename T>
 ErrorCode Index<T>::DeleteIndex(const SizeType& p_id) {
+    WriteGate::Scope gate(UpdateGate());
+    std::uint64_t lsn = m_wal.Append(WriteAheadLog::RecordType::Delete, p_id, 1);
+    if (lsn != 0 && !m_wal.Commit(lsn))
+        return ErrorCode::DiskIOFail;
     if (m_versionMap.Delete(p_id))
         return ErrorCode::Success;
     return ErrorCode::VectorNotFound;
 }
 
+// one WAL record per run of consecutive IDs and one sync for the whole batch. Succeeds when every
+// distinct ID that was live got deleted, repeated and already deleted ones are skipped
+template <typename T>
+ErrorCode Index<T>::DeleteIndex(const std::vector<SizeType>& p_ids) {
+    std::vector<SizeType> ids;
+    ids.reserve(p_ids.size());
+    for (SizeType id : p_ids) {
+        if (id >= 0 && id < m_versionMap.GetVectorNum() && !m_versionMap.Deleted(id))
+            ids.push_back(id);
+    }
+    std::sort(ids.begin(), ids.end());
+    ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+    if (ids.empty())
+        return ErrorCode::VectorNotFound;
+
+    WriteGate::Scope gate(UpdateGate());
+    std::uint64_t lsn = 0;
+    for (size_t first = 0; first < ids.size();) {
+        size_t last = first + 1;
+        while (last < ids.size() && ids[last] == ids[last - 1] + 1) last++;
+        lsn = m_wal.Append(WriteAheadLog::RecordType::Delete, ids[first], (SizeType)(last - first));
+        first = last;
+    }
+    if (lsn != 0 && !m_wal.Commit(lsn))
+        return ErrorCode::DiskIOFail;
+    SizeType deleted = m_versionMap.Delete(ids);
+    // a concurrent delete taking one of them first leaves it short
+    return (size_t)deleted == ids.size() ? ErrorCode::Success : ErrorCode::VectorNotFound;
+}
+
+template <typename T>
+ErrorCode Index<T>::DeleteIndex(const std::vector<ByteArray>& p_metas) {
+    if (!m_metadataManager.HasMetaMapping())
+        return ErrorCode::VectorNotFound;
+
+    std::vector<SizeType> ids;
+    ids.reserve(p_metas.size());
+    for (const ByteArray& meta : p_metas) {
+        std::string key((char*)meta.Data(), meta.Length());
+        SizeType vid = GetMetaMapping(key);
+        if (vid >= 0)
+            ids.push_back(vid);
+    }
+    ErrorCode ret = DeleteIndex(ids);
+    if (ret == ErrorCode::Success && ids.size() != p_metas.size())
+        return ErrorCode::VectorNotFound;
+    return ret;
+}
+
 template <typename T>
 ErrorCode Index<T>::DeleteIndex(const void* p_vectors, SizeType p_vectorNum) {
-    // TODO: Support batch delete
     DimensionType p_dimension = GetFeatureDim();
     std::shared_ptr<VectorSet> vectorSet;
     if (m_options.m_distCalcMethod == DistCalcMethod::Cosine) {
         ByteArray arr = ByteArray::Alloc(sizeof(T) * p_vectorNum * p_dimension);
-        memcpy(arr.Data(), p_vectors, sizeof(T) * p_vectorNum * p_dimension);
         vectorSet.reset(new BasicVectorSet(arr, GetEnumValueType<T>(), p_dimension, p_vectorNum));
         int base = COMMON::Utils::GetBase<T>();
         for (SizeType i = 0; i < p_vectorNum; i++) {
-            COMMON::Utils::Normalize((T*)(vectorSet->GetVector(i)), p_dimension, base);
+            COMMON::Utils::NormalizeTo((const T*)p_vectors + (size_t)i * p_dimension, (T*)(vectorSet->GetVector(i)), p_dimension, base);
         }
     } else {
-        vectorSet.reset(new BasicVectorSet(ByteArray((std::uint8_t*)p_vectors, sizeof(T) * 1 * p_dimension, false), GetEnumValueType<T>(), p_dimension, 1));
+        vectorSet.reset(new BasicVectorSet(ByteArray((std::uint8_t*)p_vectors, sizeof(T) * p_vectorNum * p_dimension, false), GetEnumValueType<T>(), p_dimension, p_vectorNum));
     }
-    SizeType p_id = m_extraSearcher->SearchVector(vectorSet, m_index);
-    if (p_id == -1)
+    std::vector<SizeType> ids;
+    m_extraSearcher->SearchVectors(vectorSet, m_index, ids);
+    size_t requested = ids.size();
+    ids.erase(std::remove(ids.begin(), ids.end(), -1), ids.end());
+    if (ids.empty())
         return ErrorCode::ExternalAbort;
 
-    return DeleteIndex(p_id);
+    ErrorCode ret = DeleteIndex(ids);
+    if (ret == ErrorCode::Success && ids.size() != requested)
+        return ErrorCode::ExternalAbort;
+    return ret;
+}
+
+template <typename T>
+ErrorCode Index<T>::OpenWriteAheadLog(bool p_replay) {
+    if (m_options.m_walPath.empty())
+        return ErrorCode::Success;
+
+    if (p_replay) {
+        // the log is still closed, so the replayed operations are not logged a second time;
+        // records are applied from one thread that sets up the block controller like any writer
+        ErrorCode ret = ErrorCode::Success;
+        std::uint64_t replayed = 0;
+        m_replayingWAL = true;
+        std::thread replayThread([&]() {
+            m_extraSearcher->Initialize();
+            WriteAheadLog::Replay(m_options.m_walPath, [&](const WriteAheadLog::Record& p_record) {
+                if (ret != ErrorCode::Success)
+                    return;
+                if (p_record.m_type == WriteAheadLog::RecordType::Delete) {
+                    for (SizeType vid = p_record.m_first; vid < p_record.m_first + p_record.m_count && vid < m_versionMap.GetVectorNum(); vid++)
+                        m_versionMap.Delete(vid);
+                } else if (!m_options.m_update) {
+                    LOG(Helper::LogLevel::LL_Error, "WAL %s holds inserts, replaying them needs Update=true\n", m_options.m_walPath.c_str());
+                    ret = ErrorCode::Fail;
+                    return;
+                } else if (p_record.m_first != m_versionMap.GetVectorNum() || p_record.m_bytes != sizeof(T) * p_record.m_count * m_options.m_dim) {
+                    LOG(Helper::LogLevel::LL_Error, "WAL record %llu inserts VID %d, index expects %d: log does not belong to this index\n",
+                        (unsigned long long)p_record.m_lsn, p_record.m_first, m_versionMap.GetVectorNum());
+                    ret = ErrorCode::Fail;
+                    return;
+                } else {
+                    ret = AddIndex(p_record.m_payload, p_record.m_count, m_options.m_dim, nullptr, false, p_record.m_type != WriteAheadLog::RecordType::InsertRaw);
+                }
+                replayed++;
+            });
+            m_extraSearcher->ExitBlockController();
+        });
+        replayThread.join();
+        m_replayingWAL = false;
+        if (ret != ErrorCode::Success)
+            return ret;
+        while (m_options.m_update && !AllFinished()) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(20));
+        }
+        LOG(Helper::LogLevel::LL_Info, "Replayed %llu WAL records from %s\n", (unsigned long long)replayed, m_options.m_walPath.c_str());
+    }
+
+    if (!m_wal.Open(m_options.m_walPath, !p_replay))
+        return ErrorCode::FailedOpenFile;
+    return ErrorCode::Success;
+}
+
+// the head index, the version labels, the head ID translation and the label masks are saved while
+// updates are held, next to the posting sizes and mappings the searcher snapshots
+template <typename T>
+ErrorCode Index<T>::BeginBackup(const std::string& p_dir) {
+    if (m_extraSearcher == nullptr || m_index == nullptr) {
+        LOG(Helper::LogLevel::LL_Error, "Backup needs an index opened with Update=true\n");
+        return ErrorCode::Fail;
+    }
+    return m_extraSearcher->StartBackup(p_dir, [&](BackupManifest& p_manifest) -> ErrorCode {
+        std::string dir = p_dir + FolderSep;
+        ErrorCode ret = m_index->SaveIndex(dir + m_options.m_headIndexFolder);
+        if (ret != ErrorCode::Success)
+            return ret;
+        auto& base = p_manifest["Base"];
+        base["HeadIndexFolder"] = m_options.m_headIndexFolder;
+        base["DeletedIDs"] = dir + "DeletedIDs.bin";
+        if ((ret = m_versionMap.Save(base["DeletedIDs"])) != ErrorCode::Success)
+            return ret;
+        // heads added by splits after the build have no vector ID, they map to -1
+        if (m_options.m_excludehead) {
+            std::vector<std::uint64_t> translate(m_index->GetNumSamples(), (std::uint64_t)-1);
+            auto in = SPTAG::f_createIO();
+            if (in == nullptr || !in->Initialize((m_options.m_indexDirectory + FolderSep + m_options.m_headIDFile).c_str(), std::ios::binary | std::ios::in))
+                return ErrorCode::FailedOpenFile;
+            in->ReadBinary(sizeof(std::uint64_t) * translate.size(), (char*)translate.data());
+            auto out = SPTAG::f_createIO();
+            if (out == nullptr || !out->Initialize((dir + m_options.m_headIDFile).c_str(), std::ios::binary | std::ios::out))
+                return ErrorCode::FailedCreateFile;
+            IOBINARY(out, WriteBinary, sizeof(std::uint64_t) * translate.size(), (char*)translate.data());
+        }
+        if (m_labels.IsReady()) {
+            p_manifest["BuildSSDIndex"]["VectorLabelFile"] = dir + "VectorLabels.bin";
+            if ((ret = m_labels.Save(dir + "VectorLabels.bin")) != ErrorCode::Success)
+                return ret;
+        }
+        p_manifest["Backup"]["WALLSN"] = std::to_string(m_wal.LastLSN());
+        return ErrorCode::Success;
+    });
 }
 
 template <typename T>
@@ -1037,6 +1910,102 @@ void Index<T>::UpdateMetaMapping(const std::string& meta, SizeType i) {
     m_metadataManager.UpdateMetaMapping(meta, i);
 }
 
+template <typename T>
+void Index<T>::StartAutoTuner() {
+    if (m_options.m_autoTuneIntervalMs <= 0 || m_extraSearcher == nullptr || m_tunerThread.joinable())
+        return;
+    std::string ranges[AutoTuner::kKnobs] = {m_options.m_autoTuneProbeRange, m_options.m_autoTunePageLimitRange, m_options.m_autoTuneMergeRange,
+                                             m_options.m_autoTuneReassignKRange, m_options.m_autoTuneThreadRange, m_options.m_autoTuneThreadRange};
+    m_tuner = AutoTuner();
+    m_tuner.SetLatencyTarget(m_options.m_autoTuneLatencyTargetUs);
+    int tuned = 0;
+    for (int k = 0; k < AutoTuner::kKnobs; k++) {
+        int low, high;
+        if (ranges[k].empty())
+            continue;
+        if (!AutoTuner::ParseRange(ranges[k], low, high)) {
+            LOG(Helper::LogLevel::LL_Warning, "AutoTune: cannot parse the range %s of %s, the knob stays fixed\n", ranges[k].c_str(), AutoTuner::KnobName(k));
+            continue;
+        }
+        // the posting store's rows have room for the pages it was opened with
+        if (k == AutoTuner::PageLimit)
+            high = (std::min)(high, m_extraSearcher->MaxPostingPages());
+        m_tuner.SetRange((AutoTuner::Knob)k, (std::max)(low, k == AutoTuner::PageLimit || k >= AutoTuner::AppendThreads ? 1 : 0), high);
+        tuned++;
+    }
+    if (tuned == 0) {
+        LOG(Helper::LogLevel::LL_Warning, "AutoTune: no knob has a range, the tuner is not started\n");
+        return;
+    }
+    m_tunerStages = m_extraSearcher->GetStageRecorder().Take(false);
+    m_tunerQueries = m_queryCount.load();
+    m_tunerProbeLimited = m_probeLimitedCount.load();
+    m_tunerVectors = GetNumSamples();
+    TunerSample sample;
+    m_extraSearcher->SampleTuner(sample, m_tunerSplits, m_index.get());
+    m_tunerStop = false;
+    m_tunerThread = std::thread([this] {
+        std::unique_lock<std::mutex> lock(m_tunerLock);
+        while (!m_tunerWake.wait_for(lock, std::chrono::milliseconds(m_options.m_autoTuneIntervalMs), [this] { return m_tunerStop; })) {
+            lock.unlock();
+            AutoTuneStep();
+            lock.lock();
+        }
+    });
+    LOG(Helper::LogLevel::LL_Info, "AutoTune: %d knobs tuned every %d ms\n", tuned, m_options.m_autoTuneIntervalMs);
+}
+
+template <typename T>
+void Index<T>::StopAutoTuner() {
+    {
+        std::lock_guard<std::mutex> lock(m_tunerLock);
+        m_tunerStop = true;
+    }
+    m_tunerWake.notify_all();
+    if (m_tunerThread.joinable())
+        m_tunerThread.join();
+}
+
+template <typename T>
+std::vector<TunerChange> Index<T>::AutoTuneStep() {
+    std::lock_guard<std::mutex> lock(m_tunerStepLock);
+    std::vector<TunerChange> changes;
+    if (m_extraSearcher == nullptr)
+        return changes;
+
+    TunerSample sample;
+    StageSnapshot stages = m_extraSearcher->GetStageRecorder().Take(false);
+    StageSnapshot interval = stages - m_tunerStages;
+    double searchUs = 0;
+    for (int s = 0; s < kSearchStages; s++) searchUs += interval.TotalUs((Stage)s);
+    std::uint64_t timed = interval.Count(Stage::HeadSearch);
+    sample.m_searchLatencyUs = timed > 0 ? searchUs / timed : 0;
+    std::uint64_t queries = m_queryCount.load(), probeLimited = m_probeLimitedCount.load();
+    sample.m_queries = queries - m_tunerQueries;
+    sample.m_probeLimitedRatio = sample.m_queries > 0 ? (double)(probeLimited - m_tunerProbeLimited) / sample.m_queries : 0;
+    SizeType vectors = GetNumSamples();
+    sample.m_inserts = vectors > m_tunerVectors ? (std::uint64_t)(vectors - m_tunerVectors) : 0;
+    std::uint64_t splits = 0;
+    m_extraSearcher->SampleTuner(sample, splits, m_index.get());
+    // the split counter restarts when the stats are printed with reset
+    sample.m_splits = splits >= m_tunerSplits ? splits - m_tunerSplits : splits;
+    m_tunerStages = std::move(stages);
+    m_tunerQueries = queries;
+    m_tunerProbeLimited = probeLimited;
+    m_tunerVectors = vectors;
+    m_tunerSplits = splits;
+
+    int values[AutoTuner::kKnobs] = {m_options.m_searchInternalResultNum, m_options.m_postingPageLimit, m_options.m_mergeThreshold,
+                                     m_options.m_reassignK, m_options.m_appendThreadNum, m_options.m_reassignThreadNum};
+    for (int k = 0; k < AutoTuner::kKnobs; k++) m_tuner.SetValue((AutoTuner::Knob)k, values[k]);
+    changes = m_tuner.Step(sample);
+    for (auto& change : changes) {
+        LOG(Helper::LogLevel::LL_Info, "AutoTune: %s %d -> %d, %s\n", change.m_param.c_str(), change.m_from, change.m_to, change.m_reason.c_str());
+        SetParameter(change.m_param.c_str(), std::to_string(change.m_to).c_str(), "BuildSSDIndex");
+    }
+    return changes;
+}
+
 template <typename T>
 void Index<T>::BuildMetaMapping(bool p_checkDeleted) {
     m_metadataManager.BuildMetaMapping(m_pMetadata.get(), GetNumSamples(), std::function<bool(SizeType)>([this](SizeType idx) -> bool {
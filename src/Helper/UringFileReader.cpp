@@ -0,0 +1,273 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Helper/UringFileReader.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <thread>
+
+namespace SPTAG::Helper {
+bool UringFileIO::Initialize(const char* filePath, int openMode, std::uint64_t maxIOSize, std::uint32_t maxReadRetries, std::uint32_t maxWriteRetries, std::uint16_t threadPoolSize) {
+    m_maxReadRetries = maxReadRetries;
+    m_fileHandle = open(filePath, O_RDONLY | O_DIRECT);
+    if (m_fileHandle < 0 && errno == EINVAL) {
+        LOG(LogLevel::LL_Warning, "UringFileIO: %s does not support O_DIRECT, using buffered I/O\n", filePath);
+        m_fileHandle = open(filePath, O_RDONLY);
+        // polled completions need O_DIRECT
+        m_ioPoll = false;
+    }
+    if (m_fileHandle < 0) {
+        LOG(LogLevel::LL_Error, "Failed to create file handle: %s\n", filePath);
+        return false;
+    }
+
+    unsigned entries = (unsigned)(std::min)((std::max)(maxIOSize, (std::uint64_t)1), (std::uint64_t)4096);
+    for (int i = 0; i < (std::max)((int)threadPoolSize, 1); i++) {
+        m_channels.emplace_back(new Channel());
+        if (!CreateRing(*m_channels.back(), entries))
+            return false;
+    }
+    LOG(LogLevel::LL_Info, "UringFileIO: %s, %d rings of depth %u, sqpoll %d, iopoll %d\n", filePath, (int)m_channels.size(), entries, (int)m_sqPoll, (int)m_ioPoll);
+    return true;
+}
+
+bool UringFileIO::CreateRing(Channel& p_channel, unsigned p_entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    if (m_ioPoll)
+        params.flags |= IORING_SETUP_IOPOLL;
+    if (m_sqPoll) {
+        params.flags |= IORING_SETUP_SQPOLL;
+        params.sq_thread_idle = 2000;
+        if (m_sqPollFd >= 0) {
+            params.flags |= IORING_SETUP_ATTACH_WQ;
+            params.wq_fd = m_sqPollFd;
+        }
+    }
+    int ret = io_uring_queue_init_params(p_entries, &p_channel.m_ring, &params);
+    if (ret < 0 && (m_sqPoll || m_ioPoll)) {
+        LOG(LogLevel::LL_Warning, "UringFileIO: SQPOLL/IOPOLL not available (%s), falling back to interrupt driven rings\n", strerror(-ret));
+        m_sqPoll = m_ioPoll = false;
+        memset(&params, 0, sizeof(params));
+        ret = io_uring_queue_init_params(p_entries, &p_channel.m_ring, &params);
+    }
+    if (ret < 0) {
+        LOG(LogLevel::LL_Error, "UringFileIO: io_uring_queue_init failed: %s\n", strerror(-ret));
+        return false;
+    }
+    if (m_sqPoll && m_sqPollFd < 0)
+        m_sqPollFd = p_channel.m_ring.ring_fd;
+
+    ret = io_uring_register_files(&p_channel.m_ring, &m_fileHandle, 1);
+    if (ret < 0) {
+        LOG(LogLevel::LL_Error, "UringFileIO: io_uring_register_files failed: %s\n", strerror(-ret));
+        io_uring_queue_exit(&p_channel.m_ring);
+        return false;
+    }
+    p_channel.m_entries = p_entries;
+    p_channel.m_ready = true;
+    return true;
+}
+
+bool UringFileIO::ResetRing(Channel& p_channel) {
+    if (p_channel.m_ready) {
+        if (m_sqPollFd == p_channel.m_ring.ring_fd)
+            m_sqPollFd = -1;
+        io_uring_queue_exit(&p_channel.m_ring);
+    }
+    p_channel.m_ready = false;
+    p_channel.m_fixed.clear();
+    return CreateRing(p_channel, p_channel.m_entries);
+}
+
+void UringFileIO::ShutDown() {
+    for (auto& channel : m_channels) {
+        if (channel->m_ready)
+            io_uring_queue_exit(&channel->m_ring);
+        channel->m_ready = false;
+    }
+    m_channels.clear();
+    m_sqPollFd = -1;
+    if (m_fileHandle >= 0)
+        close(m_fileHandle);
+    m_fileHandle = -1;
+}
+
+bool UringFileIO::RegisterBuffers(int p_channel, const struct iovec* p_buffers, int p_count) {
+    if (m_channels.empty() || m_fixedRefused.load(std::memory_order_relaxed))
+        return false;
+    Channel& channel = GetChannel(p_channel);
+    std::lock_guard<std::mutex> lock(channel.m_lock);
+    if (channel.m_fixed.size() == (size_t)p_count) {
+        int i = 0;
+        while (i < p_count && channel.m_fixed[i].iov_base == p_buffers[i].iov_base && channel.m_fixed[i].iov_len == p_buffers[i].iov_len) i++;
+        if (i == p_count)
+            return true;
+    }
+    if (!channel.m_fixed.empty()) {
+        io_uring_unregister_buffers(&channel.m_ring);
+        channel.m_fixed.clear();
+    }
+    int ret = io_uring_register_buffers(&channel.m_ring, p_buffers, p_count);
+    if (ret < 0) {
+        if (!m_fixedRefused.exchange(true))
+            LOG(LogLevel::LL_Warning, "UringFileIO: io_uring_register_buffers failed: %s, check RLIMIT_MEMLOCK. Reading without fixed buffers\n", strerror(-ret));
+        return false;
+    }
+    channel.m_fixed.assign(p_buffers, p_buffers + p_count);
+    return true;
+}
+
+void UringFileIO::Prepare(struct io_uring_sqe* p_sqe, FileBatch& p_batch, std::uint64_t p_batchIndex, std::uint32_t p_request) {
+    AsyncReadRequest* request = p_batch.m_requests[p_request];
+    const auto& fixed = p_batch.m_channel->m_fixed;
+    int index = request->m_bufferIndex;
+    if (index >= 0 && index < (int)fixed.size() && request->m_buffer >= (char*)fixed[index].iov_base &&
+        request->m_buffer + request->m_readSize <= (char*)fixed[index].iov_base + fixed[index].iov_len)
+        io_uring_prep_read_fixed(p_sqe, 0, request->m_buffer, (unsigned)request->m_readSize, request->m_offset, index);
+    else
+        io_uring_prep_read(p_sqe, 0, request->m_buffer, (unsigned)request->m_readSize, request->m_offset);
+    p_sqe->flags |= IOSQE_FIXED_FILE;
+    io_uring_sqe_set_data64(p_sqe, (p_batchIndex << 32) | p_request);
+}
+
+bool UringFileIO::Execute(std::vector<FileBatch>& p_batches) {
+    size_t total = 0, done = 0;
+    for (auto& batch : p_batches) {
+        batch.m_pending.clear();
+        batch.m_next = 0;
+        batch.m_queued = 0;
+        batch.m_inFlight = 0;
+        if (batch.m_requests.empty())
+            continue;
+        batch.m_channel->m_lock.lock();
+        batch.m_retries.assign(batch.m_requests.size(), 0);
+        for (std::uint32_t i = 0; i < (std::uint32_t)batch.m_requests.size(); i++) batch.m_pending.push_back(i);
+        total += batch.m_requests.size();
+    }
+
+    bool success = true;
+    auto complete = [&](FileBatch& p_batch, struct io_uring_cqe* p_cqe) {
+        std::uint64_t data = io_uring_cqe_get_data64(p_cqe);
+        int res = p_cqe->res;
+        io_uring_cqe_seen(&p_batch.m_channel->m_ring, p_cqe);
+        p_batch.m_inFlight--;
+
+        FileBatch& batch = p_batches[data >> 32];
+        std::uint32_t id = (std::uint32_t)data;
+        AsyncReadRequest* request = batch.m_requests[id];
+        if ((res == -EAGAIN || res == -EINTR) && batch.m_retries[id]++ < batch.m_file->m_maxReadRetries) {
+            batch.m_pending.push_back(id);
+            return;
+        }
+        // reads running past the end of the file come back short, the postings end before it
+        request->m_success = res >= 0;
+        if (!request->m_success) {
+            LOG(LogLevel::LL_Error, "UringFileIO: read of %llu bytes at %llu failed: %s\n", (unsigned long long)request->m_readSize, (unsigned long long)request->m_offset, strerror(-res));
+            success = false;
+        }
+        done++;
+        if (request->m_callback)
+            request->m_callback(request->m_success);
+    };
+
+    auto fail = [&](FileBatch& p_batch, std::uint32_t p_id) {
+        AsyncReadRequest* request = p_batch.m_requests[p_id];
+        request->m_success = false;
+        success = false;
+        done++;
+        if (request->m_callback)
+            request->m_callback(false);
+    };
+
+    while (done < total) {
+        // one submit per ring for everything that fits into its submission queue
+        for (size_t b = 0; b < p_batches.size(); b++) {
+            FileBatch& batch = p_batches[b];
+            if (!batch.m_channel->m_ready) {
+                while (batch.m_next < batch.m_pending.size()) fail(batch, batch.m_pending[batch.m_next++]);
+                continue;
+            }
+            while (batch.m_next < batch.m_pending.size()) {
+                struct io_uring_sqe* sqe = io_uring_get_sqe(&batch.m_channel->m_ring);
+                if (sqe == nullptr)
+                    break;
+                batch.m_file->Prepare(sqe, batch, b, batch.m_pending[batch.m_next++]);
+                batch.m_queued++;
+            }
+            if (batch.m_queued == 0)
+                continue;
+            // only what the kernel took is in flight. A short or busy submit leaves the rest
+            // queued and is retried once completions were reaped
+            int submitted = io_uring_submit(&batch.m_channel->m_ring);
+            if (submitted > 0) {
+                submitted = (std::min)(submitted, batch.m_queued);
+                batch.m_queued -= submitted;
+                batch.m_inFlight += submitted;
+            } else if (batch.m_inFlight == 0 && submitted != -EAGAIN && submitted != -EBUSY && submitted != -EINTR) {
+                // nothing to reap would ever unblock the ring. The refused entries would go out
+                // with the next submit on it, so it is replaced
+                LOG(LogLevel::LL_Error, "UringFileIO: submit of %d reads failed: %s\n", batch.m_queued, strerror(submitted < 0 ? -submitted : EIO));
+                for (size_t i = batch.m_next - batch.m_queued; i < batch.m_next; i++) fail(batch, batch.m_pending[i]);
+                batch.m_queued = 0;
+                batch.m_file->ResetRing(*batch.m_channel);
+            }
+        }
+
+        bool progress = false;
+        for (auto& batch : p_batches) {
+            struct io_uring_cqe* cqe;
+            while (batch.m_inFlight > 0 && io_uring_peek_cqe(&batch.m_channel->m_ring, &cqe) == 0) {
+                complete(batch, cqe);
+                progress = true;
+            }
+        }
+        if (progress)
+            continue;
+        auto waiting = std::find_if(p_batches.begin(), p_batches.end(), [](const FileBatch& p_batch) { return p_batch.m_inFlight > 0; });
+        struct io_uring_cqe* cqe;
+        if (waiting != p_batches.end() && io_uring_wait_cqe(&waiting->m_channel->m_ring, &cqe) == 0)
+            complete(*waiting, cqe);
+        else
+            std::this_thread::yield();
+    }
+
+    for (auto& batch : p_batches) {
+        if (!batch.m_requests.empty())
+            batch.m_channel->m_lock.unlock();
+    }
+    return success;
+}
+
+bool UringFileIO::BatchReadFile(AsyncReadRequest* readRequests, std::uint32_t requestCount) {
+    if (requestCount == 0)
+        return true;
+    std::vector<FileBatch> batches(1);
+    batches[0].m_file = this;
+    batches[0].m_channel = &GetChannel(readRequests[0].m_status);
+    for (std::uint32_t i = 0; i < requestCount; i++) batches[0].m_requests.push_back(readRequests + i);
+    return Execute(batches);
+}
+
+bool UringFileIO::BatchRead(std::vector<std::shared_ptr<DiskIO>>& p_handlers, AsyncReadRequest* p_requests, int p_num) {
+    // kept per thread, a query then allocates nothing once the first ones grew the lists
+    static thread_local std::vector<FileBatch> batches;
+    batches.resize(p_handlers.size());
+    for (size_t i = 0; i < p_handlers.size(); i++) {
+        batches[i].m_file = (UringFileIO*)p_handlers[i].get();
+        batches[i].m_requests.clear();
+    }
+    for (int i = 0; i < p_num; i++) batches[p_requests[i].m_status >> 16].m_requests.push_back(p_requests + i);
+    for (auto& batch : batches) {
+        if (!batch.m_requests.empty())
+            batch.m_channel = &batch.m_file->GetChannel(batch.m_requests[0]->m_status);
+    }
+    return Execute(batches);
+}
+
+bool BatchReadFileUring(std::vector<std::shared_ptr<DiskIO>>& handlers, AsyncReadRequest* readRequests, int num) {
+    return UringFileIO::BatchRead(handlers, readRequests, num);
+}
+}  // namespace SPTAG::Helper
@@ -19,7 +19,7 @@ SPTAG::Helper::ReaderOptions::~ReaderOptions() {
 
 template <typename T>
 SPTAG::Helper::VectorSetReader<T>::VectorSetReader(SPTAG::SizeType size, SPTAG::DimensionType dim, std::string p_vectorDelimiter, std::uint32_t p_threadNum, bool p_normalized)
-    : m_size(size), m_dim(dim), m_vectorDelimiter(p_vectorDelimiter), m_threadNum(p_threadNum), m_normalized(p_normalized), m_vectorOutput(""), m_metadataConentOutput(""), m_metadataIndexOutput(""), m_mappedData(nullptr), m_fileSize(0), m_fd(-1) {
+    : m_size(size), m_dim(dim), m_vectorDelimiter(p_vectorDelimiter), m_threadNum(p_threadNum), m_normalized(p_normalized), m_vectorOutput(""), m_metadataConentOutput(""), m_metadataIndexOutput(""), m_mappedData(nullptr), m_fileSize(0), m_fd(-1), m_dataOffset(0), m_fileVectors(0) {
 }
 
 template <typename T>
@@ -63,13 +63,30 @@ SPTAG::Helper::VectorSetReader<T>::LoadFile(const std::string& p_filePaths) {
     }
     m_fileSize = st.st_size;
 
-    m_mappedData = mmap(nullptr, m_fileSize, PROT_READ, MAP_PRIVATE, m_fd, 0);
+    // the vector sets handed out are views of this mapping; it is private and writable so that
+    // normalising a view in place only dirties private copies of its pages, never the file
+    m_mappedData = mmap(nullptr, m_fileSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_NORESERVE, m_fd, 0);
     if (m_mappedData == MAP_FAILED) {
         LOG(SPTAG::Helper::LogLevel::LL_Error, "Failed to mmap file %s.\n", m_vectorOutput.c_str());
         close(m_fd);
         m_fd = -1;
         throw std::runtime_error("Failed to mmap file");
     }
+#ifdef MADV_HUGEPAGE
+    madvise(m_mappedData, m_fileSize, MADV_HUGEPAGE);
+#endif
+
+    // .fbin/.u8bin style files start with the vector count and the dimension as 32-bit integers
+    m_dataOffset = 0;
+    m_fileVectors = m_dim > 0 ? static_cast<SizeType>(m_fileSize / (sizeof(T) * m_dim)) : 0;
+    if (m_fileSize >= 2 * sizeof(std::uint32_t) && m_dim > 0) {
+        const std::uint32_t* header = static_cast<const std::uint32_t*>(m_mappedData);
+        if (header[1] == static_cast<std::uint32_t>(m_dim) && 2 * sizeof(std::uint32_t) + (std::uint64_t)header[0] * m_dim * sizeof(T) == m_fileSize) {
+            m_dataOffset = 2 * sizeof(std::uint32_t);
+            m_fileVectors = static_cast<SizeType>(header[0]);
+            LOG(SPTAG::Helper::LogLevel::LL_Info, "%s has a header of %u vectors of dimension %u.\n", m_vectorOutput.c_str(), header[0], header[1]);
+        }
+    }
 
     return ErrorCode::Success;
 }
@@ -77,9 +94,10 @@ SPTAG::Helper::VectorSetReader<T>::LoadFile(const std::string& p_filePaths) {
 template <typename T>
 std::shared_ptr<SPTAG::VectorSet>
 SPTAG::Helper::VectorSetReader<T>::GetVectorSet(SPTAG::SizeType start, SPTAG::SizeType end) const {
-    SizeType effectiveSize = m_size;
-    if (effectiveSize == 0 && m_fileSize > 0 && m_dim > 0) {
-        effectiveSize = static_cast<SizeType>(m_fileSize / (sizeof(T) * m_dim));
+    // a size of 0 or less takes every vector of the file
+    SizeType effectiveSize = m_fileVectors;
+    if (m_size > 0 && m_size < effectiveSize) {
+        effectiveSize = m_size;
     }
 
     if (start > effectiveSize)
@@ -87,21 +105,26 @@ SPTAG::Helper::VectorSetReader<T>::GetVectorSet(SPTAG::SizeType start, SPTAG::Si
     if (end < 0 || end > effectiveSize)
         end = effectiveSize;
 
-    std::uint64_t offset = ((std::uint64_t)sizeof(T)) * start * m_dim;
+    std::uint64_t offset = m_dataOffset + ((std::uint64_t)sizeof(T)) * start * m_dim;
     std::uint64_t totalBytes = ((std::uint64_t)sizeof(T)) * (end - start) * m_dim;
 
     if (totalBytes == 0) {
-        SPTAG::VectorValueType valueType = SPTAG::VectorValueType::Float;
-        if constexpr (sizeof(T) == 1) {
-            valueType = SPTAG::VectorValueType::Int8;
-        } else if constexpr (sizeof(T) == 2) {
-            valueType = SPTAG::VectorValueType::Int16;
-        }
-        return std::make_shared<SPTAG::BasicVectorSet>(SPTAG::ByteArray(), valueType, m_dim, 0);
+        return std::make_shared<SPTAG::BasicVectorSet>(SPTAG::ByteArray(), GetEnumValueType<T>(), m_dim, 0);
     }
 
     void* sliceStart = static_cast<std::uint8_t*>(m_mappedData) + offset;
 
+    // a slice is a batch about to be scanned once, let the kernel read it ahead; the whole file
+    // is read at random (posting write-out, refine) and gets the default policy back
+    if (end - start < effectiveSize) {
+        std::uint64_t pageSize = (std::uint64_t)sysconf(_SC_PAGESIZE);
+        std::uint64_t alignedOffset = offset / pageSize * pageSize;
+        madvise(static_cast<std::uint8_t*>(m_mappedData) + alignedOffset, offset + totalBytes - alignedOffset, MADV_SEQUENTIAL);
+        madvise(static_cast<std::uint8_t*>(m_mappedData) + alignedOffset, offset + totalBytes - alignedOffset, MADV_WILLNEED);
+    } else {
+        madvise(m_mappedData, m_fileSize, MADV_NORMAL);
+    }
+
     auto self = this->shared_from_this();
     auto deleter = [self](std::uint8_t*) mutable {
     };
@@ -109,15 +132,8 @@ SPTAG::Helper::VectorSetReader<T>::GetVectorSet(SPTAG::SizeType start, SPTAG::Si
 
     SPTAG::ByteArray arr(reinterpret_cast<std::uint8_t*>(sliceStart), totalBytes, dataHolder);
 
-    SPTAG::VectorValueType valueType = SPTAG::VectorValueType::Float;
-    if constexpr (sizeof(T) == 1) {
-        valueType = SPTAG::VectorValueType::Int8;
-    } else if constexpr (sizeof(T) == 2) {
-        valueType = SPTAG::VectorValueType::Int16;
-    }
-
     LOG(SPTAG::Helper::LogLevel::LL_Info, "Load Vector(%d,%d)\n", end - start, m_dim);
-    return std::make_shared<SPTAG::BasicVectorSet>(arr, valueType, m_dim, end - start);
+    return std::make_shared<SPTAG::BasicVectorSet>(arr, GetEnumValueType<T>(), m_dim, end - start);
 }
 
 template <typename T>
@@ -132,3 +148,5 @@ template class SPTAG::Helper::VectorSetReader<std::int8_t>;
 template class SPTAG::Helper::VectorSetReader<std::uint8_t>;
 template class SPTAG::Helper::VectorSetReader<std::int16_t>;
 template class SPTAG::Helper::VectorSetReader<float>;
+template class SPTAG::Helper::VectorSetReader<SPTAG::Float16>;
+template class SPTAG::Helper::VectorSetReader<SPTAG::BFloat16>;
@@ -1031,3 +1031,292 @@ float SPTAG::COMMON::DistanceUtils::ComputeCosineDistance_AVX512(const float* pX
         diff += (*pX++) * (*pY++);
     return 1 - diff;
 }
+
+// eight subspaces per step: their table rows are 256 floats apart, so one gather fetches all eight entries
+float SPTAG::COMMON::DistanceUtils::ComputeLookupSum_AVX(const float* p_table, const std::uint8_t* p_codes, SPTAG::DimensionType p_count) {
+    const __m256i rowOffsets = _mm256_setr_epi32(0, 256, 512, 768, 1024, 1280, 1536, 1792);
+    __m256 sum256 = _mm256_setzero_ps();
+    SPTAG::DimensionType i = 0;
+    for (; i + 8 <= p_count; i += 8, p_table += 2048) {
+        __m256i codes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*)(p_codes + i)));
+        sum256 = _mm256_add_ps(sum256, _mm256_i32gather_ps(p_table, _mm256_add_epi32(codes, rowOffsets), 4));
+    }
+    __m128 diff128 = _mm_add_ps(_mm256_castps256_ps128(sum256), _mm256_extractf128_ps(sum256, 1));
+    float sum = DIFF128[0] + DIFF128[1] + DIFF128[2] + DIFF128[3];
+    for (; i < p_count; i++, p_table += 256)
+        sum += p_table[p_codes[i]];
+    return sum;
+}
+
+inline __m128 _mm256_reduce_ps128(__m256 X) {
+    return _mm_add_ps(_mm256_castps256_ps128(X), _mm256_extractf128_ps(X, 1));
+}
+
+inline __m128 _mm512_reduce_ps128(__m512 X) {
+    return _mm256_reduce_ps128(_mm256_add_ps(_mm512_castps512_ps256(X), _mm512_extractf32x8_ps(X, 1)));
+}
+
+// one SIMD step of the query against four vectors, the query block is loaded once
+#define REPEAT4(type, ctype, load, exec, acc)                  \
+    {                                                          \
+        type q = load((const ctype*)(pX + i));                 \
+        r0 = acc(r0, exec(q, load((const ctype*)(pY0 + i)))); \
+        r1 = acc(r1, exec(q, load((const ctype*)(pY1 + i)))); \
+        r2 = acc(r2, exec(q, load((const ctype*)(pY2 + i)))); \
+        r3 = acc(r3, exec(q, load((const ctype*)(pY3 + i)))); \
+    }
+
+// sums of the first blocked components of four vectors, reduced together into one register
+#define BLOCK4(rtype, type, ctype, delta, zero, load, exec, acc, reduce)                                                  \
+    [](const auto* pX, const auto* pY0, const auto* pY1, const auto* pY2, const auto* pY3, SPTAG::DimensionType blocked) { \
+        rtype r0 = zero(), r1 = zero(), r2 = zero(), r3 = zero();                                                           \
+        for (SPTAG::DimensionType i = 0; i < blocked; i += delta) REPEAT4(type, ctype, load, exec, acc)                     \
+        __m128 s0 = reduce(r0), s1 = reduce(r1), s2 = reduce(r2), s3 = reduce(r3);                                          \
+        _MM_TRANSPOSE4_PS(s0, s1, s2, s3);                                                                                  \
+        return _mm_add_ps(_mm_add_ps(s0, s1), _mm_add_ps(s2, s3));                                                          \
+    }
+
+inline __m128 _mm_reduce_ps128(__m128 X) {
+    return X;
+}
+
+// the widest SIMD width covers the first components of four vectors at a time and the next
+// four vectors are prefetched meanwhile. The remaining components go through the single vector
+// kernel, for Cosine that kernel returns base * base - dot so the block dots are subtracted
+template <typename T, typename Block, typename Single>
+inline void ComputeDistanceBatch(const T* pX, const void* const* pY, int count, SPTAG::DimensionType length, float* dists, SPTAG::DimensionType delta, bool cosine, Block block, Single single) {
+    SPTAG::DimensionType blocked = (length / delta) * delta;
+    float tail0 = single(pX, pX, 0);
+    size_t bytes = sizeof(T) * length;
+    int i = 0;
+    for (; i + 4 <= count; i += 4) {
+        for (int j = i + 4; j < i + 8 && j < count; j++) {
+            for (size_t offset = 0; offset < bytes; offset += 64) _mm_prefetch((const char*)pY[j] + offset, _MM_HINT_T0);
+        }
+        const T* pY0 = (const T*)pY[i];
+        const T* pY1 = (const T*)pY[i + 1];
+        const T* pY2 = (const T*)pY[i + 2];
+        const T* pY3 = (const T*)pY[i + 3];
+        float partial[4];
+        _mm_storeu_ps(partial, block(pX, pY0, pY1, pY2, pY3, blocked));
+        const T* vectors[4] = {pY0, pY1, pY2, pY3};
+        for (int j = 0; j < 4; j++) {
+            float tail = (blocked == length) ? tail0 : single(pX + blocked, vectors[j] + blocked, length - blocked);
+            dists[i + j] = cosine ? tail - partial[j] : tail + partial[j];
+        }
+    }
+    for (; i < count; i++) dists[i] = single(pX, (const T*)pY[i], length);
+}
+
+#define DEFINE_DISTANCE_BATCH(metric, isa, T, delta, rtype, type, ctype, zero, load, exec, acc, reduce)                                                                                           \
+    void SPTAG::COMMON::DistanceUtils::Compute##metric##DistanceBatch_##isa(const T* pX, const void* const* pY, int count, SPTAG::DimensionType length, float* dists) {                         \
+        ComputeDistanceBatch(pX, pY, count, length, dists, delta, #metric[0] == 'C', BLOCK4(rtype, type, ctype, delta, zero, load, exec, acc, reduce), static_cast<float (*)(const T*, const T*, SPTAG::DimensionType)>(&Compute##metric##Distance_##isa)); \
+    }
+
+DEFINE_DISTANCE_BATCH(L2, SSE, std::int8_t, 16, __m128, __m128i, __m128i, _mm_setzero_ps, _mm_loadu_si128, _mm_sqdf_epi8, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX, std::int8_t, 32, __m256, __m256i, __m256i, _mm256_setzero_ps, _mm256_loadu_si256, _mm256_sqdf_epi8, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX512, std::int8_t, 64, __m512, __m512i, __m512i, _mm512_setzero_ps, _mm512_loadu_si512, _mm512_sqdf_epi8, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, SSE, std::uint8_t, 16, __m128, __m128i, __m128i, _mm_setzero_ps, _mm_loadu_si128, _mm_sqdf_epu8, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX, std::uint8_t, 32, __m256, __m256i, __m256i, _mm256_setzero_ps, _mm256_loadu_si256, _mm256_sqdf_epu8, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX512, std::uint8_t, 64, __m512, __m512i, __m512i, _mm512_setzero_ps, _mm512_loadu_si512, _mm512_sqdf_epu8, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, SSE, std::int16_t, 8, __m128, __m128i, __m128i, _mm_setzero_ps, _mm_loadu_si128, _mm_sqdf_epi16, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX, std::int16_t, 16, __m256, __m256i, __m256i, _mm256_setzero_ps, _mm256_loadu_si256, _mm256_sqdf_epi16, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX512, std::int16_t, 32, __m512, __m512i, __m512i, _mm512_setzero_ps, _mm512_loadu_si512, _mm512_sqdf_epi16, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, SSE, float, 4, __m128, __m128, float, _mm_setzero_ps, _mm_loadu_ps, _mm_sqdf_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX, float, 8, __m256, __m256, float, _mm256_setzero_ps, _mm256_loadu_ps, _mm256_sqdf_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX512, float, 16, __m512, __m512, float, _mm512_setzero_ps, _mm512_loadu_ps, _mm512_sqdf_ps, _mm512_add_ps, _mm512_reduce_ps128)
+
+DEFINE_DISTANCE_BATCH(Cosine, SSE, std::int8_t, 16, __m128, __m128i, __m128i, _mm_setzero_ps, _mm_loadu_si128, _mm_mul_epi8, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX, std::int8_t, 32, __m256, __m256i, __m256i, _mm256_setzero_ps, _mm256_loadu_si256, _mm256_mul_epi8, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX512, std::int8_t, 64, __m512, __m512i, __m512i, _mm512_setzero_ps, _mm512_loadu_si512, _mm512_mul_epi8, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, SSE, std::uint8_t, 16, __m128, __m128i, __m128i, _mm_setzero_ps, _mm_loadu_si128, _mm_mul_epu8, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX, std::uint8_t, 32, __m256, __m256i, __m256i, _mm256_setzero_ps, _mm256_loadu_si256, _mm256_mul_epu8, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX512, std::uint8_t, 64, __m512, __m512i, __m512i, _mm512_setzero_ps, _mm512_loadu_si512, _mm512_mul_epu8, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, SSE, std::int16_t, 8, __m128, __m128i, __m128i, _mm_setzero_ps, _mm_loadu_si128, _mm_mul_epi16, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX, std::int16_t, 16, __m256, __m256i, __m256i, _mm256_setzero_ps, _mm256_loadu_si256, _mm256_mul_epi16, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX512, std::int16_t, 32, __m512, __m512i, __m512i, _mm512_setzero_ps, _mm512_loadu_si512, _mm512_mul_epi16, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, SSE, float, 4, __m128, __m128, float, _mm_setzero_ps, _mm_loadu_ps, _mm_mul_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX, float, 8, __m256, __m256, float, _mm256_setzero_ps, _mm256_loadu_ps, _mm256_mul_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX512, float, 16, __m512, __m512, float, _mm512_setzero_ps, _mm512_loadu_ps, _mm512_mul_ps, _mm512_add_ps, _mm512_reduce_ps128)
+
+// 16-bit floats are widened per register and go through the float arithmetic above, so the sums
+// are float sums of the widened values. bf16 is the upper half of a float and widens with a
+// shift; fp16 converts with F16C (AVX512F at 512 bits) and without it one value at a time
+inline __m128 _mm_loadu_fp16(const SPTAG::Float16* p) {
+    return _mm_setr_ps(p[0], p[1], p[2], p[3]);
+}
+
+inline __m256 _mm256_loadu_fp16(const SPTAG::Float16* p) {
+    return _mm256_cvtph_ps(_mm_loadu_si128((const __m128i*)p));
+}
+
+inline __m512 _mm512_loadu_fp16(const SPTAG::Float16* p) {
+    return _mm512_cvtph_ps(_mm256_loadu_si256((const __m256i*)p));
+}
+
+inline __m128 _mm_loadu_bf16(const SPTAG::BFloat16* p) {
+    return _mm_castsi128_ps(_mm_unpacklo_epi16(_mm_setzero_si128(), _mm_loadl_epi64((const __m128i*)p)));
+}
+
+inline __m256 _mm256_loadu_bf16(const SPTAG::BFloat16* p) {
+    return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)p)), 16));
+}
+
+inline __m512 _mm512_loadu_bf16(const SPTAG::BFloat16* p) {
+    return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_cvtepu16_epi32(_mm256_loadu_si256((const __m256i*)p)), 16));
+}
+
+template <typename T>
+inline float HalfTailL2(const T* pX, const T* pY, const T* pEnd1, float diff) {
+    while (pX < pEnd1) {
+        float c1 = (float)(*pX++) - (float)(*pY++);
+        diff += c1 * c1;
+    }
+    return diff;
+}
+
+template <typename T>
+inline float HalfTailCosine(const T* pX, const T* pY, const T* pEnd1, float diff) {
+    while (pX < pEnd1)
+        diff += (float)(*pX++) * (float)(*pY++);
+    return 1 - diff;
+}
+
+#define DEFINE_HALF_DISTANCE(metric, isa, T, delta, rtype, zero, load, exec, acc, reduce)                                       \
+    float SPTAG::COMMON::DistanceUtils::Compute##metric##Distance_##isa(const T* pX, const T* pY, SPTAG::DimensionType length) { \
+        const T* pEndN = pX + (length / delta) * delta;                                                                         \
+        const T* pEnd1 = pX + length;                                                                                           \
+        rtype sum = zero();                                                                                                     \
+        while (pX < pEndN) {                                                                                                    \
+            REPEAT(rtype, const T, delta, load, exec, acc, sum)                                                                 \
+        }                                                                                                                       \
+        __m128 diff128 = reduce(sum);                                                                                           \
+        float diff = DIFF128[0] + DIFF128[1] + DIFF128[2] + DIFF128[3];                                                         \
+        return HalfTail##metric(pX, pY, pEnd1, diff);                                                                           \
+    }
+
+DEFINE_HALF_DISTANCE(L2, SSE, SPTAG::Float16, 4, __m128, _mm_setzero_ps, _mm_loadu_fp16, _mm_sqdf_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_HALF_DISTANCE(L2, AVX, SPTAG::Float16, 8, __m256, _mm256_setzero_ps, _mm256_loadu_fp16, _mm256_sqdf_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_HALF_DISTANCE(L2, AVX512, SPTAG::Float16, 16, __m512, _mm512_setzero_ps, _mm512_loadu_fp16, _mm512_sqdf_ps, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_HALF_DISTANCE(L2, SSE, SPTAG::BFloat16, 4, __m128, _mm_setzero_ps, _mm_loadu_bf16, _mm_sqdf_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_HALF_DISTANCE(L2, AVX, SPTAG::BFloat16, 8, __m256, _mm256_setzero_ps, _mm256_loadu_bf16, _mm256_sqdf_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_HALF_DISTANCE(L2, AVX512, SPTAG::BFloat16, 16, __m512, _mm512_setzero_ps, _mm512_loadu_bf16, _mm512_sqdf_ps, _mm512_add_ps, _mm512_reduce_ps128)
+
+DEFINE_HALF_DISTANCE(Cosine, SSE, SPTAG::Float16, 4, __m128, _mm_setzero_ps, _mm_loadu_fp16, _mm_mul_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_HALF_DISTANCE(Cosine, AVX, SPTAG::Float16, 8, __m256, _mm256_setzero_ps, _mm256_loadu_fp16, _mm256_mul_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_HALF_DISTANCE(Cosine, AVX512, SPTAG::Float16, 16, __m512, _mm512_setzero_ps, _mm512_loadu_fp16, _mm512_mul_ps, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_HALF_DISTANCE(Cosine, SSE, SPTAG::BFloat16, 4, __m128, _mm_setzero_ps, _mm_loadu_bf16, _mm_mul_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_HALF_DISTANCE(Cosine, AVX, SPTAG::BFloat16, 8, __m256, _mm256_setzero_ps, _mm256_loadu_bf16, _mm256_mul_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_HALF_DISTANCE(Cosine, AVX512, SPTAG::BFloat16, 16, __m512, _mm512_setzero_ps, _mm512_loadu_bf16, _mm512_mul_ps, _mm512_add_ps, _mm512_reduce_ps128)
+
+// VDPBF16PS multiplies 32 bf16 pairs and adds neighbouring products into 16 float lanes. The
+// products are exact in float, only the summation order differs from the widening kernel. Kept
+// out of the class so the target attribute does not turn the member into a multiversioned one
+__attribute__((target("avx512bf16"))) static float DotBF16_AVX512(const SPTAG::BFloat16* pX, const SPTAG::BFloat16* pY, SPTAG::DimensionType length) {
+    const SPTAG::BFloat16* pEnd32 = pX + ((length >> 5) << 5);
+    const SPTAG::BFloat16* pEnd16 = pX + ((length >> 4) << 4);
+    const SPTAG::BFloat16* pEnd1 = pX + length;
+
+    __m512 diff512 = _mm512_setzero_ps();
+    while (pX < pEnd32) {
+        diff512 = _mm512_dpbf16_ps(diff512, (__m512bh)_mm512_loadu_si512(pX), (__m512bh)_mm512_loadu_si512(pY));
+        pX += 32;
+        pY += 32;
+    }
+    while (pX < pEnd16) {
+        REPEAT(__m512, const SPTAG::BFloat16, 16, _mm512_loadu_bf16, _mm512_mul_ps, _mm512_add_ps, diff512)
+    }
+    __m128 diff128 = _mm512_reduce_ps128(diff512);
+    float diff = DIFF128[0] + DIFF128[1] + DIFF128[2] + DIFF128[3];
+
+    while (pX < pEnd1)
+        diff += (float)(*pX++) * (float)(*pY++);
+    return diff;
+}
+
+float SPTAG::COMMON::DistanceUtils::ComputeCosineDistance_AVX512BF16(const SPTAG::BFloat16* pX, const SPTAG::BFloat16* pY, SPTAG::DimensionType length) {
+    return 1 - DotBF16_AVX512(pX, pY, length);
+}
+
+DEFINE_DISTANCE_BATCH(L2, SSE, SPTAG::Float16, 4, __m128, __m128, SPTAG::Float16, _mm_setzero_ps, _mm_loadu_fp16, _mm_sqdf_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX, SPTAG::Float16, 8, __m256, __m256, SPTAG::Float16, _mm256_setzero_ps, _mm256_loadu_fp16, _mm256_sqdf_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX512, SPTAG::Float16, 16, __m512, __m512, SPTAG::Float16, _mm512_setzero_ps, _mm512_loadu_fp16, _mm512_sqdf_ps, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, SSE, SPTAG::BFloat16, 4, __m128, __m128, SPTAG::BFloat16, _mm_setzero_ps, _mm_loadu_bf16, _mm_sqdf_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX, SPTAG::BFloat16, 8, __m256, __m256, SPTAG::BFloat16, _mm256_setzero_ps, _mm256_loadu_bf16, _mm256_sqdf_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(L2, AVX512, SPTAG::BFloat16, 16, __m512, __m512, SPTAG::BFloat16, _mm512_setzero_ps, _mm512_loadu_bf16, _mm512_sqdf_ps, _mm512_add_ps, _mm512_reduce_ps128)
+
+DEFINE_DISTANCE_BATCH(Cosine, SSE, SPTAG::Float16, 4, __m128, __m128, SPTAG::Float16, _mm_setzero_ps, _mm_loadu_fp16, _mm_mul_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX, SPTAG::Float16, 8, __m256, __m256, SPTAG::Float16, _mm256_setzero_ps, _mm256_loadu_fp16, _mm256_mul_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX512, SPTAG::Float16, 16, __m512, __m512, SPTAG::Float16, _mm512_setzero_ps, _mm512_loadu_fp16, _mm512_mul_ps, _mm512_add_ps, _mm512_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, SSE, SPTAG::BFloat16, 4, __m128, __m128, SPTAG::BFloat16, _mm_setzero_ps, _mm_loadu_bf16, _mm_mul_ps, _mm_add_ps, _mm_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX, SPTAG::BFloat16, 8, __m256, __m256, SPTAG::BFloat16, _mm256_setzero_ps, _mm256_loadu_bf16, _mm256_mul_ps, _mm256_add_ps, _mm256_reduce_ps128)
+DEFINE_DISTANCE_BATCH(Cosine, AVX512, SPTAG::BFloat16, 16, __m512, __m512, SPTAG::BFloat16, _mm512_setzero_ps, _mm512_loadu_bf16, _mm512_mul_ps, _mm512_add_ps, _mm512_reduce_ps128)
+
+// the kernel of the ISA inlined with the length a constant: the loop bounds are known, the tail
+// loops run zero times and go away, and the compiler unrolls what is left
+template <SPTAG::DimensionType Dim, typename T, SPTAG::COMMON::DistanceCalcReturn<T> Kernel>
+__attribute__((flatten)) float FixedDimensionDistance(const T* pX, const T* pY, SPTAG::DimensionType) {
+    return Kernel(pX, pY, Dim);
+}
+
+template <SPTAG::DimensionType Dim, typename T, SPTAG::COMMON::DistanceBatchReturn<T> Kernel>
+__attribute__((flatten)) void FixedDimensionDistanceBatch(const T* pX, const void* const* pY, int count, SPTAG::DimensionType, float* dists) {
+    Kernel(pX, pY, count, Dim, dists);
+}
+
+#define FIXED_DIMENSIONS(apply) apply(96) apply(100) apply(128) apply(200) apply(256) apply(384) apply(768) apply(1024)
+
+// the same ISA as DistanceCalcSelector picks, nullptr where it would take the SSE kernels
+template <typename T>
+inline bool FixedDimensionISA(bool& p_avx512) {
+    p_avx512 = SPTAG::COMMON::InstructionSet::AVX512();
+    return p_avx512 || SPTAG::COMMON::InstructionSet::AVX2() || (sizeof(T) == 4 && SPTAG::COMMON::InstructionSet::AVX());
+}
+
+template <typename T, SPTAG::COMMON::DistanceCalcReturn<T> L2AVX512, SPTAG::COMMON::DistanceCalcReturn<T> L2AVX, SPTAG::COMMON::DistanceCalcReturn<T> CosineAVX512, SPTAG::COMMON::DistanceCalcReturn<T> CosineAVX>
+SPTAG::COMMON::DistanceCalcReturn<T> SelectFixedDimension(SPTAG::DistCalcMethod p_method, SPTAG::DimensionType p_dim) {
+    bool avx512;
+    if (!FixedDimensionISA<T>(avx512) || (p_method != SPTAG::DistCalcMethod::L2 && p_method != SPTAG::DistCalcMethod::Cosine && p_method != SPTAG::DistCalcMethod::InnerProduct))
+        return nullptr;
+    bool l2 = p_method == SPTAG::DistCalcMethod::L2;
+    switch (p_dim) {
+#define FIXED_DIMENSION_CASE(dim) \
+    case dim:                     \
+        return l2 ? (avx512 ? &FixedDimensionDistance<dim, T, L2AVX512> : &FixedDimensionDistance<dim, T, L2AVX>) : (avx512 ? &FixedDimensionDistance<dim, T, CosineAVX512> : &FixedDimensionDistance<dim, T, CosineAVX>);
+        FIXED_DIMENSIONS(FIXED_DIMENSION_CASE)
+#undef FIXED_DIMENSION_CASE
+        default:
+            return nullptr;
+    }
+}
+
+template <typename T, SPTAG::COMMON::DistanceBatchReturn<T> L2AVX512, SPTAG::COMMON::DistanceBatchReturn<T> L2AVX, SPTAG::COMMON::DistanceBatchReturn<T> CosineAVX512, SPTAG::COMMON::DistanceBatchReturn<T> CosineAVX>
+SPTAG::COMMON::DistanceBatchReturn<T> SelectFixedDimensionBatch(SPTAG::DistCalcMethod p_method, SPTAG::DimensionType p_dim) {
+    bool avx512;
+    if (!FixedDimensionISA<T>(avx512) || (p_method != SPTAG::DistCalcMethod::L2 && p_method != SPTAG::DistCalcMethod::Cosine && p_method != SPTAG::DistCalcMethod::InnerProduct))
+        return nullptr;
+    bool l2 = p_method == SPTAG::DistCalcMethod::L2;
+    switch (p_dim) {
+#define FIXED_DIMENSION_CASE(dim) \
+    case dim:                     \
+        return l2 ? (avx512 ? &FixedDimensionDistanceBatch<dim, T, L2AVX512> : &FixedDimensionDistanceBatch<dim, T, L2AVX>) : (avx512 ? &FixedDimensionDistanceBatch<dim, T, CosineAVX512> : &FixedDimensionDistanceBatch<dim, T, CosineAVX>);
+        FIXED_DIMENSIONS(FIXED_DIMENSION_CASE)
+#undef FIXED_DIMENSION_CASE
+        default:
+            return nullptr;
+    }
+}
+
+#define DEFINE_FIXED_DIMENSION_KERNELS(T)                                                                                                                                                                     \
+    template <>                                                                                                                                                                                               \
+    SPTAG::COMMON::DistanceCalcReturn<T> SPTAG::COMMON::DistanceUtils::FixedDimensionKernel<T>(SPTAG::DistCalcMethod p_method, SPTAG::DimensionType p_dim) {                                                \
+        return SelectFixedDimension<T, &ComputeL2Distance_AVX512, &ComputeL2Distance_AVX, &ComputeCosineDistance_AVX512, &ComputeCosineDistance_AVX>(p_method, p_dim);                                      \
+    }                                                                                                                                                                                                         \
+    template <>                                                                                                                                                                                               \
+    SPTAG::COMMON::DistanceBatchReturn<T> SPTAG::COMMON::DistanceUtils::FixedDimensionBatchKernel<T>(SPTAG::DistCalcMethod p_method, SPTAG::DimensionType p_dim) {                                          \
+        return SelectFixedDimensionBatch<T, &ComputeL2DistanceBatch_AVX512, &ComputeL2DistanceBatch_AVX, &ComputeCosineDistanceBatch_AVX512, &ComputeCosineDistanceBatch_AVX>(p_method, p_dim);            \
+    }
+
+DEFINE_FIXED_DIMENSION_KERNELS(float)
+DEFINE_FIXED_DIMENSION_KERNELS(std::int8_t)
+DEFINE_FIXED_DIMENSION_KERNELS(std::uint8_t)
@@ -23,6 +23,12 @@ bool InstructionSet::AVX2(void) {
 bool InstructionSet::AVX512(void) {
     return CPU_Rep.HW_AVX512;
 }
+bool InstructionSet::F16C(void) {
+    return CPU_Rep.HW_F16C;
+}
+bool InstructionSet::AVX512BF16(void) {
+    return CPU_Rep.HW_AVX512BF16;
+}
 
 void InstructionSet::PrintInstructionSet(void) {
     if (CPU_Rep.HW_AVX512)
@@ -44,7 +50,9 @@ InstructionSet::InstructionSet_Internal::InstructionSet_Internal() : HW_SSE{fals
                                                                      HW_SSE2{false},
                                                                      HW_AVX{false},
                                                                      HW_AVX512{false},
-                                                                     HW_AVX2{false} {
+                                                                     HW_AVX2{false},
+                                                                     HW_F16C{false},
+                                                                     HW_AVX512BF16{false} {
     int info[4];
     cpuid(info, 0);
     int nIds = info[0];
@@ -55,11 +63,17 @@ InstructionSet::InstructionSet_Internal::InstructionSet_Internal() : HW_SSE{fals
         HW_SSE = (info[3] & ((int)1 << 25)) != 0;
         HW_SSE2 = (info[3] & ((int)1 << 26)) != 0;
         HW_AVX = (info[2] & ((int)1 << 28)) != 0;
+        HW_F16C = (info[2] & ((int)1 << 29)) != 0;
     }
     if (nIds >= 0x00000007) {
         cpuid(info, 0x00000007);
         HW_AVX2 = (info[1] & ((int)1 << 5)) != 0;
         HW_AVX512 = (info[1] & (((int)1 << 16) | ((int)1 << 30)));
+        if (HW_AVX512 && info[0] >= 1) {
+            // leaf 7 sub-leaf 1, EAX bit 5
+            __cpuid_count(0x00000007, 1, info[0], info[1], info[2], info[3]);
+            HW_AVX512BF16 = (info[0] & ((int)1 << 5)) != 0;
+        }
     }
     if (HW_AVX512)
         LOG(Helper::LogLevel::LL_Info, "Using AVX512 InstructionSet!\n");
@@ -218,3 +218,37 @@ void SPTAG::COMMON::SIMDUtils::ComputeSum_AVX512(float* pX, const float* pY, SPT
         *pX++ += *pY++;
     }
 }
+
+std::uint64_t SPTAG::COMMON::SIMDUtils::BitTestStrided_AVX(const std::uint32_t* p_bits, const char* p_entries, int p_stride, int p_count) {
+    std::uint64_t mask = 0;
+    int i = 0;
+    const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256i low = _mm256_set1_epi32(31), one = _mm256_set1_epi32(1);
+    const __m256i offsets = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(p_stride));
+    for (; i + 8 <= p_count; i += 8) {
+        __m256i keys = _mm256_i32gather_epi32((const int*)(p_entries + (size_t)i * p_stride), offsets, 1);
+        __m256i words = _mm256_i32gather_epi32((const int*)p_bits, _mm256_srli_epi32(keys, 5), 4);
+        __m256i bits = _mm256_and_si256(_mm256_srlv_epi32(words, _mm256_and_si256(keys, low)), one);
+        mask |= (std::uint64_t)(std::uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpeq_epi32(bits, one))) << i;
+    }
+    if (i < p_count)
+        mask |= BitTestStrided_Naive(p_bits, p_entries + (size_t)i * p_stride, p_stride, p_count - i) << i;
+    return mask;
+}
+
+std::uint64_t SPTAG::COMMON::SIMDUtils::BitTestStrided_AVX512(const std::uint32_t* p_bits, const char* p_entries, int p_stride, int p_count) {
+    std::uint64_t mask = 0;
+    int i = 0;
+    const __m512i lanes = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512i low = _mm512_set1_epi32(31), one = _mm512_set1_epi32(1);
+    const __m512i offsets = _mm512_mullo_epi32(lanes, _mm512_set1_epi32(p_stride));
+    for (; i + 16 <= p_count; i += 16) {
+        __m512i keys = _mm512_i32gather_epi32(offsets, (const void*)(p_entries + (size_t)i * p_stride), 1);
+        __m512i words = _mm512_i32gather_epi32(_mm512_srli_epi32(keys, 5), (const void*)p_bits, 4);
+        __mmask16 bits = _mm512_test_epi32_mask(_mm512_srlv_epi32(words, _mm512_and_si512(keys, low)), one);
+        mask |= (std::uint64_t)bits << i;
+    }
+    if (i < p_count)
+        mask |= BitTestStrided_AVX(p_bits, p_entries + (size_t)i * p_stride, p_stride, p_count - i) << i;
+    return mask;
+}
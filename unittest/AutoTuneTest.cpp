@@ -0,0 +1,217 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/QueryResultSet.h"
+#include "Core/SPANN/AutoTuner.h"
+#include "Core/SPANN/Index.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static const TunerChange* Find(const std::vector<TunerChange>& p_changes, const char* p_param) {
+    for (auto& change : p_changes)
+        if (change.m_param == p_param)
+            return &change;
+    return nullptr;
+}
+
+// Test 1: ranges parse as "min:max" and nothing else
+bool TestParseRange() {
+    std::cout << "  Testing range parsing..." << std::endl;
+    int low = -1, high = -1;
+    bool ok = AutoTuner::ParseRange("8:64", low, high) && low == 8 && high == 64;
+    ok = ok && !AutoTuner::ParseRange("", low, high) && !AutoTuner::ParseRange("64:8", low, high) && !AutoTuner::ParseRange("8:64x", low, high) &&
+         !AutoTuner::ParseRange("-1:4", low, high) && !AutoTuner::ParseRange("8", low, high);
+    if (!ok) {
+        std::cerr << "  FAILED: range parsing" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: the probe budget grows while queries run out of probes, shrinks over the latency
+// target, stays inside its range, and knobs without a range never move
+bool TestStep() {
+    std::cout << "  Testing tuner steps..." << std::endl;
+    AutoTuner tuner;
+    tuner.SetRange(AutoTuner::Probe, 8, 40);
+    tuner.SetValue(AutoTuner::Probe, 32);
+    tuner.SetValue(AutoTuner::Merge, 10);
+    tuner.SetValue(AutoTuner::AppendThreads, 1);
+    tuner.SetLatencyTarget(1000);
+
+    TunerSample limited;
+    limited.m_queries = 1000;
+    limited.m_searchLatencyUs = 500;
+    limited.m_probeLimitedRatio = 0.5;
+    limited.m_smallPostingRatio = 0.9;
+    limited.m_splitQueue = 100;
+    bool ok = true;
+    auto changes = tuner.Step(limited);
+    ok = ok && changes.size() == 1 && changes[0].m_param == "SearchInternalResultNum" && changes[0].m_from == 32 && changes[0].m_to == 36;
+    for (int i = 0; i < 10; i++) tuner.Step(limited);
+    ok = ok && tuner.Value(AutoTuner::Probe) == 40 && tuner.Value(AutoTuner::Merge) == 10 && tuner.Value(AutoTuner::AppendThreads) == 1;
+
+    // over the target the budget goes down even with queries still cut short
+    TunerSample slow = limited;
+    slow.m_searchLatencyUs = 2000;
+    changes = tuner.Step(slow);
+    ok = ok && Find(changes, "SearchInternalResultNum") != nullptr && tuner.Value(AutoTuner::Probe) == 35;
+    for (int i = 0; i < 20; i++) tuner.Step(slow);
+    ok = ok && tuner.Value(AutoTuner::Probe) == 8;
+
+    // too few queries say nothing about the probe budget
+    TunerSample quiet = slow;
+    quiet.m_queries = 1;
+    tuner.SetValue(AutoTuner::Probe, 20);
+    ok = ok && Find(tuner.Step(quiet), "SearchInternalResultNum") == nullptr;
+
+    // workers are taken away only after kIdleSteps idle intervals in a row
+    tuner.SetRange(AutoTuner::AppendThreads, 1, 4);
+    tuner.SetValue(AutoTuner::AppendThreads, 3);
+    TunerSample idle;
+    int idleSteps = 0;
+    while (idleSteps < 10 && Find(tuner.Step(idle), "AppendThreadNum") == nullptr) idleSteps++;
+    ok = ok && idleSteps == AutoTuner::kIdleSteps - 1 && tuner.Value(AutoTuner::AppendThreads) == 2;
+    TunerSample busy;
+    busy.m_splitQueue = 100;
+    changes = tuner.Step(busy);
+    ok = ok && Find(changes, "AppendThreadNum") != nullptr && tuner.Value(AutoTuner::AppendThreads) == 3;
+    if (!ok) {
+        std::cerr << "  FAILED: probe " << tuner.Value(AutoTuner::Probe) << ", append threads " << tuner.Value(AutoTuner::AppendThreads) << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: on a running index the tuner steps over the measured interval and moves the options
+// through SetParameter: searches over a latency target lower the probe budget, idle background
+// workers are parked
+bool TestIndexTuning() {
+    std::cout << "  Testing tuning of a running index..." << std::endl;
+    const int dim = 16, base = 3000, queries = 64, k = 10;
+    const std::string dir = "test_auto_tune";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+
+    std::mt19937 rng(17);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> data((size_t)base * dim), query((size_t)queries * dim);
+    for (auto& v : data) v = uniform(rng);
+    for (auto& v : query) v = uniform(rng);
+    {
+        std::ofstream out(dir + "/vectors.bin", std::ios::binary);
+        out.write((const char*)data.data(), data.size() * sizeof(float));
+    }
+
+    auto index = std::make_shared<SPANN::Index<float>>();
+    index->SetParameter("ValueType", "Float", "Base");
+    index->SetParameter("Dim", std::to_string(dim).c_str(), "Base");
+    index->SetParameter("VectorPath", (dir + "/vectors.bin").c_str(), "Base");
+    index->SetParameter("IndexDirectory", dir.c_str(), "Base");
+    index->SetParameter("DistCalcMethod", "L2", "Base");
+    index->SetParameter("isExecute", "true", "SelectHead");
+    index->SetParameter("SelectHeadType", "BKT", "SelectHead");
+    index->SetParameter("NumberOfThreads", "2", "SelectHead");
+    index->SetParameter("Ratio", "0.1", "SelectHead");
+    index->SetParameter("TreeNumber", "1", "SelectHead");
+    index->SetParameter("BKTKmeansK", "8", "SelectHead");
+    index->SetParameter("BKTLeafSize", "8", "SelectHead");
+    index->SetParameter("isExecute", "true", "BuildHead");
+    index->SetParameter("isExecute", "true", "BuildSSDIndex");
+    index->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    index->SetParameter("NumberOfThreads", "2", "BuildSSDIndex");
+    index->SetParameter("ExcludeHead", "true", "BuildSSDIndex");
+    index->SetParameter("UseDirectIO", "false", "BuildSSDIndex");
+    index->SetParameter("StorageBackend", "Uring", "BuildSSDIndex");
+    index->SetParameter("UringFilePath", (dir + "/postings.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SpdkMappingPath", (dir + "/mapping.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("PostingPageLimit", "4", "BuildSSDIndex");
+    index->SetParameter("SpdkCapacity", std::to_string(base * 4).c_str(), "BuildSSDIndex");
+    index->SetParameter("SearchInternalResultNum", "16", "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "2048", "BuildSSDIndex");
+    index->SetParameter("Update", "true", "BuildSSDIndex");
+    index->SetParameter("AppendThreadNum", "2", "BuildSSDIndex");
+    index->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("InsertThreadNum", "1", "BuildSSDIndex");
+    // stepped by hand below, the interval only has to turn the tuner on
+    index->SetParameter("AutoTuneIntervalMs", "3600000", "BuildSSDIndex");
+    index->SetParameter("AutoTuneLatencyTargetUs", "0.001", "BuildSSDIndex");
+    index->SetParameter("AutoTuneProbeRange", "8:32", "BuildSSDIndex");
+    index->SetParameter("AutoTunePageLimitRange", "1:64", "BuildSSDIndex");
+    index->SetParameter("AutoTuneThreadRange", "1:2", "BuildSSDIndex");
+    if (index->BuildIndex(false) != ErrorCode::Success) {
+        std::cerr << "  FAILED: BuildIndex" << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    std::thread worker([&] {
+        index->Initialize();
+        for (int q = 0; q < queries; q++) {
+            COMMON::QueryResultSet<float> result(query.data() + (size_t)q * dim, k);
+            result.Reset();
+            index->SearchIndex(result);
+        }
+        auto changes = index->AutoTuneStep();
+        const TunerChange* probe = Find(changes, "SearchInternalResultNum");
+        if (probe == nullptr || probe->m_from != 16 || probe->m_to != 14 || index->GetParameter("SearchInternalResultNum", "BuildSSDIndex") != "14") {
+            std::cerr << "  FAILED: the probe budget did not come down over the latency target" << std::endl;
+            ok = false;
+        }
+        for (auto& change : changes) {
+            if (index->GetParameter(change.m_param.c_str(), "BuildSSDIndex") != std::to_string(change.m_to)) {
+                std::cerr << "  FAILED: " << change.m_param << " not set to " << change.m_to << std::endl;
+                ok = false;
+            }
+        }
+        // no searches since: the probe budget stays, the idle split workers go after kIdleSteps
+        const TunerChange* append = nullptr;
+        for (int step = 1; step < AutoTuner::kIdleSteps && ok; step++) {
+            changes = index->AutoTuneStep();
+            ok = Find(changes, "SearchInternalResultNum") == nullptr;
+            append = Find(changes, "AppendThreadNum");
+        }
+        if (!ok || append == nullptr || append->m_to != 1 || index->GetParameter("AppendThreadNum", "BuildSSDIndex") != "1") {
+            std::cerr << "  FAILED: idle split workers were not parked" << std::endl;
+            ok = false;
+        }
+        index->ExitBlockController();
+    });
+    worker.join();
+    index.reset();
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Auto Tune Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestParseRange();
+    testPassed = TestStep() && testPassed;
+    testPassed = TestIndexTuning() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
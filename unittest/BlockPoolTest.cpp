@@ -0,0 +1,155 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/BlockPool.h"
+#include "Core/SPANN/ExtraSPDKController.h"
+#include "Core/SPANN/ExtraUringController.h"
+
+#include <cstdio>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static const std::string c_table = "block_pool_test.table";
+static const std::string c_device = "block_pool_test.bin";
+static const AddressType kSlab = 16;
+static const AddressType kMaxBlocks = 1024;
+
+static std::shared_ptr<BlockPool> AttachPool() {
+    return BlockPool::Attach(
+        c_table, [] { return std::make_shared<UringBlockController>(c_device, 64, 8, false); }, kMaxBlocks, kSlab);
+}
+
+static std::unique_ptr<SPDKIO> OpenStore(const std::string& p_name, std::shared_ptr<BlockDevice> p_device) {
+    return std::make_unique<SPDKIO>((p_name + "_mapping").c_str(), 4096, 1000, 64, 1024, 64, 1, kMaxBlocks, false, p_device);
+}
+
+static std::string Value(int p_key, size_t p_bytes) {
+    std::string value(p_bytes, 0);
+    for (size_t i = 0; i < p_bytes; i++) value[i] = (char)('a' + (p_key * 7 + i) % 26);
+    return value;
+}
+
+// Test 1: two namespaces on one device keep their data apart, grow by slabs and stop at their quota
+bool TestTenants() {
+    std::cout << "  Testing two namespaces on one device..." << std::endl;
+    auto pool = AttachPool();
+    if (pool == nullptr || AttachPool() != pool) {
+        std::cerr << "  FAILED: pool not shared" << std::endl;
+        return false;
+    }
+    auto a = pool->Open("a", 2 * kSlab);
+    auto b = pool->Open("b", 0);
+    if (a == nullptr || b == nullptr || pool->Open("a", 0) != nullptr) {
+        std::cerr << "  FAILED: open" << std::endl;
+        return false;
+    }
+    auto storeA = OpenStore("a", a);
+    auto storeB = OpenStore("b", b);
+    for (int k = 0; k < 8; k++) {
+        if (storeA->Put(k, Value(k, 3 * 4096)) != ErrorCode::Success || storeB->Put(k, Value(k + 100, 5 * 4096)) != ErrorCode::Success) {
+            std::cerr << "  FAILED: put " << k << std::endl;
+            return false;
+        }
+    }
+    // a holds 24 blocks in 2 slabs, 3 more pages cannot fit in its quota
+    if (storeA->Put(100, Value(100, 12 * 4096)) == ErrorCode::Success) {
+        std::cerr << "  FAILED: quota not enforced" << std::endl;
+        return false;
+    }
+    std::string value;
+    for (int k = 0; k < 8; k++) {
+        if (storeA->Get(k, &value) != ErrorCode::Success || value != Value(k, 3 * 4096) || storeB->Get(k, &value) != ErrorCode::Success || value != Value(k + 100, 5 * 4096)) {
+            std::cerr << "  FAILED: key " << k << " overwritten" << std::endl;
+            return false;
+        }
+    }
+    if (pool->OwnedSlabs("a") != 2 || pool->OwnedSlabs("b") < 3) {
+        std::cerr << "  FAILED: slabs " << pool->OwnedSlabs("a") << " " << pool->OwnedSlabs("b") << std::endl;
+        return false;
+    }
+    if (pool->Drop("a") == ErrorCode::Success) {
+        std::cerr << "  FAILED: open namespace dropped" << std::endl;
+        return false;
+    }
+    storeA.reset();
+    storeB.reset();
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a namespace reopened alone after a restart recovers its free space inside its own slabs,
+// so its new writes never land on the blocks of the one still closed
+bool TestReopen() {
+    std::cout << "  Testing recovery of one namespace..." << std::endl;
+    {
+        auto pool = AttachPool();
+        auto a = pool->Open("a", 0);
+        auto storeA = OpenStore("a", a);
+        for (int k = 0; k < 8; k++) storeA->Delete(k);
+        for (int k = 20; k < 40; k++) {
+            if (storeA->Put(k, Value(k, 4 * 4096)) != ErrorCode::Success) {
+                std::cerr << "  FAILED: put after reopen" << std::endl;
+                return false;
+            }
+        }
+    }
+    auto pool = AttachPool();
+    auto b = pool->Open("b", 0);
+    auto storeB = OpenStore("b", b);
+    std::string value;
+    for (int k = 0; k < 8; k++) {
+        if (storeB->Get(k, &value) != ErrorCode::Success || value != Value(k + 100, 5 * 4096)) {
+            std::cerr << "  FAILED: key " << k << " of b lost" << std::endl;
+            return false;
+        }
+    }
+    storeB.reset();
+    b.reset();
+    AddressType before = pool->OwnedSlabs("b");
+    if (pool->Drop("b") != ErrorCode::Success || pool->OwnedSlabs("b") != -1 || before <= 0) {
+        std::cerr << "  FAILED: drop" << std::endl;
+        return false;
+    }
+    auto c = pool->Open("c", 0);
+    auto storeC = OpenStore("c", c);
+    storeC->Put(0, Value(0, 4096));
+    if (pool->OwnedSlabs("c") != 1) {
+        std::cerr << "  FAILED: dropped slabs not reused" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Block Pool Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    for (const char* name : {"a", "b", "c"}) std::remove((std::string(name) + "_mapping").c_str());
+    std::remove(c_table.c_str());
+    std::remove(c_device.c_str());
+
+    bool testPassed = TestTenants();
+    testPassed = TestReopen() && testPassed;
+
+    for (const char* name : {"a", "b", "c"}) std::remove((std::string(name) + "_mapping").c_str());
+    std::remove(c_table.c_str());
+    std::remove(c_device.c_str());
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,116 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/BuildCheckpoint.h"
+
+#include <iostream>
+#include <string>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static const std::string c_manifest = "build_checkpoint_test.txt";
+
+// Test 1: phases and batches marked by one run are seen by the next
+bool TestResume() {
+    std::cout << "  Testing resume..." << std::endl;
+    std::remove(c_manifest.c_str());
+    {
+        BuildCheckpoint checkpoint;
+        checkpoint.Open(c_manifest, "1000,128", true);
+        if (checkpoint.Done(BuildCheckpoint::kSelectHead) || checkpoint.CompletedBatches() != 0) {
+            std::cerr << "  FAILED: fresh manifest has progress" << std::endl;
+            return false;
+        }
+        checkpoint.MarkDone(BuildCheckpoint::kSelectHead);
+        checkpoint.MarkDone(BuildCheckpoint::kBuildHead);
+        checkpoint.MarkBatches(2);
+        checkpoint.MarkBatches(3);
+    }
+    BuildCheckpoint checkpoint;
+    checkpoint.Open(c_manifest, "1000,128", true);
+    if (!checkpoint.Done(BuildCheckpoint::kSelectHead) || !checkpoint.Done(BuildCheckpoint::kBuildHead) || checkpoint.Done(BuildCheckpoint::kPostings) || checkpoint.CompletedBatches() != 3) {
+        std::cerr << "  FAILED: progress lost, " << checkpoint.CompletedBatches() << " batches" << std::endl;
+        return false;
+    }
+    checkpoint.Remove();
+    if (fileexists(c_manifest.c_str()) || fileexists((c_manifest + ".tmp").c_str())) {
+        std::cerr << "  FAILED: manifest left behind" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a manifest of another input is ignored and replaced
+bool TestFingerprint() {
+    std::cout << "  Testing fingerprint mismatch..." << std::endl;
+    std::remove(c_manifest.c_str());
+    {
+        BuildCheckpoint checkpoint;
+        checkpoint.Open(c_manifest, "1000,128", true);
+        checkpoint.MarkDone(BuildCheckpoint::kSelectHead);
+        checkpoint.MarkBatches(4);
+    }
+    BuildCheckpoint checkpoint;
+    checkpoint.Open(c_manifest, "2000,128", true);
+    if (checkpoint.Done(BuildCheckpoint::kSelectHead) || checkpoint.CompletedBatches() != 0) {
+        std::cerr << "  FAILED: progress of another build was taken" << std::endl;
+        return false;
+    }
+    checkpoint.MarkBatches(1);
+    BuildCheckpoint reopened;
+    reopened.Open(c_manifest, "2000,128", true);
+    if (reopened.Done(BuildCheckpoint::kSelectHead) || reopened.CompletedBatches() != 1) {
+        std::cerr << "  FAILED: stale entries survived the rewrite" << std::endl;
+        return false;
+    }
+    reopened.Remove();
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: a disabled checkpoint neither reads nor writes the manifest
+bool TestDisabled() {
+    std::cout << "  Testing disabled checkpoint..." << std::endl;
+    std::remove(c_manifest.c_str());
+    {
+        BuildCheckpoint checkpoint;
+        checkpoint.Open(c_manifest, "1000,128", true);
+        checkpoint.MarkDone(BuildCheckpoint::kPostings);
+    }
+    BuildCheckpoint checkpoint;
+    checkpoint.Open(c_manifest, "1000,128", false);
+    checkpoint.MarkDone(BuildCheckpoint::kRefine);
+    checkpoint.Remove();
+    BuildCheckpoint reopened;
+    reopened.Open(c_manifest, "1000,128", true);
+    if (checkpoint.Done(BuildCheckpoint::kPostings) || !reopened.Done(BuildCheckpoint::kPostings) || reopened.Done(BuildCheckpoint::kRefine)) {
+        std::cerr << "  FAILED: disabled checkpoint touched the manifest" << std::endl;
+        return false;
+    }
+    reopened.Remove();
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Build Checkpoint Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestResume();
+    testPassed = TestFingerprint() && testPassed;
+    testPassed = TestDisabled() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
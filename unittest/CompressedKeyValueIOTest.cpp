@@ -0,0 +1,191 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/CompressedKeyValueIO.h"
+
+#include <iostream>
+#include <map>
+#include <random>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// in-memory store, views point straight at the stored strings
+class MemoryKeyValueIO : public KeyValueIO {
+   public:
+    ErrorCode Get(SizeType key, std::string* value) override {
+        *value = m_values[key];
+        return ErrorCode::Success;
+    }
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds& timeout) override {
+        values->clear();
+        for (SizeType key : keys) values->push_back(m_values[key]);
+        return ErrorCode::Success;
+    }
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::chrono::microseconds& timeout) override {
+        return MultiGet(keys, values, std::function<void(int)>(), timeout);
+    }
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout) override {
+        values->assign(keys.size(), PostingView());
+        for (size_t i = 0; i < keys.size(); i++) {
+            std::string& value = m_values[keys[i]];
+            (*values)[i].data = value.data();
+            (*values)[i].size = (AddressType)value.size();
+            m_lent++;
+            if (p_onPostingDone)
+                p_onPostingDone((int)i);
+        }
+        return ErrorCode::Success;
+    }
+    void ReleasePostingViews(std::vector<PostingView>* values) override {
+        for (auto& view : *values) {
+            if (view.data != nullptr)
+                m_lent--;
+        }
+        values->clear();
+    }
+    ErrorCode Put(SizeType key, const std::string& value) override {
+        m_values[key] = value;
+        return ErrorCode::Success;
+    }
+    ErrorCode Merge(SizeType key, const std::string& value) override {
+        m_values[key] += value;
+        return ErrorCode::Success;
+    }
+    ErrorCode Delete(SizeType key) override {
+        m_values.erase(key);
+        return ErrorCode::Success;
+    }
+    void ForceCompaction() override {}
+    void GetStat() override {}
+    bool Initialize(bool debug) override { return true; }
+    bool ExitBlockController(bool debug) override { return true; }
+    void ShutDown() override {}
+
+    std::map<SizeType, std::string> m_values;
+    int m_lent = 0;
+};
+
+static const int kDim = 32;
+static const int kEntrySize = sizeof(int) + sizeof(uint8_t) + kDim;
+
+// p_count uint8 entries with increasing IDs and vectors close to one center, as in a posting
+static std::string MakePosting(int p_count, int p_firstID, std::mt19937& p_rng) {
+    std::uniform_int_distribution<int> noise(-3, 3);
+    std::string posting((size_t)p_count * kEntrySize, '\0');
+    for (int i = 0; i < p_count; i++) {
+        char* entry = &posting[(size_t)i * kEntrySize];
+        int vid = p_firstID + i * 7;
+        memcpy(entry, &vid, sizeof(int));
+        entry[sizeof(int)] = (char)(i % 3);
+        for (int d = 0; d < kDim; d++) entry[sizeof(int) + 1 + d] = (char)(100 + d + noise(p_rng));
+    }
+    return posting;
+}
+
+// Test 1: compressed postings decode to their entries, appended raw entries included
+bool TestCodecRoundTrip() {
+    std::cout << "  Testing codec round trip..." << std::endl;
+    std::mt19937 rng(5);
+    PostingCodec codec(kEntrySize, 0);
+    std::string posting = MakePosting(200, 10, rng), stored, decoded;
+    codec.Encode(posting.data(), posting.size(), stored);
+    if (!PostingCodec::Compressed(stored.data(), stored.size()) || stored.size() >= posting.size() * 3 / 4) {
+        std::cerr << "  FAILED: " << posting.size() << " bytes stored as " << stored.size() << std::endl;
+        return false;
+    }
+    std::string tail = MakePosting(3, 5000, rng);
+    stored += tail;
+    if (!codec.Decode(stored.data(), stored.size(), decoded) || decoded != posting + tail) {
+        std::cerr << "  FAILED: decoded posting differs" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED (ratio " << (double)(stored.size() - tail.size()) / posting.size() << ")" << std::endl;
+    return true;
+}
+
+// Test 2: postings that do not shrink or hold a single entry stay raw
+bool TestCodecRaw() {
+    std::cout << "  Testing raw postings..." << std::endl;
+    std::mt19937 rng(9);
+    PostingCodec codec(kEntrySize, 0);
+    std::string random((size_t)50 * kEntrySize, '\0'), stored, decoded;
+    for (size_t i = 0; i < random.size(); i++) random[i] = (char)rng();
+    std::string single = MakePosting(1, 3, rng);
+    for (const std::string* posting : {&random, &single}) {
+        codec.Encode(posting->data(), posting->size(), stored);
+        if (stored != *posting || !codec.Decode(stored.data(), stored.size(), decoded) || decoded != *posting) {
+            std::cerr << "  FAILED: " << posting->size() << " byte posting was not kept raw" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: the store adapter hands back what was written through every read path
+bool TestStore() {
+    std::cout << "  Testing compressed store..." << std::endl;
+    std::mt19937 rng(13);
+    auto memory = std::make_shared<MemoryKeyValueIO>();
+    CompressedKeyValueIO store(memory, kEntrySize, 0);
+    std::vector<std::string> postings;
+    for (int k = 0; k < 4; k++) postings.push_back(MakePosting(50 + k * 20, k * 1000, rng));
+    store.Put(0, postings[0]);
+    store.BulkPut({1, 2}, {postings[1].size(), postings[2].size()}, [&](size_t i, char* ptr) { memcpy(ptr, postings[1 + i].data(), postings[1 + i].size()); });
+    // key 3 only ever gets appends
+    store.Merge(3, postings[3]);
+    std::string tail = MakePosting(2, 9000, rng);
+    store.Merge(0, tail);
+    postings[0] += tail;
+
+    std::string value;
+    for (SizeType key = 0; key < 4; key++) {
+        if (store.Get(key, &value) != ErrorCode::Success || value != postings[key]) {
+            std::cerr << "  FAILED: Get of posting " << key << std::endl;
+            return false;
+        }
+    }
+    std::vector<SizeType> keys = {3, 0, 2, 1};
+    std::vector<PostingView> views;
+    int streamed = 0;
+    if (store.MultiGet(keys, &views, [&](int i) { streamed++; }) != ErrorCode::Success || streamed != 4) {
+        std::cerr << "  FAILED: streamed " << streamed << " of 4 postings" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (std::string(views[i].data, views[i].size) != postings[keys[i]]) {
+            std::cerr << "  FAILED: view of posting " << keys[i] << std::endl;
+            return false;
+        }
+    }
+    store.ReleasePostingViews(&views);
+    if (memory->m_lent != 0 || memory->m_values[3] != postings[3] || memory->m_values[1].size() >= postings[1].size()) {
+        std::cerr << "  FAILED: " << memory->m_lent << " views still lent or postings stored in the wrong form" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Compressed Key Value IO Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestCodecRoundTrip();
+    testPassed = TestCodecRaw() && testPassed;
+    testPassed = TestStore() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,173 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/Dataset.h"
+#include "Core/Common/VersionLabel.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+static const int kThreads = 8;
+static const int kBatches = 2000;
+static const DimensionType kDim = 4;
+
+// Test 1: batches appended by several threads at once get disjoint rows holding their own data,
+// and R() never shows a row before it is written
+bool TestDatasetAppend() {
+    std::cout << "  Testing concurrent dataset append..." << std::endl;
+    Dataset<int> data(0, kDim, 64, kThreads * kBatches * 3);
+    Dataset<int> companion(0, 1, 64, kThreads * kBatches * 3);
+    std::atomic<int> torn(0), failed(0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&, t] {
+            for (int b = 0; b < kBatches; b++) {
+                int num = 1 + (b % 3);
+                std::vector<int> rows(num * kDim, t * kBatches + b);
+                SizeType begin;
+                if (data.AddBatch(num, rows.data(), &begin) != ErrorCode::Success || companion.AddBatchAt(begin, num, rows.data()) != ErrorCode::Success) {
+                    failed++;
+                    continue;
+                }
+                SizeType visible = data.R();
+                if (visible > 0 && *data[visible - 1] == -1)
+                    torn++;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    SizeType expected = kThreads * (kBatches / 3 * 6 + (kBatches % 3 >= 1 ? 1 : 0) + (kBatches % 3 >= 2 ? 2 : 0));
+    if (failed.load() != 0 || data.R() != expected || companion.R() != expected) {
+        std::cerr << "  FAILED: " << data.R() << " rows instead of " << expected << std::endl;
+        return false;
+    }
+    if (torn.load() != 0) {
+        std::cerr << "  FAILED: " << torn.load() << " rows visible before written" << std::endl;
+        return false;
+    }
+    std::vector<int> seen(kThreads * kBatches, 0);
+    for (SizeType i = 0; i < data.R(); i++) {
+        int tag = *data[i];
+        for (DimensionType d = 1; d < kDim; d++) {
+            if (data[i][d] != tag) {
+                std::cerr << "  FAILED: row " << i << " mixes two batches" << std::endl;
+                return false;
+            }
+        }
+        if (*companion[i] != tag) {
+            std::cerr << "  FAILED: companion row " << i << " out of step" << std::endl;
+            return false;
+        }
+        seen[tag]++;
+    }
+    for (int tag = 0; tag < kThreads * kBatches; tag++) {
+        if (seen[tag] != 1 + (tag % kBatches) % 3) {
+            std::cerr << "  FAILED: batch " << tag << " has " << seen[tag] << " rows" << std::endl;
+            return false;
+        }
+    }
+    if (data.AddBatch(kThreads * kBatches * 3) != ErrorCode::MemoryOverFlow) {
+        std::cerr << "  FAILED: append past capacity accepted" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: version map ids handed out concurrently are unique and dense
+bool TestVersionMapAppend() {
+    std::cout << "  Testing concurrent version map append..." << std::endl;
+    VersionLabel versions;
+    versions.Initialize(0, 1024, kThreads * kBatches);
+    std::vector<std::atomic<int>> taken(kThreads * kBatches);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThreads; t++) {
+        threads.emplace_back([&] {
+            for (int b = 0; b < kBatches; b++) {
+                SizeType begin = -1;
+                if (versions.AddBatch(1, &begin) == ErrorCode::Success && begin >= 0 && begin < kThreads * kBatches)
+                    taken[begin]++;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    for (int i = 0; i < kThreads * kBatches; i++) {
+        if (taken[i].load() != 1) {
+            std::cerr << "  FAILED: id " << i << " handed out " << taken[i].load() << " times" << std::endl;
+            return false;
+        }
+    }
+    if (versions.GetVectorNum() != kThreads * kBatches) {
+        std::cerr << "  FAILED: " << versions.GetVectorNum() << " ids" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: an abandoned range and every range after it stay unpublished in the datasets growing
+// together, ranges before it still go through, and SetR takes appends again
+bool TestAbandonedRange() {
+    std::cout << "  Testing abandoned ranges..." << std::endl;
+    Dataset<int> data(0, kDim, 64, 1024);
+    Dataset<int> companion(0, 1, 64, 1024);
+    std::vector<int> rows(8 * kDim, 7);
+    SizeType first, second, third;
+    if (data.ReserveBatch(2, first) != ErrorCode::Success || data.ReserveBatch(3, second) != ErrorCode::Success || data.ReserveBatch(3, third) != ErrorCode::Success) {
+        std::cerr << "  FAILED: could not reserve" << std::endl;
+        return false;
+    }
+    // the third range waits behind the second, which is given up in both datasets
+    ErrorCode waiting = ErrorCode::Success;
+    std::thread behind([&] { waiting = data.AddBatchAt(third, 3, rows.data()); });
+    if (data.AddBatchAt(first, 2, rows.data()) != ErrorCode::Success || companion.AddBatchAt(first, 2, rows.data()) != ErrorCode::Success) {
+        std::cerr << "  FAILED: range before the abandoned one did not go through" << std::endl;
+        behind.join();
+        return false;
+    }
+    data.Abandon(second);
+    companion.Abandon(second);
+    behind.join();
+    SizeType next;
+    if (waiting == ErrorCode::Success || companion.AddBatchAt(third, 3, rows.data()) == ErrorCode::Success || data.ReserveBatch(1, next) == ErrorCode::Success) {
+        std::cerr << "  FAILED: append went past an abandoned range" << std::endl;
+        return false;
+    }
+    if (data.R() != 2 || companion.R() != 2) {
+        std::cerr << "  FAILED: published " << data.R() << " and " << companion.R() << " rows" << std::endl;
+        return false;
+    }
+    data.SetR(2);
+    if (data.AddBatch(1, rows.data(), &next) != ErrorCode::Success || next != 2 || data.R() != 3) {
+        std::cerr << "  FAILED: no append after SetR" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Concurrent Append Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestDatasetAppend();
+    testPassed = TestVersionMapAppend() && testPassed;
+    testPassed = TestAbandonedRange() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,133 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Helper/CoreServer.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::Helper;
+
+// Test 1: core lists in taskset and reactor mask forms
+bool TestParse() {
+    std::cout << "  Testing core lists..." << std::endl;
+    std::vector<int> cores;
+    if (!CoreMap::Parse("0-2,5,7-8", cores) || cores != std::vector<int>({0, 1, 2, 5, 7, 8})) {
+        std::cerr << "  FAILED: taskset list" << std::endl;
+        return false;
+    }
+    if (!CoreMap::Parse("[4-5]", cores) || cores != std::vector<int>({4, 5}) || !CoreMap::Parse("0x0A", cores) || cores != std::vector<int>({1, 3})) {
+        std::cerr << "  FAILED: reactor mask" << std::endl;
+        return false;
+    }
+    if (!CoreMap::Parse("", cores) || !cores.empty() || CoreMap::Parse("3-1", cores) || CoreMap::Parse("1,x", cores)) {
+        std::cerr << "  FAILED: empty or malformed list" << std::endl;
+        return false;
+    }
+    if (!CoreMap::Overlap({1, 2}, {2, 3}) || CoreMap::Overlap({1}, {0, 2})) {
+        std::cerr << "  FAILED: overlap" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: items pushed by several producers through a small ring are popped once each, in the
+// order of every producer
+bool TestRing() {
+    std::cout << "  Testing MPSC ring..." << std::endl;
+    const int producers = 4, perProducer = 100000;
+    MPSCRing<std::uint64_t> ring(64);
+    std::vector<std::thread> threads;
+    for (int p = 0; p < producers; p++) {
+        threads.emplace_back([&, p] {
+            for (std::uint64_t i = 0; i < perProducer; i++) {
+                while (!ring.TryPush(((std::uint64_t)p << 32) | i)) std::this_thread::yield();
+            }
+        });
+    }
+    std::vector<std::uint64_t> next(producers, 0);
+    bool ordered = true;
+    for (int popped = 0; popped < producers * perProducer;) {
+        std::uint64_t item;
+        if (!ring.TryPop(item))
+            continue;
+        int p = (int)(item >> 32);
+        if ((item & 0xffffffff) != next[p]++)
+            ordered = false;
+        popped++;
+    }
+    for (auto& t : threads) t.join();
+    std::uint64_t extra;
+    if (!ordered || ring.TryPop(extra)) {
+        std::cerr << "  FAILED: items lost, repeated or reordered" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: every request is served once, on the core of the worker it was given to
+bool TestServer() {
+    std::cout << "  Testing core server..." << std::endl;
+    std::vector<int> cores;
+    for (int c = 0; c < (int)(std::min)(std::thread::hardware_concurrency(), 2u); c++) cores.push_back(c);
+    const int requests = 20000;
+    std::vector<std::atomic<int>> served(requests);
+    std::atomic<int> misplaced(0), initialized(0), exited(0);
+    {
+        CoreServer<int> server;
+        server.Start(
+            cores,
+            16,
+            [&](int worker, int& request) {
+                served[request]++;
+                if (sched_getcpu() != cores[worker] || CoreMap::Slot() != worker)
+                    misplaced++;
+            },
+            [&](int) { initialized++; },
+            [&](int) { exited++; });
+        if (server.Workers() != (int)cores.size() || initialized.load() != (int)cores.size()) {
+            std::cerr << "  FAILED: workers not started" << std::endl;
+            return false;
+        }
+        for (int r = 0; r < requests; r++) server.Submit(r);
+        server.Stop();
+    }
+    for (int r = 0; r < requests; r++) {
+        if (served[r].load() != 1) {
+            std::cerr << "  FAILED: request " << r << " served " << served[r].load() << " times" << std::endl;
+            return false;
+        }
+    }
+    if (misplaced.load() != 0 || exited.load() != (int)cores.size()) {
+        std::cerr << "  FAILED: " << misplaced.load() << " requests off their core" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Core Server Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestParse();
+    testPassed = TestRing() && testPassed;
+    testPassed = TestServer() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,132 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/VersionLabel.h"
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+static const int kVectors = 5000;
+static const std::string c_labelFile = "deleted_bitmap_test.bin";
+
+// p_count posting entries of p_stride bytes, each starting with a VID
+static std::vector<char> MakeEntries(int p_count, int p_stride, std::mt19937& p_rng) {
+    std::vector<char> entries((size_t)p_count * p_stride, 0);
+    std::uniform_int_distribution<int> pick(0, kVectors - 1);
+    for (int i = 0; i < p_count; i++) {
+        int vid = pick(p_rng);
+        memcpy(entries.data() + (size_t)i * p_stride, &vid, sizeof(int));
+    }
+    return entries;
+}
+
+// Test 1: every kernel available on this CPU gives the bits of the entries
+bool TestKernels() {
+    std::cout << "  Testing bit test kernels..." << std::endl;
+    std::mt19937 rng(3);
+    std::vector<std::uint32_t> bits((kVectors + 31) / 32);
+    for (auto& word : bits) word = rng();
+    std::vector<BitTestReturn> kernels = {&SIMDUtils::BitTestStrided_Naive, BitTestSelector()};
+    if (InstructionSet::AVX2())
+        kernels.push_back(&SIMDUtils::BitTestStrided_AVX);
+    if (InstructionSet::AVX512())
+        kernels.push_back(&SIMDUtils::BitTestStrided_AVX512);
+    for (int stride : {4, 5, 133, 517}) {
+        for (int count : {0, 1, 7, 8, 17, 33, 64}) {
+            std::vector<char> entries = MakeEntries(count, stride, rng);
+            std::uint64_t expected = 0;
+            for (int i = 0; i < count; i++) {
+                int vid = *(const int*)(entries.data() + (size_t)i * stride);
+                expected |= (std::uint64_t)((bits[vid / 32] >> (vid % 32)) & 1) << i;
+            }
+            for (auto kernel : kernels) {
+                if (kernel(bits.data(), entries.data(), stride, count) != expected) {
+                    std::cerr << "  FAILED: " << count << " entries at stride " << stride << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+static bool MatchesLabels(VersionLabel& p_labels, std::mt19937& p_rng) {
+    for (int stride : {8, 133}) {
+        std::vector<char> entries = MakeEntries(300, stride, p_rng);
+        std::vector<std::uint64_t> mask(5);
+        p_labels.DeletedMask(entries.data(), stride, 300, mask.data());
+        for (int i = 0; i < 300; i++) {
+            int vid = *(const int*)(entries.data() + (size_t)i * stride);
+            bool expected = p_labels.GetVersion(vid) == 0xfe;
+            if (p_labels.Deleted(vid) != expected || (((mask[i / 64] >> (i % 64)) & 1) != 0) != expected)
+                return false;
+        }
+    }
+    return true;
+}
+
+// Test 2: the bits follow deletes, survive a save and load, and cover added labels
+bool TestLabels() {
+    std::cout << "  Testing version labels..." << std::endl;
+    std::mt19937 rng(5);
+    {
+        VersionLabel labels;
+        labels.Initialize(kVectors, 1024, kVectors * 2);
+        std::vector<SizeType> batch;
+        for (int vid = 0; vid < kVectors; vid++) {
+            if (rng() % 3 == 0)
+                labels.Delete(vid);
+            else if (rng() % 5 == 0)
+                batch.push_back(vid);
+        }
+        labels.Delete(batch);
+        uint8_t version;
+        if (!MatchesLabels(labels, rng) || labels.IncVersion(batch[0], &version) || labels.Delete(batch[0])) {
+            std::cerr << "  FAILED: deleted labels" << std::endl;
+            return false;
+        }
+        if (labels.Save(c_labelFile) != ErrorCode::Success) {
+            std::cerr << "  FAILED: save" << std::endl;
+            return false;
+        }
+    }
+    VersionLabel loaded;
+    if (loaded.Load(c_labelFile, 1024, kVectors * 2) != ErrorCode::Success || !MatchesLabels(loaded, rng)) {
+        std::cerr << "  FAILED: bits lost by the load" << std::endl;
+        return false;
+    }
+    std::remove(c_labelFile.c_str());
+    loaded.AddBatch(10);
+    if (loaded.Deleted(kVectors + 5) || !loaded.Delete(kVectors + 5) || !loaded.Deleted(kVectors + 5)) {
+        std::cerr << "  FAILED: added label" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Deleted Bitmap Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestKernels();
+    testPassed = TestLabels() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,155 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Utils/DistanceUtils.h"
+
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+template <typename T>
+using BatchFunc = void (*)(const T*, const void* const*, int, DimensionType, float*);
+
+template <typename T>
+using SingleFunc = float (*)(const T*, const T*, DimensionType);
+
+// every length and count around the SIMD widths, vectors at an odd stride like posting entries
+template <typename T>
+bool CheckBatch(const char* p_name, BatchFunc<T> p_batch, SingleFunc<T> p_single) {
+    std::mt19937 rng(11);
+    std::uniform_int_distribution<int> value(std::is_same<T, std::uint8_t>::value ? 0 : -100, 100);
+    const int stride = 133 * sizeof(T) + 5;
+    std::vector<std::uint8_t> block(stride * 10 + 64);
+    std::vector<T> query(133);
+    for (DimensionType length = 1; length <= 133; length += (length < 70 ? 1 : 21)) {
+        for (auto& q : query) q = (T)value(rng);
+        std::vector<const void*> vectors;
+        for (int i = 0; i < 10; i++) {
+            T* vector = (T*)(block.data() + (size_t)i * stride + 5);
+            for (DimensionType d = 0; d < length; d++) {
+                T v = (T)value(rng);
+                memcpy(vector + d, &v, sizeof(T));
+            }
+            vectors.push_back(vector);
+        }
+        for (int count = 0; count <= 10; count++) {
+            std::vector<float> dists(count + 1, -1.0f);
+            p_batch(query.data(), vectors.data(), count, length, dists.data());
+            for (int i = 0; i < count; i++) {
+                std::vector<T> aligned(length);
+                memcpy(aligned.data(), vectors[i], sizeof(T) * length);
+                float expected = p_single(query.data(), aligned.data(), length);
+                if (std::fabs(dists[i] - expected) > 1e-4f * (1.0f + std::fabs(expected))) {
+                    std::cerr << "  FAILED: " << p_name << " length " << length << " vector " << i << ": " << dists[i] << " vs " << expected << std::endl;
+                    return false;
+                }
+            }
+            if (dists[count] != -1.0f) {
+                std::cerr << "  FAILED: " << p_name << " wrote past count" << std::endl;
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+template <typename T>
+bool TestType(const char* p_type) {
+    std::cout << "  Testing " << p_type << "..." << std::endl;
+    bool passed = CheckBatch<T>("L2", &DistanceUtils::ComputeL2DistanceBatch<T>, &DistanceUtils::ComputeL2Distance<T>) &&
+                  CheckBatch<T>("Cosine", &DistanceUtils::ComputeCosineDistanceBatch<T>, &DistanceUtils::ComputeCosineDistance<T>);
+    if (InstructionSet::SSE2())
+        passed = passed && CheckBatch<T>("L2_SSE", &DistanceUtils::ComputeL2DistanceBatch_SSE, &DistanceUtils::ComputeL2Distance<T>) &&
+                 CheckBatch<T>("Cosine_SSE", &DistanceUtils::ComputeCosineDistanceBatch_SSE, &DistanceUtils::ComputeCosineDistance<T>);
+    if (InstructionSet::AVX2())
+        passed = passed && CheckBatch<T>("L2_AVX", &DistanceUtils::ComputeL2DistanceBatch_AVX, &DistanceUtils::ComputeL2Distance<T>) &&
+                 CheckBatch<T>("Cosine_AVX", &DistanceUtils::ComputeCosineDistanceBatch_AVX, &DistanceUtils::ComputeCosineDistance<T>);
+    if (InstructionSet::AVX512())
+        passed = passed && CheckBatch<T>("L2_AVX512", &DistanceUtils::ComputeL2DistanceBatch_AVX512, &DistanceUtils::ComputeL2Distance<T>) &&
+                 CheckBatch<T>("Cosine_AVX512", &DistanceUtils::ComputeCosineDistanceBatch_AVX512, &DistanceUtils::ComputeCosineDistance<T>);
+    if (passed)
+        std::cout << "  PASSED" << std::endl;
+    return passed;
+}
+
+// the fixed-dimension kernels give what the generic ones give for their dimension, in batches too,
+// and other dimensions or element types fall back to the generic kernels
+template <typename T>
+bool TestFixedDimensions(const char* p_type) {
+    std::cout << "  Testing fixed-dimension " << p_type << " kernels..." << std::endl;
+    bool expectKernels = !std::is_same<T, std::int16_t>::value && (InstructionSet::AVX512() || InstructionSet::AVX2() || (sizeof(T) == 4 && InstructionSet::AVX()));
+    std::mt19937 rng(13);
+    std::uniform_int_distribution<int> value(std::is_same<T, std::uint8_t>::value ? 0 : -100, 100);
+    for (DistCalcMethod method : {DistCalcMethod::L2, DistCalcMethod::Cosine, DistCalcMethod::InnerProduct}) {
+        SingleFunc<T> generic = DistanceCalcSelector<T>(method);
+        if (DistanceCalcSelector<T>(method, 97) != generic || DistanceUtils::FixedDimensionKernel<T>(method, 97) != nullptr) {
+            std::cerr << "  FAILED: dimension 97 did not fall back" << std::endl;
+            return false;
+        }
+        for (DimensionType dim : DistanceUtils::FixedDimensions) {
+            SingleFunc<T> fixed = DistanceUtils::FixedDimensionKernel<T>(method, dim);
+            BatchFunc<T> fixedBatch = DistanceUtils::FixedDimensionBatchKernel<T>(method, dim);
+            if ((fixed != nullptr) != expectKernels || (fixedBatch != nullptr) != expectKernels) {
+                std::cerr << "  FAILED: dimension " << dim << (expectKernels ? " has no kernel" : " has a kernel") << std::endl;
+                return false;
+            }
+            if (!expectKernels) {
+                if (DistanceCalcSelector<T>(method, dim) != generic)
+                    return false;
+                continue;
+            }
+            if (DistanceCalcSelector<T>(method, dim) != fixed || DistanceBatchSelector<T>(method, dim) != fixedBatch) {
+                std::cerr << "  FAILED: the selectors skip the dimension " << dim << " kernels" << std::endl;
+                return false;
+            }
+            std::vector<T> query(dim), vectors((size_t)dim * 9);
+            for (auto& v : query) v = (T)value(rng);
+            for (auto& v : vectors) v = (T)value(rng);
+            std::vector<const void*> pointers;
+            for (int i = 0; i < 9; i++) pointers.push_back(vectors.data() + (size_t)i * dim);
+            std::vector<float> dists(9);
+            fixedBatch(query.data(), pointers.data(), 9, dim, dists.data());
+            for (int i = 0; i < 9; i++) {
+                float expected = generic(query.data(), vectors.data() + (size_t)i * dim, dim);
+                float single = fixed(query.data(), vectors.data() + (size_t)i * dim, dim);
+                if (std::fabs(single - expected) > 1e-4f * (1.0f + std::fabs(expected)) || std::fabs(dists[i] - expected) > 1e-4f * (1.0f + std::fabs(expected))) {
+                    std::cerr << "  FAILED: dimension " << dim << " vector " << i << ": " << single << ", " << dists[i] << " vs " << expected << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Distance Batch Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestType<std::int8_t>("int8");
+    testPassed = TestType<std::uint8_t>("uint8") && testPassed;
+    testPassed = TestType<std::int16_t>("int16") && testPassed;
+    testPassed = TestType<float>("float") && testPassed;
+    testPassed = TestFixedDimensions<std::int8_t>("int8") && testPassed;
+    testPassed = TestFixedDimensions<std::uint8_t>("uint8") && testPassed;
+    testPassed = TestFixedDimensions<std::int16_t>("int16") && testPassed;
+    testPassed = TestFixedDimensions<float>("float") && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
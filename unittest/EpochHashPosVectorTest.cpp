@@ -0,0 +1,88 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/WorkSpace.h"
+
+#include <iostream>
+#include <random>
+#include <unordered_set>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+// exposes the epoch so the wrap-around can be tested without 2^32 clears
+class EpochHashPosVectorProbe : public EpochHashPosVector {
+   public:
+    void SetEpoch(std::uint32_t p_epoch) {
+        m_epoch = p_epoch;
+    }
+};
+
+// Test 1: the set matches std::unordered_set, also after growing well past its initial size
+bool TestCheckAndSet() {
+    std::cout << "  Testing CheckAndSet and growth..." << std::endl;
+    EpochHashPosVector dedup;
+    dedup.Init(64, 2);
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<SizeType> pick(0, 20000);
+    std::unordered_set<SizeType> truth;
+    for (int i = 0; i < 50000; i++) {
+        SizeType idx = pick(rng);
+        bool seen = !truth.insert(idx).second;
+        if (dedup.CheckAndSet(idx) != seen) {
+            std::cerr << "  FAILED: ID " << idx << " reported " << (seen ? "new" : "seen") << std::endl;
+            return false;
+        }
+    }
+    if (dedup.HashTableExponent() <= 2) {
+        std::cerr << "  FAILED: table did not grow" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: clear forgets every ID, including across the epoch wrap-around
+bool TestClear() {
+    std::cout << "  Testing clear..." << std::endl;
+    EpochHashPosVectorProbe dedup;
+    dedup.Init(1024, 2);
+    dedup.SetEpoch(0xFFFFFFFEu);
+    for (int round = 0; round < 4; round++) {
+        for (SizeType idx = 0; idx < 500; idx++) {
+            if (dedup.CheckAndSet(idx * 7)) {
+                std::cerr << "  FAILED: ID " << idx * 7 << " survived clear in round " << round << std::endl;
+                return false;
+            }
+        }
+        for (SizeType idx = 0; idx < 500; idx++) {
+            if (!dedup.CheckAndSet(idx * 7)) {
+                std::cerr << "  FAILED: ID " << idx * 7 << " lost in round " << round << std::endl;
+                return false;
+            }
+        }
+        dedup.clear();
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Epoch Hash Pos Vector Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestCheckAndSet();
+    testPassed = TestClear() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
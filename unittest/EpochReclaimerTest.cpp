@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/EpochReclaimer.h"
+
+#include <atomic>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG::SPANN;
+
+// Test 1: without readers retired items run on the next calls, a guard holds them back
+bool TestGuard() {
+    std::cout << "  Testing guards..." << std::endl;
+    EpochReclaimer reclaimer;
+    int freed = 0;
+    reclaimer.Retire([&]() { freed++; });
+    reclaimer.Collect();
+    if (freed != 1) {
+        std::cerr << "  FAILED: item not freed without readers" << std::endl;
+        return false;
+    }
+    {
+        EpochReclaimer::Guard guard(reclaimer);
+        reclaimer.Retire([&]() { freed++; });
+        for (int i = 0; i < 10; i++) reclaimer.Collect();
+        if (freed != 1) {
+            std::cerr << "  FAILED: item freed under an older guard" << std::endl;
+            return false;
+        }
+    }
+    reclaimer.Collect();
+    reclaimer.Retire([&]() { freed++; });
+    reclaimer.Drain();
+    if (freed != 3 || reclaimer.Pending() != 0) {
+        std::cerr << "  FAILED: " << freed << " items freed after the guard ended" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: readers never see a value that was retired and poisoned while they held it
+bool TestConcurrent() {
+    std::cout << "  Testing concurrent swaps..." << std::endl;
+    EpochReclaimer reclaimer;
+    std::atomic<std::int64_t*> current(new std::int64_t(0));
+    std::atomic<bool> stop(false), torn(false);
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++) {
+        readers.emplace_back([&]() {
+            while (!stop) {
+                EpochReclaimer::Guard guard(reclaimer);
+                std::int64_t* value = current.load();
+                std::int64_t first = *value;
+                for (int spin = 0; spin < 50; spin++) {
+                    if (*value != first || first < 0)
+                        torn = true;
+                }
+            }
+        });
+    }
+    std::vector<std::thread> writers;
+    for (int t = 0; t < 2; t++) {
+        writers.emplace_back([&, t]() {
+            for (std::int64_t i = 1; i <= 100000; i++) {
+                std::int64_t* old = current.exchange(new std::int64_t(i * 2 + t));
+                reclaimer.Retire([old]() {
+                    *old = -1;
+                    delete old;
+                });
+            }
+        });
+    }
+    for (auto& writer : writers) writer.join();
+    stop = true;
+    for (auto& reader : readers) reader.join();
+    reclaimer.Drain();
+    delete current.load();
+    if (torn) {
+        std::cerr << "  FAILED: a reader saw a reclaimed value" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Epoch Reclaimer Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestGuard();
+    testPassed = TestConcurrent() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,229 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/ExtentAllocator.h"
+
+#include <algorithm>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG::SPANN;
+typedef ExtentAllocator::AddressType AddressType;
+
+// Test 1: blocks of one request are adjacent and coalesce back into a single extent
+bool TestContiguousAndCoalesce() {
+    std::cout << "  Testing contiguous allocation and coalescing..." << std::endl;
+    ExtentAllocator allocator;
+    allocator.Initialize(1 << 20, 64);
+
+    std::vector<std::vector<AddressType>> postings(100, std::vector<AddressType>(3));
+    for (auto& posting : postings) {
+        if (!allocator.Allocate(posting.data(), 3)) {
+            std::cerr << "  FAILED: allocation failed" << std::endl;
+            return false;
+        }
+        if (posting[1] != posting[0] + 1 || posting[2] != posting[0] + 2) {
+            std::cerr << "  FAILED: posting blocks are not adjacent" << std::endl;
+            return false;
+        }
+    }
+    if (allocator.FreeBlocks() != (1 << 20) - 300) {
+        std::cerr << "  FAILED: free block count " << allocator.FreeBlocks() << std::endl;
+        return false;
+    }
+    for (auto& posting : postings) {
+        allocator.Release(posting.data(), 3);
+    }
+    if (allocator.FreeBlocks() != (1 << 20)) {
+        std::cerr << "  FAILED: free blocks not restored" << std::endl;
+        return false;
+    }
+    // the thread's cached chunk stays apart, everything else collapses into one extent
+    if (allocator.ExtentCount() > 2) {
+        std::cerr << "  FAILED: released extents not coalesced, count " << allocator.ExtentCount() << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: concurrent allocation never hands out the same block twice and fails cleanly when full
+bool TestConcurrentUnique() {
+    std::cout << "  Testing concurrent allocation..." << std::endl;
+    const AddressType totalBlocks = 8 * 1000 * 5;
+    ExtentAllocator allocator;
+    allocator.Initialize(totalBlocks, 16);
+
+    const int numThreads = 8;
+    std::vector<std::vector<AddressType>> results(numThreads);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; t++) {
+        threads.emplace_back([&, t]() {
+            AddressType blocks[5];
+            for (int i = 0; i < 1000; i++) {
+                if (allocator.Allocate(blocks, 5)) results[t].insert(results[t].end(), blocks, blocks + 5);
+                if (i % 3 == 0) {
+                    allocator.Release(results[t].data() + results[t].size() - 5, 5);
+                    results[t].resize(results[t].size() - 5);
+                }
+            }
+        });
+    }
+    for (auto& th : threads) th.join();
+
+    std::set<AddressType> seen;
+    for (auto& r : results) {
+        for (AddressType b : r) {
+            if (b < 0 || b >= totalBlocks || !seen.insert(b).second) {
+                std::cerr << "  FAILED: block " << b << " handed out twice or out of range" << std::endl;
+                return false;
+            }
+        }
+    }
+    if (allocator.FreeBlocks() != totalBlocks - (AddressType)seen.size()) {
+        std::cerr << "  FAILED: free block count mismatch" << std::endl;
+        return false;
+    }
+
+    ExtentAllocator small;
+    small.Initialize(4, 4);
+    AddressType blocks[5];
+    if (small.Allocate(blocks, 5) || small.FreeBlocks() != 4) {
+        std::cerr << "  FAILED: over-allocation should fail and roll back" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: resetting from the blocks of a recovered mapping leaves exactly the gaps free
+bool TestInitializeFromUsed() {
+    std::cout << "  Testing initialization from used blocks..." << std::endl;
+    ExtentAllocator allocator;
+    std::vector<AddressType> used = {0, 1, 5, 6, 7, 20};
+    std::vector<std::uint64_t> usedBits(1, 0);
+    for (AddressType b : used) usedBits[0] |= 1ULL << b;
+    allocator.Initialize(32, usedBits, 4);
+    if (allocator.FreeBlocks() != 32 - (AddressType)used.size() || allocator.ExtentCount() != 3) {
+        std::cerr << "  FAILED: free space " << allocator.FreeBlocks() << " in " << allocator.ExtentCount() << " extents" << std::endl;
+        return false;
+    }
+    std::vector<AddressType> blocks(26);
+    if (!allocator.Allocate(blocks.data(), 26)) {
+        std::cerr << "  FAILED: cannot allocate the remaining blocks" << std::endl;
+        return false;
+    }
+    for (AddressType b : blocks) {
+        if (std::find(used.begin(), used.end(), b) != used.end()) {
+            std::cerr << "  FAILED: used block " << b << " handed out" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 4: placement hints take the nearest free run that fits, cut at the side facing the hint
+bool TestAllocateNear() {
+    std::cout << "  Testing allocation near a hint..." << std::endl;
+    ExtentAllocator allocator;
+    // [0, 500) is used except [100, 102) and [300, 310)
+    std::vector<std::uint64_t> usedBits(16, 0);
+    for (AddressType b = 0; b < 500; b++) {
+        if ((b < 100 || b >= 102) && (b < 300 || b >= 310)) usedBits[b >> 6] |= 1ULL << (b & 63);
+    }
+    allocator.Initialize(1000, usedBits, 4);
+
+    struct Case {
+        int size;
+        AddressType near;
+        AddressType expected;
+    } cases[] = {{3, 290, 300}, {3, 320, 307}, {2, 2, 100}, {4, 700, 700}};
+    for (auto& c : cases) {
+        std::vector<AddressType> blocks(c.size);
+        if (!allocator.AllocateNear(blocks.data(), c.size, c.near)) {
+            std::cerr << "  FAILED: allocation near " << c.near << " failed" << std::endl;
+            return false;
+        }
+        for (int i = 0; i < c.size; i++) {
+            if (blocks[i] != c.expected + i) {
+                std::cerr << "  FAILED: block " << i << " near " << c.near << " is " << blocks[i] << ", expected " << c.expected + i << std::endl;
+                return false;
+            }
+        }
+    }
+    if (allocator.FreeBlocks() != 512 - 12) {
+        std::cerr << "  FAILED: free block count " << allocator.FreeBlocks() << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 5: extents stay inside their domain and chunks go to the domain with the most free space per load
+bool TestDomains() {
+    std::cout << "  Testing allocation domains..." << std::endl;
+    ExtentAllocator allocator;
+    std::vector<AddressType> load = {0, 0, 0};
+    allocator.SetDomains({0, 1000, 1500}, [&](int domain) { return load[domain]; });
+    allocator.Initialize(2000, 100);
+    if (allocator.ExtentCount() != 3 || allocator.DomainOf(999) != 0 || allocator.DomainOf(1000) != 1 || allocator.DomainOf(1999) != 2) {
+        std::cerr << "  FAILED: " << allocator.ExtentCount() << " extents for three domains" << std::endl;
+        return false;
+    }
+    // the first chunk comes from the largest domain, a busy one is passed over
+    std::vector<AddressType> blocks(100);
+    allocator.Allocate(blocks.data(), 100);
+    if (allocator.DomainOf(blocks[0]) != 0) {
+        std::cerr << "  FAILED: first chunk from domain " << allocator.DomainOf(blocks[0]) << std::endl;
+        return false;
+    }
+    load[0] = 10;
+    allocator.Allocate(blocks.data(), 100);
+    if (allocator.DomainOf(blocks[0]) == 0) {
+        std::cerr << "  FAILED: chunk from the busy domain" << std::endl;
+        return false;
+    }
+    // a request larger than a domain spans two, each run stays on its side of the boundary
+    ExtentAllocator spanning;
+    spanning.SetDomains({0, 64});
+    std::vector<std::uint64_t> usedBits(2, 0);
+    spanning.Initialize(128, usedBits, 128);
+    std::vector<AddressType> all(128);
+    if (!spanning.Allocate(all.data(), 128)) {
+        std::cerr << "  FAILED: whole space not allocated" << std::endl;
+        return false;
+    }
+    spanning.Release(all.data(), 128);
+    if (spanning.ExtentCount() != 2 || spanning.FreeBlocks() != 128) {
+        std::cerr << "  FAILED: released blocks merged across the boundary" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Extent Allocator Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestContiguousAndCoalesce();
+    testPassed = TestConcurrentUnique() && testPassed;
+    testPassed = TestInitializeFromUsed() && testPassed;
+    testPassed = TestAllocateNear() && testPassed;
+    testPassed = TestDomains() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
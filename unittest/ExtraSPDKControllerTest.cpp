@@ -121,6 +121,54 @@ bool ExtraSPDKControllerTest() {
         return false;
     }
 
+    std::cout << "  Testing zero-copy MultiGet..." << std::endl;
+    std::string largeData(3 * 4096 + 123, 'x');
+    for (size_t i = 0; i < largeData.size(); ++i) {
+        largeData[i] = static_cast<char>('a' + i % 26);
+    }
+    ret = spdkIO->Put(300, largeData);
+    if (ret != ErrorCode::Success) {
+        std::cerr << "  FAILED: Put operation failed for multi-page posting" << std::endl;
+        return false;
+    }
+
+    std::vector<SizeType> viewKeys = {200, 300, 204};
+    std::vector<SPANN::PostingView> views;
+    ret = spdkIO->MultiGet(viewKeys, &views);
+    if (ret != ErrorCode::Success || views.size() != viewKeys.size()) {
+        std::cerr << "  FAILED: zero-copy MultiGet failed" << std::endl;
+        return false;
+    }
+    const std::string* expected[] = {&testDataArray[0], &largeData, &testDataArray[4]};
+    for (size_t i = 0; i < views.size(); ++i) {
+        if (std::string(views[i].data, views[i].size) != *expected[i]) {
+            std::cerr << "  FAILED: zero-copy MultiGet data mismatch for key " << viewKeys[i] << std::endl;
+            return false;
+        }
+    }
+    spdkIO->ReleasePostingViews(&views);
+    std::cout << "  PASSED: zero-copy MultiGet matches Put data" << std::endl;
+
+    std::cout << "  Testing Merge with tail page cache..." << std::endl;
+    spdkIO->SetTailCache(1 << 20);
+    std::string mergedData = "head part of posting;";
+    ret = spdkIO->Put(400, mergedData);
+    for (int i = 0; i < 300 && ret == ErrorCode::Success; ++i) {
+        std::string part = "merge chunk " + std::to_string(i) + ";";
+        ret = spdkIO->Merge(400, part);
+        mergedData += part;
+    }
+    std::string mergedRead;
+    if (ret != ErrorCode::Success || spdkIO->Get(400, &mergedRead) != ErrorCode::Success || mergedRead != mergedData) {
+        std::cerr << "  FAILED: merged posting mismatch with tail page cache" << std::endl;
+        return false;
+    }
+    if (spdkIO->TailCacheBytes() != mergedData.size() % 4096) {
+        std::cerr << "  FAILED: tail page cache holds " << spdkIO->TailCacheBytes() << " bytes" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED: Merge with tail page cache matches" << std::endl;
+
     std::cout << "  Testing Delete operation..." << std::endl;
     SizeType deleteKey = 150;
     const std::string deleteData = "Data to be deleted";
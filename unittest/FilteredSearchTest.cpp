@@ -0,0 +1,220 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/QueryResultSet.h"
+#include "Core/SPANN/Index.h"
+#include "Core/SPANN/VectorLabels.h"
+#include "Utils/DistanceUtils.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: label masks, per-bit counts and the selectivity estimate, saved and loaded
+bool TestLabels() {
+    std::cout << "  Testing label store..." << std::endl;
+    const char* path = "test_vector_labels.bin";
+    VectorLabels labels;
+    labels.Initialize(64, 1000);
+    std::vector<std::uint64_t> masks(100);
+    for (int i = 0; i < 100; i++) masks[i] = (i % 10 == 0 ? 1 : 0) | (i % 2 == 0 ? 2 : 0);
+    // rows before 50 are added unlabeled
+    if (labels.Set(50, 50, masks.data() + 50) != ErrorCode::Success || labels.Get(10) != 0 || labels.Get(60) != 3 || labels.Get(500) != 0) {
+        std::cerr << "  FAILED: labels set past the last row" << std::endl;
+        return false;
+    }
+    labels.Set(0, 50, masks.data());
+    LabelFilter tenth{1, 0}, half{2, 0}, either{0, 3}, none{4, 0};
+    if (std::abs(labels.Selectivity(tenth, 100) - 0.1f) > 1e-6f || std::abs(labels.Selectivity(half, 100) - 0.5f) > 1e-6f ||
+        std::abs(labels.Selectivity(either, 100) - 0.6f) > 1e-6f || labels.Selectivity(none, 100) != 0.0f || labels.Selectivity(LabelFilter(), 100) != 1.0f) {
+        std::cerr << "  FAILED: selectivity " << labels.Selectivity(tenth, 100) << " " << labels.Selectivity(half, 100) << " " << labels.Selectivity(either, 100) << std::endl;
+        return false;
+    }
+    if (!tenth.Matches(3) || tenth.Matches(2) || !either.Matches(2) || either.Matches(4)) {
+        std::cerr << "  FAILED: filter matching" << std::endl;
+        return false;
+    }
+    // overwriting moves the counts with it
+    std::uint64_t cleared = 0;
+    labels.Set(0, 1, &cleared);
+    if (std::abs(labels.Selectivity(tenth, 100) - 0.09f) > 1e-6f) {
+        std::cerr << "  FAILED: counts after an overwrite" << std::endl;
+        return false;
+    }
+
+    VectorLabels loaded;
+    if (labels.Save(path) != ErrorCode::Success || loaded.Load(path, 64, 1000) != ErrorCode::Success) {
+        std::cerr << "  FAILED: save and load" << std::endl;
+        return false;
+    }
+    std::remove(path);
+    for (SizeType i = 0; i < 100; i++) {
+        if (loaded.Get(i) != labels.Get(i)) {
+            std::cerr << "  FAILED: loaded labels of " << i << std::endl;
+            return false;
+        }
+    }
+    if (std::abs(loaded.Selectivity(tenth, 100) - 0.09f) > 1e-6f) {
+        std::cerr << "  FAILED: counts after a load" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a filtered search returns only matching vectors and finds most of their true neighbors,
+// an inserted vector is found once it is labeled
+bool TestFilteredSearch() {
+    std::cout << "  Testing filtered search..." << std::endl;
+    const int dim = 16, base = 3000, queries = 50, k = 10;
+    const std::string dir = "test_filtered_search";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> data((size_t)base * dim), query((size_t)queries * dim);
+    for (auto& v : data) v = uniform(rng);
+    for (auto& v : query) v = uniform(rng);
+    {
+        std::ofstream out(dir + "/vectors.bin", std::ios::binary);
+        out.write((const char*)data.data(), data.size() * sizeof(float));
+    }
+
+    auto index = std::make_shared<SPANN::Index<float>>();
+    index->SetParameter("ValueType", "Float", "Base");
+    index->SetParameter("Dim", std::to_string(dim).c_str(), "Base");
+    index->SetParameter("VectorPath", (dir + "/vectors.bin").c_str(), "Base");
+    index->SetParameter("IndexDirectory", dir.c_str(), "Base");
+    index->SetParameter("DistCalcMethod", "L2", "Base");
+    index->SetParameter("isExecute", "true", "SelectHead");
+    index->SetParameter("SelectHeadType", "BKT", "SelectHead");
+    index->SetParameter("NumberOfThreads", "2", "SelectHead");
+    index->SetParameter("Ratio", "0.1", "SelectHead");
+    index->SetParameter("TreeNumber", "1", "SelectHead");
+    index->SetParameter("BKTKmeansK", "8", "SelectHead");
+    index->SetParameter("BKTLeafSize", "8", "SelectHead");
+    index->SetParameter("isExecute", "true", "BuildHead");
+    index->SetParameter("isExecute", "true", "BuildSSDIndex");
+    index->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    index->SetParameter("NumberOfThreads", "2", "BuildSSDIndex");
+    index->SetParameter("ExcludeHead", "true", "BuildSSDIndex");
+    index->SetParameter("UseDirectIO", "false", "BuildSSDIndex");
+    index->SetParameter("StorageBackend", "Uring", "BuildSSDIndex");
+    index->SetParameter("UringFilePath", (dir + "/postings.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SpdkMappingPath", (dir + "/mapping.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("PostingPageLimit", "4", "BuildSSDIndex");
+    index->SetParameter("SpdkCapacity", std::to_string(base * 4).c_str(), "BuildSSDIndex");
+    index->SetParameter("SearchInternalResultNum", "16", "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "2048", "BuildSSDIndex");
+    index->SetParameter("Update", "true", "BuildSSDIndex");
+    index->SetParameter("AppendThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("InsertThreadNum", "1", "BuildSSDIndex");
+    if (index->BuildIndex(false) != ErrorCode::Success) {
+        std::cerr << "  FAILED: BuildIndex" << std::endl;
+        return false;
+    }
+
+    // bit 0 on every tenth vector, bit 1 on every other
+    std::vector<std::uint64_t> labels(base);
+    for (int i = 0; i < base; i++) labels[i] = (i % 10 == 0 ? 1 : 0) | (i % 2 == 0 ? 2 : 0);
+    LabelFilter filter{1, 0};
+
+    auto l2 = COMMON::DistanceCalcSelector<float>(DistCalcMethod::L2);
+    bool ok = true;
+    std::thread worker([&] {
+        index->Initialize();
+        if (index->SetVectorLabels(0, base, labels.data()) != ErrorCode::Success || index->SetVectorLabels(base - 1, 2, labels.data()) != ErrorCode::VectorNotFound) {
+            std::cerr << "  FAILED: SetVectorLabels" << std::endl;
+            ok = false;
+        }
+        std::size_t hits = 0, unfilteredOthers = 0;
+        for (int q = 0; q < queries && ok; q++) {
+            const float* target = query.data() + (size_t)q * dim;
+            std::vector<std::pair<float, SizeType>> dists;
+            for (int i = 0; i < base; i += 10) dists.emplace_back(l2(target, data.data() + (size_t)i * dim, dim), i);
+            std::partial_sort(dists.begin(), dists.begin() + k, dists.end());
+            std::set<SizeType> truth;
+            for (int i = 0; i < k; i++) truth.insert(dists[i].second);
+
+            COMMON::QueryResultSet<float> filtered(target, k);
+            filtered.Reset();
+            index->SearchIndex(filtered, filter);
+            for (int i = 0; i < k; i++) {
+                SizeType vid = filtered.GetResult(i)->VID;
+                if (vid >= 0 && vid % 10 != 0) {
+                    std::cerr << "  FAILED: query " << q << " returned " << vid << " the filter drops" << std::endl;
+                    ok = false;
+                }
+                hits += truth.count(vid);
+            }
+
+            COMMON::QueryResultSet<float> unfiltered(target, k);
+            unfiltered.Reset();
+            index->SearchIndex(unfiltered);
+            for (int i = 0; i < k; i++) unfilteredOthers += unfiltered.GetResult(i)->VID % 10 != 0;
+        }
+        double recall = (double)hits / ((double)queries * k);
+        if (ok && (recall < 0.8 || unfilteredOthers == 0)) {
+            std::cerr << "  FAILED: filtered recall " << recall << ", " << unfilteredOthers << " unfiltered results off the filter" << std::endl;
+            ok = false;
+        }
+
+        // a copy of the first query goes in labeled, the filtered search returns it first
+        SizeType vid = -1;
+        if (ok && index->AddIndexSPFresh(query.data(), 1, dim, &vid) == ErrorCode::Success) {
+            while (!index->AllFinished()) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            std::uint64_t label = 1;
+            index->SetVectorLabels(vid, 1, &label);
+            COMMON::QueryResultSet<float> filtered(query.data(), k);
+            filtered.Reset();
+            index->SearchIndex(filtered, filter);
+            if (filtered.GetResult(0)->VID != vid || index->GetVectorLabels(vid) != 1) {
+                std::cerr << "  FAILED: inserted vector " << vid << " not found first, got " << filtered.GetResult(0)->VID << std::endl;
+                ok = false;
+            }
+        } else if (ok) {
+            std::cerr << "  FAILED: AddIndexSPFresh" << std::endl;
+            ok = false;
+        }
+        if (ok)
+            std::cout << "  filtered recall@" << k << " " << recall << std::endl;
+        index->ExitBlockController();
+    });
+    worker.join();
+    index.reset();
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Filtered Search Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestLabels();
+    testPassed = TestFilteredSearch() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
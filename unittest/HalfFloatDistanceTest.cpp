@@ -0,0 +1,148 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Utils/DistanceUtils.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+// Test 1: conversions round to nearest even and keep the special values
+bool TestConversion() {
+    std::cout << "  Testing conversions..." << std::endl;
+    struct Case {
+        float value;
+        std::uint16_t half;
+    };
+    // 1 + 2^-11 is a tie that rounds down to even, 1 + 3 * 2^-11 one that rounds up
+    std::vector<Case> halves = {{1.0f, 0x3c00}, {-2.0f, 0xc000}, {65504.0f, 0x7bff}, {1e6f, 0x7c00}, {5.960464e-8f, 0x0001}, {1.00048828125f, 0x3c00}, {1.00146484375f, 0x3c02}, {0.0f, 0x0000}};
+    for (auto& c : halves) {
+        Float16 half(c.value);
+        if (half.bits != c.half) {
+            std::cerr << "  FAILED: Float16(" << c.value << ") = " << std::hex << half.bits << std::dec << std::endl;
+            return false;
+        }
+        if (c.half != 0x7c00 && (float)half != c.value && std::fabs((float)half - c.value) > std::fabs(c.value) * 1e-3f) {
+            std::cerr << "  FAILED: Float16 " << c.value << " came back as " << (float)half << std::endl;
+            return false;
+        }
+    }
+    if (BFloat16(1.0f).bits != 0x3f80 || BFloat16(-3.5f).bits != 0xc060 || (float)BFloat16(3.140625f) != 3.140625f) {
+        std::cerr << "  FAILED: BFloat16 conversion" << std::endl;
+        return false;
+    }
+    if (!std::isnan((float)Float16(NAN)) || !std::isnan((float)BFloat16(NAN))) {
+        std::cerr << "  FAILED: NaN lost" << std::endl;
+        return false;
+    }
+    if (Utils::GetBase<Float16>() != 1 || Utils::GetBase<BFloat16>() != 1) {
+        std::cerr << "  FAILED: half floats are not normalised to 1" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+static bool Close(float p_expected, float p_actual) {
+    return std::fabs(p_expected - p_actual) <= 1e-4f * (std::fabs(p_expected) + 1.0f);
+}
+
+// the SIMD kernels, the selected one and the batch agree with the scalar kernel on the widened values
+template <typename T>
+bool CheckKernels(const char* p_name) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    for (DimensionType length : {1, 3, 8, 15, 16, 31, 33, 64, 100}) {
+        std::vector<T> x(length);
+        std::vector<std::vector<T>> ys(6, std::vector<T>(length));
+        for (auto& v : x) v = T(dist(rng));
+        for (auto& y : ys)
+            for (auto& v : y) v = T(dist(rng));
+
+        for (DistCalcMethod method : {DistCalcMethod::L2, DistCalcMethod::Cosine}) {
+            bool cosine = method == DistCalcMethod::Cosine;
+            std::vector<float> expected;
+            for (auto& y : ys)
+                expected.push_back(cosine ? DistanceUtils::ComputeCosineDistance(x.data(), y.data(), length) : DistanceUtils::ComputeL2Distance(x.data(), y.data(), length));
+
+            std::vector<DistanceCalcReturn<T>> kernels = {DistanceCalcSelector<T>(method)};
+            if (!cosine) {
+                kernels.push_back(&DistanceUtils::ComputeL2Distance_SSE);
+                if (InstructionSet::AVX2() && (std::is_same<T, BFloat16>::value || InstructionSet::F16C()))
+                    kernels.push_back(&DistanceUtils::ComputeL2Distance_AVX);
+                if (InstructionSet::AVX512())
+                    kernels.push_back(&DistanceUtils::ComputeL2Distance_AVX512);
+            } else {
+                kernels.push_back(&DistanceUtils::ComputeCosineDistance_SSE);
+                if (InstructionSet::AVX2() && (std::is_same<T, BFloat16>::value || InstructionSet::F16C()))
+                    kernels.push_back(&DistanceUtils::ComputeCosineDistance_AVX);
+                if (InstructionSet::AVX512())
+                    kernels.push_back(&DistanceUtils::ComputeCosineDistance_AVX512);
+            }
+            for (auto kernel : kernels) {
+                for (size_t i = 0; i < ys.size(); i++) {
+                    if (!Close(expected[i], kernel(x.data(), ys[i].data(), length))) {
+                        std::cerr << "  FAILED: " << p_name << " kernel off at length " << length << std::endl;
+                        return false;
+                    }
+                }
+            }
+
+            std::vector<const void*> pointers;
+            for (auto& y : ys) pointers.push_back(y.data());
+            std::vector<float> batch(ys.size());
+            DistanceBatchSelector<T>(method)(x.data(), pointers.data(), (int)pointers.size(), length, batch.data());
+            for (size_t i = 0; i < ys.size(); i++) {
+                if (!Close(expected[i], batch[i])) {
+                    std::cerr << "  FAILED: " << p_name << " batch off at length " << length << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    return true;
+}
+
+// Test 2: every kernel available on this CPU matches the scalar one
+bool TestKernels() {
+    std::cout << "  Testing distance kernels..." << std::endl;
+    if (!CheckKernels<Float16>("Float16") || !CheckKernels<BFloat16>("BFloat16"))
+        return false;
+    if (InstructionSet::AVX512BF16()) {
+        std::vector<BFloat16> x(70), y(70);
+        for (int i = 0; i < 70; i++) {
+            x[i] = BFloat16(0.01f * i);
+            y[i] = BFloat16(1.0f - 0.01f * i);
+        }
+        if (!Close(DistanceUtils::ComputeCosineDistance(x.data(), y.data(), 70), DistanceUtils::ComputeCosineDistance_AVX512BF16(x.data(), y.data(), 70))) {
+            std::cerr << "  FAILED: AVX512-BF16 dot product" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Half Float Distance Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestConversion();
+    testPassed = TestKernels() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,146 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/IOClass.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: with nothing else going on a class fills its depth, once foreground I/O is in flight
+// background only keeps its budget, and foreground is always let through first
+bool TestDispatch() {
+    std::cout << "  Testing priority dispatch..." << std::endl;
+    const int depth[kIOClasses] = {0, 0, 8};
+    const int budget[kIOClasses] = {0, 4, 2};
+    IOClassQueues<int> queues;
+    queues.Configure(depth, budget);
+    std::vector<int> device;
+    auto submit = [&](int p_item) {
+        device.push_back(p_item);
+        return true;
+    };
+    for (int i = 0; i < 20; i++) queues.Push(200 + i, (int)IOClass::Background);
+    if (queues.Dispatch(submit) != 8 || queues.Inflight((int)IOClass::Background) != 8) {
+        std::cerr << "  FAILED: background alone not held to its depth" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 5; i++) queues.Push(i, (int)IOClass::Foreground);
+    for (int i = 0; i < 6; i++) queues.Push(100 + i, (int)IOClass::Update);
+    for (int i = 0; i < 8; i++) queues.Complete((int)IOClass::Background);
+    device.clear();
+    queues.Dispatch(submit);
+    std::vector<int> expected = {0, 1, 2, 3, 4, 100, 101, 102, 103, 208, 209};
+    if (device != expected) {
+        std::cerr << "  FAILED: dispatch order under foreground load" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 5; i++) queues.Complete((int)IOClass::Foreground);
+    for (int i = 0; i < 4; i++) queues.Complete((int)IOClass::Update);
+    for (int i = 0; i < 2; i++) queues.Complete((int)IOClass::Background);
+    device.clear();
+    queues.Dispatch(submit);
+    // update is alone at the top now, background stays on its budget behind it
+    expected = {104, 105, 210, 211};
+    if (device != expected) {
+        std::cerr << "  FAILED: dispatch order behind updates" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 2; i++) queues.Complete((int)IOClass::Update);
+    for (int i = 0; i < 2; i++) queues.Complete((int)IOClass::Background);
+    device.clear();
+    queues.Dispatch(submit);
+    if (device.size() != 8 || device.front() != 212 || queues.Pending((int)IOClass::Background) != 0) {
+        std::cerr << "  FAILED: background not back to its depth when alone" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: an item the device refuses stays first in its queue and is submitted next time
+bool TestRefused() {
+    std::cout << "  Testing refused submissions..." << std::endl;
+    const int limits[kIOClasses] = {0, 0, 0};
+    IOClassQueues<int> queues;
+    queues.Configure(limits, limits);
+    for (int i = 0; i < 3; i++) queues.Push(i, (int)IOClass::Foreground);
+    int accepted = 1;
+    std::vector<int> device;
+    auto submit = [&](int p_item) {
+        if (accepted == 0)
+            return false;
+        accepted--;
+        device.push_back(p_item);
+        return true;
+    };
+    if (queues.Dispatch(submit) != 1 || queues.Pending((int)IOClass::Foreground) != 2) {
+        std::cerr << "  FAILED: refused item dropped" << std::endl;
+        return false;
+    }
+    accepted = 10;
+    queues.Dispatch(submit);
+    for (int i = 0; i < 3; i++) queues.Complete((int)IOClass::Foreground);
+    if (device != std::vector<int>({0, 1, 2}) || !queues.Idle()) {
+        std::cerr << "  FAILED: order after refusal" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: scopes only lower the class of the thread, and latency percentiles come out of the buckets
+bool TestScopeAndStats() {
+    std::cout << "  Testing class scopes and counters..." << std::endl;
+    {
+        IOClassScope update(IOClass::Update);
+        if (CurrentIOClass() != IOClass::Update)
+            return false;
+        {
+            IOClassScope background(IOClass::Background);
+            IOClassScope foreground(IOClass::Foreground);
+            if (CurrentIOClass() != IOClass::Background) {
+                std::cerr << "  FAILED: scope raised the class" << std::endl;
+                return false;
+            }
+        }
+        if (CurrentIOClass() != IOClass::Update) {
+            std::cerr << "  FAILED: scope not restored" << std::endl;
+            return false;
+        }
+    }
+    IOClassStats stats;
+    IOClassStats::Snapshot start = stats.Take();
+    for (int i = 0; i < 990; i++) stats.Record(1, 50);
+    for (int i = 0; i < 10; i++) stats.Record(2, 3000);
+    IOClassStats::Snapshot diff = stats.Take() - start;
+    if (CurrentIOClass() != IOClass::Foreground || diff.commands != 1000 || diff.pages != 1010 || diff.PercentileUs(0.5) != 64 || diff.PercentileUs(0.995) != 4096) {
+        std::cerr << "  FAILED: counters " << diff.commands << " " << diff.PercentileUs(0.5) << " " << diff.PercentileUs(0.995) << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "I/O Class Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestDispatch();
+    testPassed = TestRefused() && testPassed;
+    testPassed = TestScopeAndStats() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,144 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/ExtraSPDKController.h"
+#include "Core/SPANN/ExtraUringController.h"
+#include "Core/SPANN/IOTrace.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <map>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: records come back oldest first, and once the ring wrapped only the newest remain
+bool TestRing() {
+    std::cout << "  Testing trace ring..." << std::endl;
+    const char* path = "test_io_trace_ring.bin";
+    {
+        IOTraceWriter writer;
+        if (!writer.Open(path, 100 * sizeof(IOTraceRecord))) {
+            std::cerr << "  FAILED: cannot open " << path << std::endl;
+            return false;
+        }
+        std::vector<std::thread> threads;
+        for (int t = 0; t < 4; t++) {
+            threads.emplace_back([&writer, t] {
+                for (int i = 0; i < 50; i++) {
+                    std::uint64_t command = writer.NextCommand();
+                    writer.Record(IOTraceEvent::Submit, command, IOTraceOp::Read, t % kIOClasses, 0, (std::uint64_t)i * PageSize, PageSize, t);
+                }
+            });
+        }
+        for (auto& thread : threads) thread.join();
+        writer.Record(IOTraceEvent::Complete, 7, IOTraceOp::Write, 1, 2, 3 * PageSize, 2 * PageSize, 42, 123);
+    }
+    std::vector<IOTraceRecord> records;
+    bool ok = ReadIOTrace(path, records);
+    std::remove(path);
+    if (!ok || records.size() != 100) {
+        std::cerr << "  FAILED: read back " << records.size() << " records of a 100 record ring" << std::endl;
+        return false;
+    }
+    for (std::size_t i = 0; i < records.size(); i++) {
+        if (records[i].seq != 102 + i) {
+            std::cerr << "  FAILED: record " << i << " has seq " << records[i].seq << std::endl;
+            return false;
+        }
+    }
+    const IOTraceRecord& last = records.back();
+    if (last.event != (std::uint8_t)IOTraceEvent::Complete || last.command != 7 || last.op != (std::uint8_t)IOTraceOp::Write || last.device != 2 || last.posting != 42 ||
+        last.offset != 3 * PageSize || last.length != 2 * PageSize || last.latencyUs != 123) {
+        std::cerr << "  FAILED: last record fields" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a traced io_uring store pairs every submit with a complete and names the posting
+bool TestDeviceCapture() {
+    std::cout << "  Testing capture on io_uring..." << std::endl;
+    const char* mappingPath = "test_io_trace_mapping";
+    const char* devicePath = "test_io_trace_blocks.bin";
+    const char* tracePath = "test_io_trace.bin";
+    std::remove(mappingPath);
+    std::remove(devicePath);
+    setenv(kIOTraceEnv, tracePath, 1);
+    setenv(kIOTraceMBEnv, "1", 1);
+    {
+        auto device = std::make_shared<UringBlockController>(devicePath, 64, 8, false);
+        SPDKIO db(mappingPath, 4096, 10000, 256, 1024, 64, 1, 1 << 16, false, device);
+        std::string small(100, 's'), big(3 * PageSize + 10, 'b'), value;
+        db.Put(100, small);
+        db.Put(200, big);
+        db.Get(200, &value);
+        std::vector<SizeType> keys = {100, 200};
+        std::vector<PostingView> views;
+        db.MultiGet(keys, &views);
+        db.ReleasePostingViews(&views);
+        db.ShutDown();
+    }
+    unsetenv(kIOTraceEnv);
+    unsetenv(kIOTraceMBEnv);
+    std::vector<IOTraceRecord> records;
+    bool ok = ReadIOTrace(tracePath, records);
+    std::remove(tracePath);
+    std::remove(mappingPath);
+    std::remove(devicePath);
+    if (!ok || records.empty()) {
+        std::cerr << "  FAILED: no trace recorded" << std::endl;
+        return false;
+    }
+
+    std::map<std::uint64_t, const IOTraceRecord*> submits;
+    std::set<std::int32_t> readPostings;
+    int writes = 0, completes = 0;
+    for (auto& record : records) {
+        if (record.event == (std::uint8_t)IOTraceEvent::Submit) {
+            submits[record.command] = &record;
+            if (record.op == (std::uint8_t)IOTraceOp::Read)
+                readPostings.insert(record.posting);
+            else
+                writes++;
+            continue;
+        }
+        completes++;
+        auto it = submits.find(record.command);
+        if (it == submits.end() || it->second->offset != record.offset || it->second->length != record.length || it->second->op != record.op) {
+            std::cerr << "  FAILED: complete of command " << record.command << " does not match its submit" << std::endl;
+            return false;
+        }
+    }
+    if (completes != (int)submits.size() || writes < 2 || readPostings != std::set<std::int32_t>({100, 200})) {
+        std::cerr << "  FAILED: " << submits.size() << " submits, " << completes << " completes, " << writes << " writes, " << readPostings.size() << " read postings" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "I/O Trace Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestRing();
+    testPassed = TestDeviceCapture() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,116 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/MetadataSet.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace SPTAG;
+
+static const std::string c_metaFile = "mapped_metadata_test.bin";
+static const std::string c_indexFile = "mapped_metadata_test.idx";
+
+static void WriteMetadata(const std::vector<std::string>& p_records) {
+    std::ofstream meta(c_metaFile, std::ios::binary), index(c_indexFile, std::ios::binary);
+    SizeType count = (SizeType)p_records.size();
+    index.write((const char*)&count, sizeof(count));
+    std::uint64_t offset = 0;
+    index.write((const char*)&offset, sizeof(offset));
+    for (auto& record : p_records) {
+        meta.write(record.data(), record.size());
+        offset += record.size();
+        index.write((const char*)&offset, sizeof(offset));
+    }
+}
+
+static std::string AsString(const ByteArray& p_meta) {
+    return std::string((const char*)p_meta.Data(), p_meta.Length());
+}
+
+// Test 1: loaded records come back as views of the mapping, copies own their bytes
+bool TestViews() {
+    std::cout << "  Testing mapped views..." << std::endl;
+    WriteMetadata({"doc-0", "", "doc-2|payload"});
+    MappedMetadataSet metadata(c_metaFile, c_indexFile);
+    if (metadata.Count() != 3 || !metadata.Available()) {
+        std::cerr << "  FAILED: count " << metadata.Count() << std::endl;
+        return false;
+    }
+    ByteArray first = metadata.GetMetadataView(2), second = metadata.GetMetadataView(2);
+    if (AsString(first) != "doc-2|payload" || first.Data() != second.Data() || metadata.GetMetadataView(1).Length() != 0) {
+        std::cerr << "  FAILED: views do not point into the mapping" << std::endl;
+        return false;
+    }
+    ByteArray copy = metadata.GetMetadataCopy(0);
+    if (AsString(copy) != "doc-0" || copy.Data() == metadata.GetMetadataView(0).Data()) {
+        std::cerr << "  FAILED: copy shares the mapping" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a batch of results gets its metadata in one call, added records included
+bool TestBatch() {
+    std::cout << "  Testing batched lookup..." << std::endl;
+    WriteMetadata({"a", "bb", "ccc"});
+    MappedMetadataSet metadata(c_metaFile, c_indexFile);
+    metadata.Add(ByteArray((std::uint8_t*)"added", 5, false));
+    std::vector<BasicResult> results = {BasicResult(3, 0.1f), BasicResult(-1, MaxDist), BasicResult(1, 0.5f)};
+    metadata.GetMetadataViews(results.data(), (int)results.size());
+    if (AsString(results[0].Meta) != "added" || results[1].Meta.Length() != 0 || AsString(results[2].Meta) != "bb") {
+        std::cerr << "  FAILED: batched lookup returned wrong records" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: saving over the mapped files keeps the views valid and writes all records
+bool TestSave() {
+    std::cout << "  Testing save over the mapping..." << std::endl;
+    WriteMetadata({"x", "yy"});
+    {
+        MappedMetadataSet metadata(c_metaFile, c_indexFile);
+        metadata.Add(ByteArray((std::uint8_t*)"zzz", 3, false));
+        ByteArray view = metadata.GetMetadataView(1);
+        if (metadata.SaveMetadata(c_metaFile, c_indexFile) != ErrorCode::Success || AsString(view) != "yy") {
+            std::cerr << "  FAILED: save broke the mapping" << std::endl;
+            return false;
+        }
+    }
+    MappedMetadataSet reloaded(c_metaFile, c_indexFile);
+    if (reloaded.Count() != 3 || AsString(reloaded.GetMetadataView(0)) != "x" || AsString(reloaded.GetMetadataView(2)) != "zzz") {
+        std::cerr << "  FAILED: saved files lost records" << std::endl;
+        return false;
+    }
+    std::remove(c_metaFile.c_str());
+    std::remove(c_indexFile.c_str());
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Mapped Metadata Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestViews();
+    testPassed = TestBatch() && testPassed;
+    testPassed = TestSave() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
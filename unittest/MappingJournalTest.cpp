@@ -0,0 +1,186 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/MappingJournal.h"
+#include "Core/SPANN/ExtraSPDKController.h"
+#include "Core/SPANN/ExtraUringController.h"
+
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <map>
+#include <set>
+#include <unistd.h>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+typedef MappingJournal::AddressType AddressType;
+
+static std::map<SizeType, std::vector<AddressType>> ReplayAll(const std::vector<std::string>& p_paths) {
+    std::map<SizeType, std::vector<AddressType>> mapping;
+    for (auto& path : p_paths) {
+        MappingJournal::Replay(path, [&](SizeType key, const AddressType* entries, int count) {
+            if (count < 0)
+                mapping.erase(key);
+            else
+                mapping[key].assign(entries, entries + count);
+        });
+    }
+    return mapping;
+}
+
+// Test 1: the last entry of a key wins, deletes drop it, rotation keeps both halves replayable
+bool TestAppendRotateReplay() {
+    std::cout << "  Testing append, rotate and replay..." << std::endl;
+    std::string path = "mapping_journal_test.journal", oldPath = path + ".old";
+    std::remove(path.c_str());
+    std::remove(oldPath.c_str());
+
+    MappingJournal journal;
+    if (!journal.Open(path, 64)) {
+        std::cerr << "  FAILED: cannot open journal" << std::endl;
+        return false;
+    }
+    AddressType first[] = {4096, 10};
+    AddressType second[] = {8000, 10, 11};
+    AddressType other[] = {100, 42};
+    journal.Append(1, first, 2);
+    journal.Append(2, other, 2);
+    journal.Append(1, second, 3);
+    if (!journal.Rotate(oldPath) || journal.Size() != 0) {
+        std::cerr << "  FAILED: rotation" << std::endl;
+        return false;
+    }
+    journal.Append(2, nullptr, -1);
+    journal.Append(3, first, 2);
+    journal.Close();
+
+    auto mapping = ReplayAll({oldPath, path});
+    bool ok = mapping.size() == 2 && mapping.count(2) == 0 && mapping[1] == std::vector<AddressType>(second, second + 3) && mapping[3] == std::vector<AddressType>(first, first + 2);
+    std::remove(path.c_str());
+    std::remove(oldPath.c_str());
+    if (!ok) {
+        std::cerr << "  FAILED: replayed mapping mismatch" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a torn entry at the end of the journal is ignored
+bool TestTornTail() {
+    std::cout << "  Testing torn tail..." << std::endl;
+    std::string path = "mapping_journal_torn.journal";
+    std::remove(path.c_str());
+    {
+        MappingJournal journal;
+        journal.Open(path);
+        AddressType entry[] = {8192, 1, 2};
+        journal.Append(7, entry, 3);
+        journal.Append(8, entry, 3);
+    }
+    FILE* fp = fopen(path.c_str(), "rb");
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    if (truncate(path.c_str(), size - 4) != 0) {
+        std::cerr << "  FAILED: cannot truncate journal" << std::endl;
+        return false;
+    }
+    auto mapping = ReplayAll({path});
+    std::remove(path.c_str());
+    if (mapping.size() != 1 || mapping.count(7) != 1) {
+        std::cerr << "  FAILED: torn entry was replayed" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// the versions of a posting all differ in size, so freed blocks go to other postings
+static std::string MakeValue(SizeType p_key, int p_version) {
+    std::string value((size_t)(1 + (p_key + p_version) % 3) * PageSize - 100, 0);
+    for (size_t i = 0; i < value.size(); i++) value[i] = (char)(p_key * 31 + p_version * 7 + i);
+    return value;
+}
+
+// Test 3: a crash loses the journal entries that were not synced. The blocks the replayed mapping
+// names were not reused meanwhile, so every recovered posting reads back one of its versions
+bool TestCrashKeepsRetiredBlocks() {
+    std::cout << "  Testing retired blocks across a crash..." << std::endl;
+    const std::string dataPath = "mapping_journal_crash.bin", mappingPath = "mapping_journal_crash_mapping";
+    const std::string crashData = dataPath + ".crash", crashMapping = mappingPath + ".crash";
+    const std::string journalSuffix = ".journal";
+    const SizeType keys = 8;
+    const int versions = 3;
+    for (auto& path : {dataPath, mappingPath, mappingPath + journalSuffix, crashData, crashMapping, crashMapping + journalSuffix}) std::filesystem::remove(path);
+
+    bool ok = true;
+    {
+        auto device = std::make_shared<UringBlockController>(dataPath);
+        SPDKIO store(mappingPath.c_str(), 1024, 1024, 4, 1024, 64, 1, 40, false, device);
+        ok = store.SetMappingJournal(true, (size_t)1 << 30) == ErrorCode::Success;
+        for (SizeType key = 0; key < keys && ok; key++) ok = store.Put(key, MakeValue(key, 0)) == ErrorCode::Success;
+        store.ForceCompaction();
+        // the rewrites free blocks that later ones take again, their entries stay buffered
+        for (int version = 1; version < versions && ok; version++) {
+            for (SizeType key = 0; key < keys && ok; key++) ok = store.Put(key, MakeValue(key, version)) == ErrorCode::Success;
+        }
+        // the crash: what reached the journal file and the device survives, the buffer does not
+        std::filesystem::copy_file(dataPath, crashData);
+        if (std::filesystem::exists(mappingPath))
+            std::filesystem::copy_file(mappingPath, crashMapping);
+        std::filesystem::copy_file(mappingPath + journalSuffix, crashMapping + journalSuffix);
+    }
+    if (!ok) {
+        std::cerr << "  FAILED: writes before the crash" << std::endl;
+        return false;
+    }
+
+    {
+        auto device = std::make_shared<UringBlockController>(crashData);
+        SPDKIO recovered(crashMapping.c_str(), 1024, 1024, 4, 1024, 64, 1, 40, false, device);
+        recovered.SetMappingJournal(true, (size_t)1 << 30);
+        std::string value;
+        for (SizeType key = 0; key < keys && ok; key++) {
+            if (recovered.Get(key, &value) != ErrorCode::Success) {
+                std::cerr << "  FAILED: key " << key << " lost" << std::endl;
+                ok = false;
+                break;
+            }
+            bool known = false;
+            for (int version = 0; version < versions; version++) known = known || value == MakeValue(key, version);
+            if (!known) {
+                std::cerr << "  FAILED: key " << key << " maps blocks that were handed out again" << std::endl;
+                ok = false;
+            }
+        }
+    }
+    for (auto& path : {dataPath, mappingPath, mappingPath + journalSuffix, crashData, crashMapping, crashMapping + journalSuffix}) std::filesystem::remove(path);
+    if (!ok)
+        return false;
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Mapping Journal Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestAppendRotateReplay();
+    testPassed = TestTornTail() && testPassed;
+    testPassed = TestCrashKeepsRetiredBlocks() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
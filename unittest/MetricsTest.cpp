@@ -0,0 +1,121 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Helper/Metrics.h"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace SPTAG;
+
+static std::string Fetch(int p_port, const std::string& p_path) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons((uint16_t)p_port);
+    inet_pton(AF_INET, "127.0.0.1", &addr.sin_addr);
+    std::string response;
+    if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+        std::string request = "GET " + p_path + " HTTP/1.1\r\nHost: localhost\r\n\r\n";
+        send(fd, request.data(), request.size(), 0);
+        char buffer[4096];
+        ssize_t got;
+        while ((got = recv(fd, buffer, sizeof(buffer), 0)) > 0) response.append(buffer, (size_t)got);
+    }
+    close(fd);
+    return response;
+}
+
+static bool Contains(const std::string& p_text, const std::string& p_line) {
+    return p_text.find(p_line) != std::string::npos;
+}
+
+// Test 1: HELP and TYPE come once per metric, labels are escaped and a histogram ends in its
+// +Inf bucket, sum and count
+bool TestWriter() {
+    std::cout << "  Testing exposition format..." << std::endl;
+    Helper::MetricsWriter writer;
+    writer.Counter("test_total", "A counter", 3);
+    writer.Gauge("test_depth", "A gauge", 1, Helper::MetricsWriter::Label("job", "split"));
+    writer.Gauge("test_depth", "A gauge", 2, Helper::MetricsWriter::Label("job", "re\"assign"));
+    writer.Histogram("test_seconds", "A histogram", {0.001, 0.01}, {4, 6}, 0.05, 7, Helper::MetricsWriter::Label("stage", "IOWait"));
+    const std::string& text = writer.Text();
+    std::vector<std::string> lines = {
+        "# HELP test_total A counter\n# TYPE test_total counter\ntest_total 3\n",
+        "# TYPE test_depth gauge\ntest_depth{job=\"split\"} 1\ntest_depth{job=\"re\\\"assign\"} 2\n",
+        "test_seconds_bucket{stage=\"IOWait\",le=\"0.001\"} 4\n",
+        "test_seconds_bucket{stage=\"IOWait\",le=\"0.01\"} 6\n",
+        "test_seconds_bucket{stage=\"IOWait\",le=\"+Inf\"} 7\ntest_seconds_sum{stage=\"IOWait\"} 0.050000000000000003\ntest_seconds_count{stage=\"IOWait\"} 7\n",
+    };
+    for (auto& line : lines) {
+        if (!Contains(text, line)) {
+            std::cerr << "  FAILED: missing\n" << line << "in\n" << text << std::endl;
+            return false;
+        }
+    }
+    if (text.find("# TYPE test_depth") != text.rfind("# TYPE test_depth")) {
+        std::cerr << "  FAILED: metric declared twice" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: every scrape renders anew, other paths get a 404 and Stop ends the server
+bool TestServer() {
+    std::cout << "  Testing metrics endpoint..." << std::endl;
+    std::atomic<int> scrapes(0);
+    Helper::MetricsServer server;
+    if (!server.Start("127.0.0.1", 0, [&] {
+            Helper::MetricsWriter writer;
+            writer.Counter("test_scrapes_total", "Scrapes served", ++scrapes);
+            return writer.Text();
+        }) || server.Port() <= 0) {
+        std::cerr << "  FAILED: start" << std::endl;
+        return false;
+    }
+    std::string first = Fetch(server.Port(), "/metrics"), second = Fetch(server.Port(), "/metrics");
+    if (first.compare(0, 15, "HTTP/1.1 200 OK") != 0 || !Contains(first, "text/plain; version=0.0.4") || !Contains(first, "\r\n\r\n# HELP test_scrapes_total") || !Contains(second, "test_scrapes_total 2\n")) {
+        std::cerr << "  FAILED: response\n" << first << second << std::endl;
+        return false;
+    }
+    if (Fetch(server.Port(), "/other").compare(0, 12, "HTTP/1.1 404") != 0 || scrapes != 2) {
+        std::cerr << "  FAILED: unknown path served" << std::endl;
+        return false;
+    }
+    int port = server.Port();
+    server.Stop();
+    if (!Fetch(port, "/metrics").empty()) {
+        std::cerr << "  FAILED: still serving after Stop" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Metrics Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestWriter();
+    testPassed = TestServer() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,121 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/MiniBatchKmeans.h"
+
+#include <iostream>
+#include <random>
+#include <set>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+// p_blobs tight blobs of p_perBlob vectors each, blob b is centered at b * 100 on every dimension
+static std::vector<float> MakeBlobs(int p_blobs, SizeType p_perBlob, DimensionType p_dim) {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> noise(-1.0f, 1.0f);
+    std::vector<float> data((size_t)p_blobs * p_perBlob * p_dim);
+    for (size_t i = 0; i < (size_t)p_blobs * p_perBlob; i++) {
+        for (DimensionType d = 0; d < p_dim; d++) data[i * p_dim + d] = (float)(i / p_perBlob) * 100.0f + noise(rng);
+    }
+    return data;
+}
+
+// Test 1: as many heads as blobs puts one head in every blob
+bool TestBlobs() {
+    std::cout << "  Testing one head per blob..." << std::endl;
+    const int blobs = 8;
+    const SizeType perBlob = 500;
+    const DimensionType dim = 16;
+    auto raw = MakeBlobs(blobs, perBlob, dim);
+    Dataset<float> data(blobs * perBlob, dim, blobs * perBlob, blobs * perBlob + 1, raw.data(), false);
+
+    MiniBatchKmeans<float> kmeans;
+    kmeans.m_branch = 4;
+    kmeans.m_batchSize = 256;
+    kmeans.m_iterations = 20;
+    std::vector<SizeType> selected;
+    kmeans.SelectHeads(data, DistCalcMethod::L2, blobs, selected);
+    std::set<SizeType> hit;
+    for (SizeType vid : selected) hit.insert(vid / perBlob);
+    if (selected.size() != blobs || hit.size() != blobs) {
+        std::cerr << "  FAILED: " << selected.size() << " heads cover " << hit.size() << " blobs" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: the heads do not depend on the thread count, with and without a refined sample
+bool TestDeterministic() {
+    std::cout << "  Testing thread count independence..." << std::endl;
+    const SizeType count = 20000;
+    const DimensionType dim = 24;
+    std::mt19937 rng(3);
+    std::normal_distribution<float> value(0.0f, 10.0f);
+    std::vector<float> raw((size_t)count * dim);
+    for (auto& v : raw) v = value(rng);
+    Dataset<float> data(count, dim, count, count + 1, raw.data(), false);
+
+    for (SizeType samples : {(SizeType)0, (SizeType)5000}) {
+        std::vector<SizeType> selected[2];
+        for (int run = 0; run < 2; run++) {
+            MiniBatchKmeans<float> kmeans;
+            kmeans.m_branch = 8;
+            kmeans.m_batchSize = 512;
+            kmeans.m_iterations = 10;
+            kmeans.m_samples = samples;
+            kmeans.m_threads = run == 0 ? 1 : 4;
+            kmeans.SelectHeads(data, DistCalcMethod::L2, 1000, selected[run]);
+        }
+        if (selected[0] != selected[1]) {
+            std::cerr << "  FAILED: samples " << samples << " gives " << selected[0].size() << " and " << selected[1].size() << " heads" << std::endl;
+            return false;
+        }
+        // empty clusters may drop a few heads, never add any
+        if (selected[0].size() > 1000 || selected[0].size() < 900) {
+            std::cerr << "  FAILED: samples " << samples << " selected " << selected[0].size() << " heads of 1000" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: a head count above the vector count makes every vector a head
+bool TestAllHeads() {
+    std::cout << "  Testing budget above the vector count..." << std::endl;
+    auto raw = MakeBlobs(3, 10, 4);
+    Dataset<float> data(30, 4, 30, 31, raw.data(), false);
+    MiniBatchKmeans<float> kmeans;
+    std::vector<SizeType> selected;
+    kmeans.SelectHeads(data, DistCalcMethod::L2, 50, selected);
+    if (selected.size() != 30 || selected.front() != 0 || selected.back() != 29) {
+        std::cerr << "  FAILED: selected " << selected.size() << " of 30 vectors" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Mini-Batch Kmeans Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestBlobs();
+    testPassed = TestDeterministic() && testPassed;
+    testPassed = TestAllHeads() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
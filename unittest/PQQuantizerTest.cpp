@@ -0,0 +1,108 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/PQQuantizer.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+// clustered vectors, so that 256 centroids per subspace fit them well
+static std::vector<float> MakeData(SizeType p_count, DimensionType p_dim) {
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    std::uniform_real_distribution<float> center(-1.0f, 1.0f);
+    std::vector<float> centers(16 * p_dim);
+    for (auto& c : centers) c = center(rng);
+    std::vector<float> data((size_t)p_count * p_dim);
+    for (SizeType i = 0; i < p_count; i++)
+        for (DimensionType d = 0; d < p_dim; d++) data[(size_t)i * p_dim + d] = centers[(i % 16) * p_dim + d] + noise(rng);
+    return data;
+}
+
+// Test 1: codes reconstruct the vectors closely
+bool TestEncodeDecode() {
+    std::cout << "  Testing encode/decode..." << std::endl;
+    const DimensionType dim = 32;
+    const SizeType count = 2000;
+    auto data = MakeData(count, dim);
+    PQQuantizer quantizer(dim, PQQuantizer::DefaultSubvectors(dim), DistCalcMethod::L2, 1);
+    if (quantizer.CodeSize() != 8) {
+        std::cerr << "  FAILED: expected 8 subvectors, got " << quantizer.CodeSize() << std::endl;
+        return false;
+    }
+    quantizer.Train(data.data(), count, 10, 2);
+
+    double error = 0, norm = 0;
+    std::vector<std::uint8_t> code(quantizer.CodeSize());
+    std::vector<float> decoded(dim);
+    for (SizeType i = 0; i < count; i++) {
+        const float* vector = data.data() + (size_t)i * dim;
+        quantizer.Encode(vector, code.data());
+        quantizer.Decode(code.data(), decoded.data());
+        for (DimensionType d = 0; d < dim; d++) {
+            error += (vector[d] - decoded[d]) * (vector[d] - decoded[d]);
+            norm += vector[d] * vector[d];
+        }
+    }
+    if (error > 0.05 * norm) {
+        std::cerr << "  FAILED: relative reconstruction error " << error / norm << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: the table lookup matches the distance to the decoded vector, for both metrics
+bool TestQueryDistance() {
+    std::cout << "  Testing ADC distances..." << std::endl;
+    const DimensionType dim = 24;
+    const SizeType count = 1000;
+    auto data = MakeData(count, dim);
+    for (auto method : {DistCalcMethod::L2, DistCalcMethod::Cosine}) {
+        PQQuantizer quantizer(dim, 6, method, 1);
+        quantizer.Train(data.data(), count, 5, 2);
+        std::vector<float> table(quantizer.TableSize());
+        const float* query = data.data();
+        quantizer.BuildTable(query, table.data());
+
+        std::vector<std::uint8_t> code(quantizer.CodeSize());
+        std::vector<float> decoded(dim);
+        for (SizeType i = 1; i < 50; i++) {
+            quantizer.Encode(data.data() + (size_t)i * dim, code.data());
+            quantizer.Decode(code.data(), decoded.data());
+            float expected = (method == DistCalcMethod::L2) ? DistanceUtils::ComputeL2Distance(query, decoded.data(), dim) : DistanceUtils::ComputeCosineDistance(query, decoded.data(), dim);
+            float adc = quantizer.QueryDistance(table.data(), code.data());
+            if (std::fabs(adc - expected) > 1e-3f * (1.0f + std::fabs(expected))) {
+                std::cerr << "  FAILED: ADC distance " << adc << " vs " << expected << std::endl;
+                return false;
+            }
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "PQ Quantizer Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestEncodeDecode();
+    testPassed = TestQueryDistance() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
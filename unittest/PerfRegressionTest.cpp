@@ -0,0 +1,419 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+// Small deterministic build, search, insert and distance kernel scenarios on synthetic data,
+// compared against the stored baseline PerfBaseline.json. A metric worse than its baseline by
+// more than its tolerance fails the test when its action is "fail" and only warns when it is
+// "warn"; SPTAG_PERF_STRICT=1 or --strict makes every regression fail. --update rewrites the
+// baseline from this run, on the machine the numbers are meant for. Registered with the perf
+// label: ctest -L perf
+//
+// The index runs on the io_uring backend in a scratch directory, so no SPDK setup is needed.
+
+#include "Core/Common/QueryResultSet.h"
+#include "Core/SPANN/Index.h"
+#include "Utils/DistanceUtils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <random>
+#include <set>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+
+struct Metric {
+    double value = 0;
+    bool higherIsBetter = true;
+    double tolerance = -1;  // < 0 takes the file's default
+    bool fail = false;      // else a regression only warns
+};
+
+// the baseline file: {"tolerance": T, "metrics": {"name": {"value": V, "better": "higher"|"lower",
+// "tolerance": T, "action": "fail"|"warn"}, ...}}, read with just enough JSON for that shape
+class Baseline {
+   public:
+    double m_tolerance = 0.3;
+    std::map<std::string, Metric> m_metrics;
+
+    bool Load(const std::string& p_path) {
+        std::ifstream in(p_path);
+        if (!in.is_open())
+            return false;
+        std::stringstream buffer;
+        buffer << in.rdbuf();
+        m_text = buffer.str();
+        m_pos = 0;
+        m_metrics.clear();
+        if (!Expect('{'))
+            return false;
+        while (Peek() == '"') {
+            std::string key = String();
+            if (!Expect(':'))
+                return false;
+            if (key == "tolerance") {
+                m_tolerance = Number();
+            } else if (key == "metrics") {
+                if (!Expect('{'))
+                    return false;
+                while (Peek() == '"') {
+                    std::string name = String();
+                    if (!Expect(':') || !ReadMetric(m_metrics[name]))
+                        return false;
+                    if (Peek() == ',')
+                        m_pos++;
+                }
+                if (!Expect('}'))
+                    return false;
+            } else {
+                return false;
+            }
+            if (Peek() == ',')
+                m_pos++;
+        }
+        return Expect('}');
+    }
+
+    bool Save(const std::string& p_path) const {
+        std::ofstream out(p_path);
+        if (!out.is_open())
+            return false;
+        out << "{\n  \"tolerance\": " << m_tolerance << ",\n  \"metrics\": {\n";
+        std::size_t i = 0;
+        for (auto& entry : m_metrics) {
+            const Metric& metric = entry.second;
+            out << "    \"" << entry.first << "\": {\"value\": " << metric.value << ", \"better\": \"" << (metric.higherIsBetter ? "higher" : "lower") << "\"";
+            if (metric.tolerance >= 0)
+                out << ", \"tolerance\": " << metric.tolerance;
+            out << ", \"action\": \"" << (metric.fail ? "fail" : "warn") << "\"}" << (++i < m_metrics.size() ? "," : "") << "\n";
+        }
+        out << "  }\n}\n";
+        return out.good();
+    }
+
+   private:
+    bool ReadMetric(Metric& p_metric) {
+        if (!Expect('{'))
+            return false;
+        while (Peek() == '"') {
+            std::string key = String();
+            if (!Expect(':'))
+                return false;
+            if (key == "value")
+                p_metric.value = Number();
+            else if (key == "tolerance")
+                p_metric.tolerance = Number();
+            else if (key == "better")
+                p_metric.higherIsBetter = String() != "lower";
+            else if (key == "action")
+                p_metric.fail = String() == "fail";
+            else
+                return false;
+            if (Peek() == ',')
+                m_pos++;
+        }
+        return Expect('}');
+    }
+
+    char Peek() {
+        while (m_pos < m_text.size() && std::isspace((unsigned char)m_text[m_pos])) m_pos++;
+        return m_pos < m_text.size() ? m_text[m_pos] : '\0';
+    }
+
+    bool Expect(char p_c) {
+        if (Peek() != p_c)
+            return false;
+        m_pos++;
+        return true;
+    }
+
+    std::string String() {
+        if (!Expect('"'))
+            return std::string();
+        std::size_t end = m_text.find('"', m_pos);
+        std::string value = m_text.substr(m_pos, end - m_pos);
+        m_pos = end == std::string::npos ? m_text.size() : end + 1;
+        return value;
+    }
+
+    double Number() {
+        Peek();
+        std::size_t used = 0;
+        double value = 0;
+        try {
+            value = std::stod(m_text.substr(m_pos, 32), &used);
+        } catch (...) {
+        }
+        m_pos += used;
+        return value;
+    }
+
+    std::string m_text;
+    std::size_t m_pos = 0;
+};
+
+struct PerfConfig {
+    int dim = 32;
+    int base = 5000;
+    int queries = 500;
+    int inserts = 1000;
+    int k = 10;
+    std::string dir = "perf_regression";
+};
+
+static double PercentileUs(std::vector<double> p_us, double p_fraction) {
+    if (p_us.empty())
+        return 0;
+    std::sort(p_us.begin(), p_us.end());
+    return p_us[(std::min)(p_us.size() - 1, (std::size_t)(p_fraction * p_us.size()))];
+}
+
+static double Seconds(std::chrono::steady_clock::time_point p_begin) {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - p_begin).count();
+}
+
+// distance kernels as the index calls them: millions of calls per second over a cache-resident set
+static void RunDistance(std::map<std::string, double>& p_results) {
+    const int dim = 128, vectors = 64;
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> data((std::size_t)vectors * dim);
+    for (auto& v : data) v = uniform(rng);
+    for (DistCalcMethod method : {DistCalcMethod::L2, DistCalcMethod::Cosine}) {
+        auto func = COMMON::DistanceCalcSelector<float>(method);
+        volatile float sink = 0;
+        std::uint64_t calls = 0;
+        auto begin = std::chrono::steady_clock::now();
+        while (Seconds(begin) < 0.3) {
+            for (int i = 0; i < vectors; i++)
+                for (int j = 0; j < vectors; j++) sink = sink + func(data.data() + (std::size_t)i * dim, data.data() + (std::size_t)j * dim, dim);
+            calls += (std::uint64_t)vectors * vectors;
+        }
+        p_results[std::string("distance.") + (method == DistCalcMethod::L2 ? "l2" : "cosine") + "_float_128.mcalls_per_s"] = calls / Seconds(begin) / 1e6;
+    }
+}
+
+static std::shared_ptr<SPANN::Index<float>> Build(const PerfConfig& p_config, const std::vector<float>& p_data) {
+    std::filesystem::remove_all(p_config.dir);
+    std::filesystem::create_directory(p_config.dir);
+    std::string vectorFile = p_config.dir + "/vectors.bin";
+    {
+        std::ofstream out(vectorFile, std::ios::binary);
+        out.write((const char*)p_data.data(), p_data.size() * sizeof(float));
+    }
+    auto index = std::make_shared<SPANN::Index<float>>();
+    index->SetParameter("ValueType", "Float", "Base");
+    index->SetParameter("Dim", std::to_string(p_config.dim).c_str(), "Base");
+    index->SetParameter("VectorPath", vectorFile.c_str(), "Base");
+    index->SetParameter("IndexDirectory", p_config.dir.c_str(), "Base");
+    index->SetParameter("DistCalcMethod", "L2", "Base");
+
+    index->SetParameter("isExecute", "true", "SelectHead");
+    index->SetParameter("SelectHeadType", "BKT", "SelectHead");
+    index->SetParameter("NumberOfThreads", "2", "SelectHead");
+    index->SetParameter("Ratio", "0.1", "SelectHead");
+    index->SetParameter("TreeNumber", "1", "SelectHead");
+    index->SetParameter("BKTKmeansK", "8", "SelectHead");
+    index->SetParameter("BKTLeafSize", "8", "SelectHead");
+    index->SetParameter("isExecute", "true", "BuildHead");
+
+    index->SetParameter("isExecute", "true", "BuildSSDIndex");
+    index->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    index->SetParameter("NumberOfThreads", "2", "BuildSSDIndex");
+    index->SetParameter("ExcludeHead", "true", "BuildSSDIndex");
+    index->SetParameter("UseDirectIO", "false", "BuildSSDIndex");
+    index->SetParameter("StorageBackend", "Uring", "BuildSSDIndex");
+    index->SetParameter("UringFilePath", (p_config.dir + "/postings.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SpdkMappingPath", (p_config.dir + "/mapping.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("PostingPageLimit", "4", "BuildSSDIndex");
+    index->SetParameter("SpdkCapacity", std::to_string(p_config.base * 4).c_str(), "BuildSSDIndex");
+    index->SetParameter("InternalResultNum", "32", "BuildSSDIndex");
+    index->SetParameter("SearchInternalResultNum", "32", "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "2048", "BuildSSDIndex");
+    index->SetParameter("ResultNum", std::to_string(p_config.k).c_str(), "BuildSSDIndex");
+    index->SetParameter("Update", "true", "BuildSSDIndex");
+    index->SetParameter("AppendThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    // the OpenMP workers of AddIndex have no device ring, appends stay on the initialized thread
+    index->SetParameter("InsertThreadNum", "1", "BuildSSDIndex");
+    if (index->BuildIndex(false) != ErrorCode::Success)
+        return nullptr;
+    return index;
+}
+
+// build, then search with one thread against brute-force truth, then insert with one thread
+static bool RunIndex(const PerfConfig& p_config, std::map<std::string, double>& p_results) {
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> data((std::size_t)p_config.base * p_config.dim), queries((std::size_t)p_config.queries * p_config.dim), inserts((std::size_t)p_config.inserts * p_config.dim);
+    for (auto& v : data) v = uniform(rng);
+    for (auto& v : queries) v = uniform(rng);
+    for (auto& v : inserts) v = uniform(rng);
+
+    auto begin = std::chrono::steady_clock::now();
+    std::shared_ptr<SPANN::Index<float>> index = Build(p_config, data);
+    double buildSeconds = Seconds(begin);
+    if (index == nullptr) {
+        std::cerr << "  FAILED: BuildIndex" << std::endl;
+        return false;
+    }
+    p_results["build.vectors_per_s"] = p_config.base / buildSeconds;
+
+    auto l2 = COMMON::DistanceCalcSelector<float>(DistCalcMethod::L2);
+    std::vector<std::set<SizeType>> truth(p_config.queries);
+    for (int q = 0; q < p_config.queries; q++) {
+        std::vector<std::pair<float, SizeType>> dists(p_config.base);
+        for (int i = 0; i < p_config.base; i++) dists[i] = {l2(queries.data() + (std::size_t)q * p_config.dim, data.data() + (std::size_t)i * p_config.dim, p_config.dim), i};
+        std::partial_sort(dists.begin(), dists.begin() + p_config.k, dists.end());
+        for (int i = 0; i < p_config.k; i++) truth[q].insert(dists[i].second);
+    }
+
+    bool ok = true;
+    std::thread worker([&] {
+        index->Initialize();
+        std::vector<double> latencies;
+        std::size_t hits = 0;
+        auto searchBegin = std::chrono::steady_clock::now();
+        for (int q = 0; q < p_config.queries; q++) {
+            COMMON::QueryResultSet<float> query(queries.data() + (std::size_t)q * p_config.dim, p_config.k);
+            query.Reset();
+            auto one = std::chrono::steady_clock::now();
+            if (index->SearchIndex(query) != ErrorCode::Success)
+                ok = false;
+            latencies.push_back(Seconds(one) * 1e6);
+            for (int i = 0; i < p_config.k; i++) hits += truth[q].count(query.GetResult(i)->VID);
+        }
+        double searchSeconds = Seconds(searchBegin);
+        p_results["search.qps"] = p_config.queries / searchSeconds;
+        p_results["search.p50_us"] = PercentileUs(latencies, 0.5);
+        p_results["search.p99_us"] = PercentileUs(latencies, 0.99);
+        p_results["search.recall_at_10"] = (double)hits / ((double)p_config.queries * p_config.k);
+
+        latencies.clear();
+        auto insertBegin = std::chrono::steady_clock::now();
+        for (int i = 0; i < p_config.inserts; i++) {
+            SizeType vid;
+            auto one = std::chrono::steady_clock::now();
+            if (index->AddIndexSPFresh(inserts.data() + (std::size_t)i * p_config.dim, 1, p_config.dim, &vid) != ErrorCode::Success)
+                ok = false;
+            latencies.push_back(Seconds(one) * 1e6);
+        }
+        while (!index->AllFinished()) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+        p_results["insert.per_s"] = p_config.inserts / Seconds(insertBegin);
+        p_results["insert.p99_us"] = PercentileUs(latencies, 0.99);
+        index->ExitBlockController();
+    });
+    worker.join();
+    index.reset();
+    std::filesystem::remove_all(p_config.dir);
+    if (!ok)
+        std::cerr << "  FAILED: search or insert returned an error" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::string baselinePath = "PerfBaseline.json";
+    std::string outputPath = "PerfRegressionTest.json";
+    bool update = false;
+    const char* strictEnv = getenv("SPTAG_PERF_STRICT");
+    bool strict = strictEnv != nullptr && std::string(strictEnv) == "1";
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--baseline" && i + 1 < argc) {
+            baselinePath = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            outputPath = argv[++i];
+        } else if (arg == "--update") {
+            update = true;
+        } else if (arg == "--strict") {
+            strict = true;
+        } else {
+            std::cerr << "Usage: PerfRegressionTest [--baseline PerfBaseline.json] [--output PerfRegressionTest.json] [--update] [--strict]" << std::endl;
+            return arg == "--help" ? 0 : 1;
+        }
+    }
+
+    std::cout << "======================================" << std::endl;
+    std::cout << "Performance Regression Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    Baseline baseline;
+    bool haveBaseline = baseline.Load(baselinePath);
+    if (!haveBaseline && !update)
+        std::cout << "  no baseline at " << baselinePath << ", nothing to compare against" << std::endl;
+
+    std::map<std::string, double> results;
+    PerfConfig config;
+    std::cout << "  Running distance kernels..." << std::endl;
+    RunDistance(results);
+    std::cout << "  Running build, search and insert of " << config.base << " vectors..." << std::endl;
+    bool testPassed = RunIndex(config, results);
+
+    // this run in the baseline's shape, for CI to keep or to diff
+    Baseline current;
+    current.m_tolerance = baseline.m_tolerance;
+    for (auto& entry : results) {
+        Metric metric;
+        auto it = baseline.m_metrics.find(entry.first);
+        if (it != baseline.m_metrics.end())
+            metric = it->second;
+        else
+            metric.higherIsBetter = entry.first.find("_us") == std::string::npos;
+        metric.value = entry.second;
+        current.m_metrics[entry.first] = metric;
+    }
+    current.Save(outputPath);
+
+    printf("  %-40s %12s %12s %9s  %s\n", "metric", "baseline", "current", "change", "verdict");
+    for (auto& entry : current.m_metrics) {
+        const Metric& now = entry.second;
+        auto it = baseline.m_metrics.find(entry.first);
+        if (it == baseline.m_metrics.end()) {
+            printf("  %-40s %12s %12.3f %9s  new\n", entry.first.c_str(), "-", now.value, "");
+            continue;
+        }
+        const Metric& base = it->second;
+        double tolerance = base.tolerance >= 0 ? base.tolerance : baseline.m_tolerance;
+        // relative change in the direction that is worse, regression beyond the tolerance
+        double change = base.value != 0 ? (now.value - base.value) / std::fabs(base.value) : 0;
+        double worse = base.higherIsBetter ? -change : change;
+        const char* verdict = "ok";
+        if (worse > tolerance) {
+            if (base.fail || strict) {
+                verdict = "FAIL";
+                testPassed = false;
+            } else {
+                verdict = "WARN";
+            }
+        }
+        printf("  %-40s %12.3f %12.3f %+8.1f%%  %s\n", entry.first.c_str(), base.value, now.value, change * 100, verdict);
+    }
+
+    if (update) {
+        if (current.Save(baselinePath))
+            std::cout << "  baseline " << baselinePath << " updated" << std::endl;
+        else
+            testPassed = false;
+    }
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,91 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/PostingCache.h"
+
+#include <iostream>
+#include <string>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: the budget is kept, and entries found since the last sweep survive eviction
+bool TestClockEviction() {
+    std::cout << "  Testing CLOCK eviction..." << std::endl;
+    PostingCache cache;
+    cache.SetCapacity(4000, 1);
+    std::string posting(1000, 'x');
+    for (SizeType key = 0; key < 4; key++)
+        cache.Insert(key, posting.data(), posting.size(), cache.Generation(key));
+    if (cache.Bytes() != 4000) {
+        std::cerr << "  FAILED: expected 4000 cached bytes, got " << cache.Bytes() << std::endl;
+        return false;
+    }
+
+    PostingCache::Entry held = cache.Find(0);
+    cache.Insert(4, posting.data(), posting.size(), cache.Generation(4));
+    if (cache.Bytes() != 4000 || cache.Find(0) == nullptr || cache.Find(1) != nullptr || cache.Find(4) == nullptr) {
+        std::cerr << "  FAILED: the referenced entry was evicted or the budget was exceeded" << std::endl;
+        return false;
+    }
+
+    // an evicted entry stays readable for whoever still holds it
+    for (SizeType key = 5; key < 12; key++)
+        cache.Insert(key, posting.data(), posting.size(), cache.Generation(key));
+    if (*held != posting) {
+        std::cerr << "  FAILED: held entry changed after eviction" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a read racing with a write never leaves the old content behind
+bool TestInvalidation() {
+    std::cout << "  Testing invalidation..." << std::endl;
+    PostingCache cache;
+    cache.SetCapacity(1 << 20, 4);
+    std::string oldPosting(100, 'a'), newPosting(200, 'b');
+
+    std::uint64_t generation = cache.Generation(7);
+    cache.Erase(7);  // a writer updates key 7 while the old content is being read
+    cache.Insert(7, oldPosting.data(), oldPosting.size(), generation);
+    if (cache.Find(7) != nullptr) {
+        std::cerr << "  FAILED: stale posting was cached" << std::endl;
+        return false;
+    }
+
+    cache.Insert(7, newPosting.data(), newPosting.size(), cache.Generation(7));
+    auto entry = cache.Find(7);
+    if (entry == nullptr || *entry != newPosting) {
+        std::cerr << "  FAILED: posting not cached after the update" << std::endl;
+        return false;
+    }
+    cache.Erase(7);
+    if (cache.Find(7) != nullptr || cache.Bytes() != 0) {
+        std::cerr << "  FAILED: erased posting still cached" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Posting Cache Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestClockEviction();
+    testPassed = TestInvalidation() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,107 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/PostingHeat.h"
+
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: hot postings rank above cold ones per kind, and the estimate is in the right
+// order of magnitude
+bool TestRanking() {
+    std::cout << "  Testing hottest postings..." << std::endl;
+    PostingHeat heat;
+    heat.Initialize(200000, 1, 0);
+    // posting 7 gets 20000 reads, 150000 (another chunk) 2000, 3 gets 200 and 9 gets appends only
+    for (int i = 0; i < 20000; i++) heat.Touch(7, HeatKind::Read);
+    for (int i = 0; i < 2000; i++) heat.Touch(150000, HeatKind::Read);
+    for (int i = 0; i < 200; i++) heat.Touch(3, HeatKind::Read);
+    for (int i = 0; i < 2000; i++) heat.Touch(9, HeatKind::Append);
+    heat.Touch(-1, HeatKind::Read);
+    heat.Touch(1 << 30, HeatKind::Read);
+
+    auto hot = heat.Hottest(HeatKind::Read, 2, 200000);
+    if (hot.size() != 2 || hot[0].first != 7 || hot[1].first != 150000 || heat.Get(9, HeatKind::Read) != 0) {
+        std::cerr << "  FAILED: read ranking" << std::endl;
+        return false;
+    }
+    auto appends = heat.Hottest(HeatKind::Append, 10, 200000);
+    if (appends.size() != 1 || appends[0].first != 9) {
+        std::cerr << "  FAILED: append ranking" << std::endl;
+        return false;
+    }
+    double estimate = PostingHeat::Estimate(hot[0].second, 1);
+    if (estimate < 20000 / 4.0 || estimate > 20000 * 4.0) {
+        std::cerr << "  FAILED: estimate " << estimate << " for 20000 reads" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: sampling keeps the order, aging halves every counter and a rate of 0 tracks nothing
+bool TestSamplingAndAging() {
+    std::cout << "  Testing sampling and aging..." << std::endl;
+    PostingHeat heat;
+    heat.Initialize(1000, 8, 0);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; t++) {
+        threads.emplace_back([&] {
+            for (int i = 0; i < 100000; i++) heat.Touch(i % 10 == 0 ? 1 : 2 + i % 50, HeatKind::Read);
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    auto hot = heat.Hottest(HeatKind::Read, 1, 1000);
+    if (hot.size() != 1 || hot[0].first != 1) {
+        std::cerr << "  FAILED: sampled ranking" << std::endl;
+        return false;
+    }
+    std::uint8_t before = heat.Get(1, HeatKind::Read);
+    heat.Age();
+    if (heat.Get(1, HeatKind::Read) != before / 2) {
+        std::cerr << "  FAILED: aging " << (int)before << " -> " << (int)heat.Get(1, HeatKind::Read) << std::endl;
+        return false;
+    }
+
+    PostingHeat aging;
+    aging.Initialize(10, 1, 64);
+    for (int i = 0; i < 64 * 20; i++) aging.Touch(0, HeatKind::Split);
+    if (aging.Get(0, HeatKind::Split) > 8) {
+        std::cerr << "  FAILED: periodic aging left " << (int)aging.Get(0, HeatKind::Split) << std::endl;
+        return false;
+    }
+
+    PostingHeat off;
+    off.Initialize(1000, 0, 0);
+    off.Touch(1, HeatKind::Read);
+    if (off.Enabled() || off.Get(1, HeatKind::Read) != 0 || !off.Hottest(HeatKind::Read, 5, 1000).empty()) {
+        std::cerr << "  FAILED: disabled heat counted" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Posting Heat Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestRanking();
+    testPassed = TestSamplingAndAging() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,146 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/PostingLayout.h"
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static const std::string c_layoutFile = "posting_layout_test.txt";
+
+// Test 1: aligned entries start their vectors on the boundary and keep whole rows
+bool TestGeometry() {
+    std::cout << "  Testing entry geometry..." << std::endl;
+    if (PostingLayout::MetaSize(0) != 5 || PostingLayout::EntrySize(0, 400) != 405) {
+        std::cerr << "  FAILED: packed layout changed" << std::endl;
+        return false;
+    }
+    for (int alignment : {8, 16, 32, 64}) {
+        int entry = PostingLayout::EntrySize(alignment, 100);
+        if (PostingLayout::MetaSize(alignment) % alignment != 0 || entry % alignment != 0 || entry < 105) {
+            std::cerr << "  FAILED: alignment " << alignment << " gives " << entry << " byte entries" << std::endl;
+            return false;
+        }
+    }
+    if (PostingLayout::ValidAlignment(4) || PostingLayout::ValidAlignment(24) || PostingLayout::ValidAlignment(128) || !PostingLayout::ValidAlignment(0)) {
+        std::cerr << "  FAILED: alignment validation" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: packed -> aligned -> packed keeps every VID, version and vector
+bool TestConvert() {
+    std::cout << "  Testing conversion round trip..." << std::endl;
+    const int payload = 37, count = 11;
+    std::vector<char> packed((size_t)count * PostingLayout::EntrySize(0, payload));
+    for (size_t i = 0; i < packed.size(); i++) packed[i] = (char)(i * 131 + 7);
+    std::vector<char> aligned((size_t)count * PostingLayout::EntrySize(64, payload));
+    PostingLayout::Convert(packed.data(), count, 0, aligned.data(), 64, payload);
+    for (int i = 0; i < count; i++) {
+        const char* row = aligned.data() + (size_t)i * PostingLayout::EntrySize(64, payload);
+        if (row[PostingLayout::kHeaderBytes] != 0 || row[PostingLayout::MetaSize(64) + payload] != 0) {
+            std::cerr << "  FAILED: padding of entry " << i << " not zeroed" << std::endl;
+            return false;
+        }
+    }
+    std::vector<char> back(packed.size());
+    PostingLayout::Convert(aligned.data(), count, 64, back.data(), 0, payload);
+    if (back != packed) {
+        std::cerr << "  FAILED: round trip changed the entries" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: the file records alignment and migration progress, a missing file is the packed layout
+bool TestPersist() {
+    std::cout << "  Testing layout file..." << std::endl;
+    std::remove(c_layoutFile.c_str());
+    PostingLayout layout;
+    layout.alignment = 5;
+    if (layout.Load(c_layoutFile) != ErrorCode::Success || layout.alignment != 0 || layout.target != -1) {
+        std::cerr << "  FAILED: missing file is not the packed layout" << std::endl;
+        return false;
+    }
+    layout.alignment = 16;
+    layout.target = 64;
+    layout.migrated = 123456;
+    if (layout.Save(c_layoutFile) != ErrorCode::Success) {
+        std::cerr << "  FAILED: cannot save" << std::endl;
+        return false;
+    }
+    PostingLayout loaded;
+    if (loaded.Load(c_layoutFile) != ErrorCode::Success || loaded.alignment != 16 || loaded.target != 64 || loaded.migrated != 123456) {
+        std::cerr << "  FAILED: migration progress lost" << std::endl;
+        return false;
+    }
+    std::remove(c_layoutFile.c_str());
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 4: the norm sits after VID and version, survives conversions and is recorded in the file
+bool TestNorms() {
+    std::cout << "  Testing norm slot..." << std::endl;
+    const int payload = 40, count = 5;
+    if (PostingLayout::MetaSize(0, true) != 9 || PostingLayout::EntrySize(0, payload, true) != 49 || PostingLayout::MetaSize(64, true) != 64) {
+        std::cerr << "  FAILED: norm slot geometry" << std::endl;
+        return false;
+    }
+    std::vector<char> packed((size_t)count * PostingLayout::EntrySize(0, payload, true));
+    for (size_t i = 0; i < packed.size(); i++) packed[i] = (char)(i * 37 + 3);
+    for (int i = 0; i < count; i++) {
+        float norm = 1.5f * i;
+        memcpy(packed.data() + (size_t)i * PostingLayout::EntrySize(0, payload, true) + PostingLayout::kHeaderBytes, &norm, sizeof(norm));
+    }
+    std::vector<char> aligned((size_t)count * PostingLayout::EntrySize(32, payload, true));
+    PostingLayout::Convert(packed.data(), count, 0, aligned.data(), 32, payload, true);
+    for (int i = 0; i < count; i++) {
+        if (PostingLayout::GetNorm(aligned.data() + (size_t)i * PostingLayout::EntrySize(32, payload, true)) != 1.5f * i) {
+            std::cerr << "  FAILED: norm of entry " << i << " lost" << std::endl;
+            return false;
+        }
+    }
+    std::vector<char> back(packed.size());
+    PostingLayout::Convert(aligned.data(), count, 32, back.data(), 0, payload, true);
+    PostingLayout layout, loaded;
+    layout.norms = true;
+    if (back != packed || layout.Save(c_layoutFile) != ErrorCode::Success || loaded.Load(c_layoutFile) != ErrorCode::Success || !loaded.norms) {
+        std::cerr << "  FAILED: norms lost in a round trip" << std::endl;
+        return false;
+    }
+    std::remove(c_layoutFile.c_str());
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Posting Layout Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestGeometry();
+    testPassed = TestConvert() && testPassed;
+    testPassed = TestPersist() && testPassed;
+    testPassed = TestNorms() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
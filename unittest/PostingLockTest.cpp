@@ -0,0 +1,110 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common.h"
+#include "Core/Common/FineGrainedLock.h"
+
+#include <iostream>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+// Test 1: every ID has its own lock and neighbouring IDs sit on different cache lines
+bool TestLayout() {
+    std::cout << "  Testing lock layout..." << std::endl;
+    PostingLockTable locks;
+    std::set<SeqLock*> addresses;
+    for (SizeType id = 0; id < 100000; id++) {
+        addresses.insert(&locks[id]);
+        if (id > 0 && ((std::uintptr_t)&locks[id] >> 6) == ((std::uintptr_t)&locks[id - 1] >> 6)) {
+            std::cerr << "  FAILED: IDs " << id - 1 << " and " << id << " share a cache line" << std::endl;
+            return false;
+        }
+    }
+    if (addresses.size() != 100000 || &locks[12345] != &locks[12345]) {
+        std::cerr << "  FAILED: " << addresses.size() << " distinct locks for 100000 IDs" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: writers are exclusive and a validated read never sees a write half done
+bool TestReadersAndWriters() {
+    std::cout << "  Testing readers and writers..." << std::endl;
+    const int postings = 16, writers = 4, readers = 4, rounds = 20000;
+    PostingLockTable locks;
+    // a writer sets both halves, a consistent read sees them equal
+    std::vector<std::atomic<int>> first(postings), second(postings);
+    std::vector<int> counts(postings, 0);
+    for (int i = 0; i < postings; i++) first[i] = second[i] = 0;
+    std::atomic<bool> done{false};
+    std::atomic<int> torn{0}, validated{0};
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < writers; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(t);
+            for (int r = 0; r < rounds; r++) {
+                int id = rng() % postings;
+                std::unique_lock<SeqLock> lock(locks[id]);
+                int value = ++counts[id];
+                first[id].store(value, std::memory_order_relaxed);
+                std::this_thread::yield();
+                second[id].store(value, std::memory_order_relaxed);
+            }
+        });
+    }
+    for (int t = 0; t < readers; t++) {
+        threads.emplace_back([&, t] {
+            std::mt19937 rng(100 + t);
+            while (!done.load()) {
+                int id = rng() % postings;
+                std::uint32_t seq = locks[id].ReadBegin();
+                int b = second[id].load(std::memory_order_relaxed);
+                int a = first[id].load(std::memory_order_relaxed);
+                if (!locks[id].ReadValidate(seq))
+                    continue;
+                validated++;
+                if (a != b)
+                    torn++;
+            }
+        });
+    }
+    for (int t = 0; t < writers; t++) threads[t].join();
+    done = true;
+    for (int t = writers; t < writers + readers; t++) threads[t].join();
+
+    int total = 0;
+    for (int i = 0; i < postings; i++) total += counts[i];
+    if (total != writers * rounds || torn.load() != 0) {
+        std::cerr << "  FAILED: " << total << " writes counted, " << torn.load() << " torn reads validated" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED (" << validated.load() << " validated reads)" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Posting Lock Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestLayout();
+    testPassed = TestReadersAndWriters() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
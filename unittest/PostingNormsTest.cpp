@@ -0,0 +1,184 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/QueryResultSet.h"
+#include "Core/SPANN/Index.h"
+
+#include <algorithm>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static const int c_dim = 16, c_base = 3000, c_queries = 20, c_k = 10;
+
+static std::shared_ptr<SPANN::Index<float>> Build(const std::string& p_dir, const std::vector<float>& p_data, const char* p_method, bool p_norms) {
+    std::filesystem::remove_all(p_dir);
+    std::filesystem::create_directory(p_dir);
+    {
+        std::ofstream out(p_dir + "/vectors.bin", std::ios::binary);
+        out.write((const char*)p_data.data(), p_data.size() * sizeof(float));
+    }
+    auto index = std::make_shared<SPANN::Index<float>>();
+    index->SetParameter("ValueType", "Float", "Base");
+    index->SetParameter("Dim", std::to_string(c_dim).c_str(), "Base");
+    index->SetParameter("VectorPath", (p_dir + "/vectors.bin").c_str(), "Base");
+    index->SetParameter("IndexDirectory", p_dir.c_str(), "Base");
+    index->SetParameter("DistCalcMethod", p_method, "Base");
+    index->SetParameter("isExecute", "true", "SelectHead");
+    index->SetParameter("SelectHeadType", "BKT", "SelectHead");
+    index->SetParameter("NumberOfThreads", "1", "SelectHead");
+    index->SetParameter("Ratio", "0.1", "SelectHead");
+    index->SetParameter("TreeNumber", "1", "SelectHead");
+    index->SetParameter("BKTKmeansK", "8", "SelectHead");
+    index->SetParameter("BKTLeafSize", "8", "SelectHead");
+    index->SetParameter("isExecute", "true", "BuildHead");
+    index->SetParameter("isExecute", "true", "BuildSSDIndex");
+    index->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    index->SetParameter("NumberOfThreads", "1", "BuildSSDIndex");
+    // heads stay in their postings too, every vector is then found by a search probing all of them
+    index->SetParameter("ExcludeHead", "false", "BuildSSDIndex");
+    index->SetParameter("UseDirectIO", "false", "BuildSSDIndex");
+    index->SetParameter("StorageBackend", "Uring", "BuildSSDIndex");
+    index->SetParameter("UringFilePath", (p_dir + "/postings.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SpdkMappingPath", (p_dir + "/mapping.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("PostingPageLimit", "4", "BuildSSDIndex");
+    index->SetParameter("PostingNorms", p_norms ? "true" : "false", "BuildSSDIndex");
+    index->SetParameter("SpdkCapacity", std::to_string(c_base * 4).c_str(), "BuildSSDIndex");
+    index->SetParameter("SearchInternalResultNum", "16", "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "2048", "BuildSSDIndex");
+    index->SetParameter("Update", "true", "BuildSSDIndex");
+    index->SetParameter("AppendThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("InsertThreadNum", "1", "BuildSSDIndex");
+    if (index->BuildIndex(false) != ErrorCode::Success) {
+        std::cerr << "  FAILED: BuildIndex" << std::endl;
+        return nullptr;
+    }
+    return index;
+}
+
+static std::vector<BasicResult> Search(SPANN::Index<float>& p_index, const float* p_query) {
+    COMMON::QueryResultSet<float> result(p_query, c_k);
+    result.Reset();
+    p_index.SearchIndex(result);
+    return std::vector<BasicResult>(result.GetResults(), result.GetResults() + c_k);
+}
+
+// Test 1: with PostingNorms the scans skip the entries the norm bound rules out and still find
+// the exact top k, for the metrics the bound applies to. Every posting is probed, so a wrongly
+// skipped entry shows up as a miss
+bool TestNormBound(const char* p_method) {
+    std::cout << "  Testing norm bound with " << p_method << "..." << std::endl;
+    const std::string dir = "test_posting_norms";
+    std::mt19937 rng(23);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f), scale(0.2f, 2.0f);
+    std::vector<float> data((size_t)c_base * c_dim), query((size_t)c_queries * c_dim);
+    // vectors of different lengths, the bound has nothing to go on with equal norms
+    for (int i = 0; i < c_base; i++) {
+        float s = scale(rng);
+        for (int j = 0; j < c_dim; j++) data[(size_t)i * c_dim + j] = uniform(rng) * s;
+    }
+    for (auto& v : query) v = uniform(rng);
+    auto index = Build(dir, data, p_method, true);
+    if (index == nullptr)
+        return false;
+    index->SetParameter("SearchInternalResultNum", "1024", "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "65536", "BuildSSDIndex");
+    index->GetMemoryIndex()->SetParameter("MaxCheck", "65536");
+
+    bool ok = true;
+    std::thread worker([&] {
+        index->Initialize();
+        for (int q = 0; q < c_queries && ok; q++) {
+            const float* target = query.data() + (size_t)q * c_dim;
+            std::vector<std::pair<float, SizeType>> exact;
+            for (SizeType v = 0; v < c_base; v++) exact.emplace_back(index->ComputeDistance(target, data.data() + (size_t)v * c_dim), v);
+            std::partial_sort(exact.begin(), exact.begin() + c_k, exact.end());
+            auto result = Search(*index, target);
+            for (int i = 0; i < c_k && ok; i++) {
+                if (result[i].VID != exact[i].second || std::fabs(result[i].Dist - exact[i].first) > 1e-3f) {
+                    std::cerr << "  FAILED: query " << q << " result " << i << " is " << result[i].VID << ", exact " << exact[i].second << std::endl;
+                    ok = false;
+                }
+            }
+        }
+        index->ExitBlockController();
+    });
+    worker.join();
+    index.reset();
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+// Test 2: Cosine vectors inserted as they are land in the postings normalized, at the distance
+// their normalized copies have, both through AddIndex and AddIndexSPFresh
+bool TestCosineInsert() {
+    std::cout << "  Testing Cosine inserts without normalizing..." << std::endl;
+    const std::string dir = "test_posting_norms_cosine";
+    const int inserts = 8;
+    std::mt19937 rng(29);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f), scale(0.5f, 4.0f);
+    std::vector<float> data((size_t)c_base * c_dim), added((size_t)inserts * c_dim);
+    for (auto& v : data) v = uniform(rng);
+    for (auto& v : added) v = uniform(rng) * 3;
+    auto index = Build(dir, data, "Cosine", false);
+    if (index == nullptr)
+        return false;
+
+    bool ok = true;
+    std::thread worker([&] {
+        index->Initialize();
+        SizeType first = index->GetNumSamples();
+        ok = index->AddIndex(added.data(), inserts / 2, c_dim, nullptr) == ErrorCode::Success;
+        SizeType vid = -1;
+        ok = ok && index->AddIndexSPFresh(added.data() + (size_t)(inserts / 2) * c_dim, inserts / 2, c_dim, &vid) == ErrorCode::Success;
+        // the appends run on the background workers
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        for (int i = 0; i < inserts && ok; i++) {
+            std::vector<float> normalized(added.begin() + (size_t)i * c_dim, added.begin() + (size_t)(i + 1) * c_dim);
+            COMMON::Utils::Normalize(normalized.data(), c_dim, COMMON::Utils::GetBase<float>());
+            auto result = Search(*index, normalized.data());
+            if (result[0].VID != first + i || std::fabs(result[0].Dist) > 1e-3f) {
+                std::cerr << "  FAILED: insert " << i << " found as " << result[0].VID << " at " << result[0].Dist << std::endl;
+                ok = false;
+            }
+        }
+        index->ExitBlockController();
+    });
+    worker.join();
+    index.reset();
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Posting Norms Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestNormBound("L2");
+    testPassed = TestNormBound("InnerProduct") && testPassed;
+    testPassed = TestCosineInsert() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,205 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/PostingRadiusRecord.h"
+#include "Core/SPANN/Index.h"
+#include "Utils/DistanceUtils.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: radii start unknown, grow only while known and are learned only while unknown
+bool TestRadiusRecord() {
+    std::cout << "  Testing posting radius record..." << std::endl;
+    COMMON::PostingRadiusRecord radii;
+    radii.Initialize(4, 8, 64);
+    bool ok = !radii.Known(0) && radii.Get(100) == MaxDist;
+    radii.Grow(0, 2.0f);
+    ok = ok && !radii.Known(0);
+    radii.Learn(0, 1.0f);
+    radii.Learn(0, 0.5f);
+    radii.Grow(0, 3.0f);
+    radii.Grow(0, 2.0f);
+    ok = ok && radii.Get(0) == 3.0f;
+    radii.Set(0, 0.25f);
+    ok = ok && radii.Get(0) == 0.25f;
+    ok = ok && radii.AddBatch(1) == ErrorCode::Success && radii.GetPostingNum() == 5 && !radii.Known(4);
+    if (!ok) {
+        std::cerr << "  FAILED: radius record" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a range search returns only vectors within the radius, nearly all of them, while skipping
+// most postings; it stops at the limit and finds vectors inserted after the build. Misses come from
+// the approximate head search, not from the radius bound
+bool TestRangeSearch() {
+    std::cout << "  Testing range search..." << std::endl;
+    const int dim = 16, base = 3000, queries = 30, inserts = 100;
+    const std::string dir = "test_range_search";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+
+    // tight clusters, so that most postings lie well outside a query ball around one of them
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::normal_distribution<float> noise(0.0f, 0.05f);
+    std::vector<float> centers(40 * dim), data((size_t)(base + inserts) * dim), query((size_t)queries * dim);
+    for (auto& v : centers) v = uniform(rng);
+    for (size_t i = 0; i < data.size(); i++) data[i] = centers[(i / dim) % 40 * dim + i % dim] + noise(rng);
+    for (size_t i = 0; i < query.size(); i++) query[i] = centers[(i / dim) % 40 * dim + i % dim] + noise(rng);
+    // the inserted vectors lie around a far corner no posting covered at build
+    for (size_t i = (size_t)base * dim; i < data.size(); i++) data[i] = data[i] * 0.1f + 3.0f;
+    {
+        std::ofstream out(dir + "/vectors.bin", std::ios::binary);
+        out.write((const char*)data.data(), (size_t)base * dim * sizeof(float));
+    }
+
+    auto index = std::make_shared<SPANN::Index<float>>();
+    index->SetParameter("ValueType", "Float", "Base");
+    index->SetParameter("Dim", std::to_string(dim).c_str(), "Base");
+    index->SetParameter("VectorPath", (dir + "/vectors.bin").c_str(), "Base");
+    index->SetParameter("IndexDirectory", dir.c_str(), "Base");
+    index->SetParameter("DistCalcMethod", "L2", "Base");
+    index->SetParameter("isExecute", "true", "SelectHead");
+    index->SetParameter("SelectHeadType", "BKT", "SelectHead");
+    index->SetParameter("NumberOfThreads", "2", "SelectHead");
+    index->SetParameter("Ratio", "0.1", "SelectHead");
+    index->SetParameter("TreeNumber", "1", "SelectHead");
+    index->SetParameter("BKTKmeansK", "8", "SelectHead");
+    index->SetParameter("BKTLeafSize", "8", "SelectHead");
+    index->SetParameter("isExecute", "true", "BuildHead");
+    index->SetParameter("isExecute", "true", "BuildSSDIndex");
+    index->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    index->SetParameter("NumberOfThreads", "2", "BuildSSDIndex");
+    index->SetParameter("ExcludeHead", "true", "BuildSSDIndex");
+    index->SetParameter("UseDirectIO", "false", "BuildSSDIndex");
+    index->SetParameter("StorageBackend", "Uring", "BuildSSDIndex");
+    index->SetParameter("UringFilePath", (dir + "/postings.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SpdkMappingPath", (dir + "/mapping.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("PostingPageLimit", "4", "BuildSSDIndex");
+    index->SetParameter("SpdkCapacity", std::to_string(base * 4).c_str(), "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "4096", "BuildSSDIndex");
+    index->SetParameter("RangeSearchHeadNum", "1024", "BuildSSDIndex");
+    index->SetParameter("Update", "true", "BuildSSDIndex");
+    index->SetParameter("AppendThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("InsertThreadNum", "1", "BuildSSDIndex");
+    if (index->BuildIndex(false) != ErrorCode::Success) {
+        std::cerr << "  FAILED: BuildIndex" << std::endl;
+        return false;
+    }
+
+    auto l2 = COMMON::DistanceCalcSelector<float>(DistCalcMethod::L2);
+    // the 20 nearest of the first p_count vectors, the radius halfway to the 21st
+    auto truthOf = [&](const float* p_target, int p_count, float& p_radius) {
+        std::vector<float> dists(p_count);
+        for (int i = 0; i < p_count; i++) dists[i] = l2(p_target, data.data() + (size_t)i * dim, dim);
+        std::vector<float> sorted(dists);
+        std::partial_sort(sorted.begin(), sorted.begin() + 21, sorted.end());
+        p_radius = (sorted[19] + sorted[20]) / 2;
+        std::set<SizeType> truth;
+        for (int i = 0; i < p_count; i++)
+            if (dists[i] <= p_radius) truth.insert(i);
+        return truth;
+    };
+
+    bool ok = true;
+    std::thread worker([&] {
+        index->Initialize();
+        std::size_t found = 0, expected = 0;
+        int pruned = 0;
+        for (int q = 0; q < queries && ok; q++) {
+            const float* target = query.data() + (size_t)q * dim;
+            float radius;
+            std::set<SizeType> truth = truthOf(target, base, radius);
+            std::vector<BasicResult> results;
+            SearchStats stats;
+            index->RangeSearch(target, radius, results, 0, &stats);
+            std::set<SizeType> seen;
+            for (auto& res : results) {
+                if (res.Dist > radius || !seen.insert(res.VID).second) {
+                    std::cerr << "  FAILED: query " << q << " returned " << res.VID << " at " << res.Dist << " past " << radius << " or twice" << std::endl;
+                    ok = false;
+                }
+                found += truth.count(res.VID);
+            }
+            expected += truth.size();
+            pruned += stats.m_prunedPostings;
+
+            // the limit and the callback both end the stream
+            std::vector<BasicResult> limited;
+            int calls = 0;
+            index->RangeSearch(target, radius, limited, 5);
+            index->RangeSearch(target, radius, [&](SizeType, float) { return ++calls < 3; });
+            if (limited.size() != (std::min)((size_t)5, truth.size()) || calls != (std::min)(3, (int)truth.size())) {
+                std::cerr << "  FAILED: " << limited.size() << " results under limit 5, " << calls << " callbacks stopping at 3" << std::endl;
+                ok = false;
+            }
+        }
+        if (ok && (found < expected * 0.97 || pruned < queries * 100)) {
+            std::cerr << "  FAILED: " << found << " of " << expected << " vectors in range, " << pruned << " postings pruned" << std::endl;
+            ok = false;
+        }
+        if (ok)
+            std::cout << "  " << found << " vectors in range, " << pruned << " postings pruned over " << queries << " queries" << std::endl;
+
+        // the appends widen the radii of the postings they land in
+        SizeType first = -1;
+        if (ok && index->AddIndexSPFresh(data.data() + (size_t)base * dim, inserts, dim, &first) == ErrorCode::Success) {
+            while (!index->AllFinished()) std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            const float* target = data.data() + (size_t)base * dim;
+            float radius;
+            std::set<SizeType> truth = truthOf(target, base + inserts, radius);
+            std::vector<BasicResult> results;
+            index->RangeSearch(target, radius, results);
+            std::size_t hits = 0;
+            for (auto& res : results) hits += truth.count(res.VID >= first ? res.VID - first + base : res.VID);
+            if (hits < truth.size() * 0.9 || results.size() > truth.size()) {
+                std::cerr << "  FAILED: " << hits << " of " << truth.size() << " vectors in range around the inserted ones" << std::endl;
+                ok = false;
+            }
+        } else if (ok) {
+            std::cerr << "  FAILED: AddIndexSPFresh" << std::endl;
+            ok = false;
+        }
+        index->ExitBlockController();
+    });
+    worker.join();
+    index.reset();
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Range Search Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestRadiusRecord();
+    testPassed = TestRangeSearch() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
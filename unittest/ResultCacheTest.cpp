@@ -0,0 +1,260 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/QueryResultSet.h"
+#include "Core/SPANN/Index.h"
+#include "Core/SPANN/ResultCache.h"
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static const int c_dim = 16, c_base = 3000, c_k = 10;
+
+static ResultCache::Entry MakeEntry(SizeType p_vid, int p_results) {
+    ResultCache::Entry entry;
+    for (int i = 0; i < p_results; i++) entry.m_results.emplace_back(p_vid + i, (float)i);
+    return entry;
+}
+
+static bool SameKey(const ResultCache::Key& p_a, const ResultCache::Key& p_b) {
+    return p_a.m_hash == p_b.m_hash && p_a.m_check == p_b.m_check;
+}
+
+// Test 1: queries within the quantum share a key, anything else parts them: another k, a
+// component off by more than the quantum, or with no quantum any difference but the sign of 0
+bool TestKeys() {
+    std::cout << "  Testing query keys..." << std::endl;
+    std::vector<float> query = {0.25f, -1.5f, 3.0f, 0.0f}, near = {0.252f, -1.498f, 3.001f, -0.003f}, far = {0.25f, -1.5f, 3.02f, 0.0f};
+    std::vector<float> negativeZero = {0.25f, -1.5f, 3.0f, -0.0f};
+    const float quantum = 0.01f;
+    auto key = ResultCache::MakeKey(query.data(), 4, c_k, quantum);
+    bool ok = SameKey(key, ResultCache::MakeKey(near.data(), 4, c_k, quantum));
+    ok = ok && !SameKey(key, ResultCache::MakeKey(far.data(), 4, c_k, quantum));
+    ok = ok && !SameKey(key, ResultCache::MakeKey(query.data(), 4, c_k + 1, quantum));
+    ok = ok && !SameKey(ResultCache::MakeKey(query.data(), 4, c_k, 0), ResultCache::MakeKey(near.data(), 4, c_k, 0));
+    ok = ok && SameKey(ResultCache::MakeKey(query.data(), 4, c_k, 0), ResultCache::MakeKey(negativeZero.data(), 4, c_k, 0));
+    std::vector<std::int8_t> bytes = {3, -7, 12}, otherBytes = {3, -7, 13};
+    ok = ok && !SameKey(ResultCache::MakeKey(bytes.data(), 3, c_k, 0), ResultCache::MakeKey(otherBytes.data(), 3, c_k, 0));
+    ok = ok && SameKey(ResultCache::MakeKey(bytes.data(), 3, c_k, 4), ResultCache::MakeKey(otherBytes.data(), 3, c_k, 4));
+    if (!ok) {
+        std::cerr << "  FAILED: query keys" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: entries come back under their key only, the cache stays within its budget, and Clear
+// drops everything along with the inserts of searches that started before it
+bool TestCache() {
+    std::cout << "  Testing cache entries and budget..." << std::endl;
+    ResultCache cache;
+    bool ok = !cache.Enabled();
+    const size_t entryBytes = MakeEntry(0, c_k).Bytes();
+    cache.SetCapacity(entryBytes * 20, 1);
+    ok = ok && cache.Enabled();
+
+    std::vector<float> query(c_dim, 0.5f);
+    auto key = ResultCache::MakeKey(query.data(), c_dim, c_k, 0);
+    cache.Insert(key, MakeEntry(100, c_k), cache.Generation());
+    auto entry = cache.Find(key);
+    ok = ok && entry != nullptr && entry->m_results.size() == (size_t)c_k && entry->m_results[3].first == 103;
+    // the same first hash with another second one is another query
+    ResultCache::Key collision = key;
+    collision.m_check++;
+    ok = ok && cache.Find(collision) == nullptr;
+
+    // keep the first entry referenced while filling the cache far beyond its budget
+    for (int i = 0; i < 200; i++) {
+        query[i % c_dim] += 1.0f;
+        cache.Insert(ResultCache::MakeKey(query.data(), c_dim, c_k, 0), MakeEntry(i, c_k), cache.Generation());
+        if (i % 10 == 0)
+            cache.Find(key);
+        ok = ok && cache.Bytes() <= entryBytes * 20;
+    }
+    ok = ok && cache.Find(key) != nullptr;
+
+    cache.Erase(key, entry);
+    ok = ok && cache.Find(key) == nullptr;
+    std::uint64_t generation = cache.Generation();
+    cache.Clear();
+    cache.Insert(key, MakeEntry(100, c_k), generation);
+    ok = ok && cache.Find(key) == nullptr && cache.Bytes() == 0;
+    cache.Insert(key, MakeEntry(100, c_k), cache.Generation());
+    ok = ok && cache.Find(key) != nullptr;
+    if (!ok) {
+        std::cerr << "  FAILED: cache holds " << cache.Bytes() << " bytes of a budget of " << entryBytes * 20 << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+static std::shared_ptr<SPANN::Index<float>> Build(const std::string& p_dir, const std::vector<float>& p_data) {
+    std::filesystem::remove_all(p_dir);
+    std::filesystem::create_directory(p_dir);
+    {
+        std::ofstream out(p_dir + "/vectors.bin", std::ios::binary);
+        out.write((const char*)p_data.data(), p_data.size() * sizeof(float));
+    }
+    auto index = std::make_shared<SPANN::Index<float>>();
+    index->SetParameter("ValueType", "Float", "Base");
+    index->SetParameter("Dim", std::to_string(c_dim).c_str(), "Base");
+    index->SetParameter("VectorPath", (p_dir + "/vectors.bin").c_str(), "Base");
+    index->SetParameter("IndexDirectory", p_dir.c_str(), "Base");
+    index->SetParameter("DistCalcMethod", "L2", "Base");
+    index->SetParameter("isExecute", "true", "SelectHead");
+    index->SetParameter("SelectHeadType", "BKT", "SelectHead");
+    index->SetParameter("NumberOfThreads", "1", "SelectHead");
+    index->SetParameter("Ratio", "0.1", "SelectHead");
+    index->SetParameter("TreeNumber", "1", "SelectHead");
+    index->SetParameter("BKTKmeansK", "8", "SelectHead");
+    index->SetParameter("BKTLeafSize", "8", "SelectHead");
+    index->SetParameter("isExecute", "true", "BuildHead");
+    index->SetParameter("isExecute", "true", "BuildSSDIndex");
+    index->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    index->SetParameter("NumberOfThreads", "1", "BuildSSDIndex");
+    index->SetParameter("ExcludeHead", "false", "BuildSSDIndex");
+    index->SetParameter("UseDirectIO", "false", "BuildSSDIndex");
+    index->SetParameter("StorageBackend", "Uring", "BuildSSDIndex");
+    index->SetParameter("UringFilePath", (p_dir + "/postings.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SpdkMappingPath", (p_dir + "/mapping.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("PostingPageLimit", "4", "BuildSSDIndex");
+    index->SetParameter("SpdkCapacity", std::to_string(c_base * 4).c_str(), "BuildSSDIndex");
+    index->SetParameter("SearchInternalResultNum", "16", "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "2048", "BuildSSDIndex");
+    index->SetParameter("Update", "true", "BuildSSDIndex");
+    index->SetParameter("AppendThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("InsertThreadNum", "1", "BuildSSDIndex");
+    if (index->BuildIndex(false) != ErrorCode::Success) {
+        std::cerr << "  FAILED: BuildIndex" << std::endl;
+        return nullptr;
+    }
+    return index;
+}
+
+static std::vector<BasicResult> Search(SPANN::Index<float>& p_index, const float* p_query, bool& p_hit) {
+    COMMON::QueryResultSet<float> result(p_query, c_k);
+    result.Reset();
+    SearchStats stats;
+    p_index.SearchIndex(result, false, &stats);
+    p_hit = stats.m_resultCacheHit;
+    return std::vector<BasicResult>(result.GetResults(), result.GetResults() + c_k);
+}
+
+static bool SameResults(const std::vector<BasicResult>& p_a, const std::vector<BasicResult>& p_b) {
+    for (int i = 0; i < c_k; i++) {
+        if (p_a[i].VID != p_b[i].VID || p_a[i].Dist != p_b[i].Dist)
+            return false;
+    }
+    return true;
+}
+
+// Test 3: on a running index a repeated query and a near duplicate of it are answered from the
+// cache with the results of the first search. Deleting a result or inserting into a probed posting
+// makes the entry stale; with Global invalidation any update does
+bool TestIndexCache() {
+    std::cout << "  Testing cached searches of an index..." << std::endl;
+    const std::string dir = "test_result_cache";
+    const float quantum = 0.01f;
+    std::mt19937 rng(31);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> data((size_t)c_base * c_dim), query(c_dim), near(c_dim), other(c_dim);
+    for (auto& v : data) v = uniform(rng);
+    // on the grid of the quantum, the near duplicate rounds to the same point
+    for (int j = 0; j < c_dim; j++) {
+        query[j] = std::round(uniform(rng) / quantum) * quantum;
+        near[j] = query[j] + quantum * 0.2f;
+        other[j] = uniform(rng);
+    }
+    auto index = Build(dir, data);
+    if (index == nullptr)
+        return false;
+    // every posting is probed, an insert next to the query lands in one of them
+    index->SetParameter("SearchInternalResultNum", "1024", "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "65536", "BuildSSDIndex");
+    index->GetMemoryIndex()->SetParameter("MaxCheck", "65536");
+    index->SetParameter("ResultCacheMB", "4", "BuildSSDIndex");
+    index->SetParameter("ResultCacheQuantum", std::to_string(quantum).c_str(), "BuildSSDIndex");
+
+    bool ok = true;
+    auto check = [&ok](bool p_condition, const char* p_what) {
+        if (ok && !p_condition) {
+            std::cerr << "  FAILED: " << p_what << std::endl;
+            ok = false;
+        }
+    };
+    std::thread worker([&] {
+        index->Initialize();
+        bool hit = false;
+        auto first = Search(*index, query.data(), hit);
+        check(!hit, "the first search hit the cache");
+        auto again = Search(*index, query.data(), hit);
+        check(hit && SameResults(first, again), "the repeated search was not answered from the cache");
+        auto nearResults = Search(*index, near.data(), hit);
+        check(hit && SameResults(first, nearResults), "the near duplicate was not answered from the cache");
+
+        // a deleted result is not handed out again
+        check(index->DeleteIndex(first[0].VID) == ErrorCode::Success, "DeleteIndex");
+        auto afterDelete = Search(*index, query.data(), hit);
+        check(!hit && afterDelete[0].VID != first[0].VID, "a deleted result came from the cache");
+        Search(*index, query.data(), hit);
+        check(hit, "the search after the delete was not cached");
+
+        // a vector at the query goes into a probed posting and comes first, under the id after the built ones
+        SizeType added = c_base;
+        check(index->AddIndex(query.data(), 1, c_dim, nullptr) == ErrorCode::Success, "AddIndex");
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        auto afterInsert = Search(*index, query.data(), hit);
+        check(!hit && afterInsert[0].VID == added, "the insert next to the query was not found");
+
+        // with Global invalidation an insert anywhere drops the entries
+        index->SetParameter("ResultCacheInvalidation", "Global", "BuildSSDIndex");
+        Search(*index, query.data(), hit);
+        check(!hit, "the mode change kept the entries");
+        Search(*index, query.data(), hit);
+        check(hit, "the search was not cached under Global invalidation");
+        check(index->AddIndex(other.data(), 1, c_dim, nullptr) == ErrorCode::Success, "AddIndex");
+        std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        Search(*index, query.data(), hit);
+        check(!hit, "an insert did not drop the entry under Global invalidation");
+        index->ExitBlockController();
+    });
+    worker.join();
+    index.reset();
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Result Cache Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestKeys();
+    testPassed = TestCache() && testPassed;
+    testPassed = TestIndexCache() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -525,6 +525,75 @@ bool TestConcurrentFlushAndWrite() {
     return true;
 }
 
+// Test 8: Per-thread buffers are merged back in sequence order and the spill file is removed
+bool TestMergedOrder() {
+    std::cout << "  Testing Merged Sequence Order..." << std::endl;
+
+    const std::string testFile = "/tmp/result_writer_order_test.bin";
+    const std::size_t k = 4;
+    const std::size_t numRecords = 40000;
+    const int numThreads = 6;
+    std::size_t shards = 0;
+
+    {
+        ResultWriter writer(testFile, k, 128);
+
+        std::atomic<std::size_t> counter{0};
+        std::vector<std::thread> threads;
+        for (int t = 0; t < numThreads; ++t) {
+            threads.emplace_back([&]() {
+                std::vector<std::uint64_t> resultIds(k);
+                std::size_t seqNum;
+                while ((seqNum = counter.fetch_add(1, std::memory_order_relaxed)) < numRecords) {
+                    if (seqNum % 3 == 0) {
+                        writer.WriteInsertRecord(seqNum, seqNum + 7);
+                    } else {
+                        std::fill(resultIds.begin(), resultIds.end(), seqNum);
+                        writer.WriteSearchRecord(seqNum, resultIds.data());
+                    }
+                }
+            });
+        }
+        for (auto& t : threads) {
+            t.join();
+        }
+        shards = writer.GetShards();
+        writer.Close();
+    }
+
+    if (shards != static_cast<std::size_t>(numThreads)) {
+        std::cerr << "    FAILED: Expected one buffer per thread, got " << shards << std::endl;
+        return false;
+    }
+    if (access((testFile + ".blocks").c_str(), F_OK) == 0) {
+        std::cerr << "    FAILED: Spill file left behind" << std::endl;
+        return false;
+    }
+
+    {
+        ResultReader reader(testFile);
+        ResultReader::Record record;
+        std::size_t expected = 0;
+        while (reader.Next(record)) {
+            bool insert = expected % 3 == 0;
+            if (record.m_seqNum != expected || (record.m_type == ResultRecordType::Write) != insert ||
+                (insert ? record.m_internalId != expected + 7 : record.m_resultIds[k - 1] != expected)) {
+                std::cerr << "    FAILED: Record " << expected << " out of order or corrupt" << std::endl;
+                return false;
+            }
+            ++expected;
+        }
+        if (expected != numRecords) {
+            std::cerr << "    FAILED: Expected " << numRecords << " records, got " << expected << std::endl;
+            return false;
+        }
+    }
+
+    std::remove(testFile.c_str());
+    std::cout << "    PASSED: " << numRecords << " records from " << numThreads << " threads merged in order" << std::endl;
+    return true;
+}
+
 int main(int argc, char* argv[]) {
     std::cout << "======================================" << std::endl;
     std::cout << "ResultWriter Parallel Test Suite" << std::endl;
@@ -549,6 +618,7 @@ int main(int argc, char* argv[]) {
     runTest("FlushBehavior", TestFlushBehavior);
     runTest("RecordTypeDistribution", TestRecordTypeDistribution);
     runTest("ConcurrentFlushAndWrite", TestConcurrentFlushAndWrite);
+    runTest("MergedOrder", TestMergedOrder);
 
     std::cout << "\n======================================" << std::endl;
     std::cout << "Results: " << passed << " passed, " << failed << " failed" << std::endl;
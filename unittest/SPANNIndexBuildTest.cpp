@@ -7,6 +7,7 @@
 #include <filesystem>
 #include <thread>
 #include <atomic>
+#include <future>
 #include "Core/SPANN/Index.h"
 #include "Core/Common/QueryResultSet.h"
 #include "Helper/VectorSetReader.h"
@@ -236,6 +237,53 @@ bool TestSPANNIndexBuild() {
     }
     std::cout << std::endl;
 
+    // ========================================
+    // Test: Insert a batch in one call, every vector must be found afterwards
+    // ========================================
+    std::cout << "\n  Testing batched insertion via AddIndexSPFresh..." << std::endl;
+    const int numBatchVectors = 64;
+    // a seed of its own, GenerateRandomVectors would repeat the base vectors
+    std::vector<T> batchData(numBatchVectors * dimension);
+    std::mt19937 batchRng(7);
+    std::uniform_real_distribution<float> batchDist(-1.0f, 1.0f);
+    for (auto& value : batchData) value = static_cast<T>(batchDist(batchRng));
+    std::vector<SizeType> batchVIDs(numBatchVectors);
+    std::atomic<bool> batchSuccess(true);
+
+    std::thread batchInsertThread([&]() {
+        index->Initialize();
+        if (index->AddIndexSPFresh(batchData.data(), numBatchVectors, dimension, batchVIDs.data()) != ErrorCode::Success) {
+            std::cerr << "  FAILED: batched AddIndexSPFresh returned error" << std::endl;
+            batchSuccess.store(false);
+        }
+        index->ExitBlockController();
+    });
+    batchInsertThread.join();
+    while (!index->AllFinished()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+
+    std::thread batchSearchThread([&]() {
+        index->Initialize();
+        for (int i = 0; i < numBatchVectors && batchSuccess.load(); i++) {
+            COMMON::QueryResultSet<T> query(batchData.data() + i * dimension, 5);
+            query.Reset();
+            index->SearchIndex(query);
+            bool found = false;
+            for (int j = 0; j < 5 && !found; j++) found = query.GetResult(j)->VID == batchVIDs[i];
+            if (!found) {
+                std::cerr << "  FAILED: batch inserted VID " << batchVIDs[i] << " not found by its own vector" << std::endl;
+                batchSuccess.store(false);
+            }
+        }
+        index->ExitBlockController();
+    });
+    batchSearchThread.join();
+    if (!batchSuccess.load()) {
+        return false;
+    }
+    std::cout << "  PASSED: Inserted and found " << numBatchVectors << " vectors in one batch" << std::endl;
+
     // ========================================
     // Test: Search for ONE vector using ONE thread
     // Search also requires per-thread SPDK initialization!
@@ -271,6 +319,98 @@ bool TestSPANNIndexBuild() {
             searchSuccess.store(true);
         }
 
+        // A batch search must return what the queries return one by one
+        std::cout << "  Search thread: calling SearchIndexBatch()..." << std::endl;
+        std::vector<QueryResult> batch;
+        for (int i = 0; i < numInsertVectors; i++) {
+            batch.emplace_back(insertData.data() + i * dimension, k, false);
+            batch.back().Reset();
+        }
+        ret = index->SearchIndexBatch(batch);
+        if (ret != ErrorCode::Success) {
+            std::cerr << "  FAILED: SearchIndexBatch returned " << static_cast<int>(ret) << std::endl;
+            searchSuccess.store(false);
+        }
+        for (int i = 0; i < numInsertVectors && searchSuccess.load(); i++) {
+            COMMON::QueryResultSet<T> single(insertData.data() + i * dimension, k);
+            single.Reset();
+            index->SearchIndex(single);
+            for (int j = 0; j < k; j++) {
+                if (single.GetResult(j)->VID != batch[i].GetResult(j)->VID) {
+                    std::cerr << "  FAILED: batch result " << j << " of query " << i << " is VID " << batch[i].GetResult(j)->VID
+                              << ", single search found " << single.GetResult(j)->VID << std::endl;
+                    searchSuccess.store(false);
+                    break;
+                }
+            }
+        }
+
+        // Async searches go through the same batch path and must agree with it
+        std::cout << "  Search thread: calling SearchIndexAsync()..." << std::endl;
+        std::vector<QueryResult> asyncQueries;
+        for (int i = 0; i < numInsertVectors; i++) {
+            asyncQueries.emplace_back(insertData.data() + i * dimension, k, false);
+            asyncQueries.back().Reset();
+        }
+        std::vector<std::future<ErrorCode>> pending;
+        for (auto& query : asyncQueries)
+            pending.push_back(index->SearchIndexAsync(query));
+        for (int i = 0; i < numInsertVectors && searchSuccess.load(); i++) {
+            ret = pending[i].get();
+            if (ret != ErrorCode::Success) {
+                std::cerr << "  FAILED: SearchIndexAsync returned " << static_cast<int>(ret) << std::endl;
+                searchSuccess.store(false);
+                break;
+            }
+            for (int j = 0; j < k; j++) {
+                if (asyncQueries[i].GetResult(j)->VID != batch[i].GetResult(j)->VID) {
+                    std::cerr << "  FAILED: async result " << j << " of query " << i << " is VID " << asyncQueries[i].GetResult(j)->VID
+                              << ", batch search found " << batch[i].GetResult(j)->VID << std::endl;
+                    searchSuccess.store(false);
+                    break;
+                }
+            }
+        }
+        for (auto& future : pending) {
+            if (future.valid())
+                future.wait();
+        }
+        index->StopAsyncSearch();
+
+        // Postings scanned by several helpers at once must give what one thread finds
+        std::cout << "  Search thread: calling SearchIndex() with the parallel posting scan..." << std::endl;
+        index->SetParameter("ParallelScanThreshold", "1", "BuildSSDIndex");
+        index->SetParameter("ParallelScanWorkers", "3", "BuildSSDIndex");
+        for (int i = 0; i < numInsertVectors && searchSuccess.load(); i++) {
+            COMMON::QueryResultSet<T> parallel(insertData.data() + i * dimension, k);
+            parallel.Reset();
+            index->SearchIndex(parallel);
+            for (int j = 0; j < k; j++) {
+                if (parallel.GetResult(j)->VID != batch[i].GetResult(j)->VID) {
+                    std::cerr << "  FAILED: parallel scan result " << j << " of query " << i << " is VID " << parallel.GetResult(j)->VID
+                              << ", serial search found " << batch[i].GetResult(j)->VID << std::endl;
+                    searchSuccess.store(false);
+                    break;
+                }
+            }
+        }
+        index->SetParameter("ParallelScanThreshold", "0", "BuildSSDIndex");
+
+        // A query whose deadline has already passed reads nothing and says so
+        std::cout << "  Search thread: calling SearchIndex() past the deadline..." << std::endl;
+        {
+            COMMON::QueryResultSet<T> late(insertData.data(), k);
+            late.Reset();
+            late.SetDeadline(std::chrono::steady_clock::now() - std::chrono::milliseconds(1));
+            SPANN::SearchStats stats;
+            ret = index->SearchIndex(late, false, &stats);
+            if (ret != ErrorCode::Success || !stats.m_partial || stats.m_skippedPostings <= 0 || stats.m_diskIOCount != 0) {
+                std::cerr << "  FAILED: expired query returned " << static_cast<int>(ret) << ", partial " << stats.m_partial
+                          << ", skipped " << stats.m_skippedPostings << ", disk IOs " << stats.m_diskIOCount << std::endl;
+                searchSuccess.store(false);
+            }
+        }
+
         // Signal thread completion
         std::cout << "  Search thread: calling ExitBlockController()..." << std::endl;
         index->ExitBlockController();
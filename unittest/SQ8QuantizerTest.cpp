@@ -0,0 +1,111 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/SQ8Quantizer.h"
+#include "Utils/CommonUtils.h"
+
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+static std::vector<float> MakeData(SizeType p_count, DimensionType p_dim, bool p_normalize) {
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> value(-3.0f, 3.0f);
+    std::vector<float> data((size_t)p_count * p_dim);
+    for (auto& v : data) v = value(rng);
+    if (p_normalize) {
+        for (SizeType i = 0; i < p_count; i++) Utils::Normalize(data.data() + (size_t)i * p_dim, p_dim, 1);
+    }
+    return data;
+}
+
+// Test 1: every component is reconstructed within half a step, values past the range are clamped
+bool TestEncodeDecode() {
+    std::cout << "  Testing encode/decode..." << std::endl;
+    const DimensionType dim = 37;
+    const SizeType count = 200;
+    auto data = MakeData(count, dim, false);
+    float maxAbs = 0;
+    for (SizeType i = 0; i < count; i++) maxAbs = (std::max)(maxAbs, SQ8Quantizer::MaxAbs(data.data() + (size_t)i * dim, dim));
+    SQ8Quantizer quantizer(dim, DistCalcMethod::L2, 1, maxAbs);
+
+    std::vector<std::int8_t> code(dim);
+    std::vector<float> decoded(dim);
+    for (SizeType i = 0; i < count; i++) {
+        const float* vector = data.data() + (size_t)i * dim;
+        quantizer.Encode(vector, code.data());
+        quantizer.Decode(code.data(), decoded.data());
+        for (DimensionType d = 0; d < dim; d++) {
+            if (std::fabs(vector[d] - decoded[d]) > quantizer.Scale() * 0.5f + 1e-5f) {
+                std::cerr << "  FAILED: component " << d << " of vector " << i << " decoded to " << decoded[d] << " instead of " << vector[d] << std::endl;
+                return false;
+            }
+        }
+    }
+
+    std::vector<float> outlier(dim, 2 * maxAbs);
+    quantizer.Encode(outlier.data(), code.data());
+    for (DimensionType d = 0; d < dim; d++) {
+        if (code[d] != SQ8Quantizer::kMaxCode) {
+            std::cerr << "  FAILED: out of range value not clamped" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: code distances land on the scale of the float distances, for both metrics
+bool TestDistance(DistCalcMethod p_method) {
+    std::cout << "  Testing " << (p_method == DistCalcMethod::L2 ? "L2" : "Cosine") << " distances..." << std::endl;
+    const DimensionType dim = 64;
+    const SizeType count = 100;
+    bool cosine = p_method == DistCalcMethod::Cosine;
+    auto data = MakeData(count, dim, cosine);
+    float maxAbs = 0;
+    for (SizeType i = 0; i < count; i++) maxAbs = (std::max)(maxAbs, SQ8Quantizer::MaxAbs(data.data() + (size_t)i * dim, dim));
+    SQ8Quantizer quantizer(dim, p_method, 1, maxAbs);
+    auto distance = quantizer.DistanceFunction();
+    auto exact = DistanceCalcSelector<float>(p_method);
+
+    std::vector<std::int8_t> codes((size_t)count * dim);
+    for (SizeType i = 0; i < count; i++) quantizer.Encode(data.data() + (size_t)i * dim, codes.data() + (size_t)i * dim);
+
+    // a distance of 0 (L2) or of 1 (Cosine, orthogonal) may shift by a few quantization steps
+    float tolerance = cosine ? 0.02f : 0.02f * (float)dim * maxAbs * maxAbs / 3;
+    for (SizeType i = 1; i < count; i++) {
+        float want = exact(data.data(), data.data() + (size_t)i * dim, dim);
+        float got = distance(codes.data(), codes.data() + (size_t)i * dim, dim);
+        if (std::fabs(want - got) > tolerance) {
+            std::cerr << "  FAILED: vector " << i << " quantized distance " << got << " vs exact " << want << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "SQ8 Quantizer Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestEncodeDecode();
+    testPassed = TestDistance(DistCalcMethod::L2) && testPassed;
+    testPassed = TestDistance(DistCalcMethod::Cosine) && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
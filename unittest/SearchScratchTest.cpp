@@ -0,0 +1,86 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/IExtraSearcher.h"
+#include "Core/Common/QueryResultSet.h"
+
+#include <iostream>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: a pooled set keeps its array across queries and comes back empty and retargeted
+bool TestReuse() {
+    std::cout << "  Testing result set reuse..." << std::endl;
+    ExtraWorkSpace workspace;
+    std::vector<float> first(8, 1.0f), second(8, 2.0f);
+
+    auto* results = (COMMON::QueryResultSet<float>*)&workspace.PooledResult(0, first.data(), 16);
+    BasicResult* array = results->GetResults();
+    for (int i = 0; i < 16; i++) results->AddPoint(i, (float)(16 - i));
+    results->SetDeadline(std::chrono::steady_clock::now());
+
+    results = (COMMON::QueryResultSet<float>*)&workspace.PooledResult(0, second.data(), 16);
+    if (results->GetResults() != array || results->GetTarget() != second.data()) {
+        std::cerr << "  FAILED: pooled set reallocated or kept the old target" << std::endl;
+        return false;
+    }
+    if (results->HasDeadline()) {
+        std::cerr << "  FAILED: deadline of the previous query kept" << std::endl;
+        return false;
+    }
+    for (int i = 0; i < 16; i++) {
+        if (results->GetResult(i)->VID != -1 || results->GetResult(i)->Dist != MaxDist) {
+            std::cerr << "  FAILED: result " << i << " not reset" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: slots are independent and resize when the internal result number changes
+bool TestSlots() {
+    std::cout << "  Testing result set slots..." << std::endl;
+    ExtraWorkSpace workspace;
+    float target = 0;
+    QueryResult& slot0 = workspace.PooledResult(0, &target, 4);
+    QueryResult& slot3 = workspace.PooledResult(3, &target, 4);
+    if (&slot0 == &slot3 || workspace.m_resultPool.size() != 4) {
+        std::cerr << "  FAILED: slots share a set or the pool did not grow" << std::endl;
+        return false;
+    }
+    slot0.SetResult(0, 7, 1.0f);
+    workspace.PooledResult(3, &target, 4);
+    if (slot0.GetResult(0)->VID != 7) {
+        std::cerr << "  FAILED: reusing a slot reset another one" << std::endl;
+        return false;
+    }
+    if (workspace.PooledResult(0, &target, 32).GetResultNum() != 32) {
+        std::cerr << "  FAILED: pooled set not resized" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Search Scratch Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestReuse();
+    testPassed = TestSlots() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
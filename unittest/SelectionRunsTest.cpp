@@ -0,0 +1,124 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/SelectionRuns.h"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static Edge MakeEdge(SizeType p_node, float p_distance, SizeType p_tonode) {
+    Edge edge;
+    edge.node = p_node;
+    edge.distance = p_distance;
+    edge.tonode = p_tonode;
+    return edge;
+}
+
+// Test 1: runs spilled in random order merge into the fully sorted edge list, one call per head
+bool TestMergeOrder() {
+    std::cout << "  Testing k-way merge..." << std::endl;
+    std::mt19937 rng(7);
+    std::vector<Edge> all;
+    const SizeType heads = 500;
+    for (SizeType v = 0; v < 30000; v++) {
+        for (int r = 0; r < 3; r++) all.push_back(MakeEdge((SizeType)(rng() % heads), (float)(rng() % 1000), v));
+    }
+
+    SelectionRuns runs(".");
+    // uneven runs, one larger than a read buffer
+    size_t bounds[] = {0, 100, 100 + SelectionRuns::kReadEdges + 5, 80000, all.size()};
+    for (int b = 0; b + 1 < 5; b++) {
+        std::vector<Edge> run(all.begin() + bounds[b], all.begin() + bounds[b + 1]);
+        if (runs.AddRun(run) != ErrorCode::Success) {
+            std::cerr << "  FAILED: cannot spill run " << b << std::endl;
+            return false;
+        }
+    }
+    std::sort(all.begin(), all.end(), EdgeCompare());
+
+    std::vector<Edge> merged;
+    SizeType lastNode = -1;
+    bool ordered = true;
+    ErrorCode ret = runs.Merge([&](SizeType p_node, const Edge* p_edges, size_t p_count) {
+        if (p_node <= lastNode)
+            ordered = false;
+        lastNode = p_node;
+        for (size_t i = 0; i < p_count; i++) {
+            if (p_edges[i].node != p_node)
+                ordered = false;
+            merged.push_back(p_edges[i]);
+        }
+        return true;
+    });
+    if (ret != ErrorCode::Success || !ordered || merged.size() != all.size()) {
+        std::cerr << "  FAILED: merge returned " << (int)ret << " with " << merged.size() << " of " << all.size() << " edges" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < all.size(); i++) {
+        if (merged[i].node != all[i].node || merged[i].distance != all[i].distance || merged[i].tonode != all[i].tonode) {
+            std::cerr << "  FAILED: edge " << i << " out of order" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED (" << runs.RunCount() << " runs)" << std::endl;
+    return true;
+}
+
+// Test 2: a callback returning false stops the merge
+bool TestMergeStop() {
+    std::cout << "  Testing merge abort..." << std::endl;
+    SelectionRuns runs(".");
+    std::vector<Edge> run = {MakeEdge(2, 1.0f, 0), MakeEdge(1, 1.0f, 1), MakeEdge(3, 1.0f, 2)};
+    runs.AddRun(run);
+    int calls = 0;
+    ErrorCode ret = runs.Merge([&](SizeType, const Edge*, size_t) { return ++calls < 2; });
+    if (ret != ErrorCode::ExternalAbort || calls != 2) {
+        std::cerr << "  FAILED: merge went on for " << calls << " heads" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: two sorts sharing the temp directory keep their runs apart
+bool TestSharedTmpDir() {
+    std::cout << "  Testing shared temp directory..." << std::endl;
+    SelectionRuns first("."), second(".");
+    std::vector<Edge> a = {MakeEdge(1, 1.0f, 10)}, b = {MakeEdge(2, 2.0f, 20), MakeEdge(3, 3.0f, 30)};
+    first.AddRun(a);
+    second.AddRun(b);
+    size_t firstEdges = 0, secondEdges = 0;
+    first.Merge([&](SizeType node, const Edge*, size_t count) { firstEdges += (node == 1) ? count : 100; return true; });
+    second.Merge([&](SizeType node, const Edge*, size_t count) { secondEdges += (node != 1) ? count : 100; return true; });
+    if (firstEdges != 1 || secondEdges != 2) {
+        std::cerr << "  FAILED: merged " << firstEdges << " and " << secondEdges << " edges" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Selection Runs Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestMergeOrder();
+    testPassed = TestMergeStop() && testPassed;
+    testPassed = TestSharedTmpDir() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,136 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/ShardRouter.h"
+
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static const int kDim = 16;
+static const int kShards = 4;
+static const int kClusters = 32;
+static const int kPerCluster = 500;
+static const std::string c_routerFile = "shard_router_test.bin";
+
+// kClusters tight, well separated blobs
+static std::vector<float> MakeData(std::vector<int>& p_cluster) {
+    std::mt19937 rng(7);
+    std::normal_distribution<float> noise(0, 0.05f);
+    std::uniform_real_distribution<float> center(-10, 10);
+    std::vector<float> centers(kClusters * kDim);
+    for (auto& c : centers) c = center(rng);
+    std::vector<float> data;
+    for (int c = 0; c < kClusters; c++) {
+        for (int i = 0; i < kPerCluster; i++) {
+            for (int d = 0; d < kDim; d++) data.push_back(centers[c * kDim + d] + noise(rng));
+            p_cluster.push_back(c);
+        }
+    }
+    return data;
+}
+
+// Test 1: with fewer cells than blobs the shards get balanced parts, a blob stays on one shard
+// and a query is routed to its owner first
+bool TestPlacement() {
+    std::cout << "  Testing placement and routing..." << std::endl;
+    std::vector<int> cluster;
+    std::vector<float> data = MakeData(cluster);
+    SizeType count = (SizeType)cluster.size();
+    ShardRouter router;
+    if (router.Build(data.data(), count, kDim, kShards, 2, DistCalcMethod::L2, 8000) != ErrorCode::Success || router.Cells() != kShards * 2) {
+        std::cerr << "  FAILED: build" << std::endl;
+        return false;
+    }
+    std::vector<int> perShard(kShards, 0), clusterShard(kClusters, -1);
+    for (SizeType i = 0; i < count; i++) {
+        int owner = router.Owner(data.data() + (size_t)i * kDim);
+        perShard[owner]++;
+        if (clusterShard[cluster[i]] < 0)
+            clusterShard[cluster[i]] = owner;
+        else if (clusterShard[cluster[i]] != owner) {
+            std::cerr << "  FAILED: blob " << cluster[i] << " split over shards" << std::endl;
+            return false;
+        }
+    }
+    for (int s = 0; s < kShards; s++) {
+        if (perShard[s] < count / kShards / 2) {
+            std::cerr << "  FAILED: shard " << s << " holds " << perShard[s] << " of " << count << std::endl;
+            return false;
+        }
+    }
+    std::vector<int> shards;
+    for (SizeType i = 0; i < count; i += 97) {
+        router.Route(data.data() + (size_t)i * kDim, 3, shards);
+        if (shards.empty() || shards[0] != router.Owner(data.data() + (size_t)i * kDim) || shards.size() > 3) {
+            std::cerr << "  FAILED: query " << i << " not routed to its owner first" << std::endl;
+            return false;
+        }
+    }
+    router.Route(data.data(), router.Cells(), shards);
+    if ((int)shards.size() != kShards) {
+        std::cerr << "  FAILED: probing every cell reached " << shards.size() << " shards" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a saved router places every vector the same way after loading
+bool TestSaveLoad() {
+    std::cout << "  Testing save and load..." << std::endl;
+    std::vector<int> cluster;
+    std::vector<float> data = MakeData(cluster);
+    std::vector<std::int8_t> quantized(data.size());
+    for (size_t i = 0; i < data.size(); i++) quantized[i] = (std::int8_t)(data[i] * 10);
+    ShardRouter router;
+    router.Build(quantized.data(), (SizeType)cluster.size(), kDim, kShards, 4, DistCalcMethod::Cosine, 4000);
+    if (router.Save(c_routerFile) != ErrorCode::Success) {
+        std::cerr << "  FAILED: save" << std::endl;
+        return false;
+    }
+    ShardRouter loaded;
+    ErrorCode ret = loaded.Load(c_routerFile);
+    std::remove(c_routerFile.c_str());
+    if (ret != ErrorCode::Success || loaded.Shards() != kShards || loaded.Cells() != router.Cells() || loaded.Dimension() != kDim) {
+        std::cerr << "  FAILED: load" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < cluster.size(); i += 13) {
+        if (loaded.Owner(quantized.data() + i * kDim) != router.Owner(quantized.data() + i * kDim)) {
+            std::cerr << "  FAILED: vector " << i << " placed differently" << std::endl;
+            return false;
+        }
+    }
+    std::vector<char> bytes = router.ToBytes();
+    if (loaded.FromBytes(bytes.data(), bytes.size() - 1) == ErrorCode::Success) {
+        std::cerr << "  FAILED: truncated router accepted" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Shard Router Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestPlacement();
+    testPassed = TestSaveLoad() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
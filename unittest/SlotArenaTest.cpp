@@ -0,0 +1,116 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/SlotArena.h"
+
+#include <cstring>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: slots are distinct, aligned to 8 bytes and packed into few slabs
+bool TestAllocate() {
+    std::cout << "  Testing slot allocation..." << std::endl;
+    SlotArena arena;
+    arena.Initialize(7 * sizeof(std::int64_t), 16);
+    std::set<char*> seen;
+    for (int i = 0; i < 100000; i++) {
+        char* slot = (char*)arena.Allocate();
+        if (slot == nullptr || ((std::uintptr_t)slot) % 8 != 0 || !seen.insert(slot).second) {
+            std::cerr << "  FAILED: slot " << i << " invalid or handed out twice" << std::endl;
+            return false;
+        }
+        memset(slot, -1, arena.SlotBytes());
+    }
+    if (arena.ReservedBytes() > 100000 * arena.SlotBytes() + (2 << 20)) {
+        std::cerr << "  FAILED: " << arena.ReservedBytes() << " bytes reserved for 100000 slots" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a retired slot is handed out again only after the quarantine filled up behind it
+bool TestQuarantine() {
+    std::cout << "  Testing retirement quarantine..." << std::endl;
+    SlotArena arena;
+    arena.Initialize(64, 8);
+    void* first = arena.Allocate();
+    std::vector<void*> slots;
+    for (int i = 0; i < 8; i++) slots.push_back(arena.Allocate());
+    arena.Retire(first);
+    for (int i = 0; i < 7; i++) arena.Retire(slots[i]);
+    std::set<void*> fresh;
+    for (int i = 0; i < 1000; i++) fresh.insert(arena.Allocate());
+    if (fresh.count(first) != 0) {
+        std::cerr << "  FAILED: slot reused while still in quarantine" << std::endl;
+        return false;
+    }
+    arena.Retire(slots[7]);
+    if (arena.Allocate() != first) {
+        std::cerr << "  FAILED: oldest retired slot not released" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: concurrent swaps never hand one slot to two owners
+bool TestConcurrent() {
+    std::cout << "  Testing concurrent swaps..." << std::endl;
+    SlotArena arena;
+    arena.Initialize(64, 1024);
+    const int threadNum = 8, rounds = 200000;
+    std::atomic<bool> failed(false);
+    std::vector<std::thread> threads;
+    for (int t = 0; t < threadNum; t++) {
+        threads.emplace_back([&, t]() {
+            std::int64_t* mine = (std::int64_t*)arena.Allocate();
+            *mine = t;
+            for (int r = 0; r < rounds && !failed; r++) {
+                std::int64_t* next = (std::int64_t*)arena.Allocate();
+                if (next == nullptr) {
+                    failed = true;
+                    break;
+                }
+                *next = t;
+                if (*mine != t)
+                    failed = true;
+                arena.Retire(mine);
+                mine = next;
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    if (failed || arena.ReservedBytes() > (size_t)(threadNum * 2 + 1024) * 64 + (size_t)threadNum * (1 << 20)) {
+        std::cerr << "  FAILED: slots shared or the arena kept growing (" << arena.ReservedBytes() << " bytes)" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Slot Arena Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestAllocate();
+    testPassed = TestQuarantine() && testPassed;
+    testPassed = TestConcurrent() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,305 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/PostingSizeRecord.h"
+#include "Core/SPANN/ExtraSPDKController.h"
+#include "Core/SPANN/ExtraUringController.h"
+#include "Core/SPANN/Index.h"
+#include "Core/SPANN/Snapshot.h"
+#include "Helper/SimpleIniReader.h"
+
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static std::string MakeValue(SizeType p_key, int p_version, size_t p_size) {
+    std::string value(p_size, 0);
+    for (size_t i = 0; i < p_size; i++) value[i] = (char)(p_key * 31 + p_version * 7 + i);
+    return value;
+}
+
+static AddressType PagesOf(const std::string& p_value) {
+    return (AddressType)((p_value.size() + PageSize - 1) >> PageSizeEx);
+}
+
+// Test 1: a freeze waits for the scopes in flight, nested scopes on one thread do not wait for
+// themselves, and new scopes wait until the thaw
+bool TestWriteGate() {
+    std::cout << "  Testing write gate..." << std::endl;
+    WriteGate gate;
+    std::atomic<bool> inside{false}, release{false}, frozen{false}, entered{false};
+    std::thread writer([&] {
+        WriteGate::Scope outer(&gate);
+        {
+            WriteGate::Scope nested(&gate);
+            inside = true;
+        }
+        while (!release) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    });
+    while (!inside) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    std::thread freezer([&] {
+        gate.Freeze();
+        frozen = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    bool ok = !frozen;
+    release = true;
+    writer.join();
+    freezer.join();
+    ok = ok && frozen && gate.Frozen();
+
+    std::thread late([&] {
+        WriteGate::Scope scope(&gate);
+        entered = true;
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ok = ok && !entered;
+    gate.Thaw();
+    late.join();
+    ok = ok && entered && !gate.Frozen();
+    {
+        WriteGate::Scope none(nullptr);
+    }
+    if (!ok) {
+        std::cerr << "  FAILED: freeze did not wait for the writer or did not hold the late one" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: the snapshot keeps reading the postings it was taken at while they are rewritten,
+// merged and deleted, its blocks are not reused until it is released, and the written backup
+// opens as a store of its own holding exactly those postings
+bool TestStoreSnapshot() {
+    std::cout << "  Testing store snapshot..." << std::endl;
+    const std::string dataPath = "test_snapshot_live.bin", mappingPath = "test_snapshot_live_mapping";
+    const std::string backupData = "test_snapshot_backup.bin", backupMapping = "test_snapshot_backup_mapping";
+    const SizeType keys = 10;
+    const AddressType maxBlocks = 96;
+    for (auto& path : {dataPath, mappingPath, backupData, backupMapping}) std::filesystem::remove(path);
+
+    bool ok = true;
+    std::thread worker([&] {
+        std::vector<std::string> before(keys), after(keys);
+        std::atomic<std::uint64_t> bytes{0};
+        {
+            auto device = std::make_shared<UringBlockController>(dataPath);
+            SPDKIO store(mappingPath.c_str(), 1024, 1024, 4, 1024, 64, 1, maxBlocks, false, device);
+            for (SizeType key = 0; key < keys; key++) {
+                before[key] = MakeValue(key, 0, 100 + (size_t)key * 1000);
+                ok = ok && store.Put(key, before[key]) == ErrorCode::Success;
+            }
+            ok = ok && store.CreateSnapshot() == ErrorCode::Success && store.CreateSnapshot() != ErrorCode::Success;
+
+            // every key is rewritten a few times: reusing a held block would overwrite the snapshot
+            after = before;
+            for (int version = 1; version <= 3; version++) {
+                for (SizeType key = 3; key < keys; key++) {
+                    after[key] = MakeValue(key, version, 200 + (size_t)key * 900);
+                    ok = ok && store.Put(key, after[key]) == ErrorCode::Success;
+                }
+            }
+            std::string tail = MakeValue(1, 9, 500);
+            after[1] += tail;
+            ok = ok && store.Merge(1, tail) == ErrorCode::Success && store.Delete(2) == ErrorCode::Success;
+            after[2].clear();
+            ok = ok && store.Put(keys, MakeValue(keys, 0, 300)) == ErrorCode::Success;
+
+            std::string value;
+            for (SizeType key = 0; key < keys && ok; key++) {
+                ok = store.ReadSnapshot(key, &value) == ErrorCode::Success && value == before[key];
+                ok = ok && (after[key].empty() ? store.Get(key, &value) != ErrorCode::Success : store.Get(key, &value) == ErrorCode::Success && value == after[key]);
+            }
+            ok = ok && store.ReadSnapshot(keys, &value) != ErrorCode::Success;
+            if (!ok)
+                std::cerr << "  FAILED: snapshot reads changed under the writes" << std::endl;
+
+            ok = ok && store.WriteSnapshot(backupData, backupMapping, &bytes) == ErrorCode::Success;
+            AddressType livePages = PagesOf(MakeValue(keys, 0, 300));
+            AddressType snapshotPages = 0;
+            for (SizeType key = 0; key < keys; key++) {
+                livePages += PagesOf(after[key]);
+                snapshotPages += PagesOf(before[key]);
+            }
+            ok = ok && bytes.load() == (std::uint64_t)snapshotPages * PageSize;
+            // the blocks held for the snapshot come back once it is released
+            AddressType held = maxBlocks - livePages - device->RemainBlocks();
+            store.ReleaseSnapshot();
+            if (!ok || held <= 0 || device->RemainBlocks() != maxBlocks - livePages) {
+                std::cerr << "  FAILED: " << held << " blocks held, " << device->RemainBlocks() << " free after the release, " << (maxBlocks - livePages) << " expected" << std::endl;
+                ok = false;
+            }
+            store.ShutDown();
+        }
+        if (!ok)
+            return;
+        auto device = std::make_shared<UringBlockController>(backupData);
+        SPDKIO backup(backupMapping.c_str(), 1024, 1024, 4, 1024, 64, 1, maxBlocks, false, device);
+        std::string value;
+        for (SizeType key = 0; key < keys && ok; key++) ok = backup.Get(key, &value) == ErrorCode::Success && value == before[key];
+        if (!ok)
+            std::cerr << "  FAILED: the backup does not hold the snapshotted postings" << std::endl;
+        backup.ShutDown();
+    });
+    worker.join();
+    for (auto& path : {dataPath, mappingPath, backupData, backupMapping}) std::filesystem::remove(path);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+// Test 3: a backup taken while inserts and deletes run completes, and every posting in it is as
+// long as the posting size saved with it says, which a backup catching an append halfway breaks
+bool TestOnlineBackup() {
+    std::cout << "  Testing online backup under inserts..." << std::endl;
+    const int dim = 16, base = 2000, inserts = 3000;
+    const std::string dir = "test_snapshot_backup", backupDir = dir + "/backup";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> data((size_t)base * dim), extra((size_t)inserts * dim);
+    for (auto& v : data) v = uniform(rng);
+    for (auto& v : extra) v = uniform(rng);
+    {
+        std::ofstream out(dir + "/vectors.bin", std::ios::binary);
+        out.write((const char*)data.data(), data.size() * sizeof(float));
+    }
+
+    auto index = std::make_shared<SPANN::Index<float>>();
+    index->SetParameter("ValueType", "Float", "Base");
+    index->SetParameter("Dim", std::to_string(dim).c_str(), "Base");
+    index->SetParameter("VectorPath", (dir + "/vectors.bin").c_str(), "Base");
+    index->SetParameter("IndexDirectory", dir.c_str(), "Base");
+    index->SetParameter("DistCalcMethod", "L2", "Base");
+    index->SetParameter("isExecute", "true", "SelectHead");
+    index->SetParameter("SelectHeadType", "BKT", "SelectHead");
+    index->SetParameter("NumberOfThreads", "2", "SelectHead");
+    index->SetParameter("Ratio", "0.1", "SelectHead");
+    index->SetParameter("TreeNumber", "1", "SelectHead");
+    index->SetParameter("BKTKmeansK", "8", "SelectHead");
+    index->SetParameter("BKTLeafSize", "8", "SelectHead");
+    index->SetParameter("isExecute", "true", "BuildHead");
+    index->SetParameter("isExecute", "true", "BuildSSDIndex");
+    index->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    index->SetParameter("NumberOfThreads", "2", "BuildSSDIndex");
+    index->SetParameter("ExcludeHead", "true", "BuildSSDIndex");
+    index->SetParameter("UseDirectIO", "false", "BuildSSDIndex");
+    index->SetParameter("StorageBackend", "Uring", "BuildSSDIndex");
+    index->SetParameter("UringFilePath", (dir + "/postings.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SpdkMappingPath", (dir + "/mapping.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SsdInfoFile", (dir + "/ssdinfo.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("PostingPageLimit", "4", "BuildSSDIndex");
+    index->SetParameter("SpdkCapacity", std::to_string((base + inserts) * 4).c_str(), "BuildSSDIndex");
+    index->SetParameter("SearchInternalResultNum", "16", "BuildSSDIndex");
+    index->SetParameter("Update", "true", "BuildSSDIndex");
+    index->SetParameter("AppendThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("InsertThreadNum", "1", "BuildSSDIndex");
+    if (index->BuildIndex(false) != ErrorCode::Success) {
+        std::cerr << "  FAILED: BuildIndex" << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    std::thread worker([&] {
+        index->Initialize();
+        std::atomic<int> inserted{0};
+        std::thread inserter([&] {
+            index->Initialize();
+            for (int i = 0; i < inserts; i++) {
+                index->AddIndex(extra.data() + (size_t)i * dim, 1, dim, nullptr);
+                if (i % 10 == 0)
+                    index->DeleteIndex((SizeType)i);
+                inserted++;
+            }
+            index->ExitBlockController();
+        });
+        while (inserted < inserts / 3) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        ErrorCode ret = index->BeginBackup(backupDir);
+        ErrorCode busy = index->BeginBackup(backupDir);
+        ret = ret == ErrorCode::Success ? index->WaitBackup() : ret;
+        int insertedAtEnd = inserted;
+        inserter.join();
+        std::uint64_t bytes = 0;
+        bool running = true;
+        index->GetBackupProgress(bytes, running);
+        if (ret != ErrorCode::Success || running || bytes == 0) {
+            std::cerr << "  FAILED: backup ended with " << (int)ret << ", " << bytes << " bytes" << std::endl;
+            ok = false;
+        }
+        if (busy != ErrorCode::IndexBusy && busy != ErrorCode::Success)
+            ok = false;
+        std::cout << "  " << insertedAtEnd << " of " << inserts << " inserts done when the backup completed" << std::endl;
+        index->ExitBlockController();
+    });
+    worker.join();
+    index.reset();
+
+    Helper::IniReader manifest;
+    if (ok && (manifest.LoadIniFile(backupDir + "/backup.ini") != ErrorCode::Success || !manifest.GetParameter("Backup", "Complete", false) ||
+               !manifest.DoesParameterExist("Backup", "WALLSN") || !std::filesystem::exists(backupDir + "/HeadIndex/indexloader.ini") ||
+               !std::filesystem::exists(manifest.GetParameter("Base", "DeletedIDs", std::string())))) {
+        std::cerr << "  FAILED: the manifest or the files it names are missing" << std::endl;
+        ok = false;
+    }
+    if (ok) {
+        COMMON::PostingSizeRecord sizes;
+        ok = sizes.Load(manifest.GetParameter("BuildSSDIndex", "SsdInfoFile", std::string()), 1024, 1024 * 1024) == ErrorCode::Success;
+        const int entryBytes = dim * sizeof(float) + sizeof(int) + sizeof(uint8_t);
+        SizeType postings = 0, mismatched = 0;
+        std::thread reader([&] {
+            auto device = std::make_shared<UringBlockController>(manifest.GetParameter("BuildSSDIndex", "UringFilePath", std::string()));
+            SPDKIO backup(manifest.GetParameter("BuildSSDIndex", "SpdkMappingPath", std::string()).c_str(), 1024, 1024 * 1024, 7, 1024, 64, 1, BlockDevice::kMaxNumBlocks, false, device);
+            std::string value;
+            for (SizeType i = 0; ok && i < sizes.GetPostingNum(); i++) {
+                if (sizes.GetSize(i) <= 0)
+                    continue;
+                postings++;
+                if (backup.Get(i, &value) != ErrorCode::Success || value.size() != (size_t)sizes.GetSize(i) * entryBytes)
+                    mismatched++;
+            }
+            backup.ShutDown();
+        });
+        reader.join();
+        if (!ok || postings == 0 || mismatched != 0) {
+            std::cerr << "  FAILED: " << mismatched << " of " << postings << " backed up postings disagree with their sizes" << std::endl;
+            ok = false;
+        }
+    }
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Snapshot Backup Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestWriteGate();
+    testPassed = TestStoreSnapshot() && testPassed;
+    testPassed = TestOnlineBackup() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
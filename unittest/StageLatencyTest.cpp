@@ -0,0 +1,131 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/StageLatency.h"
+
+#include <cmath>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: every value falls in a bucket whose range holds it, and the buckets tile the axis
+bool TestBuckets() {
+    std::cout << "  Testing histogram buckets..." << std::endl;
+    for (std::uint64_t v : {0ull, 1ull, 15ull, 16ull, 31ull, 32ull, 33ull, 1000ull, 123456789ull, (1ull << 47) + 5}) {
+        int b = StageBuckets::Of(v);
+        if (b < 0 || b >= StageBuckets::kCount || StageBuckets::Low(b) > v || StageBuckets::Low(b) + StageBuckets::Width(b) <= v) {
+            std::cerr << "  FAILED: value " << v << " in bucket " << b << std::endl;
+            return false;
+        }
+    }
+    for (int b = 0; b + 1 < StageBuckets::kCount; b++) {
+        if (StageBuckets::Low(b) + StageBuckets::Width(b) != StageBuckets::Low(b + 1)) {
+            std::cerr << "  FAILED: gap after bucket " << b << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: samples recorded by several threads at once all show up, percentiles land within the
+// bucket precision, and a reset starts a new interval without touching the totals
+bool TestRecorder() {
+    std::cout << "  Testing concurrent recording..." << std::endl;
+    if (!kStageTiming) {
+        std::cout << "  SKIPPED: stage timing compiled out" << std::endl;
+        return true;
+    }
+    StageRecorder recorder;
+    const int threads = 8, samples = 10000;
+    const std::uint64_t slow = (std::uint64_t)(Tsc::TicksPerUs() * 5000), fast = (std::uint64_t)(Tsc::TicksPerUs() * 50);
+    std::vector<std::thread> workers;
+    for (int t = 0; t < threads; t++) {
+        workers.emplace_back([&] {
+            for (int i = 0; i < samples; i++) recorder.Record(Stage::AppendIO, i % 100 == 0 ? slow : fast);
+        });
+    }
+    for (auto& worker : workers) worker.join();
+    StageSnapshot snapshot = recorder.Take();
+    double p50 = snapshot.PercentileUs(Stage::AppendIO, 0.5), p995 = snapshot.PercentileUs(Stage::AppendIO, 0.995);
+    if (snapshot.Count(Stage::AppendIO) != (std::uint64_t)threads * samples || snapshot.Count(Stage::Split) != 0) {
+        std::cerr << "  FAILED: " << snapshot.Count(Stage::AppendIO) << " samples" << std::endl;
+        return false;
+    }
+    if (std::fabs(p50 - 50) > 50 / 16.0 || std::fabs(p995 - 5000) > 5000 / 16.0 || std::fabs(snapshot.MeanUs(Stage::AppendIO) - 99.5) > 1) {
+        std::cerr << "  FAILED: P50 " << p50 << " us, P99.5 " << p995 << " us, mean " << snapshot.MeanUs(Stage::AppendIO) << " us" << std::endl;
+        return false;
+    }
+    std::vector<std::uint64_t> cumulative = snapshot.CumulativeCounts(Stage::AppendIO, {16, 64, 1 << 20});
+    if (cumulative[0] != 0 || cumulative[1] != (std::uint64_t)threads * samples / 100 * 99 || cumulative[2] != (std::uint64_t)threads * samples) {
+        std::cerr << "  FAILED: cumulative counts " << cumulative[0] << " " << cumulative[1] << " " << cumulative[2] << std::endl;
+        return false;
+    }
+    recorder.Reset();
+    recorder.Record(Stage::AppendIO, fast);
+    if (recorder.Take().Count(Stage::AppendIO) != 1 || recorder.Take(false).Count(Stage::AppendIO) != (std::uint64_t)threads * samples + 1) {
+        std::cerr << "  FAILED: reset" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: spans add to the operation of the calling thread only while one is set, and a query
+// records one sample of each search stage
+bool TestSpans() {
+    std::cout << "  Testing stage spans..." << std::endl;
+    if (!kStageTiming) {
+        std::cout << "  SKIPPED: stage timing compiled out" << std::endl;
+        return true;
+    }
+    StageTicks ticks;
+    {
+        StageSpan unset(Stage::IOWait);
+    }
+    {
+        StageTicksScope scope(&ticks);
+        StageSpan span(Stage::IOWait);
+        std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    }
+    AddStageTicks(Stage::PostingScan, 1000);
+    if (CurrentStageTicks() != nullptr || ticks.Us(Stage::IOWait) < 1500 || ticks.m_ticks[(int)Stage::PostingScan] != 0) {
+        std::cerr << "  FAILED: span added " << ticks.Us(Stage::IOWait) << " us" << std::endl;
+        return false;
+    }
+    StageRecorder recorder;
+    recorder.RecordQuery(ticks);
+    StageSnapshot snapshot = recorder.Take();
+    for (int s = 0; s < kStages; s++) {
+        if (snapshot.Count((Stage)s) != (s < kSearchStages ? 1u : 0u)) {
+            std::cerr << "  FAILED: query samples of " << StageName(s) << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Stage Latency Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestBuckets();
+    testPassed = TestRecorder() && testPassed;
+    testPassed = TestSpans() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,77 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Helper/TaskScheduler.h"
+
+#include <atomic>
+#include <iostream>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::Helper;
+
+// Test 1: every index of the range is visited once, whatever the grain and arena layout
+bool TestParallelFor() {
+    std::cout << "  Testing parallel for..." << std::endl;
+    const SizeType count = 100003;
+    for (bool numa : {false, true}) {
+        TaskScheduler::Instance().Configure(4, numa);
+        for (SizeType grain : {1, 1024}) {
+            std::vector<std::atomic<int>> visits(count);
+            TaskScheduler::Instance().ParallelFor<SizeType>(7, count, grain, [&](SizeType i) { visits[i]++; });
+            for (SizeType i = 0; i < count; i++) {
+                if (visits[i].load() != (i < 7 ? 0 : 1)) {
+                    std::cerr << "  FAILED: index " << i << " visited " << visits[i].load() << " times" << std::endl;
+                    return false;
+                }
+            }
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: loops started from inside tasks run in the same arena and finish before the task does
+bool TestNested() {
+    std::cout << "  Testing nested loops..." << std::endl;
+    TaskScheduler::Instance().Configure(4, false);
+    const int tasks = 8, inner = 5000;
+    std::vector<std::atomic<int>> sums(tasks);
+    std::vector<int> seen(tasks, 0);
+    TaskScheduler::Instance().Run(tasks, [&](int task) {
+        TaskScheduler::Instance().ParallelFor<int>(0, inner, 64, [&](int) { sums[task]++; });
+        seen[task] = sums[task].load();
+    });
+    for (int t = 0; t < tasks; t++) {
+        if (seen[t] != inner) {
+            std::cerr << "  FAILED: task " << t << " saw " << seen[t] << " of " << inner << std::endl;
+            return false;
+        }
+    }
+    if (TaskScheduler::Instance().Concurrency() != 4) {
+        std::cerr << "  FAILED: concurrency " << TaskScheduler::Instance().Concurrency() << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Task Scheduler Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestParallelFor();
+    testPassed = TestNested() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
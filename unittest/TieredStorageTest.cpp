@@ -0,0 +1,229 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/QueryResultSet.h"
+#include "Core/SPANN/ExtraUringController.h"
+#include "Core/SPANN/Index.h"
+#include "Core/SPANN/PostingCache.h"
+#include "Core/SPANN/TieredStorage.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: resident entries survive CLOCK pressure, are dropped by a write of their key and by
+// Unpin, and stay within their own budget
+bool TestResidentEntries() {
+    std::cout << "  Testing resident posting cache entries..." << std::endl;
+    PostingCache cache;
+    cache.SetCapacity(8192, 1);
+    cache.SetResidentCapacity(8192, 1);
+    std::string page(4096, 'r');
+    bool ok = cache.Pin(1, page.data(), page.size(), cache.Generation(1)) && cache.Pin(2, page.data(), page.size(), cache.Generation(2));
+    ok = ok && !cache.Pin(3, page.data(), page.size(), cache.Generation(3));
+    for (SizeType key = 10; key < 20; key++) cache.Insert(key, page.data(), page.size(), cache.Generation(key));
+    ok = ok && cache.Find(1) != nullptr && cache.Find(2) != nullptr && cache.Resident(1) && cache.ResidentBytes() == 8192;
+    // a read racing a write must not pin stale content
+    std::uint64_t generation = cache.Generation(3);
+    cache.Erase(2);
+    cache.Erase(3);
+    ok = ok && !cache.Resident(2) && !cache.Pin(3, page.data(), page.size(), generation);
+    cache.Unpin(1);
+    ok = ok && !cache.Resident(1) && cache.ResidentBytes() == 0;
+    if (!ok) {
+        std::cerr << "  FAILED: resident entries" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: blocks go to the tier of the TierScope and spill over when it is full, reads and writes
+// are translated to the tier's own addresses, also for a posting spanning both tiers
+bool TestTieredDevice() {
+    std::cout << "  Testing tiered block device..." << std::endl;
+    const std::string fast = "test_tier_fast.bin", capacity = "test_tier_capacity.bin";
+    bool ok = true;
+    std::thread worker([&] {
+        std::vector<std::shared_ptr<BlockDevice>> devices = {std::make_shared<UringBlockController>(fast), std::make_shared<UringBlockController>(capacity)};
+        TieredBlockDevice device(devices, {16, 0});
+        if (!device.Initialize(64, 64) || device.MaxBlocks() != 80 || device.Tiers() != 2) {
+            std::cerr << "  FAILED: initialize" << std::endl;
+            ok = false;
+            return;
+        }
+        AddressType row[9];
+        std::string value(3 * PageSize + 100, 0);
+        for (size_t i = 0; i < value.size(); i++) value[i] = (char)(i * 7 + 3);
+        row[0] = (AddressType)value.size();
+        // a head on the capacity tier and a tail on the fast one, as after an append to a moved posting
+        {
+            TierScope scope(1);
+            ok = ok && device.GetBlocks(row + 1, 2);
+        }
+        ok = ok && device.GetBlocks(row + 3, 2) && device.TierOf(row[1]) == 1 && device.TierOf(row[3]) == 0;
+        ok = ok && device.WriteBlocks(row + 1, 4, value);
+        std::string read;
+        ok = ok && device.ReadBlocks(row, &read) && read == value;
+        std::vector<AddressType*> rows(1, row);
+        std::vector<PostingView> views;
+        int done = 0;
+        ok = ok && device.ReadBlocks(rows, &views, [&](int) { done++; }) && done == 1 && views[0].size == row[0] && std::string(views[0].data, views[0].size) == value;
+        device.ReleaseViews(&views);
+
+        // the fast tier is full after 14 more blocks, further ones spill to the capacity tier
+        std::vector<AddressType> blocks(18);
+        ok = ok && device.GetBlocks(blocks.data(), 14) && device.TierFreeBlocks(0) == 0;
+        ok = ok && device.GetBlocks(blocks.data() + 14, 4) && device.TierOf(blocks[14]) == 1;
+        ok = ok && device.ReleaseBlocks(blocks.data(), 18) && device.ReleaseBlocks(row + 1, 4) && device.RemainBlocks() == 80;
+        if (!ok)
+            std::cerr << "  FAILED: tiered reads and writes" << std::endl;
+        device.ShutDown();
+    });
+    worker.join();
+    std::filesystem::remove(fast);
+    std::filesystem::remove(capacity);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+// Test 3: cold postings drain to the capacity tier, the ones searches keep reading come back to
+// the fast tier and the hottest stay resident in DRAM; the search results never change
+bool TestTiering() {
+    std::cout << "  Testing heat driven tiering..." << std::endl;
+    const int dim = 16, base = 3000, queries = 5, k = 10;
+    const std::string dir = "test_tiered_storage";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> data((size_t)base * dim), query((size_t)queries * dim);
+    for (auto& v : data) v = uniform(rng);
+    for (auto& v : query) v = uniform(rng);
+    {
+        std::ofstream out(dir + "/vectors.bin", std::ios::binary);
+        out.write((const char*)data.data(), data.size() * sizeof(float));
+    }
+
+    auto index = std::make_shared<SPANN::Index<float>>();
+    index->SetParameter("ValueType", "Float", "Base");
+    index->SetParameter("Dim", std::to_string(dim).c_str(), "Base");
+    index->SetParameter("VectorPath", (dir + "/vectors.bin").c_str(), "Base");
+    index->SetParameter("IndexDirectory", dir.c_str(), "Base");
+    index->SetParameter("DistCalcMethod", "L2", "Base");
+    index->SetParameter("isExecute", "true", "SelectHead");
+    index->SetParameter("SelectHeadType", "BKT", "SelectHead");
+    index->SetParameter("NumberOfThreads", "2", "SelectHead");
+    index->SetParameter("Ratio", "0.1", "SelectHead");
+    index->SetParameter("TreeNumber", "1", "SelectHead");
+    index->SetParameter("BKTKmeansK", "8", "SelectHead");
+    index->SetParameter("BKTLeafSize", "8", "SelectHead");
+    index->SetParameter("isExecute", "true", "BuildHead");
+    index->SetParameter("isExecute", "true", "BuildSSDIndex");
+    index->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    index->SetParameter("NumberOfThreads", "2", "BuildSSDIndex");
+    index->SetParameter("ExcludeHead", "true", "BuildSSDIndex");
+    index->SetParameter("UseDirectIO", "false", "BuildSSDIndex");
+    index->SetParameter("StorageBackend", "Uring", "BuildSSDIndex");
+    index->SetParameter("UringFilePath", (dir + "/postings.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("CapacityTierPath", (dir + "/capacity.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("ResidentPostingMB", "1", "BuildSSDIndex");
+    index->SetParameter("TieringIntervalMs", "0", "BuildSSDIndex");
+    index->SetParameter("TieringBatch", "100000", "BuildSSDIndex");
+    index->SetParameter("TierPromoteHeat", "2", "BuildSSDIndex");
+    index->SetParameter("TierDemoteHeat", "1", "BuildSSDIndex");
+    index->SetParameter("HeatSampleRate", "1", "BuildSSDIndex");
+    index->SetParameter("SpdkMappingPath", (dir + "/mapping.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("PostingPageLimit", "4", "BuildSSDIndex");
+    index->SetParameter("SpdkCapacity", std::to_string(base * 4).c_str(), "BuildSSDIndex");
+    index->SetParameter("SearchInternalResultNum", "16", "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "2048", "BuildSSDIndex");
+    index->SetParameter("Update", "true", "BuildSSDIndex");
+    index->SetParameter("AppendThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("InsertThreadNum", "1", "BuildSSDIndex");
+    if (index->BuildIndex(false) != ErrorCode::Success) {
+        std::cerr << "  FAILED: BuildIndex" << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    std::thread worker([&] {
+        index->Initialize();
+        auto search = [&](int q) {
+            COMMON::QueryResultSet<float> result(query.data() + (size_t)q * dim, k);
+            result.Reset();
+            index->SearchIndex(result);
+            std::vector<SizeType> vids;
+            for (int i = 0; i < k; i++) vids.push_back(result.GetResult(i)->VID);
+            return vids;
+        };
+        std::vector<std::vector<SizeType>> before;
+        for (int q = 0; q < queries; q++) before.push_back(search(q));
+
+        std::vector<SizeType> postings;
+        size_t resident = 0;
+        index->GetTierState(postings, resident);
+        SizeType total = postings[0] + postings[1];
+        // the probes of the first searches count once, which is within TierDemoteHeat
+        int demoted = index->TierPostings();
+        index->GetTierState(postings, resident);
+        if (postings.size() != 2 || demoted == 0 || postings[1] < total * 9 / 10) {
+            std::cerr << "  FAILED: " << demoted << " postings demoted, " << postings[1] << " of " << total << " on the capacity tier" << std::endl;
+            ok = false;
+        }
+
+        for (int round = 0; round < 40; round++)
+            for (int q = 0; q < queries; q++) search(q);
+        int promoted = index->TierPostings();
+        index->GetTierState(postings, resident);
+        if (promoted == 0 || postings[0] == 0 || resident == 0) {
+            std::cerr << "  FAILED: " << promoted << " postings promoted, " << postings[0] << " on the fast tier, " << resident << " bytes resident" << std::endl;
+            ok = false;
+        }
+        for (int q = 0; q < queries && ok; q++) {
+            if (search(q) != before[q]) {
+                std::cerr << "  FAILED: query " << q << " returned other vectors after the moves" << std::endl;
+                ok = false;
+            }
+        }
+        if (ok)
+            std::cout << "  " << demoted << " demoted, " << promoted << " promoted, " << resident << " bytes resident" << std::endl;
+        index->ExitBlockController();
+    });
+    worker.join();
+    index.reset();
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Tiered Storage Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestResidentEntries();
+    testPassed = TestTieredDevice() && testPassed;
+    testPassed = TestTiering() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
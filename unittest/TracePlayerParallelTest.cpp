@@ -443,6 +443,64 @@ bool TestOperationKindDistribution() {
     return true;
 }
 
+// Test 8: Several loaders over a short read-ahead ring deliver every chunk intact
+bool TestMultiLoaderReadAhead() {
+    std::cout << "  Testing Multi-loader Read-ahead..." << std::endl;
+
+    const std::string testFile = "/tmp/trace_player_readahead_test.bin";
+    const std::uint32_t numVectors = 20000;
+    const std::uint32_t dim = 256;
+    const std::size_t windowSize = 32;
+    const int numThreads = 4;
+
+    CreateTestFile(testFile, numVectors, dim);
+
+    TracePlayer<float> player(testFile, windowSize, TestHash, 3, 3);
+    if (player.GetChunkVectors() * 3 >= numVectors) {
+        std::cerr << "    FAILED: Trace fits in the read-ahead ring, chunks of " << player.GetChunkVectors() << std::endl;
+        std::remove(testFile.c_str());
+        return false;
+    }
+
+    std::vector<std::atomic<int>> seen(numVectors);
+    std::atomic<bool> corrupt{false};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < numThreads; ++t) {
+        threads.emplace_back([&]() {
+            while (auto guard = player.Next()) {
+                const auto& record = **guard;
+                std::size_t seq = record.SequenceNumber();
+                for (std::uint32_t j = 0; j < dim; j += 17) {
+                    if (record.Data()[j] != static_cast<float>(seq * dim + j)) {
+                        corrupt.store(true);
+                    }
+                }
+                seen[seq]++;
+            }
+        });
+    }
+    for (auto& t : threads) {
+        t.join();
+    }
+
+    std::remove(testFile.c_str());
+
+    if (corrupt.load()) {
+        std::cerr << "    FAILED: Record data does not match its sequence number" << std::endl;
+        return false;
+    }
+    for (std::uint32_t i = 0; i < numVectors; ++i) {
+        if (seen[i].load() != 1) {
+            std::cerr << "    FAILED: Vector " << i << " consumed " << seen[i].load() << " times" << std::endl;
+            return false;
+        }
+    }
+
+    std::cout << "    PASSED: " << numVectors << " vectors over " << (numVectors + player.GetChunkVectors() - 1) / player.GetChunkVectors()
+              << " chunks with 3 loaders" << std::endl;
+    return true;
+}
+
 int main(int argc, char* argv[]) {
     std::cout << "======================================" << std::endl;
     std::cout << "TracePlayer Parallel Test Suite" << std::endl;
@@ -467,6 +525,7 @@ int main(int argc, char* argv[]) {
     runTest("HighContention", TestHighContention);
     runTest("GuardLifetimeAndSlotReuse", TestGuardLifetimeAndSlotReuse);
     runTest("OperationKindDistribution", TestOperationKindDistribution);
+    runTest("MultiLoaderReadAhead", TestMultiLoaderReadAhead);
 
     std::cout << "\n======================================" << std::endl;
     std::cout << "Results: " << passed << " passed, " << failed << " failed" << std::endl;
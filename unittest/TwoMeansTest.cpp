@@ -0,0 +1,108 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/Common/TwoMeans.h"
+
+#include <iostream>
+#include <random>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::COMMON;
+
+// p_count vectors, the first half around -p_offset and the second half around +p_offset
+template <typename T>
+static std::vector<T> MakeBlobs(SizeType p_count, DimensionType p_dim, float p_offset, float p_noise) {
+    std::mt19937 rng(5);
+    std::uniform_real_distribution<float> noise(-p_noise, p_noise);
+    std::vector<T> data((size_t)p_count * p_dim);
+    for (SizeType i = 0; i < p_count; i++) {
+        float offset = i < p_count / 2 ? -p_offset : p_offset;
+        for (DimensionType d = 0; d < p_dim; d++) data[(size_t)i * p_dim + d] = (T)(offset + noise(rng));
+    }
+    return data;
+}
+
+template <typename T>
+static std::vector<const void*> Pointers(const std::vector<T>& p_data, SizeType p_count, DimensionType p_dim) {
+    std::vector<const void*> vectors(p_count);
+    for (SizeType i = 0; i < p_count; i++) vectors[i] = p_data.data() + (size_t)i * p_dim;
+    return vectors;
+}
+
+// Test 1: two separated blobs are split along the blob boundary, centers are members of their cluster
+template <typename T>
+bool TestBlobs(DistCalcMethod p_method, float p_offset, float p_noise) {
+    std::cout << "  Testing blobs (" << (p_method == DistCalcMethod::L2 ? "L2" : "Cosine") << ", " << sizeof(T) << " byte values)..." << std::endl;
+    const SizeType count = 300;
+    const DimensionType dim = 32;
+    auto data = MakeBlobs<T>(count, dim, p_offset, p_noise);
+    auto vectors = Pointers(data, count, dim);
+
+    TwoMeans<T> clusterer;
+    clusterer.Initialize(dim, p_method);
+    // cluster twice to check the reused buffers give the same answer
+    for (int round = 0; round < 2; round++) {
+        if (clusterer.Cluster(vectors.data(), count, 16, false) != 2) {
+            std::cerr << "  FAILED: blobs not split" << std::endl;
+            return false;
+        }
+        int first = clusterer.Label(0);
+        for (SizeType i = 0; i < count; i++) {
+            if ((clusterer.Label(i) == first) != (i < count / 2)) {
+                std::cerr << "  FAILED: vector " << i << " in the wrong cluster" << std::endl;
+                return false;
+            }
+        }
+        for (int k = 0; k < 2; k++) {
+            SizeType representative = clusterer.Representative(k);
+            if (representative < 0 || clusterer.Label(representative) != k || clusterer.Count(k) != count / 2 ||
+                !std::equal(clusterer.Center(k), clusterer.Center(k) + dim, data.data() + (size_t)representative * dim)) {
+                std::cerr << "  FAILED: center " << k << " is not a member of its cluster" << std::endl;
+                return false;
+            }
+            if (clusterer.Assign((const T*)vectors[representative]) != k) {
+                std::cerr << "  FAILED: member " << representative << " assigned away from its center" << std::endl;
+                return false;
+            }
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: identical vectors cannot be split
+bool TestIdentical() {
+    std::cout << "  Testing identical vectors..." << std::endl;
+    std::vector<float> data(50 * 8, 0.25f);
+    auto vectors = Pointers(data, 50, 8);
+    TwoMeans<float> clusterer;
+    clusterer.Initialize(8, DistCalcMethod::L2);
+    if (clusterer.Cluster(vectors.data(), 50, 16, false) != 1 || clusterer.Cluster(vectors.data(), 1, 16, false) != 1) {
+        std::cerr << "  FAILED: identical vectors were split" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Two Means Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestBlobs<float>(DistCalcMethod::L2, 1.0f, 0.5f);
+    testPassed = TestBlobs<std::int8_t>(DistCalcMethod::L2, 40.0f, 20.0f) && testPassed;
+    testPassed = TestIdentical() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,134 @@
+#include <iostream>
+#include <vector>
+#include <string>
+#include <cstdio>
+#include "Core/SPANN/ExtraSPDKController.h"
+#include "Core/SPANN/ExtraUringController.h"
+
+using namespace SPTAG;
+
+bool UringBlockControllerTest() {
+    std::cout << "Testing io_uring Block Controller Basic Functionality" << std::endl;
+
+    const char* mappingPath = "test_uring_mapping";
+    const char* devicePath = "test_uring_blocks.bin";
+    std::remove(mappingPath);
+    std::remove(devicePath);
+
+    std::cout << "  Initializing SPDKIO on io_uring..." << std::endl;
+    auto device = std::make_shared<SPANN::UringBlockController>(devicePath, 64, 8, false);
+    std::unique_ptr<SPANN::SPDKIO> db = std::make_unique<SPANN::SPDKIO>(mappingPath, 4096, 10000, 256, 1024, 64, 1, 1 << 16, false, device);
+
+    std::cout << "  Testing Put and Get..." << std::endl;
+    const std::string putData = "Test data for Put/Get operations on the io_uring backend.";
+    std::string getData;
+    if (db->Put(100, putData) != ErrorCode::Success || db->Get(100, &getData) != ErrorCode::Success || getData != putData) {
+        std::cerr << "  FAILED: Put/Get data mismatch" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED: Put/Get data matches correctly" << std::endl;
+
+    std::cout << "  Testing multi-page Put and zero-copy MultiGet..." << std::endl;
+    std::string bigData(3 * 4096 + 100, 0);
+    for (size_t i = 0; i < bigData.size(); i++) bigData[i] = (char)('a' + i % 26);
+    if (db->Put(200, bigData) != ErrorCode::Success) {
+        std::cerr << "  FAILED: multi-page Put failed" << std::endl;
+        return false;
+    }
+    std::vector<SizeType> keys = {100, 200};
+    std::vector<SPANN::PostingView> views;
+    db->MultiGet(keys, &views);
+    bool viewsMatch = views.size() == 2 && std::string(views[0].data, views[0].size) == putData && std::string(views[1].data, views[1].size) == bigData;
+    db->ReleasePostingViews(&views);
+    if (!viewsMatch) {
+        std::cerr << "  FAILED: MultiGet views do not match the stored postings" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED: MultiGet views match" << std::endl;
+
+    std::cout << "  Testing streaming MultiGet..." << std::endl;
+    std::vector<int> done;
+    db->MultiGet(keys, &views, [&](int i) {
+        if (views[i].size == (SPANN::AddressType)(i == 0 ? putData.size() : bigData.size())) done.push_back(i);
+    });
+    db->ReleasePostingViews(&views);
+    if (done.size() != 2) {
+        std::cerr << "  FAILED: callback ran for " << done.size() << " of 2 postings" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED: every posting was handed to the callback" << std::endl;
+
+    std::cout << "  Testing Merge..." << std::endl;
+    const std::string mergeData(5000, 'z');
+    if (db->Merge(100, mergeData) != ErrorCode::Success || db->Get(100, &getData) != ErrorCode::Success || getData != putData + mergeData) {
+        std::cerr << "  FAILED: Merge result mismatch" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED: Merge result matches" << std::endl;
+
+    std::cout << "  Testing BulkPut..." << std::endl;
+    std::vector<SizeType> bulkKeys = {300, 301, 302, 303, 100};
+    std::vector<size_t> bulkBytes = {10, 4096, 0, 2 * 4096 + 1, 77};
+    auto fillByte = [](size_t i, size_t j) { return (char)('A' + (i * 7 + j) % 26); };
+    if (db->BulkPut(bulkKeys, bulkBytes, [&](size_t i, char* dst) {
+            for (size_t j = 0; j < bulkBytes[i]; j++) dst[j] = fillByte(i, j);
+        }) != ErrorCode::Success) {
+        std::cerr << "  FAILED: BulkPut failed" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < bulkKeys.size(); i++) {
+        std::string expected(bulkBytes[i], 0);
+        for (size_t j = 0; j < bulkBytes[i]; j++) expected[j] = fillByte(i, j);
+        if (db->Get(bulkKeys[i], &getData) != ErrorCode::Success || getData != expected) {
+            std::cerr << "  FAILED: bulk loaded key " << bulkKeys[i] << " reads back wrong" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED: bulk loaded postings read back" << std::endl;
+
+    std::cout << "  Testing failed reads..." << std::endl;
+    // a block past the end of the device file reads short, the posting must not come back
+    SPANN::AddressType missing[2] = {4096, 60000};
+    std::vector<SPANN::AddressType*> rows = {missing};
+    std::vector<std::string> values;
+    bool readFailed = !device->ReadBlocks(rows, &values) && values.size() == 1 && values[0].empty();
+    bool callbackRan = false;
+    readFailed = readFailed && !device->ReadBlocks(rows, &views, [&](int) { callbackRan = true; }) && views.size() == 1 && views[0].size == 0 && !callbackRan;
+    device->ReleaseViews(&views);
+    if (!readFailed) {
+        std::cerr << "  FAILED: a short read was handed out as a posting" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED: failed reads are reported" << std::endl;
+
+    std::cout << "  Testing Delete..." << std::endl;
+    if (db->Delete(200) != ErrorCode::Success || db->Get(200, &getData) == ErrorCode::Success) {
+        std::cerr << "  FAILED: deleted key is still readable" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED: Delete succeeded" << std::endl;
+
+    db->ShutDown();
+    std::remove(mappingPath);
+    std::remove(devicePath);
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "io_uring Block Controller Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = UringBlockControllerTest();
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
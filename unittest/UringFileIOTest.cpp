@@ -0,0 +1,150 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Helper/UringFileReader.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+using namespace SPTAG;
+
+static const int c_pages = 64;
+
+// every page of a file holds its file and page number
+static std::string WriteFile(int p_file) {
+    std::string path = "test_uring_file_" + std::to_string(p_file) + ".bin";
+    std::ofstream out(path, std::ios::binary);
+    std::vector<int> page(PageSize / sizeof(int));
+    for (int p = 0; p < c_pages; p++) {
+        for (size_t i = 0; i < page.size(); i++) page[i] = p_file * 100000 + p * 1000 + (int)(i % 1000);
+        out.write((const char*)page.data(), PageSize);
+    }
+    return path;
+}
+
+static bool CheckPages(const char* p_buffer, int p_file, int p_firstPage, int p_pages) {
+    const int* values = (const int*)p_buffer;
+    for (int p = 0; p < p_pages; p++) {
+        for (size_t i = 0; i < PageSize / sizeof(int); i++) {
+            if (values[p * (PageSize / sizeof(int)) + i] != p_file * 100000 + (p_firstPage + p) * 1000 + (int)(i % 1000))
+                return false;
+        }
+    }
+    return true;
+}
+
+struct AlignedFree {
+    void operator()(char* p) { free(p); }
+};
+
+// Test 1: a batch over two files, larger than the rings, lands every page in its buffer whether
+// the buffer is registered or not, and calls each callback once
+bool TestBatchRead() {
+    std::cout << "  Testing batched reads over two files..." << std::endl;
+    const int requests = 40, registered = 20, maxPages = 3, channel = 1;
+    std::vector<std::shared_ptr<Helper::DiskIO>> files;
+    for (int f = 0; f < 2; f++) {
+        std::string path = WriteFile(f);
+        auto file = std::make_shared<Helper::UringFileIO>();
+        if (!file->Initialize(path.c_str(), std::ios::binary | std::ios::in, 8, 2, 2, 2)) {
+            std::cerr << "  FAILED: Initialize " << path << std::endl;
+            return false;
+        }
+        files.push_back(file);
+    }
+
+    std::unique_ptr<char, AlignedFree> block((char*)aligned_alloc(PageSize, (size_t)requests * maxPages * PageSize));
+    std::vector<struct iovec> buffers(registered);
+    for (int i = 0; i < registered; i++) buffers[i] = {block.get() + (size_t)i * maxPages * PageSize, (size_t)maxPages * PageSize};
+    bool ok = true;
+    for (auto& file : files) {
+        auto uring = (Helper::UringFileIO*)file.get();
+        // the second call finds them registered already
+        ok = ok && uring->RegisterBuffers(channel, buffers.data(), registered) && uring->RegisterBuffers(channel, buffers.data(), registered);
+    }
+    if (!ok)
+        std::cout << "  fixed buffers refused, reading without them" << std::endl;
+
+    std::vector<Helper::AsyncReadRequest> batch(requests);
+    std::vector<int> calls(requests, 0);
+    for (int i = 0; i < requests; i++) {
+        auto& request = batch[i];
+        int file = i % 2, pages = 1 + i % maxPages, page = (i * 7) % (c_pages - maxPages);
+        request.m_offset = (std::uint64_t)page * PageSize;
+        request.m_readSize = (std::uint64_t)pages * PageSize;
+        request.m_buffer = block.get() + (size_t)i * maxPages * PageSize;
+        request.m_status = (file << 16) | channel;
+        request.m_bufferIndex = i;
+        request.m_callback = [&calls, &batch, i, file, page, pages](bool success) {
+            calls[i]++;
+            if (!success || !CheckPages(batch[i].m_buffer, file, page, pages))
+                calls[i] = -1000;
+        };
+    }
+    if (!Helper::BatchReadFileUring(files, batch.data(), requests))
+        ok = false;
+    for (int i = 0; i < requests; i++) {
+        if (calls[i] != 1) {
+            std::cerr << "  FAILED: request " << i << (calls[i] < 0 ? " read wrong data" : " was not completed once") << std::endl;
+            ok = false;
+        }
+    }
+    for (auto& file : files) file->ShutDown();
+    for (int f = 0; f < 2; f++) std::remove(("test_uring_file_" + std::to_string(f) + ".bin").c_str());
+    if (!ok)
+        return false;
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: a single read running past the end of the file comes back with the pages before it
+bool TestReadPastEnd() {
+    std::cout << "  Testing a read past the end of the file..." << std::endl;
+    std::string path = WriteFile(0);
+    Helper::UringFileIO file;
+    if (!file.Initialize(path.c_str(), std::ios::binary | std::ios::in, 4, 2, 2, 1)) {
+        std::cerr << "  FAILED: Initialize" << std::endl;
+        return false;
+    }
+    std::unique_ptr<char, AlignedFree> buffer((char*)aligned_alloc(PageSize, 2 * PageSize));
+    Helper::AsyncReadRequest request;
+    request.m_offset = (std::uint64_t)(c_pages - 1) * PageSize;
+    request.m_readSize = 2 * PageSize;
+    request.m_buffer = buffer.get();
+    bool called = false;
+    request.m_callback = [&called](bool success) { called = success; };
+    bool ok = file.ReadFileAsync(request) && called && CheckPages(buffer.get(), 0, c_pages - 1, 1);
+    file.ShutDown();
+    std::remove(path.c_str());
+    if (!ok) {
+        std::cerr << "  FAILED: the last page was not read" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Uring File IO Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestBatchRead();
+    testPassed = TestReadPastEnd() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,184 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/VectorStore.h"
+
+#include <iostream>
+#include <map>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// in-memory store counting the writes that would reach the device
+class MemoryKeyValueIO : public KeyValueIO {
+   public:
+    ErrorCode Get(SizeType key, std::string* value) override {
+        auto it = m_values.find(key);
+        if (it == m_values.end())
+            return ErrorCode::Fail;
+        *value = it->second;
+        return ErrorCode::Success;
+    }
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<std::string>* values, const std::chrono::microseconds& timeout) override {
+        values->clear();
+        for (SizeType key : keys) {
+            auto it = m_values.find(key);
+            values->push_back(it == m_values.end() ? std::string() : it->second);
+        }
+        return ErrorCode::Success;
+    }
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::chrono::microseconds& timeout) override {
+        return ErrorCode::Undefined;
+    }
+    ErrorCode MultiGet(const std::vector<SizeType>& keys, std::vector<PostingView>* values, const std::function<void(int)>& p_onPostingDone, const std::chrono::microseconds& timeout) override {
+        return ErrorCode::Undefined;
+    }
+    void ReleasePostingViews(std::vector<PostingView>* values) override {}
+    ErrorCode Put(SizeType key, const std::string& value) override {
+        m_values[key] = value;
+        m_puts++;
+        return ErrorCode::Success;
+    }
+    ErrorCode Merge(SizeType key, const std::string& value) override {
+        m_values[key] += value;
+        return ErrorCode::Success;
+    }
+    ErrorCode Delete(SizeType key) override {
+        m_values.erase(key);
+        return ErrorCode::Success;
+    }
+    void ForceCompaction() override {}
+    void GetStat() override {}
+    bool Initialize(bool debug) override { return true; }
+    bool ExitBlockController(bool debug) override { return true; }
+    void ShutDown() override {}
+
+    std::map<SizeType, std::string> m_values;
+    int m_puts = 0;
+};
+
+static const int kDim = 128;
+
+static std::vector<float> MakeVector(SizeType p_vid) {
+    std::vector<float> vector(kDim);
+    for (int i = 0; i < kDim; i++) vector[i] = p_vid * 0.5f + i;
+    return vector;
+}
+
+static bool Matches(const float* p_vector, SizeType p_vid) {
+    std::vector<float> expected = MakeVector(p_vid);
+    return memcmp(p_vector, expected.data(), sizeof(float) * kDim) == 0;
+}
+
+// Test 1: ascending inserts write each page group once, when it is full
+bool TestGroupWrites() {
+    std::cout << "  Testing page group writes..." << std::endl;
+    auto io = std::make_shared<MemoryKeyValueIO>();
+    VectorStore store(io, kDim * sizeof(float));
+    int n = store.GroupVectors();
+    if (n != PageSize / (kDim * sizeof(float))) {
+        std::cerr << "  FAILED: " << n << " vectors per group" << std::endl;
+        return false;
+    }
+    for (SizeType vid = 0; vid < 3 * n + 2; vid++) store.Put(vid, MakeVector(vid).data());
+    if (io->m_puts != 3 || store.OpenGroups() != 1) {
+        std::cerr << "  FAILED: " << io->m_puts << " writes for three full groups" << std::endl;
+        return false;
+    }
+    std::vector<float> vector(kDim);
+    // the partial group is served from the buffer
+    if (store.Get(3 * n + 1, vector.data()) != ErrorCode::Success || !Matches(vector.data(), 3 * n + 1) ||
+        store.Get(n + 1, vector.data()) != ErrorCode::Success || !Matches(vector.data(), n + 1)) {
+        std::cerr << "  FAILED: stored vector came back different" << std::endl;
+        return false;
+    }
+    if (store.Get(3 * n + 3, vector.data()) != ErrorCode::VectorNotFound) {
+        std::cerr << "  FAILED: missing vector found" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: flushing a partial group keeps the vectors already on the device
+bool TestPartialFlush() {
+    std::cout << "  Testing partial group flush..." << std::endl;
+    auto io = std::make_shared<MemoryKeyValueIO>();
+    VectorStore store(io, kDim * sizeof(float));
+    store.Put(0, MakeVector(0).data());
+    store.Put(2, MakeVector(2).data());
+    if (store.Flush() != ErrorCode::Success || store.OpenGroups() != 0) {
+        std::cerr << "  FAILED: flush left groups open" << std::endl;
+        return false;
+    }
+    store.Put(1, MakeVector(1).data());
+    store.Put(2, MakeVector(7).data());
+    store.Flush();
+    std::vector<float> vectors(3 * kDim);
+    std::vector<bool> found;
+    if (store.MultiGet({0, 1, 2}, (char*)vectors.data(), found) != ErrorCode::Success || !found[0] || !found[1] || !found[2] ||
+        !Matches(vectors.data(), 0) || !Matches(vectors.data() + kDim, 1) || !Matches(vectors.data() + 2 * kDim, 7)) {
+        std::cerr << "  FAILED: read-modify-write lost a vector" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: too many partial groups push the oldest to the device, range puts write whole groups directly
+bool TestEvictionAndRange() {
+    std::cout << "  Testing eviction and range puts..." << std::endl;
+    auto io = std::make_shared<MemoryKeyValueIO>();
+    int n = PageSize / (kDim * sizeof(float));
+    {
+        VectorStore store(io, kDim * sizeof(float), 2);
+        for (int g = 0; g < 4; g++) store.Put(g * n, MakeVector(g * n).data());
+        if (store.OpenGroups() != 2 || io->m_values.count(0) != 1 || io->m_values.count(1) != 1) {
+            std::cerr << "  FAILED: oldest groups were not written" << std::endl;
+            return false;
+        }
+        std::vector<std::vector<float>> range;
+        for (SizeType vid = 10 * n - 1; vid < 13 * n + 1; vid++) range.push_back(MakeVector(vid));
+        store.PutRange(10 * n - 1, (SizeType)range.size(), [&](SizeType vid) { return (const void*)range[vid - (10 * n - 1)].data(); });
+        if (io->m_values.count(10) != 1 || io->m_values.count(12) != 1 || io->m_values.count(13) != 0) {
+            std::cerr << "  FAILED: range did not write its whole groups" << std::endl;
+            return false;
+        }
+    }
+    // the destructor flushed the rest
+    VectorStore reopened(io, kDim * sizeof(float));
+    std::vector<SizeType> vids = {0, 3 * n, 10 * n - 1, 11 * n + 5, 13 * n};
+    std::vector<float> vectors(vids.size() * kDim);
+    std::vector<bool> found;
+    reopened.MultiGet(vids, (char*)vectors.data(), found);
+    for (size_t i = 0; i < vids.size(); i++) {
+        if (!found[i] || !Matches(vectors.data() + i * kDim, vids[i])) {
+            std::cerr << "  FAILED: vector " << vids[i] << " lost" << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Vector Store Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestGroupWrites();
+    testPassed = TestPartialFlush() && testPassed;
+    testPassed = TestEvictionAndRange() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
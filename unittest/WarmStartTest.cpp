@@ -0,0 +1,172 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/BKT/Index.h"
+#include "Core/Common/PostingSizeRecord.h"
+#include "Core/Common/QueryResultSet.h"
+#include "Core/SPANN/Index.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+// Test 1: prefaulting mapped posting sizes leaves them as they were
+bool TestPrefault() {
+    std::cout << "  Testing prefault of mapped records..." << std::endl;
+    const std::string path = "test_warm_sizes.bin";
+    std::filesystem::remove(path);
+    bool ok = true;
+    {
+        COMMON::PostingSizeRecord sizes;
+        ok = sizes.Map(path, 5000, 1024, 8192, true) == ErrorCode::Success;
+        for (SizeType i = 0; ok && i < 5000; i++) sizes.UpdateSize(i, i % 97);
+        sizes.Prefault();
+        for (SizeType i = 0; ok && i < 5000; i++) ok = sizes.GetSize(i) == i % 97;
+    }
+    std::filesystem::remove(path);
+    if (!ok) {
+        std::cerr << "  FAILED: mapped sizes" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: the head index saved by a build loads back through the parallel load with the same
+// vectors, and the postings listed by SaveWarmPostings are read into the cache by WarmStart
+// without changing search results
+bool TestWarmStart() {
+    std::cout << "  Testing warm start..." << std::endl;
+    const int dim = 16, base = 3000, queries = 5, k = 10;
+    const std::string dir = "test_warm_start";
+    std::filesystem::remove_all(dir);
+    std::filesystem::create_directory(dir);
+
+    std::mt19937 rng(11);
+    std::uniform_real_distribution<float> uniform(-1.0f, 1.0f);
+    std::vector<float> data((size_t)base * dim), query((size_t)queries * dim);
+    for (auto& v : data) v = uniform(rng);
+    for (auto& v : query) v = uniform(rng);
+    {
+        std::ofstream out(dir + "/vectors.bin", std::ios::binary);
+        out.write((const char*)data.data(), data.size() * sizeof(float));
+    }
+
+    auto index = std::make_shared<SPANN::Index<float>>();
+    index->SetParameter("ValueType", "Float", "Base");
+    index->SetParameter("Dim", std::to_string(dim).c_str(), "Base");
+    index->SetParameter("VectorPath", (dir + "/vectors.bin").c_str(), "Base");
+    index->SetParameter("IndexDirectory", dir.c_str(), "Base");
+    index->SetParameter("DistCalcMethod", "L2", "Base");
+    index->SetParameter("isExecute", "true", "SelectHead");
+    index->SetParameter("SelectHeadType", "BKT", "SelectHead");
+    index->SetParameter("NumberOfThreads", "2", "SelectHead");
+    index->SetParameter("Ratio", "0.1", "SelectHead");
+    index->SetParameter("TreeNumber", "1", "SelectHead");
+    index->SetParameter("BKTKmeansK", "8", "SelectHead");
+    index->SetParameter("BKTLeafSize", "8", "SelectHead");
+    index->SetParameter("isExecute", "true", "BuildHead");
+    index->SetParameter("isExecute", "true", "BuildSSDIndex");
+    index->SetParameter("BuildSsdIndex", "true", "BuildSSDIndex");
+    index->SetParameter("NumberOfThreads", "2", "BuildSSDIndex");
+    index->SetParameter("ExcludeHead", "true", "BuildSSDIndex");
+    index->SetParameter("UseDirectIO", "false", "BuildSSDIndex");
+    index->SetParameter("StorageBackend", "Uring", "BuildSSDIndex");
+    index->SetParameter("UringFilePath", (dir + "/postings.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SpdkMappingPath", (dir + "/mapping.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("SpdkPostingCacheMB", "4", "BuildSSDIndex");
+    index->SetParameter("HeatSampleRate", "1", "BuildSSDIndex");
+    index->SetParameter("WarmPostingFile", (dir + "/warm.bin").c_str(), "BuildSSDIndex");
+    index->SetParameter("WarmStartPrefault", "true", "BuildSSDIndex");
+    index->SetParameter("PostingPageLimit", "4", "BuildSSDIndex");
+    index->SetParameter("SpdkCapacity", std::to_string(base * 4).c_str(), "BuildSSDIndex");
+    index->SetParameter("SearchInternalResultNum", "16", "BuildSSDIndex");
+    index->SetParameter("MaxCheck", "2048", "BuildSSDIndex");
+    index->SetParameter("Update", "true", "BuildSSDIndex");
+    index->SetParameter("AppendThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("ReassignThreadNum", "1", "BuildSSDIndex");
+    index->SetParameter("InsertThreadNum", "1", "BuildSSDIndex");
+    if (index->BuildIndex(false) != ErrorCode::Success) {
+        std::cerr << "  FAILED: BuildIndex" << std::endl;
+        return false;
+    }
+
+    bool ok = true;
+    std::shared_ptr<BKT::Index<float>> head;
+    if (BKT::Index<float>::LoadIndex(dir + "/HeadIndex", head) != ErrorCode::Success || head->GetNumSamples() != index->GetMemoryIndex()->GetNumSamples() ||
+        memcmp(head->GetSample(head->GetNumSamples() - 1), index->GetMemoryIndex()->GetSample(head->GetNumSamples() - 1), sizeof(float) * dim) != 0) {
+        std::cerr << "  FAILED: head index load" << std::endl;
+        ok = false;
+    }
+
+    std::thread worker([&] {
+        index->Initialize();
+        auto search = [&](int q) {
+            COMMON::QueryResultSet<float> result(query.data() + (size_t)q * dim, k);
+            result.Reset();
+            index->SearchIndex(result);
+            std::vector<SizeType> vids;
+            for (int i = 0; i < k; i++) vids.push_back(result.GetResult(i)->VID);
+            return vids;
+        };
+        std::vector<std::vector<SizeType>> before;
+        for (int q = 0; q < queries; q++) before.push_back(search(q));
+
+        SizeType listed = 0;
+        if (index->SaveWarmPostings(dir + "/warm.bin") == ErrorCode::Success) {
+            std::ifstream in(dir + "/warm.bin", std::ios::binary);
+            in.read((char*)&listed, sizeof(listed));
+        }
+        index->WarmStart();
+        index->WaitWarmStart();
+        SizeType warmed = 0, total = 0;
+        bool running = true;
+        index->GetWarmStartProgress(warmed, total, running);
+        if (listed == 0 || total != listed || warmed != total || running) {
+            std::cerr << "  FAILED: " << listed << " postings listed, " << warmed << " of " << total << " warmed" << std::endl;
+            ok = false;
+        }
+        for (int q = 0; q < queries && ok; q++) {
+            if (search(q) != before[q]) {
+                std::cerr << "  FAILED: query " << q << " returned other vectors after the warm start" << std::endl;
+                ok = false;
+            }
+        }
+        if (ok)
+            std::cout << "  " << warmed << " postings warmed" << std::endl;
+        index->ExitBlockController();
+    });
+    worker.join();
+    head.reset();
+    index.reset();
+    std::filesystem::remove_all(dir);
+    if (ok)
+        std::cout << "  PASSED" << std::endl;
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Warm Start Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestPrefault();
+    testPassed = TestWarmStart() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
@@ -0,0 +1,201 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Helper/WorkStealingThreadPool.h"
+
+#include <chrono>
+#include <iostream>
+#include <set>
+#include <thread>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::Helper;
+
+static std::atomic<int> g_executed{0};
+
+// runs once and, while p_children > 0, adds two children from the worker
+class CountJob : public PooledJob<CountJob> {
+   public:
+    CountJob(WorkStealingThreadPool* p_pool, int p_children) : m_pool(p_pool), m_children(p_children) {}
+
+    void exec(IAbortOperation* p_abort) override {
+        g_executed++;
+        if (m_children > 0) {
+            m_pool->add(new CountJob(m_pool, m_children - 1), 1);
+            m_pool->add(new CountJob(m_pool, m_children - 1), 2);
+        }
+    }
+
+   private:
+    WorkStealingThreadPool* m_pool;
+    int m_children;
+};
+
+class RecordJob : public PooledJob<RecordJob> {
+   public:
+    RecordJob(std::mutex* p_lock, std::vector<int>* p_order, int p_priority) : m_lock(p_lock), m_order(p_order), m_priority(p_priority) {}
+
+    void exec(IAbortOperation* p_abort) override {
+        std::lock_guard<std::mutex> lock(*m_lock);
+        m_order->push_back(m_priority);
+    }
+
+   private:
+    std::mutex* m_lock;
+    std::vector<int>* m_order;
+    int m_priority;
+};
+
+class GateJob : public ThreadPool::Job {
+   public:
+    GateJob(std::atomic<bool>* p_open) : m_open(p_open) {}
+
+    void exec(IAbortOperation* p_abort) override {
+        while (!m_open->load()) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+   private:
+    std::atomic<bool>* m_open;
+};
+
+static bool WaitClear(WorkStealingThreadPool& p_pool) {
+    for (int i = 0; i < 10000 && !p_pool.allClear(); i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    return p_pool.allClear();
+}
+
+// Test 1: jobs added from many threads and from the workers all run exactly once
+bool TestAllJobsRun() {
+    std::cout << "  Testing job execution..." << std::endl;
+    WorkStealingThreadPool pool;
+    std::atomic<int> started{0}, finished{0};
+    pool.init(4, [&] { started++; }, [&] { finished++; });
+    g_executed = 0;
+    std::vector<std::thread> producers;
+    for (int t = 0; t < 4; t++) {
+        producers.emplace_back([&pool] {
+            for (int i = 0; i < 500; i++) pool.add(new CountJob(&pool, 0), i % 4);
+        });
+    }
+    for (auto& producer : producers) producer.join();
+    pool.add(new CountJob(&pool, 10), 0);  // 2^11 - 1 jobs in total
+    if (!WaitClear(pool)) {
+        std::cerr << "  FAILED: pool did not drain" << std::endl;
+        return false;
+    }
+    if (g_executed.load() != 2000 + 2047) {
+        std::cerr << "  FAILED: executed " << g_executed.load() << " jobs" << std::endl;
+        return false;
+    }
+    pool.stop();
+    if (started.load() != 4 || finished.load() != 4) {
+        std::cerr << "  FAILED: thread init/exit ran " << started.load() << "/" << finished.load() << " times" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 2: queued jobs run by priority, highest first
+bool TestPriority() {
+    std::cout << "  Testing priorities..." << std::endl;
+    WorkStealingThreadPool pool;
+    pool.init(1);
+    std::atomic<bool> open{false};
+    pool.add(new GateJob(&open), 0);
+    while (pool.runningJobs() == 0) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    std::mutex lock;
+    std::vector<int> order;
+    for (int i = 0; i < 40; i++) pool.add(new RecordJob(&lock, &order, i % 4), i % 4);
+    if (pool.jobsize() != 40 || pool.jobsize(3) != 10) {
+        std::cerr << "  FAILED: queue counts " << pool.jobsize() << "/" << pool.jobsize(3) << std::endl;
+        return false;
+    }
+    open = true;
+    if (!WaitClear(pool)) {
+        std::cerr << "  FAILED: pool did not drain" << std::endl;
+        return false;
+    }
+    for (size_t i = 1; i < order.size(); i++) {
+        if (order[i] > order[i - 1]) {
+            std::cerr << "  FAILED: priority " << order[i] << " ran after " << order[i - 1] << std::endl;
+            return false;
+        }
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 3: freed job blocks are handed out again
+bool TestJobPool() {
+    std::cout << "  Testing pooled job storage..." << std::endl;
+    std::set<void*> addresses;
+    for (int round = 0; round < 100; round++) {
+        std::vector<CountJob*> jobs;
+        for (int i = 0; i < 32; i++) jobs.push_back(new CountJob(nullptr, 0));
+        for (auto* job : jobs) {
+            addresses.insert(job);
+            delete job;
+        }
+    }
+    if (addresses.size() > 32) {
+        std::cerr << "  FAILED: " << addresses.size() << " distinct blocks for 32 live jobs" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+// Test 4: parked workers take no jobs, and the ones queued behind a busy worker run once more
+// workers are let in
+bool TestSetActive() {
+    std::cout << "  Testing active worker limit..." << std::endl;
+    WorkStealingThreadPool pool;
+    pool.init(4);
+    pool.setActive(1);
+    std::atomic<bool> open{false};
+    g_executed = 0;
+    pool.add(new GateJob(&open));
+    for (int i = 0; i < 10000 && pool.runningJobs() == 0; i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    for (int i = 0; i < 100; i++) pool.add(new CountJob(&pool, 0));
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    int whileParked = g_executed.load();
+    pool.setActive(3);
+    for (int i = 0; i < 10000 && g_executed.load() < 100; i++) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    int afterUnpark = g_executed.load();
+    open = true;
+    bool clear = WaitClear(pool);
+    int active = pool.active();
+    pool.setActive(100);
+    int capped = pool.active();
+    pool.stop();
+    if (whileParked != 0 || afterUnpark != 100 || !clear || active != 3 || capped != 4) {
+        std::cerr << "  FAILED: " << whileParked << " jobs ran while parked, " << afterUnpark << " after, active " << active << ", capped " << capped << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Work Stealing Thread Pool Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestAllJobsRun();
+    testPassed = TestPriority() && testPassed;
+    testPassed = TestJobPool() && testPassed;
+    testPassed = TestSetActive() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}
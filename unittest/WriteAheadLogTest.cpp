@@ -0,0 +1,145 @@
+// Copyright (c) Microsoft Corporation. All rights reserved.
+// Licensed under the MIT License.
+
+#include "Core/SPANN/WriteAheadLog.h"
+
+#include <cstdio>
+#include <iostream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+using namespace SPTAG;
+using namespace SPTAG::SPANN;
+
+static std::vector<WriteAheadLog::Record> ReplayAll(const std::string& p_path, std::vector<std::string>* p_payloads = nullptr) {
+    std::vector<WriteAheadLog::Record> records;
+    WriteAheadLog::Replay(p_path, [&](const WriteAheadLog::Record& record) {
+        records.push_back(record);
+        if (p_payloads != nullptr)
+            p_payloads->emplace_back(record.m_payload, record.m_bytes);
+    });
+    return records;
+}
+
+// Test 1: concurrent writers share syncs and every committed record is replayed in LSN order
+bool TestGroupCommit() {
+    std::cout << "  Testing group commit..." << std::endl;
+    std::string path = "write_ahead_log_test.wal";
+    std::remove(path.c_str());
+
+    WriteAheadLog wal;
+    if (!wal.Open(path, true)) {
+        std::cerr << "  FAILED: cannot open log" << std::endl;
+        return false;
+    }
+    const int threads = 8, perThread = 200;
+    std::vector<std::thread> writers;
+    std::vector<bool> committed(threads, true);
+    for (int t = 0; t < threads; t++) {
+        writers.emplace_back([&, t]() {
+            for (int i = 0; i < perThread; i++) {
+                SizeType vid = t * perThread + i;
+                std::uint64_t lsn = (i % 4 == 3) ? wal.Append(WriteAheadLog::RecordType::Delete, vid, 1)
+                                                 : wal.Append(WriteAheadLog::RecordType::Insert, vid, 1, &vid, sizeof(vid));
+                if (!wal.Commit(lsn))
+                    committed[t] = false;
+            }
+        });
+    }
+    for (auto& writer : writers) writer.join();
+    std::uint64_t syncs = wal.SyncCount();
+    wal.Close();
+
+    std::vector<std::string> payloads;
+    auto records = ReplayAll(path, &payloads);
+    std::remove(path.c_str());
+    for (int t = 0; t < threads; t++) {
+        if (!committed[t]) {
+            std::cerr << "  FAILED: commit failed in writer " << t << std::endl;
+            return false;
+        }
+    }
+    if (records.size() != (size_t)threads * perThread) {
+        std::cerr << "  FAILED: replayed " << records.size() << " records" << std::endl;
+        return false;
+    }
+    for (size_t i = 0; i < records.size(); i++) {
+        const auto& record = records[i];
+        bool insert = record.m_type == WriteAheadLog::RecordType::Insert;
+        if (record.m_lsn != i + 1 || record.m_count != 1 || (insert && (payloads[i].size() != sizeof(SizeType) || *(SizeType*)payloads[i].data() != record.m_first))) {
+            std::cerr << "  FAILED: record " << i << " replayed wrong" << std::endl;
+            return false;
+        }
+    }
+    if (syncs >= records.size()) {
+        std::cerr << "  FAILED: " << syncs << " syncs for " << records.size() << " commits" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED (" << syncs << " syncs for " << records.size() << " commits)" << std::endl;
+    return true;
+}
+
+// Test 2: a torn record ends the log and is cut off when the log is opened again
+bool TestTornTail() {
+    std::cout << "  Testing torn tail..." << std::endl;
+    std::string path = "write_ahead_log_torn.wal";
+    std::remove(path.c_str());
+    std::vector<float> vector(16, 1.5f);
+    {
+        WriteAheadLog wal;
+        wal.Open(path, true);
+        wal.Append(WriteAheadLog::RecordType::Insert, 10, 1, vector.data(), sizeof(float) * vector.size());
+        wal.Commit(wal.Append(WriteAheadLog::RecordType::Insert, 11, 1, vector.data(), sizeof(float) * vector.size()));
+    }
+    FILE* fp = fopen(path.c_str(), "rb");
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    fclose(fp);
+    if (truncate(path.c_str(), size - 8) != 0) {
+        std::cerr << "  FAILED: cannot truncate log" << std::endl;
+        return false;
+    }
+    if (ReplayAll(path).size() != 1) {
+        std::cerr << "  FAILED: torn record was replayed" << std::endl;
+        return false;
+    }
+
+    {
+        WriteAheadLog wal;
+        wal.Open(path, false);
+        if (wal.LastLSN() != 1) {
+            std::cerr << "  FAILED: reopened log continues after LSN " << wal.LastLSN() << std::endl;
+            return false;
+        }
+        wal.Commit(wal.Append(WriteAheadLog::RecordType::Delete, 10, 1));
+    }
+    auto records = ReplayAll(path);
+    std::remove(path.c_str());
+    if (records.size() != 2 || records[1].m_type != WriteAheadLog::RecordType::Delete || records[1].m_lsn != 2) {
+        std::cerr << "  FAILED: record appended after the cut is lost" << std::endl;
+        return false;
+    }
+    std::cout << "  PASSED" << std::endl;
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    std::cout << "======================================" << std::endl;
+    std::cout << "Write Ahead Log Test" << std::endl;
+    std::cout << "======================================" << std::endl;
+
+    bool testPassed = TestGroupCommit();
+    testPassed = TestTornTail() && testPassed;
+
+    std::cout << "\n======================================" << std::endl;
+    if (testPassed) {
+        std::cout << "ALL TESTS PASSED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 0;
+    } else {
+        std::cout << "SOME TESTS FAILED" << std::endl;
+        std::cout << "======================================" << std::endl;
+        return 1;
+    }
+}